@@ -0,0 +1,381 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines AggregatingAuditDelegate, which summarizes discovery audit events of bulk reads per label, action and
+ *        location
+ * 
+ * @file aggregating_audit_delegate.h
+ */
+
+#ifndef API_MIP_AGGREGATING_AUDIT_DELEGATE_H_
+#define API_MIP_AGGREGATING_AUDIT_DELEGATE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/arena_event.h"
+#include "mip/async_diagnostic_delegate.h"
+#include "mip/audit_delegate.h"
+#include "mip/audit_event.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of an AggregatingAuditDelegate
+ */
+struct AuditAggregationSettings {
+  std::vector<std::string> eventNames = {"Discover"};                  /**< Events summarized, others pass through */
+  std::vector<std::string> groupProperties = {"LabelId", "Operation"}; /**< Properties a summary is keyed by */
+  std::string locationProperty = "ObjectId";  /**< Property of the file path or URL; its parent is the location */
+  std::vector<std::string> detailProperties = {"ObjectId", "ContentId"}; /**< Properties kept for each file */
+  std::chrono::seconds window = std::chrono::seconds(60); /**< Longest time a summary stays open */
+  size_t maxFilesPerSummary = 1000;                       /**< Files after which a summary is written early */
+  std::string summaryEventName = "DiscoverSummary";       /**< Name of the summary events */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace auditaggregation {
+
+inline void AppendJsonString(std::string& out, const std::string& value) {
+  out += '"';
+  for (char c : value) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (byte < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// Directory of a path or URL: everything before the last separator
+inline std::string GetLocation(const std::string& path) {
+  size_t separator = path.find_last_of("/\\");
+  return separator == std::string::npos ? std::string() : path.substr(0, separator);
+}
+
+inline std::string GetValue(const EventPropertyView& property) {
+  if (property.type == EventPropertyType::Int64) {
+    return std::to_string(property.int64Value);
+  }
+  if (property.type == EventPropertyType::Double) {
+    return std::to_string(property.doubleValue);
+  }
+  return property.GetString();
+}
+
+struct Group {
+  std::vector<std::pair<std::string, std::string>> keys;
+  std::vector<Pii> keyPii;
+  std::string location;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::system_clock::time_point startUtc;
+  int64_t count = 0;
+  std::string files;
+};
+
+} // namespace auditaggregation
+/** @endcond */
+
+/**
+ * @brief AuditDelegate that replaces the per-file discovery events of bulk reads with periodic summaries
+ * 
+ * @note Set as DiagnosticConfiguration::auditPipelineDelegateOverride, wrapping the audit pipeline, or in front of an
+ *       AsyncAuditDelegate so summaries are also uploaded in batches. Events named in
+ *       AuditAggregationSettings::eventNames are grouped by their groupProperties and the parent of their
+ *       locationProperty; each group is written as one summary event when its window ends, when it reaches
+ *       maxFilesPerSummary files, or on Flush. A summary carries the group's properties, Location, Count,
+ *       WindowStart (UTC, ISO 8601) and WindowSeconds, and Files: an audit-only JSON array with the detailProperties of
+ *       every file and its offset in milliseconds from WindowStart, so each file read remains attributable. Other
+ *       events pass through unchanged. Summaries are handed over through DiagnosticBatchSink::WriteEvents when the
+ *       wrapped delegate implements it.
+ */
+class AggregatingAuditDelegate : public AuditDelegate {
+public:
+  /**
+   * @brief Creates the delegate and its timer thread
+   * 
+   * @param inner Delegate the summaries and other events are written to
+   * @param settings Events summarized and how
+   */
+  explicit AggregatingAuditDelegate(
+      const std::shared_ptr<AuditDelegate>& inner,
+      const AuditAggregationSettings& settings = AuditAggregationSettings())
+      : mInner(inner),
+        mBatchSink(std::dynamic_pointer_cast<DiagnosticBatchSink<AuditEvent>>(inner)),
+        mSettings(settings) {
+    if (!mInner) {
+      throw BadInputError("AggregatingAuditDelegate requires a delegate to write to");
+    }
+    if (mSettings.window <= std::chrono::seconds::zero()) {
+      mSettings.window = std::chrono::seconds(1);
+    }
+    mSettings.maxFilesPerSummary = (std::max)(mSettings.maxFilesPerSummary, static_cast<size_t>(1));
+    mTimer = std::thread([this]() { RunTimer(); });
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~AggregatingAuditDelegate() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+      mCondition.notify_all();
+    }
+    if (mTimer.joinable()) {
+      mTimer.join();
+    }
+    Write(TakeGroups(true));
+  }
+  /** @endcond */
+
+  /**
+   * @brief Add a discovery event to its summary, or pass any other event through
+   * 
+   * @param event Event to be logged
+   */
+  void WriteEvent(const std::shared_ptr<AuditEvent>& event) override {
+    if (!event) {
+      return;
+    }
+    if (std::find(mSettings.eventNames.begin(), mSettings.eventNames.end(), event->GetName()) ==
+        mSettings.eventNames.end()) {
+      mInner->WriteEvent(event);
+      return;
+    }
+    std::vector<std::pair<std::string, std::string>> keys(mSettings.groupProperties.size());
+    std::vector<Pii> keyPii(mSettings.groupProperties.size(), Pii::None);
+    std::vector<std::string> details(mSettings.detailProperties.size());
+    std::vector<bool> hasDetail(mSettings.detailProperties.size(), false);
+    std::string location;
+    VisitEventProperties(*event, [&](const EventPropertyView& property) {
+      for (size_t i = 0; i < mSettings.groupProperties.size(); ++i) {
+        const std::string& name = mSettings.groupProperties[i];
+        if (property.HasName(name.data(), name.size())) {
+          keys[i] = std::make_pair(name, auditaggregation::GetValue(property));
+          keyPii[i] = property.pii;
+        }
+      }
+      for (size_t i = 0; i < mSettings.detailProperties.size(); ++i) {
+        const std::string& name = mSettings.detailProperties[i];
+        if (property.HasName(name.data(), name.size())) {
+          details[i] = auditaggregation::GetValue(property);
+          hasDetail[i] = true;
+        }
+      }
+      const std::string& locationName = mSettings.locationProperty;
+      if (property.HasName(locationName.data(), locationName.size())) {
+        location = auditaggregation::GetLocation(property.GetString());
+      }
+    });
+    std::string key = location;
+    for (const auto& entry : keys) {
+      key += '\n';
+      key += entry.second;
+    }
+
+    std::vector<std::shared_ptr<AuditEvent>> full;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto now = std::chrono::steady_clock::now();
+      auto found = mGroups.find(key);
+      if (found == mGroups.end()) {
+        auditaggregation::Group group;
+        group.keys = keys;
+        group.keyPii = keyPii;
+        group.location = location;
+        group.start = now;
+        group.startUtc = std::chrono::system_clock::now();
+        found = mGroups.emplace(key, std::move(group)).first;
+      }
+      auditaggregation::Group& group = found->second;
+      group.files += group.count == 0 ? '[' : ',';
+      group.files += '{';
+      for (size_t i = 0; i < details.size(); ++i) {
+        if (hasDetail[i]) {
+          auditaggregation::AppendJsonString(group.files, mSettings.detailProperties[i]);
+          group.files += ':';
+          auditaggregation::AppendJsonString(group.files, details[i]);
+          group.files += ',';
+        }
+      }
+      group.files += "\"OffsetMs\":";
+      group.files += std::to_string(
+          std::chrono::duration_cast<std::chrono::milliseconds>(now - group.start).count());
+      group.files += '}';
+      ++group.count;
+      ++mAggregatedCount;
+      if (static_cast<size_t>(group.count) >= mSettings.maxFilesPerSummary) {
+        full.push_back(CreateSummary(group));
+        mGroups.erase(found);
+      }
+    }
+    Write(full);
+  }
+
+  /**
+   * @brief Write every open summary and flush the wrapped delegate
+   */
+  void Flush() override {
+    Write(TakeGroups(true));
+    mInner->Flush();
+  }
+
+  /**
+   * @brief Passes the audit setting of the policy to the wrapped delegate
+   * 
+   * @param auditSetting audit setting present in the policy.
+   */
+  void SetEnableAuditSetting(const EnableAuditSetting auditSetting) override {
+    mInner->SetEnableAuditSetting(auditSetting);
+  }
+
+  /**
+   * @brief Get the discovery events added to summaries so far
+   */
+  uint64_t GetAggregatedCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mAggregatedCount;
+  }
+
+  /**
+   * @brief Get the summary events written so far
+   */
+  uint64_t GetSummaryCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSummaryCount;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<AuditEvent> CreateSummary(const auditaggregation::Group& group) {
+    auto summary = std::make_shared<ArenaAuditEvent>(
+        mSettings.summaryEventName, EventLevel::NecessaryServiceData, group.keys.size() + 6);
+    for (size_t i = 0; i < group.keys.size(); ++i) {
+      if (!group.keys[i].first.empty()) {
+        summary->AddProperty(group.keys[i].first, group.keys[i].second, group.keyPii[i]);
+      }
+    }
+    summary->AddAuditOnlyProperty("Location", group.location);
+    summary->AddProperty("Count", group.count, Pii::None);
+    std::time_t start = std::chrono::system_clock::to_time_t(group.startUtc);
+    std::tm utc = {};
+#ifdef _WIN32
+    gmtime_s(&utc, &start);
+#else
+    gmtime_r(&start, &utc);
+#endif
+    char startText[32];
+    std::strftime(startText, sizeof(startText), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    summary->AddProperty("WindowStart", std::string(startText), Pii::None);
+    summary->AddProperty("WindowSeconds", static_cast<int64_t>(mSettings.window.count()), Pii::None);
+    summary->AddAuditOnlyProperty("Files", group.files + "]");
+    ++mSummaryCount;
+    return summary;
+  }
+
+  // Summaries of the groups whose window has ended, or of every group
+  std::vector<std::shared_ptr<AuditEvent>> TakeGroups(bool isAll) {
+    std::vector<std::shared_ptr<AuditEvent>> summaries;
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto now = std::chrono::steady_clock::now();
+    for (auto group = mGroups.begin(); group != mGroups.end();) {
+      if (isAll || now - group->second.start >= mSettings.window) {
+        summaries.push_back(CreateSummary(group->second));
+        group = mGroups.erase(group);
+      } else {
+        ++group;
+      }
+    }
+    return summaries;
+  }
+
+  void Write(const std::vector<std::shared_ptr<AuditEvent>>& summaries) {
+    if (summaries.empty()) {
+      return;
+    }
+    if (mBatchSink) {
+      mBatchSink->WriteEvents(summaries);
+      return;
+    }
+    for (const auto& summary : summaries) {
+      mInner->WriteEvent(summary);
+    }
+  }
+
+  void RunTimer() {
+    // Checking four times per window keeps a summary at most a quarter window late
+    auto interval = (std::max)(std::chrono::duration_cast<std::chrono::milliseconds>(mSettings.window) / 4,
+        std::chrono::milliseconds(10));
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mIsStopping) {
+      mCondition.wait_for(lock, interval, [this]() { return mIsStopping; });
+      if (mIsStopping) {
+        break;
+      }
+      lock.unlock();
+      try {
+        Write(TakeGroups(false));
+      } catch (...) {
+      }
+      lock.lock();
+    }
+  }
+
+  std::shared_ptr<AuditDelegate> mInner;
+  std::shared_ptr<DiagnosticBatchSink<AuditEvent>> mBatchSink;
+  AuditAggregationSettings mSettings;
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::map<std::string, auditaggregation::Group> mGroups;
+  uint64_t mAggregatedCount = 0;
+  uint64_t mSummaryCount = 0;
+  bool mIsStopping = false;
+  std::thread mTimer;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_AGGREGATING_AUDIT_DELEGATE_H_
@@ -0,0 +1,561 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ApiProfiler, an opt-in profiling mode recording allocations, CPU time, waiting time and dispatcher
+ *        queueing delay per API call
+ * 
+ * @file api_profiler.h
+ */
+
+#ifndef API_MIP_API_PROFILER_H_
+#define API_MIP_API_PROFILER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/memory_resource.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of an ApiProfiler
+ */
+struct ApiProfilerSettings {
+  uint32_t sampleEvery = 1;                 /**< Profile one call in this many of each API, 1 to profile all */
+  std::shared_ptr<MemoryResource> upstream; /**< Allocator behind the profiler's, nullptr for the default */
+};
+
+/**
+ * @brief Totals of the profiled calls of one API
+ * 
+ * @note The totals cover sampledCalls calls; divide by it for per-call figures. waitNanoseconds is the wall time not
+ *       spent on a CPU by the call or its tasks: waiting on locks, on I/O and on the network.
+ */
+struct ApiCallStatistics {
+  std::string api;                  /**< API name passed to ApiProfiler::BeginCall */
+  uint64_t calls = 0;               /**< Calls made, sampled or not */
+  uint64_t sampledCalls = 0;        /**< Calls profiled */
+  int64_t wallNanoseconds = 0;      /**< Time from the start to the end of the calls */
+  int64_t maxWallNanoseconds = 0;   /**< Longest call */
+  int64_t cpuNanoseconds = 0;       /**< On-CPU time of the calling threads and of the calls' tasks */
+  int64_t waitNanoseconds = 0;      /**< Wall time minus on-CPU time */
+  uint64_t allocations = 0;         /**< Allocations made through the profiler's MemoryResource */
+  int64_t bytesAllocated = 0;       /**< Bytes allocated through the profiler's MemoryResource */
+  uint64_t tasks = 0;               /**< Tasks dispatched by the calls */
+  int64_t queueDelayNanoseconds = 0; /**< Time the calls' tasks waited in the dispatcher before running */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace apiprofiler {
+
+inline int64_t GetThreadCpuNanoseconds() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+  uint64_t kernelTicks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+  uint64_t userTicks = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+  return static_cast<int64_t>((kernelTicks + userTicks) * 100);
+#else
+  struct timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+inline int64_t ToNanoseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+struct Counters {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> sampledCalls{0};
+  std::atomic<int64_t> wallNanoseconds{0};
+  std::atomic<int64_t> maxWallNanoseconds{0};
+  std::atomic<int64_t> cpuNanoseconds{0};
+  std::atomic<int64_t> waitNanoseconds{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<int64_t> bytesAllocated{0};
+  std::atomic<uint64_t> tasks{0};
+  std::atomic<int64_t> queueDelayNanoseconds{0};
+};
+
+struct CallState {
+  explicit CallState(Counters* counters) : counters(counters), start(std::chrono::steady_clock::now()) {}
+  Counters* counters;
+  std::chrono::steady_clock::time_point start;
+  std::atomic<int64_t> cpuNanoseconds{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<int64_t> bytesAllocated{0};
+  std::atomic<uint64_t> tasks{0};
+  std::atomic<int64_t> queueDelayNanoseconds{0};
+};
+
+// Call the current thread works for, owned by the innermost ApiCallScope
+inline const std::shared_ptr<CallState>*& GetCurrentCall() {
+  static thread_local const std::shared_ptr<CallState>* current = nullptr;
+  return current;
+}
+
+inline void AppendJsonString(std::string& out, const std::string& value) {
+  out += '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+class ProfilingMemoryResource : public MemoryResource {
+public:
+  explicit ProfilingMemoryResource(const std::shared_ptr<MemoryResource>& upstream)
+      : mUpstream(upstream ? upstream : GetDefaultMemoryResource()) {}
+
+protected:
+  void* DoAllocate(size_t bytes, size_t alignment) override {
+    void* pointer = mUpstream->Allocate(bytes, alignment);
+    const std::shared_ptr<CallState>* call = GetCurrentCall();
+    if (call) {
+      (*call)->allocations.fetch_add(1, std::memory_order_relaxed);
+      (*call)->bytesAllocated.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    }
+    return pointer;
+  }
+
+  void DoDeallocate(void* pointer, size_t bytes, size_t alignment) override {
+    mUpstream->Deallocate(pointer, bytes, alignment);
+  }
+
+private:
+  std::shared_ptr<MemoryResource> mUpstream;
+};
+
+} // namespace apiprofiler
+/** @endcond */
+
+/**
+ * @brief Attributes the work of the current thread to an API call while it exists
+ * 
+ * @note Allocations made through the profiler's MemoryResource and the thread's on-CPU time are counted against the
+ *       call, and tasks dispatched through the profiler's TaskDispatcherDelegate are attributed to it as well. Scopes
+ *       nest; a scope must be destroyed on the thread that created it.
+ */
+class ApiCallScope {
+public:
+  /** @cond DOXYGEN_HIDE */
+  explicit ApiCallScope(const std::shared_ptr<apiprofiler::CallState>& call)
+      : mCall(call),
+        mPrevious(apiprofiler::GetCurrentCall()),
+        mCpuStart(call ? apiprofiler::GetThreadCpuNanoseconds() : 0) {
+    if (mCall) {
+      apiprofiler::GetCurrentCall() = &mCall;
+    }
+  }
+
+  ~ApiCallScope() {
+    if (mCall) {
+      mCall->cpuNanoseconds.fetch_add(apiprofiler::GetThreadCpuNanoseconds() - mCpuStart, std::memory_order_relaxed);
+      apiprofiler::GetCurrentCall() = mPrevious;
+    }
+  }
+
+  ApiCallScope(const ApiCallScope&) = delete;
+  ApiCallScope& operator=(const ApiCallScope&) = delete;
+
+private:
+  std::shared_ptr<apiprofiler::CallState> mCall;
+  const std::shared_ptr<apiprofiler::CallState>* mPrevious;
+  int64_t mCpuStart;
+  /** @endcond */
+};
+
+/**
+ * @brief One profiled API call, from ApiProfiler::BeginCall until End or destruction
+ * 
+ * @note For an asynchronous API, enter the call around the invocation and end it from the observer callback.
+ */
+class ProfiledApiCall {
+public:
+  /**
+   * @brief Attribute the work of the current thread to this call until the returned scope is destroyed
+   * 
+   * @return Scope
+   */
+  std::unique_ptr<ApiCallScope> Enter() const { return std::unique_ptr<ApiCallScope>(new ApiCallScope(mState)); }
+
+  /**
+   * @brief End the call and add it to the statistics of its API
+   * 
+   * @note Later calls have no effect.
+   */
+  void End() {
+    auto state = std::move(mState);
+    mState.reset();
+    if (!state) {
+      return;
+    }
+    apiprofiler::Counters& counters = *state->counters;
+    int64_t wall = apiprofiler::ToNanoseconds(std::chrono::steady_clock::now() - state->start);
+    int64_t cpu = state->cpuNanoseconds.load();
+    counters.sampledCalls.fetch_add(1, std::memory_order_relaxed);
+    counters.wallNanoseconds.fetch_add(wall, std::memory_order_relaxed);
+    int64_t longest = counters.maxWallNanoseconds.load(std::memory_order_relaxed);
+    while (wall > longest && !counters.maxWallNanoseconds.compare_exchange_weak(longest, wall)) {
+    }
+    counters.cpuNanoseconds.fetch_add(cpu, std::memory_order_relaxed);
+    counters.waitNanoseconds.fetch_add((std::max)(wall - cpu, static_cast<int64_t>(0)), std::memory_order_relaxed);
+    counters.allocations.fetch_add(state->allocations.load(), std::memory_order_relaxed);
+    counters.bytesAllocated.fetch_add(state->bytesAllocated.load(), std::memory_order_relaxed);
+    counters.tasks.fetch_add(state->tasks.load(), std::memory_order_relaxed);
+    counters.queueDelayNanoseconds.fetch_add(state->queueDelayNanoseconds.load(), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Whether the call is profiled, or was skipped by sampling or because profiling is disabled
+   */
+  bool IsSampled() const { return mState != nullptr; }
+
+  /** @cond DOXYGEN_HIDE */
+  explicit ProfiledApiCall(const std::shared_ptr<apiprofiler::CallState>& state) : mState(state) {}
+
+  ~ProfiledApiCall() { End(); }
+
+  ProfiledApiCall(const ProfiledApiCall&) = delete;
+  ProfiledApiCall& operator=(const ProfiledApiCall&) = delete;
+
+private:
+  std::shared_ptr<apiprofiler::CallState> mState;
+  /** @endcond */
+};
+
+/**
+ * @brief Opt-in profiler of the public API calls an application makes
+ * 
+ * @note MipContext and the SDK's internal locks live in the SDK binary, so profiling is wired in at the seams the
+ *       application controls: pass GetMemoryResource to the buffer pools and caches that take a MemoryResource, wrap
+ *       the profile's TaskDispatcherDelegate with CreateTaskDispatcherDelegate, and bracket calls such as
+ *       CreateFileHandlerAsync, ComputeActions or EncryptBuffer with BeginCall or Profile. Only those buffers and
+ *       caches are allocated through the MemoryResource, and time blocked on internal mutexes is reported within
+ *       ApiCallStatistics::waitNanoseconds. A profiled call costs two thread CPU clock reads per scope and task
+ *       and a few relaxed atomic additions; raise sampleEvery where that is too much.
+ */
+class ApiProfiler : public std::enable_shared_from_this<ApiProfiler> {
+public:
+  /**
+   * @brief Create a profiler
+   * 
+   * @param settings Sampling and upstream allocator
+   * 
+   * @return Profiler, enabled
+   */
+  static std::shared_ptr<ApiProfiler> Create(const ApiProfilerSettings& settings = ApiProfilerSettings()) {
+    return std::shared_ptr<ApiProfiler>(new ApiProfiler(settings));
+  }
+
+  /**
+   * @brief Enable or disable profiling; while disabled, calls are neither profiled nor counted
+   * 
+   * @param isEnabled Whether calls are profiled
+   */
+  void SetEnabled(bool isEnabled) { mIsEnabled = isEnabled; }
+
+  /**
+   * @brief Whether calls are profiled
+   */
+  bool IsEnabled() const { return mIsEnabled; }
+
+  /**
+   * @brief Get the allocator that attributes allocations to the current call, e.g. for FixedSizeBufferPool
+   * 
+   * @return Memory resource
+   */
+  const std::shared_ptr<MemoryResource>& GetMemoryResource() const { return mMemoryResource; }
+
+  /**
+   * @brief Wrap a dispatcher so that tasks inherit the call they are dispatched from
+   * 
+   * @param inner Dispatcher running the tasks
+   * 
+   * @return Dispatcher to set on the profile
+   */
+  std::shared_ptr<TaskDispatcherDelegate> CreateTaskDispatcherDelegate(
+      const std::shared_ptr<TaskDispatcherDelegate>& inner);
+
+  /**
+   * @brief Begin a call of an API
+   * 
+   * @param api API name, e.g. "ComputeActions"
+   * 
+   * @return Call, ended by ProfiledApiCall::End or on destruction
+   */
+  std::shared_ptr<ProfiledApiCall> BeginCall(const std::string& api) {
+    if (!mIsEnabled) {
+      return std::make_shared<ProfiledApiCall>(nullptr);
+    }
+    apiprofiler::Counters* counters = GetCounters(api);
+    uint64_t call = counters->calls.fetch_add(1, std::memory_order_relaxed);
+    if (call % mSampleEvery != 0) {
+      return std::make_shared<ProfiledApiCall>(nullptr);
+    }
+    return std::make_shared<ProfiledApiCall>(std::make_shared<apiprofiler::CallState>(counters));
+  }
+
+  /**
+   * @brief Profile a synchronous call
+   * 
+   * @param api API name, e.g. "ComputeActions"
+   * @param function Function making the call
+   * 
+   * @return Result of @p function
+   */
+  template <typename Function>
+  auto Profile(const std::string& api, Function&& function) -> decltype(function()) {
+    auto call = BeginCall(api);
+    auto scope = call->Enter();
+    return function();
+  }
+
+  /**
+   * @brief Get the statistics of every API called so far
+   * 
+   * @return Statistics ordered by API name
+   */
+  std::vector<ApiCallStatistics> GetStatistics() const {
+    std::vector<ApiCallStatistics> statistics;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& entry : mCounters) {
+      const apiprofiler::Counters& counters = *entry.second;
+      ApiCallStatistics api;
+      api.api = entry.first;
+      api.calls = counters.calls.load();
+      api.sampledCalls = counters.sampledCalls.load();
+      api.wallNanoseconds = counters.wallNanoseconds.load();
+      api.maxWallNanoseconds = counters.maxWallNanoseconds.load();
+      api.cpuNanoseconds = counters.cpuNanoseconds.load();
+      api.waitNanoseconds = counters.waitNanoseconds.load();
+      api.allocations = counters.allocations.load();
+      api.bytesAllocated = counters.bytesAllocated.load();
+      api.tasks = counters.tasks.load();
+      api.queueDelayNanoseconds = counters.queueDelayNanoseconds.load();
+      statistics.push_back(std::move(api));
+    }
+    return statistics;
+  }
+
+  /**
+   * @brief Dump a snapshot of the statistics as JSON
+   * 
+   * @return JSON object with an "apis" array of ApiCallStatistics, times in nanoseconds
+   */
+  std::string ToJson() const {
+    std::string json = "{\"sampleEvery\":" + std::to_string(mSampleEvery) + ",\"apis\":[";
+    bool isFirst = true;
+    for (const auto& api : GetStatistics()) {
+      json += isFirst ? "{\"api\":" : ",{\"api\":";
+      isFirst = false;
+      apiprofiler::AppendJsonString(json, api.api);
+      json += ",\"calls\":" + std::to_string(api.calls);
+      json += ",\"sampledCalls\":" + std::to_string(api.sampledCalls);
+      json += ",\"wallNs\":" + std::to_string(api.wallNanoseconds);
+      json += ",\"maxWallNs\":" + std::to_string(api.maxWallNanoseconds);
+      json += ",\"cpuNs\":" + std::to_string(api.cpuNanoseconds);
+      json += ",\"waitNs\":" + std::to_string(api.waitNanoseconds);
+      json += ",\"allocations\":" + std::to_string(api.allocations);
+      json += ",\"bytesAllocated\":" + std::to_string(api.bytesAllocated);
+      json += ",\"tasks\":" + std::to_string(api.tasks);
+      json += ",\"queueDelayNs\":" + std::to_string(api.queueDelayNanoseconds);
+      json += '}';
+    }
+    return json + "]}";
+  }
+
+  /**
+   * @brief Clear the statistics
+   * 
+   * @note Calls in progress are still added when they end.
+   */
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& entry : mCounters) {
+      apiprofiler::Counters& counters = *entry.second;
+      counters.calls = 0;
+      counters.sampledCalls = 0;
+      counters.wallNanoseconds = 0;
+      counters.maxWallNanoseconds = 0;
+      counters.cpuNanoseconds = 0;
+      counters.waitNanoseconds = 0;
+      counters.allocations = 0;
+      counters.bytesAllocated = 0;
+      counters.tasks = 0;
+      counters.queueDelayNanoseconds = 0;
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  explicit ApiProfiler(const ApiProfilerSettings& settings)
+      : mSampleEvery((std::max)(settings.sampleEvery, static_cast<uint32_t>(1))),
+        mMemoryResource(std::make_shared<apiprofiler::ProfilingMemoryResource>(settings.upstream)) {}
+
+  apiprofiler::Counters* GetCounters(const std::string& api) {
+    // Counters are never removed, so the pointer stays valid for the lifetime of the profiler
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& counters = mCounters[api];
+    if (!counters) {
+      counters.reset(new apiprofiler::Counters());
+    }
+    return counters.get();
+  }
+
+  uint32_t mSampleEvery;
+  std::atomic<bool> mIsEnabled{true};
+  std::shared_ptr<MemoryResource> mMemoryResource;
+  mutable std::mutex mMutex;
+  std::map<std::string, std::unique_ptr<apiprofiler::Counters>> mCounters;
+  /** @endcond */
+};
+
+/**
+ * @brief TaskDispatcherDelegate decorator attributing tasks to the API call they are dispatched from
+ * 
+ * @note A task dispatched while an ApiCallScope is current runs within a scope of the same call, so its on-CPU time,
+ *       its allocations and the tasks it dispatches in turn are counted against the call, together with the time it
+ *       waited to start beyond its requested delay. Other tasks are passed through untouched.
+ */
+class ProfilingTaskDispatcherDelegate : public TaskDispatcherDelegate {
+public:
+  /**
+   * @brief Creates the decorator
+   * 
+   * @param inner Dispatcher running the tasks
+   * @param profiler Profiler the calls belong to, kept alive by the decorator
+   */
+  ProfilingTaskDispatcherDelegate(const std::shared_ptr<TaskDispatcherDelegate>& inner,
+      const std::shared_ptr<ApiProfiler>& profiler)
+      : mInner(inner),
+        mProfiler(profiler) {
+    if (!mInner || !mProfiler) {
+      throw BadInputError("ProfilingTaskDispatcherDelegate requires a dispatcher and a profiler");
+    }
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    mInner->DispatchTask(taskId, Wrap(std::move(task), 0));
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->DispatchTask(taskId, Wrap(std::move(task), 0), loggerContext);
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    mInner->DispatchTask(taskId, Wrap(std::move(task), delaySeconds), delaySeconds);
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->DispatchTask(taskId, Wrap(std::move(task), delaySeconds), delaySeconds, loggerContext);
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    mInner->ExecuteTaskOnIndependentThread(taskId, Wrap(std::move(task), 0));
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->ExecuteTaskOnIndependentThread(taskId, Wrap(std::move(task), 0), loggerContext);
+  }
+
+  bool CancelTask(const std::string& taskId) override { return mInner->CancelTask(taskId); }
+
+  bool CancelTask(const std::string& taskId, const std::shared_ptr<void>& loggerContext) override {
+    return mInner->CancelTask(taskId, loggerContext);
+  }
+
+  void CancelAllTasks() override { mInner->CancelAllTasks(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static std::function<void()> Wrap(std::function<void()> task, int64_t delaySeconds) {
+    const std::shared_ptr<apiprofiler::CallState>* current = apiprofiler::GetCurrentCall();
+    if (!current) {
+      return task;
+    }
+    std::shared_ptr<apiprofiler::CallState> call = *current;
+    call->tasks.fetch_add(1, std::memory_order_relaxed);
+    auto due = std::chrono::steady_clock::now() +
+        std::chrono::seconds((std::max)(delaySeconds, static_cast<int64_t>(0)));
+    return [call, due, task]() {
+      int64_t delay = apiprofiler::ToNanoseconds(std::chrono::steady_clock::now() - due);
+      call->queueDelayNanoseconds.fetch_add((std::max)(delay, static_cast<int64_t>(0)), std::memory_order_relaxed);
+      ApiCallScope scope(call);
+      task();
+    };
+  }
+
+  std::shared_ptr<TaskDispatcherDelegate> mInner;
+  std::shared_ptr<ApiProfiler> mProfiler;
+  /** @endcond */
+};
+
+inline std::shared_ptr<TaskDispatcherDelegate> ApiProfiler::CreateTaskDispatcherDelegate(
+    const std::shared_ptr<TaskDispatcherDelegate>& inner) {
+  return std::make_shared<ProfilingTaskDispatcherDelegate>(inner, shared_from_this());
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_API_PROFILER_H_
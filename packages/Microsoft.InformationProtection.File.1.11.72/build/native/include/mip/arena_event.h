@@ -0,0 +1,370 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines audit/telemetry events that keep their properties in an event-scoped arena, and a non-copying
+ *        property visitor
+ * 
+ * @file arena_event.h
+ */
+
+#ifndef API_MIP_ARENA_EVENT_H_
+#define API_MIP_ARENA_EVENT_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/audit_event.h"
+#include "mip/diagnostic_types.h"
+#include "mip/event.h"
+#include "mip/event_property.h"
+#include "mip/mip_namespace.h"
+#include "mip/telemetry_event.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A property of an event, pointing into storage owned by the event
+ * 
+ * @note Valid until the event is destroyed or the property is replaced.
+ */
+struct EventPropertyView {
+  EventPropertyType type = EventPropertyType::String; /**< Which of the values is set */
+  Pii pii = Pii::None;                                /**< PII classification */
+  bool isAuditOnly = false;                           /**< If the property is restricted to the audit pipeline */
+  const char* name = "";                              /**< Name, not null terminated */
+  size_t nameSize = 0;                                /**< Size of the name */
+  double doubleValue = 0;                             /**< Value of a Double property */
+  int64_t int64Value = 0;                             /**< Value of an Int64 property */
+  const char* stringData = "";                        /**< Value of a String property, not null terminated */
+  size_t stringSize = 0;                              /**< Size of the value of a String property */
+
+  /**
+   * @brief Get if the property has a name
+   */
+  bool HasName(const char* other, size_t otherSize) const {
+    return nameSize == otherSize && std::memcmp(name, other, otherSize) == 0;
+  }
+
+  /**
+   * @brief Get a copy of the name
+   */
+  std::string GetName() const { return std::string(name, nameSize); }
+
+  /**
+   * @brief Get a copy of the value of a String property
+   */
+  std::string GetString() const { return std::string(stringData, stringSize); }
+};
+
+/**
+ * @brief Interface an event also implements to expose its properties without copying them
+ * 
+ * @note Use VisitEventProperties, which falls back to Event::GetProperties for other events.
+ */
+class EventPropertySource {
+public:
+  /**
+   * @brief Calls a function for each property, in the order they were added
+   * 
+   * @param visit Function receiving each property
+   */
+  virtual void VisitProperties(const std::function<void(const EventPropertyView&)>& visit) const = 0;
+
+  /**
+   * @brief Get the number of properties
+   */
+  virtual size_t GetPropertyCount() const = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~EventPropertySource() {}
+protected:
+  EventPropertySource() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Calls a function for each property of an event
+ * 
+ * @param event Event, for example one passed to DiagnosticDelegate::WriteEvent
+ * @param visit Function receiving each property
+ * 
+ * @note Does not copy the properties of an event implementing EventPropertySource, such as ArenaTelemetryEvent and
+ *       ArenaAuditEvent. Other events go through Event::GetProperties.
+ */
+inline void VisitEventProperties(const Event& event, const std::function<void(const EventPropertyView&)>& visit) {
+  auto source = dynamic_cast<const EventPropertySource*>(&event);
+  if (source) {
+    source->VisitProperties(visit);
+    return;
+  }
+  for (const auto& property : event.GetProperties()) {
+    EventPropertyView view;
+    view.type = property->GetPropertyType();
+    view.pii = property->GetPii();
+    view.isAuditOnly = property->IsAuditOnly();
+    const std::string& name = property->GetName();
+    view.name = name.data();
+    view.nameSize = name.size();
+    if (view.type == EventPropertyType::Double) {
+      view.doubleValue = property->GetDouble();
+    } else if (view.type == EventPropertyType::Int64) {
+      view.int64Value = property->GetInt64();
+    } else {
+      const std::string& value = property->GetString();
+      view.stringData = value.data();
+      view.stringSize = value.size();
+    }
+    visit(view);
+  }
+}
+
+/** @cond DOXYGEN_HIDE */
+namespace eventarena {
+
+// Bump allocator: the first kilobyte lives in the event itself, larger needs take 4 KB blocks that are freed with it
+class Arena {
+public:
+  Arena() : mCursor(mInline), mRemaining(kInlineSize) {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  const char* Copy(const char* data, size_t size) {
+    if (size == 0) {
+      return "";
+    }
+    if (size > mRemaining) {
+      size_t blockSize = size > kBlockSize ? size : kBlockSize;
+      mBlocks.emplace_back(new char[blockSize]);
+      mCursor = mBlocks.back().get();
+      mRemaining = blockSize;
+    }
+    char* copy = mCursor;
+    std::memcpy(copy, data, size);
+    mCursor += size;
+    mRemaining -= size;
+    return copy;
+  }
+
+private:
+  static const size_t kInlineSize = 1024;
+  static const size_t kBlockSize = 4096;
+
+  char mInline[kInlineSize];
+  char* mCursor;
+  size_t mRemaining;
+  std::vector<std::unique_ptr<char[]>> mBlocks;
+};
+
+// Standalone copy handed out by Event::GetProperties and Event::GetProperty
+class Property : public EventProperty {
+public:
+  explicit Property(const EventPropertyView& view)
+      : mView(view),
+        mName(view.GetName()),
+        mString(view.GetString()) {}
+
+  EventPropertyType GetPropertyType() const override { return mView.type; }
+  const std::string& GetName() const override { return mName; }
+  Pii GetPii() const override { return mView.pii; }
+  bool IsAuditOnly() const override { return mView.isAuditOnly; }
+  double GetDouble() const override { return mView.doubleValue; }
+  int64_t GetInt64() const override { return mView.int64Value; }
+  const std::string& GetString() const override { return mString; }
+
+private:
+  EventPropertyView mView;
+  std::string mName;
+  std::string mString;
+};
+
+} // namespace eventarena
+/** @endcond */
+
+/**
+ * @brief Event that stores its properties inline and their names and string values in an event-scoped arena
+ * 
+ * @note Adding a property copies its name and value into the arena instead of allocating an EventProperty, so an
+ *       event with a few dozen properties allocates about twice. Adding a property with the name of an existing one
+ *       replaces it. Bool properties are stored as Int64 0 or 1. Read the properties with VisitEventProperties or
+ *       FindProperty; GetProperties and GetProperty still work but copy. Base is TelemetryEvent or AuditEvent, use
+ *       ArenaTelemetryEvent or ArenaAuditEvent.
+ */
+template <class Base>
+class ArenaEvent : public Base, public EventPropertySource {
+public:
+  /**
+   * @brief Creates an event starting now
+   * 
+   * @param name Event name
+   * @param level Event level
+   * @param expectedPropertyCount Properties room is reserved for
+   */
+  ArenaEvent(const std::string& name, EventLevel level, size_t expectedPropertyCount = 32)
+      : mName(name),
+        mLevel(level),
+        mStartTime(std::chrono::steady_clock::now()) {
+    mProperties.reserve(expectedPropertyCount);
+  }
+
+  const std::string& GetName() const override { return mName; }
+  EventLevel GetLevel() const override { return mLevel; }
+  const std::chrono::steady_clock::time_point& GetStartTime() const override { return mStartTime; }
+
+  void AddProperty(const std::shared_ptr<EventProperty>& prop) override {
+    if (!prop) {
+      return;
+    }
+    EventPropertyView view;
+    view.type = prop->GetPropertyType();
+    view.pii = prop->GetPii();
+    view.isAuditOnly = prop->IsAuditOnly();
+    view.doubleValue = view.type == EventPropertyType::Double ? prop->GetDouble() : 0;
+    view.int64Value = view.type == EventPropertyType::Int64 ? prop->GetInt64() : 0;
+    const std::string& value = view.type == EventPropertyType::String ? prop->GetString() : EmptyString();
+    Set(prop->GetName(), view, value.data(), value.size());
+  }
+
+  void AddProperty(const std::string& name, bool value) override {
+    EventPropertyView view;
+    view.type = EventPropertyType::Int64;
+    view.int64Value = value ? 1 : 0;
+    Set(name, view, nullptr, 0);
+  }
+
+  void AddProperty(const std::string& name, double value, Pii pii) override {
+    EventPropertyView view;
+    view.type = EventPropertyType::Double;
+    view.pii = pii;
+    view.doubleValue = value;
+    Set(name, view, nullptr, 0);
+  }
+
+  void AddProperty(const std::string& name, int64_t value, Pii pii) override {
+    EventPropertyView view;
+    view.type = EventPropertyType::Int64;
+    view.pii = pii;
+    view.int64Value = value;
+    Set(name, view, nullptr, 0);
+  }
+
+  void AddProperty(const std::string& name, const std::string& value, Pii pii) override {
+    EventPropertyView view;
+    view.pii = pii;
+    Set(name, view, value.data(), value.size());
+  }
+
+  void AddAuditOnlyProperty(const std::string& name, const std::string& value) override {
+    EventPropertyView view;
+    view.isAuditOnly = true;
+    Set(name, view, value.data(), value.size());
+  }
+
+  std::vector<std::shared_ptr<EventProperty>> GetProperties() const override {
+    std::vector<std::shared_ptr<EventProperty>> properties;
+    properties.reserve(mProperties.size());
+    for (const auto& property : mProperties) {
+      properties.push_back(std::make_shared<eventarena::Property>(property));
+    }
+    return properties;
+  }
+
+  std::shared_ptr<EventProperty> GetProperty(const std::string& name) override {
+    auto property = FindProperty(name);
+    return property ? std::make_shared<eventarena::Property>(*property) : nullptr;
+  }
+
+  void VisitProperties(const std::function<void(const EventPropertyView&)>& visit) const override {
+    for (const auto& property : mProperties) {
+      visit(property);
+    }
+  }
+
+  size_t GetPropertyCount() const override { return mProperties.size(); }
+
+  /**
+   * @brief Get a property without copying it
+   * 
+   * @param name Name of the property
+   * 
+   * @return The property, or nullptr if none. Valid until the event is destroyed or the property is replaced.
+   */
+  const EventPropertyView* FindProperty(const std::string& name) const {
+    for (const auto& property : mProperties) {
+      if (property.HasName(name.data(), name.size())) {
+        return &property;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  static const std::string& EmptyString() {
+    static const std::string empty;
+    return empty;
+  }
+
+  void Set(const std::string& name, EventPropertyView& view, const char* value, size_t valueSize) {
+    view.stringData = mArena.Copy(value, valueSize);
+    view.stringSize = valueSize;
+    for (auto& property : mProperties) {
+      if (property.HasName(name.data(), name.size())) {
+        view.name = property.name;
+        view.nameSize = property.nameSize;
+        property = view;
+        return;
+      }
+    }
+    view.name = mArena.Copy(name.data(), name.size());
+    view.nameSize = name.size();
+    mProperties.push_back(view);
+  }
+
+  std::string mName;
+  EventLevel mLevel;
+  std::chrono::steady_clock::time_point mStartTime;
+  eventarena::Arena mArena;
+  std::vector<EventPropertyView> mProperties;
+};
+
+/**
+ * @brief Telemetry event with arena-backed properties
+ */
+using ArenaTelemetryEvent = ArenaEvent<TelemetryEvent>;
+
+/**
+ * @brief Audit event with arena-backed properties
+ */
+using ArenaAuditEvent = ArenaEvent<AuditEvent>;
+
+MIP_NAMESPACE_END
+#endif // API_MIP_ARENA_EVENT_H_
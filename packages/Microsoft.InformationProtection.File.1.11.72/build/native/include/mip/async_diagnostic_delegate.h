@@ -0,0 +1,389 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines delegates that sample, queue and batch audit/telemetry events in front of another delegate
+ * 
+ * @file async_diagnostic_delegate.h
+ */
+
+#ifndef API_MIP_ASYNC_DIAGNOSTIC_DELEGATE_H_
+#define API_MIP_ASYNC_DIAGNOSTIC_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/audit_delegate.h"
+#include "mip/diagnostic_delegate.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/telemetry_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Interface a diagnostic delegate also implements to receive events in batches
+ * 
+ * @note AsyncTelemetryDelegate and AsyncAuditDelegate call WriteEvents instead of DiagnosticDelegate::WriteEvent on
+ *       a wrapped delegate that implements it.
+ */
+template <class T>
+class DiagnosticBatchSink {
+public:
+  /**
+   * @brief Log a batch of diagnostic events
+   * 
+   * @param events Events to be logged, in the order they were written
+   */
+  virtual void WriteEvents(const std::vector<std::shared_ptr<T>>& events) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~DiagnosticBatchSink() {}
+protected:
+  DiagnosticBatchSink() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Settings for AsyncTelemetryDelegate and AsyncAuditDelegate
+ */
+struct AsyncDiagnosticSettings {
+  size_t maxBatchSize = 256;     /**< Events handed to the wrapped delegate at once */
+  size_t queueCapacity = 10000;  /**< Events waiting to be written, more are dropped */
+  std::chrono::milliseconds flushInterval = std::chrono::milliseconds(1000); /**< Longest wait before a write */
+  double defaultSampleRate = 1.0; /**< Share of the events kept, from 0 to 1 */
+  std::map<std::string, double> sampleRates; /**< Share of the events kept per event name, overrides the default */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace asyncdiagnostic {
+
+// Keeps every event whose running total of the rate crosses an integer, so a rate of 0.25 keeps every fourth event
+// instead of a random quarter
+class Sampler {
+public:
+  void Configure(double defaultRate, const std::map<std::string, double>& rates) {
+    mDefaultRate = Clamp(defaultRate);
+    for (const auto& rate : rates) {
+      mStates[rate.first].rate = Clamp(rate.second);
+    }
+  }
+
+  bool IsSampledIn(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mStates.find(name);
+    if (found == mStates.end()) {
+      if (mDefaultRate >= 1.0) {
+        return true;
+      }
+      found = mStates.emplace(name, State{mDefaultRate, 0.0}).first;
+    }
+    State& state = found->second;
+    if (state.rate >= 1.0) {
+      return true;
+    }
+    state.total += state.rate;
+    if (state.total >= 1.0) {
+      state.total -= 1.0;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct State {
+    double rate;
+    double total;
+  };
+
+  static double Clamp(double rate) { return (std::min)((std::max)(rate, 0.0), 1.0); }
+
+  std::mutex mMutex;
+  double mDefaultRate = 1.0;
+  std::unordered_map<std::string, State> mStates;
+};
+
+} // namespace asyncdiagnostic
+/** @endcond */
+
+/**
+ * @brief Diagnostic delegate that samples events, queues them and writes them in batches on a background thread
+ * 
+ * @note Base is TelemetryDelegate or AuditDelegate, use AsyncTelemetryDelegate or AsyncAuditDelegate. WriteEvent
+ *       decides sampling from the event name, appends a kept event to a bounded queue and returns; a single writer
+ *       thread hands the queue to the wrapped delegate in batches of up to AsyncDiagnosticSettings::maxBatchSize,
+ *       through DiagnosticBatchSink::WriteEvents when the wrapped delegate implements it. Events that do not fit in
+ *       the queue are dropped and counted.
+ */
+template <class Base, class T>
+class AsyncDiagnosticDelegate : public Base {
+public:
+  /**
+   * @brief Log a diagnostic event, unless it is sampled out or the queue is full
+   * 
+   * @param event Event to be logged
+   */
+  void WriteEvent(const std::shared_ptr<T>& event) override {
+    if (!event) {
+      return;
+    }
+    if (!ShouldWrite(event->GetName())) {
+      ++mSampledOutCount;
+      return;
+    }
+    Enqueue(event);
+  }
+
+  /**
+   * @brief Writes the queued events and flushes the wrapped delegate
+   */
+  void Flush() override {
+    std::unique_lock<std::mutex> lock(mMutex);
+    uint64_t generation = ++mFlushRequested;
+    mCondition.notify_all();
+    mFlushedCondition.wait(lock, [this, generation] { return mFlushCompleted >= generation; });
+  }
+
+  /**
+   * @brief Get if an event of a name would be kept by sampling, consuming its sampling slot
+   * 
+   * @param name Event name
+   * 
+   * @return true if the event should be built and written
+   * 
+   * @note Lets the code creating an event skip building it. Such an event must then be passed to WriteEvent through
+   *       WriteSampledEvent, which does not sample again.
+   */
+  bool ShouldWrite(const std::string& name) { return mSampler.IsSampledIn(name); }
+
+  /**
+   * @brief Log an event that ShouldWrite already kept
+   * 
+   * @param event Event to be logged
+   */
+  void WriteSampledEvent(const std::shared_ptr<T>& event) {
+    if (event) {
+      Enqueue(event);
+    }
+  }
+
+  /**
+   * @brief Get the events discarded because the queue was full
+   */
+  uint64_t GetDroppedCount() const { return mDroppedCount.load(); }
+
+  /**
+   * @brief Get the events discarded by sampling
+   */
+  uint64_t GetSampledOutCount() const { return mSampledOutCount.load(); }
+
+  /**
+   * @brief Get the events handed to the wrapped delegate
+   */
+  uint64_t GetWrittenCount() const { return mWrittenCount.load(); }
+
+  /**
+   * @brief Get the events waiting to be written
+   */
+  size_t GetQueuedCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size();
+  }
+
+  /**
+   * @brief Get the wrapped delegate
+   */
+  const std::shared_ptr<Base>& GetInner() const { return mInner; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~AsyncDiagnosticDelegate() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+      mCondition.notify_all();
+    }
+    if (mWriter.joinable()) {
+      mWriter.join();
+    }
+  }
+
+protected:
+  AsyncDiagnosticDelegate(const std::shared_ptr<Base>& inner, const AsyncDiagnosticSettings& settings)
+      : mInner(inner),
+        mBatchSink(std::dynamic_pointer_cast<DiagnosticBatchSink<T>>(inner)),
+        mSettings(settings) {
+    if (!mInner) {
+      throw BadInputError("AsyncDiagnosticDelegate requires a delegate to write to");
+    }
+    mSettings.maxBatchSize = (std::max)(mSettings.maxBatchSize, static_cast<size_t>(1));
+    mSettings.queueCapacity = (std::max)(mSettings.queueCapacity, static_cast<size_t>(1));
+    if (mSettings.flushInterval <= std::chrono::milliseconds::zero()) {
+      mSettings.flushInterval = std::chrono::milliseconds(1);
+    }
+    mSampler.Configure(mSettings.defaultSampleRate, mSettings.sampleRates);
+    mWriter = std::thread([this]() { RunWriter(); });
+  }
+
+private:
+  void Enqueue(const std::shared_ptr<T>& event) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mQueue.size() >= mSettings.queueCapacity) {
+      ++mDroppedCount;
+      return;
+    }
+    mQueue.push_back(event);
+    if (mQueue.size() == mSettings.maxBatchSize) {
+      mCondition.notify_all();
+    }
+  }
+
+  void RunWriter() {
+    std::vector<std::shared_ptr<T>> batch;
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+      mCondition.wait_for(lock, mSettings.flushInterval, [this] {
+        return mIsStopping || mQueue.size() >= mSettings.maxBatchSize || mFlushRequested > mFlushCompleted;
+      });
+      uint64_t generation = mFlushRequested;
+      bool isStopping = mIsStopping;
+      bool isFlushing = generation > mFlushCompleted || isStopping;
+      while (!mQueue.empty()) {
+        size_t count = (std::min)(mQueue.size(), mSettings.maxBatchSize);
+        batch.assign(mQueue.begin(), mQueue.begin() + count);
+        mQueue.erase(mQueue.begin(), mQueue.begin() + count);
+        lock.unlock();
+        Write(batch);
+        batch.clear();
+        lock.lock();
+      }
+      if (isFlushing) {
+        lock.unlock();
+        try {
+          mInner->Flush();
+        } catch (...) {
+        }
+        lock.lock();
+        mFlushCompleted = (std::max)(mFlushCompleted, generation);
+        mFlushedCondition.notify_all();
+      }
+      if (isStopping) {
+        return;
+      }
+    }
+  }
+
+  void Write(const std::vector<std::shared_ptr<T>>& batch) {
+    try {
+      if (mBatchSink) {
+        mBatchSink->WriteEvents(batch);
+      } else {
+        for (const auto& event : batch) {
+          mInner->WriteEvent(event);
+        }
+      }
+      mWrittenCount += batch.size();
+    } catch (...) {
+      mDroppedCount += batch.size();
+    }
+  }
+
+  std::shared_ptr<Base> mInner;
+  std::shared_ptr<DiagnosticBatchSink<T>> mBatchSink;
+  AsyncDiagnosticSettings mSettings;
+  asyncdiagnostic::Sampler mSampler;
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::condition_variable mFlushedCondition;
+  std::deque<std::shared_ptr<T>> mQueue;
+  bool mIsStopping = false;
+  uint64_t mFlushRequested = 0;
+  uint64_t mFlushCompleted = 0;
+  std::atomic<uint64_t> mDroppedCount{0};
+  std::atomic<uint64_t> mSampledOutCount{0};
+  std::atomic<uint64_t> mWrittenCount{0};
+  std::thread mWriter;
+  /** @endcond */
+};
+
+/**
+ * @brief TelemetryDelegate that samples, queues and batches events in front of another TelemetryDelegate
+ * 
+ * @note Set as DiagnosticConfiguration::telemetryPipelineDelegateOverride.
+ */
+class AsyncTelemetryDelegate : public AsyncDiagnosticDelegate<TelemetryDelegate, TelemetryEvent> {
+public:
+  /**
+   * @brief Creates the delegate and its writer thread
+   * 
+   * @param inner Delegate the events are written to
+   * @param settings Batching, queue and sampling settings
+   */
+  explicit AsyncTelemetryDelegate(const std::shared_ptr<TelemetryDelegate>& inner,
+      const AsyncDiagnosticSettings& settings = AsyncDiagnosticSettings())
+      : AsyncDiagnosticDelegate<TelemetryDelegate, TelemetryEvent>(inner, settings) {}
+};
+
+/**
+ * @brief AuditDelegate that samples, queues and batches events in front of another AuditDelegate
+ * 
+ * @note Set as DiagnosticConfiguration::auditPipelineDelegateOverride. Audit events are usually required in full:
+ *       leave the sample rates of audit event names at 1.
+ */
+class AsyncAuditDelegate : public AsyncDiagnosticDelegate<AuditDelegate, AuditEvent> {
+public:
+  /**
+   * @brief Creates the delegate and its writer thread
+   * 
+   * @param inner Delegate the events are written to
+   * @param settings Batching, queue and sampling settings
+   */
+  explicit AsyncAuditDelegate(const std::shared_ptr<AuditDelegate>& inner,
+      const AsyncDiagnosticSettings& settings = AsyncDiagnosticSettings())
+      : AsyncDiagnosticDelegate<AuditDelegate, AuditEvent>(inner, settings) {}
+
+  /**
+   * @brief Passes the audit setting of the policy to the wrapped delegate
+   * 
+   * @param auditSetting audit setting present in the policy.
+   */
+  void SetEnableAuditSetting(const EnableAuditSetting auditSetting) override {
+    GetInner()->SetEnableAuditSetting(auditSetting);
+  }
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_ASYNC_DIAGNOSTIC_DELEGATE_H_
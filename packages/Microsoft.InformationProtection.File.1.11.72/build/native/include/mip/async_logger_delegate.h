@@ -0,0 +1,675 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines AsyncLoggerDelegate, a LoggerDelegate that writes on a background thread
+ * 
+ * @file async_logger_delegate.h
+ */
+
+#ifndef API_MIP_ASYNC_LOGGER_DELEGATE_H_
+#define API_MIP_ASYNC_LOGGER_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/binary_log.h"
+#include "mip/logger_delegate.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief What AsyncLoggerDelegate does with a log statement when the calling thread's buffer is full
+ */
+enum class AsyncLoggerOverflowPolicy : unsigned int {
+  Drop  = 0, /**< Discard the statement and count it in AsyncLoggerDelegate::GetDroppedCount */
+  Block = 1, /**< Wait for the background writer to make room */
+};
+
+/**
+ * @brief Format of the file written by AsyncLoggerDelegate
+ */
+enum class AsyncLogFormat : unsigned int {
+  Text   = 0, /**< One tab separated line per statement */
+  Binary = 1, /**< Records described in binary_log.h, converted to text by DecodeBinaryLog */
+};
+
+/**
+ * @brief Settings for AsyncLoggerDelegate
+ */
+struct AsyncLoggerSettings {
+  LogLevel thresholdLevel = LogLevel::Trace; /**< Statements below this level return at once */
+  size_t ringCapacity = 4096; /**< Statements buffered per logging thread, rounded up to a power of two */
+  AsyncLoggerOverflowPolicy overflowPolicy = AsyncLoggerOverflowPolicy::Drop; /**< Behavior when a ring is full */
+  std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100); /**< Longest wait before a write */
+  std::shared_ptr<LoggerDelegate> sink; /**< Receives the statements on the writer thread, a file if not set */
+  AsyncLogFormat format = AsyncLogFormat::Text; /**< Format of the file, ignored with a sink */
+  std::string fileName; /**< File in the storage path used without a sink, mip_sdk.miplog(b) if empty */
+  int64_t maxFileSize = 64 * 1024 * 1024; /**< Size at which the file is rotated, 0 to let it grow without limit */
+  size_t maxRotatedFiles = 3; /**< Rotated files kept as name.1 (newest) to name.N; 0 discards the full file */
+  bool isLazyStart = true; /**< Open the output and start the writer at the first kept statement, not in Init */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace asynclogger {
+
+struct Entry {
+  LogLevel level = LogLevel::Trace;
+  int32_t line = 0;
+  uint64_t sequence = 0;
+  uint64_t threadId = 0;
+  const char* format = nullptr;
+  std::chrono::system_clock::time_point time;
+  std::string message;
+  std::string function;
+  std::string file;
+  std::shared_ptr<void> context;
+};
+
+inline void SwapEntries(Entry& a, Entry& b) {
+  std::swap(a.level, b.level);
+  std::swap(a.line, b.line);
+  std::swap(a.sequence, b.sequence);
+  std::swap(a.threadId, b.threadId);
+  std::swap(a.format, b.format);
+  std::swap(a.time, b.time);
+  a.message.swap(b.message);
+  a.function.swap(b.function);
+  a.file.swap(b.file);
+  a.context.swap(b.context);
+}
+
+inline size_t RoundUpToPowerOfTwo(size_t value) {
+  size_t result = 2;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+// Single producer (the logging thread), single consumer (the writer). The slots keep their string buffers, so steady
+// state logging does not allocate: the writer swaps drained entries with the ones it wrote last time.
+class Ring {
+public:
+  explicit Ring(size_t capacity) : mSlots(RoundUpToPowerOfTwo(capacity)), mMask(mSlots.size() - 1) {}
+
+  size_t GetCapacity() const { return mSlots.size(); }
+
+  // Returns the number of entries held after the push, 0 if the ring was full. The message, or the encoded arguments
+  // of a format string, is written straight into the slot's buffer, so nothing is formatted when the ring is full.
+  template <typename WriteMessage>
+  size_t TryPush(LogLevel level, WriteMessage& writeMessage, const char* format, const char* function,
+      size_t functionLength,
+      const char* file, size_t fileLength, int32_t line, const std::shared_ptr<void>& context, uint64_t sequence,
+      uint64_t threadId) {
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+    uint64_t head = mHead.load(std::memory_order_acquire);
+    if (tail - head > mMask) {
+      return 0;
+    }
+    Entry& slot = mSlots[tail & mMask];
+    slot.level = level;
+    slot.line = line;
+    slot.sequence = sequence;
+    slot.threadId = threadId;
+    slot.format = format;
+    slot.time = std::chrono::system_clock::now();
+    slot.message.clear();
+    writeMessage(slot.message);
+    slot.function.assign(function, functionLength);
+    slot.file.assign(file, fileLength);
+    slot.context = context;
+    mTail.store(tail + 1, std::memory_order_release);
+    return static_cast<size_t>(tail + 1 - head);
+  }
+
+  // Swaps the buffered entries into batch[count...], growing it as needed, and returns the new count
+  size_t Drain(std::vector<Entry>& batch, size_t count) {
+    uint64_t head = mHead.load(std::memory_order_relaxed);
+    uint64_t tail = mTail.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      if (count == batch.size()) {
+        batch.emplace_back();
+      }
+      SwapEntries(batch[count++], mSlots[head & mMask]);
+    }
+    mHead.store(head, std::memory_order_release);
+    return count;
+  }
+
+  bool IsEmpty() const {
+    return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+  }
+
+  void MarkOrphaned() { mIsOrphaned.store(true, std::memory_order_release); }
+  bool IsOrphaned() const { return mIsOrphaned.load(std::memory_order_acquire); }
+  void MarkDetached() { mIsDetached.store(true, std::memory_order_release); }
+  bool IsDetached() const { return mIsDetached.load(std::memory_order_acquire); }
+
+private:
+  std::vector<Entry> mSlots;
+  const uint64_t mMask;
+  std::atomic<uint64_t> mHead{0};
+  char mPadding[64];
+  std::atomic<uint64_t> mTail{0};
+  std::atomic<bool> mIsOrphaned{false};
+  std::atomic<bool> mIsDetached{false};
+};
+
+// The calling thread's rings, one per logger it has written to. Rings of destroyed loggers are pruned on the next miss
+// and the remaining ones are handed to their writers as orphans when the thread exits.
+struct ThreadRings {
+  uint64_t threadId = static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  uint64_t lastLoggerId = 0;
+  Ring* lastRing = nullptr;
+  std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> rings;
+
+  ~ThreadRings() {
+    for (auto& ring : rings) {
+      ring.second->MarkOrphaned();
+    }
+  }
+};
+
+inline ThreadRings& GetThreadRings() {
+  static thread_local ThreadRings threadRings;
+  return threadRings;
+}
+
+} // namespace asynclogger
+/** @endcond */
+
+/**
+ * @brief LoggerDelegate that buffers log statements per thread and writes them on a background thread
+ * 
+ * @note WriteToLog copies the statement into a lock-free ring owned by the calling thread and returns; it does not
+ *       lock, format or touch the file. A single writer thread, started by Init or, with
+ *       AsyncLoggerSettings::isLazyStart, by the first statement at or above the threshold, drains all rings every
+ *       AsyncLoggerSettings::flushInterval, or sooner when a ring is half full or Flush is called, and writes the
+ *       statements in call order to AsyncLoggerSettings::sink, or to AsyncLoggerSettings::fileName in the storage
+ *       path, flushing once per batch. WriteStructuredLog statements are formatted on the writer thread, or
+ *       stored as format ids and typed arguments with AsyncLogFormat::Binary. Statements logged before Init stay
+ *       buffered until then. With AsyncLoggerOverflowPolicy::Block a full ring makes the logging thread wait once
+ *       the writer is running. This is the logger of a MipConfiguration on which SetLoggerDelegate was not called.
+ */
+class AsyncLoggerDelegate : public LoggerDelegate {
+public:
+  /**
+   * @brief Creates the logger
+   * 
+   * @param settings Threshold, buffering and output settings
+   */
+  explicit AsyncLoggerDelegate(const AsyncLoggerSettings& settings = AsyncLoggerSettings())
+      : mSettings(settings),
+        mId(NextId()) {
+    mSettings.ringCapacity = asynclogger::RoundUpToPowerOfTwo(mSettings.ringCapacity);
+    if (mSettings.flushInterval <= std::chrono::milliseconds::zero()) {
+      mSettings.flushInterval = std::chrono::milliseconds(1);
+    }
+  }
+
+  /**
+   * @brief Opens the output and starts the writer thread, or with AsyncLoggerSettings::isLazyStart only records where
+   *        the output goes
+   * 
+   * @param storagePath Directory of the log file, passed to AsyncLoggerSettings::sink instead if set
+   * 
+   * @note A lazy start keeps the file open and the thread creation out of MipContext creation for processes that
+   *       log nothing at the threshold level, such as short command line invocations.
+   */
+  void Init(const std::string& storagePath) override {
+    {
+      std::lock_guard<std::mutex> writeLock(mWriteMutex);
+      mStoragePath = storagePath;
+      mIsOutputOpen = false;
+    }
+    mIsInitialized.store(true, std::memory_order_release);
+    // A running writer or statements buffered before Init need the output now
+    if (!mSettings.isLazyStart || mIsWriterRunning.load(std::memory_order_acquire) || HasBuffered()) {
+      Start();
+    }
+  }
+
+  /**
+   * @brief Waits until the statements logged before the call are written and the output is flushed
+   */
+  void Flush() override {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mWriter.joinable()) {
+      return;
+    }
+    uint64_t generation = ++mFlushRequested;
+    mCondition.notify_all();
+    mFlushedCondition.wait(lock, [this, generation] { return mFlushCompleted >= generation || mIsStopping; });
+  }
+
+  void WriteToLog(
+      const LogLevel level,
+      const std::string& message,
+      const std::string& function,
+      const std::string& file,
+      const int32_t line) override {
+    auto writeMessage = [&message](std::string& out) { out.assign(message); };
+    Push(level, writeMessage, nullptr, function.data(), function.size(), file.data(), file.size(), line, NoContext());
+  }
+
+  /**
+   * @brief Buffers a log statement, the context is passed to AsyncLoggerSettings::sink
+   */
+  void WriteToLogWithContext(
+      const LogLevel level,
+      const std::string& message,
+      const std::string& function,
+      const std::string& file,
+      const int32_t line,
+      const std::shared_ptr<void>& context) override {
+    auto writeMessage = [&message](std::string& out) { out.assign(message); };
+    Push(level, writeMessage, nullptr, function.data(), function.size(), file.data(), file.size(), line, context);
+  }
+
+  /**
+   * @brief Get if statements of a level are kept
+   * 
+   * @param level Log level
+   * 
+   * @return true if the level is at or above AsyncLoggerSettings::thresholdLevel
+   */
+  bool IsEnabled(LogLevel level) const { return level >= mSettings.thresholdLevel; }
+
+  /**
+   * @brief Buffers a log statement whose message is only built if its level is enabled
+   * 
+   * @param level the log level for the log statement.
+   * @param function the function name for the log statement, for example __func__.
+   * @param file the file name where log statement was generated, for example __FILE__.
+   * @param line the line number where the log statement was generated.
+   * @param formatMessage Callable taking a std::string& it appends the message to
+   * 
+   * @note A statement below the threshold costs one comparison: no std::string is constructed and formatMessage is
+   *       not called. Otherwise formatMessage writes into the buffer of the ring slot, reusing its allocation.
+   */
+  template <typename FormatMessage>
+  void WriteToLog(LogLevel level, const char* function, const char* file, int32_t line, FormatMessage&& formatMessage) {
+    if (!IsEnabled(level)) {
+      return;
+    }
+    Push(level, formatMessage, nullptr, function, std::char_traits<char>::length(function), file,
+        std::char_traits<char>::length(file), line, NoContext());
+  }
+
+  /**
+   * @brief Buffers a structured log statement: a static format string and typed arguments
+   * 
+   * @param level the log level for the log statement.
+   * @param format Format string in which each "{}" stands for the next argument. It must outlive the logger, which
+   *        keeps the pointer: pass a string literal.
+   * @param function the function name for the log statement, for example __func__.
+   * @param file the file name where log statement was generated, for example __FILE__.
+   * @param line the line number where the log statement was generated.
+   * @param args Integers, enums, floating point numbers, bools, C strings or std::strings
+   * 
+   * @note The calling thread only encodes the arguments, the writer thread formats them. With
+   *       AsyncLogFormat::Binary the format string is written once per file and each statement refers to it by id,
+   *       followed by its arguments in binary.
+   */
+  template <typename... Args>
+  void WriteStructuredLog(LogLevel level, const char* format, const char* function, const char* file, int32_t line,
+      const Args&... args) {
+    if (!IsEnabled(level)) {
+      return;
+    }
+    auto encodeArguments = [&](std::string& out) { binarylog::EncodeArguments(out, args...); };
+    Push(level, encodeArguments, format, function, std::char_traits<char>::length(function), file,
+        std::char_traits<char>::length(file), line, NoContext());
+  }
+
+  /**
+   * @brief Get the statements discarded because a ring was full or the output could not be written
+   */
+  uint64_t GetDroppedCount() const { return mDroppedCount.load(); }
+
+  /**
+   * @brief Get the statements written to the output
+   */
+  uint64_t GetWrittenCount() const { return mWrittenCount.load(); }
+
+  /**
+   * @brief Get the settings, with the ring capacity rounded up
+   */
+  const AsyncLoggerSettings& GetSettings() const { return mSettings; }
+
+  /** @cond DOXYGEN_HIDE */
+  ~AsyncLoggerDelegate() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+      mCondition.notify_all();
+      mFlushedCondition.notify_all();
+    }
+    if (mWriter.joinable()) {
+      mWriter.join();
+    }
+    std::lock_guard<std::mutex> lock(mRingsMutex);
+    for (auto& ring : mRings) {
+      ring->MarkDetached();
+    }
+  }
+
+private:
+  static uint64_t NextId() {
+    static std::atomic<uint64_t> sCounter(0);
+    return ++sCounter;
+  }
+
+  static const std::shared_ptr<void>& NoContext() {
+    static const std::shared_ptr<void> noContext;
+    return noContext;
+  }
+
+  void Start() {
+    {
+      std::lock_guard<std::mutex> writeLock(mWriteMutex);
+      if (!mIsOutputOpen) {
+        mIsOutputOpen = true;
+        if (mSettings.sink) {
+          mSettings.sink->Init(mStoragePath);
+        } else {
+          bool isBinary = mSettings.format == AsyncLogFormat::Binary;
+          std::string fileName = !mSettings.fileName.empty() ? mSettings.fileName :
+              isBinary ? "mip_sdk.miplogb" : "mip_sdk.miplog";
+          mFilePath = mStoragePath.empty() ? fileName : mStoragePath + "/" + fileName;
+          OpenFile();
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mWriter.joinable() && !mIsStopping) {
+      mWriter = std::thread([this]() { RunWriter(); });
+      mIsWriterRunning.store(true, std::memory_order_release);
+    }
+  }
+
+  bool HasBuffered() {
+    std::lock_guard<std::mutex> lock(mRingsMutex);
+    for (const auto& ring : mRings) {
+      if (!ring->IsEmpty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  asynclogger::Ring& GetRing() {
+    auto& threadRings = asynclogger::GetThreadRings();
+    if (threadRings.lastLoggerId == mId) {
+      return *threadRings.lastRing;
+    }
+    asynclogger::Ring* found = nullptr;
+    auto& rings = threadRings.rings;
+    rings.erase(std::remove_if(rings.begin(), rings.end(),
+        [](const std::pair<uint64_t, std::shared_ptr<asynclogger::Ring>>& ring) { return ring.second->IsDetached(); }),
+        rings.end());
+    for (auto& ring : rings) {
+      if (ring.first == mId) {
+        found = ring.second.get();
+      }
+    }
+    if (!found) {
+      auto ring = std::make_shared<asynclogger::Ring>(mSettings.ringCapacity);
+      {
+        std::lock_guard<std::mutex> lock(mRingsMutex);
+        mRings.push_back(ring);
+      }
+      rings.emplace_back(mId, ring);
+      found = ring.get();
+    }
+    threadRings.lastLoggerId = mId;
+    threadRings.lastRing = found;
+    return *found;
+  }
+
+  template <typename WriteMessage>
+  void Push(LogLevel level, WriteMessage& writeMessage, const char* format, const char* function,
+      size_t functionLength, const char* file, size_t fileLength, int32_t line, const std::shared_ptr<void>& context) {
+    if (!IsEnabled(level)) {
+      return;
+    }
+    if (!mIsWriterRunning.load(std::memory_order_acquire) && mIsInitialized.load(std::memory_order_acquire)) {
+      Start();
+    }
+    auto& ring = GetRing();
+    uint64_t threadId = asynclogger::GetThreadRings().threadId;
+    uint64_t sequence = mSequence.fetch_add(1, std::memory_order_relaxed);
+    for (;;) {
+      size_t size = ring.TryPush(level, writeMessage, format, function, functionLength, file, fileLength, line,
+          context, sequence, threadId);
+      if (size == ring.GetCapacity() / 2) {
+        Wake();
+      }
+      if (size != 0) {
+        return;
+      }
+      if (mSettings.overflowPolicy == AsyncLoggerOverflowPolicy::Drop ||
+          !mIsWriterRunning.load(std::memory_order_acquire)) {
+        ++mDroppedCount;
+        return;
+      }
+      Wake();
+      std::this_thread::yield();
+    }
+  }
+
+  void Wake() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsWakeRequested = true;
+    mCondition.notify_all();
+  }
+
+  void RunWriter() {
+    for (;;) {
+      uint64_t generation = 0;
+      bool isStopping = false;
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait_for(lock, mSettings.flushInterval, [this] {
+          return mIsStopping || mIsWakeRequested || mFlushRequested > mFlushCompleted;
+        });
+        mIsWakeRequested = false;
+        generation = mFlushRequested;
+        isStopping = mIsStopping;
+      }
+      WriteBuffered();
+      std::lock_guard<std::mutex> lock(mMutex);
+      mFlushCompleted = generation;
+      mFlushedCondition.notify_all();
+      if (isStopping) {
+        return;
+      }
+    }
+  }
+
+  // Runs on the writer thread only, the lock orders it with Init
+  void WriteBuffered() {
+    std::lock_guard<std::mutex> writeLock(mWriteMutex);
+    std::vector<std::shared_ptr<asynclogger::Ring>> rings;
+    {
+      std::lock_guard<std::mutex> lock(mRingsMutex);
+      // An orphan is dropped once it is empty, nothing is pushed to it any more
+      mRings.erase(std::remove_if(mRings.begin(), mRings.end(), [](const std::shared_ptr<asynclogger::Ring>& ring) {
+        return ring->IsOrphaned() && ring->IsEmpty();
+      }), mRings.end());
+      rings = mRings;
+    }
+    size_t count = 0;
+    for (auto& ring : rings) {
+      count = ring->Drain(mBatch, count);
+    }
+    if (count == 0) {
+      return;
+    }
+    mOrder.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      mOrder[i] = &mBatch[i];
+    }
+    std::sort(mOrder.begin(), mOrder.end(), [](const asynclogger::Entry* a, const asynclogger::Entry* b) {
+      return a->sequence < b->sequence;
+    });
+    uint64_t written = 0;
+    if (mSettings.sink) {
+      for (auto entry : mOrder) {
+        try {
+          mSettings.sink->WriteToLogWithContext(entry->level, GetMessage(*entry), entry->function, entry->file,
+              entry->line, entry->context);
+          ++written;
+        } catch (...) {
+        }
+      }
+      try {
+        mSettings.sink->Flush();
+      } catch (...) {
+      }
+    } else if (mFile.is_open()) {
+      mText.clear();
+      for (auto entry : mOrder) {
+        if (mSettings.format == AsyncLogFormat::Binary) {
+          mEncoder.AppendEntry(entry->level, entry->time, entry->threadId, entry->line, entry->function, entry->file,
+              entry->format, entry->message, mText);
+        } else {
+          binarylog::AppendLine(entry->level, entry->time, entry->threadId, GetMessage(*entry), entry->function,
+              entry->file, entry->line, mText);
+        }
+      }
+      mFile.write(mText.data(), static_cast<std::streamsize>(mText.size()));
+      mFile.flush();
+      written = mFile ? count : 0;
+      mFile.clear();
+      mFileSize += static_cast<int64_t>(mText.size());
+      if (mSettings.maxFileSize > 0 && mFileSize >= mSettings.maxFileSize) {
+        RotateFile();
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      mBatch[i].context.reset();
+    }
+    mWrittenCount += written;
+    mDroppedCount += count - written;
+  }
+
+  void OpenFile() {
+    mFile.close();
+    mFile.clear();
+    mFile.open(mFilePath, std::ios::out | std::ios::app | std::ios::binary);
+    mFile.seekp(0, std::ios::end);
+    std::streamoff size = mFile.tellp();
+    mFileSize = size > 0 ? static_cast<int64_t>(size) : 0;
+    mFile.clear();
+    if (mSettings.format == AsyncLogFormat::Binary) {
+      // Every file restarts the string table, the reader resets it at each magic
+      mText.clear();
+      mEncoder.AppendMagic(mText);
+      mFile.write(mText.data(), static_cast<std::streamsize>(mText.size()));
+      mFileSize += static_cast<int64_t>(mText.size());
+    }
+  }
+
+  // Shift name.1 .. name.N-1 up by one, dropping name.N, and start a new file
+  void RotateFile() {
+    mFile.close();
+    if (mSettings.maxRotatedFiles == 0) {
+      std::remove(mFilePath.c_str());
+    } else {
+      std::remove((mFilePath + "." + std::to_string(mSettings.maxRotatedFiles)).c_str());
+      for (size_t index = mSettings.maxRotatedFiles - 1; index >= 1; --index) {
+        std::string from = mFilePath + "." + std::to_string(index);
+        std::rename(from.c_str(), (mFilePath + "." + std::to_string(index + 1)).c_str());
+      }
+      std::rename(mFilePath.c_str(), (mFilePath + ".1").c_str());
+    }
+    OpenFile();
+  }
+
+  // The message of a structured entry holds its encoded arguments
+  const std::string& GetMessage(const asynclogger::Entry& entry) {
+    if (!entry.format) {
+      return entry.message;
+    }
+    mFormatted.clear();
+    try {
+      binarylog::DecodeArguments(entry.message, mArguments);
+    } catch (const Error&) {
+      mArguments.clear();
+    }
+    binarylog::AppendFormatted(entry.format, mArguments, mFormatted);
+    return mFormatted;
+  }
+
+  AsyncLoggerSettings mSettings;
+  const uint64_t mId;
+  std::atomic<uint64_t> mSequence{0};
+  std::atomic<uint64_t> mDroppedCount{0};
+  std::atomic<uint64_t> mWrittenCount{0};
+  std::atomic<bool> mIsWriterRunning{false};
+  std::atomic<bool> mIsInitialized{false};
+  std::mutex mRingsMutex;
+  std::vector<std::shared_ptr<asynclogger::Ring>> mRings;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::condition_variable mFlushedCondition;
+  bool mIsStopping = false;
+  bool mIsWakeRequested = false;
+  uint64_t mFlushRequested = 0;
+  uint64_t mFlushCompleted = 0;
+  std::thread mWriter;
+  std::mutex mWriteMutex;
+  std::string mStoragePath;
+  bool mIsOutputOpen = false;
+  std::ofstream mFile;
+  std::string mFilePath;
+  int64_t mFileSize = 0;
+  std::vector<asynclogger::Entry> mBatch;
+  std::vector<asynclogger::Entry*> mOrder;
+  std::string mText;
+  std::string mFormatted;
+  std::vector<BinaryLogArgument> mArguments;
+  binarylog::Encoder mEncoder;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_ASYNC_LOGGER_DELEGATE_H_
@@ -0,0 +1,162 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines the AsyncStream interface for completion-based stream I/O
+ * 
+ * @file async_stream.h
+ */
+
+#ifndef API_MIP_ASYNC_STREAM_H_
+#define API_MIP_ASYNC_STREAM_H_
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A Stream whose content is transferred through completion callbacks rather than blocking calls.
+ * 
+ * @note Applications backing content with object storage or other network services implement ReadAsync/WriteAsync
+ *       once and issue the transfer without parking a thread. The synchronous Stream::Read/Stream::Write contract
+ *       required by the rest of the SDK is provided on top of them, so an AsyncStream can be passed anywhere a
+ *       Stream is accepted.
+ */
+class AsyncStream : public Stream {
+public:
+  /**
+   * @brief Signature of the callback invoked once an asynchronous transfer finishes
+   * 
+   * @param bytesTransferred Number of bytes read or written
+   * @param error Failure that occurred during the transfer, or nullptr on success
+   */
+  typedef std::function<void(int64_t bytesTransferred, const std::exception_ptr& error)> CompletionCallback;
+
+  /**
+   * @brief Start reading into a buffer from an absolute position in the stream.
+   * 
+   * @param position Absolute position to read from
+   * @param buffer pointer to a buffer that must stay valid until @p completion is called
+   * @param bufferLength buffer size.
+   * @param completion Callback invoked exactly once, on any thread, when the read finishes
+   */
+  virtual void ReadAsync(
+      int64_t position,
+      uint8_t* buffer,
+      int64_t bufferLength,
+      const CompletionCallback& completion) = 0;
+
+  /**
+   * @brief Start writing into the stream at an absolute position from a buffer.
+   * 
+   * @param position Absolute position to write to
+   * @param buffer pointer to a buffer that must stay valid until @p completion is called
+   * @param bufferLength buffer size.
+   * @param completion Callback invoked exactly once, on any thread, when the write finishes
+   */
+  virtual void WriteAsync(
+      int64_t position,
+      const uint8_t* buffer,
+      int64_t bufferLength,
+      const CompletionCallback& completion) = 0;
+
+  /**
+   * @brief Read into a buffer from the stream, waiting for ReadAsync to complete.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesRead = Wait([&](const CompletionCallback& completion) {
+      ReadAsync(mPosition, buffer, bufferLength, completion);
+    });
+    mPosition += bytesRead;
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer, waiting for WriteAsync to complete.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesWritten = Wait([&](const CompletionCallback& completion) {
+      WriteAsync(mPosition, buffer, bufferLength, completion);
+    });
+    mPosition += bytesWritten;
+    return bytesWritten;
+  }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mPosition = position; }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~AsyncStream() { }
+
+protected:
+  AsyncStream() : mPosition(0) { }
+
+private:
+  int64_t Wait(const std::function<void(const CompletionCallback&)>& start) {
+    auto promise = std::make_shared<std::promise<int64_t>>();
+    std::future<int64_t> result = promise->get_future();
+    start([promise](int64_t bytesTransferred, const std::exception_ptr& error) {
+      if (error) {
+        promise->set_exception(error);
+      } else {
+        promise->set_value(bytesTransferred);
+      }
+    });
+    return result.get();
+  }
+
+  int64_t mPosition;
+  /** @endcond */
+}; // class AsyncStream
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_ASYNC_STREAM_H_
@@ -0,0 +1,213 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines BenchmarkRecorder, which collects per-format operation timings and writes them as JSON
+ * 
+ * @file benchmark_recorder.h
+ */
+
+#ifndef API_MIP_BENCHMARK_RECORDER_H_
+#define API_MIP_BENCHMARK_RECORDER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/version.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Collects durations of SDK operations per operation and file format, and reports throughput as JSON
+ * 
+ * @note Intended for benchmark harnesses that replay recorded service traffic through HttpFixtureDelegate, so that
+ *       runs are repeatable offline and results from different SDK versions can be compared. Thread-safe.
+ */
+class BenchmarkRecorder {
+public:
+  /**
+   * @brief Times one operation from construction until Stop() or destruction, whichever comes first
+   */
+  class ScopedTimer {
+  public:
+    /** @cond DOXYGEN_HIDE */
+    ScopedTimer(BenchmarkRecorder& recorder, const std::string& operation, const std::string& format,
+        uint64_t inputBytes)
+        : mRecorder(&recorder),
+          mOperation(operation),
+          mFormat(format),
+          mInputBytes(inputBytes),
+          mStart(std::chrono::steady_clock::now()) {}
+    ScopedTimer(ScopedTimer&& other)
+        : mRecorder(other.mRecorder),
+          mOperation(std::move(other.mOperation)),
+          mFormat(std::move(other.mFormat)),
+          mInputBytes(other.mInputBytes),
+          mStart(other.mStart) {
+      other.mRecorder = nullptr;
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(ScopedTimer&&) = delete;
+    ~ScopedTimer() { Stop(); }
+    /** @endcond */
+
+    /**
+     * @brief Records the elapsed time. Subsequent calls do nothing.
+     */
+    void Stop() {
+      if (mRecorder) {
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart);
+        mRecorder->Record(mOperation, mFormat, mInputBytes, static_cast<uint64_t>(duration.count()));
+        mRecorder = nullptr;
+      }
+    }
+
+    /**
+     * @brief Discards the measurement, e.g. because the operation failed
+     */
+    void Cancel() { mRecorder = nullptr; }
+
+  private:
+    BenchmarkRecorder* mRecorder;
+    std::string mOperation;
+    std::string mFormat;
+    uint64_t mInputBytes;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  /**
+   * @brief Records one completed operation
+   * 
+   * @param operation Operation name, e.g. "Protect" or "GetFileStatus"
+   * @param format File format, e.g. "docx" or "pfile"
+   * @param inputBytes Size of the input processed by the operation
+   * @param durationNs Wall-clock duration in nanoseconds
+   */
+  void Record(const std::string& operation, const std::string& format, uint64_t inputBytes, uint64_t durationNs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& samples = mSamples[std::make_pair(operation, format)];
+    samples.durationsNs.push_back(durationNs);
+    samples.totalBytes += inputBytes;
+  }
+
+  /**
+   * @brief Starts timing an operation
+   * 
+   * @param operation Operation name
+   * @param format File format
+   * @param inputBytes Size of the input processed by the operation
+   * 
+   * @return Timer that records the operation when stopped or destroyed
+   */
+  ScopedTimer Time(const std::string& operation, const std::string& format, uint64_t inputBytes) {
+    return ScopedTimer(*this, operation, format, inputBytes);
+  }
+
+  /**
+   * @brief Discards all recorded samples
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSamples.clear();
+  }
+
+  /**
+   * @brief Writes the results as a JSON document
+   * 
+   * @param output Stream receiving the document
+   * 
+   * @note The document has the form {"sdkVersion": "...", "results": [{"operation", "format", "iterations",
+   *       "totalBytes", "minNs", "medianNs", "meanNs", "maxNs", "bytesPerSecond"}, ...]}, ordered by operation and
+   *       format. bytesPerSecond is computed from the total bytes and total duration of the operation.
+   */
+  void WriteJson(std::ostream& output) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    output << "{\n  \"sdkVersion\": \"" << VER_FILE_VERSION_STR << "\",\n  \"results\": [";
+    bool isFirst = true;
+    for (const auto& entry : mSamples) {
+      std::vector<uint64_t> durations = entry.second.durationsNs;
+      std::sort(durations.begin(), durations.end());
+      uint64_t totalNs = 0;
+      for (uint64_t duration : durations) {
+        totalNs += duration;
+      }
+      size_t count = durations.size();
+      uint64_t median = count % 2 ? durations[count / 2] : (durations[count / 2 - 1] + durations[count / 2]) / 2;
+      double bytesPerSecond = totalNs ? static_cast<double>(entry.second.totalBytes) * 1e9 / totalNs : 0.0;
+      char rate[32];
+      std::snprintf(rate, sizeof(rate), "%.1f", bytesPerSecond);
+
+      output << (isFirst ? "\n" : ",\n") << "    {\"operation\": \"" << Escape(entry.first.first)
+             << "\", \"format\": \"" << Escape(entry.first.second) << "\", \"iterations\": " << count
+             << ", \"totalBytes\": " << entry.second.totalBytes << ", \"minNs\": " << durations.front()
+             << ", \"medianNs\": " << median << ", \"meanNs\": " << totalNs / count
+             << ", \"maxNs\": " << durations.back() << ", \"bytesPerSecond\": " << rate << "}";
+      isFirst = false;
+    }
+    output << (isFirst ? "]\n}\n" : "\n  ]\n}\n");
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Samples {
+    std::vector<uint64_t> durationsNs;
+    uint64_t totalBytes = 0;
+  };
+
+  static std::string Escape(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+        escaped += code;
+      } else {
+        escaped += c;
+      }
+    }
+    return escaped;
+  }
+
+  mutable std::mutex mMutex;
+  std::map<std::pair<std::string, std::string>, Samples> mSamples;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_BENCHMARK_RECORDER_H_
@@ -0,0 +1,557 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines the binary log format written by AsyncLoggerDelegate and its decoder
+ * 
+ * @file binary_log.h
+ */
+
+#ifndef API_MIP_BINARY_LOG_H_
+#define API_MIP_BINARY_LOG_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/logger_delegate.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Type of an argument of a structured log statement
+ */
+enum class BinaryLogArgumentType : unsigned int {
+  Int    = 0, /**< Signed integer */
+  UInt   = 1, /**< Unsigned integer */
+  Double = 2, /**< Floating point number */
+  String = 3, /**< Byte string */
+  Bool   = 4, /**< Boolean */
+};
+
+/**
+ * @brief A decoded argument of a structured log statement
+ */
+struct BinaryLogArgument {
+  BinaryLogArgumentType type = BinaryLogArgumentType::Int; /**< Which of the values is set */
+  int64_t intValue = 0;                                    /**< Value of an Int argument */
+  uint64_t uintValue = 0;                                  /**< Value of a UInt argument */
+  double doubleValue = 0;                                  /**< Value of a Double argument */
+  bool boolValue = false;                                  /**< Value of a Bool argument */
+  std::string stringValue;                                 /**< Value of a String argument */
+
+  /**
+   * @brief Get the argument as it appears in a text log
+   */
+  std::string ToString() const {
+    switch (type) {
+      case BinaryLogArgumentType::Int:
+        return std::to_string(intValue);
+      case BinaryLogArgumentType::UInt:
+        return std::to_string(uintValue);
+      case BinaryLogArgumentType::Double: {
+        char text[32];
+        int length = std::snprintf(text, sizeof(text), "%g", doubleValue);
+        return std::string(text, length > 0 ? static_cast<size_t>(length) : 0);
+      }
+      case BinaryLogArgumentType::String:
+        return stringValue;
+      case BinaryLogArgumentType::Bool:
+        return boolValue ? "true" : "false";
+    }
+    return std::string();
+  }
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace binarylog {
+
+// A file is a sequence of records, each starting with a tag byte. The magic doubles as the record that resets the
+// string table, so a file appended to by several runs decodes. Integers are LEB128 varints, signed ones zigzagged.
+//   'M' "IPBLG1\n"
+//   'S' id, length, bytes: defines string id (format strings, function and file names)
+//   'E' level, time (microseconds since the epoch), thread, line, function id, file id, format id, length, payload
+// The payload of a statement without a format string (format id 0) is its message. Otherwise it is the arguments,
+// each a type byte followed by a varint, 8 little endian bytes (double), or length and bytes (string).
+static const char kMagic[] = "MIPBLG1\n";
+static const size_t kMagicSize = sizeof(kMagic) - 1;
+static const char kStringRecord = 'S';
+static const char kEntryRecord = 'E';
+
+inline void AppendVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+inline void AppendSigned(int64_t value, std::string& out) {
+  AppendVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63), out);
+}
+
+inline int64_t ToSigned(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void AppendBytes(const char* data, size_t size, std::string& out) {
+  AppendVarint(size, out);
+  out.append(data, size);
+}
+
+inline void EncodeArgument(bool value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::Bool));
+  out.push_back(value ? 1 : 0);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type EncodeArgument(
+    T value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::Int));
+  AppendSigned(static_cast<int64_t>(value), out);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type EncodeArgument(
+    T value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::UInt));
+  AppendVarint(static_cast<uint64_t>(value), out);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type EncodeArgument(T value, std::string& out) {
+  EncodeArgument(static_cast<typename std::underlying_type<T>::type>(value), out);
+}
+
+inline void EncodeArgument(double value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::Double));
+  uint64_t bits = 0;
+  static_assert(sizeof(bits) == sizeof(value), "double must be 64 bits");
+  std::memcpy(&bits, &value, sizeof(bits));
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(static_cast<char>(bits >> (8 * i)));
+  }
+}
+
+inline void EncodeArgument(float value, std::string& out) {
+  EncodeArgument(static_cast<double>(value), out);
+}
+
+inline void EncodeArgument(const char* value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::String));
+  AppendBytes(value, std::char_traits<char>::length(value), out);
+}
+
+inline void EncodeArgument(const std::string& value, std::string& out) {
+  out.push_back(static_cast<char>(BinaryLogArgumentType::String));
+  AppendBytes(value.data(), value.size(), out);
+}
+
+inline void EncodeArguments(std::string&) {}
+
+template <typename T, typename... Rest>
+inline void EncodeArguments(std::string& out, const T& value, const Rest&... rest) {
+  EncodeArgument(value, out);
+  EncodeArguments(out, rest...);
+}
+
+class Cursor {
+public:
+  Cursor(const char* data, size_t size) : mData(data), mEnd(data + size) {}
+
+  bool IsAtEnd() const { return mData == mEnd; }
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = ReadByte();
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    throw BadInputError("Binary log varint is too long");
+  }
+
+  uint8_t ReadByte() {
+    if (mData == mEnd) {
+      throw BadInputError("Binary log argument is truncated");
+    }
+    return static_cast<uint8_t>(*mData++);
+  }
+
+  std::string ReadBytes() {
+    uint64_t size = ReadVarint();
+    if (size > static_cast<uint64_t>(mEnd - mData)) {
+      throw BadInputError("Binary log argument is truncated");
+    }
+    std::string value(mData, static_cast<size_t>(size));
+    mData += size;
+    return value;
+  }
+
+private:
+  const char* mData;
+  const char* mEnd;
+};
+
+inline void DecodeArguments(const std::string& payload, std::vector<BinaryLogArgument>& arguments) {
+  arguments.clear();
+  Cursor cursor(payload.data(), payload.size());
+  while (!cursor.IsAtEnd()) {
+    BinaryLogArgument argument;
+    argument.type = static_cast<BinaryLogArgumentType>(cursor.ReadByte());
+    switch (argument.type) {
+      case BinaryLogArgumentType::Int:
+        argument.intValue = ToSigned(cursor.ReadVarint());
+        break;
+      case BinaryLogArgumentType::UInt:
+        argument.uintValue = cursor.ReadVarint();
+        break;
+      case BinaryLogArgumentType::Double: {
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i) {
+          bits |= static_cast<uint64_t>(cursor.ReadByte()) << (8 * i);
+        }
+        std::memcpy(&argument.doubleValue, &bits, sizeof(bits));
+        break;
+      }
+      case BinaryLogArgumentType::String:
+        argument.stringValue = cursor.ReadBytes();
+        break;
+      case BinaryLogArgumentType::Bool:
+        argument.boolValue = cursor.ReadByte() != 0;
+        break;
+      default:
+        throw BadInputError("Binary log argument has an unknown type");
+    }
+    arguments.push_back(std::move(argument));
+  }
+}
+
+// Each "{}" takes the next argument, arguments left over are appended separated by spaces
+inline void AppendFormatted(const std::string& format, const std::vector<BinaryLogArgument>& arguments,
+    std::string& out) {
+  size_t next = 0;
+  for (size_t i = 0; i < format.size(); ++i) {
+    if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && next < arguments.size()) {
+      out.append(arguments[next++].ToString());
+      ++i;
+    } else {
+      out.push_back(format[i]);
+    }
+  }
+  for (; next < arguments.size(); ++next) {
+    out.push_back(' ');
+    out.append(arguments[next].ToString());
+  }
+}
+
+inline const char* GetLevelName(LogLevel level) {
+  switch (level) {
+    case LogLevel::Trace:
+      return "Trace";
+    case LogLevel::Info:
+      return "Info";
+    case LogLevel::Warning:
+      return "Warning";
+    case LogLevel::Error:
+      return "Error";
+  }
+  return "Unknown";
+}
+
+// Text log line: time, level, thread, message, function and file:line, tab separated
+inline void AppendLine(LogLevel level, std::chrono::system_clock::time_point time, uint64_t threadId,
+    const std::string& message, const std::string& function, const std::string& file, int32_t line,
+    std::string& out) {
+  auto sinceEpoch = time.time_since_epoch();
+  std::time_t seconds = static_cast<std::time_t>(std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch).count());
+  int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch).count() % 1000);
+  std::tm utc = {};
+#ifdef _WIN32
+  gmtime_s(&utc, &seconds);
+#else
+  gmtime_r(&seconds, &utc);
+#endif
+  char text[32];
+  size_t length = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc);
+  out.append(text, length);
+  out.push_back('.');
+  out.push_back(static_cast<char>('0' + milliseconds / 100));
+  out.push_back(static_cast<char>('0' + milliseconds / 10 % 10));
+  out.push_back(static_cast<char>('0' + milliseconds % 10));
+  out.append("Z\t");
+  out.append(GetLevelName(level));
+  out.push_back('\t');
+  out.append(std::to_string(threadId));
+  out.push_back('\t');
+  out.append(message);
+  out.push_back('\t');
+  out.append(function);
+  out.push_back('\t');
+  out.append(file);
+  out.push_back(':');
+  out.append(std::to_string(line));
+  out.push_back('\n');
+}
+
+// Writer side string table, reset whenever a magic is written
+class Encoder {
+public:
+  void AppendMagic(std::string& out) {
+    mIds.clear();
+    out.append(kMagic, kMagicSize);
+  }
+
+  void AppendEntry(LogLevel level, std::chrono::system_clock::time_point time, uint64_t threadId, int32_t line,
+      const std::string& function, const std::string& file, const char* format, const std::string& payload,
+      std::string& out) {
+    uint64_t functionId = Intern(function, out);
+    uint64_t fileId = Intern(file, out);
+    uint64_t formatId = format ? Intern(format, out) : 0;
+    out.push_back(kEntryRecord);
+    AppendVarint(static_cast<uint64_t>(level), out);
+    AppendVarint(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count()), out);
+    AppendVarint(threadId, out);
+    AppendSigned(line, out);
+    AppendVarint(functionId, out);
+    AppendVarint(fileId, out);
+    AppendVarint(formatId, out);
+    AppendBytes(payload.data(), payload.size(), out);
+  }
+
+private:
+  uint64_t Intern(const std::string& value, std::string& out) {
+    auto found = mIds.find(value);
+    if (found != mIds.end()) {
+      return found->second;
+    }
+    uint64_t id = mIds.size() + 1;
+    mIds.emplace(value, id);
+    out.push_back(kStringRecord);
+    AppendVarint(id, out);
+    AppendBytes(value.data(), value.size(), out);
+    return id;
+  }
+
+  std::unordered_map<std::string, uint64_t> mIds;
+};
+
+} // namespace binarylog
+/** @endcond */
+
+/**
+ * @brief One statement read from a binary log
+ */
+struct BinaryLogEntry {
+  LogLevel level = LogLevel::Trace;            /**< Log level */
+  std::chrono::system_clock::time_point time;  /**< When the statement was logged */
+  uint64_t threadId = 0;                       /**< Hash of the logging thread's id */
+  int32_t line = 0;                            /**< Line number where the statement was logged */
+  std::string function;                        /**< Function name */
+  std::string file;                            /**< File name */
+  std::string format;                          /**< Format string, empty if the statement was logged as text */
+  std::vector<BinaryLogArgument> arguments;    /**< Arguments of the format string */
+  std::string text;                            /**< Message of a statement logged as text */
+
+  /**
+   * @brief Get the message, the format string with "{}" replaced by the arguments or the text
+   */
+  std::string GetMessage() const {
+    if (format.empty()) {
+      return text;
+    }
+    std::string message;
+    binarylog::AppendFormatted(format, arguments, message);
+    return message;
+  }
+
+  /**
+   * @brief Get the statement as a line of the text log written by AsyncLoggerDelegate
+   */
+  std::string ToString() const {
+    std::string out;
+    binarylog::AppendLine(level, time, threadId, GetMessage(), function, file, line, out);
+    return out;
+  }
+};
+
+/**
+ * @brief Reads the statements of a binary log written by AsyncLoggerDelegate with AsyncLogFormat::Binary
+ */
+class BinaryLogReader {
+public:
+  /**
+   * @brief Creates a reader
+   * 
+   * @param input Binary log, read from its current position
+   */
+  explicit BinaryLogReader(std::istream& input) : mInput(input) {}
+
+  /**
+   * @brief Reads the next statement
+   * 
+   * @param entry Receives the statement
+   * 
+   * @return false at the end of the log. A record cut short by a crash also ends the log.
+   * 
+   * @note Throws BadInputError if the input is not a binary log or is corrupt
+   */
+  bool Next(BinaryLogEntry& entry) {
+    for (;;) {
+      int tag = mInput.get();
+      if (tag == std::char_traits<char>::eof()) {
+        return false;
+      }
+      if (tag == kMagicTag) {
+        char rest[binarylog::kMagicSize - 1];
+        if (!mInput.read(rest, sizeof(rest))) {
+          return false;
+        }
+        if (std::string(rest, sizeof(rest)) != std::string(binarylog::kMagic + 1, sizeof(rest))) {
+          throw BadInputError("Binary log has a bad magic");
+        }
+        mStrings.clear();
+        mHasMagic = true;
+        continue;
+      }
+      if (!mHasMagic) {
+        throw BadInputError("Input is not a binary log");
+      }
+      if (tag == binarylog::kStringRecord) {
+        uint64_t id = 0;
+        std::string value;
+        if (!ReadVarint(id) || !ReadBytes(value)) {
+          return false;
+        }
+        mStrings[id] = std::move(value);
+        continue;
+      }
+      if (tag != binarylog::kEntryRecord) {
+        throw BadInputError("Binary log has an unknown record");
+      }
+      uint64_t level = 0, time = 0, threadId = 0, line = 0, functionId = 0, fileId = 0, formatId = 0;
+      std::string payload;
+      if (!ReadVarint(level) || !ReadVarint(time) || !ReadVarint(threadId) || !ReadVarint(line) ||
+          !ReadVarint(functionId) || !ReadVarint(fileId) || !ReadVarint(formatId) || !ReadBytes(payload)) {
+        return false;
+      }
+      entry.level = static_cast<LogLevel>(level);
+      entry.time = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+          std::chrono::system_clock::duration>(std::chrono::microseconds(static_cast<int64_t>(time))));
+      entry.threadId = threadId;
+      entry.line = static_cast<int32_t>(binarylog::ToSigned(line));
+      entry.function = GetString(functionId);
+      entry.file = GetString(fileId);
+      if (formatId == 0) {
+        entry.format.clear();
+        entry.arguments.clear();
+        entry.text = std::move(payload);
+      } else {
+        entry.format = GetString(formatId);
+        entry.text.clear();
+        binarylog::DecodeArguments(payload, entry.arguments);
+      }
+      return true;
+    }
+  }
+
+private:
+  static const int kMagicTag = 'M';
+
+  bool ReadVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int byte = mInput.get();
+      if (byte == std::char_traits<char>::eof()) {
+        return false;
+      }
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    throw BadInputError("Binary log varint is too long");
+  }
+
+  bool ReadBytes(std::string& value) {
+    uint64_t size = 0;
+    if (!ReadVarint(size)) {
+      return false;
+    }
+    value.resize(static_cast<size_t>(size));
+    return size == 0 || static_cast<bool>(mInput.read(&value[0], static_cast<std::streamsize>(size)));
+  }
+
+  const std::string& GetString(uint64_t id) const {
+    auto found = mStrings.find(id);
+    if (found == mStrings.end()) {
+      throw BadInputError("Binary log refers to an undefined string");
+    }
+    return found->second;
+  }
+
+  std::istream& mInput;
+  std::unordered_map<uint64_t, std::string> mStrings;
+  bool mHasMagic = false;
+};
+
+/**
+ * @brief Converts a binary log to the text log format
+ * 
+ * @param input Binary log written by AsyncLoggerDelegate with AsyncLogFormat::Binary
+ * @param output Receives one text line per statement
+ * 
+ * @return Number of statements converted
+ * 
+ * @note This is the whole of a decoder tool: call it from main with the log file and std::cout.
+ */
+inline uint64_t DecodeBinaryLog(std::istream& input, std::ostream& output) {
+  BinaryLogReader reader(input);
+  BinaryLogEntry entry;
+  uint64_t count = 0;
+  while (reader.Next(entry)) {
+    std::string line = entry.ToString();
+    output.write(line.data(), static_cast<std::streamsize>(line.size()));
+    ++count;
+  }
+  return count;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_BINARY_LOG_H_
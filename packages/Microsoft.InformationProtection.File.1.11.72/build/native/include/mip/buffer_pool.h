@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines the BufferPoolDelegate interface and a default fixed-size block pool
+ * 
+ * @file buffer_pool.h
+ */
+
+#ifndef API_MIP_BUFFER_POOL_H_
+#define API_MIP_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/memory_resource.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A class that defines the interface to a pool of fixed-size I/O buffers
+ * 
+ * @note Applications can implement this interface to supply their own allocator, for example a NUMA-local,
+ *       thread-cached slab pool. Implementations must be thread-safe.
+ */
+class BufferPoolDelegate {
+public:
+  /**
+   * @brief Get the size (in bytes) of every block handed out by the pool
+   * 
+   * @return Block size
+   */
+  virtual size_t GetBlockSize() const = 0;
+
+  /**
+   * @brief Acquire a block of GetBlockSize() bytes
+   * 
+   * @return Pointer to the block
+   */
+  virtual uint8_t* Acquire() = 0;
+
+  /**
+   * @brief Return a block previously obtained from Acquire
+   * 
+   * @param block Pointer to the block
+   */
+  virtual void Release(uint8_t* block) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~BufferPoolDelegate() {}
+protected:
+  BufferPoolDelegate() {}
+  /** @endcond */
+};
+
+/**
+ * @brief A thread-safe BufferPoolDelegate that keeps released blocks on a free list for reuse
+ */
+class FixedSizeBufferPool : public BufferPoolDelegate {
+public:
+  /**
+   * @brief FixedSizeBufferPool constructor
+   * 
+   * @param blockSize Size (in bytes) of every block
+   * @param maxRetainedBlocks Maximum number of released blocks kept for reuse; extra blocks are freed
+   * @param memoryResource Resource the blocks are allocated from, e.g. a per-tenant arena; nullptr to use the
+   *        global operator new
+   */
+  FixedSizeBufferPool(
+      size_t blockSize,
+      size_t maxRetainedBlocks,
+      const std::shared_ptr<MemoryResource>& memoryResource = nullptr)
+      : mBlockSize(blockSize),
+        mMaxRetainedBlocks(maxRetainedBlocks),
+        mMemoryResource(memoryResource ? memoryResource : GetDefaultMemoryResource()) {
+    if (mBlockSize == 0) {
+      throw BadInputError("FixedSizeBufferPool block size must be positive");
+    }
+  }
+
+  /**
+   * @brief Get the size (in bytes) of every block handed out by the pool
+   * 
+   * @return Block size
+   */
+  size_t GetBlockSize() const override { return mBlockSize; }
+
+  /**
+   * @brief Acquire a block of GetBlockSize() bytes, reusing a released block if one is available
+   * 
+   * @return Pointer to the block
+   */
+  uint8_t* Acquire() override {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!mFreeBlocks.empty()) {
+        uint8_t* block = mFreeBlocks.back();
+        mFreeBlocks.pop_back();
+        return block;
+      }
+    }
+    return static_cast<uint8_t*>(mMemoryResource->Allocate(mBlockSize));
+  }
+
+  /**
+   * @brief Return a block previously obtained from Acquire
+   * 
+   * @param block Pointer to the block
+   */
+  void Release(uint8_t* block) override {
+    if (block == nullptr) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mFreeBlocks.size() < mMaxRetainedBlocks) {
+        mFreeBlocks.push_back(block);
+        return;
+      }
+    }
+    mMemoryResource->Deallocate(block, mBlockSize);
+  }
+
+  /**
+   * @brief Get the number of released blocks currently kept for reuse
+   * 
+   * @return Number of retained blocks
+   */
+  size_t GetRetainedBlockCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFreeBlocks.size();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~FixedSizeBufferPool() {
+    for (uint8_t* block : mFreeBlocks) {
+      mMemoryResource->Deallocate(block, mBlockSize);
+    }
+  }
+
+  FixedSizeBufferPool(const FixedSizeBufferPool&) = delete;
+  FixedSizeBufferPool& operator=(const FixedSizeBufferPool&) = delete;
+
+private:
+  size_t mBlockSize;
+  size_t mMaxRetainedBlocks;
+  std::shared_ptr<MemoryResource> mMemoryResource;
+  mutable std::mutex mMutex;
+  std::vector<uint8_t*> mFreeBlocks;
+  /** @endcond */
+};
+
+/**
+ * @brief Scoped ownership of a block acquired from a BufferPoolDelegate, released back to the pool on destruction
+ */
+class PooledBuffer {
+public:
+  /**
+   * @brief PooledBuffer constructor
+   * 
+   * @param pool Pool to acquire the block from
+   */
+  explicit PooledBuffer(const std::shared_ptr<BufferPoolDelegate>& pool)
+      : mPool(pool),
+        mBlock(pool ? pool->Acquire() : nullptr) {
+    if (!mPool) {
+      throw BadInputError("PooledBuffer requires a buffer pool");
+    }
+  }
+
+  /**
+   * @brief Get the block
+   * 
+   * @return Pointer to the block
+   */
+  uint8_t* Data() const { return mBlock; }
+
+  /**
+   * @brief Get the size (in bytes) of the block
+   * 
+   * @return Block size
+   */
+  size_t Size() const { return mPool->GetBlockSize(); }
+
+  /** @cond DOXYGEN_HIDE */
+  PooledBuffer(PooledBuffer&& other) noexcept : mPool(std::move(other.mPool)), mBlock(other.mBlock) {
+    other.mBlock = nullptr;
+  }
+
+  ~PooledBuffer() {
+    if (mPool && mBlock != nullptr) {
+      mPool->Release(mBlock);
+    }
+  }
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(PooledBuffer&&) = delete;
+
+private:
+  std::shared_ptr<BufferPoolDelegate> mPool;
+  uint8_t* mBlock;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_BUFFER_POOL_H_
@@ -0,0 +1,297 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a block-caching, read-ahead Stream decorator
+ * 
+ * @file buffered_stream.h
+ */
+
+#ifndef API_MIP_BUFFERED_STREAM_H_
+#define API_MIP_BUFFERED_STREAM_H_
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A Stream decorator that caches fixed-size blocks of an inner stream and reads ahead on sequential access.
+ * 
+ * @note Small reads and seeks, such as those made while parsing a ZIP central directory, are served from cached
+ *       blocks. When a miss directly follows the previously loaded block, the next readAheadBlocks blocks are fetched
+ *       in the same inner read. Writes go straight through to the inner stream and invalidate the cached blocks they
+ *       overlap, so Position and Size always agree with the inner stream.
+ */
+class BufferedStream : public Stream {
+public:
+  /**
+   * @brief BufferedStream constructor
+   * 
+   * @param innerStream Stream being decorated
+   * @param blockSize Size (in bytes) of each cached block
+   * @param readAheadBlocks Number of additional blocks fetched on a sequential miss
+   * @param maxCachedBlocks Maximum number of blocks kept in the cache, 0 to size it from @p readAheadBlocks
+   */
+  BufferedStream(
+      const std::shared_ptr<Stream>& innerStream,
+      int64_t blockSize,
+      int64_t readAheadBlocks,
+      int64_t maxCachedBlocks = 0)
+      : mInnerStream(innerStream),
+        mBlockSize(blockSize),
+        mReadAheadBlocks((std::max)(readAheadBlocks, static_cast<int64_t>(0))),
+        mMaxCachedBlocks(maxCachedBlocks > 0 ? maxCachedBlocks : 2 * (mReadAheadBlocks + 1)),
+        mPosition(innerStream ? innerStream->Position() : 0),
+        mLastLoadedBlock(-1) {
+    if (!mInnerStream) {
+      throw BadInputError("BufferedStream requires an inner stream");
+    }
+    if (mBlockSize <= 0) {
+      throw BadInputError("BufferedStream block size must be positive");
+    }
+    mMaxCachedBlocks = (std::max)(mMaxCachedBlocks, mReadAheadBlocks + 1);
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t totalBytesRead = 0;
+    while (totalBytesRead < bufferLength) {
+      int64_t blockIndex = mPosition / mBlockSize;
+      int64_t offsetInBlock = mPosition % mBlockSize;
+      int64_t remaining = bufferLength - totalBytesRead;
+      if (offsetInBlock == 0 && remaining >= mBlockSize && mIndex.find(blockIndex) == mIndex.end()) {
+        // Large aligned reads gain nothing from the cache, so read them straight into the caller's buffer
+        int64_t directLength = remaining - (remaining % mBlockSize);
+        mInnerStream->Seek(mPosition);
+        int64_t bytesRead = ReadFromStream(mInnerStream, buffer + totalBytesRead, directLength);
+        mLastLoadedBlock = (mPosition + bytesRead - 1) / mBlockSize;
+        mPosition += bytesRead;
+        totalBytesRead += bytesRead;
+        if (bytesRead < directLength) {
+          break;
+        }
+        continue;
+      }
+      const std::vector<uint8_t>& block = GetBlock(blockIndex);
+      if (offsetInBlock >= static_cast<int64_t>(block.size())) {
+        break;
+      }
+      int64_t bytesToCopy = (std::min)(remaining, static_cast<int64_t>(block.size()) - offsetInBlock);
+      std::memcpy(buffer + totalBytesRead, block.data() + offsetInBlock, static_cast<size_t>(bytesToCopy));
+      mPosition += bytesToCopy;
+      totalBytesRead += bytesToCopy;
+    }
+    return totalBytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    mInnerStream->Seek(mPosition);
+    int64_t bytesWritten = mInnerStream->Write(buffer, bufferLength);
+    if (bytesWritten > 0) {
+      Invalidate(mPosition / mBlockSize, (mPosition + bytesWritten - 1) / mBlockSize);
+      mPosition += bytesWritten;
+    }
+    return bytesWritten;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override { return mInnerStream->Flush(); }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mPosition = (std::max)(position, static_cast<int64_t>(0)); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mInnerStream->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mInnerStream->CanWrite(); }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mInnerStream->Size(); }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t value) override {
+    mInnerStream->Size(value);
+    mBlocks.clear();
+    mIndex.clear();
+    mLastLoadedBlock = -1;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~BufferedStream() { }
+
+protected:
+  struct CachedBlock {
+    int64_t index;
+    std::vector<uint8_t> data;
+  };
+
+  const std::vector<uint8_t>& GetBlock(int64_t blockIndex) {
+    auto cached = mIndex.find(blockIndex);
+    if (cached != mIndex.end()) {
+      mBlocks.splice(mBlocks.begin(), mBlocks, cached->second);
+      return cached->second->data;
+    }
+    int64_t blockCount = blockIndex == mLastLoadedBlock + 1 ? mReadAheadBlocks + 1 : 1;
+    LoadBlocks(blockIndex, blockCount);
+    cached = mIndex.find(blockIndex);
+    if (cached == mIndex.end()) {
+      static const std::vector<uint8_t> kEmptyBlock;
+      return kEmptyBlock;
+    }
+    return cached->second->data;
+  }
+
+  void LoadBlocks(int64_t firstBlockIndex, int64_t blockCount) {
+    mScratch.resize(static_cast<size_t>(blockCount * mBlockSize));
+    mInnerStream->Seek(firstBlockIndex * mBlockSize);
+    int64_t bytesRead = ReadFromStream(mInnerStream, mScratch.data(), static_cast<int64_t>(mScratch.size()));
+    mLastLoadedBlock = firstBlockIndex + blockCount - 1;
+    // Insert in reverse so that the requested block ends up most recently used
+    for (int64_t i = blockCount - 1; i >= 0; --i) {
+      int64_t blockStart = i * mBlockSize;
+      if (blockStart >= bytesRead) {
+        continue;
+      }
+      int64_t blockLength = (std::min)(mBlockSize, bytesRead - blockStart);
+      InsertBlock(firstBlockIndex + i, mScratch.data() + blockStart, blockLength);
+    }
+  }
+
+  void InsertBlock(int64_t blockIndex, const uint8_t* data, int64_t length) {
+    auto existing = mIndex.find(blockIndex);
+    if (existing != mIndex.end()) {
+      mBlocks.erase(existing->second);
+      mIndex.erase(existing);
+    }
+    std::vector<uint8_t> blockData;
+    if (static_cast<int64_t>(mBlocks.size()) >= mMaxCachedBlocks) {
+      // Recycle the least recently used block's storage
+      blockData.swap(mBlocks.back().data);
+      mIndex.erase(mBlocks.back().index);
+      mBlocks.pop_back();
+    }
+    blockData.assign(data, data + length);
+    mBlocks.push_front(CachedBlock{blockIndex, std::move(blockData)});
+    mIndex[blockIndex] = mBlocks.begin();
+  }
+
+  void Invalidate(int64_t firstBlockIndex, int64_t lastBlockIndex) {
+    for (auto it = mBlocks.begin(); it != mBlocks.end();) {
+      if (it->index >= firstBlockIndex && it->index <= lastBlockIndex) {
+        mIndex.erase(it->index);
+        it = mBlocks.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::shared_ptr<Stream> mInnerStream;
+  int64_t mBlockSize;
+  int64_t mReadAheadBlocks;
+  int64_t mMaxCachedBlocks;
+  int64_t mPosition;
+  int64_t mLastLoadedBlock;
+  std::list<CachedBlock> mBlocks;
+  std::unordered_map<int64_t, std::list<CachedBlock>::iterator> mIndex;
+  std::vector<uint8_t> mScratch;
+  /** @endcond */
+}; // class BufferedStream
+
+/**
+ * @brief Creates a block-caching, read-ahead Stream over another stream
+ * 
+ * @param innerStream Stream being decorated, for example one returned by CreateStreamFromStdStream
+ * @param bufferSize Size (in bytes) of each cached block
+ * @param readAheadBlocks Number of additional blocks fetched when reads are sequential
+ * 
+ * @return Buffered stream
+ */
+inline std::shared_ptr<Stream> CreateBufferedStream(
+    const std::shared_ptr<Stream>& innerStream,
+    int64_t bufferSize = 64 * 1024,
+    int64_t readAheadBlocks = 4) {
+  return std::make_shared<BufferedStream>(innerStream, bufferSize, readAheadBlocks);
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_BUFFERED_STREAM_H_
@@ -0,0 +1,637 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines CachingAuthDelegate, which keeps OAuth2 tokens until they expire and refreshes them ahead of time
+ * 
+ * @file caching_auth_delegate.h
+ */
+
+#ifndef API_MIP_CACHING_AUTH_DELEGATE_H_
+#define API_MIP_CACHING_AUTH_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/timer_wheel.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a CachingAuthDelegate
+ */
+struct CachingAuthDelegateSettings {
+  /** Tokens are refreshed in the background once they expire within this time, or halfway through a shorter life */
+  std::chrono::seconds refreshAhead{300};
+  /** Tokens are not handed out once they expire within this time, so that they are still valid when presented */
+  std::chrono::seconds expirySkew{60};
+  /** Lifetime of tokens whose expiry cannot be read */
+  std::chrono::seconds defaultLifetime{300};
+  /** Refresh tokens used since their last refresh on a timer, before anyone asks for them again */
+  bool isProactiveRefreshEnabled = true;
+  /** Most tokens kept, the oldest are dropped first */
+  size_t maxEntries = 10000;
+  /** Runs background refreshes, new std::threads if not set */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+  /**
+   * Reads a token's expiry, returning false if it cannot. By default the exp claim of JWT access tokens is read.
+   */
+  std::function<bool(const AuthDelegate::OAuth2Token&, std::chrono::system_clock::time_point&)> getExpiry;
+};
+
+/**
+ * @brief Counters of a CachingAuthDelegate
+ */
+struct CachingAuthStatistics {
+  uint64_t hitCount = 0;            /**< Acquisitions answered from the cache */
+  uint64_t missCount = 0;           /**< Acquisitions that called the wrapped delegate */
+  uint64_t coalescedCount = 0;      /**< Acquisitions that waited for another caller's acquisition of the same key */
+  uint64_t refreshCount = 0;        /**< Background refreshes started */
+  uint64_t refreshFailureCount = 0; /**< Background refreshes that failed, the previous token was kept */
+  size_t cachedCount = 0;           /**< Tokens currently cached */
+};
+
+/**
+ * @brief One token to acquire with CachingAuthDelegate::Prefetch
+ */
+struct AuthTokenRequest {
+  Identity identity;                       /**< User, e.g. the account scanning a tenant */
+  AuthDelegate::OAuth2Challenge challenge; /**< Authority of the tenant and resource of the service */
+};
+
+/**
+ * @brief Outcome of one token acquired by CachingAuthDelegate::Prefetch
+ */
+struct AuthTokenPrefetchResult {
+  bool isAcquired = false;  /**< A token is cached */
+  std::string errorMessage; /**< Error message set by the wrapped delegate on failure */
+  std::exception_ptr error; /**< Exception thrown by the wrapped delegate, nullptr if none */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace authcache {
+
+// Runs work(index) for every index, on up to maxParallel threads including the calling one
+inline void ForEachParallel(
+    size_t count,
+    size_t maxParallel,
+    const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+    const std::function<void(size_t)>& work) {
+  struct Progress {
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t next = 0;
+    size_t completed = 0;
+  };
+  auto progress = std::make_shared<Progress>();
+  auto run = [progress, count, work]() {
+    for (;;) {
+      size_t index;
+      {
+        std::lock_guard<std::mutex> lock(progress->mutex);
+        if (progress->next >= count) {
+          return;
+        }
+        index = progress->next++;
+      }
+      work(index);
+      std::lock_guard<std::mutex> lock(progress->mutex);
+      ++progress->completed;
+      progress->condition.notify_all();
+    }
+  };
+  size_t workerCount = (std::min)((std::max)(maxParallel, static_cast<size_t>(1)), count);
+  std::vector<std::thread> threads;
+  static std::atomic<uint64_t> sTaskCounter(0);
+  for (size_t i = 1; i < workerCount; ++i) {
+    if (taskDispatcher) {
+      taskDispatcher->DispatchTask("mip-auth-prefetch-" + std::to_string(++sTaskCounter), run);
+    } else {
+      threads.emplace_back(run);
+    }
+  }
+  run();
+  {
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    // Dispatched workers that start after the last index was taken return at once
+    progress->condition.wait(lock, [&progress, count] { return progress->completed == count; });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+inline std::string DecodeBase64Url(const std::string& value, size_t begin, size_t end) {
+  std::string decoded;
+  decoded.reserve((end - begin) * 3 / 4);
+  uint32_t buffer = 0;
+  int bits = 0;
+  for (size_t i = begin; i < end; ++i) {
+    char c = value[i];
+    uint32_t digit;
+    if (c >= 'A' && c <= 'Z') {
+      digit = static_cast<uint32_t>(c - 'A');
+    } else if (c >= 'a' && c <= 'z') {
+      digit = static_cast<uint32_t>(c - 'a' + 26);
+    } else if (c >= '0' && c <= '9') {
+      digit = static_cast<uint32_t>(c - '0' + 52);
+    } else if (c == '-' || c == '+') {
+      digit = 62;
+    } else if (c == '_' || c == '/') {
+      digit = 63;
+    } else {
+      break;
+    }
+    buffer = (buffer << 6) | digit;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      decoded.push_back(static_cast<char>((buffer >> bits) & 0xFF));
+    }
+  }
+  return decoded;
+}
+
+// Reads the numeric exp claim of a JWT without validating the token, which is the service's job
+inline bool GetJwtExpiry(const AuthDelegate::OAuth2Token& token, std::chrono::system_clock::time_point& expiry) {
+  const std::string& accessToken = token.GetAccessToken();
+  size_t payloadBegin = accessToken.find('.');
+  size_t payloadEnd = payloadBegin == std::string::npos ? payloadBegin : accessToken.find('.', payloadBegin + 1);
+  if (payloadEnd == std::string::npos) {
+    return false;
+  }
+  std::string payload = DecodeBase64Url(accessToken, payloadBegin + 1, payloadEnd);
+  size_t claim = payload.find("\"exp\"");
+  if (claim == std::string::npos) {
+    return false;
+  }
+  size_t position = claim + 5;
+  while (position < payload.size() && (std::isspace(static_cast<unsigned char>(payload[position])) ||
+      payload[position] == ':')) {
+    ++position;
+  }
+  int64_t seconds = 0;
+  size_t digitsBegin = position;
+  while (position < payload.size() && payload[position] >= '0' && payload[position] <= '9' &&
+      position - digitsBegin < 18) {
+    seconds = seconds * 10 + (payload[position++] - '0');
+  }
+  if (position == digitsBegin) {
+    return false;
+  }
+  expiry = std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+  return true;
+}
+
+inline std::string ToLower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(),
+      [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+  return value;
+}
+
+inline std::string GetKey(const Identity& identity, const AuthDelegate::OAuth2Challenge& challenge) {
+  return ToLower(identity.GetEmail()) + '\n' + ToLower(challenge.GetAuthority()) + '\n' + challenge.GetResource() +
+      '\n' + challenge.GetScope() + '\n' + challenge.GetClaims();
+}
+
+struct Flight {
+  bool isDone = false;
+  bool isAcquired = false;
+  AuthDelegate::OAuth2Token token;
+  std::exception_ptr error;
+};
+
+struct Entry {
+  explicit Entry(const Identity& identity) : identity(identity) {}
+
+  AuthDelegate::OAuth2Token token;
+  Identity identity;
+  std::shared_ptr<const AuthDelegate::OAuth2Challenge> challenge;
+  std::weak_ptr<void> context;
+  std::chrono::system_clock::time_point expiry;
+  std::chrono::system_clock::time_point refreshAt;
+  bool isUsed = false;
+  bool isRefreshing = false;
+  TimerHandle timer;
+  std::list<std::string>::iterator position;
+};
+
+} // namespace authcache
+/** @endcond */
+
+/**
+ * @brief AuthDelegate decorator that caches tokens by identity, authority, resource, scope and claims
+ * 
+ * @note Pass it to the engine settings in place of the application's AuthDelegate. A cached token is handed out
+ *       until it is within CachingAuthDelegateSettings::expirySkew of its expiry. Once it is within
+ *       CachingAuthDelegateSettings::refreshAhead, the caller still gets it and a background refresh fetches the
+ *       next one. Tokens used since their last refresh are also refreshed on a timer at that point, so steady
+ *       traffic never waits for the wrapped delegate. Concurrent acquisitions of the same key share one call to the
+ *       wrapped delegate, including its failure. Failed acquisitions are not cached. A challenge with claims is a
+ *       key of its own, so a claims challenge always reaches the wrapped delegate.
+ */
+class CachingAuthDelegate : public AuthDelegate {
+public:
+  /**
+   * @brief CachingAuthDelegate constructor
+   * 
+   * @param authDelegate Delegate acquiring the tokens
+   * @param settings Refresh timing and cache size
+   */
+  explicit CachingAuthDelegate(
+      const std::shared_ptr<AuthDelegate>& authDelegate,
+      const CachingAuthDelegateSettings& settings = CachingAuthDelegateSettings())
+      : mState(std::make_shared<State>()) {
+    if (!authDelegate) {
+      throw BadInputError("CachingAuthDelegate requires an AuthDelegate");
+    }
+    mState->inner = authDelegate;
+    mState->settings = settings;
+    if (!mState->settings.getExpiry) {
+      mState->settings.getExpiry = authcache::GetJwtExpiry;
+    }
+    if (settings.isProactiveRefreshEnabled) {
+      mTimerWheel = std::make_shared<TimerWheel>();
+      mState->timerWheel = mTimerWheel;
+    }
+  }
+
+  /**
+   * @brief Acquire a token, from the cache if possible
+   * 
+   * @param identity User
+   * @param challenge Authority, resource, scope and claims
+   * @param token [Output] Token
+   * 
+   * @return True if a token was acquired
+   */
+  bool AcquireOAuth2Token(const Identity& identity, const OAuth2Challenge& challenge, OAuth2Token& token) override {
+    return AcquireOAuth2Token(identity, challenge, nullptr, token);
+  }
+
+  /**
+   * @brief Acquire a token, from the cache if possible
+   * 
+   * @param identity User
+   * @param challenge Authority, resource, scope and claims
+   * @param context Opaque context passed to the API that needed the token, also used by background refreshes while
+   *        it is alive
+   * @param token [Output] Token
+   * 
+   * @return True if a token was acquired
+   */
+  bool AcquireOAuth2Token(
+      const Identity& identity,
+      const OAuth2Challenge& challenge,
+      const std::shared_ptr<void>& context,
+      OAuth2Token& token) override {
+    std::string key = authcache::GetKey(identity, challenge);
+    bool isRefreshDue = false;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      auto entry = mState->entries.find(key);
+      auto now = std::chrono::system_clock::now();
+      if (entry != mState->entries.end() && now + mState->settings.expirySkew < entry->second.expiry) {
+        ++mState->hitCount;
+        token = entry->second.token;
+        entry->second.isUsed = true;
+        if (context) {
+          entry->second.context = context;
+        }
+        if (entry->second.isRefreshing || now < entry->second.refreshAt) {
+          return true;
+        }
+        entry->second.isRefreshing = true;
+        isRefreshDue = true;
+      }
+    }
+    if (isRefreshDue) {
+      // The caller keeps the cached token, the next one is fetched in the background
+      StartRefresh(mState, key);
+      return true;
+    }
+    bool isStarted = false;
+    return Load(mState, key, identity, std::make_shared<const OAuth2Challenge>(challenge), context, token, true,
+        isStarted);
+  }
+
+  /**
+   * @brief Acquire and cache many tokens concurrently, e.g. for every tenant of a scheduled scan
+   * 
+   * @param requests Identities and challenges, typically the policy and protection resources of each tenant
+   * @param maxParallel Acquisitions in flight at once, the calling thread included
+   * 
+   * @return One result per request, in the same order
+   * 
+   * @note Tokens already cached are not acquired again. The acquisitions run on the settings' task dispatcher, or
+   *       new std::threads, and the call returns once all of them are done. Prefetched tokens count as used, so
+   *       they are refreshed once ahead of expiry even if the scan has not asked for them yet.
+   */
+  std::vector<AuthTokenPrefetchResult> Prefetch(
+      const std::vector<AuthTokenRequest>& requests,
+      size_t maxParallel = 16) {
+    std::vector<AuthTokenPrefetchResult> results(requests.size());
+    authcache::ForEachParallel(requests.size(), maxParallel, mState->settings.taskDispatcher,
+        [this, &requests, &results](size_t index) {
+          OAuth2Token token;
+          try {
+            results[index].isAcquired = AcquireOAuth2Token(requests[index].identity, requests[index].challenge,
+                nullptr, token);
+          } catch (...) {
+            results[index].error = std::current_exception();
+          }
+          results[index].errorMessage = token.GetErrorMessage();
+        });
+    return results;
+  }
+
+  /**
+   * @brief Drop the cached token of an identity and challenge, e.g. after a service rejected it
+   * 
+   * @param identity User
+   * @param challenge Authority, resource, scope and claims
+   */
+  void Invalidate(const Identity& identity, const OAuth2Challenge& challenge) {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    auto entry = mState->entries.find(authcache::GetKey(identity, challenge));
+    if (entry != mState->entries.end()) {
+      mState->EraseLocked(entry);
+    }
+  }
+
+  /**
+   * @brief Drop every cached token
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    while (!mState->entries.empty()) {
+      mState->EraseLocked(mState->entries.begin());
+    }
+  }
+
+  /**
+   * @brief Get the cache counters
+   * 
+   * @return Counters
+   */
+  CachingAuthStatistics GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    CachingAuthStatistics statistics;
+    statistics.hitCount = mState->hitCount;
+    statistics.missCount = mState->missCount;
+    statistics.coalescedCount = mState->coalescedCount;
+    statistics.refreshCount = mState->refreshCount;
+    statistics.refreshFailureCount = mState->refreshFailureCount;
+    statistics.cachedCount = mState->entries.size();
+    return statistics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Refreshes and timers can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    std::shared_ptr<AuthDelegate> inner;
+    CachingAuthDelegateSettings settings;
+    std::weak_ptr<TimerWheel> timerWheel;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::unordered_map<std::string, authcache::Entry> entries;
+    std::list<std::string> order; // least recently stored first
+    std::unordered_map<std::string, std::shared_ptr<authcache::Flight>> flights;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint64_t coalescedCount = 0;
+    uint64_t refreshCount = 0;
+    uint64_t refreshFailureCount = 0;
+
+    void EraseLocked(std::unordered_map<std::string, authcache::Entry>::iterator entry) {
+      if (auto wheel = timerWheel.lock()) {
+        wheel->Cancel(entry->second.timer);
+      }
+      order.erase(entry->second.position);
+      entries.erase(entry);
+    }
+  };
+
+  static bool Load(
+      const std::shared_ptr<State>& state,
+      const std::string& key,
+      const Identity& identity,
+      const std::shared_ptr<const OAuth2Challenge>& challenge,
+      const std::shared_ptr<void>& context,
+      OAuth2Token& token,
+      bool isWaiting,
+      bool& isStarted) {
+    std::shared_ptr<authcache::Flight> flight;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      auto existing = state->flights.find(key);
+      if (existing != state->flights.end()) {
+        if (!isWaiting) {
+          return false;
+        }
+        ++state->coalescedCount;
+        flight = existing->second;
+        state->condition.wait(lock, [&flight] { return flight->isDone; });
+        if (flight->error) {
+          std::rethrow_exception(flight->error);
+        }
+        token = flight->token;
+        return flight->isAcquired;
+      }
+      flight = std::make_shared<authcache::Flight>();
+      state->flights.emplace(key, flight);
+      isStarted = true;
+      if (isWaiting) {
+        ++state->missCount;
+      }
+    }
+
+    OAuth2Token acquired;
+    try {
+      flight->isAcquired = state->inner->AcquireOAuth2Token(identity, *challenge, context, acquired);
+    } catch (...) {
+      flight->error = std::current_exception();
+    }
+    flight->token = acquired;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (flight->isAcquired) {
+        Store(state, key, identity, challenge, context, acquired, isWaiting);
+      }
+      state->flights.erase(key);
+      flight->isDone = true;
+    }
+    state->condition.notify_all();
+    if (flight->error) {
+      std::rethrow_exception(flight->error);
+    }
+    token = acquired;
+    return flight->isAcquired;
+  }
+
+  // Caller holds the mutex
+  static void Store(
+      const std::shared_ptr<State>& state,
+      const std::string& key,
+      const Identity& identity,
+      const std::shared_ptr<const OAuth2Challenge>& challenge,
+      const std::shared_ptr<void>& context,
+      const OAuth2Token& token,
+      bool isUsed) {
+    auto now = std::chrono::system_clock::now();
+    std::chrono::system_clock::time_point expiry;
+    if (!state->settings.getExpiry(token, expiry)) {
+      expiry = now + state->settings.defaultLifetime;
+    }
+    auto existing = state->entries.find(key);
+    if (existing != state->entries.end()) {
+      isUsed = isUsed || existing->second.isUsed;
+      state->EraseLocked(existing);
+    }
+    if (expiry <= now + state->settings.expirySkew) {
+      return;
+    }
+    state->order.push_back(key);
+    // Identity is copy-constructed, its implicit assignment is deprecated
+    authcache::Entry& entry = state->entries.emplace(
+        std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(identity)).first->second;
+    entry.token = token;
+    entry.challenge = challenge;
+    entry.context = context;
+    // A token living shorter than twice the refresh window is refreshed halfway through its life
+    auto lifetime = std::chrono::duration_cast<std::chrono::milliseconds>(expiry - now);
+    auto delay = (std::max)(lifetime - std::chrono::duration_cast<std::chrono::milliseconds>(
+        state->settings.refreshAhead), lifetime / 2);
+    entry.expiry = expiry;
+    entry.refreshAt = now + delay;
+    entry.isUsed = isUsed;
+    entry.position = std::prev(state->order.end());
+    if (auto wheel = state->timerWheel.lock()) {
+      std::weak_ptr<State> weakState = state;
+      entry.timer = wheel->Schedule(delay, [weakState, key]() { OnRefreshTimer(weakState, key); });
+    }
+    while (state->entries.size() > state->settings.maxEntries && !state->order.empty()) {
+      state->EraseLocked(state->entries.find(state->order.front()));
+    }
+  }
+
+  static void OnRefreshTimer(const std::weak_ptr<State>& weakState, const std::string& key) {
+    auto state = weakState.lock();
+    if (!state) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto entry = state->entries.find(key);
+      // A token nobody asked for since its last refresh is left to expire
+      if (entry == state->entries.end() || !entry->second.isUsed || entry->second.isRefreshing) {
+        return;
+      }
+      entry->second.isRefreshing = true;
+    }
+    StartRefresh(state, key);
+  }
+
+  static void StartRefresh(const std::shared_ptr<State>& state, const std::string& key) {
+    auto task = [state, key]() { Refresh(state, key); };
+    try {
+      if (state->settings.taskDispatcher) {
+        static std::atomic<uint64_t> sTaskCounter(0);
+        state->settings.taskDispatcher->DispatchTask("mip-auth-refresh-" + std::to_string(++sTaskCounter), task);
+      } else {
+        std::thread(task).detach();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto entry = state->entries.find(key);
+      if (entry != state->entries.end()) {
+        entry->second.isRefreshing = false;
+      }
+    }
+  }
+
+  static void Refresh(const std::shared_ptr<State>& state, const std::string& key) {
+    std::unique_ptr<const Identity> identity;
+    std::shared_ptr<const OAuth2Challenge> challenge;
+    std::shared_ptr<void> context;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto entry = state->entries.find(key);
+      if (entry == state->entries.end()) {
+        return;
+      }
+      identity.reset(new Identity(entry->second.identity));
+      challenge = entry->second.challenge;
+      context = entry->second.context.lock();
+      entry->second.isUsed = false;
+      ++state->refreshCount;
+    }
+    bool isAcquired = false;
+    bool isStarted = false;
+    OAuth2Token token;
+    try {
+      isAcquired = Load(state, key, *identity, challenge, context, token, false, isStarted);
+    } catch (...) {
+      // The previous token stays until it expires
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto entry = state->entries.find(key);
+    if (isStarted && !isAcquired) {
+      ++state->refreshFailureCount;
+    }
+    if (entry != state->entries.end()) {
+      entry->second.isRefreshing = false;
+    }
+  }
+
+  std::shared_ptr<State> mState;
+  // Declared last so that the timer thread stops before the state is released
+  std::shared_ptr<TimerWheel> mTimerWheel;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_CACHING_AUTH_DELEGATE_H_
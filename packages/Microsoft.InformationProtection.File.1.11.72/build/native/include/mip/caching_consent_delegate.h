@@ -0,0 +1,189 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines CachingConsentDelegate, which remembers AcceptAlways decisions so repeated URLs skip the delegate
+ * 
+ * @file caching_consent_delegate.h
+ */
+
+#ifndef API_MIP_CACHING_CONSENT_DELEGATE_H_
+#define API_MIP_CACHING_CONSENT_DELEGATE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a CachingConsentDelegate
+ */
+struct CachingConsentDelegateSettings {
+  std::string scope;                               /**< Partition of the decisions, e.g. the engine ID or user */
+  std::shared_ptr<StorageDelegate> storageDelegate; /**< Persists the decisions, in memory only if not set */
+  std::string storagePath;                         /**< Path passed to StorageDelegate::CreateStorageTable */
+};
+
+/**
+ * @brief Counters of a CachingConsentDelegate
+ */
+struct CachingConsentStatistics {
+  uint64_t hitCount = 0;   /**< Requests answered from the cache */
+  uint64_t missCount = 0;  /**< Requests passed to the wrapped delegate */
+  size_t cachedCount = 0;  /**< URLs currently remembered */
+};
+
+/**
+ * @brief ConsentDelegate decorator remembering the URLs consented to with Consent::AcceptAlways
+ * 
+ * @note Set it on the profile in place of the application's delegate. Once the wrapped delegate answers AcceptAlways
+ *       for a URL, later requests for the same URL, such as a tenant's licensing server or a DKE endpoint, are
+ *       answered without calling it. Accept and Reject are one-time answers and are not remembered. With a
+ *       StorageDelegate the decisions are written to a storage table and read back under the same scope, so a
+ *       reloaded engine skips both the prompts and the lookups. Use one scope per engine to keep the decisions of
+ *       engines apart.
+ */
+class CachingConsentDelegate : public ConsentDelegate {
+public:
+  /**
+   * @brief Wrap a delegate
+   * 
+   * @param inner Delegate asked for URLs without a remembered decision
+   * @param settings Scope and storage of the decisions
+   */
+  explicit CachingConsentDelegate(
+      const std::shared_ptr<ConsentDelegate>& inner,
+      const CachingConsentDelegateSettings& settings = CachingConsentDelegateSettings())
+      : mInner(inner),
+        mScope(settings.scope) {
+    if (!mInner) {
+      throw BadInputError("CachingConsentDelegate requires a ConsentDelegate");
+    }
+    if (settings.storageDelegate) {
+      StorageTableResult table = settings.storageDelegate->CreateStorageTable(settings.storagePath,
+          MipComponent::Protection, "mip_consent_decisions", {"scope", "url", "decision"}, {}, {"scope", "url"});
+      if (table.GetError()) {
+        throw *table.GetError();
+      }
+      mTable = table.GetData();
+      for (const auto& row : mTable->Find({"scope"}, {mScope})) {
+        if (row.size() >= 3 && row[2] == kAcceptAlways) {
+          mAccepted.insert(row[1]);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Answer from a remembered decision, or ask the wrapped delegate and remember AcceptAlways
+   * 
+   * @param url The URL for which the SDK requires user consent
+   * 
+   * @return The user's decision
+   */
+  Consent GetUserConsent(const std::string& url) override {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mAccepted.count(url) != 0) {
+        ++mHitCount;
+        return Consent::AcceptAlways;
+      }
+    }
+    ++mMissCount;
+    Consent consent = mInner->GetUserConsent(url);
+    if (consent == Consent::AcceptAlways) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mAccepted.insert(url).second && mTable) {
+        mTable->Insert({mScope, url, kAcceptAlways});
+      }
+    }
+    return consent;
+  }
+
+  /**
+   * @brief Forget the decision for a URL, so that the wrapped delegate is asked again
+   * 
+   * @param url URL consented to
+   */
+  void Revoke(const std::string& url) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mAccepted.erase(url) != 0 && mTable) {
+      mTable->Delete({"scope", "url"}, {mScope, url});
+    }
+  }
+
+  /**
+   * @brief Forget every decision of the scope
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mAccepted.clear();
+    if (mTable) {
+      mTable->Delete({"scope"}, {mScope});
+    }
+  }
+
+  /**
+   * @brief Get the counters of the cache
+   * 
+   * @return Statistics
+   */
+  CachingConsentStatistics GetStatistics() const {
+    CachingConsentStatistics statistics;
+    statistics.hitCount = mHitCount;
+    statistics.missCount = mMissCount;
+    std::lock_guard<std::mutex> lock(mMutex);
+    statistics.cachedCount = mAccepted.size();
+    return statistics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static constexpr const char* kAcceptAlways = "AcceptAlways";
+
+  std::shared_ptr<ConsentDelegate> mInner;
+  std::string mScope;
+  std::shared_ptr<StorageTable> mTable;
+  mutable std::mutex mMutex;
+  std::unordered_set<std::string> mAccepted;
+  std::atomic<uint64_t> mHitCount{0};
+  std::atomic<uint64_t> mMissCount{0};
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_CACHING_CONSENT_DELEGATE_H_
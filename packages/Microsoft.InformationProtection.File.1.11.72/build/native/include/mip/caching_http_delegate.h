@@ -0,0 +1,630 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines CachingHttpDelegate, which serves repeated requests from a Cache-Control and ETag aware cache
+ * 
+ * @file caching_http_delegate.h
+ */
+
+#ifndef API_MIP_CACHING_HTTP_DELEGATE_H_
+#define API_MIP_CACHING_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_body.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a CachingHttpDelegate
+ */
+struct CachingHttpDelegateSettings {
+  /** Most responses kept in memory */
+  size_t maxEntries = 1024;
+  /** Most response body bytes kept in memory */
+  size_t maxBytes = 64 * 1024 * 1024;
+  /** Headers identifying the caller; cached responses are only shared between requests where these are equal */
+  std::vector<std::string> identityHeaders = {"Authorization"};
+  /** Decides whether a request may be answered from the cache; by default GET requests are */
+  std::function<bool(const HttpRequest&)> isCacheable;
+  /** Persists responses across processes and engines if set */
+  std::shared_ptr<StorageDelegate> storageDelegate;
+  /** Path passed to StorageDelegate::CreateStorageTable */
+  std::string storagePath;
+  /** Budget the in-memory responses account against, as MemoryCategory::HttpCache, if set */
+  std::shared_ptr<MemoryBudget> memoryBudget;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace cachinghttp {
+
+typedef std::map<std::string, std::string, CaseInsensitiveComparator> Headers;
+
+struct Entry {
+  int32_t statusCode = 0;
+  Headers headers;
+  std::shared_ptr<const std::vector<uint8_t>> body;
+  int64_t storedAt = 0;       // seconds since the epoch, adjusted by the Age header
+  int64_t maxAge = -1;        // seconds, -1 when the response carried no max-age
+  bool isRevalidationRequired = false;
+  std::string etag;
+  std::string lastModified;
+};
+
+struct CacheControl {
+  bool isNoStore = false;
+  bool isNoCache = false;
+  int64_t maxAge = -1;
+};
+
+inline int64_t GetNow() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline std::string GetHeader(const Headers& headers, const std::string& name) {
+  auto header = headers.find(name);
+  return header == headers.end() ? std::string() : header->second;
+}
+
+inline CacheControl ParseCacheControl(const Headers& headers) {
+  CacheControl cacheControl;
+  std::string value = GetHeader(headers, "Cache-Control");
+  std::transform(value.begin(), value.end(), value.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  size_t start = 0;
+  while (start < value.size()) {
+    size_t end = value.find(',', start);
+    std::string directive = value.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    directive.erase(0, directive.find_first_not_of(" \t"));
+    directive.erase(directive.find_last_not_of(" \t") + 1);
+    if (directive == "no-store") {
+      cacheControl.isNoStore = true;
+    } else if (directive == "no-cache" || directive == "must-revalidate") {
+      cacheControl.isNoCache = true;
+    } else if (directive.compare(0, 8, "max-age=") == 0) {
+      cacheControl.maxAge = std::strtoll(directive.c_str() + 8, nullptr, 10);
+    }
+    start = end == std::string::npos ? value.size() : end + 1;
+  }
+  if (GetHeader(headers, "Pragma") == "no-cache" && GetHeader(headers, "Cache-Control").empty()) {
+    cacheControl.isNoCache = true;
+  }
+  return cacheControl;
+}
+
+// Applies the freshness information of a 200 or 304 response
+inline void SetFreshness(Entry& entry, const Headers& headers) {
+  CacheControl cacheControl = ParseCacheControl(headers);
+  entry.storedAt = GetNow() - std::strtoll(GetHeader(headers, "Age").c_str(), nullptr, 10);
+  entry.maxAge = cacheControl.maxAge;
+  entry.isRevalidationRequired = cacheControl.isNoCache;
+  std::string etag = GetHeader(headers, "ETag");
+  if (!etag.empty()) {
+    entry.etag = etag;
+  }
+  std::string lastModified = GetHeader(headers, "Last-Modified");
+  if (!lastModified.empty()) {
+    entry.lastModified = lastModified;
+  }
+}
+
+inline bool IsFresh(const Entry& entry) {
+  return !entry.isRevalidationRequired && entry.maxAge > 0 && GetNow() - entry.storedAt < entry.maxAge;
+}
+
+inline std::string ToHex(const uint8_t* data, size_t size) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(size * 2);
+  for (size_t i = 0; i < size; ++i) {
+    hex += kDigits[data[i] >> 4];
+    hex += kDigits[data[i] & 0x0f];
+  }
+  return hex;
+}
+
+inline std::vector<uint8_t> FromHex(const std::string& hex) {
+  auto digit = [](char c) { return static_cast<uint8_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10); };
+  std::vector<uint8_t> data(hex.size() / 2);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>((digit(hex[i * 2]) << 4) | digit(hex[i * 2 + 1]));
+  }
+  return data;
+}
+
+// Two FNV-1a variants, so that a row key does not expose the identity headers it was derived from
+inline std::string GetStorageKey(const std::string& key) {
+  uint64_t hashes[2] = {14695981039346656037ULL, 9650029242287828579ULL};
+  for (uint64_t& hash : hashes) {
+    for (char c : key) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ULL;
+    }
+  }
+  return ToHex(reinterpret_cast<const uint8_t*>(hashes), sizeof(hashes));
+}
+
+// Request sent instead of the caller's to revalidate a stale entry
+class ConditionalRequest : public HttpRequest {
+public:
+  ConditionalRequest(const std::shared_ptr<HttpRequest>& request, const Entry& entry)
+      : mRequest(request), mHeaders(request->GetHeaders()) {
+    if (!entry.etag.empty()) {
+      mHeaders["If-None-Match"] = entry.etag;
+    }
+    if (!entry.lastModified.empty()) {
+      mHeaders["If-Modified-Since"] = entry.lastModified;
+    }
+  }
+  const std::string& GetId() const override { return mRequest->GetId(); }
+  HttpRequestType GetRequestType() const override { return mRequest->GetRequestType(); }
+  const std::string& GetUrl() const override { return mRequest->GetUrl(); }
+  const std::vector<uint8_t>& GetBody() const override { return mRequest->GetBody(); }
+  const Headers& GetHeaders() const override { return mHeaders; }
+  TransportLayerSecurityMinimumVersion GetTransportLayerSecurityMinimumVersion() const override {
+    return mRequest->GetTransportLayerSecurityMinimumVersion();
+  }
+
+private:
+  std::shared_ptr<HttpRequest> mRequest;
+  Headers mHeaders;
+};
+
+class CachedOperation : public HttpOperation {
+public:
+  CachedOperation(const std::string& id, const std::shared_ptr<HttpResponse>& response)
+      : mId(id), mResponse(response) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return false; }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+};
+
+} // namespace cachinghttp
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that answers repeated requests, such as template, tenant discovery and service
+ *        endpoint lookups, from a cache shared by every engine that uses it
+ * 
+ * @note Only 200 responses are stored, and only when they carry a positive max-age, an ETag or a Last-Modified
+ *       header and no "Cache-Control: no-store". A fresh entry is returned without reaching the transport. A stale
+ *       entry, or one marked no-cache or must-revalidate, is revalidated with If-None-Match/If-Modified-Since, and a
+ *       304 answer is turned into the cached 200 response. Entries are kept per identity headers, so users never see
+ *       each other's responses. With a StorageDelegate, entries also live in the "mip_http_cache" table (headers and
+ *       bodies in encrypted columns) and survive eviction from memory and process restarts; storage failures only
+ *       cost cache hits.
+ */
+class CachingHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Cache size, identity headers and optional storage tier
+   */
+  explicit CachingHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const CachingHttpDelegateSettings& settings = CachingHttpDelegateSettings())
+      : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("CachingHttpDelegate requires a transport HttpDelegate");
+    }
+    mState->transport = transport;
+    mState->settings = settings;
+    if (settings.storageDelegate) {
+      StorageTableResult table = settings.storageDelegate->CreateStorageTable(settings.storagePath,
+          MipComponent::File, "mip_http_cache", State::GetColumns(), {"headers", "body"}, {"key"});
+      if (table.GetError()) {
+        throw *table.GetError();
+      }
+      mState->table = table.GetData();
+    }
+    if (settings.memoryBudget) {
+      State* state = mState.get();
+      mState->memoryRegistration = settings.memoryBudget->Register(MemoryCategory::HttpCache,
+          [state]() { return state->GetBytes(); },
+          [state](int64_t maxBytes) { state->Trim(maxBytes); });
+    }
+  }
+
+  /**
+   * @brief Send HTTP request, or answer it from the cache
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    if (!mState->IsCacheable(*request)) {
+      return mState->transport->Send(request, context);
+    }
+    std::string key = mState->GetKey(*request);
+    std::shared_ptr<const cachinghttp::Entry> entry = mState->Find(key);
+    if (entry && cachinghttp::IsFresh(*entry)) {
+      ++mState->hitCount;
+      return State::CreateOperation(request->GetId(), *entry);
+    }
+    std::shared_ptr<HttpRequest> sent = request;
+    if (entry) {
+      sent = std::make_shared<cachinghttp::ConditionalRequest>(request, *entry);
+    }
+    return mState->Complete(request->GetId(), key, entry, mState->transport->Send(sent, context));
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, or answer it from the cache before returning
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    if (!mState->IsCacheable(*request)) {
+      return mState->transport->SendAsync(request, context, callbackFn);
+    }
+    std::string key = mState->GetKey(*request);
+    std::shared_ptr<const cachinghttp::Entry> entry = mState->Find(key);
+    if (entry && cachinghttp::IsFresh(*entry)) {
+      ++mState->hitCount;
+      auto operation = State::CreateOperation(request->GetId(), *entry);
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+      return operation;
+    }
+    std::shared_ptr<HttpRequest> sent = request;
+    if (entry) {
+      sent = std::make_shared<cachinghttp::ConditionalRequest>(request, *entry);
+    }
+    auto state = mState;
+    std::string requestId = request->GetId();
+    return mState->transport->SendAsync(sent, context, [state, requestId, key, entry, callbackFn](
+        std::shared_ptr<HttpOperation> operation) {
+      auto result = state->Complete(requestId, key, entry, operation);
+      if (callbackFn) {
+        callbackFn(result);
+      }
+    });
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /**
+   * @brief Drop every cached response, in memory and in storage
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->entries.clear();
+    mState->order.clear();
+    mState->bytes = 0;
+    if (mState->table) {
+      try {
+        for (const auto& row : mState->table->List()) {
+          if (!row.empty()) {
+            mState->table->Delete({"key"}, {row[0]});
+          }
+        }
+      } catch (...) {
+      }
+    }
+  }
+
+  /**
+   * @brief Get the number of requests answered from the cache without reaching the transport
+   */
+  uint64_t GetHitCount() const { return mState->hitCount; }
+
+  /**
+   * @brief Get the number of requests answered from the cache after a 304 revalidation
+   */
+  uint64_t GetRevalidatedCount() const { return mState->revalidatedCount; }
+
+  /**
+   * @brief Get the number of cacheable requests that needed a full response
+   */
+  uint64_t GetMissCount() const { return mState->missCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Async completions can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    struct Slot {
+      std::shared_ptr<const cachinghttp::Entry> entry;
+      std::list<std::string>::iterator position;
+    };
+
+    std::shared_ptr<HttpDelegate> transport;
+    CachingHttpDelegateSettings settings;
+    std::shared_ptr<StorageTable> table;
+    std::mutex mutex;
+    std::unordered_map<std::string, Slot> entries;
+    std::list<std::string> order; // most recently used first
+    size_t bytes = 0;
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> revalidatedCount{0};
+    std::atomic<uint64_t> missCount{0};
+    // Declared last so that the budget stops calling into the state before anything else is destroyed
+    std::shared_ptr<MemoryBudgetRegistration> memoryRegistration;
+
+    static std::vector<std::string> GetColumns() {
+      return {"key", "status", "headers", "body", "storedAt", "maxAge", "revalidate", "etag", "lastModified"};
+    }
+
+    bool IsCacheable(const HttpRequest& request) const {
+      const auto& headers = request.GetHeaders();
+      if (headers.count("If-None-Match") || headers.count("If-Modified-Since")) {
+        return false;
+      }
+      return settings.isCacheable ? settings.isCacheable(request) : request.GetRequestType() == HttpRequestType::Get;
+    }
+
+    std::string GetKey(const HttpRequest& request) const {
+      std::string key = (request.GetRequestType() == HttpRequestType::Post ? "POST " : "GET ") + request.GetUrl();
+      for (const auto& name : settings.identityHeaders) {
+        key += '\n';
+        key += cachinghttp::GetHeader(request.GetHeaders(), name);
+      }
+      return key;
+    }
+
+    static std::shared_ptr<HttpOperation> CreateOperation(
+        const std::string& requestId,
+        const cachinghttp::Entry& entry) {
+      return std::make_shared<cachinghttp::CachedOperation>(requestId,
+          std::make_shared<SharedBodyHttpResponse>(requestId, entry.statusCode, entry.headers, entry.body));
+    }
+
+    std::shared_ptr<HttpOperation> Complete(
+        const std::string& requestId,
+        const std::string& key,
+        const std::shared_ptr<const cachinghttp::Entry>& entry,
+        const std::shared_ptr<HttpOperation>& operation) {
+      std::shared_ptr<HttpResponse> response = operation ? operation->GetResponse() : nullptr;
+      if (!response || operation->IsCancelled()) {
+        return operation;
+      }
+      if (response->GetStatusCode() == 304 && entry) {
+        auto revalidated = std::make_shared<cachinghttp::Entry>(*entry);
+        cachinghttp::SetFreshness(*revalidated, response->GetHeaders());
+        Store(key, revalidated);
+        ++revalidatedCount;
+        return CreateOperation(requestId, *revalidated);
+      }
+      ++missCount;
+      if (response->GetStatusCode() != 200) {
+        return operation;
+      }
+      auto stored = std::make_shared<cachinghttp::Entry>();
+      stored->statusCode = response->GetStatusCode();
+      stored->headers = response->GetHeaders();
+      cachinghttp::SetFreshness(*stored, response->GetHeaders());
+      bool hasValidator = !stored->etag.empty() || !stored->lastModified.empty();
+      if (cachinghttp::ParseCacheControl(response->GetHeaders()).isNoStore || (stored->maxAge <= 0 && !hasValidator)) {
+        Remove(key);
+        return operation;
+      }
+      auto shared = std::dynamic_pointer_cast<SharedBodyHttpResponse>(response);
+      stored->body = shared ? shared->GetSharedBody()
+                            : std::make_shared<const std::vector<uint8_t>>(response->GetBody());
+      Store(key, stored);
+      return operation;
+    }
+
+    std::shared_ptr<const cachinghttp::Entry> Find(const std::string& key) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto slot = entries.find(key);
+        if (slot != entries.end()) {
+          order.splice(order.begin(), order, slot->second.position);
+          return slot->second.entry;
+        }
+      }
+      if (!table) {
+        return nullptr;
+      }
+      std::shared_ptr<cachinghttp::Entry> entry;
+      try {
+        auto rows = table->Find({"key"}, {cachinghttp::GetStorageKey(key)});
+        if (rows.empty() || rows[0].size() < GetColumns().size()) {
+          return nullptr;
+        }
+        const auto& row = rows[0];
+        entry = std::make_shared<cachinghttp::Entry>();
+        entry->statusCode = static_cast<int32_t>(std::strtol(row[1].c_str(), nullptr, 10));
+        size_t start = 0;
+        while (start < row[2].size()) {
+          size_t end = row[2].find('\n', start);
+          std::string line = row[2].substr(start, end == std::string::npos ? std::string::npos : end - start);
+          size_t colon = line.find(':');
+          if (colon != std::string::npos) {
+            entry->headers[line.substr(0, colon)] = line.substr(colon + 1);
+          }
+          start = end == std::string::npos ? row[2].size() : end + 1;
+        }
+        entry->body = std::make_shared<const std::vector<uint8_t>>(cachinghttp::FromHex(row[3]));
+        entry->storedAt = std::strtoll(row[4].c_str(), nullptr, 10);
+        entry->maxAge = std::strtoll(row[5].c_str(), nullptr, 10);
+        entry->isRevalidationRequired = row[6] == "1";
+        entry->etag = row[7];
+        entry->lastModified = row[8];
+      } catch (...) {
+        return nullptr;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        Insert(key, entry);
+      }
+      EnforceMemoryBudget();
+      return entry;
+    }
+
+    void Store(const std::string& key, const std::shared_ptr<const cachinghttp::Entry>& entry) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        Insert(key, entry);
+      }
+      EnforceMemoryBudget();
+      if (!table) {
+        return;
+      }
+      std::string headers;
+      for (const auto& header : entry->headers) {
+        if (header.first.find_first_of(":\n") == std::string::npos && header.second.find('\n') == std::string::npos) {
+          headers += header.first + ":" + header.second + "\n";
+        }
+      }
+      std::string storageKey = cachinghttp::GetStorageKey(key);
+      try {
+        table->Delete({"key"}, {storageKey});
+        table->Insert({storageKey, std::to_string(entry->statusCode), headers,
+            cachinghttp::ToHex(entry->body->data(), entry->body->size()), std::to_string(entry->storedAt),
+            std::to_string(entry->maxAge), entry->isRevalidationRequired ? "1" : "0", entry->etag,
+            entry->lastModified});
+      } catch (...) {
+      }
+    }
+
+    void Remove(const std::string& key) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto slot = entries.find(key);
+        if (slot != entries.end()) {
+          bytes -= slot->second.entry->body->size();
+          order.erase(slot->second.position);
+          entries.erase(slot);
+        }
+      }
+      if (table) {
+        try {
+          table->Delete({"key"}, {cachinghttp::GetStorageKey(key)});
+        } catch (...) {
+        }
+      }
+    }
+
+    // Caller holds the mutex. Evicted entries stay in storage.
+    void Insert(const std::string& key, const std::shared_ptr<const cachinghttp::Entry>& entry) {
+      auto slot = entries.find(key);
+      if (slot != entries.end()) {
+        bytes -= slot->second.entry->body->size();
+        order.erase(slot->second.position);
+        entries.erase(slot);
+      }
+      if (entry->body->size() > settings.maxBytes || settings.maxEntries == 0) {
+        return;
+      }
+      order.push_front(key);
+      entries[key] = Slot{entry, order.begin()};
+      bytes += entry->body->size();
+      while (entries.size() > settings.maxEntries || bytes > settings.maxBytes) {
+        EvictOldest();
+      }
+    }
+
+    // Caller holds the mutex
+    void EvictOldest() {
+      auto oldest = entries.find(order.back());
+      bytes -= oldest->second.entry->body->size();
+      entries.erase(oldest);
+      order.pop_back();
+    }
+
+    int64_t GetBytes() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return static_cast<int64_t>(bytes);
+    }
+
+    void Trim(int64_t maxBytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      while (!order.empty() && static_cast<int64_t>(bytes) > maxBytes) {
+        EvictOldest();
+      }
+    }
+
+    void EnforceMemoryBudget() {
+      if (settings.memoryBudget) {
+        settings.memoryBudget->Enforce();
+      }
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+}; // class CachingHttpDelegate
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_CACHING_HTTP_DELEGATE_H_
@@ -0,0 +1,391 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines CoalescingHttpDelegate, which sends identical concurrent requests to the service only once
+ * 
+ * @file coalescing_http_delegate.h
+ */
+
+#ifndef API_MIP_COALESCING_HTTP_DELEGATE_H_
+#define API_MIP_COALESCING_HTTP_DELEGATE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a CoalescingHttpDelegate
+ */
+struct CoalescingHttpDelegateSettings {
+  /** Headers identifying the caller; requests only coalesce when these are equal */
+  std::vector<std::string> identityHeaders = {"Authorization"};
+  /** Decides whether a request is idempotent and may be coalesced; by default GET requests are */
+  std::function<bool(const HttpRequest&)> isCoalescable;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace coalescinghttp {
+
+// Gives the shared response the ID of the request each waiter sent
+class WaiterResponse : public HttpResponse {
+public:
+  WaiterResponse(const std::string& id, const std::shared_ptr<HttpResponse>& response)
+      : mId(id), mResponse(response) {}
+  const std::string& GetId() const override { return mId; }
+  int32_t GetStatusCode() const override { return mResponse->GetStatusCode(); }
+  const std::vector<uint8_t>& GetBody() const override { return mResponse->GetBody(); }
+  const std::map<std::string, std::string, CaseInsensitiveComparator>& GetHeaders() const override {
+    return mResponse->GetHeaders();
+  }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+};
+
+class WaiterOperation : public HttpOperation {
+public:
+  WaiterOperation(const std::string& id, const std::shared_ptr<HttpResponse>& response, bool isCancelled)
+      : mId(id), mResponse(response), mIsCancelled(isCancelled) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return mIsCancelled; }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+  bool mIsCancelled;
+};
+
+struct Waiter {
+  std::string requestId;
+  std::function<void(std::shared_ptr<HttpOperation>)> callback;
+};
+
+// One request in flight and everyone waiting for its result
+struct Flight {
+  std::string leaderId;
+  std::vector<Waiter> waiters;
+  size_t syncWaiterCount = 0;
+  std::shared_ptr<HttpOperation> operation;
+  std::exception_ptr error;
+  bool isDone = false;
+};
+
+inline void AddToHash(uint64_t& hash, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+} // namespace coalescinghttp
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that lets concurrent identical requests share one request to the service
+ * 
+ * @note Requests are identical when their method, URL, identity headers and body are equal; the body is
+ *       hashed with 64-bit FNV-1a and compared by hash. While such a request is in flight, later identical requests
+ *       attach to it instead of reaching the transport, and every caller receives the same response, labeled with its
+ *       own request ID. This removes the thundering herd of template refreshes or use license requests for the same
+ *       content that many engines or threads start at once when a cache expires. Requests are only coalesced while in
+ *       flight; nothing is cached after the response arrives. Only idempotent requests should be coalesced: by default
+ *       GET requests are, and isCoalescable can admit others, such as POST requests known to be idempotent.
+ */
+class CoalescingHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Identity headers and idempotency rule
+   */
+  explicit CoalescingHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const CoalescingHttpDelegateSettings& settings = CoalescingHttpDelegateSettings())
+      : mTransport(transport),
+        mSettings(settings),
+        mSentCount(0),
+        mCoalescedCount(0) {
+    if (!mTransport) {
+      throw BadInputError("CoalescingHttpDelegate requires a transport HttpDelegate");
+    }
+  }
+
+  /**
+   * @brief Send HTTP request, or wait for an identical request already in flight
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    if (!IsCoalescable(*request)) {
+      ++mSentCount;
+      return mTransport->Send(request, context);
+    }
+    std::string key = GetKey(*request);
+    std::shared_ptr<coalescinghttp::Flight> flight;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      auto existing = mFlights.find(key);
+      if (existing != mFlights.end()) {
+        flight = existing->second;
+        ++mCoalescedCount;
+        ++flight->syncWaiterCount;
+        mFlightDone.wait(lock, [&flight]() { return flight->isDone; });
+        if (flight->error) {
+          std::rethrow_exception(flight->error);
+        }
+        return CreateWaiterOperation(request->GetId(), flight->operation);
+      }
+      flight = std::make_shared<coalescinghttp::Flight>();
+      flight->leaderId = request->GetId();
+      mFlights[key] = flight;
+    }
+    ++mSentCount;
+    std::shared_ptr<HttpOperation> operation;
+    try {
+      operation = mTransport->Send(request, context);
+    } catch (...) {
+      Finish(key, flight, nullptr, std::current_exception());
+      throw;
+    }
+    Finish(key, flight, operation, nullptr);
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, or attach to an identical request already in flight
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container; for an attached request it reports the request ID and no response
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    if (!IsCoalescable(*request)) {
+      ++mSentCount;
+      return mTransport->SendAsync(request, context, callbackFn);
+    }
+    std::string key = GetKey(*request);
+    std::shared_ptr<coalescinghttp::Flight> flight;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto existing = mFlights.find(key);
+      if (existing != mFlights.end()) {
+        ++mCoalescedCount;
+        existing->second->waiters.push_back(coalescinghttp::Waiter{request->GetId(), callbackFn});
+        return std::make_shared<coalescinghttp::WaiterOperation>(request->GetId(), nullptr, false);
+      }
+      flight = std::make_shared<coalescinghttp::Flight>();
+      flight->leaderId = request->GetId();
+      flight->waiters.push_back(coalescinghttp::Waiter{request->GetId(), callbackFn});
+      mFlights[key] = flight;
+    }
+    ++mSentCount;
+    try {
+      return mTransport->SendAsync(request, context, [this, key, flight](std::shared_ptr<HttpOperation> operation) {
+        Finish(key, flight, operation, nullptr);
+      });
+    } catch (...) {
+      // The caller learns of the failure from the exception, so only attached requests are called back
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto waiter = flight->waiters.begin(); waiter != flight->waiters.end(); ++waiter) {
+          if (waiter->requestId == flight->leaderId) {
+            flight->waiters.erase(waiter);
+            break;
+          }
+        }
+      }
+      Finish(key, flight, nullptr, std::current_exception());
+      throw;
+    }
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   * 
+   * @note An attached request is detached and completed as cancelled. The shared request is only cancelled at the
+   *       transport once no other caller waits for it.
+   */
+  void CancelOperation(const std::string& requestId) override {
+    std::vector<coalescinghttp::Waiter> cancelled;
+    std::string transportId;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (auto& entry : mFlights) {
+        auto& flight = *entry.second;
+        size_t previousCount = cancelled.size();
+        for (auto waiter = flight.waiters.begin(); waiter != flight.waiters.end();) {
+          if (waiter->requestId == requestId) {
+            cancelled.push_back(*waiter);
+            waiter = flight.waiters.erase(waiter);
+          } else {
+            ++waiter;
+          }
+        }
+        if (cancelled.size() > previousCount && flight.waiters.empty() && flight.syncWaiterCount == 0) {
+          transportId = flight.leaderId;
+        }
+      }
+    }
+    for (const auto& waiter : cancelled) {
+      if (waiter.callback) {
+        waiter.callback(std::make_shared<coalescinghttp::WaiterOperation>(waiter.requestId, nullptr, true));
+      }
+    }
+    if (cancelled.empty() || !transportId.empty()) {
+      mTransport->CancelOperation(transportId.empty() ? requestId : transportId);
+    }
+  }
+
+  /**
+   * @brief Cancel every HTTP operation
+   */
+  void CancelAllOperations() override { mTransport->CancelAllOperations(); }
+
+  /**
+   * @brief Get the number of requests sent to the transport
+   * 
+   * @return Sent request count
+   */
+  size_t GetSentCount() const { return mSentCount; }
+
+  /**
+   * @brief Get the number of requests answered by an identical request already in flight
+   * 
+   * @return Coalesced request count
+   */
+  size_t GetCoalescedCount() const { return mCoalescedCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  bool IsCoalescable(const HttpRequest& request) const {
+    return mSettings.isCoalescable ? mSettings.isCoalescable(request) :
+        request.GetRequestType() == HttpRequestType::Get;
+  }
+
+  std::string GetKey(const HttpRequest& request) const {
+    uint64_t bodyHash = 14695981039346656037ULL;
+    coalescinghttp::AddToHash(bodyHash, request.GetBody().data(), request.GetBody().size());
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(bodyHash));
+    std::string key = (request.GetRequestType() == HttpRequestType::Post ? "POST " : "GET ") + request.GetUrl();
+    key += '\n';
+    key += hash;
+    for (const auto& name : mSettings.identityHeaders) {
+      auto header = request.GetHeaders().find(name);
+      key += '\n';
+      if (header != request.GetHeaders().end()) {
+        key += header->second;
+      }
+    }
+    return key;
+  }
+
+  static std::shared_ptr<HttpOperation> CreateWaiterOperation(
+      const std::string& requestId,
+      const std::shared_ptr<HttpOperation>& operation) {
+    if (!operation) {
+      return std::make_shared<coalescinghttp::WaiterOperation>(requestId, nullptr, true);
+    }
+    auto response = operation->GetResponse();
+    return std::make_shared<coalescinghttp::WaiterOperation>(requestId,
+        response ? std::make_shared<coalescinghttp::WaiterResponse>(requestId, response) : nullptr,
+        operation->IsCancelled());
+  }
+
+  void Finish(
+      const std::string& key,
+      const std::shared_ptr<coalescinghttp::Flight>& flight,
+      const std::shared_ptr<HttpOperation>& operation,
+      const std::exception_ptr& error) {
+    std::vector<coalescinghttp::Waiter> waiters;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto current = mFlights.find(key);
+      if (current != mFlights.end() && current->second == flight) {
+        mFlights.erase(current);
+      }
+      flight->operation = operation;
+      flight->error = error;
+      flight->isDone = true;
+      waiters.swap(flight->waiters);
+    }
+    mFlightDone.notify_all();
+    for (const auto& waiter : waiters) {
+      if (waiter.callback) {
+        waiter.callback(waiter.requestId == flight->leaderId ? operation :
+            CreateWaiterOperation(waiter.requestId, operation));
+      }
+    }
+  }
+
+  std::shared_ptr<HttpDelegate> mTransport;
+  CoalescingHttpDelegateSettings mSettings;
+  std::mutex mMutex;
+  std::condition_variable mFlightDone;
+  std::unordered_map<std::string, std::shared_ptr<coalescinghttp::Flight>> mFlights;
+  std::atomic<size_t> mSentCount;
+  std::atomic<size_t> mCoalescedCount;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_COALESCING_HTTP_DELEGATE_H_
@@ -0,0 +1,468 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines deadlines carried by logger contexts and enforced on HTTP calls, retries and async operations
+ * 
+ * @file deadline.h
+ */
+
+#ifndef API_MIP_DEADLINE_H_
+#define API_MIP_DEADLINE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/logger_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/timer_wheel.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Logger context carrying the time by which the calls it is passed to must complete
+ * 
+ * @note Pass it as the context of an *Async call, such as FileEngine::CreateFileHandlerAsync: the SDK hands the same
+ *       pointer to the HttpDelegate, where DeadlineHttpDelegate and RetryHttpDelegate enforce the deadline, and back
+ *       to the observer, where GetApplicationContext returns your own context. It can wrap or be wrapped by another
+ *       LinkedLoggerContext, such as TraceLoggerContext.
+ */
+class DeadlineLoggerContext final : public LinkedLoggerContext {
+public:
+  /**
+   * @brief Creates a logger context
+   * 
+   * @param deadline Time by which the calls must complete
+   * @param innerContext Application context carried along
+   */
+  explicit DeadlineLoggerContext(std::chrono::steady_clock::time_point deadline,
+      const std::shared_ptr<void>& innerContext = std::shared_ptr<void>())
+      : LinkedLoggerContext(this, innerContext),
+        mDeadline(deadline) {}
+
+  /**
+   * @brief Creates a logger context with a deadline relative to now
+   * 
+   * @param timeout Time the calls have to complete
+   * @param innerContext Application context carried along
+   * 
+   * @return The logger context
+   */
+  static std::shared_ptr<DeadlineLoggerContext> After(std::chrono::milliseconds timeout,
+      const std::shared_ptr<void>& innerContext = std::shared_ptr<void>()) {
+    return std::make_shared<DeadlineLoggerContext>(std::chrono::steady_clock::now() + timeout, innerContext);
+  }
+
+  /**
+   * @brief Get the deadline
+   */
+  std::chrono::steady_clock::time_point GetDeadline() const { return mDeadline; }
+
+  /**
+   * @brief Get the DeadlineLoggerContext a logger context points to
+   * 
+   * @param loggerContext Logger context received from the SDK
+   * 
+   * @return The DeadlineLoggerContext, also when wrapped by another LinkedLoggerContext, or nullptr if there is none
+   */
+  static std::shared_ptr<DeadlineLoggerContext> From(const std::shared_ptr<void>& loggerContext) {
+    return FindLoggerContext<DeadlineLoggerContext>(loggerContext);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::chrono::steady_clock::time_point mDeadline;
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace deadline {
+
+inline std::chrono::steady_clock::time_point& GetCurrentDeadline() {
+  static thread_local std::chrono::steady_clock::time_point current = (std::chrono::steady_clock::time_point::max)();
+  return current;
+}
+
+// Leaked, like the logger context registry, so that timers disarmed during static destruction find it
+inline TimerWheel& GetTimerWheel() {
+  static TimerWheel* wheel = new TimerWheel();
+  return *wheel;
+}
+
+} // namespace deadline
+/** @endcond */
+
+/**
+ * @brief Applies a deadline to the calling thread for its lifetime
+ * 
+ * @note Calls that receive no DeadlineLoggerContext use the deadline of the calling thread. A scope never extends the
+ *       deadline of an enclosing one.
+ */
+class DeadlineScope {
+public:
+  /**
+   * @brief Sets the deadline of the calling thread
+   * 
+   * @param deadline Time by which calls made in the scope must complete
+   */
+  explicit DeadlineScope(std::chrono::steady_clock::time_point deadline) : mPrevious(deadline::GetCurrentDeadline()) {
+    deadline::GetCurrentDeadline() = (std::min)(mPrevious, deadline);
+  }
+
+  DeadlineScope(const DeadlineScope&) = delete;
+  DeadlineScope& operator=(const DeadlineScope&) = delete;
+
+  /** @cond DOXYGEN_HIDE */
+  ~DeadlineScope() { deadline::GetCurrentDeadline() = mPrevious; }
+
+private:
+  std::chrono::steady_clock::time_point mPrevious;
+  /** @endcond */
+};
+
+/**
+ * @brief Get the deadline of a call
+ * 
+ * @param loggerContext Logger context passed with the call
+ * 
+ * @return The earlier of the DeadlineLoggerContext's deadline and the calling thread's, or time_point::max() if
+ *         there is neither
+ */
+inline std::chrono::steady_clock::time_point GetDeadline(const std::shared_ptr<void>& loggerContext) {
+  auto deadlineLoggerContext = DeadlineLoggerContext::From(loggerContext);
+  std::chrono::steady_clock::time_point current = deadline::GetCurrentDeadline();
+  return deadlineLoggerContext ? (std::min)(deadlineLoggerContext->GetDeadline(), current) : current;
+}
+
+/**
+ * @brief Get the time left until the deadline of a call, for example to set the timeout of an HTTP transport
+ * 
+ * @param loggerContext Logger context passed with the call
+ * 
+ * @return Time left, 0 if the deadline has passed, or milliseconds::max() if there is no deadline
+ */
+inline std::chrono::milliseconds GetRemainingTime(const std::shared_ptr<void>& loggerContext) {
+  std::chrono::steady_clock::time_point deadline = GetDeadline(loggerContext);
+  if (deadline == (std::chrono::steady_clock::time_point::max)()) {
+    return (std::chrono::milliseconds::max)();
+  }
+  auto now = std::chrono::steady_clock::now();
+  return deadline > now ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) :
+                          std::chrono::milliseconds(0);
+}
+
+/**
+ * @brief Throws if the deadline of a call has passed
+ * 
+ * @param loggerContext Logger context passed with the call
+ * @param operation Name of the operation, for the error message
+ * 
+ * @throws OperationCancelledError if the deadline has passed
+ */
+inline void ThrowIfDeadlineExceeded(const std::shared_ptr<void>& loggerContext, const std::string& operation) {
+  if (std::chrono::steady_clock::now() >= GetDeadline(loggerContext)) {
+    throw OperationCancelledError(operation + " was cancelled: its deadline was exceeded");
+  }
+}
+
+/**
+ * @brief Runs a callback once when a deadline passes, unless disarmed first
+ * 
+ * @note The callback runs on a process-wide TimerWheel thread and should only hand work off or cancel something.
+ *       Destroying the timer disarms it.
+ */
+class DeadlineTimer {
+public:
+  /**
+   * @brief Arm a timer
+   * 
+   * @param deadline When to run the callback; time_point::max() never runs it
+   * @param onExpired Function to run
+   * 
+   * @return The timer
+   */
+  static std::shared_ptr<DeadlineTimer> Start(std::chrono::steady_clock::time_point deadline,
+      std::function<void()> onExpired) {
+    std::shared_ptr<DeadlineTimer> timer(new DeadlineTimer());
+    if (deadline == (std::chrono::steady_clock::time_point::max)()) {
+      return timer;
+    }
+    auto now = std::chrono::steady_clock::now();
+    // Rounded up, so the callback never runs before the deadline
+    auto delay = deadline > now ?
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::microseconds(999)) :
+        std::chrono::milliseconds(0);
+    std::weak_ptr<DeadlineTimer> weakTimer = timer;
+    std::lock_guard<std::mutex> lock(timer->mMutex);
+    timer->mHandle = deadline::GetTimerWheel().Schedule(delay, [weakTimer, onExpired]() {
+      auto self = weakTimer.lock();
+      if (!self) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(self->mMutex);
+        if (self->mIsDisarmed) {
+          return;
+        }
+        self->mHasFired = true;
+      }
+      onExpired();
+    });
+    return timer;
+  }
+
+  DeadlineTimer(const DeadlineTimer&) = delete;
+  DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+
+  /**
+   * @brief Disarm the timer
+   * 
+   * @return true if the callback has not run and will not
+   */
+  bool Disarm() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIsDisarmed) {
+      mIsDisarmed = true;
+      deadline::GetTimerWheel().Cancel(mHandle);
+    }
+    return !mHasFired;
+  }
+
+  /**
+   * @brief Whether the callback has run or is running
+   */
+  bool HasFired() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHasFired;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~DeadlineTimer() { Disarm(); }
+
+private:
+  DeadlineTimer() : mIsDisarmed(false), mHasFired(false) {}
+
+  mutable std::mutex mMutex;
+  TimerHandle mHandle;
+  bool mIsDisarmed;
+  bool mHasFired;
+  /** @endcond */
+};
+
+/**
+ * @brief Cancel an async operation when a deadline passes
+ * 
+ * @param asyncControl Control returned by an *Async call
+ * @param deadline Deadline of the operation
+ * 
+ * @return Timer to disarm once the operation completes; destroying it disarms it too
+ * 
+ * @note AsyncControl::Cancel makes the SDK fail the operation with OperationCancelledError through its observer, so
+ *       the SDK's queued work is stopped by the SDK itself rather than dropped. Only a weak reference to the control
+ *       is kept.
+ */
+inline std::shared_ptr<DeadlineTimer> CancelAtDeadline(const std::shared_ptr<AsyncControl>& asyncControl,
+    std::chrono::steady_clock::time_point deadline) {
+  std::weak_ptr<AsyncControl> weakControl = asyncControl;
+  return DeadlineTimer::Start(deadline, [weakControl]() {
+    auto control = weakControl.lock();
+    if (control) {
+      control->Cancel();
+    }
+  });
+}
+
+/**
+ * @brief Cancel an async operation when the deadline of its context passes
+ * 
+ * @param asyncControl Control returned by an *Async call
+ * @param context Context passed to the call, usually a DeadlineLoggerContext
+ * 
+ * @return Timer to disarm once the operation completes; destroying it disarms it too
+ */
+inline std::shared_ptr<DeadlineTimer> CancelAtDeadline(const std::shared_ptr<AsyncControl>& asyncControl,
+    const std::shared_ptr<void>& context) {
+  return CancelAtDeadline(asyncControl, GetDeadline(context));
+}
+
+/**
+ * @brief HttpDelegate decorator failing requests that would outlive the deadline of their context
+ * 
+ * @note A request whose deadline has already passed is not sent and throws OperationCancelledError. Otherwise the
+ *       transport's CancelOperation is called for it at the deadline; a blocking Send that then returns a cancelled
+ *       operation, or none, throws OperationCancelledError, and SendAsync hands the cancelled operation to the
+ *       callback. Place it outside RetryHttpDelegate so that the deadline covers all attempts.
+ */
+class DeadlineHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param defaultTimeout Deadline, relative to the call, of requests whose context has none; 0 for none
+   */
+  explicit DeadlineHttpDelegate(const std::shared_ptr<HttpDelegate>& transport,
+      std::chrono::milliseconds defaultTimeout = std::chrono::milliseconds(0))
+      : mTransport(transport),
+        mDefaultTimeout(defaultTimeout) {
+    if (!mTransport) {
+      throw BadInputError("DeadlineHttpDelegate requires a transport");
+    }
+  }
+
+  /**
+   * @brief Send HTTP request, cancelling it at its deadline
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   * 
+   * @throws OperationCancelledError if the deadline passed
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    std::chrono::steady_clock::time_point deadline = GetRequestDeadline(context);
+    if (deadline == (std::chrono::steady_clock::time_point::max)()) {
+      return mTransport->Send(request, context);
+    }
+    ThrowIfExpired(*request, deadline);
+    auto timer = StartCancelTimer(*request, deadline);
+    std::shared_ptr<HttpOperation> operation;
+    try {
+      operation = mTransport->Send(request, context);
+    } catch (...) {
+      if (!timer->Disarm()) {
+        ThrowExpired(*request);
+      }
+      throw;
+    }
+    if (!timer->Disarm() && (!operation || operation->IsCancelled() || !operation->GetResponse())) {
+      ThrowExpired(*request);
+    }
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, cancelling it at its deadline
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container
+   * 
+   * @throws OperationCancelledError if the deadline has already passed
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    std::chrono::steady_clock::time_point deadline = GetRequestDeadline(context);
+    if (deadline == (std::chrono::steady_clock::time_point::max)()) {
+      return mTransport->SendAsync(request, context, callbackFn);
+    }
+    ThrowIfExpired(*request, deadline);
+    // The callback can run before SendAsync returns, so the timer is armed first and shared with it
+    auto timer = StartCancelTimer(*request, deadline);
+    try {
+      return mTransport->SendAsync(request, context, [timer, callbackFn](std::shared_ptr<HttpOperation> operation) {
+        timer->Disarm();
+        if (callbackFn) {
+          callbackFn(operation);
+        }
+      });
+    } catch (...) {
+      if (!timer->Disarm()) {
+        ThrowExpired(*request);
+      }
+      throw;
+    }
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mTransport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mTransport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::chrono::steady_clock::time_point GetRequestDeadline(const std::shared_ptr<void>& context) const {
+    std::chrono::steady_clock::time_point deadline = GetDeadline(context);
+    if (mDefaultTimeout.count() > 0 && deadline == (std::chrono::steady_clock::time_point::max)()) {
+      deadline = std::chrono::steady_clock::now() + mDefaultTimeout;
+    }
+    return deadline;
+  }
+
+  static void ThrowExpired(const HttpRequest& request) {
+    throw OperationCancelledError("HTTP request was cancelled: its deadline was exceeded",
+        {{"HttpRequest.Id", request.GetId()}, {"HttpRequest.Url", request.GetUrl()}});
+  }
+
+  static void ThrowIfExpired(const HttpRequest& request, std::chrono::steady_clock::time_point deadline) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      ThrowExpired(request);
+    }
+  }
+
+  std::shared_ptr<DeadlineTimer> StartCancelTimer(const HttpRequest& request,
+      std::chrono::steady_clock::time_point deadline) const {
+    std::weak_ptr<HttpDelegate> weakTransport = mTransport;
+    std::string requestId = request.GetId();
+    return DeadlineTimer::Start(deadline, [weakTransport, requestId]() {
+      auto transport = weakTransport.lock();
+      if (transport) {
+        transport->CancelOperation(requestId);
+      }
+    });
+  }
+
+  std::shared_ptr<HttpDelegate> mTransport;
+  std::chrono::milliseconds mDefaultTimeout;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_DEADLINE_H_
@@ -0,0 +1,349 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines DecompressingHttpDelegate, which negotiates compressed responses and decodes them
+ * 
+ * @file decompressing_http_delegate.h
+ */
+
+#ifndef API_MIP_DECOMPRESSING_HTTP_DELEGATE_H_
+#define API_MIP_DECOMPRESSING_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_body.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/inflate_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Creates a Stream that decodes one content coding
+ * 
+ * @param encoded Stream over the encoded body
+ * @param maxDecodedSize Largest decoded size the stream may produce
+ * 
+ * @return Stream producing the decoded body
+ */
+typedef std::function<std::shared_ptr<Stream>(const std::shared_ptr<Stream>& encoded, int64_t maxDecodedSize)>
+    HttpContentDecoderFactory;
+
+/**
+ * @brief Settings of a DecompressingHttpDelegate
+ */
+struct DecompressingHttpDelegateSettings {
+  /**
+   * Decoders by content coding, in addition to the built-in "gzip" and "deflate". Register "br" or "zstd" with a
+   * factory wrapping a brotli or zstd streaming decoder to have them offered as well.
+   */
+  std::map<std::string, HttpContentDecoderFactory> decoders;
+  /** Largest decoded body accepted, protecting against decompression bombs, or 0 for no limit */
+  int64_t maxDecodedSize = 512 * 1024 * 1024;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace decompressinghttp {
+
+typedef std::map<std::string, std::string, CaseInsensitiveComparator> Headers;
+
+// Caller's request plus the Accept-Encoding header
+class NegotiatingRequest : public HttpRequest {
+public:
+  NegotiatingRequest(const std::shared_ptr<HttpRequest>& request, const std::string& acceptEncoding)
+      : mRequest(request), mHeaders(request->GetHeaders()) {
+    mHeaders["Accept-Encoding"] = acceptEncoding;
+  }
+  const std::string& GetId() const override { return mRequest->GetId(); }
+  HttpRequestType GetRequestType() const override { return mRequest->GetRequestType(); }
+  const std::string& GetUrl() const override { return mRequest->GetUrl(); }
+  const std::vector<uint8_t>& GetBody() const override { return mRequest->GetBody(); }
+  const Headers& GetHeaders() const override { return mHeaders; }
+  TransportLayerSecurityMinimumVersion GetTransportLayerSecurityMinimumVersion() const override {
+    return mRequest->GetTransportLayerSecurityMinimumVersion();
+  }
+
+private:
+  std::shared_ptr<HttpRequest> mRequest;
+  Headers mHeaders;
+};
+
+class DecodedOperation : public HttpOperation {
+public:
+  DecodedOperation(const std::shared_ptr<HttpOperation>& operation, const std::shared_ptr<HttpResponse>& response)
+      : mOperation(operation), mResponse(response) {}
+  const std::string& GetId() const override { return mOperation->GetId(); }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return mOperation->IsCancelled(); }
+
+private:
+  std::shared_ptr<HttpOperation> mOperation;
+  std::shared_ptr<HttpResponse> mResponse;
+};
+
+// "gzip, br" -> {"gzip", "br"}, lower-cased, without "identity"
+inline std::vector<std::string> ParseCodings(const std::string& value) {
+  std::vector<std::string> codings;
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    std::string coding = value.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    coding.erase(0, coding.find_first_not_of(" \t"));
+    coding.erase(coding.find_last_not_of(" \t") + 1);
+    std::transform(coding.begin(), coding.end(), coding.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    if (!coding.empty() && coding != "identity") {
+      codings.push_back(coding);
+    }
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return codings;
+}
+
+} // namespace decompressinghttp
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that offers compressed responses with Accept-Encoding and hands the SDK decoded bodies
+ * 
+ * @note Large text payloads such as policy XML and sensitivity type packages typically shrink 5-10x. gzip and deflate
+ *       are decoded by InflateStream; other codings are only offered when a decoder is registered for them. Bodies
+ *       are decoded in one streaming pass from the received buffer straight into the final body buffer, so the
+ *       compressed and decoded payloads are never copied again. Requests that already carry Accept-Encoding are sent
+ *       unchanged, and responses with an unknown coding are passed through. A body that fails to decode makes Send
+ *       throw a mip::NetworkError (BadResponse); SendAsync then completes with an operation without a response.
+ */
+class DecompressingHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Additional decoders and size limit
+   */
+  explicit DecompressingHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const DecompressingHttpDelegateSettings& settings = DecompressingHttpDelegateSettings())
+      : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("DecompressingHttpDelegate requires a transport HttpDelegate");
+    }
+    mState->transport = transport;
+    mState->maxDecodedSize = settings.maxDecodedSize;
+    mState->decoders["gzip"] = [](const std::shared_ptr<Stream>& encoded, int64_t maxDecodedSize) {
+      return std::make_shared<InflateStream>(encoded, InflateFormat::Gzip, maxDecodedSize);
+    };
+    mState->decoders["x-gzip"] = mState->decoders["gzip"];
+    // Some servers send raw deflate for "deflate", so the container is detected
+    mState->decoders["deflate"] = [](const std::shared_ptr<Stream>& encoded, int64_t maxDecodedSize) {
+      return std::make_shared<InflateStream>(encoded, InflateFormat::Auto, maxDecodedSize);
+    };
+    for (const auto& decoder : settings.decoders) {
+      auto codings = decompressinghttp::ParseCodings(decoder.first);
+      if (codings.size() == 1 && decoder.second) {
+        mState->decoders[codings[0]] = decoder.second;
+      }
+    }
+    for (const auto& decoder : mState->decoders) {
+      if (decoder.first != "x-gzip") {
+        mState->acceptEncoding += (mState->acceptEncoding.empty() ? "" : ", ") + decoder.first;
+      }
+    }
+  }
+
+  /**
+   * @brief Send HTTP request
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container, with a decoded response
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    return mState->Decode(*request, mState->transport->Send(mState->Negotiate(request), context));
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion, with a decoded response
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto state = mState;
+    return mState->transport->SendAsync(mState->Negotiate(request), context, [state, request, callbackFn](
+        std::shared_ptr<HttpOperation> operation) {
+      std::shared_ptr<HttpOperation> decoded;
+      try {
+        decoded = state->Decode(*request, operation);
+      } catch (const NetworkError&) {
+        decoded = std::make_shared<decompressinghttp::DecodedOperation>(operation, nullptr);
+      }
+      if (callbackFn) {
+        callbackFn(decoded);
+      }
+    });
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /**
+   * @brief Get the value sent in the Accept-Encoding header
+   * 
+   * @return Content codings, e.g. "deflate, gzip"
+   */
+  const std::string& GetAcceptEncoding() const { return mState->acceptEncoding; }
+
+  /**
+   * @brief Get the number of encoded body bytes received so far
+   */
+  uint64_t GetEncodedBytes() const { return mState->encodedBytes; }
+
+  /**
+   * @brief Get the number of body bytes those decoded to
+   */
+  uint64_t GetDecodedBytes() const { return mState->decodedBytes; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Async completions can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    std::shared_ptr<HttpDelegate> transport;
+    std::map<std::string, HttpContentDecoderFactory> decoders;
+    std::string acceptEncoding;
+    int64_t maxDecodedSize = 0;
+    std::atomic<uint64_t> encodedBytes{0};
+    std::atomic<uint64_t> decodedBytes{0};
+
+    std::shared_ptr<HttpRequest> Negotiate(const std::shared_ptr<HttpRequest>& request) const {
+      if (request->GetHeaders().count("Accept-Encoding")) {
+        return request;
+      }
+      return std::make_shared<decompressinghttp::NegotiatingRequest>(request, acceptEncoding);
+    }
+
+    std::shared_ptr<HttpOperation> Decode(const HttpRequest& request, const std::shared_ptr<HttpOperation>& operation) {
+      std::shared_ptr<HttpResponse> response = operation ? operation->GetResponse() : nullptr;
+      if (!response) {
+        return operation;
+      }
+      auto header = response->GetHeaders().find("Content-Encoding");
+      if (header == response->GetHeaders().end()) {
+        return operation;
+      }
+      std::vector<std::string> codings = decompressinghttp::ParseCodings(header->second);
+      for (const auto& coding : codings) {
+        if (decoders.find(coding) == decoders.end()) {
+          return operation;
+        }
+      }
+      if (codings.empty() || response->GetBody().empty()) {
+        return operation;
+      }
+      std::vector<uint8_t> body;
+      try {
+        std::shared_ptr<Stream> decoded = std::make_shared<HttpBodyStream>(response);
+        for (auto coding = codings.rbegin(); coding != codings.rend(); ++coding) {
+          decoded = decoders[*coding](decoded, maxDecodedSize);
+        }
+        const size_t chunkSize = 64 * 1024;
+        const int64_t limit = maxDecodedSize > 0 ? maxDecodedSize : (std::numeric_limits<int64_t>::max)();
+        body.reserve(static_cast<size_t>((std::min)(
+            static_cast<int64_t>(response->GetBody().size() * 4 + chunkSize), limit)));
+        for (;;) {
+          size_t size = body.size();
+          body.resize(size + chunkSize);
+          int64_t bytesRead = decoded->Read(body.data() + size, static_cast<int64_t>(chunkSize));
+          body.resize(size + static_cast<size_t>((std::max)(bytesRead, static_cast<int64_t>(0))));
+          if (bytesRead <= 0) {
+            break;
+          }
+          if (static_cast<int64_t>(body.size()) > limit) {
+            throw BadInputError("Decompressed data exceeds the size limit");
+          }
+        }
+      } catch (const Error& error) {
+        std::string sanitizedUrl = request.GetUrl().substr(0, request.GetUrl().find('?'));
+        throw NetworkError(NetworkError::Category::BadResponse, sanitizedUrl, request.GetId(),
+            response->GetStatusCode(), std::string("Failed to decode the response body: ") + error.what());
+      }
+      encodedBytes += response->GetBody().size();
+      decodedBytes += body.size();
+      decompressinghttp::Headers headers = response->GetHeaders();
+      headers.erase("Content-Encoding");
+      headers["Content-Length"] = std::to_string(body.size());
+      auto decodedResponse = std::make_shared<SharedBodyHttpResponse>(response->GetId(), response->GetStatusCode(),
+          headers, std::make_shared<const std::vector<uint8_t>>(std::move(body)));
+      return std::make_shared<decompressinghttp::DecodedOperation>(operation, decodedResponse);
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+}; // class DecompressingHttpDelegate
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_DECOMPRESSING_HTTP_DELEGATE_H_
@@ -0,0 +1,367 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines DoubleKeyHttpDelegate, which caches and coalesces Double Key Encryption key service calls
+ * 
+ * @file double_key_http_delegate.h
+ */
+
+#ifndef API_MIP_DOUBLE_KEY_HTTP_DELEGATE_H_
+#define API_MIP_DOUBLE_KEY_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/caching_http_delegate.h"
+#include "mip/coalescing_http_delegate.h"
+#include "mip/error.h"
+#include "mip/http_body.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a DoubleKeyHttpDelegate
+ */
+struct DoubleKeyHttpDelegateSettings {
+  /**
+   * Key service URLs, as returned by ProtectDoNotForwardDkAction::GetDoubleKeyEncryptionUrl,
+   * ProtectAdhocDkAction::GetDoubleKeyEncryptionUrl or ProtectionDescriptor::GetDoubleKeyUrl. Only requests below
+   * one of them are cached.
+   */
+  std::vector<std::string> keyServiceUrls;
+  /** Longest time an unwrapped key is reused; 0 disables the unwrap cache but keeps coalescing */
+  std::chrono::seconds unwrapTtl = std::chrono::seconds(300);
+  /** Longest time a public key is reused; 0 disables the public key cache but keeps coalescing */
+  std::chrono::seconds publicKeyTtl = std::chrono::seconds(3600);
+  /** Most responses kept */
+  size_t maxEntries = 4096;
+  /** Headers identifying the caller; responses are only shared between requests where these are equal */
+  std::vector<std::string> identityHeaders = {"Authorization"};
+};
+
+/**
+ * @brief HttpDelegate decorator that answers repeated Double Key Encryption key service requests from memory
+ * 
+ * @note Consuming DKE content makes the SDK unwrap the content key with a POST to {key URL}/decrypt, and protecting it
+ *       fetches the public key with a GET of the key URL. Unwrap requests for the same wrapped key and caller are
+ *       answered for up to unwrapTtl, public key requests for up to publicKeyTtl. The key service stays in charge of
+ *       its key policy: a response with "Cache-Control: no-store" is never reused, a max-age shortens the TTL, and
+ *       only 200 responses are kept, so a denial is re-asked every time. Concurrent identical requests share one
+ *       call through a CoalescingHttpDelegate, so a burst of files sharing a protection costs one key service call.
+ *       The DKE protocol has no batch unwrap, so that is as far as requests can be combined. Unwrapped keys are held
+ *       in memory only, never persisted; call Clear to drop them early, for example when a user signs out.
+ */
+class DoubleKeyHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Key service URLs, TTLs and identity headers
+   */
+  explicit DoubleKeyHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const DoubleKeyHttpDelegateSettings& settings = DoubleKeyHttpDelegateSettings())
+      : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("DoubleKeyHttpDelegate requires a transport HttpDelegate");
+    }
+    mState->settings = settings;
+    for (const std::string& url : settings.keyServiceUrls) {
+      mState->AddKeyServiceUrl(url);
+    }
+    std::weak_ptr<State> weakState = mState;
+    CoalescingHttpDelegateSettings coalescingSettings;
+    coalescingSettings.identityHeaders = settings.identityHeaders;
+    coalescingSettings.isCoalescable = [weakState](const HttpRequest& request) {
+      auto state = weakState.lock();
+      return state && state->GetKind(request) != RequestKind::Other;
+    };
+    mState->transport = std::make_shared<CoalescingHttpDelegate>(transport, coalescingSettings);
+  }
+
+  /**
+   * @brief Add a key service URL, for example one read from a newly loaded policy
+   * 
+   * @param url Key service URL
+   */
+  void AddKeyServiceUrl(const std::string& url) { mState->AddKeyServiceUrl(url); }
+
+  /**
+   * @brief Send HTTP request, or answer it from the cache
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    RequestKind kind = mState->GetKind(*request);
+    if (kind == RequestKind::Other) {
+      return mState->transport->Send(request, context);
+    }
+    std::string key = mState->GetKey(*request);
+    auto cached = mState->Find(request->GetId(), key);
+    if (cached) {
+      return cached;
+    }
+    auto operation = mState->transport->Send(request, context);
+    mState->Store(key, kind, operation);
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, or answer it from the cache before returning
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    RequestKind kind = mState->GetKind(*request);
+    if (kind == RequestKind::Other) {
+      return mState->transport->SendAsync(request, context, callbackFn);
+    }
+    std::string key = mState->GetKey(*request);
+    auto cached = mState->Find(request->GetId(), key);
+    if (cached) {
+      if (callbackFn) {
+        callbackFn(cached);
+      }
+      return cached;
+    }
+    auto state = mState;
+    return mState->transport->SendAsync(request, context, [state, key, kind, callbackFn](
+        std::shared_ptr<HttpOperation> operation) {
+      state->Store(key, kind, operation);
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+    });
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /**
+   * @brief Drop every cached key service response
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->entries.clear();
+    mState->order.clear();
+  }
+
+  /**
+   * @brief Get the number of key service requests answered from the cache
+   */
+  uint64_t GetHitCount() const { return mState->hitCount; }
+
+  /**
+   * @brief Get the number of key service requests that reached the transport or an identical request in flight
+   */
+  uint64_t GetMissCount() const { return mState->missCount; }
+
+  /**
+   * @brief Get the number of key service requests answered by an identical request already in flight
+   */
+  uint64_t GetCoalescedCount() const { return mState->transport->GetCoalescedCount(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  enum class RequestKind { Other, PublicKey, Unwrap };
+
+  // Async completions can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    struct Slot {
+      int32_t statusCode;
+      cachinghttp::Headers headers;
+      std::shared_ptr<const std::vector<uint8_t>> body;
+      std::chrono::steady_clock::time_point expiresAt;
+      std::list<std::string>::iterator position;
+    };
+
+    std::shared_ptr<CoalescingHttpDelegate> transport;
+    DoubleKeyHttpDelegateSettings settings;
+    std::mutex urlMutex;
+    std::vector<std::string> urls;
+    std::mutex mutex;
+    std::unordered_map<std::string, Slot> entries;
+    std::list<std::string> order; // most recently used first
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+
+    static std::string ToLower(std::string value) {
+      std::transform(value.begin(), value.end(), value.begin(), [](char c) {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      });
+      return value;
+    }
+
+    void AddKeyServiceUrl(const std::string& url) {
+      std::string normalized = ToLower(url);
+      while (!normalized.empty() && normalized.back() == '/') {
+        normalized.pop_back();
+      }
+      if (normalized.empty()) {
+        throw BadInputError("DoubleKeyHttpDelegate requires a non-empty key service URL");
+      }
+      std::lock_guard<std::mutex> lock(urlMutex);
+      if (std::find(urls.begin(), urls.end(), normalized) == urls.end()) {
+        urls.push_back(normalized);
+      }
+    }
+
+    RequestKind GetKind(const HttpRequest& request) {
+      std::string url = ToLower(request.GetUrl());
+      url = url.substr(0, url.find_first_of("?#"));
+      bool isKeyService = false;
+      {
+        std::lock_guard<std::mutex> lock(urlMutex);
+        for (const std::string& prefix : urls) {
+          bool isPrefix = url.size() >= prefix.size() && url.compare(0, prefix.size(), prefix) == 0;
+          if (isPrefix && (url.size() == prefix.size() || url[prefix.size()] == '/')) {
+            isKeyService = true;
+            break;
+          }
+        }
+      }
+      if (!isKeyService) {
+        return RequestKind::Other;
+      }
+      static const std::string kDecrypt = "/decrypt";
+      if (request.GetRequestType() == HttpRequestType::Post) {
+        bool isUnwrap = url.size() > kDecrypt.size() &&
+            url.compare(url.size() - kDecrypt.size(), kDecrypt.size(), kDecrypt) == 0;
+        return isUnwrap ? RequestKind::Unwrap : RequestKind::Other;
+      }
+      return RequestKind::PublicKey;
+    }
+
+    // The whole body is part of the key: an unwrap body is a small JSON document holding the wrapped key
+    std::string GetKey(const HttpRequest& request) const {
+      std::string key = (request.GetRequestType() == HttpRequestType::Post ? "POST " : "GET ") + request.GetUrl();
+      for (const auto& name : settings.identityHeaders) {
+        key += '\n';
+        key += cachinghttp::GetHeader(request.GetHeaders(), name);
+      }
+      key += '\n';
+      key.append(request.GetBody().begin(), request.GetBody().end());
+      return key;
+    }
+
+    std::shared_ptr<HttpOperation> Find(const std::string& requestId, const std::string& key) {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto slot = entries.find(key);
+      if (slot == entries.end()) {
+        ++missCount;
+        return nullptr;
+      }
+      if (std::chrono::steady_clock::now() >= slot->second.expiresAt) {
+        order.erase(slot->second.position);
+        entries.erase(slot);
+        ++missCount;
+        return nullptr;
+      }
+      order.splice(order.begin(), order, slot->second.position);
+      ++hitCount;
+      return std::make_shared<cachinghttp::CachedOperation>(requestId, std::make_shared<SharedBodyHttpResponse>(
+          requestId, slot->second.statusCode, slot->second.headers, slot->second.body));
+    }
+
+    void Store(const std::string& key, RequestKind kind, const std::shared_ptr<HttpOperation>& operation) {
+      std::shared_ptr<HttpResponse> response = operation ? operation->GetResponse() : nullptr;
+      if (!response || operation->IsCancelled() || response->GetStatusCode() != 200) {
+        return;
+      }
+      cachinghttp::CacheControl cacheControl = cachinghttp::ParseCacheControl(response->GetHeaders());
+      if (cacheControl.isNoStore || cacheControl.isNoCache) {
+        return;
+      }
+      std::chrono::seconds ttl = kind == RequestKind::Unwrap ? settings.unwrapTtl : settings.publicKeyTtl;
+      if (cacheControl.maxAge >= 0) {
+        ttl = (std::min)(ttl, std::chrono::seconds(cacheControl.maxAge));
+      }
+      if (ttl <= std::chrono::seconds(0) || settings.maxEntries == 0) {
+        return;
+      }
+      auto shared = std::dynamic_pointer_cast<SharedBodyHttpResponse>(response);
+      auto body = shared ? shared->GetSharedBody() : std::make_shared<const std::vector<uint8_t>>(response->GetBody());
+      std::lock_guard<std::mutex> lock(mutex);
+      auto existing = entries.find(key);
+      if (existing != entries.end()) {
+        order.erase(existing->second.position);
+        entries.erase(existing);
+      }
+      order.push_front(key);
+      entries[key] = Slot{response->GetStatusCode(), response->GetHeaders(), body,
+          std::chrono::steady_clock::now() + ttl, order.begin()};
+      while (entries.size() > settings.maxEntries) {
+        entries.erase(order.back());
+        order.pop_back();
+      }
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_DOUBLE_KEY_HTTP_DELEGATE_H_
@@ -0,0 +1,245 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ElasticThreadPool, a bounded pool of dedicated threads for long-running tasks
+ * 
+ * @file elastic_thread_pool.h
+ */
+
+#ifndef API_MIP_ELASTIC_THREAD_POOL_H_
+#define API_MIP_ELASTIC_THREAD_POOL_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/task_function.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of an ElasticThreadPool
+ */
+struct ElasticThreadPoolSettings {
+  /** Threads kept alive while idle */
+  size_t minThreads = 0;
+  /** Upper bound on threads; tasks beyond it wait in the queue */
+  size_t maxThreads = 64;
+  /** Idle time after which threads beyond minThreads exit */
+  std::chrono::milliseconds idleTimeout = std::chrono::seconds(30);
+};
+
+/**
+ * @brief Snapshot of the state of an ElasticThreadPool
+ */
+struct ElasticThreadPoolMetrics {
+  size_t threadCount = 0;         /**< Threads alive */
+  size_t busyThreadCount = 0;     /**< Threads running a task */
+  size_t queuedTaskCount = 0;     /**< Tasks waiting for a thread */
+  size_t peakThreadCount = 0;     /**< Most threads alive at once */
+  size_t peakQueuedTaskCount = 0; /**< Most tasks waiting at once */
+  uint64_t executedTaskCount = 0; /**< Tasks run so far */
+  uint64_t startedThreadCount = 0; /**< Threads started so far */
+  uint64_t reapedThreadCount = 0; /**< Threads that exited after idleTimeout */
+  uint64_t saturatedCount = 0;    /**< Tasks that had to wait because maxThreads threads were busy */
+};
+
+/**
+ * @brief Runs long-running tasks on dedicated threads, starting threads on demand up to a bound and reaping idle ones
+ * 
+ * @note A task starts a new thread only when no thread is idle and fewer than maxThreads are alive, otherwise it
+ *       waits in a FIFO queue, so a burst of blocking tasks cannot exhaust OS threads; ElasticThreadPoolMetrics shows
+ *       when that happens. Tasks that block on other tasks of the same pool need maxThreads above the depth of that
+ *       chain. Stop discards queued tasks and waits for running ones.
+ */
+class ElasticThreadPool {
+public:
+  /**
+   * @brief Start minThreads threads
+   * 
+   * @param settings Thread bounds and idle timeout
+   */
+  explicit ElasticThreadPool(const ElasticThreadPoolSettings& settings = ElasticThreadPoolSettings())
+      : mMinThreads(settings.minThreads),
+        mMaxThreads((std::max)(settings.maxThreads, (std::max)(settings.minThreads, static_cast<size_t>(1)))),
+        mIdleTimeout(settings.idleTimeout),
+        mIdleCount(0),
+        mBusyCount(0),
+        mIsStopping(false) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    while (mThreads.size() < mMinThreads) {
+      StartThread();
+    }
+  }
+
+  /**
+   * @brief Discard queued tasks and join the threads once their running tasks return
+   */
+  ~ElasticThreadPool() { Stop(); }
+
+  ElasticThreadPool(const ElasticThreadPool&) = delete;
+  ElasticThreadPool& operator=(const ElasticThreadPool&) = delete;
+
+  /**
+   * @brief Run a task on a pool thread, queueing it while maxThreads threads are busy
+   * 
+   * @param task Function to be executed
+   * 
+   * @return false if the pool was stopped and the task discarded
+   */
+  bool Execute(TaskFunction task) {
+    std::vector<std::thread> exited;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mIsStopping) {
+        return false;
+      }
+      mTasks.push_back(std::move(task));
+      mMetrics.peakQueuedTaskCount = (std::max)(mMetrics.peakQueuedTaskCount, mTasks.size());
+      if (mTasks.size() <= mIdleCount) {
+        mChanged.notify_one();
+      } else if (mThreads.size() < mMaxThreads) {
+        StartThread();
+      } else {
+        ++mMetrics.saturatedCount;
+      }
+      exited.swap(mExited);
+    }
+    for (auto& thread : exited) {
+      thread.join();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Discard queued tasks and wait for running tasks to return. Later tasks are discarded.
+   */
+  void Stop() {
+    std::list<std::thread> threads;
+    std::vector<std::thread> exited;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+      mTasks.clear();
+      threads.swap(mThreads);
+      exited.swap(mExited);
+    }
+    mChanged.notify_all();
+    for (auto& thread : threads) {
+      if (thread.get_id() != std::this_thread::get_id()) {
+        thread.join();
+      } else {
+        thread.detach();
+      }
+    }
+    for (auto& thread : exited) {
+      thread.join();
+    }
+  }
+
+  /**
+   * @brief Get the current state and counters of the pool
+   */
+  ElasticThreadPoolMetrics GetMetrics() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ElasticThreadPoolMetrics metrics = mMetrics;
+    metrics.threadCount = mThreads.size();
+    metrics.busyThreadCount = mBusyCount;
+    metrics.queuedTaskCount = mTasks.size();
+    return metrics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Called with mMutex held; the thread reads its own entry only under mMutex, after it is assigned
+  void StartThread() {
+    auto self = mThreads.emplace(mThreads.end());
+    *self = std::thread([this, self]() { Run(self); });
+    ++mMetrics.startedThreadCount;
+    mMetrics.peakThreadCount = (std::max)(mMetrics.peakThreadCount, mThreads.size());
+  }
+
+  void Run(std::list<std::thread>::iterator self) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+      if (!mTasks.empty()) {
+        TaskFunction task = std::move(mTasks.front());
+        mTasks.pop_front();
+        ++mBusyCount;
+        lock.unlock();
+        try {
+          task();
+        } catch (...) {
+        }
+        task = nullptr;
+        lock.lock();
+        --mBusyCount;
+        ++mMetrics.executedTaskCount;
+        continue;
+      }
+      if (mIsStopping) {
+        return;
+      }
+      ++mIdleCount;
+      bool isWoken = mChanged.wait_for(lock, mIdleTimeout, [this]() { return !mTasks.empty() || mIsStopping; });
+      --mIdleCount;
+      if (!isWoken && mThreads.size() > mMinThreads) {
+        // Joined by the next Execute or Stop, since a thread cannot join itself
+        mExited.push_back(std::move(*self));
+        mThreads.erase(self);
+        ++mMetrics.reapedThreadCount;
+        return;
+      }
+    }
+  }
+
+  const size_t mMinThreads;
+  const size_t mMaxThreads;
+  const std::chrono::milliseconds mIdleTimeout;
+  mutable std::mutex mMutex;
+  std::condition_variable mChanged;
+  std::deque<TaskFunction> mTasks;
+  std::list<std::thread> mThreads;
+  std::vector<std::thread> mExited;
+  size_t mIdleCount;
+  size_t mBusyCount;
+  bool mIsStopping;
+  ElasticThreadPoolMetrics mMetrics;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_ELASTIC_THREAD_POOL_H_
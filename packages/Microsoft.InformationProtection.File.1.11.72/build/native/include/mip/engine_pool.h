@@ -0,0 +1,261 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines EnginePool, which loads engines on first use and evicts the least recently used ones
+ * 
+ * @file engine_pool.h
+ */
+
+#ifndef API_MIP_ENGINE_POOL_H_
+#define API_MIP_ENGINE_POOL_H_
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Keeps a bounded set of engines (FileEngine, ProtectionEngine, PolicyEngine) loaded, keyed by engine ID.
+ * 
+ * @note Engines are loaded by the loader on first use. When the estimated size of the loaded engines exceeds the
+ *       budget, the least recently used engines are unloaded. An engine returned by Get may be evicted once it
+ *       is no longer the most recently used, so fetch it from the pool per operation rather than holding it.
+ *       Adding an engine with the ID of a previously unloaded engine loads it from the profile's cache rather than
+ *       from the network, so reloading an evicted engine is cheap. Concurrent requests for an engine that is being
+ *       loaded wait for the same load.
+ */
+template <typename TEngine>
+class EnginePool {
+public:
+  /** @brief Loads the engine with the given ID */
+  typedef std::function<std::shared_ptr<TEngine>(const std::string& engineId)> Loader;
+  /** @brief Unloads an evicted engine, for example through FileProfile::UnloadEngineAsync */
+  typedef std::function<void(const std::string& engineId, const std::shared_ptr<TEngine>& engine)> Unloader;
+  /** @brief Estimates the memory used by an engine, in the same unit as the budget */
+  typedef std::function<int64_t(const std::shared_ptr<TEngine>& engine)> SizeEstimator;
+
+  /**
+   * @brief EnginePool constructor
+   * 
+   * @param loader Loads an engine on first use
+   * @param unloader Called for each evicted engine, may be empty
+   * @param budget Maximum total estimated size of loaded engines
+   * @param sizeEstimator Estimates each engine's size. If empty, each engine counts as 1 and @p budget is an
+   *        engine count.
+   */
+  EnginePool(
+      const Loader& loader,
+      const Unloader& unloader,
+      int64_t budget,
+      const SizeEstimator& sizeEstimator = nullptr)
+      : mLoader(loader),
+        mUnloader(unloader),
+        mSizeEstimator(sizeEstimator),
+        mBudget(budget > 0 ? budget : 1),
+        mUsedBudget(0) {
+    if (!mLoader) {
+      throw BadInputError("EnginePool requires a loader");
+    }
+  }
+
+  /**
+   * @brief Get the engine with the given ID, loading it if needed
+   * 
+   * @param engineId Engine ID
+   * 
+   * @return Engine
+   */
+  std::shared_ptr<TEngine> Get(const std::string& engineId) {
+    std::shared_future<std::shared_ptr<TEngine>> pending;
+    std::promise<std::shared_ptr<TEngine>> promise;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto existing = mEntries.find(engineId);
+      if (existing != mEntries.end()) {
+        mRecency.splice(mRecency.begin(), mRecency, existing->second.recency);
+        pending = existing->second.engine;
+      } else {
+        mRecency.push_front(engineId);
+        Entry entry;
+        entry.engine = promise.get_future().share();
+        entry.size = 0;
+        entry.isLoaded = false;
+        entry.recency = mRecency.begin();
+        mEntries.emplace(engineId, entry);
+      }
+    }
+    if (pending.valid()) {
+      return pending.get();
+    }
+
+    std::shared_ptr<TEngine> engine;
+    try {
+      engine = mLoader(engineId);
+      if (!engine) {
+        throw BadInputError("EnginePool loader returned no engine for " + engineId);
+      }
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto failed = mEntries.find(engineId);
+      if (failed != mEntries.end()) {
+        mRecency.erase(failed->second.recency);
+        mEntries.erase(failed);
+      }
+      throw;
+    }
+    promise.set_value(engine);
+    int64_t size = mSizeEstimator ? mSizeEstimator(engine) : 1;
+    std::vector<std::pair<std::string, std::shared_ptr<TEngine>>> evicted;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto loaded = mEntries.find(engineId);
+      if (loaded != mEntries.end()) {
+        loaded->second.size = size;
+        loaded->second.isLoaded = true;
+        mUsedBudget += size;
+      }
+      Evict(engineId, evicted);
+    }
+    Unload(evicted);
+    return engine;
+  }
+
+  /**
+   * @brief Unload the engine with the given ID, if it is loaded
+   * 
+   * @param engineId Engine ID
+   */
+  void Remove(const std::string& engineId) {
+    std::vector<std::pair<std::string, std::shared_ptr<TEngine>>> removed;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto existing = mEntries.find(engineId);
+      if (existing == mEntries.end() || !existing->second.isLoaded) {
+        return;
+      }
+      removed.emplace_back(engineId, existing->second.engine.get());
+      mUsedBudget -= existing->second.size;
+      mRecency.erase(existing->second.recency);
+      mEntries.erase(existing);
+    }
+    Unload(removed);
+  }
+
+  /**
+   * @brief Get the estimated size of a loaded engine
+   * 
+   * @param engineId Engine ID
+   * 
+   * @return Estimated size, or 0 if the engine is not loaded
+   */
+  int64_t GetEstimatedSize(const std::string& engineId) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto existing = mEntries.find(engineId);
+    return existing != mEntries.end() ? existing->second.size : 0;
+  }
+
+  /**
+   * @brief Get the total estimated size of the loaded engines
+   * 
+   * @return Used budget
+   */
+  int64_t GetUsedBudget() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mUsedBudget;
+  }
+
+  /**
+   * @brief Get the number of loaded or loading engines
+   * 
+   * @return Engine count
+   */
+  size_t GetEngineCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::shared_future<std::shared_ptr<TEngine>> engine;
+    int64_t size;
+    bool isLoaded;
+    std::list<std::string>::iterator recency;
+  };
+
+  void Evict(const std::string& keepEngineId, std::vector<std::pair<std::string, std::shared_ptr<TEngine>>>& evicted) {
+    for (auto it = mRecency.end(); mUsedBudget > mBudget && it != mRecency.begin();) {
+      --it;
+      auto candidate = mEntries.find(*it);
+      if (*it == keepEngineId || !candidate->second.isLoaded) {
+        continue;
+      }
+      evicted.emplace_back(*it, candidate->second.engine.get());
+      mUsedBudget -= candidate->second.size;
+      mEntries.erase(candidate);
+      it = mRecency.erase(it);
+    }
+  }
+
+  void Unload(const std::vector<std::pair<std::string, std::shared_ptr<TEngine>>>& engines) {
+    if (!mUnloader) {
+      return;
+    }
+    for (const auto& engine : engines) {
+      try {
+        mUnloader(engine.first, engine.second);
+      } catch (...) {
+        // The engine is already out of the pool; a failed unload only delays releasing its memory
+      }
+    }
+  }
+
+  Loader mLoader;
+  Unloader mUnloader;
+  SizeEstimator mSizeEstimator;
+  int64_t mBudget;
+  int64_t mUsedBudget;
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, Entry> mEntries;
+  std::list<std::string> mRecency;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_ENGINE_POOL_H_
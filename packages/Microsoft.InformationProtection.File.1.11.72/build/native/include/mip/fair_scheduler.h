@@ -0,0 +1,684 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines FairScheduler, which shares HTTP concurrency and task threads between tenants by weight, with
+ *        per-tenant caps and load shedding
+ * 
+ * @file fair_scheduler.h
+ */
+
+#ifndef API_MIP_FAIR_SCHEDULER_H_
+#define API_MIP_FAIR_SCHEDULER_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Share of a FairScheduler given to one tenant
+ */
+struct TenantQuota {
+  double weight = 1.0;      /**< Share of capacity relative to the other busy tenants */
+  size_t maxConcurrent = 0; /**< HTTP requests, and separately tasks, running at once; 0 for no cap */
+  size_t maxQueued = 1000;  /**< HTTP requests waiting beyond which new ones are shed; 0 for no limit */
+  size_t maxOperations = 0; /**< Operations admitted at once by FairScheduler::Admit; 0 for no cap */
+};
+
+/**
+ * @brief Settings of a FairScheduler
+ */
+struct FairSchedulerSettings {
+  size_t maxConcurrentHttp = 64;  /**< HTTP requests sent at once, for all tenants */
+  size_t maxConcurrentTasks = 16; /**< Tasks running at once, for all tenants; the dispatcher's thread count */
+  int64_t retryAfterSeconds = 5;  /**< Retry-After of the 429 response that sheds a request */
+  TenantQuota defaultQuota;       /**< Quota of tenants without one of their own */
+};
+
+/**
+ * @brief Statistics of one tenant of a FairScheduler
+ */
+struct FairTenantStatistics {
+  std::string tenant;   /**< Tenant */
+  size_t runningHttp;   /**< HTTP requests being sent */
+  size_t queuedHttp;    /**< HTTP requests waiting */
+  size_t runningTasks;  /**< Tasks running */
+  size_t queuedTasks;   /**< Tasks waiting */
+  size_t operations;    /**< Operations admitted */
+  size_t shedCount;     /**< HTTP requests and operations refused so far */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace fairscheduler {
+
+typedef std::map<std::string, std::string, CaseInsensitiveComparator> Headers;
+
+class ShedResponse : public HttpResponse {
+public:
+  ShedResponse(const std::string& id, int64_t retryAfterSeconds) : mId(id) {
+    mHeaders["Retry-After"] = std::to_string(retryAfterSeconds);
+  }
+  const std::string& GetId() const override { return mId; }
+  int32_t GetStatusCode() const override { return 429; }
+  const std::vector<uint8_t>& GetBody() const override { return mBody; }
+  const Headers& GetHeaders() const override { return mHeaders; }
+
+private:
+  std::string mId;
+  Headers mHeaders;
+  std::vector<uint8_t> mBody;
+};
+
+class CompletedOperation : public HttpOperation {
+public:
+  CompletedOperation(const std::string& id, const std::shared_ptr<HttpResponse>& response, bool isCancelled)
+      : mId(id), mResponse(response), mIsCancelled(isCancelled) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return mIsCancelled; }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+  bool mIsCancelled;
+};
+
+// Work of one tenant waiting for capacity. start runs it once granted, cancel reports it dropped.
+struct Item {
+  std::string id;
+  std::function<void()> start;
+  std::function<void()> cancel;
+};
+
+// Start-time fair queueing over a fixed capacity: a tenant's virtual time advances by 1 / weight per item started,
+// and the backlogged tenant with the lowest virtual time that is under its cap goes next
+class FairQueue {
+public:
+  explicit FairQueue(size_t capacity) : mCapacity((std::max)(capacity, static_cast<size_t>(1))) {}
+
+  // False if the tenant's queue is full and the item was not queued
+  bool Enqueue(const std::string& tenant, const TenantQuota& quota, bool canShed, Item item) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      Tenant& state = mTenants[tenant];
+      if (canShed && quota.maxQueued != 0 && state.queue.size() >= quota.maxQueued) {
+        ++state.shedCount;
+        return false;
+      }
+      if (state.queue.empty() && state.running == 0) {
+        state.virtualTime = (std::max)(state.virtualTime, mVirtualTime);
+      }
+      state.quota = quota;
+      state.queue.push_back(std::move(item));
+    }
+    Dispatch();
+    return true;
+  }
+
+  void Release(const std::string& tenant) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      --mTenants[tenant].running;
+      --mRunning;
+    }
+    Dispatch();
+  }
+
+  // Removes queued items of a tenant, or of every tenant if tenant is empty, matching id unless id is empty
+  std::vector<Item> Remove(const std::string& tenant, const std::string& id) {
+    std::vector<Item> removed;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& state : mTenants) {
+      if (!tenant.empty() && state.first != tenant) {
+        continue;
+      }
+      auto& queue = state.second.queue;
+      for (auto item = queue.begin(); item != queue.end();) {
+        if (id.empty() || item->id == id) {
+          removed.push_back(std::move(*item));
+          item = queue.erase(item);
+        } else {
+          ++item;
+        }
+      }
+    }
+    return removed;
+  }
+
+  void GetStatistics(const std::string& tenant, size_t& running, size_t& queued, size_t& shedCount) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto state = mTenants.find(tenant);
+    running = state == mTenants.end() ? 0 : state->second.running;
+    queued = state == mTenants.end() ? 0 : state->second.queue.size();
+    shedCount = state == mTenants.end() ? 0 : state->second.shedCount;
+  }
+
+  std::vector<std::string> GetTenants() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::string> tenants;
+    for (const auto& state : mTenants) {
+      tenants.push_back(state.first);
+    }
+    return tenants;
+  }
+
+private:
+  struct Tenant {
+    std::deque<Item> queue;
+    TenantQuota quota;
+    size_t running = 0;
+    size_t shedCount = 0;
+    double virtualTime = 0;
+  };
+
+  // Starts items while there is capacity. Items completing synchronously re-enter through Release; the
+  // mIsDispatching flag turns that recursion into iterations of the loop already running.
+  void Dispatch() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mIsDispatching) {
+      return;
+    }
+    mIsDispatching = true;
+    while (mRunning < mCapacity) {
+      Tenant* next = nullptr;
+      for (auto& state : mTenants) {
+        Tenant& tenant = state.second;
+        bool isUnderCap = tenant.quota.maxConcurrent == 0 || tenant.running < tenant.quota.maxConcurrent;
+        if (!tenant.queue.empty() && isUnderCap && (next == nullptr || tenant.virtualTime < next->virtualTime)) {
+          next = &tenant;
+        }
+      }
+      if (next == nullptr) {
+        break;
+      }
+      Item item = std::move(next->queue.front());
+      next->queue.pop_front();
+      ++next->running;
+      ++mRunning;
+      mVirtualTime = next->virtualTime;
+      next->virtualTime += 1.0 / (next->quota.weight > 0 ? next->quota.weight : 1.0);
+      lock.unlock();
+      item.start();
+      lock.lock();
+    }
+    mIsDispatching = false;
+  }
+
+  mutable std::mutex mMutex;
+  size_t mCapacity;
+  size_t mRunning = 0;
+  double mVirtualTime = 0;
+  bool mIsDispatching = false;
+  std::map<std::string, Tenant> mTenants;
+};
+
+} // namespace fairscheduler
+/** @endcond */
+
+/**
+ * @brief Shares one transport and one task dispatcher between the tenants of a service, by weight
+ * 
+ * @note Pass the delegates from CreateHttpDelegate and CreateTaskDispatcherDelegate to MipConfiguration instead of
+ *       the transport and dispatcher they wrap. When capacity is short, each busy tenant gets a share proportional to
+ *       its TenantQuota::weight, so one tenant's bulk migration queues behind its own work while other tenants'
+ *       requests start next. HTTP requests beyond a tenant's maxQueued are shed: they complete at once with a 429
+ *       response and Retry-After, which the SDK reports as a throttling NetworkError, retryable like any service
+ *       throttling. Tasks are never shed, since the SDK relies on them running; they get fair order and caps only.
+ *       Admit applies the same kind of cap to the application's own operations, before they reach the SDK.
+ *       
+ *       Requests can be attributed per call, so tenants can share one FileProfile: pass a selector that reads the
+ *       tenant from the context given to the FileEngine call. Tasks carry no context, so fair task scheduling needs a
+ *       profile (MipContext) per tenant, each with its own task dispatcher view; see SharedResourcePool.
+ */
+class FairScheduler : public std::enable_shared_from_this<FairScheduler> {
+public:
+  /**
+   * @brief Gets the tenant of an HTTP request from the request and the context of the API call that sent it
+   */
+  typedef std::function<std::string(const HttpRequest& request, const std::shared_ptr<void>& context)> TenantSelector;
+
+  /**
+   * @brief Create a scheduler
+   * 
+   * @param transport Delegate sending the requests
+   * @param taskDispatcher Dispatcher running the tasks, with settings.maxConcurrentTasks threads
+   * @param settings Capacity and default quota
+   * 
+   * @return Scheduler
+   */
+  static std::shared_ptr<FairScheduler> Create(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+      const FairSchedulerSettings& settings = FairSchedulerSettings()) {
+    if (!transport || !taskDispatcher) {
+      throw BadInputError("FairScheduler requires a transport HttpDelegate and a TaskDispatcherDelegate");
+    }
+    return std::shared_ptr<FairScheduler>(new FairScheduler(transport, taskDispatcher, settings));
+  }
+
+  /**
+   * @brief Set the quota of a tenant
+   * 
+   * @param tenant Tenant, e.g. its tenant ID
+   * @param quota Quota, applied to work queued from now on
+   */
+  void SetTenantQuota(const std::string& tenant, const TenantQuota& quota) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQuotas[tenant] = quota;
+  }
+
+  /**
+   * @brief Get the quota of a tenant
+   * 
+   * @param tenant Tenant
+   * 
+   * @return Its quota, or the default quota
+   */
+  TenantQuota GetTenantQuota(const std::string& tenant) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto quota = mQuotas.find(tenant);
+    return quota == mQuotas.end() ? mSettings.defaultQuota : quota->second;
+  }
+
+  /**
+   * @brief Create the HttpDelegate of one tenant
+   * 
+   * @param tenant Tenant every request is attributed to
+   * 
+   * @return HttpDelegate for the tenant's profile
+   */
+  std::shared_ptr<HttpDelegate> CreateHttpDelegate(const std::string& tenant) {
+    return CreateHttpDelegate([tenant](const HttpRequest&, const std::shared_ptr<void>&) { return tenant; });
+  }
+
+  /**
+   * @brief Create an HttpDelegate that attributes each request to a tenant
+   * 
+   * @param selector Gets the tenant of a request, e.g. from the context passed to the FileEngine call
+   * 
+   * @return HttpDelegate for a profile shared by tenants
+   */
+  std::shared_ptr<HttpDelegate> CreateHttpDelegate(const TenantSelector& selector);
+
+  /**
+   * @brief Create the TaskDispatcherDelegate of one tenant
+   * 
+   * @param tenant Tenant every task is attributed to
+   * 
+   * @return TaskDispatcherDelegate for the tenant's profile
+   */
+  std::shared_ptr<TaskDispatcherDelegate> CreateTaskDispatcherDelegate(const std::string& tenant);
+
+  /**
+   * @brief Admit an operation of a tenant, e.g. the processing of one file, or refuse it when the tenant is at its cap
+   * 
+   * @param tenant Tenant
+   * 
+   * @return Ticket to hold for the duration of the operation
+   * 
+   * @throw NetworkError of category Throttled if the tenant already has TenantQuota::maxOperations admitted; retry
+   *        later, as for service throttling
+   */
+  std::shared_ptr<void> Admit(const std::string& tenant) {
+    TenantQuota quota = GetTenantQuota(tenant);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      Operations& operations = mOperations[tenant];
+      if (quota.maxOperations != 0 && operations.count >= quota.maxOperations) {
+        ++operations.shedCount;
+        throw NetworkError(NetworkError::Category::Throttled, std::string(), std::string(), 429,
+            "Tenant " + tenant + " is at its limit of " + std::to_string(quota.maxOperations) + " operations");
+      }
+      ++operations.count;
+    }
+    std::weak_ptr<FairScheduler> weakScheduler = shared_from_this();
+    return std::shared_ptr<void>(nullptr, [weakScheduler, tenant](void*) {
+      if (auto scheduler = weakScheduler.lock()) {
+        std::lock_guard<std::mutex> lock(scheduler->mMutex);
+        --scheduler->mOperations[tenant].count;
+      }
+    });
+  }
+
+  /**
+   * @brief Get the statistics of every tenant seen so far
+   * 
+   * @return Per-tenant statistics
+   */
+  std::vector<FairTenantStatistics> GetStatistics() const {
+    std::vector<std::string> tenants = mHttpQueue.GetTenants();
+    std::vector<std::string> taskTenants = mTaskQueue.GetTenants();
+    tenants.insert(tenants.end(), taskTenants.begin(), taskTenants.end());
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (const auto& operations : mOperations) {
+        tenants.push_back(operations.first);
+      }
+    }
+    std::sort(tenants.begin(), tenants.end());
+    tenants.erase(std::unique(tenants.begin(), tenants.end()), tenants.end());
+    std::vector<FairTenantStatistics> statistics;
+    for (const auto& tenant : tenants) {
+      FairTenantStatistics entry{tenant, 0, 0, 0, 0, 0, 0};
+      size_t httpShed = 0;
+      size_t taskShed = 0;
+      mHttpQueue.GetStatistics(tenant, entry.runningHttp, entry.queuedHttp, httpShed);
+      mTaskQueue.GetStatistics(tenant, entry.runningTasks, entry.queuedTasks, taskShed);
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto operations = mOperations.find(tenant);
+      if (operations != mOperations.end()) {
+        entry.operations = operations->second.count;
+        entry.shedCount = operations->second.shedCount;
+      }
+      entry.shedCount += httpShed + taskShed;
+      statistics.push_back(entry);
+    }
+    return statistics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  friend class FairHttpDelegate;
+  friend class FairTaskDispatcherDelegate;
+
+  struct Operations {
+    size_t count = 0;
+    size_t shedCount = 0;
+  };
+
+  FairScheduler(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+      const FairSchedulerSettings& settings)
+      : mTransport(transport),
+        mTaskDispatcher(taskDispatcher),
+        mSettings(settings),
+        mHttpQueue(settings.maxConcurrentHttp),
+        mTaskQueue(settings.maxConcurrentTasks) {}
+
+  std::shared_ptr<HttpDelegate> mTransport;
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  FairSchedulerSettings mSettings;
+  mutable std::mutex mMutex;
+  std::map<std::string, TenantQuota> mQuotas;
+  std::map<std::string, Operations> mOperations;
+  fairscheduler::FairQueue mHttpQueue;
+  fairscheduler::FairQueue mTaskQueue;
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+// HttpDelegate of a FairScheduler: requests wait in their tenant's queue until the scheduler grants them capacity
+class FairHttpDelegate final : public HttpDelegate {
+public:
+  FairHttpDelegate(const std::shared_ptr<FairScheduler>& scheduler, const FairScheduler::TenantSelector& selector)
+      : mScheduler(scheduler), mSelector(selector) {}
+
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    std::string tenant = mSelector(*request, context);
+    auto wait = std::make_shared<SyncWait>();
+    fairscheduler::Item item{request->GetId(),
+        [wait]() { wait->Set(true); },
+        [wait]() { wait->Set(false); }};
+    if (!mScheduler->mHttpQueue.Enqueue(tenant, mScheduler->GetTenantQuota(tenant), true, std::move(item))) {
+      return Shed(request);
+    }
+    if (!wait->Wait()) {
+      return std::make_shared<fairscheduler::CompletedOperation>(request->GetId(), nullptr, true);
+    }
+    try {
+      auto operation = mScheduler->mTransport->Send(request, context);
+      mScheduler->mHttpQueue.Release(tenant);
+      return operation;
+    } catch (...) {
+      mScheduler->mHttpQueue.Release(tenant);
+      throw;
+    }
+  }
+
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    std::string tenant = mSelector(*request, context);
+    std::shared_ptr<FairScheduler> scheduler = mScheduler;
+    fairscheduler::Item item{request->GetId(),
+        [scheduler, tenant, request, context, callbackFn]() {
+          try {
+            scheduler->mTransport->SendAsync(request, context,
+                [scheduler, tenant, callbackFn](std::shared_ptr<HttpOperation> operation) {
+                  scheduler->mHttpQueue.Release(tenant);
+                  if (callbackFn) {
+                    callbackFn(operation);
+                  }
+                });
+          } catch (...) {
+            scheduler->mHttpQueue.Release(tenant);
+            if (callbackFn) {
+              callbackFn(std::make_shared<fairscheduler::CompletedOperation>(request->GetId(), nullptr, true));
+            }
+          }
+        },
+        [request, callbackFn]() {
+          if (callbackFn) {
+            callbackFn(std::make_shared<fairscheduler::CompletedOperation>(request->GetId(), nullptr, true));
+          }
+        }};
+    if (!mScheduler->mHttpQueue.Enqueue(tenant, mScheduler->GetTenantQuota(tenant), true, std::move(item))) {
+      auto operation = Shed(request);
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+      return operation;
+    }
+    return std::make_shared<fairscheduler::CompletedOperation>(request->GetId(), nullptr, false);
+  }
+
+  void CancelOperation(const std::string& requestId) override {
+    for (const auto& item : mScheduler->mHttpQueue.Remove(std::string(), requestId)) {
+      item.cancel();
+    }
+    mScheduler->mTransport->CancelOperation(requestId);
+  }
+
+  void CancelAllOperations() override {
+    for (const auto& item : mScheduler->mHttpQueue.Remove(std::string(), std::string())) {
+      item.cancel();
+    }
+    mScheduler->mTransport->CancelAllOperations();
+  }
+
+private:
+  class SyncWait {
+  public:
+    void Set(bool isStarted) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsDone = true;
+      mIsStarted = isStarted;
+      mCondition.notify_all();
+    }
+    bool Wait() {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this]() { return mIsDone; });
+      return mIsStarted;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mIsDone = false;
+    bool mIsStarted = false;
+  };
+
+  std::shared_ptr<HttpOperation> Shed(const std::shared_ptr<HttpRequest>& request) const {
+    auto response = std::make_shared<fairscheduler::ShedResponse>(
+        request->GetId(), mScheduler->mSettings.retryAfterSeconds);
+    return std::make_shared<fairscheduler::CompletedOperation>(request->GetId(), response, false);
+  }
+
+  std::shared_ptr<FairScheduler> mScheduler;
+  FairScheduler::TenantSelector mSelector;
+};
+
+// TaskDispatcherDelegate of a FairScheduler for one tenant: tasks wait in the tenant's queue, then run on the
+// scheduler's dispatcher
+class FairTaskDispatcherDelegate final : public TaskDispatcherDelegate {
+public:
+  FairTaskDispatcherDelegate(const std::shared_ptr<FairScheduler>& scheduler, const std::string& tenant)
+      : mScheduler(scheduler),
+        mTenant(tenant),
+        mDelayed(std::make_shared<Delayed>()) {}
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    Enqueue(mScheduler, mTenant, taskId, std::move(task));
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    std::shared_ptr<FairScheduler> scheduler = mScheduler;
+    std::string tenant = mTenant;
+    std::shared_ptr<Delayed> delayed = mDelayed;
+    delayed->Add(taskId);
+    mScheduler->mTaskDispatcher->DispatchTask(GetSharedTaskId(taskId), [scheduler, tenant, delayed, taskId, task]() {
+      if (delayed->Remove(taskId)) {
+        Enqueue(scheduler, tenant, taskId, task);
+      }
+    }, delaySeconds);
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    // Long-running work on its own thread does not take a dispatcher thread, so it is not scheduled
+    mScheduler->mTaskDispatcher->ExecuteTaskOnIndependentThread(GetSharedTaskId(taskId), std::move(task));
+  }
+
+  bool CancelTask(const std::string& taskId) override {
+    if (!mScheduler->mTaskQueue.Remove(mTenant, taskId).empty()) {
+      return true;
+    }
+    if (mDelayed->Remove(taskId)) {
+      mScheduler->mTaskDispatcher->CancelTask(GetSharedTaskId(taskId));
+      return true;
+    }
+    return mScheduler->mTaskDispatcher->CancelTask(GetSharedTaskId(taskId));
+  }
+
+  void CancelAllTasks() override {
+    mScheduler->mTaskQueue.Remove(mTenant, std::string());
+    for (const auto& taskId : mDelayed->RemoveAll()) {
+      mScheduler->mTaskDispatcher->CancelTask(GetSharedTaskId(taskId));
+    }
+  }
+
+private:
+  class Delayed {
+  public:
+    void Add(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIds.insert(id);
+    }
+    bool Remove(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      return mIds.erase(id) != 0;
+    }
+    std::vector<std::string> RemoveAll() {
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::vector<std::string> ids(mIds.begin(), mIds.end());
+      mIds.clear();
+      return ids;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::unordered_set<std::string> mIds;
+  };
+
+  static void Enqueue(
+      const std::shared_ptr<FairScheduler>& scheduler,
+      const std::string& tenant,
+      const std::string& taskId,
+      std::function<void()> task) {
+    std::string sharedTaskId = tenant + "/" + taskId;
+    fairscheduler::Item item{taskId,
+        [scheduler, tenant, sharedTaskId, task]() {
+          try {
+            scheduler->mTaskDispatcher->DispatchTask(sharedTaskId, [scheduler, tenant, task]() {
+              struct Release {
+                ~Release() { scheduler->mTaskQueue.Release(tenant); }
+                const std::shared_ptr<FairScheduler>& scheduler;
+                const std::string& tenant;
+              } release{scheduler, tenant};
+              task();
+            });
+          } catch (...) {
+            scheduler->mTaskQueue.Release(tenant);
+          }
+        },
+        []() {}};
+    scheduler->mTaskQueue.Enqueue(tenant, scheduler->GetTenantQuota(tenant), false, std::move(item));
+  }
+
+  std::string GetSharedTaskId(const std::string& taskId) const { return mTenant + "/" + taskId; }
+
+  std::shared_ptr<FairScheduler> mScheduler;
+  std::string mTenant;
+  std::shared_ptr<Delayed> mDelayed;
+};
+/** @endcond */
+
+inline std::shared_ptr<HttpDelegate> FairScheduler::CreateHttpDelegate(const TenantSelector& selector) {
+  if (!selector) {
+    throw BadInputError("FairScheduler requires a tenant selector");
+  }
+  return std::make_shared<FairHttpDelegate>(shared_from_this(), selector);
+}
+
+inline std::shared_ptr<TaskDispatcherDelegate> FairScheduler::CreateTaskDispatcherDelegate(const std::string& tenant) {
+  return std::make_shared<FairTaskDispatcherDelegate>(shared_from_this(), tenant);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FAIR_SCHEDULER_H_
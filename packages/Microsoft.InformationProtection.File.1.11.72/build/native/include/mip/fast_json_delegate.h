@@ -0,0 +1,899 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a JsonDelegate that keeps a parsed document in a few flat arrays and parses through JsonReader, and
+ *        non-owning views to read such documents without copies
+ * 
+ * @file fast_json_delegate.h
+ */
+
+#ifndef API_MIP_FAST_JSON_DELEGATE_H_
+#define API_MIP_FAST_JSON_DELEGATE_H_
+
+#include <algorithm>
+#include <climits>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/json_delegate.h"
+#include "mip/json_document.h"
+#include "mip/json_reader.h"
+#include "mip/json_value.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace fastjson {
+
+enum class NodeType : uint8_t { Null, False, True, Int64, Uint64, Double, String, Array, Object };
+
+struct Node {
+  NodeType type;
+  uint32_t first;    // String: offset in Storage::chars; Array, Object: first entry in Storage::links
+  uint32_t size;     // String: length; Array, Object: number of children
+  uint32_t capacity; // Array, Object: entries reserved in Storage::links
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  } number;
+};
+
+struct Link {
+  uint32_t node;
+  uint32_t keyOffset; // Object members only
+  uint32_t keySize;
+};
+
+inline int CompareKeys(const char* left, size_t leftSize, const char* right, size_t rightSize) {
+  int result = std::memcmp(left, right, (std::min)(leftSize, rightSize));
+  return result != 0 ? result : (leftSize < rightSize ? -1 : (leftSize > rightSize ? 1 : 0));
+}
+
+// One document: every value is a Node, children are contiguous runs of Links, and all text shares one buffer
+struct Storage {
+  // Objects with at least this many members get a sorted index on their first lookup by key
+  static const uint32_t kIndexedMemberCount = 16;
+
+  std::vector<Node> nodes;
+  std::vector<Link> links;
+  std::string chars;
+  mutable std::mutex indexMutex;
+  mutable std::unordered_map<uint32_t, std::vector<uint32_t>> memberIndexes; // Object node to sorted link positions
+
+  static void CheckSize(size_t size) {
+    if (size > UINT32_MAX) {
+      throw BadInputError("JSON document is too large");
+    }
+  }
+
+  uint32_t AddString(const char* data, size_t size) {
+    CheckSize(chars.size() + size);
+    uint32_t offset = static_cast<uint32_t>(chars.size());
+    chars.append(data, size);
+    return offset;
+  }
+
+  uint32_t AddNode(NodeType type) {
+    CheckSize(nodes.size() + 1);
+    Node node;
+    node.type = type;
+    node.first = 0;
+    node.size = 0;
+    node.capacity = 0;
+    node.number.u = 0;
+    nodes.push_back(node);
+    return static_cast<uint32_t>(nodes.size() - 1);
+  }
+
+  uint32_t AddStringNode(const char* data, size_t size) {
+    uint32_t offset = AddString(data, size);
+    uint32_t index = AddNode(NodeType::String);
+    nodes[index].first = offset;
+    nodes[index].size = static_cast<uint32_t>(size);
+    return index;
+  }
+
+  // Adds a child to a container built after parsing; a full run of links moves to the end with twice the room
+  void Append(uint32_t container, const Link& link) {
+    Node& node = nodes[container];
+    if (node.type == NodeType::Object && node.size + 1 >= kIndexedMemberCount) {
+      std::lock_guard<std::mutex> lock(indexMutex);
+      memberIndexes.erase(container);
+    }
+    if (node.size == node.capacity) {
+      uint32_t capacity = node.capacity == 0 ? 4 : node.capacity * 2;
+      CheckSize(links.size() + capacity);
+      uint32_t first = static_cast<uint32_t>(links.size());
+      links.resize(links.size() + capacity);
+      std::copy(links.begin() + node.first, links.begin() + node.first + node.size, links.begin() + first);
+      node.first = first;
+      node.capacity = capacity;
+    }
+    links[node.first + node.size++] = link;
+  }
+
+  // Returns the first member with the key, like a scan in document order would
+  const Link* FindMember(uint32_t object, const char* key, size_t keySize) const {
+    const Node& node = nodes[object];
+    if (node.size < kIndexedMemberCount) {
+      for (uint32_t i = 0; i < node.size; ++i) {
+        const Link& link = links[node.first + i];
+        if (link.keySize == keySize && std::memcmp(chars.data() + link.keyOffset, key, keySize) == 0) {
+          return &link;
+        }
+      }
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(indexMutex);
+    std::vector<uint32_t>& index = memberIndexes[object];
+    if (index.empty()) {
+      index.reserve(node.size);
+      for (uint32_t i = 0; i < node.size; ++i) {
+        index.push_back(node.first + i);
+      }
+      std::stable_sort(index.begin(), index.end(), [this](uint32_t left, uint32_t right) {
+        return CompareKeys(chars.data() + links[left].keyOffset, links[left].keySize,
+            chars.data() + links[right].keyOffset, links[right].keySize) < 0;
+      });
+    }
+    auto found = std::lower_bound(index.begin(), index.end(), 0, [this, key, keySize](uint32_t position, int) {
+      return CompareKeys(chars.data() + links[position].keyOffset, links[position].keySize, key, keySize) < 0;
+    });
+    if (found == index.end()) {
+      return nullptr;
+    }
+    const Link& link = links[*found];
+    return CompareKeys(chars.data() + link.keyOffset, link.keySize, key, keySize) == 0 ? &link : nullptr;
+  }
+};
+
+// Builds nodes from JsonReader events; the children of a container are gathered and stored as one run at its end
+class Builder : public JsonHandler {
+public:
+  explicit Builder(Storage& storage) : mStorage(storage), mRoot(0), mKeyOffset(0), mKeySize(0) {}
+
+  uint32_t GetRoot() const { return mRoot; }
+
+  bool Null() override { return AddValue(mStorage.AddNode(NodeType::Null)); }
+  bool Bool(bool value) override { return AddValue(mStorage.AddNode(value ? NodeType::True : NodeType::False)); }
+  bool Int64(int64_t value) override {
+    uint32_t index = mStorage.AddNode(NodeType::Int64);
+    mStorage.nodes[index].number.i = value;
+    return AddValue(index);
+  }
+  bool Uint64(uint64_t value) override {
+    uint32_t index = mStorage.AddNode(NodeType::Uint64);
+    mStorage.nodes[index].number.u = value;
+    return AddValue(index);
+  }
+  bool Double(double value) override {
+    uint32_t index = mStorage.AddNode(NodeType::Double);
+    mStorage.nodes[index].number.d = value;
+    return AddValue(index);
+  }
+  bool String(const char* data, size_t size) override { return AddValue(mStorage.AddStringNode(data, size)); }
+  bool Key(const char* data, size_t size) override {
+    mKeyOffset = mStorage.AddString(data, size);
+    mKeySize = static_cast<uint32_t>(size);
+    return true;
+  }
+  bool StartObject() override { return StartContainer(NodeType::Object); }
+  bool EndObject(size_t /*memberCount*/) override { return EndContainer(); }
+  bool StartArray() override { return StartContainer(NodeType::Array); }
+  bool EndArray(size_t /*elementCount*/) override { return EndContainer(); }
+
+private:
+  struct Frame {
+    uint32_t node;
+    size_t firstPending;
+  };
+
+  bool AddValue(uint32_t index) {
+    if (mFrames.empty()) {
+      mRoot = index;
+    } else {
+      mPending.push_back(Link{index, mKeyOffset, mKeySize});
+      mKeySize = 0;
+    }
+    return true;
+  }
+
+  bool StartContainer(NodeType type) {
+    uint32_t index = mStorage.AddNode(type);
+    AddValue(index);
+    mFrames.push_back(Frame{index, mPending.size()});
+    return true;
+  }
+
+  bool EndContainer() {
+    Frame frame = mFrames.back();
+    mFrames.pop_back();
+    size_t count = mPending.size() - frame.firstPending;
+    Storage::CheckSize(mStorage.links.size() + count);
+    Node& node = mStorage.nodes[frame.node];
+    node.first = static_cast<uint32_t>(mStorage.links.size());
+    node.size = static_cast<uint32_t>(count);
+    node.capacity = node.size;
+    mStorage.links.insert(mStorage.links.end(), mPending.begin() + frame.firstPending, mPending.end());
+    mPending.resize(frame.firstPending);
+    return true;
+  }
+
+  Storage& mStorage;
+  uint32_t mRoot;
+  uint32_t mKeyOffset;
+  uint32_t mKeySize;
+  std::vector<Frame> mFrames;
+  std::vector<Link> mPending;
+};
+
+inline void AppendEscaped(std::string& out, const char* data, size_t size) {
+  static const char kHex[] = "0123456789ABCDEF";
+  out += '"';
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          out += "\\u00";
+          out += kHex[c >> 4];
+          out += kHex[c & 0xF];
+        } else {
+          out += static_cast<char>(c);
+        }
+    }
+  }
+  out += '"';
+}
+
+// Shortest text that reads back as the same double, always with a fraction or exponent
+inline void AppendDouble(std::string& out, double value) {
+  if (!std::isfinite(value)) {
+    out += "null";
+    return;
+  }
+  char decimalPoint = std::localeconv()->decimal_point[0];
+  char buffer[32];
+  for (int precision = 15; precision <= 17; ++precision) {
+    std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (precision == 17 || std::strtod(buffer, nullptr) == value) {
+      break;
+    }
+  }
+  std::string text(buffer);
+  size_t point = text.find(decimalPoint);
+  if (point != std::string::npos) {
+    text[point] = '.';
+  } else if (text.find('e') == std::string::npos) {
+    text += ".0";
+  }
+  out += text;
+}
+
+inline void Serialize(const Storage& storage, uint32_t index, std::string& out) {
+  const Node& node = storage.nodes[index];
+  switch (node.type) {
+    case NodeType::Null: out += "null"; break;
+    case NodeType::False: out += "false"; break;
+    case NodeType::True: out += "true"; break;
+    case NodeType::Int64: out += std::to_string(node.number.i); break;
+    case NodeType::Uint64: out += std::to_string(node.number.u); break;
+    case NodeType::Double: AppendDouble(out, node.number.d); break;
+    case NodeType::String: AppendEscaped(out, storage.chars.data() + node.first, node.size); break;
+    case NodeType::Array:
+    case NodeType::Object: {
+      bool isObject = node.type == NodeType::Object;
+      out += isObject ? '{' : '[';
+      for (uint32_t i = 0; i < node.size; ++i) {
+        const Link& link = storage.links[node.first + i];
+        if (i != 0) {
+          out += ',';
+        }
+        if (isObject) {
+          AppendEscaped(out, storage.chars.data() + link.keyOffset, link.keySize);
+          out += ':';
+        }
+        Serialize(storage, link.node, out);
+      }
+      out += isObject ? '}' : ']';
+      break;
+    }
+  }
+}
+
+} // namespace fastjson
+/** @endcond */
+
+/**
+ * @brief A non-owning view of a JSON string, valid while its document is alive
+ */
+struct JsonStringView {
+  const char* data = ""; /**< First byte, not null terminated */
+  size_t size = 0;       /**< Size in bytes */
+
+  /** @cond DOXYGEN_HIDE */
+  JsonStringView() {}
+  JsonStringView(const char* viewData, size_t viewSize) : data(viewData), size(viewSize) {}
+  /** @endcond */
+
+  /**
+   * @brief Copies the string
+   */
+  std::string ToString() const { return std::string(data, size); }
+
+  /** @cond DOXYGEN_HIDE */
+  bool operator==(const JsonStringView& other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+  bool operator!=(const JsonStringView& other) const { return !(*this == other); }
+  bool operator==(const std::string& other) const { return *this == JsonStringView(other.data(), other.size()); }
+  bool operator!=(const std::string& other) const { return !(*this == other); }
+  bool operator==(const char* other) const { return *this == JsonStringView(other, std::strlen(other)); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  /** @endcond */
+};
+
+class JsonElement;
+struct JsonMember;
+
+/**
+ * @brief Forward iterator over the children of a JsonElement, in document order
+ */
+class JsonElementIterator {
+public:
+  /** @cond DOXYGEN_HIDE */
+  typedef std::forward_iterator_tag iterator_category;
+  typedef JsonMember value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const JsonMember* pointer;
+  typedef JsonMember reference;
+
+  JsonElementIterator() : mStorage(nullptr), mPosition(0) {}
+  JsonElementIterator(const fastjson::Storage* storage, uint32_t position) : mStorage(storage), mPosition(position) {}
+  /** @endcond */
+
+  /**
+   * @brief Get the current member
+   */
+  JsonMember operator*() const;
+
+  /** @cond DOXYGEN_HIDE */
+  JsonElementIterator& operator++() {
+    ++mPosition;
+    return *this;
+  }
+  JsonElementIterator operator++(int) {
+    JsonElementIterator previous = *this;
+    ++mPosition;
+    return previous;
+  }
+  bool operator==(const JsonElementIterator& other) const {
+    return mStorage == other.mStorage && mPosition == other.mPosition;
+  }
+  bool operator!=(const JsonElementIterator& other) const { return !(*this == other); }
+
+private:
+  const fastjson::Storage* mStorage;
+  uint32_t mPosition;
+  /** @endcond */
+};
+
+/**
+ * @brief A non-owning handle to a value of a FastJsonDelegate document, for reading it without shared_ptr or copies
+ * 
+ * @note Copying an element copies two words. It is only valid while the document, or a JsonValue of it, is alive,
+ *       and while the document is not modified. A default-constructed element, or one for a missing member or an
+ *       index out of range, is invalid and reads as null.
+ */
+class JsonElement {
+public:
+  /** @cond DOXYGEN_HIDE */
+  JsonElement() : mStorage(nullptr), mIndex(0) {}
+  JsonElement(const fastjson::Storage* storage, uint32_t index) : mStorage(storage), mIndex(index) {}
+  /** @endcond */
+
+  /** @brief Whether the element refers to a value */
+  bool IsValid() const { return mStorage != nullptr; }
+  /** @brief Whether the value is null, or the element is invalid */
+  bool IsNull() const { return GetType() == fastjson::NodeType::Null; }
+  /** @brief Whether the value is true or false */
+  bool IsBool() const { return GetType() == fastjson::NodeType::True || GetType() == fastjson::NodeType::False; }
+  /** @brief Whether the value is a number of any type */
+  bool IsNumber() const {
+    fastjson::NodeType type = GetType();
+    return type == fastjson::NodeType::Int64 || type == fastjson::NodeType::Uint64 ||
+        type == fastjson::NodeType::Double;
+  }
+  /** @brief Whether the value is an integer that fits an int64_t */
+  bool IsInt64() const {
+    return GetType() == fastjson::NodeType::Int64 ||
+        (GetType() == fastjson::NodeType::Uint64 && GetNode().number.u <= static_cast<uint64_t>(INT64_MAX));
+  }
+  /** @brief Whether the value is a non-negative integer */
+  bool IsUint64() const { return GetType() == fastjson::NodeType::Uint64; }
+  /** @brief Whether the value is a string */
+  bool IsString() const { return GetType() == fastjson::NodeType::String; }
+  /** @brief Whether the value is an array */
+  bool IsArray() const { return GetType() == fastjson::NodeType::Array; }
+  /** @brief Whether the value is an object */
+  bool IsObject() const { return GetType() == fastjson::NodeType::Object; }
+
+  /** @brief Get a bool value, false for any other type */
+  bool GetBool() const { return GetType() == fastjson::NodeType::True; }
+
+  /** @brief Get a number as int64_t, 0 for any other type */
+  int64_t GetInt64() const {
+    switch (GetType()) {
+      case fastjson::NodeType::Int64: return GetNode().number.i;
+      case fastjson::NodeType::Uint64: return static_cast<int64_t>(GetNode().number.u);
+      case fastjson::NodeType::Double: return static_cast<int64_t>(GetNode().number.d);
+      default: return 0;
+    }
+  }
+
+  /** @brief Get a number as uint64_t, 0 for any other type */
+  uint64_t GetUint64() const {
+    switch (GetType()) {
+      case fastjson::NodeType::Int64: return static_cast<uint64_t>(GetNode().number.i);
+      case fastjson::NodeType::Uint64: return GetNode().number.u;
+      case fastjson::NodeType::Double: return static_cast<uint64_t>(GetNode().number.d);
+      default: return 0;
+    }
+  }
+
+  /** @brief Get a number as double, 0 for any other type */
+  double GetDouble() const {
+    switch (GetType()) {
+      case fastjson::NodeType::Int64: return static_cast<double>(GetNode().number.i);
+      case fastjson::NodeType::Uint64: return static_cast<double>(GetNode().number.u);
+      case fastjson::NodeType::Double: return GetNode().number.d;
+      default: return 0.0;
+    }
+  }
+
+  /**
+   * @brief Get a string value without copying it
+   * 
+   * @return The string, empty for any other type
+   */
+  JsonStringView GetStringView() const {
+    if (!IsString()) {
+      return JsonStringView();
+    }
+    const fastjson::Node& node = GetNode();
+    return JsonStringView(mStorage->chars.data() + node.first, node.size);
+  }
+
+  /** @brief Get the number of members of an object or elements of an array, 0 for any other type */
+  size_t Size() const { return IsArray() || IsObject() ? GetNode().size : 0; }
+
+  /**
+   * @brief Get an element of an array
+   * 
+   * @param index Position of the element
+   * 
+   * @return The element, invalid if this is not an array or the index is out of range
+   */
+  JsonElement operator[](size_t index) const {
+    if (!IsArray() || index >= GetNode().size) {
+      return JsonElement();
+    }
+    return JsonElement(mStorage, mStorage->links[GetNode().first + index].node);
+  }
+
+  /**
+   * @brief Get a member of an object
+   * 
+   * @param key Name of the member, not null terminated
+   * @param keySize Size of the name
+   * 
+   * @return The first member with that name, invalid if there is none or this is not an object
+   * 
+   * @note Objects with many members are indexed on the first lookup, so later lookups are logarithmic.
+   */
+  JsonElement FindMember(const char* key, size_t keySize) const {
+    if (!IsObject()) {
+      return JsonElement();
+    }
+    const fastjson::Link* link = mStorage->FindMember(mIndex, key, keySize);
+    return link ? JsonElement(mStorage, link->node) : JsonElement();
+  }
+
+  /** @brief Get a member of an object, see FindMember(const char*, size_t) */
+  JsonElement FindMember(const std::string& key) const { return FindMember(key.data(), key.size()); }
+
+  /** @brief Get the first child of an array or object, for range-based for loops */
+  JsonElementIterator begin() const {
+    return Size() == 0 ? JsonElementIterator() : JsonElementIterator(mStorage, GetNode().first);
+  }
+
+  /** @brief Get the end of the children of an array or object */
+  JsonElementIterator end() const {
+    return Size() == 0 ? JsonElementIterator() : JsonElementIterator(mStorage, GetNode().first + GetNode().size);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  fastjson::NodeType GetType() const { return mStorage ? GetNode().type : fastjson::NodeType::Null; }
+  const fastjson::Node& GetNode() const { return mStorage->nodes[mIndex]; }
+
+  const fastjson::Storage* mStorage;
+  uint32_t mIndex;
+  /** @endcond */
+};
+
+/**
+ * @brief A member of an object, or an element of an array with an empty key
+ */
+struct JsonMember {
+  JsonStringView key; /**< Name of an object member, empty for an array element */
+  JsonElement value;  /**< Value */
+};
+
+/** @cond DOXYGEN_HIDE */
+inline JsonMember JsonElementIterator::operator*() const {
+  const fastjson::Link& link = mStorage->links[mPosition];
+  return JsonMember{JsonStringView(mStorage->chars.data() + link.keyOffset, link.keySize),
+      JsonElement(mStorage, link.node)};
+}
+
+namespace fastjson {
+
+class Value : public JsonValue {
+public:
+  Value(const std::shared_ptr<Storage>& storage, uint32_t index) : mStorage(storage), mIndex(index) {}
+
+  bool IsString() const override { return GetNode().type == NodeType::String; }
+  bool IsArray() const override { return GetNode().type == NodeType::Array; }
+  bool IsObject() const override { return GetNode().type == NodeType::Object; }
+
+  bool HasMember(const std::string& key) const override {
+    return IsObject() && mStorage->FindMember(mIndex, key.data(), key.size()) != nullptr;
+  }
+
+  void PushBack(const std::shared_ptr<JsonValue>& jsonValue) override {
+    CheckType(NodeType::Array);
+    uint32_t index = Import(jsonValue);
+    mStorage->Append(mIndex, Link{index, 0, 0});
+  }
+
+  void PushBack(const std::string& member) override {
+    CheckType(NodeType::Array);
+    uint32_t index = mStorage->AddStringNode(member.data(), member.size());
+    mStorage->Append(mIndex, Link{index, 0, 0});
+  }
+
+  void AddMember(const std::string& key, const std::shared_ptr<JsonValue>& jsonValue) override {
+    CheckType(NodeType::Object);
+    AddMemberNode(key, Import(jsonValue));
+  }
+
+  void AddMember(const std::string& key, const std::string& member) override {
+    CheckType(NodeType::Object);
+    AddMemberNode(key, mStorage->AddStringNode(member.data(), member.size()));
+  }
+
+  void AddMember(const std::string& key, bool member) override {
+    CheckType(NodeType::Object);
+    AddMemberNode(key, mStorage->AddNode(member ? NodeType::True : NodeType::False));
+  }
+
+  void AddMember(const std::string& key, int member) override {
+    CheckType(NodeType::Object);
+    uint32_t index = mStorage->AddNode(member < 0 ? NodeType::Int64 : NodeType::Uint64);
+    mStorage->nodes[index].number.i = member;
+    AddMemberNode(key, index);
+  }
+
+  void AddMember(const std::string& key, unsigned int member) override {
+    CheckType(NodeType::Object);
+    uint32_t index = mStorage->AddNode(NodeType::Uint64);
+    mStorage->nodes[index].number.u = member;
+    AddMemberNode(key, index);
+  }
+
+  // Handles are cached per value, so HasMember then GetMember, or repeated lookups, allocate once per member
+  std::shared_ptr<JsonValue> GetMember(const std::string& key) const override {
+    if (!IsObject()) {
+      return nullptr;
+    }
+    const Link* link = mStorage->FindMember(mIndex, key.data(), key.size());
+    if (!link) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mMemberCacheMutex);
+    std::shared_ptr<JsonValue>& member = mMemberCache[link->node];
+    if (!member) {
+      member = std::make_shared<Value>(mStorage, link->node);
+    }
+    return member;
+  }
+
+  std::shared_ptr<JsonValue> GetMember(unsigned int index) const override {
+    const Node& node = GetNode();
+    if (node.type != NodeType::Array || index >= node.size) {
+      return nullptr;
+    }
+    return std::make_shared<Value>(mStorage, mStorage->links[node.first + index].node);
+  }
+
+  size_t Size() const override {
+    const Node& node = GetNode();
+    return node.type == NodeType::Array || node.type == NodeType::Object ? node.size : 0;
+  }
+
+  std::vector<std::string> GetStringArray() const override {
+    std::vector<std::string> strings;
+    const Node& node = GetNode();
+    if (node.type != NodeType::Array) {
+      return strings;
+    }
+    strings.reserve(node.size);
+    for (uint32_t i = 0; i < node.size; ++i) {
+      const Node& child = mStorage->nodes[mStorage->links[node.first + i].node];
+      if (child.type == NodeType::String) {
+        strings.emplace_back(mStorage->chars.data() + child.first, child.size);
+      }
+    }
+    return strings;
+  }
+
+  std::vector<std::pair<std::string, std::string>> GetStringObjectMembers() const override {
+    std::vector<std::pair<std::string, std::string>> members;
+    const Node& node = GetNode();
+    if (node.type != NodeType::Object) {
+      return members;
+    }
+    for (uint32_t i = 0; i < node.size; ++i) {
+      const Link& link = mStorage->links[node.first + i];
+      const Node& child = mStorage->nodes[link.node];
+      if (child.type == NodeType::String) {
+        members.emplace_back(std::string(mStorage->chars.data() + link.keyOffset, link.keySize),
+            std::string(mStorage->chars.data() + child.first, child.size));
+      }
+    }
+    return members;
+  }
+
+  std::string GetString() const override {
+    const Node& node = GetNode();
+    return node.type == NodeType::String ? std::string(mStorage->chars.data() + node.first, node.size) :
+                                           std::string();
+  }
+
+  bool IsInt() const override {
+    const Node& node = GetNode();
+    return (node.type == NodeType::Int64 && node.number.i >= INT_MIN) ||
+        (node.type == NodeType::Uint64 && node.number.u <= static_cast<uint64_t>(INT_MAX));
+  }
+
+  int GetInt() const override {
+    const Node& node = GetNode();
+    switch (node.type) {
+      case NodeType::Int64: return static_cast<int>(node.number.i);
+      case NodeType::Uint64: return static_cast<int>(node.number.u);
+      case NodeType::Double: return static_cast<int>(node.number.d);
+      default: return 0;
+    }
+  }
+
+  bool IsBool() const override { return GetNode().type == NodeType::True || GetNode().type == NodeType::False; }
+
+  bool IsUint() const override {
+    const Node& node = GetNode();
+    return node.type == NodeType::Uint64 && node.number.u <= UINT_MAX;
+  }
+
+  unsigned int GetUint() const override {
+    const Node& node = GetNode();
+    switch (node.type) {
+      case NodeType::Int64: return static_cast<unsigned int>(node.number.i);
+      case NodeType::Uint64: return static_cast<unsigned int>(node.number.u);
+      case NodeType::Double: return static_cast<unsigned int>(node.number.d);
+      default: return 0;
+    }
+  }
+
+  bool IsNumber() const override {
+    NodeType type = GetNode().type;
+    return type == NodeType::Int64 || type == NodeType::Uint64 || type == NodeType::Double;
+  }
+
+  double GetDouble() const override {
+    const Node& node = GetNode();
+    switch (node.type) {
+      case NodeType::Int64: return static_cast<double>(node.number.i);
+      case NodeType::Uint64: return static_cast<double>(node.number.u);
+      case NodeType::Double: return node.number.d;
+      default: return 0.0;
+    }
+  }
+
+  bool GetBool() const override { return GetNode().type == NodeType::True; }
+
+  std::string SerializeToString() const override {
+    std::string out;
+    Serialize(*mStorage, mIndex, out);
+    return out;
+  }
+
+  JsonElement GetElement() const { return JsonElement(mStorage.get(), mIndex); }
+
+private:
+  const Node& GetNode() const { return mStorage->nodes[mIndex]; }
+
+  void CheckType(NodeType type) const {
+    if (GetNode().type != type) {
+      throw BadInputError(type == NodeType::Object ? "JSON value is not an object" : "JSON value is not an array");
+    }
+  }
+
+  void AddMemberNode(const std::string& key, uint32_t index) {
+    uint32_t keyOffset = mStorage->AddString(key.data(), key.size());
+    mStorage->Append(mIndex, Link{index, keyOffset, static_cast<uint32_t>(key.size())});
+  }
+
+  // A value of this document is linked in place; any other is copied in through its serialization
+  uint32_t Import(const std::shared_ptr<JsonValue>& jsonValue) {
+    if (!jsonValue) {
+      throw BadInputError("JSON value is null");
+    }
+    auto value = std::dynamic_pointer_cast<Value>(jsonValue);
+    if (value && value->mStorage == mStorage) {
+      return value->mIndex;
+    }
+    Builder builder(*mStorage);
+    JsonReader reader;
+    reader.Parse(jsonValue->SerializeToString(), builder);
+    return builder.GetRoot();
+  }
+
+  std::shared_ptr<Storage> mStorage;
+  uint32_t mIndex;
+  mutable std::mutex mMemberCacheMutex;
+  mutable std::unordered_map<uint32_t, std::shared_ptr<JsonValue>> mMemberCache;
+};
+
+class Document : public JsonDocument {
+public:
+  Document(const std::shared_ptr<Storage>& storage, uint32_t root) : mStorage(storage), mRoot(root) {}
+
+  std::shared_ptr<JsonValue> Root() const override { return std::make_shared<Value>(mStorage, mRoot); }
+
+  std::shared_ptr<JsonValue> CreateObjectValue() override {
+    return std::make_shared<Value>(mStorage, mStorage->AddNode(NodeType::Object));
+  }
+
+  std::shared_ptr<JsonValue> CreateArrayValue() override {
+    return std::make_shared<Value>(mStorage, mStorage->AddNode(NodeType::Array));
+  }
+
+private:
+  std::shared_ptr<Storage> mStorage;
+  uint32_t mRoot;
+};
+
+} // namespace fastjson
+/** @endcond */
+
+/**
+ * @brief Get a non-owning view of a JSON value
+ * 
+ * @param jsonValue Value of a FastJsonDelegate document
+ * 
+ * @return The element, or an invalid element if the value comes from another JsonDelegate
+ * 
+ * @note The element stays valid while the document is alive and unmodified, not only while jsonValue is.
+ */
+inline JsonElement GetJsonElement(const JsonValue& jsonValue) {
+  auto value = dynamic_cast<const fastjson::Value*>(&jsonValue);
+  return value ? value->GetElement() : JsonElement();
+}
+
+/**
+ * @brief JsonDelegate that parses with JsonReader into a flat document, and streams to a JsonHandler without one
+ * 
+ * @note A parsed document is three arrays, of values, of child links and of text, instead of one heap object per
+ *       value, so parsing a large publishing license or template list costs a handful of allocations. JsonValue
+ *       objects are small handles into the document created on access, and keep it alive. Values added after parsing
+ *       are appended to the same arrays. A document can be read from several threads at once but not modified
+ *       concurrently. GetJsonElement gives a non-owning view of a value for reading strings and iterating arrays and
+ *       objects without copies or shared_ptr. Opt in with MipConfiguration::SetJsonDelegate.
+ */
+class FastJsonDelegate : public JsonDelegate, public JsonStreamParser {
+public:
+  /**
+   * @brief Creates a blank json document with an Object as the root.
+   * 
+   * @return A delegate response with the document
+   */
+  JsonResult CreateJsonObjectDocument() const override {
+    auto storage = std::make_shared<fastjson::Storage>();
+    uint32_t root = storage->AddNode(fastjson::NodeType::Object);
+    return JsonResult(std::make_shared<fastjson::Document>(storage, root));
+  }
+
+  /**
+   * @brief parse value as json document.
+   * 
+   * @return A delegate response with the document, or a BadInputError if the value is not valid JSON
+   */
+  JsonResult Parse(const std::string& value) const override {
+    try {
+      auto storage = std::make_shared<fastjson::Storage>();
+      // Text never outgrows the input, and values take at least a few bytes each
+      storage->chars.reserve(value.size());
+      storage->nodes.reserve(value.size() / 8 + 1);
+      fastjson::Builder builder(*storage);
+      JsonReader reader;
+      reader.Parse(value, builder);
+      return JsonResult(std::make_shared<fastjson::Document>(storage, builder.GetRoot()));
+    } catch (...) {
+      return JsonResult(std::current_exception());
+    }
+  }
+
+  /**
+   * @brief Parse a JSON text, reporting its values to a handler without building a document
+   * 
+   * @param value JSON text
+   * @param handler Receives the values
+   * 
+   * @return false if the handler stopped parsing
+   * 
+   * @throws BadInputError if the text is not valid JSON
+   */
+  bool ParseStream(const std::string& value, JsonHandler& handler) const override {
+    JsonReader reader;
+    return reader.Parse(value, handler);
+  }
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FAST_JSON_DELEGATE_H_
@@ -0,0 +1,800 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an XmlReader that parses a buffer in place and returns views instead of strings
+ * 
+ * @file fast_xml_reader.h
+ */
+
+#ifndef API_MIP_FAST_XML_READER_H_
+#define API_MIP_FAST_XML_READER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mapped_file_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/xml_delegate.h"
+#include "mip/xml_reader.h"
+
+MIP_NAMESPACE_BEGIN
+
+namespace xml {
+
+/**
+ * @brief A non-owning view of a name or value of the current node of a FastXmlReader
+ * 
+ * @note Valid until the reader moves to another node.
+ */
+struct XmlStringView {
+  const char* data = ""; /**< First byte, not null terminated */
+  size_t size = 0;       /**< Size in bytes */
+
+  /** @cond DOXYGEN_HIDE */
+  XmlStringView() {}
+  XmlStringView(const char* viewData, size_t viewSize) : data(viewData), size(viewSize) {}
+  /** @endcond */
+
+  /**
+   * @brief Copies the string
+   */
+  std::string ToString() const { return std::string(data, size); }
+
+  /** @cond DOXYGEN_HIDE */
+  bool operator==(const XmlStringView& other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+  bool operator!=(const XmlStringView& other) const { return !(*this == other); }
+  bool operator==(const char* other) const { return *this == XmlStringView(other, std::strlen(other)); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace fastxml {
+
+inline bool IsWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool IsNameEnd(char c) {
+  return IsWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '?';
+}
+
+inline void AppendUtf8(std::string& out, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    out += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    out += static_cast<char>(0xC0 | (codePoint >> 6));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    out += static_cast<char>(0xE0 | (codePoint >> 12));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (codePoint >> 18));
+    out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+}
+
+struct Span {
+  const char* data;
+  size_t size;
+};
+
+struct Attribute {
+  Span name;
+  Span value;
+};
+
+struct OpenElement {
+  Span name;
+  Span tag; // Start tag, for GetAncestors
+};
+
+} // namespace fastxml
+/** @endcond */
+
+/**
+ * @brief XmlReader over a buffer that is parsed in place
+ * 
+ * @note Names and values are found by scanning the buffer with memchr, which the C runtime vectorizes, and are held
+ *       as pointers into it, so moving from node to node allocates nothing once the element stack and attribute list
+ *       have grown. The GetNameView, GetValueView and GetAttributeView methods return them without copying; the
+ *       XmlReader methods copy into std::string as the interface requires. Values are only unescaped, into a buffer
+ *       of the reader, when they contain entity references. Only the predefined entities and character references
+ *       are expanded and the DTD is skipped, so no external resource is ever loaded. Node types, names and values
+ *       follow the libxml2 text reader: the XML declaration is not reported, "<a/>" is one ELEMENT with
+ *       IsEmptyElement true, and whitespace-only text is SIGNIFICANT_WHITESPACE.
+ */
+class FastXmlReader : public XmlReader {
+public:
+  /**
+   * @brief Read a buffer without copying it
+   * 
+   * @param data XML text, UTF-8, kept alive by the caller for the lifetime of the reader
+   * @param size Size in bytes
+   */
+  FastXmlReader(const char* data, size_t size) { Reset(data, size); }
+
+  /**
+   * @brief Read a string, taking ownership of it
+   * 
+   * @param xml XML text, UTF-8
+   */
+  explicit FastXmlReader(std::string xml) : mOwnedText(std::move(xml)) { Reset(mOwnedText.data(), mOwnedText.size()); }
+
+  /**
+   * @brief Read a stream
+   * 
+   * @param stream XML content from its current position; a MappedFileStream is read in place
+   */
+  explicit FastXmlReader(const std::shared_ptr<Stream>& stream) {
+    if (!stream) {
+      throw BadInputError("FastXmlReader requires a stream");
+    }
+    auto mapped = std::dynamic_pointer_cast<MappedFileStream>(stream);
+    int64_t position = stream->Position();
+    int64_t size = stream->Size() - position;
+    const uint8_t* borrowed = mapped && size > 0 ? mapped->Borrow(position, size) : nullptr;
+    if (borrowed) {
+      mOwnedStream = stream;
+      Reset(reinterpret_cast<const char*>(borrowed), static_cast<size_t>(size));
+      return;
+    }
+    mOwnedBuffer.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    size_t read = 0;
+    for (;;) {
+      if (read == mOwnedBuffer.size()) {
+        mOwnedBuffer.resize(mOwnedBuffer.size() + 64 * 1024);
+      }
+      int64_t count = stream->Read(reinterpret_cast<uint8_t*>(&mOwnedBuffer[read]),
+          static_cast<int64_t>(mOwnedBuffer.size() - read));
+      if (count <= 0) {
+        break;
+      }
+      read += static_cast<size_t>(count);
+    }
+    mOwnedBuffer.resize(read);
+    Reset(mOwnedBuffer.data(), mOwnedBuffer.size());
+  }
+
+  FastXmlReader(const FastXmlReader&) = delete;
+  FastXmlReader& operator=(const FastXmlReader&) = delete;
+
+  /** @brief Reads the next node */
+  bool Read() override {
+    mAttribute = -1;
+    mAttributes.clear();
+    mIsEmpty = false;
+    mValueIsDecoded = false;
+    for (;;) {
+      mNodeBegin = mPos;
+      if (mPos >= mEnd) {
+        if (!mStack.empty()) {
+          Fail("unexpected end of document");
+        }
+        if (!mHasRoot) {
+          Fail("no root element");
+        }
+        mType = XmlReaderTypes::NONE;
+        return false;
+      }
+      if (*mPos != '<') {
+        if (ReadText()) {
+          return true;
+        }
+        continue;
+      }
+      if (StartsWith("<?")) {
+        if (ReadProcessingInstruction()) {
+          return true;
+        }
+        continue;
+      }
+      if (StartsWith("<!--")) {
+        ReadDelimited(XmlReaderTypes::COMMENT, 4, "-->");
+      } else if (StartsWith("<![CDATA[")) {
+        if (mStack.empty()) {
+          Fail("CDATA outside the root element");
+        }
+        ReadDelimited(XmlReaderTypes::CDATA, 9, "]]>");
+      } else if (StartsWith("<!DOCTYPE")) {
+        ReadDocumentType();
+      } else if (StartsWith("</")) {
+        ReadEndTag();
+      } else {
+        ReadStartTag();
+      }
+      return true;
+    }
+  }
+
+  /** @brief Get current node type, ATTRIBUTE while on an attribute */
+  XmlReaderTypes GetNodeType() const override { return mAttribute >= 0 ? XmlReaderTypes::ATTRIBUTE : mType; }
+
+  /** @brief Get the name of the current node or attribute */
+  std::string GetName() const override { return GetNameView().ToString(); }
+
+  /** @brief Get the name of the current node or attribute, false before the first node */
+  bool GetName(std::string& name) const override {
+    if (mType == XmlReaderTypes::NONE) {
+      return false;
+    }
+    XmlStringView view = GetNameView();
+    name.assign(view.data, view.size);
+    return true;
+  }
+
+  /** @brief Move past the current element and its children to the next node */
+  bool Skip() override {
+    MoveToElement();
+    if (mType == XmlReaderTypes::ELEMENT && !mIsEmpty) {
+      SkipToEndTag();
+    }
+    return Read();
+  }
+
+  /** @brief Get the value of the current node or attribute */
+  bool GetValue(std::string& value) const override {
+    XmlStringView view;
+    if (!GetValueView(view)) {
+      return false;
+    }
+    value.assign(view.data, view.size);
+    return true;
+  }
+
+  /** @brief Get the start tags of the elements enclosing the current node, for error messages */
+  std::string GetAncestors() const override {
+    std::string ancestors;
+    for (const auto& element : mStack) {
+      ancestors.append(element.tag.data, element.tag.size);
+    }
+    bool isOnStack = mType == XmlReaderTypes::ELEMENT && !mIsEmpty;
+    if (!isOnStack) {
+      XmlStringView name = mType == XmlReaderTypes::ELEMENT ? XmlStringView() : GetNameView();
+      ancestors += mType == XmlReaderTypes::ELEMENT ? std::string(mNodeBegin, mNodeEnd) : "<" + name.ToString() + ">";
+    }
+    return ancestors;
+  }
+
+  /** @brief Whether the current node is an element written as "<a/>" */
+  bool IsEmptyElement() const override { return mAttribute < 0 && mType == XmlReaderTypes::ELEMENT && mIsEmpty; }
+
+  /** @brief Get an attribute of the current element */
+  bool GetAttribute(const std::string& attributeName, std::string& attribute) const override {
+    XmlStringView view;
+    if (!GetAttributeView(attributeName.data(), attributeName.size(), view)) {
+      return false;
+    }
+    attribute.assign(view.data, view.size);
+    return true;
+  }
+
+  /** @brief Whether the current element has attributes */
+  bool HasAttributes() const override { return !mAttributes.empty(); }
+
+  /** @brief Move to the first attribute of the current element */
+  bool MoveToFirstAttribute() override {
+    if (mAttributes.empty()) {
+      return false;
+    }
+    mAttribute = 0;
+    mValueIsDecoded = false;
+    return true;
+  }
+
+  /** @brief Move to the next attribute of the current element */
+  bool MoveToNextAttribute() override {
+    if (mAttribute < 0) {
+      return MoveToFirstAttribute();
+    }
+    if (static_cast<size_t>(mAttribute) + 1 >= mAttributes.size()) {
+      return false;
+    }
+    ++mAttribute;
+    mValueIsDecoded = false;
+    return true;
+  }
+
+  /** @brief Move from an attribute back to its element */
+  bool MoveToElement() override {
+    if (mAttribute < 0) {
+      return false;
+    }
+    mAttribute = -1;
+    mValueIsDecoded = false;
+    return true;
+  }
+
+  /** @brief Get the text of the current node as written, moving to the end tag of an element */
+  std::string DumpNode() override {
+    MoveToElement();
+    const char* begin = mNodeBegin;
+    if (mType == XmlReaderTypes::ELEMENT && !mIsEmpty) {
+      SkipToEndTag();
+    }
+    return std::string(begin, mNodeEnd);
+  }
+
+  /**
+   * @brief Get the name of the current node or attribute without copying it
+   * 
+   * @return Qualified name of an element or attribute, target of a processing instruction, or a name such as "#text"
+   */
+  XmlStringView GetNameView() const {
+    if (mAttribute >= 0) {
+      return ToView(mAttributes[mAttribute].name);
+    }
+    switch (mType) {
+      case XmlReaderTypes::TEXT:
+      case XmlReaderTypes::SIGNIFICANT_WHITESPACE: return XmlStringView("#text", 5);
+      case XmlReaderTypes::CDATA: return XmlStringView("#cdata-section", 14);
+      case XmlReaderTypes::COMMENT: return XmlStringView("#comment", 8);
+      case XmlReaderTypes::NONE: return XmlStringView();
+      default: return ToView(mName);
+    }
+  }
+
+  /**
+   * @brief Get the value of the current node or attribute without copying it, unless it has entity references
+   * 
+   * @param value Set to the value, valid until the reader moves or another value with entity references is read
+   * 
+   * @return true for text, CDATA, comments, processing instructions and attributes; false for other nodes
+   */
+  bool GetValueView(XmlStringView& value) const {
+    if (mAttribute >= 0) {
+      value = Decode(mAttributes[mAttribute].value, true);
+      return true;
+    }
+    switch (mType) {
+      case XmlReaderTypes::TEXT:
+      case XmlReaderTypes::SIGNIFICANT_WHITESPACE: value = Decode(mValue, false); return true;
+      case XmlReaderTypes::CDATA:
+      case XmlReaderTypes::COMMENT:
+      case XmlReaderTypes::PROCESSING_INSTRUCTION: value = ToView(mValue); return true;
+      default: return false;
+    }
+  }
+
+  /**
+   * @brief Get an attribute of the current element without copying it, unless it has entity references
+   * 
+   * @param name Qualified name of the attribute, not null terminated
+   * @param nameSize Size of the name
+   * @param value Set to the value, valid until the reader moves or another value with entity references is read
+   * 
+   * @return true if the element has the attribute
+   */
+  bool GetAttributeView(const char* name, size_t nameSize, XmlStringView& value) const {
+    for (const auto& attribute : mAttributes) {
+      if (attribute.name.size == nameSize && std::memcmp(attribute.name.data, name, nameSize) == 0) {
+        value = Decode(attribute.value, true);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Get the number of elements enclosing the current node
+   */
+  size_t GetDepth() const {
+    bool isOnStack = mAttribute < 0 && mType == XmlReaderTypes::ELEMENT && !mIsEmpty;
+    return mStack.size() - (isOnStack ? 1 : 0) + (mAttribute >= 0 ? 1 : 0);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  void Reset(const char* data, size_t size) {
+    mBegin = data;
+    mPos = data;
+    mEnd = data + size;
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+      mPos += 3;
+    }
+    mNodeBegin = mPos;
+    mNodeEnd = mPos;
+    mType = XmlReaderTypes::NONE;
+    mName = fastxml::Span{mPos, 0};
+    mValue = fastxml::Span{mPos, 0};
+  }
+
+  [[noreturn]] void Fail(const char* reason) const {
+    throw BadInputError(std::string("Invalid XML at offset ") + std::to_string(mPos - mBegin) + ": " + reason);
+  }
+
+  static XmlStringView ToView(const fastxml::Span& span) { return XmlStringView(span.data, span.size); }
+
+  bool StartsWith(const char* prefix) const {
+    size_t length = std::strlen(prefix);
+    return static_cast<size_t>(mEnd - mPos) >= length && std::memcmp(mPos, prefix, length) == 0;
+  }
+
+  const char* Find(const char* from, const char* delimiter) const {
+    size_t length = std::strlen(delimiter);
+    const char* at = from;
+    while (static_cast<size_t>(mEnd - at) >= length) {
+      at = static_cast<const char*>(std::memchr(at, delimiter[0], static_cast<size_t>(mEnd - at)));
+      if (!at || static_cast<size_t>(mEnd - at) < length) {
+        return nullptr;
+      }
+      if (std::memcmp(at, delimiter, length) == 0) {
+        return at;
+      }
+      ++at;
+    }
+    return nullptr;
+  }
+
+  void SkipWhitespace() {
+    while (mPos < mEnd && fastxml::IsWhitespace(*mPos)) {
+      ++mPos;
+    }
+  }
+
+  fastxml::Span ReadName() {
+    const char* start = mPos;
+    while (mPos < mEnd && !fastxml::IsNameEnd(*mPos)) {
+      ++mPos;
+    }
+    if (mPos == start) {
+      Fail("expected a name");
+    }
+    return fastxml::Span{start, static_cast<size_t>(mPos - start)};
+  }
+
+  // Returns false for whitespace outside the root element, which is not a node
+  bool ReadText() {
+    const char* start = mPos;
+    const char* end = static_cast<const char*>(std::memchr(mPos, '<', static_cast<size_t>(mEnd - mPos)));
+    mPos = end ? end : mEnd;
+    bool isWhitespace = true;
+    for (const char* c = start; c < mPos && isWhitespace; ++c) {
+      isWhitespace = fastxml::IsWhitespace(*c);
+    }
+    if (mStack.empty()) {
+      if (!isWhitespace) {
+        mPos = start;
+        Fail("text outside the root element");
+      }
+      return false;
+    }
+    mType = isWhitespace ? XmlReaderTypes::SIGNIFICANT_WHITESPACE : XmlReaderTypes::TEXT;
+    mValue = fastxml::Span{start, static_cast<size_t>(mPos - start)};
+    mNodeEnd = mPos;
+    return true;
+  }
+
+  // Returns false for the XML declaration, which is not a node
+  bool ReadProcessingInstruction() {
+    mPos += 2;
+    fastxml::Span target = ReadName();
+    const char* end = Find(mPos, "?>");
+    if (!end) {
+      Fail("unterminated processing instruction");
+    }
+    SkipWhitespace();
+    const char* valueStart = mPos < end ? mPos : end;
+    mPos = end + 2;
+    if (target.size == 3 && (target.data[0] | 0x20) == 'x' && (target.data[1] | 0x20) == 'm' &&
+        (target.data[2] | 0x20) == 'l') {
+      return false;
+    }
+    mType = XmlReaderTypes::PROCESSING_INSTRUCTION;
+    mName = target;
+    mValue = fastxml::Span{valueStart, static_cast<size_t>(end - valueStart)};
+    mNodeEnd = mPos;
+    return true;
+  }
+
+  void ReadDelimited(XmlReaderTypes type, size_t prefixLength, const char* terminator) {
+    const char* start = mPos + prefixLength;
+    const char* end = Find(start, terminator);
+    if (!end) {
+      Fail(type == XmlReaderTypes::COMMENT ? "unterminated comment" : "unterminated CDATA section");
+    }
+    mType = type;
+    mValue = fastxml::Span{start, static_cast<size_t>(end - start)};
+    mPos = end + std::strlen(terminator);
+    mNodeEnd = mPos;
+  }
+
+  // The internal subset is skipped, not interpreted: entities it declares stay undefined
+  void ReadDocumentType() {
+    if (mHasRoot || !mStack.empty()) {
+      Fail("DOCTYPE after the root element");
+    }
+    mPos += 9;
+    SkipWhitespace();
+    mName = ReadName();
+    int bracketDepth = 0;
+    char quote = 0;
+    for (; mPos < mEnd; ++mPos) {
+      char c = *mPos;
+      if (quote) {
+        quote = c == quote ? 0 : quote;
+      } else if (c == '"' || c == '\'') {
+        quote = c;
+      } else if (c == '[') {
+        ++bracketDepth;
+      } else if (c == ']') {
+        --bracketDepth;
+      } else if (c == '>' && bracketDepth <= 0) {
+        break;
+      }
+    }
+    if (mPos == mEnd) {
+      Fail("unterminated DOCTYPE");
+    }
+    ++mPos;
+    mType = XmlReaderTypes::DOCUMENT_TYPE;
+    mNodeEnd = mPos;
+  }
+
+  void ReadEndTag() {
+    mPos += 2;
+    fastxml::Span name = ReadName();
+    SkipWhitespace();
+    if (mPos == mEnd || *mPos != '>') {
+      Fail("expected '>'");
+    }
+    ++mPos;
+    if (mStack.empty() || mStack.back().name.size != name.size ||
+        std::memcmp(mStack.back().name.data, name.data, name.size) != 0) {
+      mPos = mNodeBegin;
+      Fail("end tag does not match the start tag");
+    }
+    mStack.pop_back();
+    mType = XmlReaderTypes::END_ELEMENT;
+    mName = name;
+    mNodeEnd = mPos;
+  }
+
+  void ReadStartTag() {
+    if (mStack.empty() && mHasRoot) {
+      Fail("more than one root element");
+    }
+    ++mPos;
+    mName = ReadName();
+    for (;;) {
+      SkipWhitespace();
+      if (mPos == mEnd) {
+        Fail("unterminated start tag");
+      }
+      if (*mPos == '>' || *mPos == '/') {
+        break;
+      }
+      fastxml::Span name = ReadName();
+      SkipWhitespace();
+      if (mPos == mEnd || *mPos != '=') {
+        Fail("expected '=' after the attribute name");
+      }
+      ++mPos;
+      SkipWhitespace();
+      if (mPos == mEnd || (*mPos != '"' && *mPos != '\'')) {
+        Fail("expected a quoted attribute value");
+      }
+      char quote = *mPos++;
+      const char* end = static_cast<const char*>(std::memchr(mPos, quote, static_cast<size_t>(mEnd - mPos)));
+      if (!end) {
+        Fail("unterminated attribute value");
+      }
+      if (std::memchr(mPos, '<', static_cast<size_t>(end - mPos))) {
+        Fail("'<' in an attribute value");
+      }
+      mAttributes.push_back(fastxml::Attribute{name, fastxml::Span{mPos, static_cast<size_t>(end - mPos)}});
+      mPos = end + 1;
+    }
+    if (*mPos == '/') {
+      if (mEnd - mPos < 2 || mPos[1] != '>') {
+        Fail("expected '/>'");
+      }
+      mPos += 2;
+      mIsEmpty = true;
+    } else {
+      ++mPos;
+    }
+    mType = XmlReaderTypes::ELEMENT;
+    mHasRoot = true;
+    mNodeEnd = mPos;
+    if (!mIsEmpty) {
+      mStack.push_back(fastxml::OpenElement{mName, fastxml::Span{mNodeBegin, static_cast<size_t>(mPos - mNodeBegin)}});
+    }
+  }
+
+  // From a non-empty start tag to its end tag, which becomes the current node
+  void SkipToEndTag() {
+    size_t depth = mStack.size();
+    while (Read()) {
+      if (mType == XmlReaderTypes::END_ELEMENT && mStack.size() == depth - 1) {
+        return;
+      }
+    }
+  }
+
+  // Text and attribute values are unescaped on first access; attribute whitespace is normalized as XML requires
+  XmlStringView Decode(const fastxml::Span& span, bool isAttribute) const {
+    bool needsDecoding = std::memchr(span.data, '&', span.size) != nullptr;
+    for (size_t i = 0; isAttribute && !needsDecoding && i < span.size; ++i) {
+      needsDecoding = span.data[i] == '\t' || span.data[i] == '\n' || span.data[i] == '\r';
+    }
+    if (!needsDecoding) {
+      return ToView(span);
+    }
+    if (mValueIsDecoded && mDecodedSource == span.data) {
+      return XmlStringView(mDecoded.data(), mDecoded.size());
+    }
+    mDecoded.clear();
+    const char* end = span.data + span.size;
+    for (const char* c = span.data; c < end; ++c) {
+      if (isAttribute && (*c == '\t' || *c == '\n' || *c == '\r')) {
+        mDecoded += ' ';
+      } else if (*c != '&') {
+        mDecoded += *c;
+      } else {
+        const char* semicolon = static_cast<const char*>(std::memchr(c, ';', static_cast<size_t>(end - c)));
+        if (!semicolon) {
+          Fail("unterminated entity reference");
+        }
+        c = DecodeEntity(c + 1, semicolon);
+      }
+    }
+    mValueIsDecoded = true;
+    mDecodedSource = span.data;
+    return XmlStringView(mDecoded.data(), mDecoded.size());
+  }
+
+  const char* DecodeEntity(const char* name, const char* semicolon) const {
+    size_t length = static_cast<size_t>(semicolon - name);
+    if (length >= 2 && name[0] == '#') {
+      bool isHex = name[1] == 'x';
+      uint32_t codePoint = 0;
+      for (const char* digit = name + (isHex ? 2 : 1); digit < semicolon; ++digit) {
+        uint32_t value = 0;
+        if (*digit >= '0' && *digit <= '9') {
+          value = static_cast<uint32_t>(*digit - '0');
+        } else if (isHex && (*digit | 0x20) >= 'a' && (*digit | 0x20) <= 'f') {
+          value = static_cast<uint32_t>((*digit | 0x20) - 'a' + 10);
+        } else {
+          Fail("invalid character reference");
+        }
+        codePoint = codePoint * (isHex ? 16 : 10) + value;
+        if (codePoint > 0x10FFFF) {
+          Fail("invalid character reference");
+        }
+      }
+      fastxml::AppendUtf8(mDecoded, codePoint);
+    } else if (length == 2 && std::memcmp(name, "lt", 2) == 0) {
+      mDecoded += '<';
+    } else if (length == 2 && std::memcmp(name, "gt", 2) == 0) {
+      mDecoded += '>';
+    } else if (length == 3 && std::memcmp(name, "amp", 3) == 0) {
+      mDecoded += '&';
+    } else if (length == 4 && std::memcmp(name, "quot", 4) == 0) {
+      mDecoded += '"';
+    } else if (length == 4 && std::memcmp(name, "apos", 4) == 0) {
+      mDecoded += '\'';
+    } else {
+      Fail("undefined entity");
+    }
+    return semicolon;
+  }
+
+  std::string mOwnedText;
+  std::vector<char> mOwnedBuffer;
+  std::shared_ptr<Stream> mOwnedStream;
+  const char* mBegin = nullptr;
+  const char* mPos = nullptr;
+  const char* mEnd = nullptr;
+  const char* mNodeBegin = nullptr;
+  const char* mNodeEnd = nullptr;
+  XmlReaderTypes mType = XmlReaderTypes::NONE;
+  fastxml::Span mName;
+  fastxml::Span mValue;
+  bool mIsEmpty = false;
+  bool mHasRoot = false;
+  int mAttribute = -1;
+  std::vector<fastxml::Attribute> mAttributes;
+  std::vector<fastxml::OpenElement> mStack;
+  mutable std::string mDecoded;
+  mutable const char* mDecodedSource = nullptr;
+  mutable bool mValueIsDecoded = false;
+  /** @endcond */
+};
+
+/**
+ * @brief XmlDelegate that creates FastXmlReaders, and leaves documents to another XmlDelegate
+ * 
+ * @note Policy and license XML is mostly read through readers, which this delegate parses in one copy of the input
+ *       instead of allocating strings per node. XmlDelegate::ParseData needs a document model with XPath, so it is
+ *       forwarded, as is CreateXmlReader for input that is a URI rather than XML text. Set it as
+ *       MipConfiguration::mXmlDelegate from a derived configuration.
+ */
+class FastXmlDelegate : public XmlDelegate {
+public:
+  /**
+   * @brief Create the delegate
+   * 
+   * @param documentDelegate Delegate parsing documents and URIs
+   */
+  explicit FastXmlDelegate(const std::shared_ptr<XmlDelegate>& documentDelegate)
+      : mDocumentDelegate(documentDelegate) {
+    if (!mDocumentDelegate) {
+      throw BadInputError("FastXmlDelegate requires a delegate for documents");
+    }
+  }
+
+  /**
+   * @brief Create an xml reader that can transverse the input
+   * 
+   * @param xmlParserInput XML text, or a URI, which is forwarded
+   * 
+   * @return A delegate response with a FastXmlReader over a copy of the input
+   */
+  XmlReaderResult CreateXmlReader(const std::string& xmlParserInput) const override {
+    size_t start = xmlParserInput.compare(0, 3, "\xEF\xBB\xBF") == 0 ? 3 : 0;
+    start = xmlParserInput.find_first_not_of(" \t\r\n", start);
+    if (start == std::string::npos || xmlParserInput[start] != '<') {
+      return mDocumentDelegate->CreateXmlReader(xmlParserInput);
+    }
+    try {
+      return XmlReaderResult(std::make_shared<FastXmlReader>(xmlParserInput));
+    } catch (...) {
+      return XmlReaderResult(std::current_exception());
+    }
+  }
+
+  /**
+   * @brief Parse an xml formatted buffer into an XmlDocument, through the document delegate
+   * 
+   * @param data A string that should be in xml format
+   * 
+   * @return A delegate response with the document or an exception
+   */
+  XmlDocumentResult ParseData(const std::string& data) const override { return mDocumentDelegate->ParseData(data); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<XmlDelegate> mDocumentDelegate;
+  /** @endcond */
+};
+
+} // xml
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FAST_XML_READER_H_
@@ -0,0 +1,169 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines AttachedProtectionProfile, which serves ProtectionEngines sharing the identity and caches of
+ *        FileEngines
+ * 
+ * @file attached_protection_engine.h
+ */
+
+#ifndef API_MIP_FILE_ATTACHED_PROTECTION_ENGINE_H_
+#define API_MIP_FILE_ATTACHED_PROTECTION_ENGINE_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_profile.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_profile.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Serves a ProtectionEngine for each FileEngine of a FileProfile, sharing its identity, caches and delegates
+ * 
+ * @note The SDK does not expose the protection engine a FileEngine uses internally. An application needing both
+ *       APIs otherwise loads a second profile with its own HttpDelegate and storage, and a second engine that
+ *       acquires its own user certificate, licenses and templates for the same identity. AttachedProtectionProfile
+ *       loads one ProtectionProfile from the FileProfile's settings: the same MipContext (and so the same storage
+ *       root), cache storage type, consent, HTTP and task dispatcher delegates, session ID and license caching. Each
+ *       ProtectionEngine it returns is loaded with the FileEngine's engine ID, identity, authentication delegate,
+ *       cloud and protection endpoint, so it reads the user certificate, templates and licenses the FileEngine's
+ *       protection already cached, and its requests share the application's connection pool. Use the
+ *       ProtectionProfile of the File SDK package, which is the binary the FileEngine runs in; the separate
+ *       Protection SDK package keeps its own in-process state. Engines are held weakly and reloaded on demand.
+ *       Thread-safe.
+ */
+class AttachedProtectionProfile {
+public:
+  /**
+   * @brief AttachedProtectionProfile constructor
+   * 
+   * @param fileProfile File profile whose engines protection engines are attached to
+   * @param protectionObserver Observer of the protection profile, or nullptr
+   */
+  explicit AttachedProtectionProfile(
+      const std::shared_ptr<FileProfile>& fileProfile,
+      const std::shared_ptr<ProtectionProfile::Observer>& protectionObserver = nullptr)
+      : mFileProfile(fileProfile),
+        mProtectionObserver(protectionObserver) {
+    if (!fileProfile) {
+      throw BadInputError("AttachedProtectionProfile requires a file profile");
+    }
+  }
+
+  /**
+   * @brief Get the protection profile, loading it on first use
+   * 
+   * @return Protection profile sharing the file profile's context and delegates
+   */
+  std::shared_ptr<ProtectionProfile> GetProfile() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return GetProfileLocked();
+  }
+
+  /**
+   * @brief Get the protection engine attached to a file engine, loading it on first use
+   * 
+   * @param fileEngine Engine of the file profile
+   * 
+   * @return Protection engine with the same engine ID and identity
+   */
+  std::shared_ptr<ProtectionEngine> GetEngine(const std::shared_ptr<FileEngine>& fileEngine) {
+    if (!fileEngine) {
+      throw BadInputError("Cannot attach a protection engine to a null file engine");
+    }
+    const FileEngine::Settings& fileSettings = fileEngine->GetSettings();
+    if (!fileSettings.GetDelegatedUserEmail().empty()) {
+      throw NotSupportedError("Protection engines cannot be attached to delegated file engines");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& engine = mEngines[fileSettings.GetEngineId()];
+    auto existing = engine.lock();
+    if (existing) {
+      return existing;
+    }
+    ProtectionEngine::Settings settings(fileSettings.GetEngineId(), fileSettings.GetAuthDelegate(),
+        fileSettings.GetClientData(), fileSettings.GetLocale());
+    settings.SetIdentity(fileSettings.GetIdentity());
+    settings.SetCustomSettings(fileSettings.GetCustomSettings());
+    settings.SetSessionId(fileSettings.GetSessionId());
+    settings.SetCloud(fileSettings.GetCloud());
+    if (!fileSettings.GetProtectionCloudEndpointBaseUrl().empty()) {
+      settings.SetCloudEndpointBaseUrl(fileSettings.GetProtectionCloudEndpointBaseUrl());
+    }
+    settings.SetLoggerContext(fileSettings.GetLoggerContext());
+    existing = GetProfileLocked()->AddEngine(settings);
+    engine = existing;
+    return existing;
+  }
+
+  /**
+   * @brief Unload the protection engine attached to a file engine, if loaded
+   * 
+   * @param engineId Engine ID
+   * 
+   * @note The engine's cached state is kept, since it is shared with the file engine.
+   */
+  void Release(const std::string& engineId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEngines.erase(engineId);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<ProtectionProfile> GetProfileLocked() {
+    if (mProtectionProfile) {
+      return mProtectionProfile;
+    }
+    const FileProfile::Settings& fileSettings = mFileProfile->GetSettings();
+    ProtectionProfile::Settings settings(fileSettings.GetMipContext(), fileSettings.GetCacheStorageType(),
+        fileSettings.GetConsentDelegate(), mProtectionObserver);
+    settings.SetHttpDelegate(fileSettings.GetHttpDelegate());
+    settings.SetTaskDispatcherDelegate(fileSettings.GetTaskDispatcherDelegate());
+    settings.SetSessionId(fileSettings.GetSessionId());
+    settings.SetCanCacheLicenses(fileSettings.CanCacheLicenses());
+    settings.SetLoggerContext(fileSettings.GetLoggerContext());
+    mProtectionProfile = ProtectionProfile::Load(settings);
+    return mProtectionProfile;
+  }
+
+  std::shared_ptr<FileProfile> mFileProfile;
+  std::shared_ptr<ProtectionProfile::Observer> mProtectionObserver;
+  std::mutex mMutex;
+  std::shared_ptr<ProtectionProfile> mProtectionProfile;
+  std::map<std::string, std::weak_ptr<ProtectionEngine>> mEngines;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_ATTACHED_PROTECTION_ENGINE_H_
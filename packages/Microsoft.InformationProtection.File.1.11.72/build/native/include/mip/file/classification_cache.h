@@ -0,0 +1,244 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a cache of classification results keyed by content and policy
+ * 
+ * @file classification_cache.h
+ */
+
+#ifndef API_MIP_FILE_CLASSIFICATION_CACHE_H_
+#define API_MIP_FILE_CLASSIFICATION_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_handler_factory.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/upe/action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Caches the actions returned by FileHandler::ClassifyAsync, keyed by content hash and policy version.
+ * 
+ * @note The key combines the engine ID, FileEngine::GetPolicyFileId, FileEngine::GetSensitivityFileId and a hash of
+ *       the content, so a policy update never serves stale results even before it is reported. Forward
+ *       FileProfile::Observer::OnPolicyChanged to ClassificationCache::OnPolicyChanged to release the entries of the
+ *       old policy right away. Results are only valid for handlers created with the same FileExecutionState
+ *       settings; use one cache per configuration. Actions are SDK objects, so entries are kept in memory only.
+ */
+class ClassificationCache {
+public:
+  /**
+   * @brief ClassificationCache constructor
+   * 
+   * @param maxEntries Maximum number of results kept, least recently used results are evicted first
+   */
+  explicit ClassificationCache(size_t maxEntries = 1024) : mMaxEntries(maxEntries > 0 ? maxEntries : 1) {}
+
+  /**
+   * @brief Computes a content hash suitable for this cache
+   * 
+   * @param stream Content to hash. It is read from the start and then seeked back to where it was.
+   * 
+   * @return Hash of the content
+   * 
+   * @note This is a 64-bit FNV-1a hash combined with the content size. Callers that already have a cryptographic
+   *       hash of the content, for example from their mail or storage system, should pass that instead.
+   */
+  static std::string ComputeContentHash(const std::shared_ptr<Stream>& stream) {
+    if (!stream) {
+      throw BadInputError("ComputeContentHash requires a stream");
+    }
+    int64_t position = stream->Position();
+    stream->Seek(0);
+    uint64_t hash = 14695981039346656037ULL;
+    int64_t size = 0;
+    std::vector<uint8_t> buffer(64 * 1024);
+    int64_t bytesRead = 0;
+    while ((bytesRead = stream->Read(buffer.data(), static_cast<int64_t>(buffer.size()))) > 0) {
+      for (int64_t i = 0; i < bytesRead; ++i) {
+        hash ^= buffer[static_cast<size_t>(i)];
+        hash *= 1099511628211ULL;
+      }
+      size += bytesRead;
+    }
+    stream->Seek(position);
+    char text[48];
+    std::snprintf(text, sizeof(text), "fnv1a64:%016llx:%lld",
+        static_cast<unsigned long long>(hash), static_cast<long long>(size));
+    return text;
+  }
+
+  /**
+   * @brief Looks up the cached actions of a content
+   * 
+   * @param engine Engine the content was classified with
+   * @param contentHash Hash of the content
+   * @param actions [Output] Cached actions, set on a hit
+   * 
+   * @return true on a hit
+   */
+  bool Find(
+      const std::shared_ptr<FileEngine>& engine,
+      const std::string& contentHash,
+      std::vector<std::shared_ptr<Action>>& actions) {
+    std::string key = GetKey(engine, contentHash);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto cached = mIndex.find(key);
+    if (cached == mIndex.end()) {
+      return false;
+    }
+    mEntries.splice(mEntries.begin(), mEntries, cached->second);
+    actions = cached->second->actions;
+    return true;
+  }
+
+  /**
+   * @brief Stores the actions of a content
+   * 
+   * @param engine Engine the content was classified with
+   * @param contentHash Hash of the content
+   * @param actions Actions returned by FileHandler::ClassifyAsync
+   */
+  void Add(
+      const std::shared_ptr<FileEngine>& engine,
+      const std::string& contentHash,
+      const std::vector<std::shared_ptr<Action>>& actions) {
+    std::string key = GetKey(engine, contentHash);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto existing = mIndex.find(key);
+    if (existing != mIndex.end()) {
+      mEntries.erase(existing->second);
+      mIndex.erase(existing);
+    }
+    mEntries.push_front(Entry{key, engine->GetSettings().GetEngineId(), actions});
+    mIndex[key] = mEntries.begin();
+    while (mEntries.size() > mMaxEntries) {
+      mIndex.erase(mEntries.back().key);
+      mEntries.pop_back();
+    }
+  }
+
+  /**
+   * @brief Returns the cached actions of a content, classifying it on a miss
+   * 
+   * @param factory Factory that created @p handler
+   * @param engine Engine that created @p handler
+   * @param handler File handler of the content
+   * @param contentHash Hash of the content, for example from ComputeContentHash
+   * @param context Client context forwarded to FileHandler::ClassifyAsync
+   * 
+   * @return Actions computed by the policy
+   */
+  std::vector<std::shared_ptr<Action>> Classify(
+      FileHandlerFactory& factory,
+      const std::shared_ptr<FileEngine>& engine,
+      const std::shared_ptr<FileHandler>& handler,
+      const std::string& contentHash,
+      const std::shared_ptr<void>& context = nullptr) {
+    std::vector<std::shared_ptr<Action>> actions;
+    if (Find(engine, contentHash, actions)) {
+      return actions;
+    }
+    actions = factory.Classify(handler, context);
+    Add(engine, contentHash, actions);
+    return actions;
+  }
+
+  /**
+   * @brief Removes the results of an engine whose policy changed
+   * 
+   * @param engineId ID passed to FileProfile::Observer::OnPolicyChanged
+   */
+  void OnPolicyChanged(const std::string& engineId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto entry = mEntries.begin(); entry != mEntries.end();) {
+      if (entry->engineId == engineId) {
+        mIndex.erase(entry->key);
+        entry = mEntries.erase(entry);
+      } else {
+        ++entry;
+      }
+    }
+  }
+
+  /**
+   * @brief Remove all cached results
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mIndex.clear();
+  }
+
+  /**
+   * @brief Gets the number of cached results
+   * 
+   * @return Number of entries
+   */
+  size_t GetEntryCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::string key;
+    std::string engineId;
+    std::vector<std::shared_ptr<Action>> actions;
+  };
+
+  static std::string GetKey(const std::shared_ptr<FileEngine>& engine, const std::string& contentHash) {
+    if (!engine) {
+      throw BadInputError("ClassificationCache requires an engine");
+    }
+    return engine->GetSettings().GetEngineId() + "\n" + engine->GetPolicyFileId() + "\n" +
+        engine->GetSensitivityFileId() + "\n" + contentHash;
+  }
+
+  size_t mMaxEntries;
+  mutable std::mutex mMutex;
+  std::list<Entry> mEntries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_CLASSIFICATION_CACHE_H_
@@ -0,0 +1,357 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines CommitNotificationQueue, which moves commit notifications and their audit events off the caller's
+ *        thread
+ * 
+ * @file commit_notification_queue.h
+ */
+
+#ifndef API_MIP_FILE_COMMIT_NOTIFICATION_QUEUE_H_
+#define API_MIP_FILE_COMMIT_NOTIFICATION_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/policy_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A queued commit notification, as recorded in the journal
+ */
+struct CommitNotificationRecord {
+  std::string id;     /**< Unique ID of the notification */
+  std::string kind;   /**< "FileCommit", "PolicyCommit" or the kind given to CommitNotificationQueue::Enqueue */
+  std::string target; /**< Output file path, or the description given when the notification was queued */
+};
+
+/**
+ * @brief Settings of a CommitNotificationQueue
+ */
+struct CommitNotificationQueueSettings {
+  size_t maxQueued = 1024;             /**< Notifications queued before Enqueue blocks the caller */
+  size_t maxBatchSize = 64;            /**< Notifications delivered by the worker in one pass */
+  std::chrono::milliseconds batchDelay = std::chrono::milliseconds(50); /**< Wait for a batch to fill up */
+  std::shared_ptr<StorageDelegate> storageDelegate; /**< Journals queued notifications if set */
+  std::string storagePath;             /**< Path passed to StorageDelegate::CreateStorageTable */
+  /** Called on the worker thread when a notification throws */
+  std::function<void(const CommitNotificationRecord&, const std::exception_ptr&)> onError;
+};
+
+/**
+ * @brief Delivers FileHandler::NotifyCommitSuccessful and PolicyHandler::NotifyCommittedActions on a background
+ *        thread, so building and sending their audit events is no longer on the commit's critical path
+ * 
+ * @note Notifications are delivered in queue order by one worker thread, which waits up to batchDelay for up to
+ *       maxBatchSize of them and delivers each group in one pass, so the SDK's audit pipeline receives them in bursts.
+ *       When maxQueued notifications are waiting, Enqueue blocks until there is room or its timeout expires, which
+ *       bounds memory and slows producers down to the rate the audit pipeline can sustain.
+ *       
+ *       With a StorageDelegate, every notification is journaled in a storage table until it was delivered. A
+ *       notification cannot be replayed without its handler, so journal rows left by a process that stopped
+ *       abruptly are reported by GetRecoveredNotifications for the application to re-notify, e.g. by opening the
+ *       output file again, and are then removed with RemoveRecoveredNotification.
+ *       
+ *       The destructor delivers every queued notification before returning. Handlers and execution states are kept
+ *       alive until their notification was delivered.
+ */
+class CommitNotificationQueue {
+public:
+  /**
+   * @brief Start the worker thread and open the journal
+   * 
+   * @param settings Queue bound, batching and journal settings
+   */
+  explicit CommitNotificationQueue(const CommitNotificationQueueSettings& settings = CommitNotificationQueueSettings())
+      : mSettings(settings),
+        mIsStopping(false),
+        mInFlightCount(0) {
+    mSettings.maxQueued = (std::max)(mSettings.maxQueued, static_cast<size_t>(1));
+    mSettings.maxBatchSize = (std::max)(mSettings.maxBatchSize, static_cast<size_t>(1));
+    if (mSettings.storageDelegate) {
+      StorageTableResult table = mSettings.storageDelegate->CreateStorageTable(mSettings.storagePath,
+          MipComponent::File, "mip_commit_notifications", {"id", "kind", "target"}, {"target"}, {"id"});
+      if (table.GetError()) {
+        throw *table.GetError();
+      }
+      mJournal = table.GetData();
+      for (const auto& row : mJournal->List()) {
+        if (row.size() >= 3) {
+          mRecovered.push_back(CommitNotificationRecord{row[0], row[1], row[2]});
+        }
+      }
+    }
+    mWorker = std::thread([this]() { Run(); });
+  }
+
+  /**
+   * @brief Deliver every queued notification and stop the worker thread
+   */
+  ~CommitNotificationQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+    }
+    mQueueChanged.notify_all();
+    if (mWorker.joinable()) {
+      mWorker.join();
+    }
+  }
+
+  CommitNotificationQueue(const CommitNotificationQueue&) = delete;
+  CommitNotificationQueue& operator=(const CommitNotificationQueue&) = delete;
+
+  /**
+   * @brief Queue FileHandler::NotifyCommitSuccessful
+   * 
+   * @param handler Handler whose commit succeeded
+   * @param actualFilePath Output file path passed to NotifyCommitSuccessful
+   * @param timeout Longest time to wait for room in the queue
+   * 
+   * @return false if the queue stayed full for the whole timeout; the notification was not queued
+   */
+  bool EnqueueCommitSuccessful(
+      const std::shared_ptr<FileHandler>& handler,
+      const std::string& actualFilePath,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) {
+    if (!handler) {
+      throw BadInputError("EnqueueCommitSuccessful requires a FileHandler");
+    }
+    return Enqueue("FileCommit", actualFilePath, [handler, actualFilePath]() {
+      handler->NotifyCommitSuccessful(actualFilePath);
+    }, timeout);
+  }
+
+  /**
+   * @brief Queue PolicyHandler::NotifyCommittedActions
+   * 
+   * @param handler Handler that computed the committed actions
+   * @param state Execution state of the content after the actions were committed
+   * @param description Text identifying the content in the journal, e.g. its path
+   * @param timeout Longest time to wait for room in the queue
+   * 
+   * @return false if the queue stayed full for the whole timeout; the notification was not queued
+   */
+  bool EnqueueCommittedActions(
+      const std::shared_ptr<PolicyHandler>& handler,
+      const std::shared_ptr<const ExecutionState>& state,
+      const std::string& description,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) {
+    if (!handler || !state) {
+      throw BadInputError("EnqueueCommittedActions requires a PolicyHandler and an ExecutionState");
+    }
+    return Enqueue("PolicyCommit", description, [handler, state]() { handler->NotifyCommittedActions(*state); },
+        timeout);
+  }
+
+  /**
+   * @brief Queue any notification
+   * 
+   * @param kind Kind recorded in the journal
+   * @param target Description recorded in the journal
+   * @param notify Delivers the notification on the worker thread
+   * @param timeout Longest time to wait for room in the queue
+   * 
+   * @return false if the queue stayed full for the whole timeout; the notification was not queued
+   */
+  bool Enqueue(
+      const std::string& kind,
+      const std::string& target,
+      std::function<void()> notify,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) {
+    Entry entry{CommitNotificationRecord{CreateId(), kind, target}, std::move(notify)};
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      if (mIsStopping) {
+        throw BadInputError("CommitNotificationQueue is stopping");
+      }
+      auto hasRoom = [this]() { return mQueue.size() < mSettings.maxQueued || mIsStopping; };
+      if (timeout == std::chrono::milliseconds::max()) {
+        mQueueChanged.wait(lock, hasRoom);
+      } else if (!mQueueChanged.wait_for(lock, timeout, hasRoom)) {
+        return false;
+      }
+      if (mIsStopping) {
+        throw BadInputError("CommitNotificationQueue is stopping");
+      }
+      // Journaling under the lock keeps journal order equal to delivery order
+      if (mJournal) {
+        mJournal->Insert({entry.record.id, entry.record.kind, entry.record.target});
+      }
+      mQueue.push_back(std::move(entry));
+    }
+    mQueueChanged.notify_all();
+    return true;
+  }
+
+  /**
+   * @brief Wait until every notification queued so far was delivered
+   */
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueueChanged.wait(lock, [this]() { return mQueue.empty() && mInFlightCount == 0; });
+  }
+
+  /**
+   * @brief Get the number of notifications waiting or being delivered
+   * 
+   * @return Pending notification count
+   */
+  size_t GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size() + mInFlightCount;
+  }
+
+  /**
+   * @brief Get the notifications a previous process journaled but did not deliver
+   * 
+   * @return Recovered notifications, read from the journal when the queue was created
+   */
+  std::vector<CommitNotificationRecord> GetRecoveredNotifications() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRecovered;
+  }
+
+  /**
+   * @brief Remove a recovered notification from the journal once the application dealt with it
+   * 
+   * @param id ID of the recovered notification
+   */
+  void RemoveRecoveredNotification(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto record = mRecovered.begin(); record != mRecovered.end(); ++record) {
+      if (record->id == id) {
+        mRecovered.erase(record);
+        if (mJournal) {
+          mJournal->Delete({"id"}, {id});
+        }
+        return;
+      }
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    CommitNotificationRecord record;
+    std::function<void()> notify;
+  };
+
+  static std::string CreateId() {
+    static std::atomic<uint64_t> sCounter(0);
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(now).count()) + "-" +
+        std::to_string(++sCounter);
+  }
+
+  void Run() {
+    std::vector<Entry> batch;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQueueChanged.wait(lock, [this]() { return !mQueue.empty() || mIsStopping; });
+        if (mQueue.empty()) {
+          return;
+        }
+        if (mQueue.size() < mSettings.maxBatchSize && !mIsStopping) {
+          mQueueChanged.wait_for(lock, mSettings.batchDelay,
+              [this]() { return mQueue.size() >= mSettings.maxBatchSize || mIsStopping; });
+        }
+        size_t count = (std::min)(mQueue.size(), mSettings.maxBatchSize);
+        for (size_t i = 0; i < count; ++i) {
+          batch.push_back(std::move(mQueue.front()));
+          mQueue.pop_front();
+        }
+        mInFlightCount = batch.size();
+      }
+      // Producers blocked on a full queue can continue while the batch is delivered
+      mQueueChanged.notify_all();
+      for (auto& entry : batch) {
+        try {
+          entry.notify();
+        } catch (...) {
+          ReportError(entry.record, std::current_exception());
+        }
+        if (mJournal) {
+          try {
+            mJournal->Delete({"id"}, {entry.record.id});
+          } catch (...) {
+            ReportError(entry.record, std::current_exception());
+          }
+        }
+      }
+      batch.clear();
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mInFlightCount = 0;
+      }
+      mQueueChanged.notify_all();
+    }
+  }
+
+  void ReportError(const CommitNotificationRecord& record, const std::exception_ptr& error) {
+    if (mSettings.onError) {
+      try {
+        mSettings.onError(record, error);
+      } catch (...) {
+      }
+    }
+  }
+
+  CommitNotificationQueueSettings mSettings;
+  std::shared_ptr<StorageTable> mJournal;
+  std::vector<CommitNotificationRecord> mRecovered;
+  mutable std::mutex mMutex;
+  std::condition_variable mQueueChanged;
+  std::deque<Entry> mQueue;
+  bool mIsStopping;
+  size_t mInFlightCount;
+  std::thread mWorker;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_COMMIT_NOTIFICATION_QUEUE_H_
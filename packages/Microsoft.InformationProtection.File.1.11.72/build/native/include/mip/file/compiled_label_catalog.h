@@ -0,0 +1,340 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a compact binary form of an engine's label tree, cached per policy file ID
+ * 
+ * @file compiled_label_catalog.h
+ */
+
+#ifndef API_MIP_FILE_COMPILED_LABEL_CATALOG_H_
+#define API_MIP_FILE_COMPILED_LABEL_CATALOG_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/file/label_index.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/label.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace labelcatalog {
+
+constexpr const char kMagic[8] = {'M', 'I', 'P', 'L', 'B', 'L', 'C', '1'};
+
+// Label rebuilt from a catalog. Strings point into the catalog's interned string table.
+class CompiledLabel : public Label {
+public:
+  const std::string& GetId() const override { return *id; }
+  const std::string& GetName() const override { return *name; }
+  const std::string& GetDescription() const override { return *description; }
+  const std::string& GetColor() const override { return *color; }
+  int GetSensitivity() const override { return sensitivity; }
+  const std::string& GetTooltip() const override { return *tooltip; }
+  const std::string& GetAutoTooltip() const override { return *autoTooltip; }
+  bool IsActive() const override { return isActive; }
+  std::weak_ptr<Label> GetParent() const override { return parent; }
+  const std::vector<std::shared_ptr<Label>>& GetChildren() const override { return children; }
+  const std::vector<std::pair<std::string, std::string>>& GetCustomSettings() const override { return customSettings; }
+  ActionSource GetActionSource() const override { return actionSource; }
+  const std::vector<std::string>& GetContentFormats() const override { return contentFormats; }
+
+  std::shared_ptr<const std::vector<std::string>> strings;
+  const std::string* id = nullptr;
+  const std::string* name = nullptr;
+  const std::string* description = nullptr;
+  const std::string* color = nullptr;
+  const std::string* tooltip = nullptr;
+  const std::string* autoTooltip = nullptr;
+  int sensitivity = 0;
+  bool isActive = false;
+  ActionSource actionSource = ActionSource::MANUAL;
+  std::weak_ptr<Label> parent;
+  std::vector<std::shared_ptr<Label>> children;
+  std::vector<std::pair<std::string, std::string>> customSettings;
+  std::vector<std::string> contentFormats;
+};
+
+// Little-endian encoder with an interned string table
+class Writer {
+public:
+  uint32_t Intern(const std::string& value) {
+    auto entry = mStringIds.emplace(value, static_cast<uint32_t>(mStrings.size()));
+    if (entry.second) {
+      mStrings.push_back(&entry.first->first);
+    }
+    return entry.first->second;
+  }
+
+  void PutU32(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      mRecords.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void PutString(const std::string& value) { PutU32(Intern(value)); }
+
+  std::vector<uint8_t> Finish() const {
+    std::vector<uint8_t> output(kMagic, kMagic + sizeof(kMagic));
+    auto put = [&output](uint32_t value) {
+      for (int i = 0; i < 4; ++i) {
+        output.push_back(static_cast<uint8_t>(value >> (8 * i)));
+      }
+    };
+    put(static_cast<uint32_t>(mStrings.size()));
+    for (const std::string* value : mStrings) {
+      put(static_cast<uint32_t>(value->size()));
+      output.insert(output.end(), value->begin(), value->end());
+    }
+    output.insert(output.end(), mRecords.begin(), mRecords.end());
+    return output;
+  }
+
+private:
+  std::unordered_map<std::string, uint32_t> mStringIds;
+  std::vector<const std::string*> mStrings;
+  std::vector<uint8_t> mRecords;
+};
+
+class Reader {
+public:
+  Reader(const std::vector<uint8_t>& data, size_t position) : mData(data), mPosition(position) {}
+
+  uint32_t GetU32() {
+    if (mData.size() - mPosition < 4) {
+      throw BadInputError("Truncated compiled label catalog");
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      value |= static_cast<uint32_t>(mData[mPosition++]) << (8 * i);
+    }
+    return value;
+  }
+
+  std::string GetBytes(uint32_t size) {
+    if (mData.size() - mPosition < size) {
+      throw BadInputError("Truncated compiled label catalog");
+    }
+    std::string value(reinterpret_cast<const char*>(mData.data()) + mPosition, size);
+    mPosition += size;
+    return value;
+  }
+
+  bool IsAtEnd() const { return mPosition == mData.size(); }
+
+private:
+  const std::vector<uint8_t>& mData;
+  size_t mPosition;
+};
+
+inline std::string GetCatalogPath(const std::string& catalogDirectory, const std::string& policyFileId) {
+  std::string fileName;
+  for (char c : policyFileId) {
+    bool isSafe = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_';
+    fileName += isSafe ? c : '_';
+  }
+  return catalogDirectory + "/" + fileName + ".labels.bin";
+}
+
+} // namespace labelcatalog
+/** @endcond */
+
+/**
+ * @brief Serialize a label snapshot into the compiled catalog format
+ * 
+ * @param index Label snapshot
+ * 
+ * @return Catalog bytes: a header, an interned string table and one fixed-layout record per label in GetAllLabels
+ *         order, each referring to its parent by record index
+ */
+inline std::vector<uint8_t> CompileLabelCatalog(const LabelIndex& index) {
+  labelcatalog::Writer writer;
+  const auto& labels = index.GetAllLabels();
+  std::unordered_map<const Label*, uint32_t> recordIndexes;
+  writer.PutString(index.GetPolicyFileId());
+  writer.PutU32(static_cast<uint32_t>(labels.size()));
+  for (const auto& label : labels) {
+    recordIndexes.emplace(label.get(), static_cast<uint32_t>(recordIndexes.size()));
+    auto parent = label->GetParent().lock();
+    auto parentIndex = parent ? recordIndexes.find(parent.get()) : recordIndexes.end();
+    writer.PutU32(parentIndex == recordIndexes.end() ? UINT32_MAX : parentIndex->second);
+    writer.PutString(label->GetId());
+    writer.PutString(label->GetName());
+    writer.PutString(label->GetDescription());
+    writer.PutString(label->GetColor());
+    writer.PutString(label->GetTooltip());
+    writer.PutString(label->GetAutoTooltip());
+    writer.PutU32(static_cast<uint32_t>(label->GetSensitivity()));
+    writer.PutU32((label->IsActive() ? 1u : 0u) | (static_cast<uint32_t>(label->GetActionSource()) << 1));
+    writer.PutU32(static_cast<uint32_t>(label->GetContentFormats().size()));
+    for (const auto& format : label->GetContentFormats()) {
+      writer.PutString(format);
+    }
+    writer.PutU32(static_cast<uint32_t>(label->GetCustomSettings().size()));
+    for (const auto& setting : label->GetCustomSettings()) {
+      writer.PutString(setting.first);
+      writer.PutString(setting.second);
+    }
+  }
+  return writer.Finish();
+}
+
+/**
+ * @brief Rebuild a label snapshot from compiled catalog bytes
+ * 
+ * @param catalog Catalog bytes produced by CompileLabelCatalog
+ * 
+ * @return Label snapshot. Labels that had no parent in the catalog, including sublabels whose parent was not listed,
+ *         become top-level labels. Throws BadInputError if the catalog is malformed.
+ */
+inline std::shared_ptr<const LabelIndex> LoadLabelCatalog(const std::vector<uint8_t>& catalog) {
+  if (catalog.size() < sizeof(labelcatalog::kMagic) ||
+      !std::equal(labelcatalog::kMagic, labelcatalog::kMagic + sizeof(labelcatalog::kMagic), catalog.begin())) {
+    throw BadInputError("Not a compiled label catalog");
+  }
+  labelcatalog::Reader reader(catalog, sizeof(labelcatalog::kMagic));
+  auto strings = std::make_shared<std::vector<std::string>>(reader.GetU32());
+  for (auto& value : *strings) {
+    value = reader.GetBytes(reader.GetU32());
+  }
+  auto getString = [&reader, &strings]() -> const std::string& {
+    uint32_t id = reader.GetU32();
+    if (id >= strings->size()) {
+      throw BadInputError("Invalid string in compiled label catalog");
+    }
+    return (*strings)[id];
+  };
+
+  const std::string& policyFileId = getString();
+  uint32_t count = reader.GetU32();
+  std::vector<std::shared_ptr<labelcatalog::CompiledLabel>> records;
+  std::vector<std::shared_ptr<Label>> topLevelLabels;
+  for (uint32_t i = 0; i < count; ++i) {
+    auto label = std::make_shared<labelcatalog::CompiledLabel>();
+    label->strings = strings;
+    uint32_t parentIndex = reader.GetU32();
+    label->id = &getString();
+    label->name = &getString();
+    label->description = &getString();
+    label->color = &getString();
+    label->tooltip = &getString();
+    label->autoTooltip = &getString();
+    label->sensitivity = static_cast<int>(reader.GetU32());
+    uint32_t flags = reader.GetU32();
+    label->isActive = (flags & 1u) != 0;
+    label->actionSource = static_cast<ActionSource>(flags >> 1);
+    for (uint32_t formatCount = reader.GetU32(); formatCount > 0; --formatCount) {
+      label->contentFormats.push_back(getString());
+    }
+    for (uint32_t settingCount = reader.GetU32(); settingCount > 0; --settingCount) {
+      const std::string& key = getString();
+      label->customSettings.emplace_back(key, getString());
+    }
+    if (parentIndex < records.size()) {
+      label->parent = records[parentIndex];
+      records[parentIndex]->children.push_back(label);
+    } else {
+      topLevelLabels.push_back(label);
+    }
+    records.push_back(std::move(label));
+  }
+  if (!reader.IsAtEnd()) {
+    throw BadInputError("Trailing data in compiled label catalog");
+  }
+  return LabelIndex::Create(policyFileId, topLevelLabels);
+}
+
+/**
+ * @brief Write the compiled catalog of a label snapshot to a directory, keyed by its policy file ID
+ * 
+ * @param index Label snapshot, e.g. from LabelIndex::Create(engine)
+ * @param catalogDirectory Existing directory holding catalogs
+ * 
+ * @return true if the catalog was written
+ * 
+ * @note Write the catalog once per policy file ID, after the engine first loads a policy. The file is replaced
+ *       atomically, so concurrent readers never see a partial catalog.
+ */
+inline bool WriteCompiledLabelCatalog(const LabelIndex& index, const std::string& catalogDirectory) {
+  std::vector<uint8_t> catalog = CompileLabelCatalog(index);
+  std::string path = labelcatalog::GetCatalogPath(catalogDirectory, index.GetPolicyFileId());
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+    file.write(reinterpret_cast<const char*>(catalog.data()), static_cast<std::streamsize>(catalog.size()));
+    if (!file) {
+      return false;
+    }
+  }
+  std::remove(path.c_str());
+  return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Load the compiled catalog for a policy file ID
+ * 
+ * @param catalogDirectory Directory holding catalogs
+ * @param policyFileId Policy file ID, e.g. from a previous FileEngine::GetPolicyFileId or an engine snapshot manifest
+ * 
+ * @return Label snapshot, or nullptr if there is no valid catalog for the policy
+ * 
+ * @note Loading reads one file and rebuilds the label tree without parsing policy XML, so a process can resolve
+ *       labels, such as for a UI listing, before or without loading a FileEngine. Use the engine for anything that
+ *       evaluates policy.
+ */
+inline std::shared_ptr<const LabelIndex> LoadCompiledLabelCatalog(
+    const std::string& catalogDirectory,
+    const std::string& policyFileId) {
+  std::ifstream file(labelcatalog::GetCatalogPath(catalogDirectory, policyFileId), std::ios::binary);
+  if (!file) {
+    return nullptr;
+  }
+  std::vector<uint8_t> catalog((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  try {
+    auto index = LoadLabelCatalog(catalog);
+    return index->GetPolicyFileId() == policyFileId ? index : nullptr;
+  } catch (const BadInputError&) {
+    return nullptr;
+  }
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_COMPILED_LABEL_CATALOG_H_
@@ -0,0 +1,247 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines parallel decryption of the protected children of a container, such as .msg attachments
+ * 
+ * @file container_decryption.h
+ */
+
+#ifndef API_MIP_FILE_CONTAINER_DECRYPTION_H_
+#define API_MIP_FILE_CONTAINER_DECRYPTION_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler_factory.h"
+#include "mip/file/msg_inspector.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/numa_task_dispatcher.h"
+#include "mip/numa_topology.h"
+#include "mip/stream.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief One child object of a container
+ */
+struct ContainerChild {
+  std::shared_ptr<Stream> stream; /**< Content of the child */
+  std::string name;               /**< File name of the child, including its extension */
+};
+
+/**
+ * @brief Limits for DecryptContainerChildren
+ */
+struct ContainerDecryptionOptions {
+  size_t maxParallel = 4;                      /**< Children decrypted concurrently */
+  int64_t maxBytesInFlight = 64 * 1024 * 1024; /**< Total input size of the children being decrypted at once */
+  bool isAuditDiscoveryEnabled = true;         /**< Passed to FileEngine::CreateFileHandlerAsync */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher; /**< Runs the workers, new std::threads if not set */
+  AffinityHint affinity; /**< Node the workers run on with a NumaTaskDispatcher, the calling thread's if not set */
+  std::shared_ptr<MemoryBudget> memoryBudget; /**< Reserves each child's size as MemoryCategory::TemporaryStreams */
+};
+
+/**
+ * @brief Result of one child decrypted by DecryptContainerChildren
+ */
+struct ContainerChildDecryptionResult {
+  std::shared_ptr<Stream> stream; /**< Decrypted content, or the original content if the child is not protected */
+  bool isProtected = false;       /**< If the child was protected */
+  std::exception_ptr error;       /**< Failure, nullptr on success. The child was left encrypted. */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace containerdecryption {
+
+struct State {
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::vector<ContainerChild> children;
+  std::vector<int64_t> sizes;
+  std::vector<ContainerChildDecryptionResult> results;
+  std::shared_ptr<FileHandlerFactory> factory;
+  std::shared_ptr<MemoryBudget> memoryBudget;
+  int64_t maxBytesInFlight = 0;
+  int64_t bytesInFlight = 0;
+  size_t next = 0;
+  size_t completed = 0;
+};
+
+inline void DecryptChild(FileHandlerFactory& factory, const ContainerChild& child,
+    ContainerChildDecryptionResult& result) {
+  try {
+    auto handler = factory.Create(child.stream, child.name);
+    if (!handler->GetProtection()) {
+      result.stream = child.stream;
+      return;
+    }
+    result.isProtected = true;
+    result.stream = factory.GetDecryptedTemporaryStream(handler);
+  } catch (...) {
+    result.stream = child.stream;
+    result.error = std::current_exception();
+  }
+}
+
+inline void RunWorker(const std::shared_ptr<State>& state) {
+  for (;;) {
+    size_t index = 0;
+    int64_t size = 0;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      // A child larger than the budget still runs, alone
+      state->condition.wait(lock, [&state] {
+        return state->next >= state->children.size() || state->bytesInFlight == 0 ||
+            state->bytesInFlight + state->sizes[state->next] <= state->maxBytesInFlight;
+      });
+      if (state->next >= state->children.size()) {
+        return;
+      }
+      index = state->next++;
+      size = state->sizes[index];
+      state->bytesInFlight += size;
+    }
+    {
+      // Waits, outside the lock, while other operations hold the temporary stream budget
+      MemoryReservation reservation = state->memoryBudget ?
+          state->memoryBudget->Reserve(MemoryCategory::TemporaryStreams, size) : MemoryReservation();
+      DecryptChild(*state->factory, state->children[index], state->results[index]);
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->bytesInFlight -= size;
+    ++state->completed;
+    state->condition.notify_all();
+  }
+}
+
+} // namespace containerdecryption
+/** @endcond */
+
+/**
+ * @brief Decrypts the children of a container concurrently
+ * 
+ * @param engine File engine
+ * @param children Child objects, for example the attachments of a message
+ * @param options Concurrency and memory limits
+ * 
+ * @return One result per child, in the same order
+ * 
+ * @note Each child goes through FileEngine::CreateFileHandlerAsync and, if protected,
+ *       FileHandler::GetDecryptedTemporaryStreamAsync. Up to ContainerDecryptionOptions::maxParallel children are in
+ *       progress at once, so their use license requests overlap instead of adding up. A child only starts when the
+ *       input sizes of the children in progress, its own included, fit in ContainerDecryptionOptions::maxBytesInFlight.
+ *       The calling thread works on children too and returns once all of them are done.
+ */
+inline std::vector<ContainerChildDecryptionResult> DecryptContainerChildren(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::vector<ContainerChild>& children,
+    const ContainerDecryptionOptions& options = ContainerDecryptionOptions()) {
+  if (!engine) {
+    throw BadInputError("DecryptContainerChildren requires an engine");
+  }
+  auto state = std::make_shared<containerdecryption::State>();
+  state->children = children;
+  state->results.resize(children.size());
+  state->factory = std::make_shared<FileHandlerFactory>(engine, options.isAuditDiscoveryEnabled);
+  state->memoryBudget = options.memoryBudget;
+  state->maxBytesInFlight = (std::max)(options.maxBytesInFlight, static_cast<int64_t>(1));
+  for (const auto& child : children) {
+    if (!child.stream) {
+      throw BadInputError("Container child has no stream");
+    }
+    state->sizes.push_back((std::max)(child.stream->Size(), static_cast<int64_t>(0)));
+  }
+  size_t workerCount = (std::min)((std::max)(options.maxParallel, static_cast<size_t>(1)), children.size());
+  if (workerCount == 0) {
+    return std::move(state->results);
+  }
+  std::vector<std::thread> threads;
+  static std::atomic<uint64_t> sTaskCounter(0);
+  auto numaDispatcher = std::dynamic_pointer_cast<NumaTaskDispatcher>(options.taskDispatcher);
+  // The children are read and decrypted into temporary streams by the calling thread's node unless told otherwise
+  AffinityHint affinity = options.affinity.IsSet() || !numaDispatcher ? options.affinity :
+                                                                         AffinityHint::ForCurrentThread();
+  for (size_t i = 1; i < workerCount; ++i) {
+    auto task = [state]() { containerdecryption::RunWorker(state); };
+    std::string taskId = "mip-container-decrypt-" + std::to_string(++sTaskCounter);
+    if (numaDispatcher) {
+      numaDispatcher->DispatchTask(taskId, task, affinity);
+    } else if (options.taskDispatcher) {
+      options.taskDispatcher->DispatchTask(taskId, task);
+    } else {
+      threads.emplace_back(task);
+    }
+  }
+  containerdecryption::RunWorker(state);
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    // Dispatched workers that start after the last child was taken return at once
+    state->condition.wait(lock, [&state] { return state->completed == state->children.size(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return std::move(state->results);
+}
+
+/**
+ * @brief Decrypts the attachments of a message concurrently
+ * 
+ * @param engine File engine
+ * @param attachments Attachments, for example from GetMsgAttachments or MsgInspector::GetAttachments
+ * @param options Concurrency and memory limits
+ * 
+ * @return One result per attachment, in the same order
+ */
+inline std::vector<ContainerChildDecryptionResult> DecryptContainerChildren(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::vector<std::shared_ptr<MsgAttachmentData>>& attachments,
+    const ContainerDecryptionOptions& options = ContainerDecryptionOptions()) {
+  std::vector<ContainerChild> children;
+  children.reserve(attachments.size());
+  for (const auto& attachment : attachments) {
+    const std::string& name = attachment->GetLongName().empty() ? attachment->GetName() : attachment->GetLongName();
+    children.push_back(ContainerChild{attachment->GetStream(), name});
+  }
+  return DecryptContainerChildren(engine, children, options);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_CONTAINER_DECRYPTION_H_
@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines parallel protection of the children of a container, such as the attachments of an outgoing .msg
+ * 
+ * @file container_protection.h
+ */
+
+#ifndef API_MIP_FILE_CONTAINER_PROTECTION_H_
+#define API_MIP_FILE_CONTAINER_PROTECTION_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/container_decryption.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler_factory.h"
+#include "mip/file/msg_inspector.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/spill_stream.h"
+#include "mip/stream.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Limits for ProtectContainerChildren
+ */
+struct ContainerProtectionOptions {
+  size_t maxParallel = 4;                      /**< Children protected concurrently */
+  int64_t maxBytesInFlight = 64 * 1024 * 1024; /**< Total input size of the children being protected at once */
+  bool isAuditDiscoveryEnabled = false;        /**< Passed to FileEngine::CreateFileHandlerAsync */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher; /**< Runs the workers, new std::threads if not set */
+  SpillStreamSettings output; /**< Where the protected children are written: memory, then a temporary file */
+};
+
+/**
+ * @brief Result of one child protected by ProtectContainerChildren
+ */
+struct ContainerChildProtectionResult {
+  std::shared_ptr<Stream> stream; /**< Protected content positioned at its start, or the original content on failure */
+  bool isProtected = false;       /**< If the child was protected */
+  std::exception_ptr error;       /**< Failure, nullptr on success */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace containerprotection {
+
+struct State {
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::vector<ContainerChild> children;
+  std::vector<int64_t> sizes;
+  std::vector<ContainerChildProtectionResult> results;
+  std::shared_ptr<FileHandlerFactory> factory;
+  std::shared_ptr<ProtectionHandler> protectionHandler;
+  SpillStreamSettings output;
+  int64_t maxBytesInFlight = 0;
+  int64_t bytesInFlight = 0;
+  size_t next = 0;
+  size_t completed = 0;
+};
+
+inline void ProtectChild(State& state, const ContainerChild& child, ContainerChildProtectionResult& result) {
+  try {
+    auto handler = state.factory->Create(child.stream, child.name);
+    handler->SetProtection(state.protectionHandler);
+    auto output = CreateSpillStream(state.output);
+    result.isProtected = state.factory->Commit(handler, output);
+    output->Seek(0);
+    result.stream = output;
+  } catch (...) {
+    result.stream = child.stream;
+    result.isProtected = false;
+    result.error = std::current_exception();
+  }
+}
+
+inline void RunWorker(const std::shared_ptr<State>& state) {
+  for (;;) {
+    size_t index = 0;
+    int64_t size = 0;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      // A child larger than the budget still runs, alone
+      state->condition.wait(lock, [&state] {
+        return state->next >= state->children.size() || state->bytesInFlight == 0 ||
+            state->bytesInFlight + state->sizes[state->next] <= state->maxBytesInFlight;
+      });
+      if (state->next >= state->children.size()) {
+        return;
+      }
+      index = state->next++;
+      size = state->sizes[index];
+      state->bytesInFlight += size;
+    }
+    ProtectChild(*state, state->children[index], state->results[index]);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->bytesInFlight -= size;
+    ++state->completed;
+    state->condition.notify_all();
+  }
+}
+
+} // namespace containerprotection
+/** @endcond */
+
+/**
+ * @brief Protects the children of a container concurrently, all with the same content key and publishing license
+ * 
+ * @param engine File engine
+ * @param protectionHandler Publishing handler shared by every child, e.g. from
+ *        ProtectionEngine::CreateProtectionHandlerForPublishing
+ * @param children Child objects, for example the attachments of a message being composed
+ * @param options Concurrency, memory and output limits
+ * 
+ * @return One result per child, in the same order
+ * 
+ * @note Each child goes through FileEngine::CreateFileHandlerAsync, FileHandler::SetProtection with
+ *       @p protectionHandler and FileHandler::CommitAsync into a SpillStream, so the children share one license and
+ *       their encryption overlaps: the children of a large message are protected in about the time of the largest
+ *       one. The calling thread works on children too and returns once all of them are done. Assembling the
+ *       message from the protected children is left to the application's writer, since the SDK rewrites the
+ *       attachment storages of a .msg one after another inside FileHandler::CommitAsync.
+ */
+inline std::vector<ContainerChildProtectionResult> ProtectContainerChildren(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& protectionHandler,
+    const std::vector<ContainerChild>& children,
+    const ContainerProtectionOptions& options = ContainerProtectionOptions()) {
+  if (!engine) {
+    throw BadInputError("ProtectContainerChildren requires an engine");
+  }
+  if (!protectionHandler) {
+    throw BadInputError("ProtectContainerChildren requires a protection handler");
+  }
+  auto state = std::make_shared<containerprotection::State>();
+  state->children = children;
+  state->results.resize(children.size());
+  state->factory = std::make_shared<FileHandlerFactory>(engine, options.isAuditDiscoveryEnabled);
+  state->protectionHandler = protectionHandler;
+  state->output = options.output;
+  state->maxBytesInFlight = (std::max)(options.maxBytesInFlight, static_cast<int64_t>(1));
+  for (const auto& child : children) {
+    if (!child.stream) {
+      throw BadInputError("Container child has no stream");
+    }
+    state->sizes.push_back((std::max)(child.stream->Size(), static_cast<int64_t>(0)));
+  }
+  size_t workerCount = (std::min)((std::max)(options.maxParallel, static_cast<size_t>(1)), children.size());
+  if (workerCount == 0) {
+    return std::move(state->results);
+  }
+  std::vector<std::thread> threads;
+  static std::atomic<uint64_t> sTaskCounter(0);
+  for (size_t i = 1; i < workerCount; ++i) {
+    auto task = [state]() { containerprotection::RunWorker(state); };
+    if (options.taskDispatcher) {
+      options.taskDispatcher->DispatchTask("mip-container-protect-" + std::to_string(++sTaskCounter), task);
+    } else {
+      threads.emplace_back(task);
+    }
+  }
+  containerprotection::RunWorker(state);
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    // Dispatched workers that start after the last child was taken return at once
+    state->condition.wait(lock, [&state] { return state->completed == state->children.size(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return std::move(state->results);
+}
+
+/**
+ * @brief Protects the attachments of a message concurrently with one content key and publishing license
+ * 
+ * @param engine File engine
+ * @param protectionHandler Publishing handler shared by every attachment
+ * @param attachments Attachments, for example from GetMsgAttachments or MsgInspector::GetAttachments
+ * @param options Concurrency, memory and output limits
+ * 
+ * @return One result per attachment, in the same order
+ */
+inline std::vector<ContainerChildProtectionResult> ProtectContainerChildren(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& protectionHandler,
+    const std::vector<std::shared_ptr<MsgAttachmentData>>& attachments,
+    const ContainerProtectionOptions& options = ContainerProtectionOptions()) {
+  std::vector<ContainerChild> children;
+  children.reserve(attachments.size());
+  for (const auto& attachment : attachments) {
+    const std::string& name = attachment->GetLongName().empty() ? attachment->GetName() : attachment->GetLongName();
+    children.push_back(ContainerChild{attachment->GetStream(), name});
+  }
+  return ProtectContainerChildren(engine, protectionHandler, children, options);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_CONTAINER_PROTECTION_H_
@@ -0,0 +1,417 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines DirectoryPipeline, a staged, multi-threaded pipeline for labeling and protecting many files in place
+ * 
+ * @file directory_pipeline.h
+ */
+
+#ifndef API_MIP_FILE_DIRECTORY_PIPELINE_H_
+#define API_MIP_FILE_DIRECTORY_PIPELINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_status.h"
+#include "mip/file/file_sync.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Stages of a DirectoryPipeline, in order
+ */
+enum class DirectoryPipelineStage : unsigned int {
+  Enumerate = 0, /**< Listing the files */
+  Status = 1,    /**< FileHandler::GetFileStatus */
+  Decide = 2,    /**< Opening the file and applying the decision, e.g. SetLabel or SetProtection */
+  Commit = 3,    /**< FileHandler::CommitAsync to a temporary file next to the input */
+  Replace = 4,   /**< Replacing the input with the temporary file, then FileHandler::NotifyCommitSuccessful */
+};
+
+/**
+ * @brief A file moving through a DirectoryPipeline
+ */
+struct DirectoryPipelineFile {
+  std::string path;                   /**< File path */
+  std::shared_ptr<FileStatus> status; /**< Status, set from the Status stage on */
+};
+
+/**
+ * @brief Outcome of one file of a DirectoryPipeline
+ */
+struct DirectoryPipelineResult {
+  std::string path;                                          /**< File path */
+  DirectoryPipelineStage stage = DirectoryPipelineStage::Status; /**< Last stage the file reached */
+  bool isCommitted = false; /**< If the file was replaced with modified content */
+  std::exception_ptr error; /**< Failure of that stage, nullptr otherwise */
+};
+
+/**
+ * @brief Counts of a DirectoryPipeline run
+ */
+struct DirectoryPipelineStatistics {
+  size_t enumerated = 0; /**< Files listed */
+  size_t skipped = 0;    /**< Files the filter or decision left alone */
+  size_t committed = 0;  /**< Files replaced with modified content */
+  size_t failed = 0;     /**< Files that failed in any stage */
+};
+
+/**
+ * @brief Settings of a DirectoryPipeline
+ * 
+ * @note Each stage has its own workers and a bounded queue in front of it, so the slowest stage sets the pace and
+ *       memory stays bounded. Status is file I/O, Decide waits on policy and licensing, and Commit is encryption and
+ *       output I/O; give the stages that wait on the network more workers than the others.
+ */
+struct DirectoryPipelineSettings {
+  size_t statusWorkers = 4;  /**< Threads checking file status */
+  size_t decideWorkers = 8;  /**< Threads opening files and applying decisions */
+  size_t commitWorkers = 4;  /**< Threads committing files */
+  size_t replaceWorkers = 1; /**< Threads replacing files and notifying commits */
+  size_t queueCapacity = 64; /**< Files waiting in front of each stage before the previous stage blocks */
+  std::string temporarySuffix = ".mip.tmp"; /**< Appended to a file's path for its temporary output */
+  bool isAuditDiscoveryEnabled = true;      /**< Passed to FileEngine::CreateFileHandlerAsync */
+  /** Decides from the status alone whether a file is opened, e.g. to skip labeled files; nullptr opens every file */
+  std::function<bool(const DirectoryPipelineFile& file)> filter;
+  /** Called once per file, serialized, from the pipeline's threads */
+  std::function<void(const DirectoryPipelineResult& result)> onResult;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace directorypipeline {
+
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : mCapacity((std::max)(capacity, static_cast<size_t>(1))) {}
+
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mNotFull.wait(lock, [this]() { return mItems.size() < mCapacity; });
+    mItems.push_back(std::move(item));
+    mNotEmpty.notify_one();
+  }
+
+  // Returns false once the queue is closed and drained
+  bool Pop(T& item) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mNotEmpty.wait(lock, [this]() { return !mItems.empty() || mIsClosed; });
+    if (mItems.empty()) {
+      return false;
+    }
+    item = std::move(mItems.front());
+    mItems.pop_front();
+    mNotFull.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsClosed = true;
+    mNotEmpty.notify_all();
+  }
+
+private:
+  size_t mCapacity;
+  std::mutex mMutex;
+  std::condition_variable mNotFull;
+  std::condition_variable mNotEmpty;
+  std::deque<T> mItems;
+  bool mIsClosed = false;
+};
+
+struct Item {
+  DirectoryPipelineFile file;
+  std::shared_ptr<FileHandler> handler;
+  std::string temporaryPath;
+};
+
+inline bool ReplaceFile(const std::string& source, const std::string& target) {
+#ifdef _WIN32
+  return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+}
+
+} // namespace directorypipeline
+/** @endcond */
+
+/**
+ * @brief Labels or protects many files in place, overlapping file I/O, policy evaluation, licensing and encryption
+ *        across files
+ * 
+ * @note Files flow through the stages of DirectoryPipelineStage. The decision is made by a callback given the open
+ *       FileHandler: it calls SetLabel, DeleteLabel, SetProtection or RemoveProtection, possibly from the actions of
+ *       ClassifyFile (file_sync.h), and returns whether the file should be committed. Committed content is written to a
+ *       temporary file next to the input and then renamed over it, which replaces it atomically on the same volume,
+ *       so a failure at any point leaves the original file intact. The temporary file is removed on failure.
+ *       
+ *       Every file produces one result: failures of one file never stop the others. Run blocks until every listed
+ *       file went through; Cancel stops listing files and skips the ones not yet opened.
+ */
+class DirectoryPipeline {
+public:
+  /** @brief Produces the next file path, returning false when there are none left */
+  typedef std::function<bool(std::string& path)> Enumerator;
+
+  /** @brief Applies the decision for a file to its handler, returning whether to commit it */
+  typedef std::function<bool(const DirectoryPipelineFile& file, FileHandler& handler)> Decider;
+
+  /**
+   * @brief DirectoryPipeline constructor
+   * 
+   * @param engine File engine the files are opened with
+   * @param mipContext MIP context passed to FileHandler::GetFileStatus
+   * @param decider Applies the decision for each file that passed the filter
+   * @param settings Workers, queues and callbacks
+   */
+  DirectoryPipeline(
+      const std::shared_ptr<FileEngine>& engine,
+      const std::shared_ptr<MipContext>& mipContext,
+      const Decider& decider,
+      const DirectoryPipelineSettings& settings = DirectoryPipelineSettings())
+      : mEngine(engine),
+        mMipContext(mipContext),
+        mDecider(decider),
+        mSettings(settings),
+        mIsCancelled(false) {
+    if (!mEngine || !mMipContext || !mDecider) {
+      throw BadInputError("DirectoryPipeline requires an engine, a MIP context and a decider");
+    }
+  }
+
+  /**
+   * @brief Process every file listed by an enumerator
+   * 
+   * @param enumerator Lists the files, e.g. by walking a directory tree; called on a thread of its own
+   * 
+   * @return Counts of files listed, skipped, committed and failed. A failure of the enumerator is rethrown once the
+   *         files it listed went through.
+   */
+  DirectoryPipelineStatistics Run(const Enumerator& enumerator) {
+    if (!enumerator) {
+      throw BadInputError("Run requires an enumerator");
+    }
+    mIsCancelled = false;
+    mStatistics = DirectoryPipelineStatistics();
+    typedef directorypipeline::BoundedQueue<directorypipeline::Item> Queue;
+    Queue statusQueue(mSettings.queueCapacity);
+    Queue decideQueue(mSettings.queueCapacity);
+    Queue commitQueue(mSettings.queueCapacity);
+    Queue replaceQueue(mSettings.queueCapacity);
+
+    std::vector<std::thread> threads;
+    std::exception_ptr enumeratorError;
+    threads.emplace_back([&]() {
+      try {
+        directorypipeline::Item item;
+        while (!mIsCancelled && enumerator(item.file.path)) {
+          Count(mStatistics.enumerated);
+          statusQueue.Push(std::move(item));
+          item = directorypipeline::Item();
+        }
+      } catch (...) {
+        enumeratorError = std::current_exception();
+      }
+      statusQueue.Close();
+    });
+    StartStage(threads, mSettings.statusWorkers, statusQueue, decideQueue,
+        [this](directorypipeline::Item& item) { return CheckStatus(item); });
+    StartStage(threads, mSettings.decideWorkers, decideQueue, commitQueue,
+        [this](directorypipeline::Item& item) { return Decide(item); });
+    StartStage(threads, mSettings.commitWorkers, commitQueue, replaceQueue,
+        [this](directorypipeline::Item& item) { return Commit(item); });
+    StartStage(threads, mSettings.replaceWorkers, replaceQueue, replaceQueue,
+        [this](directorypipeline::Item& item) { return Replace(item); });
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (enumeratorError) {
+      std::rethrow_exception(enumeratorError);
+    }
+    std::lock_guard<std::mutex> lock(mResultMutex);
+    return mStatistics;
+  }
+
+  /**
+   * @brief Stop listing files; files not yet opened are skipped and the others complete
+   */
+  void Cancel() { mIsCancelled = true; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  typedef directorypipeline::BoundedQueue<directorypipeline::Item> Queue;
+
+  // Each stage returns true to pass the item on; the last one of a stage's workers closes the next queue
+  void StartStage(std::vector<std::thread>& threads, size_t workerCount, Queue& input, Queue& output,
+      const std::function<bool(directorypipeline::Item&)>& process) {
+    workerCount = (std::max)(workerCount, static_cast<size_t>(1));
+    auto remaining = std::make_shared<std::atomic<size_t>>(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+      threads.emplace_back([&input, &output, process, remaining]() {
+        directorypipeline::Item item;
+        while (input.Pop(item)) {
+          if (process(item) && &output != &input) {
+            output.Push(std::move(item));
+          }
+          item = directorypipeline::Item();
+        }
+        if (--*remaining == 0 && &output != &input) {
+          output.Close();
+        }
+      });
+    }
+  }
+
+  bool CheckStatus(directorypipeline::Item& item) {
+    try {
+      item.file.status = FileHandler::GetFileStatus(item.file.path, mMipContext);
+      if (mSettings.filter && !mSettings.filter(item.file)) {
+        Report(item, DirectoryPipelineStage::Status, false, nullptr);
+        return false;
+      }
+      return true;
+    } catch (...) {
+      Report(item, DirectoryPipelineStage::Status, false, std::current_exception());
+      return false;
+    }
+  }
+
+  bool Decide(directorypipeline::Item& item) {
+    if (mIsCancelled) {
+      Report(item, DirectoryPipelineStage::Status, false, nullptr);
+      return false;
+    }
+    try {
+      item.handler = CreateFileHandler(mEngine, item.file.path, item.file.path,
+          mSettings.isAuditDiscoveryEnabled);
+      if (!mDecider(item.file, *item.handler)) {
+        Report(item, DirectoryPipelineStage::Decide, false, nullptr);
+        return false;
+      }
+      return true;
+    } catch (...) {
+      Report(item, DirectoryPipelineStage::Decide, false, std::current_exception());
+      return false;
+    }
+  }
+
+  bool Commit(directorypipeline::Item& item) {
+    item.temporaryPath = item.file.path + mSettings.temporarySuffix;
+    try {
+      if (!CommitFile(item.handler, item.temporaryPath)) {
+        std::remove(item.temporaryPath.c_str());
+        Report(item, DirectoryPipelineStage::Commit, false, nullptr);
+        return false;
+      }
+      return true;
+    } catch (...) {
+      std::remove(item.temporaryPath.c_str());
+      Report(item, DirectoryPipelineStage::Commit, false, std::current_exception());
+      return false;
+    }
+  }
+
+  bool Replace(directorypipeline::Item& item) {
+    if (!directorypipeline::ReplaceFile(item.temporaryPath, item.file.path)) {
+      std::remove(item.temporaryPath.c_str());
+      Report(item, DirectoryPipelineStage::Replace, false,
+          std::make_exception_ptr(FileIOError("Failed to replace " + item.file.path)));
+      return false;
+    }
+    std::exception_ptr error;
+    try {
+      item.handler->NotifyCommitSuccessful(item.file.path);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    Report(item, DirectoryPipelineStage::Replace, true, error);
+    return false;
+  }
+
+  void Report(const directorypipeline::Item& item, DirectoryPipelineStage stage, bool isCommitted,
+      const std::exception_ptr& error) {
+    DirectoryPipelineResult result;
+    result.path = item.file.path;
+    result.stage = stage;
+    result.isCommitted = isCommitted;
+    result.error = error;
+    std::lock_guard<std::mutex> lock(mResultMutex);
+    if (isCommitted) {
+      ++mStatistics.committed;
+    } else if (error) {
+      ++mStatistics.failed;
+    } else {
+      ++mStatistics.skipped;
+    }
+    if (mSettings.onResult) {
+      try {
+        mSettings.onResult(result);
+      } catch (...) {
+      }
+    }
+  }
+
+  void Count(size_t& counter) {
+    std::lock_guard<std::mutex> lock(mResultMutex);
+    ++counter;
+  }
+
+  std::shared_ptr<FileEngine> mEngine;
+  std::shared_ptr<MipContext> mMipContext;
+  Decider mDecider;
+  DirectoryPipelineSettings mSettings;
+  std::atomic<bool> mIsCancelled;
+  std::mutex mResultMutex;
+  DirectoryPipelineStatistics mStatistics;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_DIRECTORY_PIPELINE_H_
@@ -0,0 +1,279 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines C++20 awaitable counterparts of the FileProfile, FileEngine and FileHandler async operations
+ * 
+ * @file file_awaitable.h
+ */
+
+#ifndef API_MIP_FILE_FILE_AWAITABLE_H_
+#define API_MIP_FILE_FILE_AWAITABLE_H_
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_execution_state.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_inspector.h"
+#include "mip/file/file_profile.h"
+#include "mip/file/file_sync.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/upe/action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Awaitable result of one FileProfile, FileEngine or FileHandler async operation
+ * 
+ * @tparam TStart Callable starting the operation with a completion context
+ * @tparam TResult Callable extracting the result once the operation completed
+ * 
+ * @note The awaitable lives in the awaiting coroutine's frame, so an operation costs no allocation beyond what the
+ *       SDK itself does. The coroutine resumes on a TaskDispatcherDelegate task if one was given, else on the SDK
+ *       thread that reported completion. Failures are rethrown from co_await. Create awaitables through the
+ *       functions below and await them right away.
+ */
+template <typename TStart, typename TResult>
+class FileOperationAwaitable : private filesync::PendingCall {
+public:
+  /** @cond DOXYGEN_HIDE */
+  FileOperationAwaitable(TStart start, TResult result, const std::shared_ptr<TaskDispatcherDelegate>& dispatcher)
+      : mStart(std::move(start)), mResult(std::move(result)), mDispatcher(dispatcher) {}
+
+  FileOperationAwaitable(const FileOperationAwaitable&) = delete;
+  FileOperationAwaitable& operator=(const FileOperationAwaitable&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    mHandle = handle;
+    try {
+      mStart(filesync::MakeContext(*this));
+    } catch (...) {
+      // The operation did not start, so no callback will follow
+      error = std::current_exception();
+      return false;
+    }
+    return true;
+  }
+
+  decltype(auto) await_resume() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return mResult(static_cast<filesync::PendingCall&>(*this));
+  }
+
+private:
+  void OnComplete() override {
+    std::coroutine_handle<> handle = mHandle;
+    if (mDispatcher) {
+      static std::atomic<uint64_t> sTaskCounter(0);
+      mDispatcher->DispatchTask("mip-await-" + std::to_string(++sTaskCounter), [handle]() { handle.resume(); });
+    } else {
+      handle.resume();
+    }
+  }
+
+  TStart mStart;
+  TResult mResult;
+  std::shared_ptr<TaskDispatcherDelegate> mDispatcher;
+  std::coroutine_handle<> mHandle;
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace filesync {
+
+template <typename TStart, typename TResult>
+inline FileOperationAwaitable<TStart, TResult> MakeAwaitable(
+    TStart start,
+    TResult result,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher) {
+  return FileOperationAwaitable<TStart, TResult>(std::move(start), std::move(result), dispatcher);
+}
+
+} // namespace filesync
+/** @endcond */
+
+/**
+ * @brief Adds an engine to a profile
+ * 
+ * @param profile Profile loaded with a SyncFileProfileObserver
+ * @param settings Engine settings
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing the engine
+ */
+inline auto AddFileEngineAwaitable(
+    const std::shared_ptr<FileProfile>& profile,
+    const FileEngine::Settings& settings,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  filesync::RequireSyncProfileObserver(profile->GetSettings());
+  return filesync::MakeAwaitable(
+      [profile, settings](const std::shared_ptr<void>& context) { profile->AddEngineAsync(settings, context); },
+      [](filesync::PendingCall& call) { return std::move(call.engine); },
+      dispatcher);
+}
+
+/**
+ * @brief Creates a file handler for a stream
+ * 
+ * @param engine File engine
+ * @param inputStream Stream containing the file data
+ * @param actualFilePath Path of the file, including its extension, also used for audit
+ * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+ * @param fileExecutionState Execution state, or nullptr
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing the file handler
+ * 
+ * @note Handlers created here share the observer of CreateFileHandler, so they work with both the awaitable and
+ *       the synchronous functions.
+ */
+inline auto CreateFileHandlerAwaitable(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::shared_ptr<Stream>& inputStream,
+    const std::string& actualFilePath,
+    bool isAuditDiscoveryEnabled = true,
+    const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [=](const std::shared_ptr<void>& context) {
+        engine->CreateFileHandlerAsync(inputStream, actualFilePath, isAuditDiscoveryEnabled,
+            filesync::GetFileHandlerObserver(), context, fileExecutionState);
+      },
+      [](filesync::PendingCall& call) { return std::move(call.handler); },
+      dispatcher);
+}
+
+/**
+ * @brief Classifies a file
+ * 
+ * @param handler File handler returned by CreateFileHandlerAwaitable or CreateFileHandler
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing the actions computed by the policy
+ */
+inline auto ClassifyFileAwaitable(
+    const std::shared_ptr<FileHandler>& handler,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [handler](const std::shared_ptr<void>& context) { handler->ClassifyAsync(context); },
+      [](filesync::PendingCall& call) { return std::move(call.actions); },
+      dispatcher);
+}
+
+/**
+ * @brief Inspects a file
+ * 
+ * @param handler File handler returned by CreateFileHandlerAwaitable or CreateFileHandler
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing the file inspector
+ */
+inline auto InspectFileAwaitable(
+    const std::shared_ptr<FileHandler>& handler,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [handler](const std::shared_ptr<void>& context) { handler->InspectAsync(context); },
+      [](filesync::PendingCall& call) { return std::move(call.inspector); },
+      dispatcher);
+}
+
+/**
+ * @brief Decrypts a file to a temporary stream
+ * 
+ * @param handler File handler returned by CreateFileHandlerAwaitable or CreateFileHandler
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing the decrypted content
+ */
+inline auto GetDecryptedTemporaryStreamAwaitable(
+    const std::shared_ptr<FileHandler>& handler,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [handler](const std::shared_ptr<void>& context) { handler->GetDecryptedTemporaryStreamAsync(context); },
+      [](filesync::PendingCall& call) { return std::move(call.stream); },
+      dispatcher);
+}
+
+/**
+ * @brief Commits the changes of a file to a stream
+ * 
+ * @param handler File handler returned by CreateFileHandlerAwaitable or CreateFileHandler
+ * @param outputStream Stream receiving the modified file
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing true if changes were committed
+ */
+inline auto CommitFileAwaitable(
+    const std::shared_ptr<FileHandler>& handler,
+    const std::shared_ptr<Stream>& outputStream,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [handler, outputStream](const std::shared_ptr<void>& context) { handler->CommitAsync(outputStream, context); },
+      [](filesync::PendingCall& call) { return call.isCommitted; },
+      dispatcher);
+}
+
+/**
+ * @brief Commits the changes of a file to a file
+ * 
+ * @param handler File handler returned by CreateFileHandlerAwaitable or CreateFileHandler
+ * @param outputFilePath File receiving the modified content
+ * @param dispatcher Task dispatcher the awaiting coroutine resumes on, or nullptr to resume on the SDK thread
+ * 
+ * @return Awaitable producing true if changes were committed
+ */
+inline auto CommitFileAwaitable(
+    const std::shared_ptr<FileHandler>& handler,
+    const std::string& outputFilePath,
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr) {
+  return filesync::MakeAwaitable(
+      [handler, outputFilePath](const std::shared_ptr<void>& context) {
+        handler->CommitAsync(outputFilePath, context);
+      },
+      [](filesync::PendingCall& call) { return call.isCommitted; },
+      dispatcher);
+}
+
+MIP_NAMESPACE_END
+
+#endif // __cpp_impl_coroutine
+#endif // API_MIP_FILE_FILE_AWAITABLE_H_
@@ -0,0 +1,269 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a bounded-concurrency pipeline for labeling and protecting many files
+ * 
+ * @file file_engine_batch.h
+ */
+
+#ifndef API_MIP_FILE_FILE_ENGINE_BATCH_H_
+#define API_MIP_FILE_FILE_ENGINE_BATCH_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief One file processed by ProcessFileBatch
+ */
+struct FileJob {
+  std::string inputFilePath;  /**< File to open */
+  std::string outputFilePath; /**< File the modified content is committed to */
+  std::string actualFilePath; /**< Actual (not temporary) path used for audit, the input path if empty */
+  std::function<void(FileHandler& handler)> apply; /**< Modifies the file, for example with SetLabel or SetProtection */
+};
+
+/**
+ * @brief Concurrency limits for ProcessFileBatch
+ */
+struct FileBatchOptions {
+  size_t maxOpening = 8;    /**< Files being opened concurrently (file I/O and license acquisition) */
+  size_t maxCommitting = 4; /**< Files being committed concurrently (encryption and output I/O) */
+  size_t maxPending = 4;    /**< Opened files allowed to wait for a commit slot before opening pauses */
+  bool isAuditDiscoveryEnabled = true; /**< Passed to FileEngine::CreateFileHandlerAsync */
+};
+
+/**
+ * @brief Result of one file processed by ProcessFileBatch
+ */
+struct FileJobResult {
+  bool isCommitted = false; /**< If changes were written to the output file */
+  std::exception_ptr error; /**< Failure of any stage, nullptr on success */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace filebatch {
+
+class BatchState {
+public:
+  explicit BatchState(size_t jobCount) : results(jobCount), handlers(jobCount), opening(0), committing(0), completed(0) {}
+
+  void OnOpened(size_t index, const std::shared_ptr<FileHandler>& handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    --opening;
+    handlers[index] = handler;
+    opened.push_back(index);
+    condition.notify_all();
+  }
+
+  void OnCommitted(size_t index, bool isCommitted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    --committing;
+    results[index].isCommitted = isCommitted;
+    committed.push_back(index);
+    condition.notify_all();
+  }
+
+  void OnOpenFailed(size_t index, const std::exception_ptr& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    --opening;
+    FinishLocked(index, error);
+  }
+
+  void OnCommitFailed(size_t index, const std::exception_ptr& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    --committing;
+    FinishLocked(index, error);
+  }
+
+  void Finish(size_t index, const std::exception_ptr& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    FinishLocked(index, error);
+  }
+
+  void FinishLocked(size_t index, const std::exception_ptr& error) {
+    results[index].error = error;
+    handlers[index].reset();
+    ++completed;
+    condition.notify_all();
+  }
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::vector<FileJobResult> results;
+  std::vector<std::shared_ptr<FileHandler>> handlers;
+  std::deque<size_t> opened;
+  std::deque<size_t> committed;
+  size_t opening;
+  size_t committing;
+  size_t completed;
+};
+
+class JobObserver : public FileHandler::Observer {
+public:
+  JobObserver(const std::shared_ptr<BatchState>& state, size_t index) : mState(state), mIndex(index) {}
+
+  void OnCreateFileHandlerSuccess(
+      const std::shared_ptr<FileHandler>& fileHandler,
+      const std::shared_ptr<void>& /*context*/) override {
+    mState->OnOpened(mIndex, fileHandler);
+  }
+
+  void OnCreateFileHandlerFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    mState->OnOpenFailed(mIndex, error);
+  }
+
+  void OnCommitSuccess(bool committed, const std::shared_ptr<void>& /*context*/) override {
+    mState->OnCommitted(mIndex, committed);
+  }
+
+  void OnCommitFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    mState->OnCommitFailed(mIndex, error);
+  }
+
+private:
+  std::shared_ptr<BatchState> mState;
+  size_t mIndex;
+};
+
+} // namespace filebatch
+/** @endcond */
+
+/**
+ * @brief Open, modify and commit many files, overlapping the stages of different files
+ * 
+ * @param engine File engine
+ * @param jobs Files to process
+ * @param options Concurrency limits for each stage
+ * 
+ * @return One result per job, in the same order
+ * 
+ * @note Each file goes through FileEngine::CreateFileHandlerAsync, FileJob::apply, FileHandler::CommitAsync and, if
+ *       changes were committed, FileHandler::NotifyCommitSuccessful. While some files are being committed, others
+ *       are being opened, so license acquisition overlaps with encryption. When @p options.maxPending opened files
+ *       are waiting for a commit slot, no more files are opened until one is committed. All SDK calls and every
+ *       FileJob::apply are made on the calling thread; the call blocks until every job completes. A failure of one
+ *       job does not affect the others.
+ */
+inline std::vector<FileJobResult> ProcessFileBatch(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::vector<FileJob>& jobs,
+    const FileBatchOptions& options = FileBatchOptions()) {
+  if (!engine) {
+    throw BadInputError("A FileEngine is required");
+  }
+  size_t maxOpening = (std::max)(options.maxOpening, static_cast<size_t>(1));
+  size_t maxCommitting = (std::max)(options.maxCommitting, static_cast<size_t>(1));
+  size_t maxPending = (std::max)(options.maxPending, static_cast<size_t>(1));
+  auto state = std::make_shared<filebatch::BatchState>(jobs.size());
+  std::vector<std::shared_ptr<filebatch::JobObserver>> observers(jobs.size());
+  size_t nextJob = 0;
+
+  for (;;) {
+    std::vector<size_t> toOpen;
+    std::vector<size_t> toCommit;
+    std::vector<size_t> toNotify;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      auto canOpen = [&]() {
+        return nextJob < jobs.size() && state->opening < maxOpening && state->opened.size() < maxPending;
+      };
+      auto canCommit = [&]() { return !state->opened.empty() && state->committing < maxCommitting; };
+      state->condition.wait(lock, [&]() {
+        return canOpen() || canCommit() || !state->committed.empty() || state->completed == jobs.size();
+      });
+      if (state->completed == jobs.size()) {
+        break;
+      }
+      while (canCommit()) {
+        toCommit.push_back(state->opened.front());
+        state->opened.pop_front();
+        ++state->committing;
+      }
+      while (canOpen()) {
+        toOpen.push_back(nextJob++);
+        ++state->opening;
+      }
+      toNotify.assign(state->committed.begin(), state->committed.end());
+      state->committed.clear();
+    }
+
+    for (size_t index : toNotify) {
+      try {
+        if (state->results[index].isCommitted) {
+          state->handlers[index]->NotifyCommitSuccessful(
+              jobs[index].actualFilePath.empty() ? jobs[index].inputFilePath : jobs[index].actualFilePath);
+        }
+        state->Finish(index, nullptr);
+      } catch (...) {
+        state->Finish(index, std::current_exception());
+      }
+      observers[index].reset();
+    }
+    for (size_t index : toCommit) {
+      try {
+        if (jobs[index].apply) {
+          jobs[index].apply(*state->handlers[index]);
+        }
+        state->handlers[index]->CommitAsync(jobs[index].outputFilePath, nullptr);
+      } catch (...) {
+        state->OnCommitFailed(index, std::current_exception());
+      }
+    }
+    for (size_t index : toOpen) {
+      const FileJob& job = jobs[index];
+      observers[index] = std::make_shared<filebatch::JobObserver>(state, index);
+      try {
+        engine->CreateFileHandlerAsync(
+            job.inputFilePath,
+            job.actualFilePath.empty() ? job.inputFilePath : job.actualFilePath,
+            options.isAuditDiscoveryEnabled,
+            observers[index],
+            nullptr);
+      } catch (...) {
+        state->OnOpenFailed(index, std::current_exception());
+      }
+    }
+  }
+  return state->results;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_ENGINE_BATCH_H_
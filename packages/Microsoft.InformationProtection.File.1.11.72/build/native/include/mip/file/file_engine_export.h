@@ -0,0 +1,359 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that export the cached state of a FileEngine as a sealed blob and add an engine from it
+ * 
+ * @file file_engine_export.h
+ */
+
+#ifndef API_MIP_FILE_FILE_ENGINE_EXPORT_H_
+#define API_MIP_FILE_FILE_ENGINE_EXPORT_H_
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_profile.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/segment_integrity.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Cached state of a FileEngine that another node needs to add the same engine without fetching policy
+ */
+struct FileEngineExport {
+  std::string engineId;           /**< Engine ID */
+  std::string identity;           /**< Email of the engine's identity */
+  std::string policyFileId;       /**< Policy file ID the policy was exported from */
+  std::string sensitivityFileId;  /**< Sensitivity file ID of the engine */
+  std::string policyDataXml;      /**< Policy data XML, as returned by FileEngine::GetPolicyDataXml */
+  int64_t policyFetchTime = 0;    /**< When the policy was fetched from the service, in seconds since the epoch */
+  int64_t exportTime = 0;         /**< When the state was exported, in seconds since the epoch */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace engineexport {
+
+const uint8_t kMagic[4] = {'M', 'F', 'E', 'X'};
+const uint8_t kVersion = 1;
+const size_t kSealSize = 32;
+
+inline void AppendField(std::vector<uint8_t>& out, const std::string& value) {
+  uint64_t size = value.size();
+  while (size >= 0x80) {
+    out.push_back(static_cast<uint8_t>(size | 0x80));
+    size >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(size));
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+inline void AppendInt64(std::vector<uint8_t>& out, int64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+  }
+}
+
+inline std::string ReadField(const std::vector<uint8_t>& in, size_t end, size_t& position) {
+  uint64_t size = 0;
+  for (int shift = 0;; shift += 7) {
+    if (position >= end || shift >= 64) {
+      throw BadInputError("Damaged FileEngine export");
+    }
+    uint8_t byte = in[position++];
+    size |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  if (size > end - position) {
+    throw BadInputError("Damaged FileEngine export");
+  }
+  std::string field(in.begin() + position, in.begin() + position + static_cast<size_t>(size));
+  position += static_cast<size_t>(size);
+  return field;
+}
+
+inline int64_t ReadInt64(const std::vector<uint8_t>& in, size_t end, size_t& position) {
+  if (end - position < 8) {
+    throw BadInputError("Damaged FileEngine export");
+  }
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= static_cast<uint64_t>(in[position++]) << (8 * i);
+  }
+  return static_cast<int64_t>(value);
+}
+
+// HMAC-SHA256, so that a blob changed in transit or sealed with another key is never loaded as policy
+inline std::array<uint8_t, kSealSize> ComputeSeal(
+    const std::vector<uint8_t>& sealKey,
+    const uint8_t* data,
+    size_t size) {
+  if (sealKey.empty()) {
+    throw BadInputError("A seal key is required");
+  }
+  uint8_t key[64] = {};
+  if (sealKey.size() > sizeof(key)) {
+    auto digest = segmentintegrity::Sha256(sealKey.data(), sealKey.size());
+    std::memcpy(key, digest.data(), digest.size());
+  } else {
+    std::memcpy(key, sealKey.data(), sealKey.size());
+  }
+  std::vector<uint8_t> inner(sizeof(key) + size);
+  for (size_t i = 0; i < sizeof(key); ++i) {
+    inner[i] = key[i] ^ 0x36;
+  }
+  if (size > 0) {
+    std::memcpy(inner.data() + sizeof(key), data, size);
+  }
+  auto innerDigest = segmentintegrity::Sha256(inner.data(), inner.size());
+  uint8_t outer[sizeof(key) + kSealSize];
+  for (size_t i = 0; i < sizeof(key); ++i) {
+    outer[i] = key[i] ^ 0x5c;
+  }
+  std::memcpy(outer + sizeof(key), innerDigest.data(), innerDigest.size());
+  return segmentintegrity::Sha256(outer, sizeof(outer));
+}
+
+inline bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+    return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+  });
+}
+
+inline int64_t ToSeconds(std::chrono::time_point<std::chrono::system_clock> time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+} // namespace engineexport
+/** @endcond */
+
+/**
+ * @brief Capture the cached state of a loaded engine
+ * 
+ * @param engine Loaded engine
+ * 
+ * @return Exported state
+ */
+inline FileEngineExport CreateFileEngineExport(const std::shared_ptr<FileEngine>& engine) {
+  if (!engine) {
+    throw BadInputError("A FileEngine is required");
+  }
+  FileEngineExport state;
+  state.engineId = engine->GetSettings().GetEngineId();
+  state.identity = engine->GetSettings().GetIdentity().GetEmail();
+  state.policyFileId = engine->GetPolicyFileId();
+  state.sensitivityFileId = engine->GetSensitivityFileId();
+  state.policyDataXml = engine->GetPolicyDataXml();
+  state.policyFetchTime = engineexport::ToSeconds(engine->GetLastPolicyFetchTime());
+  state.exportTime = engineexport::ToSeconds(std::chrono::system_clock::now());
+  return state;
+}
+
+/**
+ * @brief Serialize exported state and seal it against changes
+ * 
+ * @param state Exported state
+ * @param sealKey Key shared by the nodes a tenant may move between
+ * 
+ * @return Sealed, versioned blob
+ * 
+ * @note The seal is an HMAC-SHA256 of the blob, which ImportFileEngineState checks before anything in the blob is
+ *       used. It does not encrypt the blob: policy XML is tenant data, so move it over the same channel as content.
+ */
+inline std::vector<uint8_t> SealFileEngineExport(const FileEngineExport& state, const std::vector<uint8_t>& sealKey) {
+  std::vector<uint8_t> out(engineexport::kMagic, engineexport::kMagic + 4);
+  out.push_back(engineexport::kVersion);
+  out.reserve(out.size() + state.engineId.size() + state.identity.size() + state.policyFileId.size() +
+      state.sensitivityFileId.size() + state.policyDataXml.size() + 32 + engineexport::kSealSize);
+  engineexport::AppendField(out, state.engineId);
+  engineexport::AppendField(out, state.identity);
+  engineexport::AppendField(out, state.policyFileId);
+  engineexport::AppendField(out, state.sensitivityFileId);
+  engineexport::AppendField(out, state.policyDataXml);
+  engineexport::AppendInt64(out, state.policyFetchTime);
+  engineexport::AppendInt64(out, state.exportTime);
+  auto seal = engineexport::ComputeSeal(sealKey, out.data(), out.size());
+  out.insert(out.end(), seal.begin(), seal.end());
+  return out;
+}
+
+/**
+ * @brief Export the cached state of a loaded engine as a sealed blob
+ * 
+ * @param engine Loaded engine
+ * @param sealKey Key shared by the nodes a tenant may move between
+ * 
+ * @return Sealed, versioned blob for ImportFileEngineState or AddEngineFromExportAsync
+ */
+inline std::vector<uint8_t> ExportFileEngineState(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::vector<uint8_t>& sealKey) {
+  return SealFileEngineExport(CreateFileEngineExport(engine), sealKey);
+}
+
+/**
+ * @brief Check the seal of a blob and read the state it carries
+ * 
+ * @param sealedExport Blob written by SealFileEngineExport or ExportFileEngineState
+ * @param sealKey Key the blob was sealed with
+ * 
+ * @return Exported state
+ * 
+ * @throw BadInputError if the blob is damaged, of an unknown version or sealed with another key
+ */
+inline FileEngineExport ImportFileEngineState(
+    const std::vector<uint8_t>& sealedExport,
+    const std::vector<uint8_t>& sealKey) {
+  if (sealedExport.size() < 5 + engineexport::kSealSize ||
+      std::memcmp(sealedExport.data(), engineexport::kMagic, 4) != 0) {
+    throw BadInputError("Not a FileEngine export");
+  }
+  if (sealedExport[4] != engineexport::kVersion) {
+    throw BadInputError("Unsupported FileEngine export version " + std::to_string(sealedExport[4]));
+  }
+  size_t end = sealedExport.size() - engineexport::kSealSize;
+  auto seal = engineexport::ComputeSeal(sealKey, sealedExport.data(), end);
+  uint8_t difference = 0;
+  for (size_t i = 0; i < engineexport::kSealSize; ++i) {
+    difference |= seal[i] ^ sealedExport[end + i];
+  }
+  if (difference != 0) {
+    throw BadInputError("FileEngine export was changed or sealed with another key");
+  }
+  size_t position = 5;
+  FileEngineExport state;
+  state.engineId = engineexport::ReadField(sealedExport, end, position);
+  state.identity = engineexport::ReadField(sealedExport, end, position);
+  state.policyFileId = engineexport::ReadField(sealedExport, end, position);
+  state.sensitivityFileId = engineexport::ReadField(sealedExport, end, position);
+  state.policyDataXml = engineexport::ReadField(sealedExport, end, position);
+  state.policyFetchTime = engineexport::ReadInt64(sealedExport, end, position);
+  state.exportTime = engineexport::ReadInt64(sealedExport, end, position);
+  if (position != end || state.policyDataXml.empty()) {
+    throw BadInputError("Damaged FileEngine export");
+  }
+  return state;
+}
+
+/**
+ * @brief Check whether exported state is recent enough to load an engine from
+ * 
+ * @param state Exported state
+ * @param maxAge Oldest policy that may be used, measured from when the exporting engine fetched it
+ * 
+ * @return true if the policy was fetched less than maxAge ago
+ */
+inline bool IsFileEngineExportFresh(
+    const FileEngineExport& state,
+    std::chrono::seconds maxAge = std::chrono::hours(24)) {
+  int64_t age = engineexport::ToSeconds(std::chrono::system_clock::now()) - state.policyFetchTime;
+  return age >= 0 && age < maxAge.count();
+}
+
+/**
+ * @brief Configure engine settings to load policy from exported state
+ * 
+ * @param settings Engine settings of the same identity; an empty engine ID is set to the exported one
+ * @param state Exported state, e.g. from ImportFileEngineState
+ * @param maxAge Oldest policy that may be used
+ * 
+ * @return true if the engine will load its policy from the exported state, false if the state is stale and the
+ *         engine will fetch policy as usual
+ * 
+ * @throw BadInputError if the state was exported for another engine or identity
+ * 
+ * @note The policy is passed with GetCustomSettingPolicyDataName, so the engine does not fetch it from the service.
+ *       Sensitivity types, templates and user certificates are cached by the SDK binary in its own storage and are
+ *       not part of the export; use a shared StorageDelegate to move them with the tenant.
+ */
+inline bool ApplyFileEngineExport(
+    FileEngine::Settings& settings,
+    const FileEngineExport& state,
+    std::chrono::seconds maxAge = std::chrono::hours(24)) {
+  if (settings.GetEngineId().empty()) {
+    settings.SetEngineId(state.engineId);
+  } else if (settings.GetEngineId() != state.engineId) {
+    throw BadInputError("FileEngine export is of engine " + state.engineId);
+  }
+  if (!engineexport::EqualsIgnoreCase(settings.GetIdentity().GetEmail(), state.identity)) {
+    throw BadInputError("FileEngine export is bound to another identity");
+  }
+  if (!IsFileEngineExportFresh(state, maxAge)) {
+    return false;
+  }
+  std::vector<std::pair<std::string, std::string>> customSettings = settings.GetCustomSettings();
+  customSettings.emplace_back(GetCustomSettingPolicyDataName(), state.policyDataXml);
+  settings.SetCustomSettings(customSettings);
+  return true;
+}
+
+/**
+ * @brief Start adding a file engine from the sealed state exported by another node
+ * 
+ * @param profile Profile to add the engine to
+ * @param settings Engine settings of the exported identity
+ * @param sealedExport Blob written by ExportFileEngineState
+ * @param sealKey Key the blob was sealed with
+ * @param context Client context that will be opaquely passed back to FileProfile::Observer
+ * @param maxAge Oldest policy that may be used; staler state falls back to fetching policy
+ * 
+ * @return Async control object
+ * 
+ * @throw BadInputError if the blob is damaged, sealed with another key, or of another engine or identity
+ * 
+ * @note FileProfile::Observer will be called upon success or failure, as for FileProfile::AddEngineAsync.
+ */
+inline std::shared_ptr<AsyncControl> AddEngineFromExportAsync(
+    const std::shared_ptr<FileProfile>& profile,
+    const FileEngine::Settings& settings,
+    const std::vector<uint8_t>& sealedExport,
+    const std::vector<uint8_t>& sealKey,
+    const std::shared_ptr<void>& context,
+    std::chrono::seconds maxAge = std::chrono::hours(24)) {
+  if (!profile) {
+    throw BadInputError("A FileProfile is required");
+  }
+  FileEngine::Settings importSettings = settings;
+  ApplyFileEngineExport(importSettings, ImportFileEngineState(sealedExport, sealKey), maxAge);
+  return profile->AddEngineAsync(importSettings, context);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_ENGINE_EXPORT_H_
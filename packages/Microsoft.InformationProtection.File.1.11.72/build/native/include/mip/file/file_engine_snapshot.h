@@ -0,0 +1,218 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that let a FileEngine start from a policy snapshot exported by a previous process
+ * 
+ * @file file_engine_snapshot.h
+ */
+
+#ifndef API_MIP_FILE_FILE_ENGINE_SNAPSHOT_H_
+#define API_MIP_FILE_FILE_ENGINE_SNAPSHOT_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace enginesnapshot {
+
+constexpr const char* kManifestVersion = "1";
+
+struct Manifest {
+  std::string version;
+  std::string policyFileId;
+  std::string sensitivityFileId;
+  int64_t createdTime = 0;
+};
+
+inline std::string GetPolicyPath(const std::string& snapshotDirectory, const std::string& engineId) {
+  return snapshotDirectory + "/" + engineId + ".policy.xml";
+}
+
+inline std::string GetManifestPath(const std::string& snapshotDirectory, const std::string& engineId) {
+  return snapshotDirectory + "/" + engineId + ".snapshot";
+}
+
+inline bool ReadManifest(const std::string& path, Manifest& manifest) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t separator = line.find('=');
+    if (separator == std::string::npos) {
+      continue;
+    }
+    std::string key = line.substr(0, separator);
+    std::string value = line.substr(separator + 1);
+    if (key == "version") {
+      manifest.version = value;
+    } else if (key == "policyFileId") {
+      manifest.policyFileId = value;
+    } else if (key == "sensitivityFileId") {
+      manifest.sensitivityFileId = value;
+    } else if (key == "created") {
+      manifest.createdTime = std::strtoll(value.c_str(), nullptr, 10);
+    }
+  }
+  return manifest.version == kManifestVersion;
+}
+
+inline bool FileExists(const std::string& path) {
+  std::ifstream file(path);
+  return static_cast<bool>(file);
+}
+
+inline int64_t GetCurrentTime() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace enginesnapshot
+/** @endcond */
+
+/**
+ * @brief Configure engine settings to start from a policy snapshot, or to export one
+ * 
+ * @param settings Engine settings, which must have an engine ID
+ * @param snapshotDirectory Directory holding snapshots, shared by process restarts
+ * @param maxAge Oldest snapshot that may be used; older snapshots are replaced with a fresh export
+ * 
+ * @return true if the engine will load its policy from the snapshot, false if it will fetch policy and export it
+ * 
+ * @note When a current snapshot exists, the policy file is passed with GetCustomSettingPolicyDataFile, so the engine
+ *       does not fetch and reparse policy from the service. Otherwise GetCustomSettingExportPolicyFileName makes the
+ *       engine export the policy it fetches, and CommitFileEngineSnapshot then records it for the next start.
+ *       Sensitivity types are not exported by the engine and are always loaded as usual.
+ */
+inline bool ApplyFileEngineSnapshot(
+    FileEngine::Settings& settings,
+    const std::string& snapshotDirectory,
+    std::chrono::seconds maxAge = std::chrono::hours(24)) {
+  if (settings.GetEngineId().empty()) {
+    throw BadInputError("A policy snapshot requires an engine ID");
+  }
+  std::string policyPath = enginesnapshot::GetPolicyPath(snapshotDirectory, settings.GetEngineId());
+  std::string manifestPath = enginesnapshot::GetManifestPath(snapshotDirectory, settings.GetEngineId());
+  enginesnapshot::Manifest manifest;
+  bool isCurrent =
+      enginesnapshot::ReadManifest(manifestPath, manifest) &&
+      enginesnapshot::GetCurrentTime() - manifest.createdTime < maxAge.count() &&
+      enginesnapshot::FileExists(policyPath);
+  std::vector<std::pair<std::string, std::string>> customSettings = settings.GetCustomSettings();
+  customSettings.emplace_back(
+      isCurrent ? GetCustomSettingPolicyDataFile() : GetCustomSettingExportPolicyFileName(), policyPath);
+  settings.SetCustomSettings(customSettings);
+  return isCurrent;
+}
+
+/**
+ * @brief Record the policy exported by a freshly loaded engine as the snapshot for the next start
+ * 
+ * @param engine Engine loaded with settings prepared by ApplyFileEngineSnapshot
+ * @param snapshotDirectory Directory holding snapshots
+ * 
+ * @return true if a snapshot was recorded
+ * 
+ * @note Call after FileProfile::AddEngineAsync succeeds. The manifest records GetPolicyFileId and
+ *       GetSensitivityFileId, which IsFileEngineSnapshotCurrent compares against a later engine.
+ */
+inline bool CommitFileEngineSnapshot(const std::shared_ptr<FileEngine>& engine, const std::string& snapshotDirectory) {
+  if (!engine) {
+    throw BadInputError("A FileEngine is required");
+  }
+  const std::string& engineId = engine->GetSettings().GetEngineId();
+  if (!enginesnapshot::FileExists(enginesnapshot::GetPolicyPath(snapshotDirectory, engineId))) {
+    return false;
+  }
+  // Write to a temporary file first so that a crash never leaves a truncated manifest behind
+  std::string manifestPath = enginesnapshot::GetManifestPath(snapshotDirectory, engineId);
+  std::string temporaryPath = manifestPath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::trunc);
+    if (!file) {
+      return false;
+    }
+    file << "version=" << enginesnapshot::kManifestVersion << "\n"
+         << "policyFileId=" << engine->GetPolicyFileId() << "\n"
+         << "sensitivityFileId=" << engine->GetSensitivityFileId() << "\n"
+         << "created=" << enginesnapshot::GetCurrentTime() << "\n";
+    if (!file) {
+      return false;
+    }
+  }
+  std::remove(manifestPath.c_str());
+  return std::rename(temporaryPath.c_str(), manifestPath.c_str()) == 0;
+}
+
+/**
+ * @brief Check whether a snapshot matches the policy of an engine
+ * 
+ * @param engine Engine whose policy is current, for example one reloaded after FileProfile::Observer::OnPolicyChanged
+ * @param snapshotDirectory Directory holding snapshots
+ * 
+ * @return true if the snapshot was taken from the same policy and sensitivity files
+ */
+inline bool IsFileEngineSnapshotCurrent(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::string& snapshotDirectory) {
+  if (!engine) {
+    throw BadInputError("A FileEngine is required");
+  }
+  enginesnapshot::Manifest manifest;
+  return enginesnapshot::ReadManifest(
+             enginesnapshot::GetManifestPath(snapshotDirectory, engine->GetSettings().GetEngineId()), manifest) &&
+         manifest.policyFileId == engine->GetPolicyFileId() &&
+         manifest.sensitivityFileId == engine->GetSensitivityFileId();
+}
+
+/**
+ * @brief Discard the snapshot of an engine, so that its next start fetches policy from the service
+ * 
+ * @param snapshotDirectory Directory holding snapshots
+ * @param engineId Engine ID
+ */
+inline void InvalidateFileEngineSnapshot(const std::string& snapshotDirectory, const std::string& engineId) {
+  std::remove(enginesnapshot::GetManifestPath(snapshotDirectory, engineId).c_str());
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_ENGINE_SNAPSHOT_H_
@@ -0,0 +1,208 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines AddFileEngines and AcquirePolicyAuthTokens, which warm up a FileProfile with bounded concurrency
+ * 
+ * @file file_engine_warmup.h
+ */
+
+#ifndef API_MIP_FILE_FILE_ENGINE_WARMUP_H_
+#define API_MIP_FILE_FILE_ENGINE_WARMUP_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mip/caching_auth_delegate.h"
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_profile.h"
+#include "mip/file/file_sync.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Result of one engine added by AddFileEngines
+ */
+struct FileEngineWarmupResult {
+  std::shared_ptr<FileEngine> engine; /**< Added engine, nullptr on failure */
+  std::exception_ptr error;           /**< Failure, nullptr on success */
+};
+
+/**
+ * @brief Options of AddFileEngines
+ */
+struct FileEngineWarmupOptions {
+  size_t maxConcurrency = 16; /**< Engines being added concurrently (policy fetch and parse) */
+  /**
+   * Called as each engine completes, with its index in the settings list, its result and the number of engines
+   * completed so far. Called on SDK threads, one call at a time.
+   */
+  std::function<void(size_t index, const FileEngineWarmupResult& result, size_t completedCount)> onProgress;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace enginewarmup {
+
+struct WarmupState {
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t activeCount = 0;
+  size_t completedCount = 0;
+  std::mutex progressMutex;
+};
+
+class WarmupCall : public filesync::PendingCall {
+public:
+  WarmupCall(WarmupState& state, const FileEngineWarmupOptions& options, size_t index, FileEngineWarmupResult& result)
+      : mState(state), mOptions(options), mIndex(index), mResult(result) {}
+
+  // Records the outcome of an AddEngineAsync that threw instead of reporting through the observer
+  void FailToStart(const std::exception_ptr& failure) { Fail(failure); }
+
+private:
+  void OnComplete() override {
+    mResult.engine = std::move(engine);
+    mResult.error = error;
+    size_t completedCount;
+    {
+      std::lock_guard<std::mutex> lock(mState.mutex);
+      completedCount = ++mState.completedCount;
+    }
+    if (mOptions.onProgress) {
+      std::lock_guard<std::mutex> lock(mState.progressMutex);
+      try {
+        mOptions.onProgress(mIndex, mResult, completedCount);
+      } catch (...) {
+        // A failing progress callback must not leave the caller waiting for a slot that never frees
+      }
+    }
+    std::lock_guard<std::mutex> lock(mState.mutex);
+    --mState.activeCount;
+    mState.condition.notify_all();
+  }
+
+  WarmupState& mState;
+  const FileEngineWarmupOptions& mOptions;
+  size_t mIndex;
+  FileEngineWarmupResult& mResult;
+};
+
+} // namespace enginewarmup
+/** @endcond */
+
+/**
+ * @brief Adds many engines to a profile, keeping several AddEngineAsync operations in flight
+ * 
+ * @param profile Profile loaded with a SyncFileProfileObserver, e.g. by LoadFileProfile
+ * @param settingsList Settings of the engines to add, one per identity
+ * @param options Concurrency limit and progress callback
+ * 
+ * @return One result per engine, in settings order
+ * 
+ * @note The calling thread starts the operations and blocks until all of them complete. Policy fetch and parse of
+ *       different engines then overlap inside the SDK instead of running one engine after another. A failure of one
+ *       engine is reported in its result and does not stop the others. Combine with ApplyFileEngineSnapshot so that
+ *       restarts load policy from local snapshots.
+ */
+inline std::vector<FileEngineWarmupResult> AddFileEngines(
+    const std::shared_ptr<FileProfile>& profile,
+    const std::vector<FileEngine::Settings>& settingsList,
+    const FileEngineWarmupOptions& options = FileEngineWarmupOptions()) {
+  if (!profile) {
+    throw BadInputError("A FileProfile is required");
+  }
+  filesync::RequireSyncProfileObserver(profile->GetSettings());
+  std::vector<FileEngineWarmupResult> results(settingsList.size());
+  std::vector<std::unique_ptr<enginewarmup::WarmupCall>> calls;
+  calls.reserve(settingsList.size());
+  enginewarmup::WarmupState state;
+  size_t maxConcurrency = (std::max)(options.maxConcurrency, static_cast<size_t>(1));
+
+  for (size_t i = 0; i < settingsList.size(); ++i) {
+    {
+      std::unique_lock<std::mutex> lock(state.mutex);
+      state.condition.wait(lock, [&] { return state.activeCount < maxConcurrency; });
+      ++state.activeCount;
+    }
+    calls.emplace_back(new enginewarmup::WarmupCall(state, options, i, results[i]));
+    try {
+      profile->AddEngineAsync(settingsList[i], filesync::MakeContext(*calls.back()));
+    } catch (...) {
+      calls.back()->FailToStart(std::current_exception());
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(state.mutex);
+  state.condition.wait(lock, [&] { return state.activeCount == 0; });
+  return results;
+}
+
+/**
+ * @brief Triggers FileProfile::AcquirePolicyAuthToken for many delegates concurrently
+ * 
+ * @param profile Profile
+ * @param cloud Azure cloud
+ * @param authDelegates Delegates to trigger, typically one CachingAuthDelegate per tenant, so that the tokens they
+ *        acquire are cached for the engines added afterwards
+ * @param maxParallel Acquisitions in flight at once, the calling thread included
+ * 
+ * @return One failure per delegate, nullptr on success, in the same order
+ * 
+ * @note The SDK does not keep the tokens, which is why the delegates should cache them. Protection tokens, which
+ *       have no profile-level trigger, are prefetched with CachingAuthDelegate::Prefetch.
+ */
+inline std::vector<std::exception_ptr> AcquirePolicyAuthTokens(
+    const std::shared_ptr<FileProfile>& profile,
+    Cloud cloud,
+    const std::vector<std::shared_ptr<AuthDelegate>>& authDelegates,
+    size_t maxParallel = 16) {
+  if (!profile) {
+    throw BadInputError("A FileProfile is required");
+  }
+  std::vector<std::exception_ptr> errors(authDelegates.size());
+  authcache::ForEachParallel(authDelegates.size(), maxParallel, profile->GetSettings().GetTaskDispatcherDelegate(),
+      [&profile, cloud, &authDelegates, &errors](size_t index) {
+        try {
+          if (!authDelegates[index]) {
+            throw BadInputError("AcquirePolicyAuthTokens requires an AuthDelegate");
+          }
+          profile->AcquirePolicyAuthToken(cloud, authDelegates[index]);
+        } catch (...) {
+          errors[index] = std::current_exception();
+        }
+      });
+  return errors;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_ENGINE_WARMUP_H_
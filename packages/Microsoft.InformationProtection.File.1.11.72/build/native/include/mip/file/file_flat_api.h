@@ -0,0 +1,768 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a flat, handle-based C ABI over FileEngine, FileHandler and ProtectionHandler
+ *
+ * @file file_flat_api.h
+ *
+ * @note The functions below let managed hosts such as ASP.NET Core call the SDK through P/Invoke without marshalling
+ *       documents into managed arrays. Content is passed as caller-pinned buffers or as caller-implemented stream
+ *       callbacks, and asynchronous operations are reported on a completion port.
+ *
+ *       The header declares the ABI for C and C++ callers. Exactly one translation unit of the native host library
+ *       defines MIP_FLAT_API_IMPLEMENTATION before including it to emit the exported definitions. Engines are still
+ *       loaded in C++, because the application delegates (auth, consent, HTTP) are native objects; the host hands
+ *       each loaded engine to the ABI with MipFlat_WrapFileEngine.
+ */
+
+#ifndef API_MIP_FILE_FILE_FLAT_API_H_
+#define API_MIP_FILE_FILE_FLAT_API_H_
+
+#include <stdint.h>
+
+#include "mip/mip_export.h"
+
+/** @cond DOXYGEN_HIDE */
+#ifndef MIP_FLAT_API
+#  if defined(MIP_FLAT_API_IMPLEMENTATION) && defined(_WIN32)
+#    define MIP_FLAT_API __declspec(dllexport)
+#  elif defined(MIP_FLAT_API_IMPLEMENTATION)
+#    define MIP_FLAT_API __attribute__((visibility("default")))
+#  else
+#    define MIP_FLAT_API
+#  endif
+#endif // MIP_FLAT_API
+/** @endcond */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Operation succeeded
+ *
+ * @note Failures reported by the SDK are 1 + the value of their mip::ErrorType.
+ */
+#define MIP_FLAT_OK 0
+/** @brief MipFlat_GetQueuedCompletion timed out before a completion was posted */
+#define MIP_FLAT_TIMEOUT (-1)
+/** @brief Operation failed with an exception that is not a mip::Error */
+#define MIP_FLAT_UNKNOWN_ERROR (-2)
+
+/** @brief Size (in bytes, including the terminator) of the error message carried by a completion */
+#define MIP_FLAT_MAX_ERROR_MESSAGE 512
+
+/** @brief Opaque handle to a FileEngine */
+typedef struct mip_flat_file_engine mip_flat_file_engine;
+/** @brief Opaque handle to a FileHandler */
+typedef struct mip_flat_file_handler mip_flat_file_handler;
+/** @brief Opaque handle to a ProtectionHandler */
+typedef struct mip_flat_protection_handler mip_flat_protection_handler;
+/** @brief Opaque handle to a completion port */
+typedef struct mip_flat_completion_port mip_flat_completion_port;
+
+/**
+ * @brief Caller-implemented stream
+ *
+ * @note The SDK calls these functions from its own threads. read or write is NULL for a stream that cannot be read
+ *       or written. release, if not NULL, is called once after the SDK drops its last reference to the stream, so
+ *       the caller can unpin buffers or free the GCHandle behind context.
+ */
+typedef struct mip_flat_stream_callbacks {
+  void* context; /**< Caller state passed to every callback */
+  int64_t (__CDECL *read)(void* context, uint8_t* buffer, int64_t bufferLength); /**< Returns bytes read */
+  int64_t (__CDECL *write)(void* context, const uint8_t* buffer, int64_t bufferLength); /**< Returns bytes written */
+  int32_t (__CDECL *flush)(void* context); /**< Returns nonzero on success */
+  void (__CDECL *seek)(void* context, int64_t position); /**< Seeks to an absolute position */
+  int64_t (__CDECL *position)(void* context); /**< Returns the current position */
+  int64_t (__CDECL *size)(void* context); /**< Returns the content size */
+  void (__CDECL *set_size)(void* context, int64_t value); /**< Sets the content size */
+  void (__CDECL *release)(void* context); /**< Called once the SDK no longer uses the stream */
+} mip_flat_stream_callbacks;
+
+/**
+ * @brief Result of one asynchronous operation
+ */
+typedef struct mip_flat_completion {
+  uint64_t key; /**< Key passed when the operation was started */
+  int32_t status; /**< MIP_FLAT_OK or a failure code */
+  int32_t committed; /**< For commits, nonzero if the output was written */
+  mip_flat_file_handler* fileHandler; /**< For handler creation, the new handler, owned by the caller */
+  char errorMessage[MIP_FLAT_MAX_ERROR_MESSAGE]; /**< Failure message, truncated and NUL-terminated */
+} mip_flat_completion;
+
+/**
+ * @brief Callback notified of a completion instead of queueing it
+ *
+ * @note Called on the SDK thread that finished the operation, one completion at a time. completion is only valid
+ *       during the call, but the callback owns its fileHandler.
+ */
+typedef void (__CDECL *mip_flat_completion_callback)(void* context, const mip_flat_completion* completion);
+
+/**
+ * @brief Creates a completion port that queues completions until MipFlat_GetQueuedCompletion dequeues them
+ *
+ * @param port [Output] New port, released with MipFlat_ReleaseCompletionPort
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_CreateCompletionPort(mip_flat_completion_port** port);
+
+/**
+ * @brief Creates a completion port that hands every completion to a callback
+ *
+ * @param callback Callback, for example one that completes a .NET TaskCompletionSource
+ * @param context Caller state passed to the callback
+ * @param port [Output] New port, released with MipFlat_ReleaseCompletionPort
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_CreateCallbackCompletionPort(
+    mip_flat_completion_callback callback,
+    void* context,
+    mip_flat_completion_port** port);
+
+/**
+ * @brief Waits for the next queued completion
+ *
+ * @param port Port created with MipFlat_CreateCompletionPort
+ * @param timeoutMs Time to wait in milliseconds, or a negative value to wait indefinitely
+ * @param completion [Output] Dequeued completion
+ *
+ * @return MIP_FLAT_OK, MIP_FLAT_TIMEOUT, or a failure code for a callback port
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_GetQueuedCompletion(
+    mip_flat_completion_port* port,
+    int64_t timeoutMs,
+    mip_flat_completion* completion);
+
+/**
+ * @brief Releases a completion port
+ *
+ * @note Operations still in flight keep the port alive, and their completions are discarded. No callback runs once
+ *       this returns.
+ */
+MIP_FLAT_API void __CDECL MipFlat_ReleaseCompletionPort(mip_flat_completion_port* port);
+
+/**
+ * @brief Releases an engine handle
+ */
+MIP_FLAT_API void __CDECL MipFlat_ReleaseFileEngine(mip_flat_file_engine* engine);
+
+/**
+ * @brief Starts creating a file handler over a caller-implemented stream
+ *
+ * @param engine Engine handle
+ * @param stream Stream callbacks. They are copied; stream->release is called once the handler no longer reads.
+ * @param actualFilePath UTF-8 path of the file, including its extension, also used for audit
+ * @param isAuditDiscoveryEnabled Nonzero if audit discovery is enabled
+ * @param port Port the completion is posted to; its fileHandler is the new handler
+ * @param key Caller key echoed in the completion
+ *
+ * @return MIP_FLAT_OK if the operation started, else a failure code and no completion is posted
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_CreateFileHandlerFromStreamAsync(
+    mip_flat_file_engine* engine,
+    const mip_flat_stream_callbacks* stream,
+    const char* actualFilePath,
+    int32_t isAuditDiscoveryEnabled,
+    mip_flat_completion_port* port,
+    uint64_t key);
+
+/**
+ * @brief Starts creating a file handler over a caller-pinned buffer
+ *
+ * @param engine Engine handle
+ * @param buffer File content. It is read in place, so it must stay pinned until the handler is released.
+ * @param bufferLength Size (in bytes) of the content
+ * @param actualFilePath UTF-8 path of the file, including its extension, also used for audit
+ * @param isAuditDiscoveryEnabled Nonzero if audit discovery is enabled
+ * @param port Port the completion is posted to; its fileHandler is the new handler
+ * @param key Caller key echoed in the completion
+ *
+ * @return MIP_FLAT_OK if the operation started, else a failure code and no completion is posted
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_CreateFileHandlerFromBufferAsync(
+    mip_flat_file_engine* engine,
+    const uint8_t* buffer,
+    int64_t bufferLength,
+    const char* actualFilePath,
+    int32_t isAuditDiscoveryEnabled,
+    mip_flat_completion_port* port,
+    uint64_t key);
+
+/**
+ * @brief Starts committing a file handler's pending changes to a caller-implemented stream
+ *
+ * @param handler Handler created by this ABI
+ * @param outputStream Stream callbacks. They are copied; outputStream->release is called once writing ends.
+ * @param port Port the completion is posted to; its committed field reports whether the output was written
+ * @param key Caller key echoed in the completion
+ *
+ * @return MIP_FLAT_OK if the operation started, else a failure code and no completion is posted
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_FileHandler_CommitAsync(
+    mip_flat_file_handler* handler,
+    const mip_flat_stream_callbacks* outputStream,
+    mip_flat_completion_port* port,
+    uint64_t key);
+
+/**
+ * @brief Gets the protection of a file
+ *
+ * @param handler Handler created by this ABI
+ * @param protectionHandler [Output] Protection handler, or NULL if the file is not protected
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_FileHandler_GetProtection(
+    mip_flat_file_handler* handler,
+    mip_flat_protection_handler** protectionHandler);
+
+/**
+ * @brief Releases a file handler handle
+ */
+MIP_FLAT_API void __CDECL MipFlat_ReleaseFileHandler(mip_flat_file_handler* handler);
+
+/**
+ * @brief Encrypts a caller-pinned buffer into another, see ProtectionHandler::EncryptBuffer
+ *
+ * @param bytesWritten [Output] Size (in bytes) of the encrypted content
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_ProtectionHandler_EncryptBuffer(
+    mip_flat_protection_handler* handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    int32_t isFinal,
+    int64_t* bytesWritten);
+
+/**
+ * @brief Decrypts a caller-pinned buffer into another, see ProtectionHandler::DecryptBuffer
+ *
+ * @param bytesWritten [Output] Size (in bytes) of the decrypted content
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_ProtectionHandler_DecryptBuffer(
+    mip_flat_protection_handler* handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    int32_t isFinal,
+    int64_t* bytesWritten);
+
+/**
+ * @brief Gets the protected size of content, see ProtectionHandler::GetProtectedContentLength
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_ProtectionHandler_GetProtectedContentLength(
+    mip_flat_protection_handler* handler,
+    int64_t unprotectedLength,
+    int32_t includesFinalBlock,
+    int64_t* protectedLength);
+
+/**
+ * @brief Gets the cipher block size, see ProtectionHandler::GetBlockSize
+ *
+ * @return MIP_FLAT_OK or a failure code
+ */
+MIP_FLAT_API int32_t __CDECL MipFlat_ProtectionHandler_GetBlockSize(
+    mip_flat_protection_handler* handler,
+    int64_t* blockSize);
+
+/**
+ * @brief Releases a protection handler handle
+ */
+MIP_FLAT_API void __CDECL MipFlat_ReleaseProtectionHandler(mip_flat_protection_handler* handler);
+
+/**
+ * @brief Copies the message of the last failure of a synchronous call on this thread
+ *
+ * @param buffer Buffer receiving the NUL-terminated, possibly truncated message
+ * @param bufferLength Size (in bytes) of the buffer
+ *
+ * @return Length of the full message, excluding the terminator
+ */
+MIP_FLAT_API int64_t __CDECL MipFlat_GetLastErrorMessage(char* buffer, int64_t bufferLength);
+
+#ifdef __cplusplus
+} // extern "C"
+
+#include <memory>
+
+#include "mip/file/file_engine.h"
+#include "mip/mip_namespace.h"
+
+/**
+ * @brief Hands an engine loaded in C++ to the flat ABI
+ *
+ * @param engine Loaded engine
+ *
+ * @return Engine handle, released with MipFlat_ReleaseFileEngine
+ */
+MIP_FLAT_API mip_flat_file_engine* MipFlat_WrapFileEngine(const std::shared_ptr<mip::FileEngine>& engine);
+
+#ifdef MIP_FLAT_API_IMPLEMENTATION
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_sync.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+
+/** @cond DOXYGEN_HIDE */
+struct mip_flat_file_engine {
+  std::shared_ptr<mip::FileEngine> engine;
+};
+
+struct mip_flat_file_handler {
+  std::shared_ptr<mip::FileHandler> handler;
+};
+
+struct mip_flat_protection_handler {
+  std::shared_ptr<mip::ProtectionHandler> handler;
+};
+
+MIP_NAMESPACE_BEGIN
+namespace flatapi {
+
+class CompletionPort {
+public:
+  CompletionPort(mip_flat_completion_callback callback, void* context) : mCallback(callback), mContext(context) {}
+
+  // Callbacks run under the lock, so none runs once Release returns
+  void Post(const mip_flat_completion& completion) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mIsReleased) {
+      delete completion.fileHandler;
+    } else if (mCallback != nullptr) {
+      mCallback(mContext, &completion);
+    } else {
+      mCompletions.push_back(completion);
+      mCondition.notify_one();
+    }
+  }
+
+  int32_t Get(int64_t timeoutMs, mip_flat_completion& completion) {
+    if (mCallback != nullptr) {
+      throw BadInputError("Completions of a callback port are not queued");
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto isReady = [this] { return !mCompletions.empty(); };
+    if (timeoutMs < 0) {
+      mCondition.wait(lock, isReady);
+    } else if (!mCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), isReady)) {
+      return MIP_FLAT_TIMEOUT;
+    }
+    completion = mCompletions.front();
+    mCompletions.pop_front();
+    return MIP_FLAT_OK;
+  }
+
+  // Handlers nobody will dequeue are released here and by Post
+  void Release() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsReleased = true;
+    for (const mip_flat_completion& completion : mCompletions) {
+      delete completion.fileHandler;
+    }
+    mCompletions.clear();
+  }
+
+private:
+  mip_flat_completion_callback mCallback;
+  void* mContext;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<mip_flat_completion> mCompletions;
+  bool mIsReleased = false;
+};
+
+inline void CopyMessage(const std::string& message, char* buffer, size_t bufferLength) {
+  if (buffer == nullptr || bufferLength == 0) {
+    return;
+  }
+  size_t length = (std::min)(message.size(), bufferLength - 1);
+  std::memcpy(buffer, message.data(), length);
+  buffer[length] = '\0';
+}
+
+inline int32_t ToStatus(const std::exception_ptr& error, std::string& message) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const Error& e) {
+    message = e.what();
+    return 1 + static_cast<int32_t>(e.GetErrorType());
+  } catch (const std::exception& e) {
+    message = e.what();
+  } catch (...) {
+    message = "Unknown error";
+  }
+  return MIP_FLAT_UNKNOWN_ERROR;
+}
+
+inline std::string& LastErrorMessage() {
+  static thread_local std::string message;
+  return message;
+}
+
+// Runs a synchronous call, translating exceptions into a status and the thread's last error
+template <typename TCall>
+inline int32_t Guard(TCall call) {
+  try {
+    call();
+    LastErrorMessage().clear();
+    return MIP_FLAT_OK;
+  } catch (...) {
+    return ToStatus(std::current_exception(), LastErrorMessage());
+  }
+}
+
+inline void RequireHandle(const void* handle, const char* name) {
+  if (handle == nullptr) {
+    throw BadInputError(std::string(name) + " must not be null");
+  }
+}
+
+// Stream over caller callbacks. Content never passes through an intermediate buffer.
+class CallbackStream : public Stream {
+public:
+  explicit CallbackStream(const mip_flat_stream_callbacks& callbacks) : mCallbacks(callbacks) {
+    if (mCallbacks.seek == nullptr || mCallbacks.position == nullptr || mCallbacks.size == nullptr) {
+      throw BadInputError("Stream callbacks must implement seek, position and size");
+    }
+    if (mCallbacks.read == nullptr && mCallbacks.write == nullptr) {
+      throw BadInputError("Stream callbacks must implement read or write");
+    }
+  }
+
+  ~CallbackStream() {
+    if (mCallbacks.release != nullptr) {
+      mCallbacks.release(mCallbacks.context);
+    }
+  }
+
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    if (mCallbacks.read == nullptr) {
+      throw NotSupportedError("Stream is not readable");
+    }
+    return mCallbacks.read(mCallbacks.context, buffer, bufferLength);
+  }
+
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    if (mCallbacks.write == nullptr) {
+      throw NotSupportedError("Stream is not writable");
+    }
+    return mCallbacks.write(mCallbacks.context, buffer, bufferLength);
+  }
+
+  bool Flush() override { return mCallbacks.flush == nullptr || mCallbacks.flush(mCallbacks.context) != 0; }
+  void Seek(int64_t position) override { mCallbacks.seek(mCallbacks.context, position); }
+  bool CanRead() const override { return mCallbacks.read != nullptr; }
+  bool CanWrite() const override { return mCallbacks.write != nullptr; }
+  int64_t Position() override { return mCallbacks.position(mCallbacks.context); }
+  int64_t Size() override { return mCallbacks.size(mCallbacks.context); }
+
+  void Size(int64_t value) override {
+    if (mCallbacks.set_size == nullptr) {
+      throw NotSupportedError("Stream size cannot be set");
+    }
+    mCallbacks.set_size(mCallbacks.context, value);
+  }
+
+private:
+  mip_flat_stream_callbacks mCallbacks;
+};
+
+// One in-flight operation. It owns itself from the moment it is handed to the SDK until its completion is posted.
+struct FlatCall : public filesync::PendingCall {
+  FlatCall(const std::shared_ptr<CompletionPort>& port, uint64_t key) : mPort(port), mKey(key) {}
+
+private:
+  void OnComplete() override {
+    mip_flat_completion completion = {};
+    completion.key = mKey;
+    if (error) {
+      std::string message;
+      completion.status = ToStatus(error, message);
+      CopyMessage(message, completion.errorMessage, sizeof(completion.errorMessage));
+    } else {
+      completion.committed = isCommitted ? 1 : 0;
+      if (handler) {
+        completion.fileHandler = new mip_flat_file_handler{std::move(handler)};
+      }
+    }
+    std::shared_ptr<CompletionPort> port = std::move(mPort);
+    delete this;
+    port->Post(completion);
+  }
+
+  std::shared_ptr<CompletionPort> mPort;
+  uint64_t mKey;
+};
+
+// Hands a FlatCall to the SDK; if the operation does not start, the call is freed and the failure returned
+template <typename TStart>
+inline int32_t StartAsync(mip_flat_completion_port* port, uint64_t key, TStart start);
+
+} // namespace flatapi
+MIP_NAMESPACE_END
+
+struct mip_flat_completion_port {
+  std::shared_ptr<mip::flatapi::CompletionPort> port;
+};
+
+MIP_NAMESPACE_BEGIN
+namespace flatapi {
+
+template <typename TStart>
+inline int32_t StartAsync(mip_flat_completion_port* port, uint64_t key, TStart start) {
+  FlatCall* call = nullptr;
+  int32_t status = Guard([&] {
+    RequireHandle(port, "port");
+    call = new FlatCall(port->port, key);
+    start(filesync::MakeContext(*call));
+  });
+  if (status != MIP_FLAT_OK) {
+    // The SDK reports failures of started operations through the observer, so a throw means it did not start
+    delete call;
+  }
+  return status;
+}
+
+} // namespace flatapi
+MIP_NAMESPACE_END
+/** @endcond */
+
+mip_flat_file_engine* MipFlat_WrapFileEngine(const std::shared_ptr<mip::FileEngine>& engine) {
+  if (!engine) {
+    throw mip::BadInputError("engine must not be null");
+  }
+  return new mip_flat_file_engine{engine};
+}
+
+extern "C" {
+
+int32_t __CDECL MipFlat_CreateCompletionPort(mip_flat_completion_port** port) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(port, "port");
+    *port = new mip_flat_completion_port{std::make_shared<mip::flatapi::CompletionPort>(nullptr, nullptr)};
+  });
+}
+
+int32_t __CDECL MipFlat_CreateCallbackCompletionPort(
+    mip_flat_completion_callback callback,
+    void* context,
+    mip_flat_completion_port** port) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(reinterpret_cast<const void*>(callback), "callback");
+    mip::flatapi::RequireHandle(port, "port");
+    *port = new mip_flat_completion_port{std::make_shared<mip::flatapi::CompletionPort>(callback, context)};
+  });
+}
+
+int32_t __CDECL MipFlat_GetQueuedCompletion(
+    mip_flat_completion_port* port,
+    int64_t timeoutMs,
+    mip_flat_completion* completion) {
+  int32_t result = MIP_FLAT_OK;
+  int32_t status = mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(port, "port");
+    mip::flatapi::RequireHandle(completion, "completion");
+    result = port->port->Get(timeoutMs, *completion);
+  });
+  return status != MIP_FLAT_OK ? status : result;
+}
+
+void __CDECL MipFlat_ReleaseCompletionPort(mip_flat_completion_port* port) {
+  if (port != nullptr) {
+    port->port->Release();
+    delete port;
+  }
+}
+
+void __CDECL MipFlat_ReleaseFileEngine(mip_flat_file_engine* engine) {
+  delete engine;
+}
+
+int32_t __CDECL MipFlat_CreateFileHandlerFromStreamAsync(
+    mip_flat_file_engine* engine,
+    const mip_flat_stream_callbacks* stream,
+    const char* actualFilePath,
+    int32_t isAuditDiscoveryEnabled,
+    mip_flat_completion_port* port,
+    uint64_t key) {
+  return mip::flatapi::StartAsync(port, key, [&](const std::shared_ptr<void>& context) {
+    mip::flatapi::RequireHandle(engine, "engine");
+    mip::flatapi::RequireHandle(stream, "stream");
+    mip::flatapi::RequireHandle(actualFilePath, "actualFilePath");
+    auto inputStream = std::make_shared<mip::flatapi::CallbackStream>(*stream);
+    engine->engine->CreateFileHandlerAsync(inputStream, actualFilePath, isAuditDiscoveryEnabled != 0,
+        mip::filesync::GetFileHandlerObserver(), context);
+  });
+}
+
+int32_t __CDECL MipFlat_CreateFileHandlerFromBufferAsync(
+    mip_flat_file_engine* engine,
+    const uint8_t* buffer,
+    int64_t bufferLength,
+    const char* actualFilePath,
+    int32_t isAuditDiscoveryEnabled,
+    mip_flat_completion_port* port,
+    uint64_t key) {
+  return mip::flatapi::StartAsync(port, key, [&](const std::shared_ptr<void>& context) {
+    mip::flatapi::RequireHandle(engine, "engine");
+    mip::flatapi::RequireHandle(buffer, "buffer");
+    mip::flatapi::RequireHandle(actualFilePath, "actualFilePath");
+    // The input stream is only read, so the buffer is never written through
+    auto inputStream = mip::CreateStreamFromBuffer(const_cast<uint8_t*>(buffer), bufferLength);
+    engine->engine->CreateFileHandlerAsync(inputStream, actualFilePath, isAuditDiscoveryEnabled != 0,
+        mip::filesync::GetFileHandlerObserver(), context);
+  });
+}
+
+int32_t __CDECL MipFlat_FileHandler_CommitAsync(
+    mip_flat_file_handler* handler,
+    const mip_flat_stream_callbacks* outputStream,
+    mip_flat_completion_port* port,
+    uint64_t key) {
+  return mip::flatapi::StartAsync(port, key, [&](const std::shared_ptr<void>& context) {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(outputStream, "outputStream");
+    handler->handler->CommitAsync(std::make_shared<mip::flatapi::CallbackStream>(*outputStream), context);
+  });
+}
+
+int32_t __CDECL MipFlat_FileHandler_GetProtection(
+    mip_flat_file_handler* handler,
+    mip_flat_protection_handler** protectionHandler) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(protectionHandler, "protectionHandler");
+    std::shared_ptr<mip::ProtectionHandler> protection = handler->handler->GetProtection();
+    *protectionHandler = protection ? new mip_flat_protection_handler{std::move(protection)} : nullptr;
+  });
+}
+
+void __CDECL MipFlat_ReleaseFileHandler(mip_flat_file_handler* handler) {
+  delete handler;
+}
+
+int32_t __CDECL MipFlat_ProtectionHandler_EncryptBuffer(
+    mip_flat_protection_handler* handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    int32_t isFinal,
+    int64_t* bytesWritten) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(bytesWritten, "bytesWritten");
+    *bytesWritten = handler->handler->EncryptBuffer(
+        offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal != 0);
+  });
+}
+
+int32_t __CDECL MipFlat_ProtectionHandler_DecryptBuffer(
+    mip_flat_protection_handler* handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    int32_t isFinal,
+    int64_t* bytesWritten) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(bytesWritten, "bytesWritten");
+    *bytesWritten = handler->handler->DecryptBuffer(
+        offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal != 0);
+  });
+}
+
+int32_t __CDECL MipFlat_ProtectionHandler_GetProtectedContentLength(
+    mip_flat_protection_handler* handler,
+    int64_t unprotectedLength,
+    int32_t includesFinalBlock,
+    int64_t* protectedLength) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(protectedLength, "protectedLength");
+    *protectedLength = handler->handler->GetProtectedContentLength(unprotectedLength, includesFinalBlock != 0);
+  });
+}
+
+int32_t __CDECL MipFlat_ProtectionHandler_GetBlockSize(
+    mip_flat_protection_handler* handler,
+    int64_t* blockSize) {
+  return mip::flatapi::Guard([&] {
+    mip::flatapi::RequireHandle(handler, "handler");
+    mip::flatapi::RequireHandle(blockSize, "blockSize");
+    *blockSize = handler->handler->GetBlockSize();
+  });
+}
+
+void __CDECL MipFlat_ReleaseProtectionHandler(mip_flat_protection_handler* handler) {
+  delete handler;
+}
+
+int64_t __CDECL MipFlat_GetLastErrorMessage(char* buffer, int64_t bufferLength) {
+  const std::string& message = mip::flatapi::LastErrorMessage();
+  if (bufferLength > 0) {
+    mip::flatapi::CopyMessage(message, buffer, static_cast<size_t>(bufferLength));
+  }
+  return static_cast<int64_t>(message.size());
+}
+
+} // extern "C"
+
+#endif // MIP_FLAT_API_IMPLEMENTATION
+
+#endif // __cplusplus
+
+#endif // API_MIP_FILE_FILE_FLAT_API_H_
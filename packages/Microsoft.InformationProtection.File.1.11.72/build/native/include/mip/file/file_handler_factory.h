@@ -0,0 +1,379 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a factory that creates file handlers synchronously and recycles their observers
+ * 
+ * @file file_handler_factory.h
+ */
+
+#ifndef API_MIP_FILE_FILE_HANDLER_FACTORY_H_
+#define API_MIP_FILE_FILE_HANDLER_FACTORY_H_
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_execution_state.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/upe/action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace filehandlerfactory {
+
+// Observer reused for consecutive handlers. It stays bound to a handler for as long as the SDK holds it.
+class RecyclableObserver : public FileHandler::Observer {
+public:
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsDone = false;
+    mHandler.reset();
+    mError = nullptr;
+    mIsCommitted = false;
+    mActions.clear();
+    mDecryptedStream.reset();
+  }
+
+  void Recycle() {
+    Reset();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBoundHandler = nullptr;
+  }
+
+  std::shared_ptr<FileHandler> WaitForHandler() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return mIsDone; });
+    if (mError) {
+      std::rethrow_exception(mError);
+    }
+    mBoundHandler = mHandler.get();
+    return std::move(mHandler);
+  }
+
+  bool WaitForCommit() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return mIsDone; });
+    if (mError) {
+      std::rethrow_exception(mError);
+    }
+    return mIsCommitted;
+  }
+
+  std::vector<std::shared_ptr<Action>> WaitForClassify() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return mIsDone; });
+    if (mError) {
+      std::rethrow_exception(mError);
+    }
+    return std::move(mActions);
+  }
+
+  std::shared_ptr<Stream> WaitForDecryptedStream() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return mIsDone; });
+    if (mError) {
+      std::rethrow_exception(mError);
+    }
+    return std::move(mDecryptedStream);
+  }
+
+  bool IsBoundTo(const FileHandler* handler) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBoundHandler == handler;
+  }
+
+  void OnCreateFileHandlerSuccess(
+      const std::shared_ptr<FileHandler>& fileHandler,
+      const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHandler = fileHandler;
+    Done();
+  }
+
+  void OnCreateFileHandlerFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mError = error;
+    Done();
+  }
+
+  void OnClassifySuccess(
+      const std::vector<std::shared_ptr<Action>>& actions,
+      const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mActions = actions;
+    Done();
+  }
+
+  void OnClassifyFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mError = error;
+    Done();
+  }
+
+  void OnGetDecryptedTemporaryStreamSuccess(
+      const std::shared_ptr<Stream>& decryptedStream,
+      const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDecryptedStream = decryptedStream;
+    Done();
+  }
+
+  void OnGetDecryptedTemporaryStreamFailure(
+      const std::exception_ptr& error,
+      const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mError = error;
+    Done();
+  }
+
+  void OnCommitSuccess(bool committed, const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsCommitted = committed;
+    Done();
+  }
+
+  void OnCommitFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mError = error;
+    Done();
+  }
+
+private:
+  void Done() {
+    mIsDone = true;
+    mCondition.notify_all();
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mIsDone = false;
+  std::shared_ptr<FileHandler> mHandler;
+  const FileHandler* mBoundHandler = nullptr;
+  std::exception_ptr mError;
+  bool mIsCommitted = false;
+  std::vector<std::shared_ptr<Action>> mActions;
+  std::shared_ptr<Stream> mDecryptedStream;
+};
+
+} // namespace filehandlerfactory
+/** @endcond */
+
+/**
+ * @brief Creates file handlers for many small files with per-file setup kept to the SDK call itself
+ * 
+ * @note Observers are recycled: once the SDK releases a handler, its observer serves the next one. The engine,
+ *       audit setting and execution state are bound once. Handlers created here deliver their callbacks to the
+ *       factory, so classify and commit them with FileHandlerFactory::Classify and FileHandlerFactory::Commit. The
+ *       factory must outlive them.
+ *       The policy handler and format parsers are owned by the handler inside the SDK and are created for each file
+ *       by FileEngine::CreateFileHandlerAsync.
+ */
+class FileHandlerFactory {
+public:
+  /**
+   * @brief FileHandlerFactory constructor
+   * 
+   * @param engine File engine
+   * @param isAuditDiscoveryEnabled Passed to FileEngine::CreateFileHandlerAsync
+   * @param fileExecutionState Execution state shared by all the handlers, or nullptr
+   */
+  FileHandlerFactory(
+      const std::shared_ptr<FileEngine>& engine,
+      bool isAuditDiscoveryEnabled = true,
+      const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr)
+      : mEngine(engine),
+        mIsAuditDiscoveryEnabled(isAuditDiscoveryEnabled),
+        mFileExecutionState(fileExecutionState) {
+    if (!mEngine) {
+      throw BadInputError("FileHandlerFactory requires an engine");
+    }
+  }
+
+  /**
+   * @brief Creates a file handler and waits for it
+   * 
+   * @param inputStream Stream containing the file data
+   * @param actualFilePath Path of the file, including its extension, also used for audit
+   * @param context Client context forwarded to FileEngine::CreateFileHandlerAsync
+   * 
+   * @return File handler. Creation failures are rethrown.
+   */
+  std::shared_ptr<FileHandler> Create(
+      const std::shared_ptr<Stream>& inputStream,
+      const std::string& actualFilePath,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = AcquireObserver();
+    mEngine->CreateFileHandlerAsync(
+        inputStream, actualFilePath, mIsAuditDiscoveryEnabled, observer, context, mFileExecutionState);
+    return observer->WaitForHandler();
+  }
+
+  /**
+   * @brief Creates a file handler for a file path and waits for it
+   * 
+   * @param inputFilePath File to open, including its extension
+   * @param actualFilePath Actual (not temporary) file path used for audit
+   * @param context Client context forwarded to FileEngine::CreateFileHandlerAsync
+   * 
+   * @return File handler. Creation failures are rethrown.
+   */
+  std::shared_ptr<FileHandler> Create(
+      const std::string& inputFilePath,
+      const std::string& actualFilePath,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = AcquireObserver();
+    mEngine->CreateFileHandlerAsync(
+        inputFilePath, actualFilePath, mIsAuditDiscoveryEnabled, observer, context, mFileExecutionState);
+    return observer->WaitForHandler();
+  }
+
+  /**
+   * @brief Classifies a handler created by this factory and waits for the resulting actions
+   * 
+   * @param handler File handler returned by Create
+   * @param context Client context forwarded to FileHandler::ClassifyAsync
+   * 
+   * @return Actions computed by the policy. Classification failures are rethrown.
+   */
+  std::vector<std::shared_ptr<Action>> Classify(
+      const std::shared_ptr<FileHandler>& handler,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = FindObserver(handler);
+    observer->Reset();
+    handler->ClassifyAsync(context);
+    return observer->WaitForClassify();
+  }
+
+  /**
+   * @brief Decrypts the content of a handler created by this factory and waits for it
+   * 
+   * @param handler File handler returned by Create
+   * @param context Client context forwarded to FileHandler::GetDecryptedTemporaryStreamAsync
+   * 
+   * @return Decrypted content. Failures are rethrown.
+   */
+  std::shared_ptr<Stream> GetDecryptedTemporaryStream(
+      const std::shared_ptr<FileHandler>& handler,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = FindObserver(handler);
+    observer->Reset();
+    handler->GetDecryptedTemporaryStreamAsync(context);
+    return observer->WaitForDecryptedStream();
+  }
+
+  /**
+   * @brief Commits a handler created by this factory and waits for it
+   * 
+   * @param handler File handler returned by Create
+   * @param outputStream Stream receiving the modified file
+   * @param context Client context forwarded to FileHandler::CommitAsync
+   * 
+   * @return true if changes were committed. Commit failures are rethrown.
+   */
+  bool Commit(
+      const std::shared_ptr<FileHandler>& handler,
+      const std::shared_ptr<Stream>& outputStream,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = FindObserver(handler);
+    observer->Reset();
+    handler->CommitAsync(outputStream, context);
+    return observer->WaitForCommit();
+  }
+
+  /**
+   * @brief Commits a handler created by this factory to a file and waits for it
+   * 
+   * @param handler File handler returned by Create
+   * @param outputFilePath File receiving the modified content
+   * @param context Client context forwarded to FileHandler::CommitAsync
+   * 
+   * @return true if changes were committed. Commit failures are rethrown.
+   */
+  bool Commit(
+      const std::shared_ptr<FileHandler>& handler,
+      const std::string& outputFilePath,
+      const std::shared_ptr<void>& context = nullptr) {
+    auto observer = FindObserver(handler);
+    observer->Reset();
+    handler->CommitAsync(outputFilePath, context);
+    return observer->WaitForCommit();
+  }
+
+  /**
+   * @brief Gets the number of observers allocated so far, which is the peak number of live handlers
+   * 
+   * @return Number of observers
+   */
+  size_t GetObserverCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mObservers.size();
+  }
+
+private:
+  std::shared_ptr<filehandlerfactory::RecyclableObserver> AcquireObserver() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& observer : mObservers) {
+      // Only the factory holding it means no handler or pending operation refers to it any more
+      if (observer.use_count() == 1) {
+        observer->Recycle();
+        return observer;
+      }
+    }
+    mObservers.push_back(std::make_shared<filehandlerfactory::RecyclableObserver>());
+    return mObservers.back();
+  }
+
+  std::shared_ptr<filehandlerfactory::RecyclableObserver> FindObserver(const std::shared_ptr<FileHandler>& handler) {
+    if (!handler) {
+      throw BadInputError("FileHandlerFactory requires a file handler");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& observer : mObservers) {
+      if (observer.use_count() > 1 && observer->IsBoundTo(handler.get())) {
+        return observer;
+      }
+    }
+    throw BadInputError("File handler was not created by this FileHandlerFactory");
+  }
+
+  std::shared_ptr<FileEngine> mEngine;
+  bool mIsAuditDiscoveryEnabled;
+  std::shared_ptr<FileExecutionState> mFileExecutionState;
+  mutable std::mutex mMutex;
+  std::vector<std::shared_ptr<filehandlerfactory::RecyclableObserver>> mObservers;
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_HANDLER_FACTORY_H_
@@ -0,0 +1,108 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a FileHandler observer that reports every failure through one error-code callback
+ * 
+ * @file file_handler_failure_observer.h
+ */
+
+#ifndef API_MIP_FILE_FILE_HANDLER_FAILURE_OBSERVER_H_
+#define API_MIP_FILE_FILE_HANDLER_FAILURE_OBSERVER_H_
+
+#include <exception>
+#include <memory>
+
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+#include "mip/result.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief FileHandler operation that failed
+ */
+enum class FileHandlerOperation : unsigned int {
+  CREATE_FILE_HANDLER,            /**< FileEngine::CreateFileHandlerAsync */
+  CLASSIFY,                       /**< FileHandler::ClassifyAsync */
+  GET_DECRYPTED_TEMPORARY_FILE,   /**< FileHandler::GetDecryptedTemporaryFileAsync */
+  GET_DECRYPTED_TEMPORARY_STREAM, /**< FileHandler::GetDecryptedTemporaryStreamAsync */
+  COMMIT,                         /**< FileHandler::CommitAsync */
+  INSPECT,                        /**< FileHandler::InspectAsync */
+};
+
+/**
+ * @brief FileHandler observer routing every failure callback to OnFailure
+ * 
+ * @note Each failure arrives as an ErrorInfo, which is only rethrown if OnFailure reads its type or message. A scan
+ *       that counts or skips failed files therefore handles them without unwinding, and one that only cares about
+ *       some error types can test ErrorInfo::Is for them. Derive from it and override the success callbacks and
+ *       OnFailure; the failure callbacks of FileHandler::Observer are final.
+ */
+class FileHandlerFailureObserver : public FileHandler::Observer {
+public:
+  /**
+   * @brief Called when any FileHandler operation fails
+   * 
+   * @param operation Operation that failed
+   * @param error Failure, classified on first inspection
+   * @param context The same context that was passed to the operation
+   */
+  virtual void OnFailure(
+      FileHandlerOperation operation,
+      const ErrorInfo& error,
+      const std::shared_ptr<void>& context) = 0;
+
+  void OnCreateFileHandlerFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) final {
+    OnFailure(FileHandlerOperation::CREATE_FILE_HANDLER, ErrorInfo(error), context);
+  }
+
+  void OnClassifyFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) final {
+    OnFailure(FileHandlerOperation::CLASSIFY, ErrorInfo(error), context);
+  }
+
+  void OnGetDecryptedTemporaryFileFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context)
+      final {
+    OnFailure(FileHandlerOperation::GET_DECRYPTED_TEMPORARY_FILE, ErrorInfo(error), context);
+  }
+
+  void OnGetDecryptedTemporaryStreamFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context)
+      final {
+    OnFailure(FileHandlerOperation::GET_DECRYPTED_TEMPORARY_STREAM, ErrorInfo(error), context);
+  }
+
+  void OnCommitFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) final {
+    OnFailure(FileHandlerOperation::COMMIT, ErrorInfo(error), context);
+  }
+
+  void OnInspectFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) final {
+    OnFailure(FileHandlerOperation::INSPECT, ErrorInfo(error), context);
+  }
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_FILE_FILE_HANDLER_FAILURE_OBSERVER_H_
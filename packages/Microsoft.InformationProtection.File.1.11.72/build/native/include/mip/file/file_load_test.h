@@ -0,0 +1,429 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a multi-tenant load test driving FileProfile, FileEngine and FileHandler
+ *
+ * @file file_load_test.h
+ */
+
+#ifndef API_MIP_FILE_FILE_LOAD_TEST_H_
+#define API_MIP_FILE_FILE_LOAD_TEST_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_profile.h"
+#include "mip/file/file_sync.h"
+#include "mip/file/labeling_options.h"
+#include "mip/file/protection_settings.h"
+#include "mip/mip_namespace.h"
+#include "mip/sdk_metrics.h"
+#include "mip/stream_utils.h"
+#include "mip/version.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Shape of a FileLoadTest run
+ *
+ * @note Tenants map to profiles round robin, so one profile per tenant models isolated caches and a single shared
+ *       profile models a multi-tenant service. Each worker repeatedly picks an engine and a sample and processes one
+ *       file: it creates a handler, reads the label and, if labelId is set, applies it and commits to memory.
+ */
+struct FileLoadTestSettings {
+  std::vector<std::shared_ptr<FileProfile>> profiles; /**< Profiles loaded with a SyncFileProfileObserver */
+  int tenantCount = 1;                                /**< N: number of tenants */
+  int enginesPerTenant = 1;                           /**< M: engines added per tenant */
+  int concurrentFiles = 8;                            /**< K: workers, each processing one file at a time */
+  std::chrono::seconds duration{60};                  /**< Length of the measured phase */
+  /** @brief Settings of engine @p engine of tenant @p tenant, e.g. with a per-tenant identity and auth delegate */
+  std::function<FileEngine::Settings(int tenant, int engine)> engineSettings;
+  std::vector<std::pair<std::string, std::vector<uint8_t>>> samples; /**< Sample files: path (for the format) and content */
+  std::string labelId;                                /**< Label applied to every file, or empty to only read labels */
+  std::shared_ptr<SdkMetricsRegistry> metrics;        /**< Registry whose cache counters give hit rates, or nullptr */
+};
+
+/**
+ * @brief Latency distribution of one stage, in milliseconds
+ */
+struct FileLoadTestLatency {
+  uint64_t count = 0; /**< Completed operations */
+  uint64_t failureCount = 0; /**< Failed operations, not included in the percentiles */
+  double p50 = 0; /**< Median */
+  double p90 = 0; /**< 90th percentile */
+  double p99 = 0; /**< 99th percentile */
+  double max = 0; /**< Slowest operation */
+};
+
+/**
+ * @brief Results of a FileLoadTest run
+ */
+struct FileLoadTestReport {
+  double durationSeconds = 0; /**< Length of the measured phase */
+  uint64_t filesCompleted = 0; /**< Files processed without failure */
+  uint64_t filesFailed = 0; /**< Files that failed at any stage */
+  double filesPerSecond = 0; /**< Completed files per second */
+  std::map<std::string, FileLoadTestLatency> stages; /**< Latency per stage: AddEngine, CreateFileHandler, GetLabel, SetLabel, Commit, File */
+  int64_t peakMemoryBytes = -1; /**< Peak resident memory of the process, or -1 if unknown */
+  int64_t peakThreadCount = -1; /**< Highest sampled thread count of the process, or -1 if unknown */
+  std::map<std::string, double> cacheHitRates; /**< Hit rate per cache, from "<name>_hits_total"/"<name>_misses_total" */
+  std::map<std::string, uint64_t> failures; /**< Failure count per error name */
+
+  /**
+   * @brief Writes the report as a JSON document tagged with the SDK version
+   *
+   * @param output Stream receiving the document
+   */
+  void WriteJson(std::ostream& output) const {
+    output << "{\n  \"sdkVersion\": \"" << VER_FILE_VERSION_STR << "\",\n  \"durationSeconds\": " << durationSeconds
+           << ",\n  \"filesCompleted\": " << filesCompleted << ",\n  \"filesFailed\": " << filesFailed
+           << ",\n  \"filesPerSecond\": " << filesPerSecond << ",\n  \"peakMemoryBytes\": " << peakMemoryBytes
+           << ",\n  \"peakThreadCount\": " << peakThreadCount << ",\n  \"stages\": {";
+    const char* separator = "\n";
+    for (const auto& stage : stages) {
+      output << separator << "    \"" << stage.first << "\": {\"count\": " << stage.second.count
+             << ", \"failures\": " << stage.second.failureCount << ", \"p50Ms\": " << stage.second.p50
+             << ", \"p90Ms\": " << stage.second.p90 << ", \"p99Ms\": " << stage.second.p99
+             << ", \"maxMs\": " << stage.second.max << "}";
+      separator = ",\n";
+    }
+    output << "\n  },\n  \"cacheHitRates\": {";
+    separator = "\n";
+    for (const auto& cache : cacheHitRates) {
+      output << separator << "    \"" << cache.first << "\": " << cache.second;
+      separator = ",\n";
+    }
+    output << "\n  },\n  \"failures\": {";
+    separator = "\n";
+    for (const auto& failure : failures) {
+      output << separator << "    \"" << failure.first << "\": " << failure.second;
+      separator = ",\n";
+    }
+    output << "\n  }\n}\n";
+  }
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace fileloadtest {
+
+inline int64_t GetPeakMemoryBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return static_cast<int64_t>(counters.PeakWorkingSetSize);
+  }
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+#ifdef __APPLE__
+  return static_cast<int64_t>(usage.ru_maxrss);
+#else
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+inline int64_t GetThreadCount() {
+#ifdef _WIN32
+  HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+  if (snapshot == INVALID_HANDLE_VALUE) {
+    return -1;
+  }
+  int64_t count = 0;
+  THREADENTRY32 entry;
+  entry.dwSize = sizeof(entry);
+  for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry)) {
+    if (entry.th32OwnerProcessID == GetCurrentProcessId()) {
+      ++count;
+    }
+  }
+  CloseHandle(snapshot);
+  return count;
+#elif defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 8, "Threads:") == 0) {
+      return std::stoll(line.substr(8));
+    }
+  }
+  return -1;
+#else
+  return -1;
+#endif
+}
+
+// Nearest-rank percentile over sorted samples
+inline double Percentile(const std::vector<double>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sorted.size()) + 0.999999);
+  return sorted[(std::min)((std::max)(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+}
+
+// Samples recorded by one worker; merged once the run ends, so recording takes no lock
+struct StageSamples {
+  std::map<std::string, std::vector<double>> durationsMs;
+  std::map<std::string, uint64_t> stageFailures;
+  std::map<std::string, uint64_t> errors;
+  uint64_t filesCompleted = 0;
+  uint64_t filesFailed = 0;
+};
+
+class StageTimer {
+public:
+  StageTimer(StageSamples& samples, const char* stage)
+      : mSamples(samples), mStage(stage), mStart(std::chrono::steady_clock::now()) {}
+
+  void Succeeded() {
+    mSamples.durationsMs[mStage].push_back(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count());
+  }
+
+  void Failed(const std::string& errorName) {
+    ++mSamples.stageFailures[mStage];
+    ++mSamples.errors[errorName];
+  }
+
+private:
+  StageSamples& mSamples;
+  const char* mStage;
+  std::chrono::steady_clock::time_point mStart;
+};
+
+template <typename TOperation>
+inline bool RunStage(StageSamples& samples, const char* stage, TOperation operation) {
+  StageTimer timer(samples, stage);
+  try {
+    operation();
+    timer.Succeeded();
+    return true;
+  } catch (const Error& error) {
+    timer.Failed(error.GetErrorName());
+  } catch (const std::exception&) {
+    timer.Failed("std::exception");
+  }
+  return false;
+}
+
+inline void AddCacheHitRates(const std::vector<SdkMetricSample>& metrics, std::map<std::string, double>& rates) {
+  std::map<std::string, std::pair<double, double>> counts;
+  const std::string hits = "_hits_total";
+  const std::string misses = "_misses_total";
+  for (const SdkMetricSample& sample : metrics) {
+    std::string labels;
+    for (const auto& label : sample.labels) {
+      labels += (labels.empty() ? "{" : ",") + label.first + "=" + label.second;
+    }
+    labels += labels.empty() ? "" : "}";
+    const std::string& name = sample.name;
+    if (name.size() > hits.size() && name.compare(name.size() - hits.size(), hits.size(), hits) == 0) {
+      counts[name.substr(0, name.size() - hits.size()) + labels].first += sample.value;
+    } else if (name.size() > misses.size() &&
+               name.compare(name.size() - misses.size(), misses.size(), misses) == 0) {
+      counts[name.substr(0, name.size() - misses.size()) + labels].second += sample.value;
+    }
+  }
+  for (const auto& cache : counts) {
+    double total = cache.second.first + cache.second.second;
+    if (total > 0) {
+      rates[cache.first] = cache.second.first / total;
+    }
+  }
+}
+
+} // namespace fileloadtest
+/** @endcond */
+
+/**
+ * @brief Runs a multi-tenant load test: N tenants x M engines x K concurrent files
+ *
+ * @param settings Shape of the run
+ *
+ * @return Report with throughput, stage latency percentiles, peak memory, peak thread count and cache hit rates
+ *
+ * @note Engines are added first and timed as the AddEngine stage; the measured phase starts once all are loaded.
+ *       Point the profiles' MipConfiguration at a SimulatedHttpDelegate to run against a fake service with chosen
+ *       latency and error rates. A thread samples the process thread count every 100 ms, so dispatcher growth and
+ *       thread leaks show up next to latency; comparing runs with growing K exposes the point where throughput stops
+ *       scaling and p99 climbs, i.e. lock contention or dispatcher saturation.
+ */
+inline FileLoadTestReport RunFileLoadTest(const FileLoadTestSettings& settings) {
+  if (settings.profiles.empty() || !settings.engineSettings || settings.samples.empty()) {
+    throw BadInputError("File load test requires profiles, engine settings and samples");
+  }
+  if (settings.tenantCount <= 0 || settings.enginesPerTenant <= 0 || settings.concurrentFiles <= 0) {
+    throw BadInputError("File load test requires positive tenant, engine and concurrency counts");
+  }
+
+  FileLoadTestReport report;
+  std::atomic<int64_t> peakThreadCount(fileloadtest::GetThreadCount());
+  std::atomic<bool> isDone(false);
+  std::mutex samplerMutex;
+  std::condition_variable samplerCondition;
+  std::thread sampler([&]() {
+    std::unique_lock<std::mutex> lock(samplerMutex);
+    while (!samplerCondition.wait_for(lock, std::chrono::milliseconds(100), [&] { return isDone.load(); })) {
+      int64_t count = fileloadtest::GetThreadCount();
+      int64_t peak = peakThreadCount;
+      while (count > peak && !peakThreadCount.compare_exchange_weak(peak, count)) {
+      }
+    }
+  });
+
+  fileloadtest::StageSamples setupSamples;
+  std::vector<std::shared_ptr<FileEngine>> engines;
+  for (int tenant = 0; tenant < settings.tenantCount; ++tenant) {
+    const auto& profile = settings.profiles[static_cast<size_t>(tenant) % settings.profiles.size()];
+    for (int engine = 0; engine < settings.enginesPerTenant; ++engine) {
+      fileloadtest::RunStage(setupSamples, "AddEngine", [&]() {
+        engines.push_back(AddFileEngine(profile, settings.engineSettings(tenant, engine)));
+      });
+    }
+  }
+
+  std::vector<fileloadtest::StageSamples> workerSamples(static_cast<size_t>(settings.concurrentFiles));
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + settings.duration;
+  if (!engines.empty()) {
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < settings.concurrentFiles; ++worker) {
+      workers.emplace_back([&, worker]() {
+        fileloadtest::StageSamples& samples = workerSamples[static_cast<size_t>(worker)];
+        for (size_t iteration = static_cast<size_t>(worker); std::chrono::steady_clock::now() < deadline;
+             iteration += static_cast<size_t>(settings.concurrentFiles)) {
+          const auto& engine = engines[iteration % engines.size()];
+          const auto& sample = settings.samples[iteration % settings.samples.size()];
+          fileloadtest::StageTimer file(samples, "File");
+          std::shared_ptr<FileHandler> handler;
+          auto input = CreateStreamFromBuffer(const_cast<uint8_t*>(sample.second.data()),
+              static_cast<int64_t>(sample.second.size()));
+          bool succeeded =
+              fileloadtest::RunStage(samples, "CreateFileHandler", [&]() {
+                handler = CreateFileHandler(engine, input, sample.first, false);
+              }) &&
+              fileloadtest::RunStage(samples, "GetLabel", [&]() { handler->GetLabel(); });
+          if (succeeded && !settings.labelId.empty()) {
+            succeeded =
+                fileloadtest::RunStage(samples, "SetLabel", [&]() {
+                  handler->SetLabel(engine->GetLabelById(settings.labelId),
+                      LabelingOptions(AssignmentMethod::STANDARD), ProtectionSettings());
+                }) &&
+                fileloadtest::RunStage(samples, "Commit", [&]() {
+                  auto output = std::make_shared<std::stringstream>();
+                  CommitFile(handler, CreateStreamFromStdStream(std::static_pointer_cast<std::iostream>(output)));
+                });
+          }
+          if (succeeded) {
+            file.Succeeded();
+            ++samples.filesCompleted;
+          } else {
+            ++samples.filesFailed;
+          }
+        }
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+  report.durationSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  {
+    std::lock_guard<std::mutex> lock(samplerMutex);
+    isDone = true;
+  }
+  samplerCondition.notify_all();
+  sampler.join();
+
+  workerSamples.push_back(std::move(setupSamples));
+  std::map<std::string, std::vector<double>> durations;
+  for (const fileloadtest::StageSamples& samples : workerSamples) {
+    for (const auto& stage : samples.durationsMs) {
+      durations[stage.first].insert(durations[stage.first].end(), stage.second.begin(), stage.second.end());
+    }
+    for (const auto& stage : samples.stageFailures) {
+      report.stages[stage.first].failureCount += stage.second;
+    }
+    for (const auto& error : samples.errors) {
+      report.failures[error.first] += error.second;
+    }
+    report.filesCompleted += samples.filesCompleted;
+    report.filesFailed += samples.filesFailed;
+  }
+  for (auto& stage : durations) {
+    std::sort(stage.second.begin(), stage.second.end());
+    FileLoadTestLatency& latency = report.stages[stage.first];
+    latency.count = stage.second.size();
+    latency.p50 = fileloadtest::Percentile(stage.second, 50);
+    latency.p90 = fileloadtest::Percentile(stage.second, 90);
+    latency.p99 = fileloadtest::Percentile(stage.second, 99);
+    latency.max = stage.second.empty() ? 0 : stage.second.back();
+  }
+  report.filesPerSecond = report.durationSeconds > 0 ? report.filesCompleted / report.durationSeconds : 0;
+  report.peakMemoryBytes = fileloadtest::GetPeakMemoryBytes();
+  report.peakThreadCount = peakThreadCount;
+  if (settings.metrics) {
+    fileloadtest::AddCacheHitRates(settings.metrics->Collect(), report.cacheHitRates);
+  }
+  return report;
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_FILE_FILE_LOAD_TEST_H_
@@ -0,0 +1,251 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines FileStageTimer, which reports per-stage timings of FileHandler operations to a MetricsDelegate
+ * 
+ * @file file_stage_timing.h
+ */
+
+#ifndef API_MIP_FILE_FILE_STAGE_TIMING_H_
+#define API_MIP_FILE_FILE_STAGE_TIMING_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_execution_state.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_sync.h"
+#include "mip/metrics_delegate.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/upe/action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Runs FileHandler operations synchronously and reports where their time went
+ * 
+ * @note Each operation reports its own stage with its total duration, plus I/O stages measured on the streams the
+ *       timer wraps:
+ *       - "Open": CreateFileHandler, with "InputRead" for the input stream reads it made (parse)
+ *       - "ComputeActions": Classify
+ *       - "SetLabel", "DeleteLabel", "SetProtection", "RemoveProtection": metadata and protection changes, the last
+ *         two including protection handler creation
+ *       - "Decrypt": GetDecryptedTemporaryStream, with the decrypted size as bytes
+ *       - "Commit", with "InputRead", "OutputWrite" and "OutputFlush" for its stream I/O, and "Processing" for the
+ *         remainder (encryption, decryption and container rewrite performed inside the SDK)
+ *       Every metric carries the logger context given to the timer. One timer serves one file at a time.
+ */
+class FileStageTimer {
+public:
+  /**
+   * @brief FileStageTimer constructor
+   * 
+   * @param metricsDelegate Delegate receiving the stage timings
+   * @param loggerContext Logger context passed to the SDK for this file, copied onto every metric
+   */
+  FileStageTimer(const std::shared_ptr<MetricsDelegate>& metricsDelegate, const std::shared_ptr<void>& loggerContext)
+      : mMetricsDelegate(metricsDelegate),
+        mLoggerContext(loggerContext) {
+    if (!mMetricsDelegate) {
+      throw BadInputError("FileStageTimer requires a metrics delegate");
+    }
+  }
+
+  /**
+   * @brief Creates a file handler over a timed view of the input stream
+   * 
+   * @param engine File engine
+   * @param inputStream Stream containing the file data
+   * @param actualFilePath Path of the file, including its extension, also used for audit
+   * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+   * @param fileExecutionState Execution state, or nullptr
+   * 
+   * @return File handler reading through the timed input stream. Failures are rethrown after the stage is reported.
+   */
+  std::shared_ptr<FileHandler> CreateFileHandler(
+      const std::shared_ptr<FileEngine>& engine,
+      const std::shared_ptr<Stream>& inputStream,
+      const std::string& actualFilePath,
+      bool isAuditDiscoveryEnabled = true,
+      const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr) {
+    mInputStream = std::make_shared<TimingStream>(inputStream);
+    auto readStart = mInputStream->GetReadDuration();
+    int64_t bytesStart = mInputStream->GetBytesRead();
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto handler = mip::CreateFileHandler(
+          engine, mInputStream, actualFilePath, isAuditDiscoveryEnabled, fileExecutionState);
+      ReportInputRead("Open", readStart, bytesStart);
+      Report("Open", "Open", start, mInputStream->GetBytesRead() - bytesStart);
+      return handler;
+    } catch (...) {
+      ReportInputRead("Open", readStart, bytesStart);
+      Report("Open", "Open", start, mInputStream->GetBytesRead() - bytesStart);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Classifies a file and reports the "ComputeActions" stage
+   * 
+   * @param handler File handler
+   * 
+   * @return Actions computed by the policy. Failures are rethrown after the stage is reported.
+   */
+  std::vector<std::shared_ptr<Action>> Classify(const std::shared_ptr<FileHandler>& handler) {
+    return Measure("ComputeActions", [&]() { return ClassifyFile(handler); });
+  }
+
+  /**
+   * @brief Decrypts a file to a temporary stream and reports the "Decrypt" stage
+   * 
+   * @param handler File handler
+   * 
+   * @return Decrypted content. Failures are rethrown after the stage is reported.
+   */
+  std::shared_ptr<Stream> GetDecryptedTemporaryStream(const std::shared_ptr<FileHandler>& handler) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Stream> stream;
+    try {
+      stream = mip::GetDecryptedTemporaryStream(handler);
+    } catch (...) {
+      Report("Decrypt", "Decrypt", start, 0);
+      throw;
+    }
+    Report("Decrypt", "Decrypt", start, stream ? stream->Size() : 0);
+    return stream;
+  }
+
+  /**
+   * @brief Commits a file to a timed view of the output stream and reports the commit stages
+   * 
+   * @param handler File handler, preferably created by this timer so that input reads are attributed
+   * @param outputStream Stream receiving the modified file
+   * 
+   * @return true if changes were committed. Failures are rethrown after the stages are reported.
+   */
+  bool Commit(const std::shared_ptr<FileHandler>& handler, const std::shared_ptr<Stream>& outputStream) {
+    auto timedOutput = std::make_shared<TimingStream>(outputStream);
+    auto readStart = mInputStream ? mInputStream->GetReadDuration() : std::chrono::nanoseconds(0);
+    int64_t bytesStart = mInputStream ? mInputStream->GetBytesRead() : 0;
+    auto start = std::chrono::steady_clock::now();
+    bool isCommitted = false;
+    try {
+      isCommitted = CommitFile(handler, timedOutput);
+    } catch (...) {
+      ReportCommit(*timedOutput, start, readStart, bytesStart);
+      throw;
+    }
+    ReportCommit(*timedOutput, start, readStart, bytesStart);
+    return isCommitted;
+  }
+
+  /**
+   * @brief Runs a synchronous step, e.g. FileHandler::SetLabel, and reports it as a stage
+   * 
+   * @param stage Stage name, also used as the operation name
+   * @param step Function to run
+   * 
+   * @return The value returned by step. Failures are rethrown after the stage is reported.
+   */
+  template <typename TStep>
+  auto Measure(const std::string& stage, TStep step) -> decltype(step()) {
+    StageClock clock(*this, stage);
+    return step();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  class StageClock {
+  public:
+    StageClock(FileStageTimer& timer, const std::string& stage)
+        : mTimer(timer), mStage(stage), mStart(std::chrono::steady_clock::now()) {}
+    ~StageClock() {
+      try {
+        mTimer.Report(mStage, mStage, mStart, 0);
+      } catch (...) {
+        // Metrics are best effort and must not turn into a second exception during unwinding
+      }
+    }
+
+  private:
+    FileStageTimer& mTimer;
+    std::string mStage;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  void Report(const std::string& operation, const std::string& stage, std::chrono::nanoseconds duration,
+      int64_t bytes) {
+    StageMetric metric;
+    metric.operation = operation;
+    metric.stage = stage;
+    metric.duration = duration;
+    metric.bytes = bytes;
+    metric.loggerContext = mLoggerContext;
+    mMetricsDelegate->OnStageCompleted(metric);
+  }
+
+  void Report(const std::string& operation, const std::string& stage, std::chrono::steady_clock::time_point start,
+      int64_t bytes) {
+    Report(operation, stage,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start), bytes);
+  }
+
+  std::chrono::nanoseconds ReportInputRead(const std::string& operation, std::chrono::nanoseconds readStart,
+      int64_t bytesStart) {
+    if (!mInputStream) {
+      return std::chrono::nanoseconds(0);
+    }
+    auto duration = mInputStream->GetReadDuration() - readStart;
+    Report(operation, "InputRead", duration, mInputStream->GetBytesRead() - bytesStart);
+    return duration;
+  }
+
+  void ReportCommit(const TimingStream& output, std::chrono::steady_clock::time_point start,
+      std::chrono::nanoseconds readStart, int64_t bytesStart) {
+    auto total = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    auto io = ReportInputRead("Commit", readStart, bytesStart) + output.GetWriteDuration() + output.GetFlushDuration();
+    Report("Commit", "OutputWrite", output.GetWriteDuration(), output.GetBytesWritten());
+    Report("Commit", "OutputFlush", output.GetFlushDuration(), 0);
+    Report("Commit", "Processing", total > io ? total - io : std::chrono::nanoseconds(0), 0);
+    Report("Commit", "Commit", total, output.GetBytesWritten());
+  }
+
+  std::shared_ptr<MetricsDelegate> mMetricsDelegate;
+  std::shared_ptr<void> mLoggerContext;
+  std::shared_ptr<TimingStream> mInputStream;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_STAGE_TIMING_H_
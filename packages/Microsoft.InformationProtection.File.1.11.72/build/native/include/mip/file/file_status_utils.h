@@ -0,0 +1,108 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines bounded-read variants of the FileHandler status checks
+ * 
+ * @file file_status_utils.h
+ */
+
+#ifndef API_MIP_FILE_FILE_STATUS_UTILS_H_
+#define API_MIP_FILE_FILE_STATUS_UTILS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mip/buffered_stream.h"
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_status.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/read_budget_stream.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Result of a status check made with a read budget
+ */
+struct BoundedFileStatus {
+  bool isProtected = false;              /**< If the file is protected; only meaningful when isDefinitive is true */
+  bool isLabeled = false;                /**< If the file is labeled; only meaningful when isDefinitive is true */
+  bool containsProtectedObjects = false; /**< If an unprotected container holds protected objects */
+  int64_t bytesRead = 0;                 /**< Bytes read from the input stream */
+  bool isDefinitive = false;             /**< False if the read budget ran out before the status was known */
+};
+
+/**
+ * @brief Get the labeled/protected status of a file, reading at most a given number of bytes
+ * 
+ * @param stream Stream containing file data to check
+ * @param filePath File path associated with data in @p stream
+ * @param mipContext Global MIP context
+ * @param maxBytesToRead Maximum number of bytes read from @p stream
+ * @param readBlockSize Reads from @p stream are made in blocks of this size, then served from memory
+ * @param loggerContext Logger context that will be opaquely passed to the logger delegate
+ * 
+ * @return Status, with the number of bytes read and whether the answer is definitive
+ * 
+ * @note Format detection issues many small, scattered reads (for example the ZIP end of central directory of OPC
+ *       files, or the sector tables of OLE files). Serving them from @p readBlockSize blocks keeps the number of
+ *       round trips to remote storage low, while the budget bounds the total transferred. When the budget runs out,
+ *       the result is not definitive and the caller can fall back to FileHandler::GetFileStatus without one.
+ *       Failures other than the budget running out are rethrown.
+ */
+inline BoundedFileStatus GetFileStatusWithReadBudget(
+    const std::shared_ptr<Stream>& stream,
+    const std::string& filePath,
+    const std::shared_ptr<MipContext>& mipContext,
+    int64_t maxBytesToRead,
+    int64_t readBlockSize = 16 * 1024,
+    const std::shared_ptr<void>& loggerContext = nullptr) {
+  auto budgetStream = std::make_shared<ReadBudgetStream>(stream, maxBytesToRead);
+  auto bufferedStream = std::make_shared<BufferedStream>(budgetStream, readBlockSize, 0);
+  BoundedFileStatus result;
+  try {
+    auto status = FileHandler::GetFileStatus(bufferedStream, filePath, mipContext, loggerContext);
+    if (status) {
+      result.isProtected = status->IsProtected();
+      result.isLabeled = status->IsLabeled();
+      result.containsProtectedObjects = status->ContainsProtectedObjects();
+      result.isDefinitive = true;
+    }
+  } catch (...) {
+    if (!budgetStream->IsBudgetExceeded()) {
+      throw;
+    }
+  }
+  result.bytesRead = budgetStream->GetBytesRead();
+  return result;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_STATUS_UTILS_H_
@@ -0,0 +1,683 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines synchronous counterparts of the FileProfile, FileEngine and FileHandler async operations
+ * 
+ * @file file_sync.h
+ */
+
+#ifndef API_MIP_FILE_FILE_SYNC_H_
+#define API_MIP_FILE_FILE_SYNC_H_
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_execution_state.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_inspector.h"
+#include "mip/file/file_profile.h"
+#include "mip/mip_namespace.h"
+#include "mip/result.h"
+#include "mip/stream.h"
+#include "mip/upe/action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace filesync {
+
+// Result of one pending operation. The context handed to the SDK points at it, and the observers fill it in.
+struct PendingCall {
+  std::exception_ptr error;
+  std::shared_ptr<FileProfile> profile;
+  std::shared_ptr<FileEngine> engine;
+  std::shared_ptr<FileHandler> handler;
+  std::shared_ptr<FileInspector> inspector;
+  std::shared_ptr<Stream> stream;
+  std::vector<std::string> engineIds;
+  std::vector<std::shared_ptr<Action>> actions;
+  std::string filePath;
+  bool isCommitted = false;
+
+  template <typename TSetter>
+  void Complete(TSetter setter) {
+    setter(*this);
+    OnComplete();
+  }
+
+  void Fail(const std::exception_ptr& failure) {
+    Complete([&failure](PendingCall& call) { call.error = failure; });
+  }
+
+protected:
+  ~PendingCall() {}
+
+  // Called once, after the result is set. The call may be destroyed as soon as this signals the waiter.
+  virtual void OnComplete() = 0;
+};
+
+// State of one synchronous call. It lives on the caller's stack.
+struct SyncCall : public PendingCall {
+  void Wait() {
+    WaitNoThrow();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // Waits without rethrowing, for the Try* functions
+  const std::exception_ptr& WaitNoThrow() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return mIsDone; });
+    return error;
+  }
+
+private:
+  void OnComplete() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsDone = true;
+    mCondition.notify_all();
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mIsDone = false;
+};
+
+// Contexts of pending calls share this owner, so observers can tell them from application contexts without
+// an allocation per call
+inline const std::shared_ptr<void>& GetContextOwner() {
+  static const std::shared_ptr<void> owner = std::make_shared<int>(0);
+  return owner;
+}
+
+inline std::shared_ptr<void> MakeContext(PendingCall& call) {
+  return std::shared_ptr<void>(GetContextOwner(), &call);
+}
+
+inline PendingCall* GetCall(const std::shared_ptr<void>& context) {
+  const std::shared_ptr<void>& owner = GetContextOwner();
+  if (!context || context.owner_before(owner) || owner.owner_before(context)) {
+    return nullptr;
+  }
+  return static_cast<PendingCall*>(context.get());
+}
+
+} // namespace filesync
+/** @endcond */
+
+/**
+ * @brief FileProfile observer that completes the synchronous profile operations
+ * 
+ * @note Set it, or a class derived from it, as the FileProfile::Settings observer to use LoadFileProfile,
+ *       AddFileEngine, ListFileEngines, UnloadFileEngine and their awaitable counterparts. Callbacks of other calls are ignored, so a derived class
+ *       that overrides a callback must call the base implementation.
+ */
+class SyncFileProfileObserver : public FileProfile::Observer {
+public:
+  void OnLoadSuccess(const std::shared_ptr<FileProfile>& profile, const std::shared_ptr<void>& context) override {
+    if (auto call = filesync::GetCall(context)) {
+      call->Complete([&profile](filesync::PendingCall& c) { c.profile = profile; });
+    }
+  }
+
+  void OnLoadFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnListEnginesSuccess(const std::vector<std::string>& engineIds, const std::shared_ptr<void>& context) override {
+    if (auto call = filesync::GetCall(context)) {
+      call->Complete([&engineIds](filesync::PendingCall& c) { c.engineIds = engineIds; });
+    }
+  }
+
+  void OnListEnginesFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnUnloadEngineSuccess(const std::shared_ptr<void>& context) override {
+    if (auto call = filesync::GetCall(context)) {
+      call->Complete([](filesync::PendingCall&) {});
+    }
+  }
+
+  void OnUnloadEngineFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnAddEngineSuccess(const std::shared_ptr<FileEngine>& engine, const std::shared_ptr<void>& context) override {
+    if (auto call = filesync::GetCall(context)) {
+      call->Complete([&engine](filesync::PendingCall& c) { c.engine = engine; });
+    }
+  }
+
+  void OnAddEngineFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static void Fail(const std::exception_ptr& error, const std::shared_ptr<void>& context) {
+    if (auto call = filesync::GetCall(context)) {
+      call->Fail(error);
+    }
+  }
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace filesync {
+
+// Stateless, so one instance serves every handler created by CreateFileHandler or CreateFileHandlerAwaitable
+class SyncFileHandlerObserver : public FileHandler::Observer {
+public:
+  void OnCreateFileHandlerSuccess(
+      const std::shared_ptr<FileHandler>& fileHandler,
+      const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([&fileHandler](PendingCall& c) { c.handler = fileHandler; });
+    }
+  }
+
+  void OnCreateFileHandlerFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnClassifySuccess(
+      const std::vector<std::shared_ptr<Action>>& actions,
+      const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([&actions](PendingCall& c) { c.actions = actions; });
+    }
+  }
+
+  void OnClassifyFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnGetDecryptedTemporaryFileSuccess(
+      const std::string& decryptedFilePath,
+      const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([&decryptedFilePath](PendingCall& c) { c.filePath = decryptedFilePath; });
+    }
+  }
+
+  void OnGetDecryptedTemporaryFileFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context)
+      override {
+    Fail(error, context);
+  }
+
+  void OnGetDecryptedTemporaryStreamSuccess(
+      const std::shared_ptr<Stream>& decryptedStream,
+      const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([&decryptedStream](PendingCall& c) { c.stream = decryptedStream; });
+    }
+  }
+
+  void OnGetDecryptedTemporaryStreamFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context)
+      override {
+    Fail(error, context);
+  }
+
+  void OnCommitSuccess(bool committed, const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([committed](PendingCall& c) { c.isCommitted = committed; });
+    }
+  }
+
+  void OnCommitFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+  void OnInspectSuccess(
+      const std::shared_ptr<FileInspector>& fileInspector,
+      const std::shared_ptr<void>& context) override {
+    if (auto call = GetCall(context)) {
+      call->Complete([&fileInspector](PendingCall& c) { c.inspector = fileInspector; });
+    }
+  }
+
+  void OnInspectFailure(const std::exception_ptr& error, const std::shared_ptr<void>& context) override {
+    Fail(error, context);
+  }
+
+private:
+  static void Fail(const std::exception_ptr& error, const std::shared_ptr<void>& context) {
+    if (auto call = GetCall(context)) {
+      call->Fail(error);
+    }
+  }
+};
+
+inline const std::shared_ptr<SyncFileHandlerObserver>& GetFileHandlerObserver() {
+  static const std::shared_ptr<SyncFileHandlerObserver> observer = std::make_shared<SyncFileHandlerObserver>();
+  return observer;
+}
+
+inline void RequireSyncProfileObserver(const FileProfile::Settings& settings) {
+  if (!std::dynamic_pointer_cast<SyncFileProfileObserver>(settings.GetObserver())) {
+    throw BadInputError("Synchronous profile operations require a SyncFileProfileObserver");
+  }
+}
+
+// Starts the operation with a context pointing at a stack call, then waits for its callback
+template <typename TStart>
+inline void Run(SyncCall& call, TStart start) {
+  start(MakeContext(call));
+  call.Wait();
+}
+
+// Like Run, but returns the failure instead of rethrowing it. Invalid arguments rejected before the SDK is called
+// are still thrown.
+template <typename TStart>
+inline ErrorInfo TryRun(SyncCall& call, TStart start) {
+  start(MakeContext(call));
+  return ErrorInfo(call.WaitNoThrow());
+}
+
+} // namespace filesync
+/** @endcond */
+
+/**
+ * @brief Loads a profile and waits for it
+ * 
+ * @param settings Profile settings, whose observer must be a SyncFileProfileObserver
+ * 
+ * @return Profile. Failures are rethrown.
+ * 
+ * @note The synchronous functions in this file block the calling thread until the SDK reports completion. The SDK
+ *       still completes on its own threads, but no promise or observer is allocated per call: the call state lives
+ *       on the caller's stack. The SDK also forwards that context to the application's delegates, such as
+ *       HttpDelegate, so they must not assume a context type for these calls.
+ */
+inline std::shared_ptr<FileProfile> LoadFileProfile(const FileProfile::Settings& settings) {
+  filesync::RequireSyncProfileObserver(settings);
+  filesync::SyncCall call;
+  filesync::Run(call, [&settings](const std::shared_ptr<void>& context) { FileProfile::LoadAsync(settings, context); });
+  return std::move(call.profile);
+}
+
+/**
+ * @brief Adds an engine to a profile and waits for it
+ * 
+ * @param profile Profile loaded with a SyncFileProfileObserver
+ * @param settings Engine settings
+ * 
+ * @return Engine. Failures are rethrown.
+ */
+inline std::shared_ptr<FileEngine> AddFileEngine(
+    const std::shared_ptr<FileProfile>& profile,
+    const FileEngine::Settings& settings) {
+  filesync::RequireSyncProfileObserver(profile->GetSettings());
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { profile->AddEngineAsync(settings, context); });
+  return std::move(call.engine);
+}
+
+/**
+ * @brief Lists the engines of a profile and waits for them
+ * 
+ * @param profile Profile loaded with a SyncFileProfileObserver
+ * 
+ * @return Engine IDs. Failures are rethrown.
+ */
+inline std::vector<std::string> ListFileEngines(const std::shared_ptr<FileProfile>& profile) {
+  filesync::RequireSyncProfileObserver(profile->GetSettings());
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { profile->ListEnginesAsync(context); });
+  return std::move(call.engineIds);
+}
+
+/**
+ * @brief Unloads an engine of a profile and waits for it
+ * 
+ * @param profile Profile loaded with a SyncFileProfileObserver
+ * @param engineId ID of the engine
+ */
+inline void UnloadFileEngine(const std::shared_ptr<FileProfile>& profile, const std::string& engineId) {
+  filesync::RequireSyncProfileObserver(profile->GetSettings());
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { profile->UnloadEngineAsync(engineId, context); });
+}
+
+/**
+ * @brief Creates a file handler for a stream and waits for it
+ * 
+ * @param engine File engine
+ * @param inputStream Stream containing the file data
+ * @param actualFilePath Path of the file, including its extension, also used for audit
+ * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+ * @param fileExecutionState Execution state, or nullptr
+ * 
+ * @return File handler. Failures are rethrown.
+ * 
+ * @note All handlers created here share one stateless observer. Use ClassifyFile, InspectFile,
+ *       GetDecryptedTemporaryStream, GetDecryptedTemporaryFile and CommitFile on them, since their callbacks only
+ *       complete synchronous calls.
+ */
+inline std::shared_ptr<FileHandler> CreateFileHandler(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::shared_ptr<Stream>& inputStream,
+    const std::string& actualFilePath,
+    bool isAuditDiscoveryEnabled = true,
+    const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) {
+    engine->CreateFileHandlerAsync(inputStream, actualFilePath, isAuditDiscoveryEnabled,
+        filesync::GetFileHandlerObserver(), context, fileExecutionState);
+  });
+  return std::move(call.handler);
+}
+
+/**
+ * @brief Creates a file handler for a file path and waits for it
+ * 
+ * @param engine File engine
+ * @param inputFilePath File to open, including its extension
+ * @param actualFilePath Actual (not temporary) file path used for audit
+ * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+ * @param fileExecutionState Execution state, or nullptr
+ * 
+ * @return File handler. Failures are rethrown.
+ */
+inline std::shared_ptr<FileHandler> CreateFileHandler(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::string& inputFilePath,
+    const std::string& actualFilePath,
+    bool isAuditDiscoveryEnabled = true,
+    const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) {
+    engine->CreateFileHandlerAsync(inputFilePath, actualFilePath, isAuditDiscoveryEnabled,
+        filesync::GetFileHandlerObserver(), context, fileExecutionState);
+  });
+  return std::move(call.handler);
+}
+
+/**
+ * @brief Classifies a file and waits for the resulting actions
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * 
+ * @return Actions computed by the policy. Failures are rethrown.
+ */
+inline std::vector<std::shared_ptr<Action>> ClassifyFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { handler->ClassifyAsync(context); });
+  return std::move(call.actions);
+}
+
+/**
+ * @brief Inspects a file and waits for the inspector
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * 
+ * @return File inspector. Failures are rethrown.
+ */
+inline std::shared_ptr<FileInspector> InspectFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { handler->InspectAsync(context); });
+  return std::move(call.inspector);
+}
+
+/**
+ * @brief Decrypts a file to a temporary stream and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * 
+ * @return Decrypted content. Failures are rethrown.
+ */
+inline std::shared_ptr<Stream> GetDecryptedTemporaryStream(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) {
+    handler->GetDecryptedTemporaryStreamAsync(context);
+  });
+  return std::move(call.stream);
+}
+
+/**
+ * @brief Decrypts a file to a temporary file and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * 
+ * @return Path of the decrypted file. Failures are rethrown.
+ */
+inline std::string GetDecryptedTemporaryFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { handler->GetDecryptedTemporaryFileAsync(context); });
+  return std::move(call.filePath);
+}
+
+/**
+ * @brief Commits the changes of a file to a stream and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param outputStream Stream receiving the modified file
+ * 
+ * @return true if changes were committed. Failures are rethrown.
+ */
+inline bool CommitFile(const std::shared_ptr<FileHandler>& handler, const std::shared_ptr<Stream>& outputStream) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { handler->CommitAsync(outputStream, context); });
+  return call.isCommitted;
+}
+
+/**
+ * @brief Commits the changes of a file to a file and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param outputFilePath File receiving the modified content
+ * 
+ * @return true if changes were committed. Failures are rethrown.
+ */
+inline bool CommitFile(const std::shared_ptr<FileHandler>& handler, const std::string& outputFilePath) {
+  filesync::SyncCall call;
+  filesync::Run(call, [&](const std::shared_ptr<void>& context) { handler->CommitAsync(outputFilePath, context); });
+  return call.isCommitted;
+}
+
+/**
+ * @brief Creates a file handler for a stream and waits for it, returning failures instead of throwing them
+ * 
+ * @param engine File engine
+ * @param inputStream Stream containing the file data
+ * @param actualFilePath Path of the file, including its extension, also used for audit
+ * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+ * @param fileExecutionState Execution state, or nullptr
+ * 
+ * @return File handler, or the failure reported by the SDK
+ * 
+ * @note The Try* functions below are counterparts of the synchronous functions above for bulk scans, where failures
+ *       such as ErrorType::NO_PERMISSIONS are expected for many files. The SDK's failure is handed back in the Result
+ *       as is; it is only rethrown if the caller inspects its type or message, or calls Result::GetValue.
+ */
+inline Result<std::shared_ptr<FileHandler>> TryCreateFileHandler(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::shared_ptr<Stream>& inputStream,
+    const std::string& actualFilePath,
+    bool isAuditDiscoveryEnabled = true,
+    const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    engine->CreateFileHandlerAsync(inputStream, actualFilePath, isAuditDiscoveryEnabled,
+        filesync::GetFileHandlerObserver(), context, fileExecutionState);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.handler);
+}
+
+/**
+ * @brief Creates a file handler for a file path and waits for it, returning failures instead of throwing them
+ * 
+ * @param engine File engine
+ * @param inputFilePath File to open, including its extension
+ * @param actualFilePath Actual (not temporary) file path used for audit
+ * @param isAuditDiscoveryEnabled Whether audit discovery is enabled
+ * @param fileExecutionState Execution state, or nullptr
+ * 
+ * @return File handler, or the failure reported by the SDK
+ */
+inline Result<std::shared_ptr<FileHandler>> TryCreateFileHandler(
+    const std::shared_ptr<FileEngine>& engine,
+    const std::string& inputFilePath,
+    const std::string& actualFilePath,
+    bool isAuditDiscoveryEnabled = true,
+    const std::shared_ptr<FileExecutionState>& fileExecutionState = nullptr) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    engine->CreateFileHandlerAsync(inputFilePath, actualFilePath, isAuditDiscoveryEnabled,
+        filesync::GetFileHandlerObserver(), context, fileExecutionState);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.handler);
+}
+
+/**
+ * @brief Classifies a file and waits for the resulting actions, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * 
+ * @return Actions computed by the policy, or the failure reported by the SDK
+ */
+inline Result<std::vector<std::shared_ptr<Action>>> TryClassifyFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->ClassifyAsync(context);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.actions);
+}
+
+/**
+ * @brief Inspects a file and waits for the inspector, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * 
+ * @return File inspector, or the failure reported by the SDK
+ */
+inline Result<std::shared_ptr<FileInspector>> TryInspectFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->InspectAsync(context);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.inspector);
+}
+
+/**
+ * @brief Decrypts a file to a temporary stream and waits for it, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * 
+ * @return Decrypted content, or the failure reported by the SDK
+ */
+inline Result<std::shared_ptr<Stream>> TryGetDecryptedTemporaryStream(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->GetDecryptedTemporaryStreamAsync(context);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.stream);
+}
+
+/**
+ * @brief Decrypts a file to a temporary file and waits for it, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * 
+ * @return Path of the decrypted file, or the failure reported by the SDK
+ */
+inline Result<std::string> TryGetDecryptedTemporaryFile(const std::shared_ptr<FileHandler>& handler) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->GetDecryptedTemporaryFileAsync(context);
+  });
+  if (error) {
+    return error;
+  }
+  return std::move(call.filePath);
+}
+
+/**
+ * @brief Commits the changes of a file to a stream and waits for it, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * @param outputStream Stream receiving the modified file
+ * 
+ * @return true if changes were committed, or the failure reported by the SDK
+ */
+inline Result<bool> TryCommitFile(const std::shared_ptr<FileHandler>& handler,
+    const std::shared_ptr<Stream>& outputStream) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->CommitAsync(outputStream, context);
+  });
+  if (error) {
+    return error;
+  }
+  return call.isCommitted;
+}
+
+/**
+ * @brief Commits the changes of a file to a file and waits for it, returning failures instead of throwing them
+ * 
+ * @param handler File handler returned by CreateFileHandler or TryCreateFileHandler
+ * @param outputFilePath File receiving the modified content
+ * 
+ * @return true if changes were committed, or the failure reported by the SDK
+ */
+inline Result<bool> TryCommitFile(const std::shared_ptr<FileHandler>& handler, const std::string& outputFilePath) {
+  filesync::SyncCall call;
+  ErrorInfo error = filesync::TryRun(call, [&](const std::shared_ptr<void>& context) {
+    handler->CommitAsync(outputFilePath, context);
+  });
+  if (error) {
+    return error;
+  }
+  return call.isCommitted;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_FILE_SYNC_H_
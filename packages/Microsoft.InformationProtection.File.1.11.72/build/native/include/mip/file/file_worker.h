@@ -0,0 +1,534 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines FileWorker, which serves file operations to client processes over shared-memory rings
+ *
+ * @file file_worker.h
+ */
+
+#ifndef API_MIP_FILE_FILE_WORKER_H_
+#define API_MIP_FILE_FILE_WORKER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/engine_pool.h"
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_sync.h"
+#include "mip/file/labeling_options.h"
+#include "mip/file/protection_settings.h"
+#include "mip/mip_namespace.h"
+#include "mip/shared_memory_ring.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+#include "mip/upe/content_label.h"
+#include "mip/upe/label.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Operations a FileWorker performs for its clients
+ */
+enum class FileWorkerOperation : uint32_t {
+  GetLabel = 1, /**< Read the label of the content */
+  SetLabel = 2, /**< Apply a label and return the committed content */
+  DeleteLabel = 3, /**< Remove the label and return the committed content */
+  RemoveProtection = 4, /**< Remove protection and return the committed content */
+};
+
+/**
+ * @brief Result of one FileWorker operation
+ */
+struct FileWorkerResult {
+  int32_t status = 0; /**< 0 on success, else 1 + the mip::ErrorType of the failure, or -1 for other failures */
+  std::string errorMessage; /**< Failure message */
+  std::string labelId; /**< Label of the content, or empty, for FileWorkerOperation::GetLabel */
+  bool isCommitted = false; /**< Whether the output content was written */
+  std::vector<uint8_t> content; /**< Committed content */
+};
+
+/**
+ * @brief The pair of rings connecting one client process to a FileWorker.
+ *
+ * @note The client creates the channel and owns its name; the worker opens it when the client connects. Requests
+ *       flow through one ring and responses through the other, so the channel serves one request at a time.
+ */
+class FileWorkerChannel {
+public:
+  /**
+   * @brief Create a channel in a new shared memory region
+   *
+   * @param name Region name, unique on the machine
+   * @param ringCapacity Size (in bytes) of each ring. Content larger than a ring streams through it.
+   *
+   * @return Channel
+   */
+  static std::shared_ptr<FileWorkerChannel> Create(const std::string& name, size_t ringCapacity = 4 * 1024 * 1024) {
+    size_t ringSize = AlignUp(SharedMemoryRing::GetRequiredSize(ringCapacity));
+    auto region = SharedMemoryRegion::Create(name, kLayoutSize + 2 * ringSize);
+    reinterpret_cast<uint64_t*>(region->Data())[0] = ringSize;
+    return std::shared_ptr<FileWorkerChannel>(new FileWorkerChannel(region, ringSize, true));
+  }
+
+  /**
+   * @brief Open a channel created by another process
+   *
+   * @param name Region name
+   *
+   * @return Channel
+   */
+  static std::shared_ptr<FileWorkerChannel> Open(const std::string& name) {
+    auto region = SharedMemoryRegion::Open(name);
+    size_t ringSize = static_cast<size_t>(reinterpret_cast<const uint64_t*>(region->Data())[0]);
+    if (ringSize == 0 || kLayoutSize + 2 * ringSize > region->Size()) {
+      throw BadInputError("Shared memory region is not a FileWorkerChannel: " + name);
+    }
+    return std::shared_ptr<FileWorkerChannel>(new FileWorkerChannel(region, ringSize, false));
+  }
+
+  /** @brief Ring carrying requests from the client to the worker */
+  SharedMemoryRing& Requests() { return mRequests; }
+  /** @brief Ring carrying responses from the worker to the client */
+  SharedMemoryRing& Responses() { return mResponses; }
+  /** @brief Region name */
+  const std::string& GetName() const { return mRegion->GetName(); }
+
+  /** @brief Close both rings, ending the session on both sides */
+  void Close() {
+    mRequests.Close();
+    mResponses.Close();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static const size_t kLayoutSize = 64;
+
+  static size_t AlignUp(size_t size) { return (size + 63) / 64 * 64; }
+
+  FileWorkerChannel(const std::shared_ptr<SharedMemoryRegion>& region, size_t ringSize, bool initialize)
+      : mRegion(region),
+        mRequests(region->Data() + kLayoutSize, ringSize, initialize),
+        mResponses(region->Data() + kLayoutSize + ringSize, ringSize, initialize) {}
+
+  std::shared_ptr<SharedMemoryRegion> mRegion;
+  SharedMemoryRing mRequests;
+  SharedMemoryRing mResponses;
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace fileworker {
+
+// Content streams through the ring, so this only bounds what a peer can make the reader allocate
+const uint64_t kMaxContentSize = 1024ull * 1024 * 1024;
+
+// Messages are written field by field straight into the ring, so content is never assembled in a separate buffer
+inline void WriteUint32(SharedMemoryRing& ring, uint32_t value) {
+  ring.Write(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+}
+
+inline void WriteBytes(SharedMemoryRing& ring, const uint8_t* data, uint64_t length) {
+  ring.Write(reinterpret_cast<const uint8_t*>(&length), sizeof(length));
+  ring.Write(data, static_cast<size_t>(length));
+}
+
+inline void WriteString(SharedMemoryRing& ring, const std::string& value) {
+  WriteBytes(ring, reinterpret_cast<const uint8_t*>(value.data()), value.size());
+}
+
+inline uint32_t ReadUint32(SharedMemoryRing& ring) {
+  uint32_t value = 0;
+  ring.Read(reinterpret_cast<uint8_t*>(&value), sizeof(value));
+  return value;
+}
+
+inline std::vector<uint8_t> ReadBytes(SharedMemoryRing& ring, uint64_t maxLength = kMaxContentSize) {
+  uint64_t length = 0;
+  ring.Read(reinterpret_cast<uint8_t*>(&length), sizeof(length));
+  if (length > maxLength) {
+    throw FileIOError("Shared memory message field is larger than allowed");
+  }
+  std::vector<uint8_t> value(static_cast<size_t>(length));
+  ring.Read(value.data(), value.size());
+  return value;
+}
+
+inline std::string ReadString(SharedMemoryRing& ring) {
+  // Names, paths and messages always fit in the ring at once
+  std::vector<uint8_t> bytes = ReadBytes(ring, ring.GetCapacity());
+  return std::string(bytes.begin(), bytes.end());
+}
+
+// Regions holding a single ring record the ring size up front, since a mapping may be larger than requested
+inline std::shared_ptr<SharedMemoryRegion> CreateRingRegion(const std::string& name, size_t capacity) {
+  size_t ringSize = SharedMemoryRing::GetRequiredSize(capacity);
+  auto region = SharedMemoryRegion::Create(name, 64 + ringSize);
+  reinterpret_cast<uint64_t*>(region->Data())[0] = ringSize;
+  return region;
+}
+
+inline std::unique_ptr<SharedMemoryRing> MapRing(SharedMemoryRegion& region, bool initialize) {
+  size_t ringSize = static_cast<size_t>(reinterpret_cast<const uint64_t*>(region.Data())[0]);
+  if (ringSize == 0 || 64 + ringSize > region.Size()) {
+    throw BadInputError("Shared memory region does not hold a ring: " + region.GetName());
+  }
+  return std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing(region.Data() + 64, ringSize, initialize));
+}
+
+struct Request {
+  FileWorkerOperation operation;
+  std::string engineId;
+  std::string filePath;
+  std::string labelId;
+  std::vector<uint8_t> content;
+};
+
+inline Request ReadRequest(SharedMemoryRing& ring) {
+  Request request;
+  request.operation = static_cast<FileWorkerOperation>(ReadUint32(ring));
+  request.engineId = ReadString(ring);
+  request.filePath = ReadString(ring);
+  request.labelId = ReadString(ring);
+  request.content = ReadBytes(ring);
+  return request;
+}
+
+inline void WriteResult(SharedMemoryRing& ring, const FileWorkerResult& result) {
+  SharedMemoryRing::WriteLock lock(ring);
+  WriteUint32(ring, static_cast<uint32_t>(result.status));
+  WriteString(ring, result.errorMessage);
+  WriteString(ring, result.labelId);
+  WriteUint32(ring, result.isCommitted ? 1 : 0);
+  WriteBytes(ring, result.content.data(), result.content.size());
+}
+
+inline FileWorkerResult ReadResult(SharedMemoryRing& ring) {
+  FileWorkerResult result;
+  result.status = static_cast<int32_t>(ReadUint32(ring));
+  result.errorMessage = ReadString(ring);
+  result.labelId = ReadString(ring);
+  result.isCommitted = ReadUint32(ring) != 0;
+  result.content = ReadBytes(ring);
+  return result;
+}
+
+} // namespace fileworker
+/** @endcond */
+
+/**
+ * @brief Serves file operations to many client processes from one set of warm engines.
+ *
+ * @note The worker process owns the FileProfile and loads engines through an EnginePool, so policy, templates and
+ *       licenses are cached once per machine rather than once per web worker process, and an SDK crash does not take
+ *       the front end down with it. Clients connect by writing the name of their FileWorkerChannel to the worker's
+ *       accept ring; each connected channel is served on its own thread. Content is passed through the rings; the
+ *       worker keeps it in memory for the duration of the request, since the SDK needs random access to it.
+ *       FileWorker is the building block of a worker host: the host process loads the profile, builds the
+ *       EnginePool loader from its delegates, calls Listen and waits.
+ */
+class FileWorker {
+public:
+  /**
+   * @brief FileWorker constructor
+   *
+   * @param engines Pool loading engines by ID on first use. The engines must have been loaded with a
+   *        SyncFileProfileObserver profile, because handlers are driven through the synchronous file functions.
+   */
+  explicit FileWorker(const std::shared_ptr<EnginePool<FileEngine>>& engines) : mEngines(engines) {
+    if (!mEngines) {
+      throw BadInputError("FileWorker requires an engine pool");
+    }
+  }
+
+  /**
+   * @brief Start accepting clients
+   *
+   * @param serviceName Name of the accept region clients connect through
+   * @param acceptCapacity Size (in bytes) of the accept ring
+   */
+  void Listen(const std::string& serviceName, size_t acceptCapacity = 64 * 1024) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mAcceptRegion) {
+      throw BadInputError("FileWorker is already listening");
+    }
+    mAcceptRegion = fileworker::CreateRingRegion(serviceName, acceptCapacity);
+    mAccept = fileworker::MapRing(*mAcceptRegion, true);
+    mAcceptThread = std::thread([this] { AcceptLoop(); });
+  }
+
+  /**
+   * @brief Serve one channel on the calling thread until the client closes it or the worker stops
+   *
+   * @param channel Channel opened by the worker
+   */
+  void Serve(FileWorkerChannel& channel) {
+    while (!mIsStopped) {
+      try {
+        if (!channel.Requests().WaitReadable(std::chrono::milliseconds(100))) {
+          continue;
+        }
+        fileworker::Request request = fileworker::ReadRequest(channel.Requests());
+        fileworker::WriteResult(channel.Responses(), Execute(request));
+      } catch (const FileIOError&) {
+        // The client closed the channel, exited or stalled mid-message
+        break;
+      } catch (const std::exception&) {
+        // Any other failure, such as std::bad_alloc, ends this channel rather than the worker process
+        break;
+      }
+    }
+    channel.Close();
+  }
+
+  /**
+   * @brief Perform one operation
+   *
+   * @param operation Operation
+   * @param engineId Engine to use
+   * @param filePath Path of the file, including its extension, also used for audit
+   * @param labelId Label to apply, for FileWorkerOperation::SetLabel
+   * @param content File content
+   *
+   * @return Result. Failures are reported in the result rather than thrown.
+   */
+  FileWorkerResult Execute(
+      FileWorkerOperation operation,
+      const std::string& engineId,
+      const std::string& filePath,
+      const std::string& labelId,
+      std::vector<uint8_t> content) {
+    fileworker::Request request{operation, engineId, filePath, labelId, std::move(content)};
+    return Execute(request);
+  }
+
+  /**
+   * @brief Stop accepting clients and serving channels, and wait for the serving threads
+   */
+  void Stop() {
+    mIsStopped = true;
+    if (mAcceptThread.joinable()) {
+      mAccept->Close();
+      mAcceptThread.join();
+    }
+    for (Session& session : mSessions) {
+      session.thread.join();
+    }
+    mSessions.clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  FileWorker(const FileWorker&) = delete;
+  FileWorker& operator=(const FileWorker&) = delete;
+
+  ~FileWorker() { Stop(); }
+
+private:
+  void AcceptLoop() {
+    while (!mIsStopped) {
+      std::string channelName;
+      try {
+        if (!mAccept->WaitReadable(std::chrono::milliseconds(100))) {
+          continue;
+        }
+        channelName = fileworker::ReadString(*mAccept);
+      } catch (const std::exception&) {
+        // The accept ring was closed, or a malformed connect request left it out of sync
+        break;
+      }
+      std::shared_ptr<FileWorkerChannel> channel;
+      try {
+        channel = FileWorkerChannel::Open(channelName);
+      } catch (const Error&) {
+        // The client went away before it was accepted
+        continue;
+      }
+      ReapSessions();
+      auto isDone = std::make_shared<std::atomic<bool>>(false);
+      mSessions.push_back(Session{std::thread([this, channel, isDone] {
+        Serve(*channel);
+        *isDone = true;
+      }), isDone});
+    }
+  }
+
+  // Only the accept thread adds sessions, so finished ones are joined there too
+  void ReapSessions() {
+    for (auto it = mSessions.begin(); it != mSessions.end();) {
+      if (*it->isDone) {
+        it->thread.join();
+        it = mSessions.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  FileWorkerResult Execute(fileworker::Request& request) {
+    FileWorkerResult result;
+    try {
+      std::shared_ptr<FileEngine> engine = mEngines->Get(request.engineId);
+      auto input = CreateStreamFromBuffer(request.content.data(), static_cast<int64_t>(request.content.size()));
+      std::shared_ptr<FileHandler> handler = CreateFileHandler(engine, input, request.filePath);
+      LabelingOptions labelingOptions(AssignmentMethod::STANDARD);
+      switch (request.operation) {
+        case FileWorkerOperation::GetLabel: {
+          std::shared_ptr<ContentLabel> label = handler->GetLabel();
+          if (label && label->GetLabel()) {
+            result.labelId = label->GetLabel()->GetId();
+          }
+          return result;
+        }
+        case FileWorkerOperation::SetLabel: {
+          std::shared_ptr<Label> label = engine->GetLabelById(request.labelId);
+          handler->SetLabel(label, labelingOptions, ProtectionSettings());
+          break;
+        }
+        case FileWorkerOperation::DeleteLabel:
+          handler->DeleteLabel(labelingOptions);
+          break;
+        case FileWorkerOperation::RemoveProtection:
+          handler->RemoveProtection();
+          break;
+        default:
+          throw BadInputError("Unknown FileWorker operation");
+      }
+      auto outputBuffer = std::make_shared<std::stringstream>();
+      result.isCommitted = CommitFile(handler, CreateStreamFromStdStream(
+          std::static_pointer_cast<std::iostream>(outputBuffer)));
+      const std::string output = outputBuffer->str();
+      result.content.assign(output.begin(), output.end());
+    } catch (const Error& error) {
+      result.status = 1 + static_cast<int32_t>(error.GetErrorType());
+      result.errorMessage = error.what();
+    } catch (const std::exception& error) {
+      result.status = -1;
+      result.errorMessage = error.what();
+    }
+    return result;
+  }
+
+  struct Session {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> isDone;
+  };
+
+  std::shared_ptr<EnginePool<FileEngine>> mEngines;
+  std::shared_ptr<SharedMemoryRegion> mAcceptRegion;
+  std::unique_ptr<SharedMemoryRing> mAccept;
+  std::thread mAcceptThread;
+  std::list<Session> mSessions;
+  std::atomic<bool> mIsStopped{false};
+  std::mutex mMutex;
+  /** @endcond */
+};
+
+/**
+ * @brief Client side of a FileWorker connection.
+ *
+ * @note Each client owns one channel, so a client serves one request at a time; use one client per thread for
+ *       parallel requests.
+ */
+class FileWorkerClient {
+public:
+  /**
+   * @brief Create a channel and connect it to a worker
+   *
+   * @param serviceName Name the worker listens on
+   * @param channelName Name of the new channel, unique on the machine
+   * @param ringCapacity Size (in bytes) of each ring of the channel
+   */
+  FileWorkerClient(
+      const std::string& serviceName,
+      const std::string& channelName,
+      size_t ringCapacity = 4 * 1024 * 1024)
+      : mChannel(FileWorkerChannel::Create(channelName, ringCapacity)) {
+    auto acceptRegion = SharedMemoryRegion::Open(serviceName);
+    std::unique_ptr<SharedMemoryRing> accept = fileworker::MapRing(*acceptRegion, false);
+    SharedMemoryRing::WriteLock lock(*accept);
+    fileworker::WriteString(*accept, channelName);
+  }
+
+  /**
+   * @brief Perform one operation in the worker
+   *
+   * @param operation Operation
+   * @param engineId Engine to use
+   * @param filePath Path of the file, including its extension, also used for audit
+   * @param labelId Label to apply, for FileWorkerOperation::SetLabel
+   * @param content File content, written straight into the request ring
+   * @param contentLength Size (in bytes) of the content
+   *
+   * @return Result
+   *
+   * @note A mip::FileIOError is thrown if the worker exits or stops responding.
+   */
+  FileWorkerResult Execute(
+      FileWorkerOperation operation,
+      const std::string& engineId,
+      const std::string& filePath,
+      const std::string& labelId,
+      const uint8_t* content,
+      int64_t contentLength) {
+    SharedMemoryRing& requests = mChannel->Requests();
+    {
+      SharedMemoryRing::WriteLock lock(requests);
+      fileworker::WriteUint32(requests, static_cast<uint32_t>(operation));
+      fileworker::WriteString(requests, engineId);
+      fileworker::WriteString(requests, filePath);
+      fileworker::WriteString(requests, labelId);
+      fileworker::WriteBytes(requests, content, static_cast<uint64_t>(contentLength));
+    }
+    return fileworker::ReadResult(mChannel->Responses());
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  FileWorkerClient(const FileWorkerClient&) = delete;
+  FileWorkerClient& operator=(const FileWorkerClient&) = delete;
+
+  ~FileWorkerClient() { mChannel->Close(); }
+
+private:
+  std::shared_ptr<FileWorkerChannel> mChannel;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_FILE_FILE_WORKER_H_
@@ -0,0 +1,407 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines IncrementalScanner, which keeps a persistent index of scanned files so that repeated scans only
+ *        process the files that changed
+ * 
+ * @file incremental_scanner.h
+ */
+
+#ifndef API_MIP_FILE_INCREMENTAL_SCANNER_H_
+#define API_MIP_FILE_INCREMENTAL_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A file found while walking a repository
+ */
+struct ScanFileInfo {
+  std::string path;         /**< File path, the key of the index */
+  int64_t size = 0;         /**< Size in bytes */
+  int64_t modifiedTime = 0; /**< Last write time, in any unit as long as it is the same on every scan */
+};
+
+/**
+ * @brief What was learned by processing a file, recorded in the index
+ */
+struct ScanOutcome {
+  std::string contentHash;  /**< Hash of the content, or empty if not computed */
+  std::string labelId;      /**< Label ID, or empty if not labeled */
+  bool isProtected = false; /**< If the file is protected */
+};
+
+/**
+ * @brief An entry of the scan index
+ */
+struct ScanIndexEntry {
+  ScanFileInfo file;             /**< File as it was when processed */
+  ScanOutcome outcome;           /**< Outcome of processing it */
+  std::string policyFileId;      /**< FileEngine::GetPolicyFileId when it was processed */
+  std::string sensitivityFileId; /**< FileEngine::GetSensitivityFileId when it was processed */
+};
+
+/**
+ * @brief Why a file must be processed again, or that it need not be
+ */
+enum class ScanReason : unsigned int {
+  Unchanged = 0,     /**< Indexed with the same size, time and policy */
+  New = 1,           /**< Not in the index */
+  Modified = 2,      /**< Size, time or content hash differ from the index */
+  PolicyChanged = 3, /**< Processed under another policy or sensitivity types package */
+};
+
+/**
+ * @brief Counts of a call to IncrementalScanner::Scan
+ */
+struct IncrementalScanStatistics {
+  size_t examined = 0;  /**< Files checked against the index */
+  size_t processed = 0; /**< Files passed to the processor */
+  size_t skipped = 0;   /**< Files left alone because they did not change */
+  size_t failed = 0;    /**< Files whose processor threw; they are retried on the next scan */
+};
+
+/**
+ * @brief Changes reported by a FileChangeJournal
+ */
+struct FileChanges {
+  std::vector<std::string> changedPaths; /**< Files created, written or renamed to */
+  std::vector<std::string> removedPaths; /**< Files deleted or renamed from */
+  std::string nextCursor;                /**< Cursor to read from next time */
+};
+
+/**
+ * @brief A source of file system changes, such as the NTFS USN change journal or fanotify
+ * 
+ * @note Implemented by the application, since reading change journals is platform specific: a USN journal cursor
+ *       would hold the journal ID and the next USN to read, while a fanotify listener would keep the events it
+ *       received since the last call. Cursors are opaque to the scanner, which stores them in the index.
+ */
+class FileChangeJournal {
+public:
+  /**
+   * @brief Get an ID for the journal, e.g. the volume it watches
+   * 
+   * @return Journal ID, under which its cursor is stored
+   */
+  virtual std::string GetId() const = 0;
+
+  /**
+   * @brief Read the changes made since a cursor
+   * 
+   * @param cursor Cursor returned by a previous call, or empty on the first one
+   * @param changes [Output] Changes since @p cursor, and the cursor to read from next time
+   * 
+   * @return false if the changes since @p cursor are no longer known, e.g. the journal was recreated or wrapped
+   *         around, or @p cursor is empty; the repository must then be walked in full
+   */
+  virtual bool ReadChanges(const std::string& cursor, FileChanges& changes) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~FileChangeJournal() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Settings of an IncrementalScanner
+ */
+struct IncrementalScannerSettings {
+  std::shared_ptr<StorageDelegate> storageDelegate; /**< Holds the index */
+  std::string storagePath;                          /**< Path passed to StorageDelegate::CreateStorageTable */
+  /** Hashes a file, or nullptr to rely on size and time only. A file whose size or time changed but whose hash did
+      not is not processed again. */
+  std::function<std::string(const ScanFileInfo&)> computeContentHash;
+  /** Called when the processor throws for a file */
+  std::function<void(const ScanFileInfo&, const std::exception_ptr&)> onError;
+};
+
+/**
+ * @brief Keeps an index of scanned files in the StorageDelegate, so that repeated scans of a repository only
+ *        process the files, or the policy, that changed
+ * 
+ * @note The index holds the path, size, modification time, content hash, label ID and protection state of every
+ *       processed file, with the policy and sensitivity types package it was processed under. A file is processed
+ *       again when it is not indexed, when its size or time changed (and, with computeContentHash, its content), or
+ *       when FileEngine::GetPolicyFileId or GetSensitivityFileId changed since, since new rules can yield another
+ *       label. When a FileChangeJournal is available, GetChanges lists the files to check instead of a full walk;
+ *       call SaveJournalCursor once they were scanned, so that a scan stopped midway is resumed from the same changes.
+ *       Not thread-safe: use one scanner per thread, over one StorageDelegate path each, or serialize calls.
+ */
+class IncrementalScanner {
+public:
+  /** @brief Processes a file, e.g. with FileHandler::GetFileStatus and ClassifyAsync, and returns the outcome */
+  typedef std::function<ScanOutcome(const ScanFileInfo& file, ScanReason reason)> Processor;
+
+  /**
+   * @brief IncrementalScanner constructor
+   * 
+   * @param engine Engine the files are processed with; its policy IDs are recorded with each entry
+   * @param settings Storage and hashing settings
+   */
+  IncrementalScanner(const std::shared_ptr<FileEngine>& engine, const IncrementalScannerSettings& settings)
+      : mEngine(engine),
+        mSettings(settings) {
+    if (!mEngine || !mSettings.storageDelegate) {
+      throw BadInputError("IncrementalScanner requires an engine and a StorageDelegate");
+    }
+    mIndex = CreateTable("mip_scan_index",
+        {"path", "size", "modified_time", "content_hash", "label_id", "is_protected", "policy_file_id",
+         "sensitivity_file_id"});
+    mJournals = CreateTable("mip_scan_journal", {"journal_id", "cursor"});
+  }
+
+  /**
+   * @brief Check whether a file must be processed again
+   * 
+   * @param file File as found by the walk
+   * 
+   * @return Reason to process it, or ScanReason::Unchanged
+   */
+  ScanReason Check(const ScanFileInfo& file) {
+    ScanIndexEntry entry;
+    return Check(file, entry);
+  }
+
+  /**
+   * @brief Record the outcome of processing a file
+   * 
+   * @param file File as it was processed
+   * @param outcome Outcome of processing it
+   */
+  void Record(const ScanFileInfo& file, const ScanOutcome& outcome) {
+    ScanIndexEntry entry;
+    Write(file, outcome, Find(file.path, entry));
+  }
+
+  /**
+   * @brief Get the index entry of a file
+   * 
+   * @param path File path
+   * @param entry [Output] Entry, set if found
+   * 
+   * @return true if the file is indexed
+   */
+  bool Find(const std::string& path, ScanIndexEntry& entry) {
+    auto rows = mIndex->Find({"path"}, {path});
+    if (rows.empty() || rows.front().size() < 8) {
+      return false;
+    }
+    const auto& row = rows.front();
+    entry.file.path = row[0];
+    entry.file.size = ToInt64(row[1]);
+    entry.file.modifiedTime = ToInt64(row[2]);
+    entry.outcome.contentHash = row[3];
+    entry.outcome.labelId = row[4];
+    entry.outcome.isProtected = row[5] == "1";
+    entry.policyFileId = row[6];
+    entry.sensitivityFileId = row[7];
+    return true;
+  }
+
+  /**
+   * @brief Remove a deleted file from the index
+   * 
+   * @param path File path
+   */
+  void Remove(const std::string& path) { mIndex->Delete({"path"}, {path}); }
+
+  /**
+   * @brief Process the files that changed since they were indexed, and index the outcome
+   * 
+   * @param files Files found by the walk, or listed by GetChanges
+   * @param processor Processes one file
+   * 
+   * @return Counts of files examined, processed, skipped and failed
+   * 
+   * @note Index writes are grouped into one storage transaction per call; pass files in batches of a few thousand
+   *       so that progress is saved as the scan goes.
+   */
+  IncrementalScanStatistics Scan(const std::vector<ScanFileInfo>& files, const Processor& processor) {
+    if (!processor) {
+      throw BadInputError("Scan requires a processor");
+    }
+    IncrementalScanStatistics statistics;
+    StorageTableTransaction transaction(*mIndex);
+    for (const ScanFileInfo& file : files) {
+      ++statistics.examined;
+      ScanIndexEntry entry;
+      ScanReason reason = Check(file, entry);
+      bool isIndexed = reason != ScanReason::New;
+      std::string contentHash;
+      if (reason == ScanReason::Modified && IsSameContent(file, entry, contentHash)) {
+        // Touched but not changed: only refresh the size and time, so that the hash is not computed again
+        Write(file, entry.outcome, true);
+        reason = ScanReason::Unchanged;
+      }
+      if (reason == ScanReason::Unchanged) {
+        ++statistics.skipped;
+        continue;
+      }
+      try {
+        ScanOutcome outcome = processor(file, reason);
+        if (outcome.contentHash.empty()) {
+          outcome.contentHash = std::move(contentHash);
+        }
+        Write(file, outcome, isIndexed);
+        ++statistics.processed;
+      } catch (...) {
+        ++statistics.failed;
+        if (mSettings.onError) {
+          mSettings.onError(file, std::current_exception());
+        }
+      }
+    }
+    transaction.Commit();
+    return statistics;
+  }
+
+  /**
+   * @brief Read the changes recorded by a journal since its saved cursor
+   * 
+   * @param journal Change journal
+   * @param changes [Output] Changes; removed files are already removed from the index
+   * 
+   * @return false if the changes are not known and the repository must be walked in full; call SaveJournalCursor
+   *         with changes.nextCursor once the walk is done
+   */
+  bool GetChanges(FileChangeJournal& journal, FileChanges& changes) {
+    auto rows = mJournals->Find({"journal_id"}, {journal.GetId()});
+    std::string cursor = !rows.empty() && rows.front().size() >= 2 ? rows.front()[1] : std::string();
+    changes = FileChanges();
+    bool isComplete = journal.ReadChanges(cursor, changes) && !cursor.empty();
+    if (isComplete) {
+      StorageTableTransaction transaction(*mIndex);
+      for (const std::string& path : changes.removedPaths) {
+        Remove(path);
+      }
+      transaction.Commit();
+    }
+    return isComplete;
+  }
+
+  /**
+   * @brief Save the cursor of a journal, once the changes read up to it were scanned
+   * 
+   * @param journal Change journal
+   * @param cursor FileChanges::nextCursor returned by GetChanges
+   */
+  void SaveJournalCursor(FileChangeJournal& journal, const std::string& cursor) {
+    std::string journalId = journal.GetId();
+    if (mJournals->Find({"journal_id"}, {journalId}).empty()) {
+      mJournals->Insert({journalId, cursor});
+    } else {
+      mJournals->Update({"cursor"}, {cursor}, {"journal_id"}, {journalId});
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<StorageTable> CreateTable(const std::string& name, const std::vector<std::string>& columns) {
+    StorageTableResult table = mSettings.storageDelegate->CreateStorageTable(mSettings.storagePath,
+        MipComponent::File, name, columns, {}, {columns.front()});
+    if (table.GetError()) {
+      throw *table.GetError();
+    }
+    return table.GetData();
+  }
+
+  ScanReason Check(const ScanFileInfo& file, ScanIndexEntry& entry) {
+    if (!Find(file.path, entry)) {
+      return ScanReason::New;
+    }
+    if (entry.policyFileId != mEngine->GetPolicyFileId() ||
+        entry.sensitivityFileId != mEngine->GetSensitivityFileId()) {
+      return ScanReason::PolicyChanged;
+    }
+    if (entry.file.size != file.size || entry.file.modifiedTime != file.modifiedTime) {
+      return ScanReason::Modified;
+    }
+    return ScanReason::Unchanged;
+  }
+
+  bool IsSameContent(const ScanFileInfo& file, const ScanIndexEntry& entry, std::string& contentHash) {
+    if (!mSettings.computeContentHash || entry.outcome.contentHash.empty() || entry.file.size != file.size) {
+      return false;
+    }
+    contentHash = mSettings.computeContentHash(file);
+    return contentHash == entry.outcome.contentHash;
+  }
+
+  void Write(const ScanFileInfo& file, const ScanOutcome& outcome, bool isIndexed) {
+    std::vector<std::string> values = {
+        file.path,
+        std::to_string(file.size),
+        std::to_string(file.modifiedTime),
+        outcome.contentHash.empty() && mSettings.computeContentHash ? mSettings.computeContentHash(file)
+                                                                     : outcome.contentHash,
+        outcome.labelId,
+        outcome.isProtected ? "1" : "0",
+        mEngine->GetPolicyFileId(),
+        mEngine->GetSensitivityFileId()};
+    if (!isIndexed) {
+      mIndex->Insert(values);
+      return;
+    }
+    mIndex->Update(
+        {"size", "modified_time", "content_hash", "label_id", "is_protected", "policy_file_id",
+         "sensitivity_file_id"},
+        std::vector<std::string>(values.begin() + 1, values.end()),
+        {"path"},
+        {file.path});
+  }
+
+  static int64_t ToInt64(const std::string& value) {
+    try {
+      return static_cast<int64_t>(std::stoll(value));
+    } catch (...) {
+      return -1;
+    }
+  }
+
+  std::shared_ptr<FileEngine> mEngine;
+  IncrementalScannerSettings mSettings;
+  std::shared_ptr<StorageTable> mIndex;
+  std::shared_ptr<StorageTable> mJournals;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_INCREMENTAL_SCANNER_H_
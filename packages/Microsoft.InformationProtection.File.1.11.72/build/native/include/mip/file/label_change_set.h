@@ -0,0 +1,213 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines LabelChangeSet, which describes how the labels of an engine changed between two policies
+ * 
+ * @file label_change_set.h
+ */
+
+#ifndef API_MIP_FILE_LABEL_CHANGE_SET_H_
+#define API_MIP_FILE_LABEL_CHANGE_SET_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/file/label_index.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/label.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Labels added, removed and modified between two snapshots of a policy
+ */
+struct LabelChangeSet {
+  std::string previousPolicyFileId;  /**< Policy the changes are relative to, empty if there was none */
+  std::string policyFileId;          /**< Policy the changes lead to */
+  std::vector<std::string> addedLabelIds;    /**< Labels only in the new policy */
+  std::vector<std::string> removedLabelIds;  /**< Labels only in the previous policy */
+  std::vector<std::string> modifiedLabelIds; /**< Labels in both whose properties, parent or children differ */
+
+  /**
+   * @brief Get whether any label changed
+   * 
+   * @return true if a label was added, removed or modified
+   */
+  bool HasLabelChanges() const {
+    return !addedLabelIds.empty() || !removedLabelIds.empty() || !modifiedLabelIds.empty();
+  }
+
+  /**
+   * @brief Get whether content labeled with a label ID may be affected by the change
+   * 
+   * @param labelId Label ID
+   * 
+   * @return true if the label was removed or modified
+   */
+  bool IsLabelAffected(const std::string& labelId) const {
+    for (const auto* ids : {&removedLabelIds, &modifiedLabelIds}) {
+      for (const auto& id : *ids) {
+        if (id == labelId) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace labelchanges {
+
+inline bool HasSameId(const std::shared_ptr<Label>& left, const std::shared_ptr<Label>& right) {
+  return (!left && !right) || (left && right && left->GetId() == right->GetId());
+}
+
+inline bool IsSameLabel(const Label& left, const Label& right) {
+  if (left.GetName() != right.GetName() || left.GetDescription() != right.GetDescription() ||
+      left.GetColor() != right.GetColor() || left.GetSensitivity() != right.GetSensitivity() ||
+      left.GetTooltip() != right.GetTooltip() || left.GetAutoTooltip() != right.GetAutoTooltip() ||
+      left.IsActive() != right.IsActive() || left.GetActionSource() != right.GetActionSource() ||
+      left.GetCustomSettings() != right.GetCustomSettings() || left.GetContentFormats() != right.GetContentFormats() ||
+      !HasSameId(left.GetParent().lock(), right.GetParent().lock()) ||
+      left.GetChildren().size() != right.GetChildren().size()) {
+    return false;
+  }
+  for (size_t i = 0; i < left.GetChildren().size(); ++i) {
+    if (!HasSameId(left.GetChildren()[i], right.GetChildren()[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace labelchanges
+/** @endcond */
+
+/**
+ * @brief Compare two label snapshots
+ * 
+ * @param previous Snapshot of the previous policy, or nullptr if there was none
+ * @param current Snapshot of the current policy
+ * 
+ * @return Labels added, removed and modified, each list in policy order
+ */
+inline LabelChangeSet ComputeLabelChanges(
+    const std::shared_ptr<const LabelIndex>& previous,
+    const std::shared_ptr<const LabelIndex>& current) {
+  if (!current) {
+    throw BadInputError("A current label snapshot is required");
+  }
+  LabelChangeSet changes;
+  changes.policyFileId = current->GetPolicyFileId();
+  if (previous) {
+    changes.previousPolicyFileId = previous->GetPolicyFileId();
+    for (const auto& label : previous->GetAllLabels()) {
+      if (!current->FindById(label->GetId())) {
+        changes.removedLabelIds.push_back(label->GetId());
+      }
+    }
+  }
+  for (const auto& label : current->GetAllLabels()) {
+    std::shared_ptr<Label> previousLabel = previous ? previous->FindById(label->GetId()) : nullptr;
+    if (!previousLabel) {
+      changes.addedLabelIds.push_back(label->GetId());
+    } else if (!labelchanges::IsSameLabel(*previousLabel, *label)) {
+      changes.modifiedLabelIds.push_back(label->GetId());
+    }
+  }
+  return changes;
+}
+
+/**
+ * @brief Tracks the label snapshot of each engine and reports what changed when its policy is refreshed
+ * 
+ * @note Call Update from FileProfile::Observer::OnPolicyChanged handling, once the engine reflects the new policy.
+ *       Snapshots are immutable, so handlers that captured the previous snapshot keep using it safely while callers
+ *       evict only the cache entries for affected labels.
+ */
+class LabelChangeTracker {
+public:
+  /**
+   * @brief Snapshot the engine's labels and compare them with the previous snapshot of the same engine
+   * 
+   * @param engine File engine
+   * 
+   * @return Changes since the previous Update, or every label as added on the first Update of an engine
+   */
+  LabelChangeSet Update(const std::shared_ptr<FileEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A FileEngine is required");
+    }
+    auto current = LabelIndex::Create(engine);
+    std::shared_ptr<const LabelIndex> previous;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto& entry = mIndexes[engine->GetSettings().GetEngineId()];
+      previous = entry;
+      entry = current;
+    }
+    return ComputeLabelChanges(previous, current);
+  }
+
+  /**
+   * @brief Get the latest snapshot of an engine
+   * 
+   * @param engineId Engine ID
+   * 
+   * @return Snapshot taken by the latest Update, or nullptr
+   */
+  std::shared_ptr<const LabelIndex> GetSnapshot(const std::string& engineId) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto entry = mIndexes.find(engineId);
+    return entry == mIndexes.end() ? nullptr : entry->second;
+  }
+
+  /**
+   * @brief Forget an engine, for example when it is unloaded
+   * 
+   * @param engineId Engine ID
+   */
+  void Remove(const std::string& engineId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes.erase(engineId);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, std::shared_ptr<const LabelIndex>> mIndexes;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_LABEL_CHANGE_SET_H_
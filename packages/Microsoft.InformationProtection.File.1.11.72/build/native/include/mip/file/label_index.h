@@ -0,0 +1,368 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines LabelIndex, an immutable snapshot of an engine's labels with constant-time lookup by ID and name
+ * 
+ * @file label_index.h
+ */
+
+#ifndef API_MIP_FILE_LABEL_INDEX_H_
+#define API_MIP_FILE_LABEL_INDEX_H_
+
+#include <cctype>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/label.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Immutable snapshot of the sensitivity labels of a FileEngine, indexed by ID and by name
+ * 
+ * @note Built once per policy with a single call to FileEngine::ListSensitivityLabels. Every accessor returns a
+ *       reference or a pointer into the snapshot, so per-request label resolution does not allocate or copy the label
+ *       tree. A snapshot is never modified after construction and can be shared between threads freely; use
+ *       LabelIndexCache to get the snapshot matching an engine's current policy.
+ */
+class LabelIndex {
+public:
+  /**
+   * @brief Build a snapshot of the labels of an engine
+   * 
+   * @param engine File engine
+   * 
+   * @return Snapshot of the engine's current labels
+   */
+  static std::shared_ptr<const LabelIndex> Create(const std::shared_ptr<FileEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A FileEngine is required");
+    }
+    std::shared_ptr<LabelIndex> index(new LabelIndex(engine->GetPolicyFileId(), engine->ListSensitivityLabels()));
+    return index;
+  }
+
+  /**
+   * @brief Build a snapshot from a list of top-level labels
+   * 
+   * @param policyFileId Policy file ID the labels belong to
+   * @param labels Top-level labels; children are indexed as well
+   * 
+   * @return Snapshot of the labels
+   */
+  static std::shared_ptr<const LabelIndex> Create(
+      const std::string& policyFileId,
+      const std::vector<std::shared_ptr<Label>>& labels) {
+    std::shared_ptr<LabelIndex> index(new LabelIndex(policyFileId, labels));
+    return index;
+  }
+
+  /**
+   * @brief Get the policy file ID the snapshot was built from
+   * 
+   * @return Policy file ID
+   */
+  const std::string& GetPolicyFileId() const { return mPolicyFileId; }
+
+  /**
+   * @brief Get the top-level labels, in policy order
+   * 
+   * @return Top-level labels
+   */
+  const std::vector<std::shared_ptr<Label>>& GetLabels() const { return mLabels; }
+
+  /**
+   * @brief Get every label, parents before their children, in policy order
+   * 
+   * @return All labels
+   */
+  const std::vector<std::shared_ptr<Label>>& GetAllLabels() const { return mAllLabels; }
+
+  /**
+   * @brief Find a label by ID, ignoring case
+   * 
+   * @param id Label ID
+   * 
+   * @return The label, or nullptr if the policy has no such label
+   */
+  const std::shared_ptr<Label>& FindById(const std::string& id) const {
+    auto entry = mLabelsById.find(ToLower(id));
+    return entry == mLabelsById.end() ? GetEmptyLabel() : mAllLabels[entry->second];
+  }
+
+  /**
+   * @brief Find the labels with a name, ignoring case
+   * 
+   * @param name Label name
+   * 
+   * @return Matching labels in policy order, or an empty list. Sublabels of different parents may share a name.
+   */
+  const std::vector<std::shared_ptr<Label>>& FindByName(const std::string& name) const {
+    auto entry = mLabelsByName.find(ToLower(name));
+    return entry == mLabelsByName.end() ? GetEmptyLabels() : entry->second;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  LabelIndex(const std::string& policyFileId, const std::vector<std::shared_ptr<Label>>& labels)
+      : mPolicyFileId(policyFileId),
+        mLabels(labels) {
+    for (const auto& label : mLabels) {
+      Add(label);
+    }
+  }
+
+  void Add(const std::shared_ptr<Label>& label) {
+    if (!label) {
+      return;
+    }
+    mLabelsById.emplace(ToLower(label->GetId()), mAllLabels.size());
+    mLabelsByName[ToLower(label->GetName())].push_back(label);
+    mAllLabels.push_back(label);
+    for (const auto& child : label->GetChildren()) {
+      Add(child);
+    }
+  }
+
+  static std::string ToLower(const std::string& value) {
+    std::string lower(value);
+    for (char& c : lower) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return lower;
+  }
+
+  static const std::shared_ptr<Label>& GetEmptyLabel() {
+    static const std::shared_ptr<Label> kEmpty;
+    return kEmpty;
+  }
+
+  static const std::vector<std::shared_ptr<Label>>& GetEmptyLabels() {
+    static const std::vector<std::shared_ptr<Label>> kEmpty;
+    return kEmpty;
+  }
+
+  std::string mPolicyFileId;
+  std::vector<std::shared_ptr<Label>> mLabels;
+  std::vector<std::shared_ptr<Label>> mAllLabels;
+  std::unordered_map<std::string, size_t> mLabelsById;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Label>>> mLabelsByName;
+  /** @endcond */
+};
+
+/**
+ * @brief Thread-safe cache of LabelIndex snapshots, one per engine, rebuilt when the engine's policy changes
+ * 
+ * @note Get compares the engine's GetPolicyFileId with the cached snapshot and only lists labels again when it differs,
+ *       so a policy refresh is picked up on the next call while in-flight readers keep the snapshot they hold.
+ */
+class LabelIndexCache {
+public:
+  /**
+   * @brief Get the snapshot matching the current policy of an engine
+   * 
+   * @param engine File engine
+   * 
+   * @return Snapshot of the engine's labels
+   */
+  std::shared_ptr<const LabelIndex> Get(const std::shared_ptr<FileEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A FileEngine is required");
+    }
+    const std::string& engineId = engine->GetSettings().GetEngineId();
+    const std::string& policyFileId = engine->GetPolicyFileId();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto entry = mIndexes.find(engineId);
+      if (entry != mIndexes.end() && entry->second->GetPolicyFileId() == policyFileId) {
+        return entry->second;
+      }
+    }
+    // Build outside the lock so that one engine's rebuild does not stall lookups for the others
+    auto index = LabelIndex::Create(engine);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes[engineId] = index;
+    return index;
+  }
+
+  /**
+   * @brief Drop the snapshot of an engine, for example when the engine is unloaded
+   * 
+   * @param engineId Engine ID
+   */
+  void Remove(const std::string& engineId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes.erase(engineId);
+  }
+
+  /**
+   * @brief Drop all snapshots
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes.clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::shared_ptr<const LabelIndex>> mIndexes;
+  /** @endcond */
+};
+
+/**
+ * @brief Thread-safe cache of LabelIndex snapshots that shares label objects between engines of the same policy
+ * 
+ * @note Engines of different users in one tenant load the same policy file, yet each lists its own copy of every
+ *       label. The first engine to load a policy file ID becomes the base for it. Each later engine with that policy
+ *       file ID lists its labels once, and every top-level label whose subtree matches the base's is replaced by the
+ *       base's object, so the engine's own copies are released as soon as the listing goes out of scope. An engine
+ *       that sees exactly the base's labels gets the base snapshot itself. Per-user differences, such as labels
+ *       hidden by filters or scoped to other users, become an overlay snapshot that holds the shared objects for the
+ *       common labels and the engine's own objects only for the labels that differ. Snapshots are rebuilt when an
+ *       engine's policy file ID changes, as with LabelIndexCache.
+ */
+class SharedLabelIndexCache {
+public:
+  /**
+   * @brief Get the snapshot matching the current policy of an engine
+   * 
+   * @param engine File engine
+   * 
+   * @return Snapshot of the engine's labels, sharing label objects with other engines of the same policy
+   */
+  std::shared_ptr<const LabelIndex> Get(const std::shared_ptr<FileEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A FileEngine is required");
+    }
+    const std::string& engineId = engine->GetSettings().GetEngineId();
+    const std::string& policyFileId = engine->GetPolicyFileId();
+    std::shared_ptr<const LabelIndex> base;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto entry = mIndexes.find(engineId);
+      if (entry != mIndexes.end() && entry->second->GetPolicyFileId() == policyFileId) {
+        return entry->second;
+      }
+      auto baseEntry = mBases.find(policyFileId);
+      if (baseEntry != mBases.end()) {
+        base = baseEntry->second.lock();
+      }
+    }
+    // List and merge outside the lock so that one engine's rebuild does not stall lookups for the others
+    std::vector<std::shared_ptr<Label>> labels = engine->ListSensitivityLabels();
+    std::shared_ptr<const LabelIndex> index;
+    if (base) {
+      bool isBase = labels.size() == base->GetLabels().size();
+      for (size_t i = 0; i < labels.size(); ++i) {
+        const std::shared_ptr<Label>& shared = base->FindById(labels[i] ? labels[i]->GetId() : std::string());
+        if (shared && IsSameSubtree(*shared, *labels[i])) {
+          labels[i] = shared;
+        }
+        isBase = isBase && labels[i] == base->GetLabels()[i];
+      }
+      index = isBase ? base : LabelIndex::Create(policyFileId, labels);
+    } else {
+      index = LabelIndex::Create(policyFileId, labels);
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!base) {
+      mBases[policyFileId] = index;
+    }
+    mIndexes[engineId] = index;
+    for (auto it = mBases.begin(); it != mBases.end();) {
+      it = it->second.expired() ? mBases.erase(it) : std::next(it);
+    }
+    return index;
+  }
+
+  /**
+   * @brief Drop the snapshot of an engine, for example when the engine is unloaded
+   * 
+   * @param engineId Engine ID
+   */
+  void Remove(const std::string& engineId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes.erase(engineId);
+  }
+
+  /**
+   * @brief Drop all snapshots
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndexes.clear();
+    mBases.clear();
+  }
+
+  /**
+   * @brief Get the number of distinct base snapshots, at most one per policy file ID in use
+   * 
+   * @return Base snapshot count
+   */
+  size_t GetBaseCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t count = 0;
+    for (const auto& base : mBases) {
+      count += base.second.expired() ? 0 : 1;
+    }
+    return count;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Within one policy file, a label ID identifies the definition; only the visible children can differ per user
+  static bool IsSameSubtree(const Label& shared, const Label& own) {
+    const auto& sharedChildren = shared.GetChildren();
+    const auto& ownChildren = own.GetChildren();
+    if (sharedChildren.size() != ownChildren.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < sharedChildren.size(); ++i) {
+      if (!sharedChildren[i] || !ownChildren[i] || sharedChildren[i]->GetId() != ownChildren[i]->GetId() ||
+          !IsSameSubtree(*sharedChildren[i], *ownChildren[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, std::shared_ptr<const LabelIndex>> mIndexes;
+  std::unordered_map<std::string, std::weak_ptr<const LabelIndex>> mBases;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_LABEL_INDEX_H_
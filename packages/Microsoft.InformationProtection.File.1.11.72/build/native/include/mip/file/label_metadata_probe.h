@@ -0,0 +1,301 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ProbeOpcLabel, which reads the label of an Office document from its label metadata parts only
+ * 
+ * @file label_metadata_probe.h
+ */
+
+#ifndef API_MIP_FILE_LABEL_METADATA_PROBE_H_
+#define API_MIP_FILE_LABEL_METADATA_PROBE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/opc_metadata_commit.h"
+#include "mip/mip_namespace.h"
+#include "mip/read_budget_stream.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Label found by ProbeOpcLabel
+ */
+struct OpcLabelProbeResult {
+  bool isDefinitive = false; /**< False if the document could not be inspected within the budget or is not a
+                                  plain Office package; use FileHandler or PolicyHandler::IsLabeled instead */
+  bool isLabeled = false;    /**< If an enabled Microsoft label was found */
+  std::string labelId;       /**< Label ID, without braces */
+  std::string siteId;        /**< Tenant ID that applied the label, without braces */
+  std::string method;        /**< Assignment method as stored, e.g. "Standard" or "Privileged" */
+  int64_t bytesRead = 0;     /**< Bytes read from the stream */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace opclabelprobe {
+
+struct PartLocation {
+  bool isFound = false;
+  uint16_t method = 0;
+  uint32_t compressedSize = 0;
+  uint32_t uncompressedSize = 0;
+  uint32_t crc = 0;
+  uint32_t localOffset = 0;
+};
+
+inline std::string StripBraces(const std::string& value) {
+  if (value.size() >= 2 && value.front() == '{' && value.back() == '}') {
+    return value.substr(1, value.size() - 2);
+  }
+  return value;
+}
+
+inline bool IsTrue(const std::string& value) {
+  return value == "1" || opcmetadata::EqualsIgnoreCase(value, "true");
+}
+
+inline std::string ReadPart(const std::shared_ptr<Stream>& stream, const PartLocation& part, uint32_t maxPartSize) {
+  using namespace opcmetadata;
+  if (part.compressedSize > maxPartSize || part.uncompressedSize > maxPartSize ||
+      (part.method != kStoredMethod && part.method != kDeflatedMethod)) {
+    throw BadInputError("Label metadata part is too large or not supported");
+  }
+  uint8_t localHeader[kLocalHeaderSize];
+  ReadAt(stream, part.localOffset, localHeader, kLocalHeaderSize);
+  if (GetUInt32(localHeader) != kLocalHeaderSignature) {
+    throw BadInputError("Invalid OPC local header");
+  }
+  std::vector<uint8_t> compressed(part.compressedSize);
+  ReadAt(stream, static_cast<int64_t>(part.localOffset) + static_cast<int64_t>(kLocalHeaderSize) +
+      GetUInt16(localHeader + 26) + GetUInt16(localHeader + 28), compressed.data(), part.compressedSize);
+  std::vector<uint8_t> content = part.method == kStoredMethod ? compressed :
+      Inflate(compressed.data(), compressed.size(), part.uncompressedSize);
+  if (Crc32(content.data(), content.size()) != part.crc) {
+    throw BadInputError("Label metadata part failed its checksum");
+  }
+  return std::string(content.begin(), content.end());
+}
+
+// docMetadata/LabelInfo.xml: <clbl:label id="{...}" enabled="1" method="Standard" siteId="{...}" removed="0" />
+inline bool ParseLabelInfo(const std::string& xml, OpcLabelProbeResult& result) {
+  size_t position = 0;
+  while ((position = xml.find("<clbl:label", position)) != std::string::npos) {
+    size_t end = xml.find('>', position);
+    if (end == std::string::npos) {
+      return false;
+    }
+    std::string tag = xml.substr(position, end - position);
+    std::string enabled;
+    std::string removed;
+    std::string id;
+    if (opcmetadata::GetAttribute(tag, "id", id) && opcmetadata::GetAttribute(tag, "enabled", enabled) &&
+        IsTrue(enabled) && !(opcmetadata::GetAttribute(tag, "removed", removed) && IsTrue(removed))) {
+      result.isLabeled = true;
+      result.labelId = StripBraces(id);
+      opcmetadata::GetAttribute(tag, "method", result.method);
+      if (opcmetadata::GetAttribute(tag, "siteId", result.siteId)) {
+        result.siteId = StripBraces(result.siteId);
+      }
+      return true;
+    }
+    position = end;
+  }
+  return true;
+}
+
+// docProps/custom.xml: MSIP_Label_<id>_Enabled, _SiteId and _Method properties
+inline bool ParseCustomProperties(const std::string& xml, OpcLabelProbeResult& result) {
+  const std::string prefix = "MSIP_Label_";
+  std::vector<std::pair<std::string, std::string>> properties;
+  size_t position = 0;
+  while ((position = xml.find("<property", position)) != std::string::npos) {
+    size_t tagEnd = xml.find('>', position);
+    size_t close = xml.find("</property>", position);
+    if (tagEnd == std::string::npos || close == std::string::npos || close < tagEnd) {
+      return false;
+    }
+    std::string name;
+    if (opcmetadata::GetAttribute(xml.substr(position, tagEnd - position), "name", name) &&
+        name.compare(0, prefix.size(), prefix) == 0) {
+      // The value is the text of the single vt: element inside the property
+      size_t valueStart = xml.find('>', tagEnd + 1);
+      size_t valueEnd = xml.rfind('<', close - 1);
+      std::string value = valueStart != std::string::npos && valueEnd != std::string::npos && valueStart < valueEnd ?
+          opcmetadata::XmlUnescape(xml.substr(valueStart + 1, valueEnd - valueStart - 1)) : std::string();
+      properties.emplace_back(name, value);
+    }
+    position = close;
+  }
+  const std::string enabledSuffix = "_Enabled";
+  for (const auto& property : properties) {
+    const std::string& name = property.first;
+    if (name.size() <= prefix.size() + enabledSuffix.size() ||
+        name.compare(name.size() - enabledSuffix.size(), enabledSuffix.size(), enabledSuffix) != 0 ||
+        !IsTrue(property.second)) {
+      continue;
+    }
+    std::string stem = name.substr(0, name.size() - enabledSuffix.size());
+    result.isLabeled = true;
+    result.labelId = stem.substr(prefix.size());
+    for (const auto& other : properties) {
+      if (other.first == stem + "_SiteId") {
+        result.siteId = StripBraces(other.second);
+      } else if (other.first == stem + "_Method") {
+        result.method = other.second;
+      }
+    }
+    return true;
+  }
+  return true;
+}
+
+inline OpcLabelProbeResult Probe(const std::shared_ptr<Stream>& stream, uint32_t maxPartSize) {
+  using namespace opcmetadata;
+  OpcLabelProbeResult result;
+  int64_t packageSize = stream->Size();
+  if (packageSize < static_cast<int64_t>(kEndOfCentralDirectorySize)) {
+    return result;
+  }
+
+  // Most packages have no archive comment, so try the last 22 bytes before scanning the longest possible comment
+  std::vector<uint8_t> tail;
+  int64_t recordIndex = -1;
+  for (int64_t tailSize : {static_cast<int64_t>(kEndOfCentralDirectorySize),
+                           (std::min)(packageSize, static_cast<int64_t>(kEndOfCentralDirectorySize + 0xFFFF))}) {
+    tail.resize(static_cast<size_t>(tailSize));
+    ReadAt(stream, packageSize - tailSize, tail.data(), tailSize);
+    for (recordIndex = tailSize - static_cast<int64_t>(kEndOfCentralDirectorySize); recordIndex >= 0 &&
+         GetUInt32(&tail[static_cast<size_t>(recordIndex)]) != kEndOfCentralDirectorySignature; --recordIndex) {
+    }
+    if (recordIndex >= 0 || tailSize == packageSize) {
+      break;
+    }
+  }
+  if (recordIndex < 0) {
+    return result;
+  }
+  const uint8_t* record = &tail[static_cast<size_t>(recordIndex)];
+  uint16_t entryCount = GetUInt16(record + 10);
+  uint32_t directorySize = GetUInt32(record + 12);
+  uint32_t directoryOffset = GetUInt32(record + 16);
+  if (entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF ||
+      static_cast<int64_t>(directoryOffset) + directorySize > packageSize) {
+    return result;
+  }
+
+  std::vector<uint8_t> directory(directorySize);
+  ReadAt(stream, directoryOffset, directory.data(), directorySize);
+  PartLocation labelInfo;
+  PartLocation customProperties;
+  bool isOfficePackage = false;
+  size_t position = 0;
+  for (uint16_t i = 0; i < entryCount; ++i) {
+    if (position + kCentralHeaderSize > directory.size() ||
+        GetUInt32(&directory[position]) != kCentralHeaderSignature) {
+      return result;
+    }
+    const uint8_t* header = &directory[position];
+    uint16_t nameSize = GetUInt16(header + 28);
+    if (position + kCentralHeaderSize + nameSize > directory.size()) {
+      return result;
+    }
+    std::string name(reinterpret_cast<const char*>(header + kCentralHeaderSize), nameSize);
+    PartLocation* part = EqualsIgnoreCase(name, kLabelInfoPartName) ? &labelInfo :
+        EqualsIgnoreCase(name, kCustomPropertiesPartName) ? &customProperties : nullptr;
+    isOfficePackage = isOfficePackage || EqualsIgnoreCase(name, "[Content_Types].xml");
+    if (part) {
+      if ((GetUInt16(header + 8) & kEncryptedFlag) != 0) {
+        return result;
+      }
+      part->isFound = true;
+      part->method = GetUInt16(header + 10);
+      part->crc = GetUInt32(header + 16);
+      part->compressedSize = GetUInt32(header + 20);
+      part->uncompressedSize = GetUInt32(header + 24);
+      part->localOffset = GetUInt32(header + 42);
+    }
+    position += kCentralHeaderSize + nameSize + GetUInt16(header + 30) + GetUInt16(header + 32);
+  }
+  if (!isOfficePackage) {
+    return result;
+  }
+
+  // Label information in docMetadata/LabelInfo.xml takes precedence over the custom properties
+  bool isParsed = labelInfo.isFound ? ParseLabelInfo(ReadPart(stream, labelInfo, maxPartSize), result) :
+      !customProperties.isFound || ParseCustomProperties(ReadPart(stream, customProperties, maxPartSize), result);
+  result.isDefinitive = isParsed;
+  if (!isParsed) {
+    result = OpcLabelProbeResult();
+  }
+  return result;
+}
+
+} // namespace opclabelprobe
+/** @endcond */
+
+/**
+ * @brief Read the Microsoft label of an Office (OPC) document from its label metadata only
+ * 
+ * @param stream Document
+ * @param maxBytesToRead Most bytes that may be read from the stream
+ * @param maxPartSize Largest label metadata part that will be read and inflated
+ * 
+ * @return Label ID, tenant and method, or a result that is not definitive
+ * 
+ * @note Only the ZIP end record, the central directory, and docMetadata/LabelInfo.xml or docProps/custom.xml are
+ *       read; no ContentLabel, engine or policy is involved. The result is not definitive, and the caller should fall
+ *       back to FileHandler, when the stream is not a plain Office package (for example a PDF or a protected
+ *       document, whose label metadata is encrypted), uses ZIP64, is malformed, or cannot be inspected within the
+ *       budget. Like PolicyHandler::IsLabeled, only Microsoft labels are detected.
+ */
+inline OpcLabelProbeResult ProbeOpcLabel(
+    const std::shared_ptr<Stream>& stream,
+    int64_t maxBytesToRead = 1024 * 1024,
+    uint32_t maxPartSize = 256 * 1024) {
+  if (!stream) {
+    throw BadInputError("ProbeOpcLabel requires a stream");
+  }
+  auto budgetStream = std::make_shared<ReadBudgetStream>(stream, maxBytesToRead);
+  OpcLabelProbeResult result;
+  try {
+    result = opclabelprobe::Probe(budgetStream, maxPartSize);
+  } catch (const Error&) {
+    // Budget failures and malformed packages both leave the result non-definitive
+    result = OpcLabelProbeResult();
+  }
+  result.bytesRead = budgetStream->GetBytesRead();
+  return result;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_LABEL_METADATA_PROBE_H_
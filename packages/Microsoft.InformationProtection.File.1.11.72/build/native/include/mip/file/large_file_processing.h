@@ -0,0 +1,105 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that keep the memory used by a file handler bounded for content of any size
+ * 
+ * @file large_file_processing.h
+ */
+
+#ifndef API_MIP_FILE_LARGE_FILE_PROCESSING_H_
+#define API_MIP_FILE_LARGE_FILE_PROCESSING_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_sync.h"
+#include "mip/mapped_file_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/spill_stream.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Decrypts a file to a stream, through a temporary file when the content is larger than the memory ceiling
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param contentSize Size of the input, e.g. Stream::Size of the stream the handler was created from
+ * @param settings maxMemoryBytes is the ceiling; the other settings are not used
+ * 
+ * @return Decrypted content. Failures are rethrown.
+ * 
+ * @note GetDecryptedTemporaryStreamAsync may hold the decrypted content in memory. Up to the ceiling that is used;
+ *       beyond it, GetDecryptedTemporaryFileAsync decrypts to disk and the file is read through a read-only
+ *       MappedFileStream, whose pages the OS can evict, so resident memory does not grow with the content. When
+ *       the layout of the protected payload is known, CreateLazyDecryptedStream avoids the temporary copy entirely.
+ */
+inline std::shared_ptr<Stream> GetDecryptedStreamWithinCeiling(
+    const std::shared_ptr<FileHandler>& handler,
+    int64_t contentSize,
+    const SpillStreamSettings& settings = SpillStreamSettings()) {
+  if (!handler) {
+    throw BadInputError("GetDecryptedStreamWithinCeiling requires a file handler");
+  }
+  if (contentSize >= 0 && contentSize <= settings.maxMemoryBytes) {
+    return GetDecryptedTemporaryStream(handler);
+  }
+  return CreateStreamFromMappedFile(GetDecryptedTemporaryFile(handler), MappedFileAccess::Read);
+}
+
+/**
+ * @brief Commits the changes of a file to a temporary stream whose memory use is capped, and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param settings Memory ceiling, temporary directory and budget of the output
+ * @param isCommitted [Output] true if changes were committed
+ * 
+ * @return Committed content, positioned at its start; it spills to a temporary file past the ceiling. Failures are
+ *         rethrown.
+ * 
+ * @note Use it instead of committing to a buffer-backed stream, such as one from CreateStreamFromBuffer, when the
+ *       output is uploaded or moved afterwards: the memory held for the output is at most settings.maxMemoryBytes
+ *       whatever the file size. Commit to a file path when the output stays on disk.
+ */
+inline std::shared_ptr<SpillStream> CommitFileToSpillStream(
+    const std::shared_ptr<FileHandler>& handler,
+    const SpillStreamSettings& settings,
+    bool& isCommitted) {
+  if (!handler) {
+    throw BadInputError("CommitFileToSpillStream requires a file handler");
+  }
+  auto output = CreateSpillStream(settings);
+  isCommitted = CommitFile(handler, output);
+  output->Seek(0);
+  return output;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_LARGE_FILE_PROCESSING_H_
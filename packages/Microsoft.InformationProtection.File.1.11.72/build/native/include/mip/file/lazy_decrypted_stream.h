@@ -0,0 +1,119 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that create decrypting streams which decrypt on demand
+ * 
+ * @file lazy_decrypted_stream.h
+ */
+
+#ifndef API_MIP_FILE_LAZY_DECRYPTED_STREAM_H_
+#define API_MIP_FILE_LAZY_DECRYPTED_STREAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/decrypted_segment_cache.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Creates a view of protected content that decrypts segments only as they are read or seeked to
+ * 
+ * @param protectionHandler Handler of the protected content
+ * @param backingStream Stream holding the encrypted content
+ * @param contentStartPosition Position (in bytes) within @p backingStream where the encrypted content begins
+ * @param contentSize Size (in bytes) of the encrypted content, or -1 if it runs to the end of @p backingStream
+ * @param settings Settings of the cache of decrypted segments
+ * 
+ * @return Decrypting stream, positioned at the start of the cleartext
+ * 
+ * @note Unlike FileHandler::GetDecryptedTemporaryStreamAsync, which decrypts the whole document before it reports
+ *       success, the time to the first byte and the memory used do not depend on the content size: only the segments
+ *       read, the prefetched ones and the most recently used ones up to the cache budget are decrypted and held.
+ */
+inline std::shared_ptr<Stream> CreateLazyDecryptedStream(
+    const std::shared_ptr<ProtectionHandler>& protectionHandler,
+    const std::shared_ptr<Stream>& backingStream,
+    int64_t contentStartPosition,
+    int64_t contentSize = -1,
+    const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings()) {
+  if (!protectionHandler) {
+    throw BadInputError("CreateLazyDecryptedStream requires a protection handler");
+  }
+  if (!backingStream) {
+    throw BadInputError("CreateLazyDecryptedStream requires a backing stream");
+  }
+  if (contentStartPosition < 0 || contentStartPosition > backingStream->Size()) {
+    throw BadInputError("Protected content start position is outside of the backing stream");
+  }
+  if (contentSize < 0) {
+    contentSize = backingStream->Size() - contentStartPosition;
+  }
+  auto protectedStream = protectionHandler->CreateProtectedStream(backingStream, contentStartPosition, contentSize);
+  protectedStream->Seek(0);
+  return CreateDecryptedSegmentCacheStream(protectedStream, settings);
+}
+
+/**
+ * @brief Creates a view of a protected file's content that decrypts segments only as they are read
+ * 
+ * @param fileHandler Handler of the protected file
+ * @param backingStream Stream holding the encrypted content
+ * @param contentStartPosition Position (in bytes) within @p backingStream where the encrypted content begins
+ * @param contentSize Size (in bytes) of the encrypted content, or -1 if it runs to the end of @p backingStream
+ * @param settings Settings of the cache of decrypted segments
+ * 
+ * @return Decrypting stream, positioned at the start of the cleartext
+ * 
+ * @note The file format parsers that locate the encrypted payload live behind FileHandler, so the caller supplies
+ *       its range, for example from its own container or index. Use GetDecryptedTemporaryStreamAsync when it is
+ *       not known.
+ */
+inline std::shared_ptr<Stream> CreateLazyDecryptedStream(
+    const std::shared_ptr<FileHandler>& fileHandler,
+    const std::shared_ptr<Stream>& backingStream,
+    int64_t contentStartPosition,
+    int64_t contentSize = -1,
+    const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings()) {
+  if (!fileHandler) {
+    throw BadInputError("CreateLazyDecryptedStream requires a file handler");
+  }
+  auto protectionHandler = fileHandler->GetProtection();
+  if (!protectionHandler) {
+    throw BadInputError("File is not protected");
+  }
+  return CreateLazyDecryptedStream(protectionHandler, backingStream, contentStartPosition, contentSize, settings);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_LAZY_DECRYPTED_STREAM_H_
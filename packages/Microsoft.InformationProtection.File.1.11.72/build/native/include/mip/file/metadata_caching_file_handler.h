@@ -0,0 +1,274 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MetadataCachingFileHandler, a FileHandler that parses label and properties once and shares them
+ * 
+ * @file metadata_caching_file_handler.h
+ */
+
+#ifndef API_MIP_FILE_METADATA_CACHING_FILE_HANDLER_H_
+#define API_MIP_FILE_METADATA_CACHING_FILE_HANDLER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief File properties, as returned by FileHandler::GetProperties
+ */
+using FileProperties = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief Immutable view of the properties of a file, with lookup by name
+ */
+class FilePropertiesView {
+public:
+  /**
+   * @brief FilePropertiesView constructor
+   * 
+   * @param properties Properties of a file
+   */
+  explicit FilePropertiesView(FileProperties&& properties) : mProperties(std::move(properties)) {
+    mIndex.reserve(mProperties.size());
+    for (size_t i = 0; i < mProperties.size(); ++i) {
+      // The first of duplicate names wins, as it would for a caller scanning the list
+      mIndex.emplace(mProperties[i].first, i);
+    }
+  }
+
+  /**
+   * @brief Get all properties
+   * 
+   * @return Properties, in the order the handler returned them
+   */
+  const FileProperties& GetProperties() const { return mProperties; }
+
+  /**
+   * @brief Get the value of a property
+   * 
+   * @param name Property name
+   * 
+   * @return Value of the property, nullptr if the file has no such property
+   */
+  const std::string* Find(const std::string& name) const {
+    auto entry = mIndex.find(name);
+    return entry == mIndex.end() ? nullptr : &mProperties[entry->second].second;
+  }
+
+private:
+  FileProperties mProperties;
+  std::unordered_map<std::string, size_t> mIndex;
+};
+
+/**
+ * @brief FileHandler that reads the label and properties of its file once and shares them as immutable views
+ * 
+ * @note Every call is forwarded to the wrapped handler. GetLabel returns the same ContentLabel on every call, and
+ *       GetPropertiesView and GetProperty share one copy of the properties per version, so services that read the
+ *       metadata of every document repeatedly pay for parsing and copying it once. GetProperties still returns a
+ *       copy, as its signature requires, but a copy of the cached list. SetLabel, DeleteLabel, SetProtection and
+ *       RemoveProtection drop the cached metadata. The wrapper is safe to read from several threads.
+ */
+class MetadataCachingFileHandler : public FileHandler {
+public:
+  /**
+   * @brief MetadataCachingFileHandler constructor
+   * 
+   * @param handler Handler to wrap
+   */
+  explicit MetadataCachingFileHandler(const std::shared_ptr<FileHandler>& handler) : mHandler(handler) {
+    if (!mHandler) {
+      throw BadInputError("MetadataCachingFileHandler requires a FileHandler");
+    }
+  }
+
+  /**
+   * @brief Get the wrapped handler
+   * 
+   * @return Wrapped handler
+   */
+  const std::shared_ptr<FileHandler>& GetInnerHandler() const { return mHandler; }
+
+  /**
+   * @brief Get the properties of the file as a shared, immutable view
+   * 
+   * @param version Properties version, as for FileHandler::GetProperties
+   * 
+   * @return Properties view, read from the wrapped handler on first access
+   */
+  std::shared_ptr<const FilePropertiesView> GetPropertiesView(uint32_t version) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& view = mProperties[version];
+    if (!view) {
+      view = std::make_shared<const FilePropertiesView>(mHandler->GetProperties(version));
+    }
+    return view;
+  }
+
+  /**
+   * @brief Get the value of one property of the file
+   * 
+   * @param name Property name
+   * @param version Properties version, as for FileHandler::GetProperties
+   * 
+   * @return Value of the property, sharing the cached view, or nullptr if the file has no such property
+   */
+  std::shared_ptr<const std::string> GetProperty(const std::string& name, uint32_t version) {
+    auto view = GetPropertiesView(version);
+    const std::string* value = view->Find(name);
+    return value ? std::shared_ptr<const std::string>(view, value) : nullptr;
+  }
+
+  std::shared_ptr<ContentLabel> GetLabel() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mHasLabel) {
+      mLabel = mHandler->GetLabel();
+      mHasLabel = true;
+    }
+    return mLabel;
+  }
+
+  std::vector<std::pair<std::string, std::string>> GetProperties(uint32_t version) override {
+    return GetPropertiesView(version)->GetProperties();
+  }
+
+  std::shared_ptr<ProtectionHandler> GetProtection() override { return mHandler->GetProtection(); }
+
+  void RegisterContentForTrackingAndRevocationAsync(
+      bool isOwnerNotificationEnabled,
+      const std::shared_ptr<ProtectionEngine::Observer>& observer,
+      const std::shared_ptr<void>& context) override {
+    mHandler->RegisterContentForTrackingAndRevocationAsync(isOwnerNotificationEnabled, observer, context);
+  }
+
+  void RevokeContentAsync(
+      const std::shared_ptr<ProtectionEngine::Observer>& observer,
+      const std::shared_ptr<void>& context) override {
+    mHandler->RevokeContentAsync(observer, context);
+  }
+
+  void ClassifyAsync(const std::shared_ptr<void>& context) override { mHandler->ClassifyAsync(context); }
+
+  void InspectAsync(const std::shared_ptr<void>& context) override { mHandler->InspectAsync(context); }
+
+  void SetLabel(
+      const std::shared_ptr<Label>& label,
+      const LabelingOptions& labelingOptions,
+      const ProtectionSettings& protectionSettings) override {
+    mHandler->SetLabel(label, labelingOptions, protectionSettings);
+    Invalidate();
+  }
+
+  void DeleteLabel(const LabelingOptions& labelingOptions) override {
+    mHandler->DeleteLabel(labelingOptions);
+    Invalidate();
+  }
+
+  void SetProtection(
+      const std::shared_ptr<ProtectionDescriptor>& protectionDescriptor,
+      const ProtectionSettings& protectionSettings) override {
+    mHandler->SetProtection(protectionDescriptor, protectionSettings);
+    Invalidate();
+  }
+
+  void SetProtection(const std::shared_ptr<ProtectionHandler>& protectionHandler) override {
+    mHandler->SetProtection(protectionHandler);
+    Invalidate();
+  }
+
+  void RemoveProtection() override {
+    mHandler->RemoveProtection();
+    Invalidate();
+  }
+
+  void CommitAsync(const std::string& outputFilePath, const std::shared_ptr<void>& context) override {
+    mHandler->CommitAsync(outputFilePath, context);
+  }
+
+  void CommitAsync(const std::shared_ptr<Stream>& outputStream, const std::shared_ptr<void>& context) override {
+    mHandler->CommitAsync(outputStream, context);
+  }
+
+  bool IsModified() override { return mHandler->IsModified(); }
+
+  void GetDecryptedTemporaryFileAsync(const std::shared_ptr<void>& context) override {
+    mHandler->GetDecryptedTemporaryFileAsync(context);
+  }
+
+  void GetDecryptedTemporaryStreamAsync(const std::shared_ptr<void>& context) override {
+    mHandler->GetDecryptedTemporaryStreamAsync(context);
+  }
+
+  void NotifyCommitSuccessful(const std::string& actualFilePath) override {
+    mHandler->NotifyCommitSuccessful(actualFilePath);
+  }
+
+  std::string GetOutputFileName() override { return mHandler->GetOutputFileName(); }
+
+  /**
+   * @brief Drop the cached label and properties, so that the next access reads them from the wrapped handler
+   */
+  void Invalidate() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLabel.reset();
+    mHasLabel = false;
+    mProperties.clear();
+  }
+
+private:
+  std::shared_ptr<FileHandler> mHandler;
+  std::mutex mMutex;
+  std::shared_ptr<ContentLabel> mLabel;
+  bool mHasLabel = false;
+  std::map<uint32_t, std::shared_ptr<const FilePropertiesView>> mProperties;
+};
+
+/**
+ * @brief Wrap a handler so that its label and properties are read once
+ * 
+ * @param handler Handler to wrap, e.g. from FileEngine::CreateFileHandlerAsync
+ * 
+ * @return Wrapping handler
+ */
+inline std::shared_ptr<MetadataCachingFileHandler> CreateMetadataCachingFileHandler(
+    const std::shared_ptr<FileHandler>& handler) {
+  return std::make_shared<MetadataCachingFileHandler>(handler);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_METADATA_CACHING_FILE_HANDLER_H_
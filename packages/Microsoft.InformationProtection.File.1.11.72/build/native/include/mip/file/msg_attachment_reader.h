@@ -0,0 +1,471 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a reader that lists the attachments of a .msg file and reads their content on demand
+ * 
+ * @file msg_attachment_reader.h
+ */
+
+#ifndef API_MIP_FILE_MSG_ATTACHMENT_READER_H_
+#define API_MIP_FILE_MSG_ATTACHMENT_READER_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/msg_inspector.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace msgattachments {
+
+const uint32_t kEndOfChain = 0xFFFFFFFE;
+const uint32_t kNoStream = 0xFFFFFFFF;
+const uint8_t kStorageObject = 1;
+const uint8_t kStreamObject = 2;
+const uint8_t kRootObject = 5;
+const size_t kHeaderSize = 512;
+const size_t kDirectoryEntrySize = 128;
+const size_t kHeaderDifatCount = 109;
+const char kAttachmentStoragePrefix[] = "__attach_version1.0_#";
+const char kAttachDataStream[] = "__substg1.0_37010102";
+const char kAttachFileNameProperty[] = "__substg1.0_3704";
+const char kAttachLongFileNameProperty[] = "__substg1.0_3707";
+const char kAttachPathNameProperty[] = "__substg1.0_3708";
+const char kAttachLongPathNameProperty[] = "__substg1.0_370D";
+
+inline uint16_t GetUInt16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+inline uint32_t GetUInt32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+      (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline bool StartsWithIgnoreCase(const std::string& value, const std::string& prefix) {
+  return value.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), value.begin(), [](char a, char b) {
+    return std::toupper(static_cast<unsigned char>(a)) == std::toupper(static_cast<unsigned char>(b));
+  });
+}
+
+inline std::string Utf16ToUtf8(const uint8_t* data, size_t size) {
+  std::string utf8;
+  utf8.reserve(size / 2);
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    uint32_t codePoint = GetUInt16(data + i);
+    if (codePoint == 0) {
+      break;
+    }
+    if (codePoint >= 0xD800 && codePoint < 0xDC00 && i + 3 < size) {
+      uint32_t low = GetUInt16(data + i + 2);
+      if (low >= 0xDC00 && low < 0xE000) {
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+        i += 2;
+      }
+    }
+    if (codePoint < 0x80) {
+      utf8 += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+      utf8 += static_cast<char>(0xC0 | (codePoint >> 6));
+      utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+      utf8 += static_cast<char>(0xE0 | (codePoint >> 12));
+      utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+      utf8 += static_cast<char>(0xF0 | (codePoint >> 18));
+      utf8 += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+      utf8 += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      utf8 += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+  }
+  return utf8;
+}
+
+struct DirectoryEntry {
+  std::string name;
+  uint8_t type;
+  uint32_t left;
+  uint32_t right;
+  uint32_t child;
+  uint32_t startSector;
+  int64_t size;
+};
+
+// Parsed structure of a compound file (MS-CFB): sector allocation tables and directory. Content is read on demand.
+class CompoundFile {
+public:
+  explicit CompoundFile(const std::shared_ptr<Stream>& stream) : mStream(stream) {
+    uint8_t header[kHeaderSize];
+    static const uint8_t kSignature[8] = {0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1};
+    if (mStream->Size() < static_cast<int64_t>(kHeaderSize)) {
+      throw BadInputError("File is not a compound file");
+    }
+    ReadAt(0, header, kHeaderSize);
+    if (!std::equal(kSignature, kSignature + 8, header)) {
+      throw BadInputError("File is not a compound file");
+    }
+    mIsVersion3 = GetUInt16(header + 0x1A) == 3;
+    mSectorShift = GetUInt16(header + 0x1E);
+    mMiniSectorShift = GetUInt16(header + 0x20);
+    if ((mSectorShift != 9 && mSectorShift != 12) || mMiniSectorShift != 6) {
+      throw BadInputError("Unsupported compound file sector size");
+    }
+    mMiniStreamCutoff = GetUInt32(header + 0x38);
+    uint32_t fatSectorCount = GetUInt32(header + 0x2C);
+    uint32_t sectorCount = static_cast<uint32_t>((mStream->Size() >> mSectorShift) + 1);
+    if (fatSectorCount > sectorCount) {
+      throw BadInputError("Invalid compound file allocation table");
+    }
+
+    // Locate the allocation table sectors, first from the header, then from the DIFAT chain
+    std::vector<uint32_t> fatSectors;
+    for (size_t i = 0; i < kHeaderDifatCount && fatSectors.size() < fatSectorCount; ++i) {
+      fatSectors.push_back(GetUInt32(header + 0x4C + 4 * i));
+    }
+    uint32_t difatSector = GetUInt32(header + 0x44);
+    std::vector<uint8_t> sector(GetSectorSize());
+    for (uint32_t i = 0; fatSectors.size() < fatSectorCount && difatSector < kEndOfChain; ++i) {
+      if (i > sectorCount) {
+        throw BadInputError("Invalid compound file DIFAT chain");
+      }
+      ReadSector(difatSector, sector.data());
+      for (size_t entry = 0; entry + 1 < sector.size() / 4 && fatSectors.size() < fatSectorCount; ++entry) {
+        fatSectors.push_back(GetUInt32(&sector[4 * entry]));
+      }
+      difatSector = GetUInt32(&sector[sector.size() - 4]);
+    }
+    if (fatSectors.size() != fatSectorCount) {
+      throw BadInputError("Invalid compound file DIFAT chain");
+    }
+    mFat.reserve(fatSectorCount * (sector.size() / 4));
+    for (uint32_t fatSector : fatSectors) {
+      ReadSector(fatSector, sector.data());
+      for (size_t entry = 0; entry < sector.size() / 4; ++entry) {
+        mFat.push_back(GetUInt32(&sector[4 * entry]));
+      }
+    }
+
+    // Directory, then the mini stream and its allocation table
+    std::vector<uint8_t> directory = ReadChain(mFat, GetUInt32(header + 0x30));
+    for (size_t offset = 0; offset + kDirectoryEntrySize <= directory.size(); offset += kDirectoryEntrySize) {
+      const uint8_t* data = &directory[offset];
+      DirectoryEntry entry;
+      entry.name = Utf16ToUtf8(data, (std::min)(static_cast<size_t>(GetUInt16(data + 64)), static_cast<size_t>(64)));
+      entry.type = data[66];
+      entry.left = GetUInt32(data + 68);
+      entry.right = GetUInt32(data + 72);
+      entry.child = GetUInt32(data + 76);
+      entry.startSector = GetUInt32(data + 116);
+      uint64_t size = GetUInt32(data + 120) | (mIsVersion3 ? 0 : static_cast<uint64_t>(GetUInt32(data + 124)) << 32);
+      entry.size = static_cast<int64_t>((std::min)(size, static_cast<uint64_t>(mStream->Size())));
+      mEntries.push_back(entry);
+    }
+    if (mEntries.empty() || mEntries[0].type != kRootObject) {
+      throw BadInputError("Compound file has no root storage");
+    }
+    std::vector<uint8_t> miniFat = ReadChain(mFat, GetUInt32(header + 0x3C));
+    for (size_t entry = 0; entry + 4 <= miniFat.size(); entry += 4) {
+      mMiniFat.push_back(GetUInt32(&miniFat[entry]));
+    }
+    mMiniStreamSectors = GetChain(mFat, mEntries[0].startSector);
+  }
+
+  const DirectoryEntry& GetEntry(uint32_t index) const { return mEntries.at(index); }
+
+  // Children of a storage, in directory tree order
+  std::vector<uint32_t> GetChildren(uint32_t storage) const {
+    std::vector<uint32_t> children;
+    std::vector<uint32_t> pending;
+    uint32_t current = GetEntry(storage).child;
+    while ((current != kNoStream && current < mEntries.size()) || !pending.empty()) {
+      while (current != kNoStream && current < mEntries.size()) {
+        if (pending.size() > mEntries.size()) {
+          throw BadInputError("Invalid compound file directory tree");
+        }
+        pending.push_back(current);
+        current = mEntries[current].left;
+      }
+      current = pending.back();
+      pending.pop_back();
+      children.push_back(current);
+      if (children.size() > mEntries.size()) {
+        throw BadInputError("Invalid compound file directory tree");
+      }
+      current = mEntries[current].right;
+    }
+    return children;
+  }
+
+  // Absolute file offsets of the units (sectors or mini sectors) holding a stream, in order
+  std::vector<int64_t> GetUnitOffsets(const DirectoryEntry& entry, int64_t& unitSize) const {
+    std::vector<int64_t> offsets;
+    if (entry.size == 0) {
+      unitSize = GetSectorSize();
+      return offsets;
+    }
+    if (entry.size < static_cast<int64_t>(mMiniStreamCutoff)) {
+      unitSize = static_cast<int64_t>(1) << mMiniSectorShift;
+      for (uint32_t miniSector : GetChain(mMiniFat, entry.startSector)) {
+        int64_t miniOffset = static_cast<int64_t>(miniSector) << mMiniSectorShift;
+        size_t index = static_cast<size_t>(miniOffset >> mSectorShift);
+        if (index >= mMiniStreamSectors.size()) {
+          throw BadInputError("Invalid compound file mini stream");
+        }
+        offsets.push_back(GetSectorOffset(mMiniStreamSectors[index]) + (miniOffset & (GetSectorSize() - 1)));
+      }
+    } else {
+      unitSize = GetSectorSize();
+      for (uint32_t sector : GetChain(mFat, entry.startSector)) {
+        offsets.push_back(GetSectorOffset(sector));
+      }
+    }
+    if (static_cast<int64_t>(offsets.size()) * unitSize < entry.size) {
+      throw BadInputError("Compound file stream is shorter than its size");
+    }
+    return offsets;
+  }
+
+  // Reads from the underlying stream, which is shared between all the streams of the file
+  void ReadAt(int64_t position, uint8_t* buffer, int64_t length) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStream->Seek(position);
+    if (ReadFromStream(mStream, buffer, length) != length) {
+      throw BadInputError("Unexpected end of compound file");
+    }
+  }
+
+private:
+  int64_t GetSectorSize() const { return static_cast<int64_t>(1) << mSectorShift; }
+
+  int64_t GetSectorOffset(uint32_t sector) const { return (static_cast<int64_t>(sector) + 1) << mSectorShift; }
+
+  void ReadSector(uint32_t sector, uint8_t* buffer) { ReadAt(GetSectorOffset(sector), buffer, GetSectorSize()); }
+
+  std::vector<uint32_t> GetChain(const std::vector<uint32_t>& table, uint32_t start) const {
+    std::vector<uint32_t> chain;
+    for (uint32_t current = start; current != kEndOfChain && current != kNoStream; current = table[current]) {
+      if (current >= table.size() || chain.size() >= table.size()) {
+        throw BadInputError("Invalid compound file sector chain");
+      }
+      chain.push_back(current);
+    }
+    return chain;
+  }
+
+  std::vector<uint8_t> ReadChain(const std::vector<uint32_t>& table, uint32_t start) {
+    std::vector<uint32_t> chain = GetChain(table, start);
+    std::vector<uint8_t> data(chain.size() * static_cast<size_t>(GetSectorSize()));
+    for (size_t i = 0; i < chain.size(); ++i) {
+      ReadSector(chain[i], &data[i * static_cast<size_t>(GetSectorSize())]);
+    }
+    return data;
+  }
+
+  std::shared_ptr<Stream> mStream;
+  std::mutex mMutex;
+  bool mIsVersion3 = true;
+  uint16_t mSectorShift = 9;
+  uint16_t mMiniSectorShift = 6;
+  uint32_t mMiniStreamCutoff = 4096;
+  std::vector<uint32_t> mFat;
+  std::vector<uint32_t> mMiniFat;
+  std::vector<uint32_t> mMiniStreamSectors;
+  std::vector<DirectoryEntry> mEntries;
+};
+
+// Read-only view of one compound file stream over the original file, reading contiguous sectors in one call
+class ChainStream : public Stream {
+public:
+  ChainStream(const std::shared_ptr<CompoundFile>& file, const DirectoryEntry& entry)
+      : mFile(file), mSize(entry.size), mPosition(0) {
+    mUnitOffsets = mFile->GetUnitOffsets(entry, mUnitSize);
+  }
+
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t totalBytesRead = 0;
+    while (totalBytesRead < bufferLength && mPosition < mSize) {
+      size_t unit = static_cast<size_t>(mPosition / mUnitSize);
+      int64_t offsetInUnit = mPosition % mUnitSize;
+      int64_t wanted = (std::min)(bufferLength - totalBytesRead, mSize - mPosition);
+      int64_t runLength = mUnitSize - offsetInUnit;
+      while (runLength < wanted && unit + 1 < mUnitOffsets.size() &&
+             mUnitOffsets[unit + 1] == mUnitOffsets[unit] + mUnitSize) {
+        ++unit;
+        runLength += mUnitSize;
+      }
+      runLength = (std::min)(runLength, wanted);
+      size_t firstUnit = static_cast<size_t>(mPosition / mUnitSize);
+      mFile->ReadAt(mUnitOffsets[firstUnit] + offsetInUnit, buffer + totalBytesRead, runLength);
+      totalBytesRead += runLength;
+      mPosition += runLength;
+    }
+    return totalBytesRead;
+  }
+
+  int64_t Write(const uint8_t* /*buffer*/, int64_t /*bufferLength*/) override {
+    throw NotSupportedError("Attachment streams are read-only");
+  }
+
+  bool Flush() override { return true; }
+
+  void Seek(int64_t position) override { mPosition = (std::max)(static_cast<int64_t>(0), (std::min)(position, mSize)); }
+
+  bool CanRead() const override { return true; }
+
+  bool CanWrite() const override { return false; }
+
+  int64_t Position() override { return mPosition; }
+
+  int64_t Size() override { return mSize; }
+
+  void Size(int64_t /*value*/) override { throw NotSupportedError("Attachment streams are read-only"); }
+
+private:
+  std::shared_ptr<CompoundFile> mFile;
+  std::vector<int64_t> mUnitOffsets;
+  int64_t mUnitSize = 0;
+  int64_t mSize;
+  int64_t mPosition;
+};
+
+class LazyAttachment : public MsgAttachmentData {
+public:
+  LazyAttachment(const std::shared_ptr<CompoundFile>& file, uint32_t storage)
+      : mFile(file), mDataEntry(kNoStream), mIsLoaded(false) {
+    for (uint32_t child : mFile->GetChildren(storage)) {
+      const DirectoryEntry& entry = mFile->GetEntry(child);
+      if (entry.type != kStreamObject) {
+        continue;
+      }
+      if (StartsWithIgnoreCase(entry.name, kAttachDataStream)) {
+        mDataEntry = child;
+      } else if (StartsWithIgnoreCase(entry.name, kAttachFileNameProperty)) {
+        mName = ReadString(entry);
+      } else if (StartsWithIgnoreCase(entry.name, kAttachLongFileNameProperty)) {
+        mLongName = ReadString(entry);
+      } else if (StartsWithIgnoreCase(entry.name, kAttachPathNameProperty)) {
+        mPath = ReadString(entry);
+      } else if (StartsWithIgnoreCase(entry.name, kAttachLongPathNameProperty)) {
+        mLongPath = ReadString(entry);
+      }
+    }
+  }
+
+  const std::vector<uint8_t>& GetBytes() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIsLoaded) {
+      auto stream = GetStream();
+      ReadFromStreamInto(stream, mBytes);
+      mIsLoaded = true;
+    }
+    return mBytes;
+  }
+
+  std::shared_ptr<Stream> GetStream() const override {
+    static const DirectoryEntry kEmptyEntry = {std::string(), kStreamObject, kNoStream, kNoStream, kNoStream,
+        kEndOfChain, 0};
+    return std::make_shared<ChainStream>(mFile, mDataEntry != kNoStream ? mFile->GetEntry(mDataEntry) : kEmptyEntry);
+  }
+
+  const std::string& GetName() const override { return mName; }
+
+  const std::string& GetLongName() const override { return mLongName; }
+
+  const std::string& GetPath() const override { return mPath; }
+
+  const std::string& GetLongPath() const override { return mLongPath; }
+
+private:
+  // Name properties are a few bytes, stored as UTF-16 (type 001F) or 8-bit (type 001E) strings
+  std::string ReadString(const DirectoryEntry& entry) {
+    ChainStream stream(mFile, entry);
+    std::vector<uint8_t> data(static_cast<size_t>((std::min)(entry.size, static_cast<int64_t>(64 * 1024))));
+    data.resize(static_cast<size_t>(stream.Read(data.data(), static_cast<int64_t>(data.size()))));
+    if (StartsWithIgnoreCase(entry.name.substr((std::min)(entry.name.size(), static_cast<size_t>(16))), "001F")) {
+      return Utf16ToUtf8(data.data(), data.size());
+    }
+    std::string value(data.begin(), data.end());
+    return value.substr(0, value.find('\0'));
+  }
+
+  std::shared_ptr<CompoundFile> mFile;
+  uint32_t mDataEntry;
+  std::string mName;
+  std::string mLongName;
+  std::string mPath;
+  std::string mLongPath;
+  std::mutex mMutex;
+  bool mIsLoaded;
+  std::vector<uint8_t> mBytes;
+};
+
+} // namespace msgattachments
+/** @endcond */
+
+/**
+ * @brief Lists the attachments of a .msg file without reading their content
+ * 
+ * @param msgStream Stream of an unprotected .msg file, for example FileInspector::GetFileStream
+ * 
+ * @return Attachments, in attachment number order
+ * 
+ * @note Only the compound file directory and the small name properties are read. MsgAttachmentData::GetStream
+ *       returns a read-only view over @p msgStream that reads the attachment's sectors when they are read, and
+ *       MsgAttachmentData::GetBytes reads the content the first time it is called. Keep @p msgStream alive and
+ *       unmodified while the attachments are in use; reads through different attachments are serialized on it.
+ *       Embedded message attachments, which are storages rather than streams, report empty content.
+ *       A BadInputError is thrown if @p msgStream is not a compound file.
+ */
+inline std::vector<std::shared_ptr<MsgAttachmentData>> GetMsgAttachments(const std::shared_ptr<Stream>& msgStream) {
+  if (!msgStream) {
+    throw BadInputError("GetMsgAttachments requires a stream");
+  }
+  auto file = std::make_shared<msgattachments::CompoundFile>(msgStream);
+  std::vector<std::shared_ptr<MsgAttachmentData>> attachments;
+  for (uint32_t child : file->GetChildren(0)) {
+    const msgattachments::DirectoryEntry& entry = file->GetEntry(child);
+    if (entry.type == msgattachments::kStorageObject &&
+        msgattachments::StartsWithIgnoreCase(entry.name, msgattachments::kAttachmentStoragePrefix)) {
+      attachments.push_back(std::make_shared<msgattachments::LazyAttachment>(file, child));
+    }
+  }
+  return attachments;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_MSG_ATTACHMENT_READER_H_
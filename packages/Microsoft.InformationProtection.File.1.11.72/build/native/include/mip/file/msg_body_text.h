@@ -0,0 +1,778 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines GetMsgBodyText, which converts the body of a MsgInspector to UTF-8 plain text
+ * 
+ * @file msg_body_text.h
+ */
+
+#ifndef API_MIP_FILE_MSG_BODY_TEXT_H_
+#define API_MIP_FILE_MSG_BODY_TEXT_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mip/file/msg_inspector.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace msgbodytext {
+
+const unsigned int kUtf16LittleEndian = 1200;
+const unsigned int kUtf16BigEndian = 1201;
+const unsigned int kWindows1252 = 1252;
+const unsigned int kUsAscii = 20127;
+const unsigned int kLatin1 = 28591;
+const unsigned int kUtf8 = 65001;
+const uint32_t kReplacementCharacter = 0xFFFD;
+
+// Windows-1252 differs from Latin-1 only in 0x80-0x9F
+const uint16_t kWindows1252High[32] = {
+    0x20AC, 0xFFFD, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0xFFFD, 0x017D, 0xFFFD,
+    0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0xFFFD, 0x017E, 0x0178};
+
+inline void AppendCodePoint(uint32_t codePoint, std::string& text) {
+  if (codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+    codePoint = kReplacementCharacter;
+  }
+  if (codePoint < 0x80) {
+    text += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    text += static_cast<char>(0xC0 | (codePoint >> 6));
+    text += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    text += static_cast<char>(0xE0 | (codePoint >> 12));
+    text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    text += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    text += static_cast<char>(0xF0 | (codePoint >> 18));
+    text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    text += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+}
+
+// Length of the ASCII run at the start of data, eight bytes at a time
+inline size_t GetAsciiLength(const uint8_t* data, size_t size) {
+  size_t length = 0;
+  for (; length + 8 <= size; length += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + length, 8);
+    if ((word & 0x8080808080808080ull) != 0) {
+      break;
+    }
+  }
+  while (length < size && data[length] < 0x80) {
+    ++length;
+  }
+  return length;
+}
+
+// Length of the valid UTF-8 sequence at data, or 0 if it is invalid
+inline size_t GetUtf8SequenceLength(const uint8_t* data, size_t size, uint32_t& codePoint) {
+  uint8_t lead = data[0];
+  size_t length = lead >= 0xF0 ? 4 : (lead >= 0xE0 ? 3 : (lead >= 0xC2 ? 2 : 0));
+  if (length == 0 || lead > 0xF4 || length > size) {
+    return 0;
+  }
+  codePoint = lead & (0x7F >> length);
+  for (size_t i = 1; i < length; ++i) {
+    if ((data[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    codePoint = (codePoint << 6) | (data[i] & 0x3F);
+  }
+  static const uint32_t kMinimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+  if (codePoint < kMinimum[length] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+    return 0;
+  }
+  return length;
+}
+
+inline bool IsSupportedCodePage(unsigned int codePage) {
+  return codePage == kUtf8 || codePage == kUsAscii || codePage == kLatin1 || codePage == kWindows1252 ||
+      codePage == kUtf16LittleEndian || codePage == kUtf16BigEndian;
+}
+
+// Appends text in a code page as UTF-8; false if the code page is not supported, with nothing appended
+inline bool AppendUtf8(const uint8_t* data, size_t size, unsigned int codePage, std::string& text) {
+  if (!IsSupportedCodePage(codePage)) {
+    return false;
+  }
+  text.reserve(text.size() + size + size / 8);
+  if (codePage == kUtf16LittleEndian || codePage == kUtf16BigEndian) {
+    int high = codePage == kUtf16LittleEndian ? 1 : 0;
+    size_t i = 0;
+    if (size >= 2 && data[high] == 0xFE && data[1 - high] == 0xFF) {
+      i = 2;
+    }
+    for (; i + 1 < size; i += 2) {
+      uint32_t unit = (static_cast<uint32_t>(data[i + high]) << 8) | data[i + 1 - high];
+      if (unit >= 0xD800 && unit <= 0xDBFF && i + 3 < size) {
+        uint32_t low = (static_cast<uint32_t>(data[i + 2 + high]) << 8) | data[i + 3 - high];
+        if (low >= 0xDC00 && low <= 0xDFFF) {
+          AppendCodePoint(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00), text);
+          i += 2;
+          continue;
+        }
+      }
+      AppendCodePoint(unit, text);
+    }
+    return true;
+  }
+  size_t i = 0;
+  if (codePage == kUtf8 && size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+    i = 3;
+  }
+  while (i < size) {
+    size_t ascii = GetAsciiLength(data + i, size - i);
+    text.append(reinterpret_cast<const char*>(data + i), ascii);
+    i += ascii;
+    if (i >= size) {
+      break;
+    }
+    uint8_t byte = data[i];
+    if (codePage == kUtf8) {
+      uint32_t codePoint = 0;
+      size_t length = GetUtf8SequenceLength(data + i, size - i, codePoint);
+      if (length == 0) {
+        AppendCodePoint(kReplacementCharacter, text);
+        ++i;
+      } else {
+        text.append(reinterpret_cast<const char*>(data + i), length);
+        i += length;
+      }
+      continue;
+    }
+    if (codePage == kUsAscii) {
+      AppendCodePoint(kReplacementCharacter, text);
+    } else if (codePage == kWindows1252 && byte < 0xA0) {
+      AppendCodePoint(kWindows1252High[byte - 0x80], text);
+    } else {
+      AppendCodePoint(byte, text);
+    }
+    ++i;
+  }
+  return true;
+}
+
+inline bool EqualsIgnoreCase(const char* a, size_t size, const char* b) {
+  size_t i = 0;
+  for (; i < size && b[i] != '\0'; ++i) {
+    char c = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] - 'A' + 'a') : a[i];
+    if (c != b[i]) {
+      return false;
+    }
+  }
+  return i == size && b[i] == '\0';
+}
+
+inline bool IsAsciiWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+// Collapses whitespace the way a browser lays text out, and keeps at most one blank line between blocks
+class TextWriter {
+public:
+  explicit TextWriter(std::string& text) : mText(text), mStart(text.size()) {}
+
+  // Drops trailing whitespace appended by this writer
+  void Finish() {
+    while (mText.size() > mStart && IsAsciiWhitespace(mText.back())) {
+      mText.pop_back();
+    }
+    mIsSpacePending = false;
+  }
+
+  void AppendText(const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      if (IsAsciiWhitespace(data[i])) {
+        mIsSpacePending = true;
+        continue;
+      }
+      Flush();
+      mText += data[i];
+    }
+  }
+
+  void AppendCodePoint(uint32_t codePoint) {
+    if (codePoint == 0xA0 || codePoint < 0x20) {
+      mIsSpacePending = true;
+      return;
+    }
+    Flush();
+    msgbodytext::AppendCodePoint(codePoint, mText);
+  }
+
+  void AppendBreak(char separator) {
+    if (separator == '\t') {
+      if (mText.size() > mStart && mText.back() != '\n') {
+        mText += '\t';
+      }
+      mIsSpacePending = false;
+      return;
+    }
+    while (mText.size() > mStart && (mText.back() == ' ' || mText.back() == '\t')) {
+      mText.pop_back();
+    }
+    size_t newlines = 0;
+    for (size_t i = mText.size(); i > mStart && mText[i - 1] == '\n'; --i) {
+      ++newlines;
+    }
+    if (mText.size() > mStart && newlines < 2) {
+      mText += '\n';
+    }
+    mIsSpacePending = false;
+  }
+
+private:
+  void Flush() {
+    if (mIsSpacePending && mText.size() > mStart && mText.back() != '\n' && mText.back() != '\t') {
+      mText += ' ';
+    }
+    mIsSpacePending = false;
+  }
+
+  std::string& mText;
+  size_t mStart;
+  bool mIsSpacePending = false;
+};
+
+inline uint32_t GetNamedEntity(const char* name, size_t size) {
+  static const struct { const char* name; uint32_t codePoint; } kEntities[] = {
+      {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''}, {"nbsp", 0xA0},
+      {"copy", 0xA9}, {"reg", 0xAE}, {"trade", 0x2122}, {"hellip", 0x2026}, {"mdash", 0x2014},
+      {"ndash", 0x2013}, {"lsquo", 0x2018}, {"rsquo", 0x2019}, {"ldquo", 0x201C}, {"rdquo", 0x201D},
+      {"bull", 0x2022}, {"euro", 0x20AC}, {"middot", 0xB7}, {"shy", 0xAD}};
+  for (const auto& entity : kEntities) {
+    if (std::strlen(entity.name) == size && std::memcmp(entity.name, name, size) == 0) {
+      return entity.codePoint;
+    }
+  }
+  return 0;
+}
+
+// Appends the text content of UTF-8 HTML: markup, comments, scripts and styles are dropped, entities decoded, and
+// block elements become line breaks
+inline void AppendHtmlText(const char* html, size_t size, std::string& text) {
+  static const char* const kBlockTags[] = {"br", "p", "div", "tr", "li", "h1", "h2", "h3", "h4", "h5", "h6",
+      "table", "ul", "ol", "blockquote", "pre", "hr", "dt", "dd"};
+  static const char* const kSkippedTags[] = {"script", "style", "xml", "title"};
+  TextWriter writer(text);
+  const char* skippedTag = nullptr;
+  size_t i = 0;
+  while (i < size) {
+    if (html[i] == '<') {
+      if (size - i >= 4 && std::memcmp(html + i, "<!--", 4) == 0) {
+        const char* end = nullptr;
+        for (size_t j = i + 4; j + 2 < size; ++j) {
+          if (html[j] == '-' && html[j + 1] == '-' && html[j + 2] == '>') {
+            end = html + j + 3;
+            break;
+          }
+        }
+        i = end ? static_cast<size_t>(end - html) : size;
+        continue;
+      }
+      size_t nameStart = i + 1;
+      bool isClosing = nameStart < size && html[nameStart] == '/';
+      nameStart += isClosing ? 1 : 0;
+      size_t nameEnd = nameStart;
+      while (nameEnd < size && (std::isalnum(static_cast<unsigned char>(html[nameEnd])) || html[nameEnd] == ':')) {
+        ++nameEnd;
+      }
+      // Not a tag: a lone '<' is text
+      if (nameEnd == nameStart && (nameStart >= size || (html[nameStart] != '!' && html[nameStart] != '?'))) {
+        if (skippedTag == nullptr) {
+          writer.AppendText(html + i, 1);
+        }
+        ++i;
+        continue;
+      }
+      // Skip to the end of the tag, past quoted attribute values
+      size_t end = nameEnd;
+      char quote = 0;
+      for (; end < size; ++end) {
+        if (quote != 0) {
+          quote = html[end] == quote ? 0 : quote;
+        } else if (html[end] == '"' || html[end] == '\'') {
+          quote = html[end];
+        } else if (html[end] == '>') {
+          break;
+        }
+      }
+      const char* name = html + nameStart;
+      size_t nameSize = nameEnd - nameStart;
+      if (skippedTag != nullptr) {
+        if (isClosing && EqualsIgnoreCase(name, nameSize, skippedTag)) {
+          skippedTag = nullptr;
+        }
+      } else {
+        for (const char* tag : kSkippedTags) {
+          if (!isClosing && EqualsIgnoreCase(name, nameSize, tag) && (end == 0 || html[end - 1] != '/')) {
+            skippedTag = tag;
+          }
+        }
+        for (const char* tag : kBlockTags) {
+          if (EqualsIgnoreCase(name, nameSize, tag)) {
+            writer.AppendBreak('\n');
+          }
+        }
+        if (!isClosing && (EqualsIgnoreCase(name, nameSize, "td") || EqualsIgnoreCase(name, nameSize, "th"))) {
+          writer.AppendBreak('\t');
+        }
+      }
+      i = end < size ? end + 1 : size;
+      continue;
+    }
+    if (skippedTag != nullptr) {
+      ++i;
+      continue;
+    }
+    if (html[i] == '&') {
+      size_t end = i + 1;
+      while (end < size && end - i <= 10 && html[end] != ';' && html[end] != '&' && html[end] != '<' &&
+             !IsAsciiWhitespace(html[end])) {
+        ++end;
+      }
+      uint32_t codePoint = 0;
+      if (end < size && html[end] == ';' && end > i + 1) {
+        if (html[i + 1] == '#') {
+          bool isHex = end > i + 2 && (html[i + 2] == 'x' || html[i + 2] == 'X');
+          std::string digits(html + i + (isHex ? 3 : 2), html + end);
+          char* digitsEnd = nullptr;
+          unsigned long value = std::strtoul(digits.c_str(), &digitsEnd, isHex ? 16 : 10);
+          codePoint = !digits.empty() && *digitsEnd == '\0' && value > 0 && value <= 0x10FFFF ?
+              static_cast<uint32_t>(value) : 0;
+        } else {
+          codePoint = GetNamedEntity(html + i + 1, end - i - 1);
+        }
+      }
+      if (codePoint != 0) {
+        writer.AppendCodePoint(codePoint);
+        i = end + 1;
+        continue;
+      }
+    }
+    size_t run = i + 1;
+    while (run < size && html[run] != '<' && html[run] != '&') {
+      ++run;
+    }
+    writer.AppendText(html + i, run - i);
+    i = run;
+  }
+  writer.Finish();
+}
+
+// Decompresses compressed RTF (MS-OXRTFCP); false if data is not compressed RTF
+inline bool DecompressRtf(const uint8_t* data, size_t size, std::vector<uint8_t>& rtf) {
+  static const char kDictionary[] =
+      "{\\rtf1\\ansi\\mac\\deff0\\deftab720{\\fonttbl;}{\\f0\\fnil \\froman \\fswiss \\fmodern \\fscript "
+      "\\fdecor MS Sans SerifSymbolArialTimes New RomanCourier{\\colortbl\\red0\\green0\\blue0\r\n\\par "
+      "\\pard\\plain\\f0\\fs20\\b\\i\\u\\tab\\tx";
+  if (size < 16) {
+    return false;
+  }
+  uint32_t compressedSize = data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+  uint32_t rawSize = data[4] | (data[5] << 8) | (data[6] << 16) | (static_cast<uint32_t>(data[7]) << 24);
+  bool isCompressed = std::memcmp(data + 8, "LZFu", 4) == 0;
+  size_t end = static_cast<size_t>(compressedSize) + 4;
+  if ((!isCompressed && std::memcmp(data + 8, "MELA", 4) != 0) || end < 16 || end > size) {
+    return false;
+  }
+  if (!isCompressed) {
+    rtf.assign(data + 16, data + (std::min)(end, static_cast<size_t>(16) + rawSize));
+    return true;
+  }
+  uint8_t dictionary[4096];
+  size_t prefix = sizeof(kDictionary) - 1;
+  std::memcpy(dictionary, kDictionary, prefix);
+  std::memset(dictionary + prefix, 0, sizeof(dictionary) - prefix);
+  size_t write = prefix;
+  rtf.clear();
+  // A 2-byte reference expands to at most 17 bytes, so the header's raw size is only trusted up to that ratio
+  rtf.reserve((std::min)(static_cast<size_t>(rawSize), (end - 16) * 9));
+  size_t position = 16;
+  while (position < end) {
+    uint8_t control = data[position++];
+    for (int bit = 0; bit < 8 && position < end; ++bit) {
+      if ((control & (1 << bit)) == 0) {
+        rtf.push_back(data[position]);
+        dictionary[write++ % 4096] = data[position++];
+        continue;
+      }
+      if (position + 1 >= end) {
+        return true;
+      }
+      size_t reference = (static_cast<size_t>(data[position]) << 8) | data[position + 1];
+      position += 2;
+      size_t offset = reference >> 4;
+      size_t length = (reference & 0xF) + 2;
+      if (offset == write % 4096) {
+        return true;
+      }
+      for (size_t i = 0; i < length; ++i) {
+        uint8_t byte = dictionary[(offset + i) % 4096];
+        rtf.push_back(byte);
+        dictionary[write++ % 4096] = byte;
+      }
+      if (rtf.size() > rawSize) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Converts RTF in one pass. Text of RTF that encapsulates HTML (\fromhtml) is collected as HTML and converted after.
+class RtfConverter {
+public:
+  explicit RtfConverter(unsigned int codePage) : mCodePage(codePage) {}
+
+  bool Convert(const uint8_t* data, size_t size, std::string& text) {
+    mData = data;
+    mSize = size;
+    mStack.assign(1, Group());
+    std::string html;
+    mOutput = &text;
+    TextWriter writer(text);
+    mWriter = &writer;
+    // \fromhtml appears in the header; when it does, everything is collected as HTML
+    for (size_t i = 0; i + 9 < size && i < 1024; ++i) {
+      if (std::memcmp(data + i, "\\fromhtml", 9) == 0) {
+        mIsHtml = true;
+        mOutput = &html;
+        break;
+      }
+    }
+    for (mPosition = 0; mPosition < mSize;) {
+      uint8_t c = mData[mPosition];
+      if (c == '{') {
+        FlushBytes();
+        mStack.push_back(mStack.back());
+        mStack.back().isDestinationPending = false;
+        ++mPosition;
+      } else if (c == '}') {
+        FlushBytes();
+        if (mStack.size() > 1) {
+          mStack.pop_back();
+        }
+        ++mPosition;
+      } else if (c == '\\') {
+        if (!ReadControl()) {
+          return false;
+        }
+      } else if (c == '\r' || c == '\n') {
+        ++mPosition;
+      } else {
+        AppendByte(c);
+        ++mPosition;
+      }
+    }
+    FlushBytes();
+    if (mIsHtml) {
+      AppendHtmlText(html.data(), html.size(), text);
+    } else {
+      writer.Finish();
+    }
+    return mIsCodePageSupported;
+  }
+
+private:
+  struct Group {
+    bool isSkipped = false;
+    bool isDestinationPending = false;
+    bool isHtmlTag = false;
+    int unicodeSkip = 1;
+  };
+
+  bool IsVisible() const {
+    const Group& group = mStack.back();
+    return !group.isSkipped && (!mIsHtml || group.isHtmlTag || !mIsHtmlRtf);
+  }
+
+  void AppendByte(uint8_t byte) {
+    if (mPendingSkip > 0) {
+      --mPendingSkip;
+      return;
+    }
+    if (IsVisible()) {
+      mBytes.push_back(byte);
+    }
+  }
+
+  void AppendCodePoint(uint32_t codePoint) {
+    FlushBytes();
+    if (!IsVisible()) {
+      return;
+    }
+    if (mIsHtml) {
+      msgbodytext::AppendCodePoint(codePoint, *mOutput);
+    } else {
+      mWriter->AppendCodePoint(codePoint);
+    }
+  }
+
+  void AppendBreak(char separator) {
+    FlushBytes();
+    if (!IsVisible()) {
+      return;
+    }
+    if (mIsHtml) {
+      *mOutput += separator;
+    } else {
+      mWriter->AppendBreak(separator);
+    }
+  }
+
+  void FlushBytes() {
+    if (mBytes.empty()) {
+      return;
+    }
+    std::string utf8;
+    if (!AppendUtf8(mBytes.data(), mBytes.size(), mCodePage, utf8)) {
+      mIsCodePageSupported = false;
+    }
+    mBytes.clear();
+    if (mIsHtml) {
+      *mOutput += utf8;
+    } else {
+      mWriter->AppendText(utf8.data(), utf8.size());
+    }
+  }
+
+  static bool IsSkippedDestination(const std::string& word) {
+    static const char* const kDestinations[] = {"fonttbl", "colortbl", "stylesheet", "info", "pict", "object",
+        "header", "headerl", "headerr", "headerf", "footer", "footerl", "footerr", "footerf", "listtable",
+        "listoverridetable", "rsidtbl", "generator", "xmlnstbl", "themedata", "colorschememapping", "datastore",
+        "latentstyles", "fldinst", "mhtmltag", "filetbl", "revtbl", "pgdsctbl", "bkmkstart", "bkmkend"};
+    for (const char* destination : kDestinations) {
+      if (word == destination) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadControl() {
+    ++mPosition;
+    if (mPosition >= mSize) {
+      return true;
+    }
+    uint8_t c = mData[mPosition];
+    if (!std::isalpha(c)) {
+      ++mPosition;
+      switch (c) {
+        case '\'': {
+          if (mPosition + 2 > mSize) {
+            return true;
+          }
+          char hex[3] = {static_cast<char>(mData[mPosition]), static_cast<char>(mData[mPosition + 1]), 0};
+          mPosition += 2;
+          AppendByte(static_cast<uint8_t>(std::strtoul(hex, nullptr, 16)));
+          break;
+        }
+        case '*':
+          mStack.back().isDestinationPending = true;
+          break;
+        case '~': AppendCodePoint(0xA0); break;
+        case '_': AppendCodePoint('-'); break;
+        case '\r':
+        case '\n': AppendBreak('\n'); break;
+        case '\\':
+        case '{':
+        case '}': AppendByte(c); break;
+        default: break;
+      }
+      return true;
+    }
+    size_t start = mPosition;
+    while (mPosition < mSize && std::isalpha(mData[mPosition])) {
+      ++mPosition;
+    }
+    std::string word(reinterpret_cast<const char*>(mData + start), mPosition - start);
+    bool hasParameter = false;
+    long parameter = 0;
+    size_t parameterStart = mPosition;
+    if (mPosition < mSize && (mData[mPosition] == '-' || std::isdigit(mData[mPosition]))) {
+      ++mPosition;
+      while (mPosition < mSize && std::isdigit(mData[mPosition]) && mPosition - parameterStart < 10) {
+        ++mPosition;
+      }
+      std::string digits(reinterpret_cast<const char*>(mData + parameterStart), mPosition - parameterStart);
+      parameter = std::strtol(digits.c_str(), nullptr, 10);
+      hasParameter = true;
+    }
+    if (mPosition < mSize && mData[mPosition] == ' ') {
+      ++mPosition;
+    }
+    Group& group = mStack.back();
+    bool isDestination = group.isDestinationPending;
+    group.isDestinationPending = false;
+    if (isDestination) {
+      // Of the {\* ...} destinations only \htmltag carries text, and only in HTML-encapsulating RTF
+      if (mIsHtml && word == "htmltag") {
+        FlushBytes();
+        group.isHtmlTag = true;
+      } else {
+        FlushBytes();
+        group.isSkipped = true;
+      }
+      return true;
+    }
+    if (IsSkippedDestination(word)) {
+      FlushBytes();
+      group.isSkipped = true;
+    } else if (word == "par" || word == "line" || word == "row" || word == "sect" || word == "page") {
+      if (!mIsHtml) {
+        AppendBreak('\n');
+      }
+    } else if (word == "tab" || word == "cell") {
+      if (!mIsHtml) {
+        AppendBreak('\t');
+      }
+    } else if (word == "u" && hasParameter) {
+      AppendCodePoint(static_cast<uint32_t>(parameter < 0 ? parameter + 65536 : parameter));
+      mPendingSkip = group.unicodeSkip;
+    } else if (word == "uc" && hasParameter) {
+      group.unicodeSkip = static_cast<int>(parameter);
+    } else if (word == "ansicpg" && hasParameter) {
+      FlushBytes();
+      mCodePage = static_cast<unsigned int>(parameter);
+    } else if (word == "htmlrtf") {
+      FlushBytes();
+      mIsHtmlRtf = !hasParameter || parameter != 0;
+    } else if (word == "emdash") {
+      AppendCodePoint(0x2014);
+    } else if (word == "endash") {
+      AppendCodePoint(0x2013);
+    } else if (word == "bullet") {
+      AppendCodePoint(0x2022);
+    } else if (word == "lquote") {
+      AppendCodePoint(0x2018);
+    } else if (word == "rquote") {
+      AppendCodePoint(0x2019);
+    } else if (word == "ldblquote") {
+      AppendCodePoint(0x201C);
+    } else if (word == "rdblquote") {
+      AppendCodePoint(0x201D);
+    }
+    if (word != "u") {
+      mPendingSkip = 0;
+    }
+    return mIsCodePageSupported;
+  }
+
+  const uint8_t* mData = nullptr;
+  size_t mSize = 0;
+  size_t mPosition = 0;
+  std::vector<Group> mStack;
+  std::vector<uint8_t> mBytes;
+  std::string* mOutput = nullptr;
+  TextWriter* mWriter = nullptr;
+  unsigned int mCodePage;
+  int mPendingSkip = 0;
+  bool mIsHtml = false;
+  bool mIsHtmlRtf = false;
+  bool mIsCodePageSupported = true;
+};
+
+} // namespace msgbodytext
+/** @endcond */
+
+/**
+ * @brief Appends text in a code page to a string as UTF-8
+ * 
+ * @param data Text
+ * @param size Size of the text, in bytes
+ * @param codePage Code page of the text: UTF-8, UTF-16 (1200, 1201), US-ASCII, Latin-1 or Windows-1252
+ * @param text String the UTF-8 text is appended to
+ * 
+ * @return true if converted, false if the code page is not supported, with nothing appended
+ * 
+ * @note ASCII runs are detected eight bytes at a time and copied as they are, which is most of the text of typical
+ *       messages. Invalid UTF-8 and unpaired surrogates become U+FFFD.
+ */
+inline bool AppendTextAsUtf8(const uint8_t* data, size_t size, unsigned int codePage, std::string& text) {
+  return msgbodytext::AppendUtf8(data, size, codePage, text);
+}
+
+/**
+ * @brief Gets the body of a message as UTF-8 plain text
+ * 
+ * @param inspector Message inspector
+ * @param text String the text is appended to
+ * 
+ * @return true if the body was converted, false if its body type, code page or RTF code page is not supported, in
+ *         which case text may hold part of the body and the caller should fall back to its own transcoding
+ * 
+ * @note The inspector returns TXT and HTML bodies as UTF-8; they are validated, ASCII runs eight bytes at a time, and
+ *       invalid sequences become U+FFFD. HTML bodies are reduced to their text in one pass, without markup, comments,
+ *       scripts or styles, with entities decoded and block elements turned into line breaks. RTF bodies, compressed
+ *       or not, are converted in one pass from their \ansicpg code page (GetCodePage when absent): control words and
+ *       non-text destinations are dropped, and RTF that encapsulates HTML (\fromhtml, as Outlook writes it) yields
+ *       the text of the original HTML.
+ */
+inline bool GetMsgBodyText(const MsgInspector& inspector, std::string& text) {
+  const std::vector<uint8_t>& body = inspector.GetBody();
+  switch (inspector.GetBodyType()) {
+    case BodyType::TXT:
+      return msgbodytext::AppendUtf8(body.data(), body.size(), msgbodytext::kUtf8, text);
+    case BodyType::HTML: {
+      // Markup is ASCII, so strip it first and validate only the text that is kept
+      std::string html;
+      msgbodytext::AppendHtmlText(reinterpret_cast<const char*>(body.data()), body.size(), html);
+      return msgbodytext::AppendUtf8(
+          reinterpret_cast<const uint8_t*>(html.data()), html.size(), msgbodytext::kUtf8, text);
+    }
+    case BodyType::RTF: {
+      std::vector<uint8_t> rtf;
+      bool isCompressed = msgbodytext::DecompressRtf(body.data(), body.size(), rtf);
+      const std::vector<uint8_t>& source = isCompressed ? rtf : body;
+      unsigned int codePage = inspector.GetCodePage();
+      if (!msgbodytext::IsSupportedCodePage(codePage) || codePage == msgbodytext::kUtf16LittleEndian ||
+          codePage == msgbodytext::kUtf16BigEndian) {
+        codePage = msgbodytext::kWindows1252;
+      }
+      return msgbodytext::RtfConverter(codePage).Convert(source.data(), source.size(), text);
+    }
+    default:
+      return false;
+  }
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_MSG_BODY_TEXT_H_
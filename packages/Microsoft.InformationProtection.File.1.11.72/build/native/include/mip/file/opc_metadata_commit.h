@@ -0,0 +1,510 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a commit path for Office (OPC) documents whose label metadata is the only change
+ * 
+ * @file opc_metadata_commit.h
+ */
+
+#ifndef API_MIP_FILE_OPC_METADATA_COMMIT_H_
+#define API_MIP_FILE_OPC_METADATA_COMMIT_H_
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/inflate_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_slice.h"
+#include "mip/stream_utils.h"
+#include "mip/upe/metadata_action.h"
+#include "mip/upe/metadata_entry.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace opcmetadata {
+
+const char kCustomPropertiesPartName[] = "docProps/custom.xml";
+const char kLabelInfoPartName[] = "docMetadata/LabelInfo.xml";
+const char kCustomPropertiesFmtId[] = "{D5CDD505-2E9C-101B-9397-08002B2CF9AE}";
+const char kVariantTypesNamespace[] = "http://schemas.openxmlformats.org/officeDocument/2006/docPropsVTypes";
+const uint32_t kLocalHeaderSignature = 0x04034b50;
+const uint32_t kCentralHeaderSignature = 0x02014b50;
+const uint32_t kEndOfCentralDirectorySignature = 0x06054b50;
+const uint32_t kZip64LocatorSignature = 0x07064b50;
+const size_t kLocalHeaderSize = 30;
+const size_t kCentralHeaderSize = 46;
+const size_t kEndOfCentralDirectorySize = 22;
+const uint16_t kStoredMethod = 0;
+const uint16_t kDeflatedMethod = 8;
+const uint16_t kDataDescriptorFlag = 0x0008;
+const uint16_t kEncryptedFlag = 0x0001;
+
+inline uint16_t GetUInt16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+inline uint32_t GetUInt32(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+      (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline void PutUInt16(uint8_t* data, uint16_t value) {
+  data[0] = static_cast<uint8_t>(value);
+  data[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void PutUInt32(uint8_t* data, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    data[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+inline uint32_t Crc32(const uint8_t* data, size_t size) {
+  const std::array<uint32_t, 256>& table = inflate::GetCrcTable();
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+// Raw DEFLATE (RFC 1951) payload of a ZIP entry or a PDF stream, decoded by the shared InflateStream decoder
+inline std::vector<uint8_t> Inflate(const uint8_t* input, size_t inputSize, size_t maxOutputSize) {
+  return inflate::InflateBuffer(input, inputSize, InflateFormat::Raw, maxOutputSize);
+}
+
+inline bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+    return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+  });
+}
+
+inline void ReadAt(const std::shared_ptr<Stream>& stream, int64_t position, uint8_t* buffer, int64_t length) {
+  stream->Seek(position);
+  if (ReadFromStream(stream, buffer, length) != length) {
+    throw BadInputError("Unexpected end of OPC package");
+  }
+}
+
+inline void WriteAll(const std::shared_ptr<Stream>& stream, const uint8_t* buffer, size_t length) {
+  if (length > 0 && stream->Write(buffer, static_cast<int64_t>(length)) != static_cast<int64_t>(length)) {
+    throw FileIOError("Failed to write OPC package");
+  }
+}
+
+inline std::string XmlEscape(const std::string& value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    switch (c) {
+      case '&': escaped += "&amp;"; break;
+      case '<': escaped += "&lt;"; break;
+      case '>': escaped += "&gt;"; break;
+      case '"': escaped += "&quot;"; break;
+      case '\'': escaped += "&apos;"; break;
+      default: escaped += c; break;
+    }
+  }
+  return escaped;
+}
+
+inline std::string XmlUnescape(const std::string& value) {
+  static const struct { const char* entity; char character; } kEntities[] = {
+      {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+  std::string unescaped;
+  unescaped.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    bool isReplaced = false;
+    if (value[i] == '&') {
+      for (const auto& entity : kEntities) {
+        size_t length = std::strlen(entity.entity);
+        if (value.compare(i, length, entity.entity) == 0) {
+          unescaped += entity.character;
+          i += length - 1;
+          isReplaced = true;
+          break;
+        }
+      }
+    }
+    if (!isReplaced) {
+      unescaped += value[i];
+    }
+  }
+  return unescaped;
+}
+
+inline bool GetAttribute(const std::string& startTag, const std::string& name, std::string& value) {
+  size_t position = 0;
+  while ((position = startTag.find(name, position)) != std::string::npos) {
+    size_t end = position + name.size();
+    bool isDelimited = position > 0 && std::isspace(static_cast<unsigned char>(startTag[position - 1])) &&
+        end + 1 < startTag.size() && startTag[end] == '=' && (startTag[end + 1] == '"' || startTag[end + 1] == '\'');
+    if (isDelimited) {
+      size_t close = startTag.find(startTag[end + 1], end + 2);
+      if (close == std::string::npos) {
+        return false;
+      }
+      value = XmlUnescape(startTag.substr(end + 2, close - end - 2));
+      return true;
+    }
+    position = end;
+  }
+  return false;
+}
+
+// Applies removals, then additions, to a custom properties part. Returns false if the part is not in the plain form
+// written by Office, in which case the caller falls back to a full commit.
+inline bool UpdateCustomProperties(
+    std::string& xml,
+    const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd) {
+  size_t rootEnd = xml.rfind("</Properties>");
+  if (rootEnd == std::string::npos || xml.find(kVariantTypesNamespace) == std::string::npos) {
+    return false;
+  }
+  std::string updated;
+  updated.reserve(xml.size() + 256 * metadataToAdd.size());
+  size_t copied = 0;
+  int maxPid = 1;
+  size_t position = 0;
+  while ((position = xml.find("<property", position)) != std::string::npos && position < rootEnd) {
+    size_t tagEnd = xml.find('>', position);
+    if (tagEnd == std::string::npos || tagEnd > rootEnd) {
+      return false;
+    }
+    char next = xml[position + 9];
+    if (!std::isspace(static_cast<unsigned char>(next)) && next != '>' && next != '/') {
+      position = tagEnd;
+      continue;
+    }
+    std::string startTag = xml.substr(position, tagEnd - position);
+    size_t elementEnd = tagEnd + 1;
+    if (xml[tagEnd - 1] != '/') {
+      elementEnd = xml.find("</property>", tagEnd);
+      if (elementEnd == std::string::npos || elementEnd > rootEnd) {
+        return false;
+      }
+      elementEnd += std::strlen("</property>");
+    }
+    std::string name;
+    std::string pid;
+    if (GetAttribute(startTag, "pid", pid)) {
+      maxPid = (std::max)(maxPid, std::atoi(pid.c_str()));
+    }
+    bool isRemoved = false;
+    if (GetAttribute(startTag, "name", name)) {
+      for (const auto& key : metadataToRemove) {
+        isRemoved = isRemoved || EqualsIgnoreCase(key, name);
+      }
+      for (const auto& entry : metadataToAdd) {
+        isRemoved = isRemoved || EqualsIgnoreCase(entry.GetKey(), name);
+      }
+    }
+    if (isRemoved) {
+      updated.append(xml, copied, position - copied);
+      copied = elementEnd;
+    }
+    position = elementEnd;
+  }
+  updated.append(xml, copied, rootEnd - copied);
+  for (const auto& entry : metadataToAdd) {
+    updated += "<property fmtid=\"";
+    updated += kCustomPropertiesFmtId;
+    updated += "\" pid=\"" + std::to_string(++maxPid) + "\" name=\"" + XmlEscape(entry.GetKey()) + "\"><vt:lpwstr>";
+    updated += XmlEscape(entry.GetValue()) + "</vt:lpwstr></property>";
+  }
+  updated.append(xml, rootEnd, std::string::npos);
+  xml.swap(updated);
+  return true;
+}
+
+struct CentralEntry {
+  std::vector<uint8_t> record;
+  std::string name;
+  int64_t localOffset;
+  int64_t endOffset;
+};
+
+struct Package {
+  std::vector<CentralEntry> entries;
+  std::vector<size_t> fileOrder; // Entry indexes sorted by local offset
+  std::vector<uint8_t> endRecord;
+  uint32_t directoryOffset = 0;
+  uint32_t directorySize = 0;
+};
+
+// Reads the central directory of a plain ZIP package; returns false for ZIP64, multi-disk and non-ZIP input
+inline bool ReadPackage(const std::shared_ptr<Stream>& inputStream, Package& package) {
+  // Locate the end of central directory record, which may be followed by a comment of up to 64 KB
+  int64_t packageSize = inputStream->Size();
+  if (packageSize < static_cast<int64_t>(kEndOfCentralDirectorySize)) {
+    return false;
+  }
+  int64_t tailSize = (std::min)(packageSize, static_cast<int64_t>(kEndOfCentralDirectorySize + 0xFFFF));
+  std::vector<uint8_t> tail(static_cast<size_t>(tailSize));
+  ReadAt(inputStream, packageSize - tailSize, tail.data(), tailSize);
+  int64_t recordIndex = tailSize - static_cast<int64_t>(kEndOfCentralDirectorySize);
+  while (recordIndex >= 0 && GetUInt32(&tail[static_cast<size_t>(recordIndex)]) != kEndOfCentralDirectorySignature) {
+    --recordIndex;
+  }
+  if (recordIndex < 0) {
+    return false;
+  }
+  const uint8_t* record = &tail[static_cast<size_t>(recordIndex)];
+  uint16_t entryCount = GetUInt16(record + 10);
+  uint32_t directorySize = GetUInt32(record + 12);
+  uint32_t directoryOffset = GetUInt32(record + 16);
+  bool isZip64 = entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF ||
+      (recordIndex >= 20 && GetUInt32(&tail[static_cast<size_t>(recordIndex - 20)]) == kZip64LocatorSignature);
+  if (isZip64 || GetUInt16(record + 4) != 0 || static_cast<int64_t>(directoryOffset) + directorySize >
+      packageSize - tailSize + recordIndex) {
+    return false;
+  }
+  package.endRecord.assign(record, static_cast<const uint8_t*>(tail.data() + tail.size()));
+  package.directoryOffset = directoryOffset;
+  package.directorySize = directorySize;
+
+  // Parse the central directory
+  std::vector<uint8_t> directory(directorySize);
+  ReadAt(inputStream, directoryOffset, directory.data(), directorySize);
+  std::vector<CentralEntry>& entries = package.entries;
+  entries.clear();
+  entries.reserve(entryCount);
+  size_t position = 0;
+  for (uint16_t i = 0; i < entryCount; ++i) {
+    if (position + kCentralHeaderSize > directory.size() ||
+        GetUInt32(&directory[position]) != kCentralHeaderSignature) {
+      throw BadInputError("Invalid OPC central directory");
+    }
+    const uint8_t* header = &directory[position];
+    size_t recordSize = kCentralHeaderSize + GetUInt16(header + 28) + GetUInt16(header + 30) + GetUInt16(header + 32);
+    if (position + recordSize > directory.size()) {
+      throw BadInputError("Invalid OPC central directory");
+    }
+    CentralEntry entry;
+    entry.record.assign(header, header + recordSize);
+    entry.name.assign(reinterpret_cast<const char*>(header + kCentralHeaderSize), GetUInt16(header + 28));
+    entry.localOffset = GetUInt32(header + 42);
+    entries.push_back(std::move(entry));
+    position += recordSize;
+  }
+
+  // Each entry's local data runs up to the next entry in file order, or to the central directory
+  std::vector<size_t>& fileOrder = package.fileOrder;
+  fileOrder.resize(entries.size());
+  for (size_t i = 0; i < fileOrder.size(); ++i) {
+    fileOrder[i] = i;
+  }
+  std::sort(fileOrder.begin(), fileOrder.end(), [&entries](size_t a, size_t b) {
+    return entries[a].localOffset < entries[b].localOffset;
+  });
+  for (size_t i = 0; i < fileOrder.size(); ++i) {
+    entries[fileOrder[i]].endOffset =
+        i + 1 < fileOrder.size() ? entries[fileOrder[i + 1]].localOffset : static_cast<int64_t>(directoryOffset);
+  }
+  return true;
+}
+
+// Reads an entry's local header and returns the offset of its data
+inline int64_t GetDataOffset(const std::shared_ptr<Stream>& inputStream, const CentralEntry& entry,
+    uint8_t* localHeader) {
+  ReadAt(inputStream, entry.localOffset, localHeader, kLocalHeaderSize);
+  if (GetUInt32(localHeader) != kLocalHeaderSignature) {
+    throw BadInputError("Invalid OPC local header");
+  }
+  int64_t dataOffset = entry.localOffset + static_cast<int64_t>(kLocalHeaderSize) + GetUInt16(localHeader + 26) +
+      GetUInt16(localHeader + 28);
+  if (dataOffset + GetUInt32(entry.record.data() + 20) > entry.endOffset) {
+    throw BadInputError("Invalid OPC local header");
+  }
+  return dataOffset;
+}
+
+} // namespace opcmetadata
+/** @endcond */
+
+/**
+ * @brief Writes an Office (OPC) document with updated label metadata, copying every other part byte for byte
+ * 
+ * @param inputStream Original document
+ * @param outputStream Stream receiving the updated document, positioned at its start and empty
+ * @param metadataToRemove Names of the custom properties to remove
+ * @param metadataToAdd Custom properties to add or replace
+ * 
+ * @return true if the document was written, false if this fast path does not apply and nothing was written
+ * 
+ * @note Only docProps/custom.xml and the ZIP central directory are rewritten. The other entries are copied as they
+ *       are, without being inflated or deflated, so the cost depends on the package size only through the copy.
+ *       The fast path does not apply, and FileHandler::CommitAsync must be used, when the document is not a plain
+ *       ZIP package (for example a protected document), uses ZIP64, has no custom properties part, keeps label
+ *       information in docMetadata/LabelInfo.xml, or when protection or content markings change as well.
+ *       The caller remains responsible for FileHandler::NotifyCommitSuccessful, which fires the audit event.
+ */
+inline bool CommitOpcMetadataOnly(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::shared_ptr<Stream>& outputStream,
+    const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd) {
+  using namespace opcmetadata;
+  if (!inputStream || !outputStream) {
+    throw BadInputError("CommitOpcMetadataOnly requires input and output streams");
+  }
+
+  Package package;
+  if (!ReadPackage(inputStream, package)) {
+    return false;
+  }
+  std::vector<CentralEntry>& entries = package.entries;
+  const std::vector<size_t>& fileOrder = package.fileOrder;
+  std::vector<uint8_t>& endRecord = package.endRecord;
+  uint32_t directorySize = package.directorySize;
+  size_t customIndex = entries.size();
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (EqualsIgnoreCase(entries[i].name, kLabelInfoPartName)) {
+      return false;
+    }
+    if (EqualsIgnoreCase(entries[i].name, kCustomPropertiesPartName)) {
+      customIndex = i;
+    }
+  }
+  if (customIndex == entries.size()) {
+    return false;
+  }
+
+  // Read and update the custom properties part
+  CentralEntry& custom = entries[customIndex];
+  const uint8_t* customHeader = custom.record.data();
+  uint16_t flags = GetUInt16(customHeader + 8);
+  uint16_t method = GetUInt16(customHeader + 10);
+  uint32_t compressedSize = GetUInt32(customHeader + 20);
+  uint32_t uncompressedSize = GetUInt32(customHeader + 24);
+  if ((flags & kEncryptedFlag) != 0 || (method != kStoredMethod && method != kDeflatedMethod)) {
+    return false;
+  }
+  uint8_t localHeader[kLocalHeaderSize];
+  int64_t dataOffset = GetDataOffset(inputStream, custom, localHeader);
+  std::vector<uint8_t> compressed(compressedSize);
+  ReadAt(inputStream, dataOffset, compressed.data(), compressedSize);
+  std::vector<uint8_t> content = method == kStoredMethod ? compressed :
+      Inflate(compressed.data(), compressed.size(), uncompressedSize);
+  if (Crc32(content.data(), content.size()) != GetUInt32(customHeader + 16)) {
+    throw BadInputError("Custom properties part failed its checksum");
+  }
+  std::string xml(content.begin(), content.end());
+  if (!UpdateCustomProperties(xml, metadataToRemove, metadataToAdd)) {
+    return false;
+  }
+
+  int64_t outputSize = static_cast<int64_t>(kLocalHeaderSize + custom.name.size() + xml.size() + directorySize +
+      endRecord.size()) - (custom.endOffset - custom.localOffset);
+  for (const auto& entry : entries) {
+    outputSize += entry.endOffset - entry.localOffset;
+  }
+  if (outputSize > 0xFFFFFFFFll) {
+    return false;
+  }
+
+  // Write the entries in their original order, then the central directory and its end record
+  const uint8_t* xmlData = reinterpret_cast<const uint8_t*>(xml.data());
+  uint32_t xmlCrc = Crc32(xmlData, xml.size());
+  uint32_t xmlSize = static_cast<uint32_t>(xml.size());
+  outputStream->Seek(0);
+  int64_t outputOffset = 0;
+  for (size_t index : fileOrder) {
+    CentralEntry& entry = entries[index];
+    int64_t newOffset = outputOffset;
+    if (index == customIndex) {
+      uint16_t newFlags = static_cast<uint16_t>(flags & ~kDataDescriptorFlag);
+      uint8_t newLocalHeader[kLocalHeaderSize];
+      std::memcpy(newLocalHeader, localHeader, kLocalHeaderSize);
+      PutUInt16(newLocalHeader + 6, newFlags);
+      PutUInt16(newLocalHeader + 8, kStoredMethod);
+      PutUInt32(newLocalHeader + 14, xmlCrc);
+      PutUInt32(newLocalHeader + 18, xmlSize);
+      PutUInt32(newLocalHeader + 22, xmlSize);
+      PutUInt16(newLocalHeader + 26, static_cast<uint16_t>(entry.name.size()));
+      PutUInt16(newLocalHeader + 28, 0);
+      WriteAll(outputStream, newLocalHeader, kLocalHeaderSize);
+      WriteAll(outputStream, reinterpret_cast<const uint8_t*>(entry.name.data()), entry.name.size());
+      WriteAll(outputStream, xmlData, xml.size());
+      outputOffset += static_cast<int64_t>(kLocalHeaderSize + entry.name.size() + xml.size());
+      PutUInt16(&entry.record[8], newFlags);
+      PutUInt16(&entry.record[10], kStoredMethod);
+      PutUInt32(&entry.record[16], xmlCrc);
+      PutUInt32(&entry.record[20], xmlSize);
+      PutUInt32(&entry.record[24], xmlSize);
+    } else {
+      int64_t length = entry.endOffset - entry.localOffset;
+      int64_t copied = CopyStream(CreateStreamSlice(inputStream, entry.localOffset, length), outputStream, 1024 * 1024);
+      if (copied != length) {
+        throw FileIOError("Failed to copy OPC package entry");
+      }
+      outputOffset += length;
+    }
+    PutUInt32(&entry.record[42], static_cast<uint32_t>(newOffset));
+  }
+  int64_t newDirectoryOffset = outputOffset;
+  for (const auto& entry : entries) {
+    WriteAll(outputStream, entry.record.data(), entry.record.size());
+    outputOffset += static_cast<int64_t>(entry.record.size());
+  }
+  PutUInt32(&endRecord[12], static_cast<uint32_t>(outputOffset - newDirectoryOffset));
+  PutUInt32(&endRecord[16], static_cast<uint32_t>(newDirectoryOffset));
+  WriteAll(outputStream, endRecord.data(), endRecord.size());
+  outputStream->Flush();
+  return true;
+}
+
+/**
+ * @brief Writes an Office (OPC) document with the metadata changes computed by a policy handler
+ * 
+ * @param inputStream Original document
+ * @param outputStream Stream receiving the updated document, positioned at its start and empty
+ * @param metadataAction Metadata action returned by PolicyHandler::ComputeActions
+ * 
+ * @return true if the document was written, false if this fast path does not apply and nothing was written
+ */
+inline bool CommitOpcMetadataOnly(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::shared_ptr<Stream>& outputStream,
+    const MetadataAction& metadataAction) {
+  return CommitOpcMetadataOnly(
+      inputStream, outputStream, metadataAction.GetMetadataToRemove(), metadataAction.GetMetadataToAdd());
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_OPC_METADATA_COMMIT_H_
@@ -0,0 +1,748 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines RepackOpcPackage, which recompresses the parts of an Office (OPC) document in parallel
+ * 
+ * @file opc_repack.h
+ */
+
+#ifndef API_MIP_FILE_OPC_REPACK_H_
+#define API_MIP_FILE_OPC_REPACK_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/opc_metadata_commit.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_slice.h"
+#include "mip/stream_utils.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Compression applied to the parts of a package
+ */
+enum class OpcCompressionLevel : unsigned int {
+  Store = 0,   /**< No compression; fastest to write, and the cheapest to encrypt afterwards per part read */
+  Fast = 1,    /**< Short match search, for throughput */
+  Default = 2, /**< Longer match search with lazy matching, for size */
+};
+
+/**
+ * @brief Settings of RepackOpcPackage
+ */
+struct OpcRepackSettings {
+  OpcCompressionLevel level = OpcCompressionLevel::Default; /**< Compression of every part */
+  /** Compresses the parts; a thread per part if not set */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+  size_t maxPartsInFlight = 8;         /**< Parts being compressed at once, which bounds the memory used */
+  int64_t minParallelSize = 64 * 1024; /**< Parts smaller than this are compressed on the calling thread */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace opcdeflate {
+
+const int kWindowSize = 32768;
+const int kMinMatch = 3;
+const int kMaxMatch = 258;
+const int kHashBits = 15;
+const size_t kMaxBlockTokens = 32768;
+
+const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+inline int GetLengthCode(int length) {
+  static const std::vector<uint8_t> codes = [] {
+    std::vector<uint8_t> table(kMaxMatch + 1, 0);
+    for (int code = 0; code < 29; ++code) {
+      int last = code == 28 ? kMaxMatch : kLengthBase[code] + (1 << kLengthExtra[code]) - 1;
+      for (int length = kLengthBase[code]; length <= last && length <= kMaxMatch; ++length) {
+        table[static_cast<size_t>(length)] = static_cast<uint8_t>(code);
+      }
+    }
+    table[kMaxMatch] = 28;
+    return table;
+  }();
+  return codes[static_cast<size_t>(length)];
+}
+
+inline int GetDistanceCode(int distance) {
+  static const std::vector<uint8_t> codes = [] {
+    std::vector<uint8_t> table(kWindowSize + 1, 0);
+    for (int code = 0; code < 30; ++code) {
+      int last = kDistanceBase[code] + (1 << kDistanceExtra[code]) - 1;
+      for (int distance = kDistanceBase[code]; distance <= last && distance <= kWindowSize; ++distance) {
+        table[static_cast<size_t>(distance)] = static_cast<uint8_t>(code);
+      }
+    }
+    return table;
+  }();
+  return codes[static_cast<size_t>(distance)];
+}
+
+// Huffman code lengths of at most maxBits; frequencies are halved until the tree fits
+inline void BuildLengths(const uint32_t* frequencies, int symbolCount, int maxBits, uint8_t* lengths) {
+  std::vector<uint32_t> weights(frequencies, frequencies + symbolCount);
+  for (;;) {
+    std::fill(lengths, lengths + symbolCount, 0);
+    typedef std::pair<uint64_t, int> Node;
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+    std::vector<int> parents;
+    for (int symbol = 0; symbol < symbolCount; ++symbol) {
+      if (weights[static_cast<size_t>(symbol)] > 0) {
+        heap.push(Node(weights[static_cast<size_t>(symbol)], static_cast<int>(parents.size())));
+        parents.push_back(-1);
+      }
+    }
+    if (parents.size() <= 1) {
+      for (int symbol = 0; symbol < symbolCount; ++symbol) {
+        lengths[symbol] = weights[static_cast<size_t>(symbol)] > 0 ? 1 : 0;
+      }
+      return;
+    }
+    size_t leafCount = parents.size();
+    while (heap.size() > 1) {
+      Node a = heap.top();
+      heap.pop();
+      Node b = heap.top();
+      heap.pop();
+      int parent = static_cast<int>(parents.size());
+      parents.push_back(-1);
+      parents[static_cast<size_t>(a.second)] = parent;
+      parents[static_cast<size_t>(b.second)] = parent;
+      heap.push(Node(a.first + b.first, parent));
+    }
+    int maxLength = 0;
+    size_t leaf = 0;
+    for (int symbol = 0; symbol < symbolCount; ++symbol) {
+      if (weights[static_cast<size_t>(symbol)] == 0) {
+        continue;
+      }
+      int length = 0;
+      for (int node = static_cast<int>(leaf++); parents[static_cast<size_t>(node)] >= 0;
+           node = parents[static_cast<size_t>(node)]) {
+        ++length;
+      }
+      lengths[symbol] = static_cast<uint8_t>(length);
+      maxLength = (std::max)(maxLength, length);
+    }
+    if (maxLength <= maxBits || leaf != leafCount) {
+      return;
+    }
+    for (auto& weight : weights) {
+      weight = weight > 0 ? (std::max)(weight >> 1, static_cast<uint32_t>(1)) : 0;
+    }
+  }
+}
+
+// Canonical codes, bit-reversed since deflate sends Huffman codes starting from their most significant bit
+inline void BuildCodes(const uint8_t* lengths, int symbolCount, uint16_t* codes) {
+  int counts[16] = {};
+  for (int symbol = 0; symbol < symbolCount; ++symbol) {
+    counts[lengths[symbol]]++;
+  }
+  counts[0] = 0;
+  int next[16] = {};
+  int code = 0;
+  for (int bits = 1; bits < 16; ++bits) {
+    code = (code + counts[bits - 1]) << 1;
+    next[bits] = code;
+  }
+  for (int symbol = 0; symbol < symbolCount; ++symbol) {
+    int length = lengths[symbol];
+    if (length == 0) {
+      codes[symbol] = 0;
+      continue;
+    }
+    int value = next[length]++;
+    int reversed = 0;
+    for (int i = 0; i < length; ++i) {
+      reversed = (reversed << 1) | ((value >> i) & 1);
+    }
+    codes[symbol] = static_cast<uint16_t>(reversed);
+  }
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t>& output) : mOutput(output) {}
+
+  void Put(uint32_t value, int bits) {
+    mBuffer |= static_cast<uint64_t>(value) << mCount;
+    mCount += bits;
+    while (mCount >= 8) {
+      mOutput.push_back(static_cast<uint8_t>(mBuffer));
+      mBuffer >>= 8;
+      mCount -= 8;
+    }
+  }
+
+  void Align() {
+    if (mCount > 0) {
+      Put(0, 8 - mCount);
+    }
+  }
+
+private:
+  std::vector<uint8_t>& mOutput;
+  uint64_t mBuffer = 0;
+  int mCount = 0;
+};
+
+struct Token {
+  uint16_t value;    // Literal byte, or match length
+  uint16_t distance; // 0 for a literal
+};
+
+// LZ77 with hash chains, then each block in whichever of stored, fixed or dynamic Huffman coding is smallest
+class Deflater {
+public:
+  Deflater(int maxChainLength, int niceLength, bool isLazy)
+      : mMaxChainLength(maxChainLength),
+        mNiceLength(niceLength),
+        mIsLazy(isLazy),
+        mHead(1 << kHashBits, -1),
+        mPrevious(kWindowSize, -1) {}
+
+  std::vector<uint8_t> Deflate(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> output;
+    output.reserve(size / 2 + 64);
+    BitWriter writer(output);
+    mData = data;
+    mSize = size;
+    std::vector<Token> tokens;
+    tokens.reserve(kMaxBlockTokens);
+    size_t blockStart = 0;
+    size_t position = 0;
+    while (position < size) {
+      int length = 0;
+      int distance = 0;
+      FindMatch(position, length, distance);
+      if (mIsLazy && length >= kMinMatch && length < mNiceLength && position + 1 < size) {
+        Insert(position);
+        int nextLength = 0;
+        int nextDistance = 0;
+        FindMatch(position + 1, nextLength, nextDistance);
+        if (nextLength > length) {
+          tokens.push_back(Token{data[position], 0});
+          ++position;
+        } else {
+          tokens.push_back(Token{static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+          for (int i = 1; i < length; ++i) {
+            Insert(position + static_cast<size_t>(i));
+          }
+          position += static_cast<size_t>(length);
+        }
+      } else if (length >= kMinMatch) {
+        tokens.push_back(Token{static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+        for (int i = 0; i < length; ++i) {
+          Insert(position + static_cast<size_t>(i));
+        }
+        position += static_cast<size_t>(length);
+      } else {
+        tokens.push_back(Token{data[position], 0});
+        Insert(position);
+        ++position;
+      }
+      if (tokens.size() >= kMaxBlockTokens) {
+        WriteBlock(writer, tokens, blockStart, position, position >= size);
+        tokens.clear();
+        blockStart = position;
+      }
+    }
+    if (!tokens.empty() || size == 0) {
+      WriteBlock(writer, tokens, blockStart, position, true);
+    }
+    writer.Align();
+    return output;
+  }
+
+private:
+  uint32_t Hash(size_t position) const {
+    return ((static_cast<uint32_t>(mData[position]) << 10) ^ (static_cast<uint32_t>(mData[position + 1]) << 5) ^
+        mData[position + 2]) & ((1u << kHashBits) - 1);
+  }
+
+  void Insert(size_t position) {
+    if (position + kMinMatch > mSize) {
+      return;
+    }
+    uint32_t hash = Hash(position);
+    mPrevious[position % kWindowSize] = mHead[hash];
+    mHead[hash] = static_cast<int64_t>(position);
+  }
+
+  void FindMatch(size_t position, int& bestLength, int& bestDistance) const {
+    bestLength = 0;
+    bestDistance = 0;
+    if (position + kMinMatch > mSize) {
+      return;
+    }
+    int maxLength = static_cast<int>((std::min)(static_cast<size_t>(kMaxMatch), mSize - position));
+    int64_t candidate = mHead[Hash(position)];
+    for (int chain = mMaxChainLength; candidate >= 0 && chain > 0; --chain) {
+      int64_t distance = static_cast<int64_t>(position) - candidate;
+      if (distance <= 0 || distance > kWindowSize) {
+        break;
+      }
+      const uint8_t* a = mData + position;
+      const uint8_t* b = mData + candidate;
+      if (b[bestLength] == a[bestLength]) {
+        int length = 0;
+        while (length < maxLength && a[length] == b[length]) {
+          ++length;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = static_cast<int>(distance);
+          if (length >= mNiceLength || length == maxLength) {
+            break;
+          }
+        }
+      }
+      int64_t next = mPrevious[static_cast<size_t>(candidate) % kWindowSize];
+      if (next >= candidate) {
+        break;
+      }
+      candidate = next;
+    }
+    if (bestLength < kMinMatch) {
+      bestLength = 0;
+    }
+  }
+
+  void WriteBlock(BitWriter& writer, const std::vector<Token>& tokens, size_t start, size_t end, bool isFinal) {
+    uint32_t literalFrequencies[286] = {};
+    uint32_t distanceFrequencies[30] = {};
+    uint64_t extraBits = 0;
+    for (const Token& token : tokens) {
+      if (token.distance == 0) {
+        literalFrequencies[token.value]++;
+        continue;
+      }
+      int lengthCode = GetLengthCode(token.value);
+      int distanceCode = GetDistanceCode(token.distance);
+      literalFrequencies[257 + lengthCode]++;
+      distanceFrequencies[distanceCode]++;
+      extraBits += kLengthExtra[lengthCode] + kDistanceExtra[distanceCode];
+    }
+    literalFrequencies[256] = 1;
+
+    uint8_t fixedLengths[288 + 30];
+    std::fill(fixedLengths, fixedLengths + 144, 8);
+    std::fill(fixedLengths + 144, fixedLengths + 256, 9);
+    std::fill(fixedLengths + 256, fixedLengths + 280, 7);
+    std::fill(fixedLengths + 280, fixedLengths + 288, 8);
+    std::fill(fixedLengths + 288, fixedLengths + 318, 5);
+
+    uint8_t lengths[286 + 30] = {};
+    BuildLengths(literalFrequencies, 286, 15, lengths);
+    BuildLengths(distanceFrequencies, 30, 15, lengths + 286);
+    int literalCount = 286;
+    while (literalCount > 257 && lengths[literalCount - 1] == 0) {
+      --literalCount;
+    }
+    int distanceCount = 30;
+    while (distanceCount > 1 && lengths[286 + distanceCount - 1] == 0) {
+      --distanceCount;
+    }
+    if (lengths[286] == 0 && distanceCount == 1) {
+      lengths[286] = 1; // At least one distance code must be sent
+    }
+
+    // Code lengths, run-length encoded with symbols 16 (repeat previous), 17 and 18 (repeat zero)
+    std::vector<uint8_t> all(lengths, lengths + literalCount);
+    all.insert(all.end(), lengths + 286, lengths + 286 + distanceCount);
+    std::vector<std::pair<uint8_t, uint8_t>> runs; // Symbol and extra bits value
+    uint32_t codeLengthFrequencies[19] = {};
+    for (size_t i = 0; i < all.size();) {
+      size_t run = 1;
+      while (i + run < all.size() && all[i + run] == all[i]) {
+        ++run;
+      }
+      if (all[i] == 0 && run >= 3) {
+        size_t count = (std::min)(run, static_cast<size_t>(138));
+        runs.emplace_back(count >= 11 ? 18 : 17, static_cast<uint8_t>(count >= 11 ? count - 11 : count - 3));
+        i += count;
+      } else if (all[i] != 0 && run >= 4) {
+        runs.emplace_back(all[i], 0);
+        size_t count = (std::min)(run - 1, static_cast<size_t>(6));
+        runs.emplace_back(16, static_cast<uint8_t>(count - 3));
+        i += 1 + count;
+      } else {
+        runs.emplace_back(all[i], 0);
+        ++i;
+      }
+      codeLengthFrequencies[runs.back().first]++;
+      if (runs.size() >= 2 && runs.back().first == 16) {
+        codeLengthFrequencies[runs[runs.size() - 2].first]++;
+      }
+    }
+    uint8_t codeLengthLengths[19] = {};
+    BuildLengths(codeLengthFrequencies, 19, 7, codeLengthLengths);
+    int codeLengthCount = 19;
+    while (codeLengthCount > 4 && codeLengthLengths[kCodeLengthOrder[codeLengthCount - 1]] == 0) {
+      --codeLengthCount;
+    }
+
+    uint64_t dynamicBits = 3 + 14 + 3 * static_cast<uint64_t>(codeLengthCount) + extraBits;
+    uint64_t fixedBits = 3 + extraBits;
+    for (const auto& run : runs) {
+      int runExtraBits = run.first == 16 ? 2 : run.first == 17 ? 3 : run.first == 18 ? 7 : 0;
+      dynamicBits += codeLengthLengths[run.first] + static_cast<uint64_t>(runExtraBits);
+    }
+    for (int symbol = 0; symbol < 286; ++symbol) {
+      dynamicBits += static_cast<uint64_t>(literalFrequencies[symbol]) * lengths[symbol];
+      fixedBits += static_cast<uint64_t>(literalFrequencies[symbol]) * fixedLengths[symbol];
+    }
+    for (int symbol = 0; symbol < 30; ++symbol) {
+      dynamicBits += static_cast<uint64_t>(distanceFrequencies[symbol]) * lengths[286 + symbol];
+      fixedBits += static_cast<uint64_t>(distanceFrequencies[symbol]) * 5;
+    }
+    uint64_t storedBits = (end - start) * 8 + ((end - start) / 65535 + 1) * 40 + 8;
+
+    if (storedBits <= dynamicBits && storedBits <= fixedBits) {
+      WriteStored(writer, start, end, isFinal);
+      return;
+    }
+    uint16_t literalCodes[288];
+    uint16_t distanceCodes[30];
+    const uint8_t* literalLengths = lengths;
+    const uint8_t* distanceLengths = lengths + 286;
+    if (fixedBits <= dynamicBits) {
+      writer.Put(isFinal ? 1 : 0, 1);
+      writer.Put(1, 2);
+      literalLengths = fixedLengths;
+      distanceLengths = fixedLengths + 288;
+      BuildCodes(literalLengths, 288, literalCodes);
+      BuildCodes(distanceLengths, 30, distanceCodes);
+    } else {
+      writer.Put(isFinal ? 1 : 0, 1);
+      writer.Put(2, 2);
+      writer.Put(static_cast<uint32_t>(literalCount - 257), 5);
+      writer.Put(static_cast<uint32_t>(distanceCount - 1), 5);
+      writer.Put(static_cast<uint32_t>(codeLengthCount - 4), 4);
+      for (int i = 0; i < codeLengthCount; ++i) {
+        writer.Put(codeLengthLengths[kCodeLengthOrder[i]], 3);
+      }
+      uint16_t codeLengthCodes[19];
+      BuildCodes(codeLengthLengths, 19, codeLengthCodes);
+      for (const auto& run : runs) {
+        writer.Put(codeLengthCodes[run.first], codeLengthLengths[run.first]);
+        if (run.first == 16) {
+          writer.Put(run.second, 2);
+        } else if (run.first == 17) {
+          writer.Put(run.second, 3);
+        } else if (run.first == 18) {
+          writer.Put(run.second, 7);
+        }
+      }
+      BuildCodes(literalLengths, 286, literalCodes);
+      BuildCodes(distanceLengths, 30, distanceCodes);
+    }
+    for (const Token& token : tokens) {
+      if (token.distance == 0) {
+        writer.Put(literalCodes[token.value], literalLengths[token.value]);
+        continue;
+      }
+      int lengthCode = GetLengthCode(token.value);
+      writer.Put(literalCodes[257 + lengthCode], literalLengths[257 + lengthCode]);
+      writer.Put(token.value - kLengthBase[lengthCode], kLengthExtra[lengthCode]);
+      int distanceCode = GetDistanceCode(token.distance);
+      writer.Put(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+      writer.Put(token.distance - kDistanceBase[distanceCode], kDistanceExtra[distanceCode]);
+    }
+    writer.Put(literalCodes[256], literalLengths[256]);
+  }
+
+  void WriteStored(BitWriter& writer, size_t start, size_t end, bool isFinal) {
+    do {
+      size_t length = (std::min)(end - start, static_cast<size_t>(65535));
+      bool isLast = isFinal && start + length == end;
+      writer.Put(isLast ? 1 : 0, 1);
+      writer.Put(0, 2);
+      writer.Align();
+      writer.Put(static_cast<uint32_t>(length), 16);
+      writer.Put(static_cast<uint32_t>(~length) & 0xFFFF, 16);
+      for (size_t i = 0; i < length; ++i) {
+        writer.Put(mData[start + i], 8);
+      }
+      start += length;
+    } while (start < end);
+  }
+
+  int mMaxChainLength;
+  int mNiceLength;
+  bool mIsLazy;
+  std::vector<int64_t> mHead;
+  std::vector<int64_t> mPrevious;
+  const uint8_t* mData = nullptr;
+  size_t mSize = 0;
+};
+
+struct Part {
+  opcmetadata::CentralEntry* entry = nullptr;
+  std::vector<uint8_t> localHeader; // Fixed fields, name and extra field
+  std::vector<uint8_t> data;        // Compressed data as read, then the data to write
+  bool isRepacked = false;
+  uint16_t method = 0;
+  uint32_t crc = 0;
+  uint32_t uncompressedSize = 0;
+  std::exception_ptr error;
+  bool isDone = false;
+};
+
+inline void Repack(Part& part, OpcCompressionLevel level) {
+  using namespace opcmetadata;
+  const uint8_t* header = part.entry->record.data();
+  uint16_t method = GetUInt16(header + 10);
+  uint32_t crc = GetUInt32(header + 16);
+  uint32_t uncompressedSize = GetUInt32(header + 24);
+  std::vector<uint8_t> content;
+  if (method == kDeflatedMethod) {
+    content = Inflate(part.data.data(), part.data.size(), uncompressedSize);
+  } else {
+    content.swap(part.data);
+  }
+  if (content.size() != uncompressedSize || Crc32(content.data(), content.size()) != crc) {
+    throw BadInputError("OPC part failed its checksum: " + part.entry->name);
+  }
+  part.crc = crc;
+  part.uncompressedSize = uncompressedSize;
+  if (level == OpcCompressionLevel::Store) {
+    part.method = kStoredMethod;
+    part.data.swap(content);
+  } else {
+    bool isFast = level == OpcCompressionLevel::Fast;
+    part.method = kDeflatedMethod;
+    part.data = Deflater(isFast ? 8 : 128, isFast ? 32 : 258, !isFast).Deflate(content.data(), content.size());
+  }
+  part.isRepacked = true;
+}
+
+struct State {
+  std::mutex mutex;
+  std::condition_variable condition;
+};
+
+} // namespace opcdeflate
+/** @endcond */
+
+/**
+ * @brief Writes an Office (OPC) document with every part recompressed at a chosen level, compressing parts in
+ *        parallel
+ * 
+ * @param inputStream Original document, a plain ZIP package
+ * @param outputStream Stream receiving the repacked document, positioned at its start and empty
+ * @param settings Compression level and parallelism
+ * 
+ * @return true if the document was written, false if it is not a plain ZIP package (for example a protected
+ *         document) or uses ZIP64, and nothing was written
+ * 
+ * @note FileHandler::CommitAsync compresses the parts inside the SDK, one at a time, at a level it chooses. Repack
+ *       a document before it is protected, or after a label-only commit, to choose the level: Store makes writing
+ *       and encrypting a large workbook much cheaper at the cost of size, while Default approaches the size Office
+ *       produces. Parts are read and written in their original order on the calling thread and compressed on the
+ *       task dispatcher, at most maxPartsInFlight at a time, so sheets of a workbook are compressed on all cores.
+ *       Encrypted or unknown parts are copied as they are. Every part is verified against its CRC before it is
+ *       recompressed.
+ */
+inline bool RepackOpcPackage(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::shared_ptr<Stream>& outputStream,
+    const OpcRepackSettings& settings = OpcRepackSettings()) {
+  using namespace opcmetadata;
+  if (!inputStream || !outputStream) {
+    throw BadInputError("RepackOpcPackage requires input and output streams");
+  }
+  Package package;
+  if (!ReadPackage(inputStream, package)) {
+    return false;
+  }
+  // A stored part is at most its size plus deflate block overhead; refuse output that could need ZIP64
+  int64_t maxOutputSize = static_cast<int64_t>(package.directorySize + package.endRecord.size());
+  for (const auto& entry : package.entries) {
+    int64_t uncompressedSize = GetUInt32(entry.record.data() + 24);
+    maxOutputSize += (entry.endOffset - entry.localOffset) + uncompressedSize + (uncompressedSize / 65535 + 1) * 5;
+  }
+  if (maxOutputSize > 0xFFFFFFFFll) {
+    return false;
+  }
+
+  size_t maxInFlight = (std::max)(settings.maxPartsInFlight, static_cast<size_t>(1));
+  auto state = std::make_shared<opcdeflate::State>();
+  std::deque<std::shared_ptr<opcdeflate::Part>> inFlight;
+  size_t nextPart = 0;
+  int64_t outputOffset = 0;
+  outputStream->Seek(0);
+  std::exception_ptr error;
+
+  auto waitForAll = [&]() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    for (const auto& part : inFlight) {
+      state->condition.wait(lock, [&part]() { return part->isDone; });
+    }
+  };
+  try {
+    while (nextPart < package.fileOrder.size() || !inFlight.empty()) {
+      // Read parts ahead, up to the in-flight limit, and start compressing them
+      while (nextPart < package.fileOrder.size() && inFlight.size() < maxInFlight) {
+        auto part = std::make_shared<opcdeflate::Part>();
+        part->entry = &package.entries[package.fileOrder[nextPart++]];
+        const uint8_t* header = part->entry->record.data();
+        uint16_t flags = GetUInt16(header + 8);
+        uint16_t method = GetUInt16(header + 10);
+        if ((flags & kEncryptedFlag) != 0 || (method != kStoredMethod && method != kDeflatedMethod)) {
+          part->isDone = true;
+          inFlight.push_back(part);
+          continue;
+        }
+        uint8_t localHeader[kLocalHeaderSize];
+        int64_t dataOffset = GetDataOffset(inputStream, *part->entry, localHeader);
+        part->localHeader.resize(static_cast<size_t>(dataOffset - part->entry->localOffset));
+        ReadAt(inputStream, part->entry->localOffset, part->localHeader.data(),
+            static_cast<int64_t>(part->localHeader.size()));
+        part->data.resize(GetUInt32(header + 20));
+        ReadAt(inputStream, dataOffset, part->data.data(), static_cast<int64_t>(part->data.size()));
+        OpcCompressionLevel level = settings.level;
+        auto compress = [part, state, level]() {
+          std::exception_ptr partError;
+          try {
+            opcdeflate::Repack(*part, level);
+          } catch (...) {
+            partError = std::current_exception();
+          }
+          std::lock_guard<std::mutex> lock(state->mutex);
+          part->error = partError;
+          part->isDone = true;
+          state->condition.notify_all();
+        };
+        // Only a part whose data was read is waited for, so that a damaged entry fails instead of hanging
+        inFlight.push_back(part);
+        if (static_cast<int64_t>(GetUInt32(header + 24)) < settings.minParallelSize) {
+          compress();
+        } else {
+          try {
+            if (settings.taskDispatcher) {
+              static std::atomic<uint64_t> sTaskCounter(0);
+              settings.taskDispatcher->DispatchTask("mip-opc-repack-" + std::to_string(++sTaskCounter), compress);
+            } else {
+              std::thread(compress).detach();
+            }
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            part->isDone = true;
+            throw;
+          }
+        }
+      }
+
+      // Write the oldest part once it is compressed
+      auto part = inFlight.front();
+      {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&part]() { return part->isDone; });
+      }
+      inFlight.pop_front();
+      if (part->error) {
+        std::rethrow_exception(part->error);
+      }
+      CentralEntry& entry = *part->entry;
+      int64_t newOffset = outputOffset;
+      if (!part->isRepacked) {
+        int64_t length = entry.endOffset - entry.localOffset;
+        if (CopyStream(CreateStreamSlice(inputStream, entry.localOffset, length), outputStream, 1024 * 1024) !=
+            length) {
+          throw FileIOError("Failed to copy OPC package entry");
+        }
+        outputOffset += length;
+      } else {
+        uint16_t flags = static_cast<uint16_t>(GetUInt16(entry.record.data() + 8) & ~(kDataDescriptorFlag | 0x0006));
+        uint16_t version = (std::max)(GetUInt16(entry.record.data() + 6),
+            static_cast<uint16_t>(part->method == kDeflatedMethod ? 20 : 10));
+        uint32_t compressedSize = static_cast<uint32_t>(part->data.size());
+        // The central record holds the same fields as the local header, two bytes further
+        for (int pass = 0; pass < 2; ++pass) {
+          uint8_t* fields = pass == 0 ? part->localHeader.data() : entry.record.data() + 2;
+          PutUInt16(fields + 4, version);
+          PutUInt16(fields + 6, flags);
+          PutUInt16(fields + 8, part->method);
+          PutUInt32(fields + 14, part->crc);
+          PutUInt32(fields + 18, compressedSize);
+          PutUInt32(fields + 22, part->uncompressedSize);
+        }
+        WriteAll(outputStream, part->localHeader.data(), part->localHeader.size());
+        WriteAll(outputStream, part->data.data(), part->data.size());
+        outputOffset += static_cast<int64_t>(part->localHeader.size() + part->data.size());
+      }
+      PutUInt32(&entry.record[42], static_cast<uint32_t>(newOffset));
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  waitForAll();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  int64_t newDirectoryOffset = outputOffset;
+  for (const auto& entry : package.entries) {
+    WriteAll(outputStream, entry.record.data(), entry.record.size());
+    outputOffset += static_cast<int64_t>(entry.record.size());
+  }
+  PutUInt32(&package.endRecord[12], static_cast<uint32_t>(outputOffset - newDirectoryOffset));
+  PutUInt32(&package.endRecord[16], static_cast<uint32_t>(newDirectoryOffset));
+  WriteAll(outputStream, package.endRecord.data(), package.endRecord.size());
+  outputStream->Flush();
+  return true;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_OPC_REPACK_H_
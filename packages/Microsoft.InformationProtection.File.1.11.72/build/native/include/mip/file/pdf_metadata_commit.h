@@ -0,0 +1,1059 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an incremental-update commit path for PDF documents whose label metadata is the only change
+ * 
+ * @file pdf_metadata_commit.h
+ */
+
+#ifndef API_MIP_FILE_PDF_METADATA_COMMIT_H_
+#define API_MIP_FILE_PDF_METADATA_COMMIT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/opc_metadata_commit.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+#include "mip/upe/metadata_action.h"
+#include "mip/upe/metadata_entry.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace pdfmetadata {
+
+const char kPdfxNamespace[] = "http://ns.adobe.com/pdfx/1.3/";
+const int64_t kTailSize = 2048;
+const int64_t kMaxObjectSize = 16 * 1024 * 1024;
+const size_t kMaxXrefSections = 4096;
+const int kMaxNestingDepth = 64;
+
+inline bool IsWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
+
+inline bool IsDelimiter(char c) {
+  return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' || c == '{' || c == '}' ||
+      c == '/' || c == '%';
+}
+
+inline size_t SkipWhitespace(const std::string& text, size_t position) {
+  while (position < text.size()) {
+    if (text[position] == '%') {
+      while (position < text.size() && text[position] != '\n' && text[position] != '\r') {
+        ++position;
+      }
+    } else if (IsWhitespace(text[position])) {
+      ++position;
+    } else {
+      break;
+    }
+  }
+  return position;
+}
+
+// End of the token or compound value at position, or npos if the text ends first. A reference ("12 0 R") is three
+// values; GetObjectEnd joins them. Arrays and dictionaries nested deeper than kMaxNestingDepth are rejected.
+inline size_t GetValueEnd(const std::string& text, size_t position, int depth = 0) {
+  if (depth > kMaxNestingDepth) {
+    throw BadInputError("PDF value is nested too deeply");
+  }
+  position = SkipWhitespace(text, position);
+  if (position >= text.size()) {
+    return std::string::npos;
+  }
+  char c = text[position];
+  if (c == '(') {
+    int parentheses = 0;
+    for (; position < text.size(); ++position) {
+      if (text[position] == '\\') {
+        ++position;
+      } else if (text[position] == '(') {
+        ++parentheses;
+      } else if (text[position] == ')' && --parentheses == 0) {
+        return position + 1;
+      }
+    }
+    return std::string::npos;
+  }
+  if (c == '<' && position + 1 < text.size() && text[position + 1] == '<') {
+    position += 2;
+    for (;;) {
+      position = SkipWhitespace(text, position);
+      if (position + 1 >= text.size()) {
+        return std::string::npos;
+      }
+      if (text[position] == '>' && text[position + 1] == '>') {
+        return position + 2;
+      }
+      position = GetValueEnd(text, position, depth + 1);
+      if (position == std::string::npos) {
+        return position;
+      }
+    }
+  }
+  if (c == '<') {
+    size_t end = text.find('>', position);
+    return end == std::string::npos ? end : end + 1;
+  }
+  if (c == '[') {
+    ++position;
+    for (;;) {
+      position = SkipWhitespace(text, position);
+      if (position >= text.size()) {
+        return std::string::npos;
+      }
+      if (text[position] == ']') {
+        return position + 1;
+      }
+      position = GetValueEnd(text, position, depth + 1);
+      if (position == std::string::npos) {
+        return position;
+      }
+    }
+  }
+  if (c == ')' || c == '>' || c == ']' || c == '{' || c == '}') {
+    throw BadInputError("Unexpected delimiter in PDF document");
+  }
+  ++position;
+  while (position < text.size() && !IsWhitespace(text[position]) && !IsDelimiter(text[position])) {
+    ++position;
+  }
+  return position;
+}
+
+// True if length bytes at offset lie within the stream
+inline bool IsWithinStream(const std::shared_ptr<Stream>& stream, int64_t offset, int64_t length) {
+  return offset >= 0 && length >= 0 && length <= stream->Size() - offset;
+}
+
+inline bool IsUnsignedInteger(const std::string& text, size_t start, size_t end) {
+  if (start >= end) {
+    return false;
+  }
+  for (size_t i = start; i < end; ++i) {
+    if (text[i] < '0' || text[i] > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline size_t GetObjectEnd(const std::string& text, size_t position) {
+  position = SkipWhitespace(text, position);
+  size_t end = GetValueEnd(text, position);
+  if (end == std::string::npos || !IsUnsignedInteger(text, position, end)) {
+    return end;
+  }
+  // Only look ahead at regular tokens, since the integer may be the last value before a closing delimiter
+  size_t generationStart = SkipWhitespace(text, end);
+  if (generationStart >= text.size() || text[generationStart] < '0' || text[generationStart] > '9') {
+    return end;
+  }
+  size_t generationEnd = GetValueEnd(text, generationStart);
+  if (generationEnd == std::string::npos || !IsUnsignedInteger(text, generationStart, generationEnd)) {
+    return end;
+  }
+  size_t keywordStart = SkipWhitespace(text, generationEnd);
+  if (keywordStart >= text.size() || text[keywordStart] != 'R') {
+    return end;
+  }
+  size_t keywordEnd = GetValueEnd(text, keywordStart);
+  return keywordEnd == keywordStart + 1 ? keywordEnd : end;
+}
+
+struct DictionaryEntry {
+  std::string key;
+  size_t keyStart;
+  size_t valueStart;
+  size_t valueEnd;
+};
+
+struct Dictionary {
+  std::vector<DictionaryEntry> entries;
+  size_t start = 0;
+  size_t end = 0;
+
+  const DictionaryEntry* Find(const std::string& key) const {
+    for (const auto& entry : entries) {
+      if (entry.key == key) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+};
+
+// Parses the dictionary at position; false if the text ends before it does
+inline bool ParseDictionary(const std::string& text, size_t position, Dictionary& dictionary) {
+  position = SkipWhitespace(text, position);
+  if (text.compare(position, 2, "<<") != 0) {
+    throw BadInputError("Expected a PDF dictionary");
+  }
+  dictionary.entries.clear();
+  dictionary.start = position;
+  position += 2;
+  for (;;) {
+    position = SkipWhitespace(text, position);
+    if (position + 1 >= text.size()) {
+      return false;
+    }
+    if (text[position] == '>' && text[position + 1] == '>') {
+      dictionary.end = position + 2;
+      return true;
+    }
+    if (text[position] != '/') {
+      throw BadInputError("Expected a name in PDF dictionary");
+    }
+    DictionaryEntry entry;
+    entry.keyStart = position;
+    size_t keyEnd = GetValueEnd(text, position);
+    if (keyEnd == std::string::npos) {
+      return false;
+    }
+    entry.key = text.substr(position + 1, keyEnd - position - 1);
+    entry.valueStart = SkipWhitespace(text, keyEnd);
+    entry.valueEnd = GetObjectEnd(text, entry.valueStart);
+    if (entry.valueEnd == std::string::npos) {
+      return false;
+    }
+    position = entry.valueEnd;
+    dictionary.entries.push_back(std::move(entry));
+  }
+}
+
+inline bool GetValue(const std::string& text, const Dictionary& dictionary, const std::string& key,
+    std::string& value) {
+  const DictionaryEntry* entry = dictionary.Find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  value = text.substr(entry->valueStart, entry->valueEnd - entry->valueStart);
+  return true;
+}
+
+inline bool ParseInteger(const std::string& value, int64_t& result) {
+  size_t start = SkipWhitespace(value, 0);
+  size_t end = GetValueEnd(value, start);
+  if (end == std::string::npos || !IsUnsignedInteger(value, start, end) || end - start > 18) {
+    return false;
+  }
+  result = std::stoll(value.substr(start, end - start));
+  return true;
+}
+
+inline bool ParseIntegerArray(const std::string& value, std::vector<int64_t>& numbers) {
+  size_t position = SkipWhitespace(value, 0);
+  if (position >= value.size() || value[position] != '[') {
+    return false;
+  }
+  for (position = SkipWhitespace(value, position + 1); position < value.size() && value[position] != ']';
+       position = SkipWhitespace(value, position)) {
+    size_t end = GetValueEnd(value, position);
+    int64_t number = 0;
+    if (end == std::string::npos || !ParseInteger(value.substr(position, end - position), number)) {
+      return false;
+    }
+    numbers.push_back(number);
+    position = end;
+  }
+  return position < value.size();
+}
+
+inline bool ParseReference(const std::string& value, int64_t& number, int64_t& generation) {
+  size_t start = SkipWhitespace(value, 0);
+  size_t end = GetValueEnd(value, start);
+  if (end == std::string::npos || GetObjectEnd(value, start) == end) {
+    return false;
+  }
+  size_t generationStart = SkipWhitespace(value, end);
+  size_t generationEnd = GetValueEnd(value, generationStart);
+  return ParseInteger(value.substr(start, end - start), number) &&
+      ParseInteger(value.substr(generationStart, generationEnd - generationStart), generation);
+}
+
+inline std::string ReadText(const std::shared_ptr<Stream>& stream, int64_t position, int64_t length) {
+  length = (std::max)(static_cast<int64_t>(0), (std::min)(length, stream->Size() - position));
+  std::string text(static_cast<size_t>(length), '\0');
+  if (length > 0) {
+    opcmetadata::ReadAt(stream, position, reinterpret_cast<uint8_t*>(&text[0]), length);
+  }
+  return text;
+}
+
+// An indirect object: its dictionary (or other value) and the absolute offset of its stream data, if any
+struct Object {
+  std::string text;
+  size_t valueStart = 0;
+  size_t valueEnd = 0;
+  bool isDictionary = false;
+  Dictionary dictionary;
+  int64_t streamOffset = -1;
+};
+
+inline bool ReadObject(const std::shared_ptr<Stream>& stream, int64_t offset, int64_t number, Object& object) {
+  for (int64_t chunkSize = 4096;; chunkSize *= 4) {
+    object.text = ReadText(stream, offset, chunkSize);
+    bool isComplete = static_cast<int64_t>(object.text.size()) < chunkSize;
+    const std::string& text = object.text;
+    size_t position = SkipWhitespace(text, 0);
+    size_t numberEnd = GetValueEnd(text, position);
+    int64_t actualNumber = -1;
+    if (numberEnd == std::string::npos || !ParseInteger(text.substr(position, numberEnd - position), actualNumber)) {
+      return false;
+    }
+    if (actualNumber != number) {
+      return false;
+    }
+    size_t generationEnd = GetValueEnd(text, numberEnd);
+    size_t keywordStart = SkipWhitespace(text, generationEnd);
+    if (generationEnd == std::string::npos || text.compare(keywordStart, 3, "obj") != 0) {
+      return false;
+    }
+    object.valueStart = SkipWhitespace(text, keywordStart + 3);
+    object.isDictionary = text.compare(object.valueStart, 2, "<<") == 0;
+    bool isParsed = object.isDictionary ? ParseDictionary(text, object.valueStart, object.dictionary) :
+        GetObjectEnd(text, object.valueStart) != std::string::npos;
+    if (isParsed) {
+      object.valueEnd = object.isDictionary ? object.dictionary.end : GetObjectEnd(text, object.valueStart);
+      size_t keyword = SkipWhitespace(text, object.valueEnd);
+      if (object.isDictionary && text.compare(keyword, 6, "stream") == 0) {
+        size_t data = keyword + 6;
+        data += text.compare(data, 2, "\r\n") == 0 ? 2 : (data < text.size() && text[data] == '\n' ? 1 : 0);
+        object.streamOffset = offset + static_cast<int64_t>(data);
+      }
+      return true;
+    }
+    if (isComplete || chunkSize >= kMaxObjectSize) {
+      return false;
+    }
+  }
+}
+
+// One cross-reference section: a classic table or a cross-reference stream, and its trailer
+struct XrefSection {
+  int64_t offset = 0;
+  bool isStream = false;
+  std::string trailer;
+  Dictionary trailerDictionary;
+  std::vector<std::pair<int64_t, int64_t>> subsections; // First object number and count
+  std::vector<int64_t> tableOffsets;                     // Classic table: offset of each subsection's entries
+  std::vector<uint8_t> rows;                             // Stream: decoded entries
+  int widths[3] = {};
+};
+
+inline void ApplyPngPredictor(std::vector<uint8_t>& data, size_t columns) {
+  size_t rowSize = columns + 1;
+  if (columns == 0 || data.size() % rowSize != 0) {
+    throw BadInputError("Invalid PDF cross-reference stream predictor data");
+  }
+  std::vector<uint8_t> output;
+  output.reserve(data.size() / rowSize * columns);
+  std::vector<uint8_t> previous(columns, 0);
+  for (size_t row = 0; row * rowSize < data.size(); ++row) {
+    uint8_t filter = data[row * rowSize];
+    uint8_t* current = &data[row * rowSize + 1];
+    for (size_t i = 0; i < columns; ++i) {
+      int left = 0;
+      int upperLeft = i > 0 ? previous[i - 1] : 0;
+      int up = previous[i];
+      left = i > 0 ? current[i - 1] : 0;
+      int predicted = 0;
+      switch (filter) {
+        case 0: predicted = 0; break;
+        case 1: predicted = left; break;
+        case 2: predicted = up; break;
+        case 3: predicted = (left + up) / 2; break;
+        case 4: {
+          int estimate = left + up - upperLeft;
+          int distanceLeft = std::abs(estimate - left);
+          int distanceUp = std::abs(estimate - up);
+          int distanceUpperLeft = std::abs(estimate - upperLeft);
+          predicted = distanceLeft <= distanceUp && distanceLeft <= distanceUpperLeft ? left :
+              (distanceUp <= distanceUpperLeft ? up : upperLeft);
+          break;
+        }
+        default: throw BadInputError("Invalid PNG predictor in PDF cross-reference stream");
+      }
+      current[i] = static_cast<uint8_t>(current[i] + predicted);
+    }
+    previous.assign(current, current + columns);
+    output.insert(output.end(), current, current + columns);
+  }
+  data.swap(output);
+}
+
+inline bool ReadXrefStream(const std::shared_ptr<Stream>& stream, XrefSection& section) {
+  std::string text = ReadText(stream, section.offset, 64);
+  size_t numberEnd = GetValueEnd(text, 0);
+  int64_t number = 0;
+  if (numberEnd == std::string::npos || !ParseInteger(text.substr(0, numberEnd), number)) {
+    return false;
+  }
+  Object object;
+  if (!ReadObject(stream, section.offset, number, object) || !object.isDictionary || object.streamOffset < 0) {
+    return false;
+  }
+  std::string value;
+  int64_t length = 0;
+  int64_t size = 0;
+  if (!GetValue(object.text, object.dictionary, "Type", value) || value != "/XRef" ||
+      !GetValue(object.text, object.dictionary, "Length", value) || !ParseInteger(value, length) ||
+      !GetValue(object.text, object.dictionary, "Size", value) || !ParseInteger(value, size) ||
+      !GetValue(object.text, object.dictionary, "W", value)) {
+    return false;
+  }
+  section.isStream = true;
+  section.trailer = object.text.substr(0, object.dictionary.end);
+  section.trailerDictionary = object.dictionary;
+
+  // Field widths and the object ranges the rows describe
+  std::vector<int64_t> numbers;
+  if (!ParseIntegerArray(value, numbers) || numbers.size() != 3) {
+    return false;
+  }
+  for (int64_t width : numbers) {
+    if (width < 0 || width > 8) {
+      return false;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    section.widths[i] = static_cast<int>(numbers[static_cast<size_t>(i)]);
+  }
+  numbers.clear();
+  if (GetValue(object.text, object.dictionary, "Index", value)) {
+    if (!ParseIntegerArray(value, numbers)) {
+      return false;
+    }
+  } else {
+    numbers.push_back(0);
+    numbers.push_back(size);
+  }
+  // The rows of all subsections must fit in a decoded stream of at most kMaxObjectSize bytes
+  size_t rowSize = static_cast<size_t>(section.widths[0] + section.widths[1] + section.widths[2]);
+  int64_t rowCount = 0;
+  for (size_t i = 0; i + 1 < numbers.size(); i += 2) {
+    int64_t first = numbers[i];
+    int64_t count = numbers[i + 1];
+    if (first < 0 || count < 0 || count > kMaxObjectSize - rowCount) {
+      return false;
+    }
+    section.subsections.emplace_back(first, count);
+    rowCount += count;
+  }
+  if (rowSize == 0 || !IsWithinStream(stream, object.streamOffset, length) ||
+      static_cast<uint64_t>(rowCount) * rowSize > static_cast<uint64_t>(kMaxObjectSize)) {
+    return false;
+  }
+
+  // Decode the rows: FlateDecode, optionally with a PNG predictor, or no filter
+  std::vector<uint8_t> data(static_cast<size_t>(length));
+  opcmetadata::ReadAt(stream, object.streamOffset, data.data(), length);
+  if (GetValue(object.text, object.dictionary, "Filter", value)) {
+    if (value.find("/FlateDecode") == std::string::npos || value.find('/', value.find("/FlateDecode") + 1) !=
+        std::string::npos || data.size() < 2) {
+      return false;
+    }
+    data = opcmetadata::Inflate(data.data() + 2, data.size() - 2,
+        static_cast<size_t>(rowCount) * (rowSize + 1));
+    std::string parameters;
+    if (GetValue(object.text, object.dictionary, "DecodeParms", parameters) && parameters.compare(0, 2, "<<") == 0) {
+      Dictionary parameterDictionary;
+      int64_t predictor = 1;
+      int64_t columns = 1;
+      if (!ParseDictionary(parameters, 0, parameterDictionary)) {
+        return false;
+      }
+      if (GetValue(parameters, parameterDictionary, "Predictor", value)) {
+        ParseInteger(value, predictor);
+      }
+      if (GetValue(parameters, parameterDictionary, "Columns", value)) {
+        ParseInteger(value, columns);
+      }
+      if (predictor >= 10) {
+        ApplyPngPredictor(data, static_cast<size_t>(columns));
+      } else if (predictor != 1) {
+        return false;
+      }
+    }
+  }
+  if (data.size() < static_cast<size_t>(rowCount) * rowSize) {
+    return false;
+  }
+  section.rows.swap(data);
+  return true;
+}
+
+inline bool ReadXrefSection(const std::shared_ptr<Stream>& stream, int64_t offset, XrefSection& section) {
+  section.offset = offset;
+  std::string text = ReadText(stream, offset, 4096);
+  size_t position = SkipWhitespace(text, 0);
+  if (text.compare(position, 4, "xref") != 0) {
+    return ReadXrefStream(stream, section);
+  }
+  // Classic table: subsection headers, each followed by fixed 20-byte entries, then the trailer
+  int64_t base = offset;
+  position += 4;
+  for (;;) {
+    position = SkipWhitespace(text, position);
+    if (position + 64 > text.size() && static_cast<int64_t>(text.size()) == 4096) {
+      base += static_cast<int64_t>(position);
+      text = ReadText(stream, base, 4096);
+      position = 0;
+    }
+    if (text.compare(position, 7, "trailer") == 0) {
+      break;
+    }
+    size_t firstEnd = GetValueEnd(text, position);
+    size_t countStart = SkipWhitespace(text, firstEnd);
+    size_t countEnd = GetValueEnd(text, countStart);
+    int64_t first = 0;
+    int64_t count = 0;
+    if (countEnd == std::string::npos || !ParseInteger(text.substr(position, firstEnd - position), first) ||
+        !ParseInteger(text.substr(countStart, countEnd - countStart), count) || first < 0 || count < 0 ||
+        count > stream->Size() / 20) {
+      return false;
+    }
+    // The header line ends with its end-of-line marker; the entries follow
+    size_t entries = countEnd;
+    while (entries < text.size() && (text[entries] == ' ' || text[entries] == '\r' || text[entries] == '\n')) {
+      ++entries;
+    }
+    section.subsections.emplace_back(first, count);
+    section.tableOffsets.push_back(base + static_cast<int64_t>(entries));
+    base += static_cast<int64_t>(entries) + count * 20;
+    text = ReadText(stream, base, 4096);
+    position = 0;
+  }
+  size_t trailerStart = position + 7;
+  for (int64_t chunkSize = 4096;; chunkSize *= 4) {
+    text = ReadText(stream, base, chunkSize);
+    if (ParseDictionary(text, trailerStart, section.trailerDictionary)) {
+      break;
+    }
+    if (static_cast<int64_t>(text.size()) < chunkSize || chunkSize >= kMaxObjectSize) {
+      return false;
+    }
+  }
+  section.trailer = text.substr(0, section.trailerDictionary.end);
+  return true;
+}
+
+// Looks an object up in one section: 1 for an object at offset, 2 for an object in an object stream, 0 for a free
+// entry, -1 if the section does not describe the object
+inline int FindObject(const std::shared_ptr<Stream>& stream, const XrefSection& section, int64_t number,
+    int64_t& offset) {
+  int64_t row = 0;
+  for (size_t i = 0; i < section.subsections.size(); ++i) {
+    int64_t first = section.subsections[i].first;
+    int64_t count = section.subsections[i].second;
+    if (number < first || number - first >= count) {
+      row += count;
+      continue;
+    }
+    if (!section.isStream) {
+      std::string entry = ReadText(stream, section.tableOffsets[i] + (number - first) * 20, 20);
+      if (entry.size() < 18 || !ParseInteger(entry.substr(0, 10), offset)) {
+        throw BadInputError("Invalid PDF cross-reference entry");
+      }
+      return entry[17] == 'n' ? 1 : 0;
+    }
+    size_t rowSize = static_cast<size_t>(section.widths[0] + section.widths[1] + section.widths[2]);
+    size_t rowIndex = static_cast<size_t>(row + number - first);
+    if (rowSize == 0 || rowIndex >= section.rows.size() / rowSize) {
+      throw BadInputError("Invalid PDF cross-reference stream entry");
+    }
+    const uint8_t* data = &section.rows[rowIndex * rowSize];
+    int64_t fields[3] = {section.widths[0] == 0 ? 1 : 0, 0, 0};
+    for (int field = 0; field < 3; ++field) {
+      for (int byte = 0; byte < section.widths[field]; ++byte) {
+        fields[field] = (field == 0 && byte == 0 ? 0 : fields[field] << 8) | *data++;
+      }
+    }
+    offset = fields[1];
+    return fields[0] == 1 ? 1 : (fields[0] == 2 ? 2 : 0);
+  }
+  return -1;
+}
+
+// The cross-reference chain of a document, newest section first
+class Xref {
+public:
+  bool Read(const std::shared_ptr<Stream>& stream) {
+    mStream = stream;
+    int64_t size = stream->Size();
+    std::string tail = ReadText(stream, (std::max)(static_cast<int64_t>(0), size - kTailSize), kTailSize);
+    size_t keyword = tail.rfind("startxref");
+    if (keyword == std::string::npos || tail.find("%%EOF", keyword) == std::string::npos) {
+      return false;
+    }
+    size_t start = SkipWhitespace(tail, keyword + 9);
+    size_t end = GetValueEnd(tail, start);
+    int64_t offset = 0;
+    if (end == std::string::npos || !ParseInteger(tail.substr(start, end - start), offset)) {
+      return false;
+    }
+    mStartOffset = offset;
+    std::vector<int64_t> pending(1, offset);
+    while (!pending.empty()) {
+      offset = pending.back();
+      pending.pop_back();
+      if (offset <= 0 || offset >= size || mSections.size() >= kMaxXrefSections) {
+        return false;
+      }
+      XrefSection section;
+      if (!ReadXrefSection(stream, offset, section)) {
+        return false;
+      }
+      std::string value;
+      int64_t previous = 0;
+      bool hasPrevious = GetValue(section.trailer, section.trailerDictionary, "Prev", value) &&
+          ParseInteger(value, previous);
+      int64_t hybrid = 0;
+      bool isHybrid = !section.isStream &&
+          GetValue(section.trailer, section.trailerDictionary, "XRefStm", value) && ParseInteger(value, hybrid);
+      mSections.push_back(std::move(section));
+      // Searched in order: this section, its hybrid cross-reference stream, then the previous section
+      if (hasPrevious) {
+        pending.push_back(previous);
+      }
+      if (isHybrid) {
+        pending.push_back(hybrid);
+      }
+    }
+    return true;
+  }
+
+  const XrefSection& GetNewest() const { return mSections.front(); }
+  int64_t GetStartOffset() const { return mStartOffset; }
+
+  // Offset of an object stored directly in the file, or -1 if it is free, compressed or missing
+  int64_t FindObjectOffset(int64_t number) const {
+    for (const auto& section : mSections) {
+      int64_t offset = 0;
+      int type = FindObject(mStream, section, number, offset);
+      if (type >= 0) {
+        return type == 1 ? offset : -1;
+      }
+    }
+    return -1;
+  }
+
+  bool ReadObject(int64_t number, Object& object) const {
+    int64_t offset = FindObjectOffset(number);
+    return offset >= 0 && pdfmetadata::ReadObject(mStream, offset, number, object);
+  }
+
+  bool ResolveInteger(const std::string& value, int64_t& result) const {
+    int64_t number = 0;
+    int64_t generation = 0;
+    if (!ParseReference(value, number, generation)) {
+      return ParseInteger(value, result);
+    }
+    Object object;
+    return ReadObject(number, object) &&
+        ParseInteger(object.text.substr(object.valueStart, object.valueEnd - object.valueStart), result);
+  }
+
+private:
+  std::shared_ptr<Stream> mStream;
+  std::vector<XrefSection> mSections;
+  int64_t mStartOffset = 0;
+};
+
+inline std::string FindNamespacePrefix(const std::string& xmp, const std::string& uri) {
+  size_t position = xmp.find("\"" + uri + "\"");
+  if (position == std::string::npos) {
+    position = xmp.find("'" + uri + "'");
+  }
+  if (position == std::string::npos) {
+    return std::string();
+  }
+  size_t declaration = xmp.rfind("xmlns:", position);
+  if (declaration == std::string::npos) {
+    return std::string();
+  }
+  size_t end = xmp.find('=', declaration);
+  return end != std::string::npos && end < position ? xmp.substr(declaration + 6, end - declaration - 6) :
+      std::string();
+}
+
+// Removes every element and attribute form of a property
+inline void RemoveXmpProperty(std::string& xmp, const std::string& qualifiedName) {
+  for (size_t position = 0; (position = xmp.find("<" + qualifiedName, position)) != std::string::npos;) {
+    size_t nameEnd = position + 1 + qualifiedName.size();
+    if (nameEnd >= xmp.size() || (xmp[nameEnd] != '>' && xmp[nameEnd] != '/' && !IsWhitespace(xmp[nameEnd]))) {
+      position = nameEnd;
+      continue;
+    }
+    size_t tagEnd = xmp.find('>', nameEnd);
+    if (tagEnd == std::string::npos) {
+      return;
+    }
+    size_t end = tagEnd + 1;
+    if (xmp[tagEnd - 1] != '/') {
+      size_t close = xmp.find("</" + qualifiedName + ">", tagEnd);
+      if (close == std::string::npos) {
+        return;
+      }
+      end = close + qualifiedName.size() + 3;
+    }
+    xmp.erase(position, end - position);
+  }
+  for (size_t position = 0; (position = xmp.find(qualifiedName + "=", position)) != std::string::npos;) {
+    if (position == 0 || !IsWhitespace(xmp[position - 1]) || position + qualifiedName.size() + 1 >= xmp.size()) {
+      position += qualifiedName.size();
+      continue;
+    }
+    char quote = xmp[position + qualifiedName.size() + 1];
+    size_t end = xmp.find(quote, position + qualifiedName.size() + 2);
+    if ((quote != '"' && quote != '\'') || end == std::string::npos) {
+      return;
+    }
+    xmp.erase(position - 1, end + 2 - position);
+  }
+}
+
+// Removes rdf:Description elements left with neither properties nor attributes other than rdf:about and xmlns
+inline void RemoveEmptyXmpDescriptions(std::string& xmp) {
+  static const std::string kStart = "<rdf:Description";
+  static const std::string kEnd = "</rdf:Description>";
+  for (size_t position = 0; (position = xmp.find(kStart, position)) != std::string::npos;) {
+    size_t cursor = position + kStart.size();
+    bool isEmpty = cursor < xmp.size() && (xmp[cursor] == '>' || xmp[cursor] == '/' || IsWhitespace(xmp[cursor]));
+    while (isEmpty) {
+      while (cursor < xmp.size() && IsWhitespace(xmp[cursor])) {
+        cursor++;
+      }
+      if (cursor >= xmp.size() || xmp[cursor] == '>' || xmp[cursor] == '/') {
+        break;
+      }
+      size_t equals = xmp.find('=', cursor);
+      size_t valueEnd = equals == std::string::npos || equals + 1 >= xmp.size() ? std::string::npos :
+          xmp.find(xmp[equals + 1], equals + 2);
+      if (valueEnd == std::string::npos || (xmp[equals + 1] != '"' && xmp[equals + 1] != '\'')) {
+        return;
+      }
+      std::string name = xmp.substr(cursor, equals - cursor);
+      isEmpty = name == "rdf:about" || name == "xmlns" || name.compare(0, 6, "xmlns:") == 0;
+      cursor = valueEnd + 1;
+    }
+    size_t end = std::string::npos;
+    if (isEmpty && cursor + 1 < xmp.size() && xmp[cursor] == '/' && xmp[cursor + 1] == '>') {
+      end = cursor + 2;
+    } else if (isEmpty && cursor < xmp.size() && xmp[cursor] == '>') {
+      size_t close = xmp.find('<', cursor);
+      bool isBlank = close != std::string::npos && xmp.compare(close, kEnd.size(), kEnd) == 0 &&
+          std::all_of(xmp.begin() + cursor + 1, xmp.begin() + close, IsWhitespace);
+      end = isBlank ? close + kEnd.size() : std::string::npos;
+    }
+    if (end == std::string::npos) {
+      position = cursor;
+      continue;
+    }
+    if (end < xmp.size() && xmp[end] == '\n') {
+      end++;
+    }
+    xmp.erase(position, end - position);
+  }
+}
+
+// Applies the metadata changes to an XMP packet, creating one if empty; false if the packet has no rdf:RDF
+inline bool UpdateXmp(std::string& xmp, const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd) {
+  if (xmp.empty()) {
+    xmp = "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+        "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+        "<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+        "</rdf:RDF>\n"
+        "</x:xmpmeta>\n"
+        "<?xpacket end=\"w\"?>";
+  }
+  size_t rdfEnd = xmp.rfind("</rdf:RDF>");
+  if (rdfEnd == std::string::npos) {
+    return false;
+  }
+  std::string prefix = FindNamespacePrefix(xmp, kPdfxNamespace);
+  if (!prefix.empty()) {
+    for (const std::string& name : metadataToRemove) {
+      RemoveXmpProperty(xmp, prefix + ":" + name);
+    }
+    for (const MetadataEntry& entry : metadataToAdd) {
+      RemoveXmpProperty(xmp, prefix + ":" + entry.GetKey());
+    }
+    RemoveEmptyXmpDescriptions(xmp);
+  }
+  if (metadataToAdd.empty()) {
+    return true;
+  }
+  std::string description = "<rdf:Description rdf:about=\"\" xmlns:pdfx=\"" + std::string(kPdfxNamespace) + "\">\n";
+  for (const MetadataEntry& entry : metadataToAdd) {
+    description += "<pdfx:" + entry.GetKey() + ">" + opcmetadata::XmlEscape(entry.GetValue()) + "</pdfx:" +
+        entry.GetKey() + ">\n";
+  }
+  description += "</rdf:Description>\n";
+  xmp.insert(xmp.rfind("</rdf:RDF>"), description);
+  return true;
+}
+
+inline std::string ToString(int64_t value) {
+  return std::to_string(static_cast<long long>(value));
+}
+
+// Builds the bytes to append to the document: the metadata stream, the catalog if it did not reference metadata
+// yet, and a cross-reference section of the same kind as the newest one
+inline bool BuildIncrementalUpdate(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd,
+    std::string& update) {
+  int64_t inputSize = inputStream->Size();
+  std::string header = ReadText(inputStream, 0, 1024);
+  if (header.find("%PDF-") == std::string::npos) {
+    return false;
+  }
+  Xref xref;
+  if (!xref.Read(inputStream)) {
+    return false;
+  }
+  const XrefSection& newest = xref.GetNewest();
+  const std::string& trailer = newest.trailer;
+  std::string rootValue;
+  std::string sizeValue;
+  std::string value;
+  int64_t rootNumber = 0;
+  int64_t rootGeneration = 0;
+  int64_t size = 0;
+  if (newest.trailerDictionary.Find("Encrypt") != nullptr ||
+      !GetValue(trailer, newest.trailerDictionary, "Root", rootValue) ||
+      !ParseReference(rootValue, rootNumber, rootGeneration) ||
+      !GetValue(trailer, newest.trailerDictionary, "Size", sizeValue) || !ParseInteger(sizeValue, size)) {
+    return false;
+  }
+  Object catalog;
+  if (!xref.ReadObject(rootNumber, catalog) || !catalog.isDictionary) {
+    return false;
+  }
+
+  // Read the current XMP packet, if the catalog references one
+  std::string xmp;
+  int64_t metadataNumber = size;
+  int64_t metadataGeneration = 0;
+  bool hasMetadata = GetValue(catalog.text, catalog.dictionary, "Metadata", value);
+  if (hasMetadata) {
+    Object metadata;
+    int64_t length = 0;
+    if (!ParseReference(value, metadataNumber, metadataGeneration) || !xref.ReadObject(metadataNumber, metadata) ||
+        !metadata.isDictionary || metadata.streamOffset < 0 ||
+        !GetValue(metadata.text, metadata.dictionary, "Length", value) || !xref.ResolveInteger(value, length) ||
+        length > kMaxObjectSize || !IsWithinStream(inputStream, metadata.streamOffset, length)) {
+      return false;
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(length));
+    opcmetadata::ReadAt(inputStream, metadata.streamOffset, data.data(), length);
+    if (GetValue(metadata.text, metadata.dictionary, "Filter", value)) {
+      if (value.find("/FlateDecode") == std::string::npos || data.size() < 2 ||
+          metadata.dictionary.Find("DecodeParms") != nullptr) {
+        return false;
+      }
+      data = opcmetadata::Inflate(data.data() + 2, data.size() - 2, static_cast<size_t>(kMaxObjectSize));
+    }
+    xmp.assign(data.begin(), data.end());
+  }
+  if (!UpdateXmp(xmp, metadataToRemove, metadataToAdd)) {
+    return false;
+  }
+
+  // New objects, each with its offset in the updated document
+  std::vector<std::pair<std::pair<int64_t, int64_t>, int64_t>> objects;
+  update = "\n";
+  objects.push_back(std::make_pair(std::make_pair(metadataNumber, metadataGeneration),
+      inputSize + static_cast<int64_t>(update.size())));
+  update += ToString(metadataNumber) + " " + ToString(metadataGeneration) + " obj\n<< /Type /Metadata /Subtype /XML" +
+      " /Length " + ToString(static_cast<int64_t>(xmp.size())) + " >>\nstream\n" + xmp + "\nendstream\nendobj\n";
+  int64_t newSize = hasMetadata ? size : size + 1;
+  if (!hasMetadata) {
+    objects.push_back(std::make_pair(std::make_pair(rootNumber, rootGeneration),
+        inputSize + static_cast<int64_t>(update.size())));
+    std::string dictionary = catalog.text.substr(catalog.dictionary.start, catalog.dictionary.end -
+        catalog.dictionary.start - 2);
+    update += ToString(rootNumber) + " " + ToString(rootGeneration) + " obj\n" + dictionary + " /Metadata " +
+        ToString(metadataNumber) + " 0 R >>\nendobj\n";
+  }
+
+  // Trailer entries carried over from the newest section
+  std::string trailerEntries = " /Root " + rootValue;
+  for (const char* key : {"Info", "ID"}) {
+    if (GetValue(trailer, newest.trailerDictionary, key, value)) {
+      trailerEntries += std::string(" /") + key + " " + value;
+    }
+  }
+  trailerEntries += " /Prev " + ToString(xref.GetStartOffset());
+
+  int64_t xrefOffset = inputSize + static_cast<int64_t>(update.size());
+  if (!newest.isStream) {
+    std::sort(objects.begin(), objects.end());
+    update += "xref\n";
+    for (const auto& object : objects) {
+      char entry[32];
+      std::snprintf(entry, sizeof(entry), "%010lld %05lld n\r\n", static_cast<long long>(object.second),
+          static_cast<long long>(object.first.second));
+      update += ToString(object.first.first) + " 1\n" + entry;
+    }
+    update += "trailer\n<< /Size " + ToString(newSize) + trailerEntries + " >>\nstartxref\n" +
+        ToString(xrefOffset) + "\n%%EOF\n";
+    return true;
+  }
+
+  // The document uses cross-reference streams, so the update does too; the stream describes itself
+  int64_t xrefNumber = newSize++;
+  objects.push_back(std::make_pair(std::make_pair(xrefNumber, static_cast<int64_t>(0)), xrefOffset));
+  std::sort(objects.begin(), objects.end());
+  int offsetWidth = xrefOffset > 0xFFFFFFFFll ? 8 : 4;
+  std::string rows;
+  std::string index;
+  for (const auto& object : objects) {
+    rows += '\x01';
+    for (int byte = offsetWidth - 1; byte >= 0; --byte) {
+      rows += static_cast<char>((object.second >> (8 * byte)) & 0xFF);
+    }
+    rows += static_cast<char>((object.first.second >> 8) & 0xFF);
+    rows += static_cast<char>(object.first.second & 0xFF);
+    index += " " + ToString(object.first.first) + " 1";
+  }
+  update += ToString(xrefNumber) + " 0 obj\n<< /Type /XRef /Size " + ToString(newSize) + " /Index [" + index +
+      " ] /W [1 " + ToString(offsetWidth) + " 2]" + trailerEntries + " /Length " +
+      ToString(static_cast<int64_t>(rows.size())) + " >>\nstream\n" + rows + "\nendstream\nendobj\nstartxref\n" +
+      ToString(xrefOffset) + "\n%%EOF\n";
+  return true;
+}
+
+} // namespace pdfmetadata
+/** @endcond */
+
+/**
+ * @brief Writes a PDF document with updated label metadata as an incremental update, streaming the original bytes
+ *        through unchanged
+ * 
+ * @param inputStream Original document
+ * @param outputStream Stream receiving the updated document, positioned at its start and empty
+ * @param metadataToRemove Names of the metadata entries to remove
+ * @param metadataToAdd Metadata entries to add or replace
+ * 
+ * @return true if the document was written, false if this fast path does not apply and nothing was written
+ * 
+ * @note The label is written to the document's XMP packet as custom document properties (the pdfx namespace). The
+ *       new metadata stream, the catalog if it did not reference metadata yet, and a cross-reference section of the
+ *       same kind as the document's (table or stream) are appended after the original bytes, as PDF incremental
+ *       updates specify; nothing of the original is parsed beyond its cross-reference chain, the catalog and the
+ *       current XMP packet. The fast path does not apply, and FileHandler::CommitAsync must be used, when the
+ *       document is encrypted (including a protected PDF), its catalog is in an object stream, its XMP packet uses
+ *       a filter other than FlateDecode, or when protection or content markings change as well. The caller remains
+ *       responsible for FileHandler::NotifyCommitSuccessful, which fires the audit event.
+ */
+inline bool CommitPdfMetadataIncrementally(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::shared_ptr<Stream>& outputStream,
+    const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd) {
+  if (!inputStream || !outputStream) {
+    throw BadInputError("CommitPdfMetadataIncrementally requires input and output streams");
+  }
+  std::string update;
+  if (!pdfmetadata::BuildIncrementalUpdate(inputStream, metadataToRemove, metadataToAdd, update)) {
+    return false;
+  }
+  inputStream->Seek(0);
+  outputStream->Seek(0);
+  if (CopyStream(inputStream, outputStream, 1024 * 1024) != inputStream->Size()) {
+    throw FileIOError("Failed to copy PDF document");
+  }
+  opcmetadata::WriteAll(outputStream, reinterpret_cast<const uint8_t*>(update.data()), update.size());
+  outputStream->Flush();
+  return true;
+}
+
+/**
+ * @brief Writes a PDF document with the metadata changes computed by a policy handler as an incremental update
+ * 
+ * @param inputStream Original document
+ * @param outputStream Stream receiving the updated document, positioned at its start and empty
+ * @param metadataAction Metadata action returned by PolicyHandler::ComputeActions
+ * 
+ * @return true if the document was written, false if this fast path does not apply and nothing was written
+ */
+inline bool CommitPdfMetadataIncrementally(
+    const std::shared_ptr<Stream>& inputStream,
+    const std::shared_ptr<Stream>& outputStream,
+    const MetadataAction& metadataAction) {
+  return CommitPdfMetadataIncrementally(
+      inputStream, outputStream, metadataAction.GetMetadataToRemove(), metadataAction.GetMetadataToAdd());
+}
+
+/**
+ * @brief Updates the label metadata of a PDF document in place, by appending an incremental update to it
+ * 
+ * @param stream Document, opened for reading and writing
+ * @param metadataToRemove Names of the metadata entries to remove
+ * @param metadataToAdd Metadata entries to add or replace
+ * 
+ * @return true if the update was appended, false if this fast path does not apply and the document is unchanged
+ * 
+ * @note Only the appended bytes are written, so labeling a 300 MB scanned document reads its cross-reference chain
+ *       and writes a few kilobytes. See CommitPdfMetadataIncrementally for when the fast path applies. A failure
+ *       while appending can leave a partial update after the original bytes, which readers ignore as long as the
+ *       previous end-of-file marker is intact; truncate the stream to its original size to discard it.
+ */
+inline bool AppendPdfMetadataUpdate(
+    const std::shared_ptr<Stream>& stream,
+    const std::vector<std::string>& metadataToRemove,
+    const std::vector<MetadataEntry>& metadataToAdd) {
+  if (!stream) {
+    throw BadInputError("AppendPdfMetadataUpdate requires a stream");
+  }
+  std::string update;
+  if (!pdfmetadata::BuildIncrementalUpdate(stream, metadataToRemove, metadataToAdd, update)) {
+    return false;
+  }
+  stream->Seek(stream->Size());
+  opcmetadata::WriteAll(stream, reinterpret_cast<const uint8_t*>(update.data()), update.size());
+  stream->Flush();
+  return true;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_PDF_METADATA_COMMIT_H_
@@ -0,0 +1,270 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines PFileSegmentIndex, which lets the content of a PFile be read from any offset without decrypting what
+ *        comes before it
+ * 
+ * @file pfile_segment_index.h
+ */
+
+#ifndef API_MIP_FILE_PFILE_SEGMENT_INDEX_H_
+#define API_MIP_FILE_PFILE_SEGMENT_INDEX_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/lazy_decrypted_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/decrypted_segment_cache.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/stream.h"
+#include "mip/stream_slice.h"
+#include "mip/stream_utils.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Location of the encrypted payload within a PFile
+ * 
+ * @note The payload of a PFile follows its header and runs to the end of the file; with the offset of its first byte
+ *       known, CreateIndexedPFileStream seeks to any cleartext offset by decrypting only the segment holding it. The
+ *       index is small and is stored next to the PFile, e.g. in the application's own catalog, because the header
+ *       layout is written by the SDK. The file size and the first encrypted bytes are recorded so that an index
+ *       which no longer matches its PFile is detected.
+ */
+struct PFileSegmentIndex {
+  int64_t contentStart = 0;                /**< Offset of the encrypted payload in the PFile */
+  int64_t contentSize = 0;                 /**< Size of the encrypted payload */
+  int64_t originalSize = 0;                /**< Size of the cleartext */
+  int64_t fileSize = 0;                    /**< Size of the PFile */
+  std::array<uint8_t, 16> fingerprint = {}; /**< First bytes of the encrypted payload */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace pfileindex {
+
+constexpr const char kMagic[8] = {'M', 'I', 'P', 'P', 'S', 'I', 'X', '1'};
+constexpr size_t kSerializedSize = sizeof(kMagic) + 4 * sizeof(uint64_t) + 16;
+
+inline void AppendUint64(uint64_t value, std::vector<uint8_t>& out) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+inline int64_t ReadInt64(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = (value << 8) | data[i];
+  }
+  return static_cast<int64_t>(value);
+}
+
+// Reads the fingerprint at the start of the payload, leaving the position of the stream unchanged
+inline std::array<uint8_t, 16> ReadFingerprint(const std::shared_ptr<Stream>& stream, int64_t contentStart) {
+  std::array<uint8_t, 16> fingerprint = {};
+  int64_t position = stream->Position();
+  stream->Seek(contentStart);
+  ReadFromStream(stream, fingerprint.data(), static_cast<int64_t>(fingerprint.size()));
+  stream->Seek(position);
+  return fingerprint;
+}
+
+} // namespace pfileindex
+/** @endcond */
+
+/**
+ * @brief Serialize a segment index
+ * 
+ * @param index Index to serialize
+ * 
+ * @return Serialized index of fixed size
+ */
+inline std::vector<uint8_t> SerializePFileSegmentIndex(const PFileSegmentIndex& index) {
+  std::vector<uint8_t> output(pfileindex::kMagic, pfileindex::kMagic + sizeof(pfileindex::kMagic));
+  output.reserve(pfileindex::kSerializedSize);
+  pfileindex::AppendUint64(static_cast<uint64_t>(index.contentStart), output);
+  pfileindex::AppendUint64(static_cast<uint64_t>(index.contentSize), output);
+  pfileindex::AppendUint64(static_cast<uint64_t>(index.originalSize), output);
+  pfileindex::AppendUint64(static_cast<uint64_t>(index.fileSize), output);
+  output.insert(output.end(), index.fingerprint.begin(), index.fingerprint.end());
+  return output;
+}
+
+/**
+ * @brief Deserialize a segment index
+ * 
+ * @param serializedIndex Index returned by SerializePFileSegmentIndex
+ * 
+ * @return Segment index
+ * 
+ * @throws BadInputError when @p serializedIndex is not a valid index
+ */
+inline PFileSegmentIndex DeserializePFileSegmentIndex(const std::vector<uint8_t>& serializedIndex) {
+  if (serializedIndex.size() != pfileindex::kSerializedSize ||
+      !std::equal(pfileindex::kMagic, pfileindex::kMagic + sizeof(pfileindex::kMagic), serializedIndex.begin())) {
+    throw BadInputError("Serialized PFile segment index is invalid");
+  }
+  const uint8_t* data = serializedIndex.data() + sizeof(pfileindex::kMagic);
+  PFileSegmentIndex index;
+  index.contentStart = pfileindex::ReadInt64(data);
+  index.contentSize = pfileindex::ReadInt64(data + 8);
+  index.originalSize = pfileindex::ReadInt64(data + 16);
+  index.fileSize = pfileindex::ReadInt64(data + 24);
+  std::copy(data + 32, data + 48, index.fingerprint.begin());
+  if (index.contentStart < 0 || index.contentSize < 0 || index.originalSize < 0 ||
+      index.contentStart + index.contentSize != index.fileSize) {
+    throw BadInputError("Serialized PFile segment index is invalid");
+  }
+  return index;
+}
+
+/**
+ * @brief Checks that a segment index still describes a PFile
+ * 
+ * @param index Segment index of the PFile
+ * @param pfileStream Stream holding the PFile
+ * 
+ * @return true if the size and the first encrypted bytes of the PFile match the index
+ * 
+ * @note Reads 16 bytes; the position of @p pfileStream is left unchanged.
+ */
+inline bool MatchesPFileSegmentIndex(const PFileSegmentIndex& index, const std::shared_ptr<Stream>& pfileStream) {
+  return pfileStream && pfileStream->Size() == index.fileSize &&
+      pfileindex::ReadFingerprint(pfileStream, index.contentStart) == index.fingerprint;
+}
+
+/**
+ * @brief Creates the segment index of a PFile just written from known cleartext
+ * 
+ * @param protectionHandler Handler the PFile was protected with, e.g. FileHandler::GetProtection
+ * @param pfileStream Stream holding the PFile written by FileHandler::CommitAsync
+ * @param originalStream Stream holding the cleartext that was protected
+ * 
+ * @return Segment index of the PFile
+ * 
+ * @throws BadInputError when the PFile does not end with the protected cleartext, e.g. when it is not a PFile
+ * 
+ * @note The payload is located from the protected size of the cleartext and checked by decrypting its first segment
+ *       and comparing it with the cleartext; nothing else is read.
+ */
+inline PFileSegmentIndex CreatePFileSegmentIndex(
+    const std::shared_ptr<ProtectionHandler>& protectionHandler,
+    const std::shared_ptr<Stream>& pfileStream,
+    const std::shared_ptr<Stream>& originalStream) {
+  if (!protectionHandler) {
+    throw BadInputError("CreatePFileSegmentIndex requires a protection handler");
+  }
+  if (!pfileStream || !originalStream) {
+    throw BadInputError("CreatePFileSegmentIndex requires the PFile and its cleartext");
+  }
+  PFileSegmentIndex index;
+  index.originalSize = originalStream->Size();
+  index.fileSize = pfileStream->Size();
+  index.contentSize = protectionHandler->GetProtectedContentLength(index.originalSize, true);
+  index.contentStart = index.fileSize - index.contentSize;
+  if (index.contentStart < 0) {
+    throw BadInputError("PFile is smaller than its protected content");
+  }
+
+  int64_t checkedSize = (std::min)(index.originalSize, DecryptedSegmentCacheSettings().GetSegmentSize());
+  std::vector<uint8_t> expected(static_cast<size_t>(checkedSize));
+  std::vector<uint8_t> actual(static_cast<size_t>(checkedSize));
+  int64_t originalPosition = originalStream->Position();
+  originalStream->Seek(0);
+  int64_t expectedSize = ReadFromStream(originalStream, expected.data(), checkedSize);
+  originalStream->Seek(originalPosition);
+  auto protectedStream = protectionHandler->CreateProtectedStream(pfileStream, index.contentStart, index.contentSize);
+  protectedStream->Seek(0);
+  if (expectedSize != checkedSize || ReadFromStream(protectedStream, actual.data(), checkedSize) != checkedSize ||
+      actual != expected) {
+    throw BadInputError("PFile does not end with the protected content of the original stream");
+  }
+  index.fingerprint = pfileindex::ReadFingerprint(pfileStream, index.contentStart);
+  return index;
+}
+
+/**
+ * @brief Creates a decrypting view of a PFile's content that seeks to any offset without reading what precedes it
+ * 
+ * @param protectionHandler Handler of the PFile, e.g. FileHandler::GetProtection
+ * @param pfileStream Stream holding the PFile
+ * @param index Segment index of the PFile
+ * @param settings Settings of the cache of decrypted segments
+ * 
+ * @return Decrypting stream of PFileSegmentIndex::originalSize bytes, positioned at the start of the cleartext
+ * 
+ * @throws BadInputError when @p index does not match the PFile
+ * 
+ * @note Seeking costs the decryption of one segment, so protected video and large archives can be streamed to a
+ *       viewer as they are read. Without an index, use FileHandler::GetDecryptedTemporaryStreamAsync.
+ */
+inline std::shared_ptr<Stream> CreateIndexedPFileStream(
+    const std::shared_ptr<ProtectionHandler>& protectionHandler,
+    const std::shared_ptr<Stream>& pfileStream,
+    const PFileSegmentIndex& index,
+    const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings()) {
+  if (!MatchesPFileSegmentIndex(index, pfileStream)) {
+    throw BadInputError("Segment index does not match the PFile");
+  }
+  auto decrypted = CreateLazyDecryptedStream(
+      protectionHandler, pfileStream, index.contentStart, index.contentSize, settings);
+  return CreateStreamSlice(decrypted, 0, index.originalSize);
+}
+
+/**
+ * @brief Creates a decrypting view of a protected PFile's content that seeks to any offset
+ * 
+ * @param fileHandler Handler of the PFile
+ * @param pfileStream Stream holding the PFile
+ * @param index Segment index of the PFile
+ * @param settings Settings of the cache of decrypted segments
+ * 
+ * @return Decrypting stream of PFileSegmentIndex::originalSize bytes, positioned at the start of the cleartext
+ */
+inline std::shared_ptr<Stream> CreateIndexedPFileStream(
+    const std::shared_ptr<FileHandler>& fileHandler,
+    const std::shared_ptr<Stream>& pfileStream,
+    const PFileSegmentIndex& index,
+    const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings()) {
+  if (!fileHandler) {
+    throw BadInputError("CreateIndexedPFileStream requires a file handler");
+  }
+  auto protectionHandler = fileHandler->GetProtection();
+  if (!protectionHandler) {
+    throw BadInputError("File is not protected");
+  }
+  return CreateIndexedPFileStream(protectionHandler, pfileStream, index, settings);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_PFILE_SEGMENT_INDEX_H_
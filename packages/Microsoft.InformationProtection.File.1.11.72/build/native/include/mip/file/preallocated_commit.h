@@ -0,0 +1,137 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that commit a file into output reserved up front at its expected size
+ * 
+ * @file preallocated_commit.h
+ */
+
+#ifndef API_MIP_FILE_PREALLOCATED_COMMIT_H_
+#define API_MIP_FILE_PREALLOCATED_COMMIT_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/file/file_sync.h"
+#include "mip/mapped_file_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/preallocating_stream.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Estimates an upper bound of the size of the output of FileHandler::CommitAsync
+ * 
+ * @param handler File handler returned by CreateFileHandler, with its changes applied
+ * @param inputSize Size of the input, e.g. Stream::Size of the stream the handler was created from
+ * @param overhead Bytes allowed for the container and the label metadata on top of the content
+ * 
+ * @return Expected output size (in bytes)
+ * 
+ * @note When the output is protected, the content grows to ProtectionHandler::GetProtectedContentLength and the
+ *       publishing license is stored beside it. The default overhead covers the PFile header and the sector rounding
+ *       of the compound file that wraps protected Office documents.
+ */
+inline int64_t EstimateCommitSize(
+    const std::shared_ptr<FileHandler>& handler,
+    int64_t inputSize,
+    int64_t overhead = 64 * 1024) {
+  if (!handler) {
+    throw BadInputError("EstimateCommitSize requires a file handler");
+  }
+  if (inputSize < 0) {
+    throw BadInputError("Input size cannot be negative");
+  }
+  auto protection = handler->GetProtection();
+  if (!protection) {
+    return inputSize + overhead;
+  }
+  return protection->GetProtectedContentLength(inputSize, true) +
+      static_cast<int64_t>(protection->GetSerializedPublishingLicense().size()) + overhead;
+}
+
+/**
+ * @brief Commits the changes of a file to a stream reserved up front at the expected size, and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param inputSize Size of the input, e.g. Stream::Size of the stream the handler was created from
+ * @param outputStream Stream receiving the modified file. It must support Size(int64_t).
+ * @param overhead Bytes allowed for the container and the label metadata, see EstimateCommitSize
+ * 
+ * @return true if changes were committed. Failures are rethrown.
+ * 
+ * @note The output is sized once before the commit writes to it and trimmed to what was written afterwards, so the
+ *       file system or the multipart upload allocates its extents once instead of on every write.
+ */
+inline bool CommitFilePreallocated(
+    const std::shared_ptr<FileHandler>& handler,
+    int64_t inputSize,
+    const std::shared_ptr<Stream>& outputStream,
+    int64_t overhead = 64 * 1024) {
+  auto output = CreatePreallocatingStream(outputStream, EstimateCommitSize(handler, inputSize, overhead));
+  bool isCommitted = CommitFile(handler, output);
+  if (!output->Finish()) {
+    throw FileIOError("Failed to flush the committed output");
+  }
+  return isCommitted;
+}
+
+/**
+ * @brief Commits the changes of a file to a file reserved up front at the expected size, and waits for it
+ * 
+ * @param handler File handler returned by CreateFileHandler
+ * @param inputSize Size of the input, e.g. Stream::Size of the stream the handler was created from
+ * @param outputFilePath File receiving the modified content. It is created, or truncated if it exists.
+ * @param overhead Bytes allowed for the container and the label metadata, see EstimateCommitSize
+ * 
+ * @return true if changes were committed. Failures are rethrown.
+ * 
+ * @note The file is written through a memory mapping that is sized once, instead of being remapped as it grows.
+ */
+inline bool CommitFilePreallocated(
+    const std::shared_ptr<FileHandler>& handler,
+    int64_t inputSize,
+    const std::string& outputFilePath,
+    int64_t overhead = 64 * 1024) {
+  {
+    std::ofstream create(outputFilePath, std::ios::binary | std::ios::trunc);
+    if (!create) {
+      throw FileIOError("Failed to create output file: " + outputFilePath);
+    }
+  }
+  return CommitFilePreallocated(
+      handler, inputSize, CreateStreamFromMappedFile(outputFilePath, MappedFileAccess::ReadWrite), overhead);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_PREALLOCATED_COMMIT_H_
@@ -0,0 +1,197 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines bulk, parallel extraction and parsing of the publishing licenses of many files
+ * 
+ * @file publishing_license_batch.h
+ */
+
+#ifndef API_MIP_FILE_PUBLISHING_LICENSE_BATCH_H_
+#define API_MIP_FILE_PUBLISHING_LICENSE_BATCH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/buffered_stream.h"
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_profile.h"
+#include "mip/protection/publishing_license_info_cache.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief One file whose publishing license is extracted
+ */
+struct PublishingLicenseSource {
+  std::shared_ptr<Stream> stream; /**< Content of the file, or nullptr to open filePath */
+  std::string filePath;           /**< Path of the file, including its extension */
+};
+
+/**
+ * @brief Publishing license extracted from one file
+ */
+struct PublishingLicenseExtraction {
+  std::vector<uint8_t> serializedPublishingLicense; /**< Serialized license, empty if the file is not protected */
+  std::shared_ptr<PublishingLicenseInfo> info;      /**< Parsed license, if parsing was requested and a license found */
+  std::exception_ptr error;                         /**< Failure, nullptr on success */
+};
+
+/**
+ * @brief Options for ExtractPublishingLicenses
+ */
+struct PublishingLicenseExtractionOptions {
+  size_t maxParallel = 8;            /**< Files processed concurrently */
+  bool isInfoParsed = true;          /**< Whether to parse each license found */
+  int64_t readBlockSize = 16 * 1024; /**< Reads from source streams are made in blocks of this size, 0 to disable */
+  std::shared_ptr<PublishingLicenseInfoCache> infoCache; /**< If set, repeated licenses are parsed once */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace plbatch {
+
+inline PublishingLicenseExtraction Extract(
+    const PublishingLicenseSource& source,
+    const std::shared_ptr<MipContext>& mipContext,
+    const PublishingLicenseExtractionOptions& options) {
+  PublishingLicenseExtraction result;
+  try {
+    if (source.stream) {
+      std::shared_ptr<Stream> stream = source.stream;
+      if (options.readBlockSize > 0) {
+        stream = std::make_shared<BufferedStream>(source.stream, options.readBlockSize, 0);
+      }
+      result.serializedPublishingLicense =
+          FileHandler::GetSerializedPublishingLicense(stream, source.filePath, mipContext);
+    } else {
+      result.serializedPublishingLicense = FileHandler::GetSerializedPublishingLicense(source.filePath, mipContext);
+    }
+    if (options.isInfoParsed && !result.serializedPublishingLicense.empty()) {
+      result.info = options.infoCache ?
+          options.infoCache->Get(result.serializedPublishingLicense) :
+          ProtectionProfile::GetPublishingLicenseInfo(result.serializedPublishingLicense, mipContext);
+    }
+  } catch (...) {
+    result.error = std::current_exception();
+  }
+  return result;
+}
+
+} // namespace plbatch
+/** @endcond */
+
+/**
+ * @brief Extracts, and optionally parses, the publishing licenses of many files in one streaming pass
+ * 
+ * @param sources Files to process
+ * @param mipContext MIP context
+ * @param onResult Receives each result with the index of its source, as soon as it is ready. Calls are serialized,
+ *        but arrive in completion order; results are moved out and owned by the callee.
+ * @param options Parallelism and parsing options
+ * 
+ * @note Results are not accumulated, so memory does not grow with the number of files. The format parsers that
+ *       locate the license run inside FileHandler::GetSerializedPublishingLicense and read only what they need;
+ *       block buffering turns their small reads into few large ones. The calling thread processes files too. If
+ *       @p onResult throws, no further files are started and the exception is rethrown once the others finish.
+ */
+inline void ExtractPublishingLicenses(
+    const std::vector<PublishingLicenseSource>& sources,
+    const std::shared_ptr<MipContext>& mipContext,
+    const std::function<void(size_t index, PublishingLicenseExtraction&& result)>& onResult,
+    const PublishingLicenseExtractionOptions& options = PublishingLicenseExtractionOptions()) {
+  if (!mipContext) {
+    throw BadInputError("ExtractPublishingLicenses requires a MipContext");
+  }
+  if (!onResult) {
+    throw BadInputError("ExtractPublishingLicenses requires a result callback");
+  }
+  std::atomic<size_t> next(0);
+  std::atomic<bool> isStopped(false);
+  std::mutex callbackMutex;
+  std::exception_ptr callbackError;
+  auto worker = [&]() {
+    for (size_t index = next++; index < sources.size() && !isStopped; index = next++) {
+      PublishingLicenseExtraction result = plbatch::Extract(sources[index], mipContext, options);
+      std::lock_guard<std::mutex> lock(callbackMutex);
+      if (isStopped) {
+        return;
+      }
+      try {
+        onResult(index, std::move(result));
+      } catch (...) {
+        callbackError = std::current_exception();
+        isStopped = true;
+      }
+    }
+  };
+  size_t workerCount = (std::min)((std::max)(options.maxParallel, static_cast<size_t>(1)), sources.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workerCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (callbackError) {
+    std::rethrow_exception(callbackError);
+  }
+}
+
+/**
+ * @brief Extracts, and optionally parses, the publishing licenses of many files
+ * 
+ * @param sources Files to process
+ * @param mipContext MIP context
+ * @param options Parallelism and parsing options
+ * 
+ * @return One result per source, in the same order
+ */
+inline std::vector<PublishingLicenseExtraction> ExtractPublishingLicenses(
+    const std::vector<PublishingLicenseSource>& sources,
+    const std::shared_ptr<MipContext>& mipContext,
+    const PublishingLicenseExtractionOptions& options = PublishingLicenseExtractionOptions()) {
+  std::vector<PublishingLicenseExtraction> results(sources.size());
+  ExtractPublishingLicenses(sources, mipContext, [&results](size_t index, PublishingLicenseExtraction&& result) {
+    results[index] = std::move(result);
+  }, options);
+  return results;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_PUBLISHING_LICENSE_BATCH_H_
@@ -0,0 +1,321 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines microbenchmark suites for the core SDK primitives
+ *
+ * @file sdk_microbenchmarks.h
+ */
+
+#ifndef API_MIP_FILE_SDK_MICROBENCHMARKS_H_
+#define API_MIP_FILE_SDK_MICROBENCHMARKS_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_handler.h"
+#include "mip/json_delegate.h"
+#include "mip/microbenchmark.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/protection_profile.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/policy_handler.h"
+#include "mip/xml_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace microbenchmarks {
+
+inline std::string GetCipherModeName(CipherMode cipherMode) {
+  switch (cipherMode) {
+    case CipherMode::CIPHER_MODE_CBC4K: return "CBC4K";
+    case CipherMode::CIPHER_MODE_ECB: return "ECB";
+    case CipherMode::CIPHER_MODE_CBC512NOPADDING: return "CBC512NoPadding";
+    case CipherMode::CIPHER_MODE_CBC4KNOPADDING: return "CBC4KNoPadding";
+  }
+  return "Unknown";
+}
+
+// Deterministic content, so runs against different SDK versions encrypt the same bytes
+inline std::shared_ptr<std::vector<uint8_t>> MakeContent(int64_t size) {
+  auto content = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(size));
+  uint32_t state = 0x9E3779B9u;
+  for (uint8_t& byte : *content) {
+    state = state * 1664525u + 1013904223u;
+    byte = static_cast<uint8_t>(state >> 24);
+  }
+  return content;
+}
+
+inline std::shared_ptr<std::vector<uint8_t>> Encrypt(ProtectionHandler& handler, const std::vector<uint8_t>& plain) {
+  int64_t size = static_cast<int64_t>(plain.size());
+  auto encrypted = std::make_shared<std::vector<uint8_t>>(
+      static_cast<size_t>(handler.GetProtectedContentLength(size, true)));
+  int64_t written = handler.EncryptBuffer(0, plain.data(), size, encrypted->data(),
+      static_cast<int64_t>(encrypted->size()), true);
+  encrypted->resize(static_cast<size_t>(written));
+  return encrypted;
+}
+
+inline std::shared_ptr<std::vector<uint8_t>> ReadFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw FileIOError("Failed to open benchmark sample: " + path);
+  }
+  return std::make_shared<std::vector<uint8_t>>(
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+} // namespace microbenchmarks
+/** @endcond */
+
+/**
+ * @brief Registers ProtectionHandler benchmarks for one handler, and so for one cipher mode
+ *
+ * @param registry Registry receiving the benchmarks
+ * @param handler Protection handler, created for publishing with the cipher mode to measure
+ * @param bufferSizes Buffer sizes (in bytes) to measure
+ *
+ * @note Registers "ProtectionHandler::EncryptBuffer", "ProtectionHandler::DecryptBuffer",
+ *       "ProtectionHandler::GetProtectedContentLength", "ProtectedStream::SequentialRead" and
+ *       "ProtectedStream::RandomRead", with variants "<cipher mode>/<buffer size>". Register one handler per
+ *       CipherMode to compare modes. Random reads fetch 4 KiB at offsets spread over the content.
+ */
+inline void RegisterProtectionHandlerBenchmarks(
+    MicrobenchmarkRegistry& registry,
+    const std::shared_ptr<ProtectionHandler>& handler,
+    const std::vector<int64_t>& bufferSizes = {4096, 65536, 1048576}) {
+  if (!handler) {
+    throw BadInputError("Protection handler benchmarks require a handler");
+  }
+  const std::string mode = microbenchmarks::GetCipherModeName(handler->GetCipherMode());
+  for (int64_t size : bufferSizes) {
+    const std::string variant = mode + "/" + std::to_string(size);
+    auto plain = microbenchmarks::MakeContent(size);
+    auto encrypted = microbenchmarks::Encrypt(*handler, *plain);
+
+    registry.Register("ProtectionHandler::EncryptBuffer", variant, [handler, plain, encrypted](
+        MicrobenchmarkState& state) {
+      std::vector<uint8_t> output(encrypted->size() + static_cast<size_t>(handler->GetBlockSize()));
+      int64_t size = static_cast<int64_t>(plain->size());
+      state.SetBytesPerIteration(plain->size());
+      while (state.KeepRunning()) {
+        handler->EncryptBuffer(0, plain->data(), size, output.data(), static_cast<int64_t>(output.size()), true);
+      }
+    });
+
+    registry.Register("ProtectionHandler::DecryptBuffer", variant, [handler, plain, encrypted](
+        MicrobenchmarkState& state) {
+      std::vector<uint8_t> output(encrypted->size());
+      state.SetBytesPerIteration(plain->size());
+      while (state.KeepRunning()) {
+        handler->DecryptBuffer(0, encrypted->data(), static_cast<int64_t>(encrypted->size()), output.data(),
+            static_cast<int64_t>(output.size()), true);
+      }
+    });
+
+    registry.Register("ProtectionHandler::GetProtectedContentLength", variant, [handler, size](
+        MicrobenchmarkState& state) {
+      int64_t sink = 0;
+      while (state.KeepRunning()) {
+        sink += handler->GetProtectedContentLength(size, true);
+      }
+      if (sink < 0) {
+        throw InternalError("Protected content length is negative");
+      }
+    });
+
+    registry.Register("ProtectedStream::SequentialRead", variant, [handler, plain, encrypted](
+        MicrobenchmarkState& state) {
+      std::vector<uint8_t> buffer(4096);
+      state.SetBytesPerIteration(plain->size());
+      while (state.KeepRunning()) {
+        auto backing = CreateStreamFromBuffer(encrypted->data(), static_cast<int64_t>(encrypted->size()));
+        auto stream = handler->CreateProtectedStream(backing, 0, static_cast<int64_t>(encrypted->size()));
+        while (stream->Read(buffer.data(), static_cast<int64_t>(buffer.size())) > 0) {
+        }
+      }
+    });
+
+    registry.Register("ProtectedStream::RandomRead", variant, [handler, plain, encrypted](
+        MicrobenchmarkState& state) {
+      const int64_t readSize = 4096;
+      const int64_t contentSize = static_cast<int64_t>(plain->size());
+      std::vector<uint8_t> buffer(static_cast<size_t>(readSize));
+      auto backing = CreateStreamFromBuffer(encrypted->data(), static_cast<int64_t>(encrypted->size()));
+      auto stream = handler->CreateProtectedStream(backing, 0, static_cast<int64_t>(encrypted->size()));
+      uint32_t offsetState = 12345u;
+      state.SetBytesPerIteration(static_cast<uint64_t>((std::min)(readSize, contentSize)));
+      while (state.KeepRunning()) {
+        offsetState = offsetState * 1664525u + 1013904223u;
+        stream->Seek(contentSize > readSize ? static_cast<int64_t>(offsetState % (contentSize - readSize)) : 0);
+        stream->Read(buffer.data(), readSize);
+      }
+    });
+  }
+}
+
+/**
+ * @brief Registers file status benchmarks for sample files of several formats
+ *
+ * @param registry Registry receiving the benchmarks
+ * @param mipContext MIP context
+ * @param samples Sample files keyed by format name, e.g. {"docx", "sample.docx"}, {"pfile", "sample.ptxt"}
+ *
+ * @note Registers "FileHandler::IsProtected" and "FileHandler::GetFileStatus" with the format as variant. Each
+ *       sample is loaded into memory once and inspected through a buffer stream, so disk I/O is not measured.
+ */
+inline void RegisterFileStatusBenchmarks(
+    MicrobenchmarkRegistry& registry,
+    const std::shared_ptr<MipContext>& mipContext,
+    const std::map<std::string, std::string>& samples) {
+  for (const auto& sample : samples) {
+    auto content = microbenchmarks::ReadFile(sample.second);
+    const std::string path = sample.second;
+
+    registry.Register("FileHandler::IsProtected", sample.first, [mipContext, content, path](
+        MicrobenchmarkState& state) {
+      state.SetBytesPerIteration(content->size());
+      while (state.KeepRunning()) {
+        FileHandler::IsProtected(
+            CreateStreamFromBuffer(content->data(), static_cast<int64_t>(content->size())), path, mipContext);
+      }
+    });
+
+    registry.Register("FileHandler::GetFileStatus", sample.first, [mipContext, content, path](
+        MicrobenchmarkState& state) {
+      state.SetBytesPerIteration(content->size());
+      while (state.KeepRunning()) {
+        FileHandler::GetFileStatus(
+            CreateStreamFromBuffer(content->data(), static_cast<int64_t>(content->size())), path, mipContext);
+      }
+    });
+  }
+}
+
+/**
+ * @brief Registers a PolicyHandler::ComputeActions benchmark
+ *
+ * @param registry Registry receiving the benchmark
+ * @param policyHandler Policy handler, created without audit discovery so that iterations do not send audit events
+ * @param executionState Execution state describing the content
+ * @param variant Variant name describing the scenario, e.g. "label-change" or "no-op"
+ */
+inline void RegisterComputeActionsBenchmark(
+    MicrobenchmarkRegistry& registry,
+    const std::shared_ptr<PolicyHandler>& policyHandler,
+    const std::shared_ptr<ExecutionState>& executionState,
+    const std::string& variant) {
+  registry.Register("PolicyHandler::ComputeActions", variant, [policyHandler, executionState](
+      MicrobenchmarkState& state) {
+    while (state.KeepRunning()) {
+      policyHandler->ComputeActions(*executionState);
+    }
+  });
+}
+
+/**
+ * @brief Registers a ProtectionProfile::GetPublishingLicenseInfo benchmark
+ *
+ * @param registry Registry receiving the benchmark
+ * @param serializedPublishingLicense Publishing license, e.g. from ProtectionHandler::GetSerializedPublishingLicense
+ * @param mipContext MIP context
+ * @param variant Variant name describing the license, e.g. "template" or "adhoc-50-users"
+ */
+inline void RegisterPublishingLicenseInfoBenchmark(
+    MicrobenchmarkRegistry& registry,
+    const std::vector<uint8_t>& serializedPublishingLicense,
+    const std::shared_ptr<MipContext>& mipContext,
+    const std::string& variant) {
+  auto license = std::make_shared<std::vector<uint8_t>>(serializedPublishingLicense);
+  registry.Register("ProtectionProfile::GetPublishingLicenseInfo", variant, [license, mipContext](
+      MicrobenchmarkState& state) {
+    state.SetBytesPerIteration(license->size());
+    while (state.KeepRunning()) {
+      ProtectionProfile::GetPublishingLicenseInfo(*license, mipContext);
+    }
+  });
+}
+
+/**
+ * @brief Registers JSON and XML parsing benchmarks
+ *
+ * @param registry Registry receiving the benchmarks
+ * @param jsonDelegate JSON delegate to measure, or nullptr
+ * @param jsonDocuments JSON documents keyed by name, e.g. a captured policy response
+ * @param xmlDelegate XML delegate to measure, or nullptr
+ * @param xmlDocuments XML documents keyed by name, e.g. a captured policy or publishing license
+ *
+ * @note Registers "JsonDelegate::Parse" and "XmlDelegate::ParseData" with the document name as variant, so the
+ *       default and custom delegates can be compared on the same documents.
+ */
+inline void RegisterParsingBenchmarks(
+    MicrobenchmarkRegistry& registry,
+    const std::shared_ptr<JsonDelegate>& jsonDelegate,
+    const std::map<std::string, std::string>& jsonDocuments,
+    const std::shared_ptr<xml::XmlDelegate>& xmlDelegate,
+    const std::map<std::string, std::string>& xmlDocuments) {
+  if (jsonDelegate) {
+    for (const auto& document : jsonDocuments) {
+      auto text = std::make_shared<std::string>(document.second);
+      registry.Register("JsonDelegate::Parse", document.first, [jsonDelegate, text](MicrobenchmarkState& state) {
+        state.SetBytesPerIteration(text->size());
+        while (state.KeepRunning()) {
+          jsonDelegate->Parse(*text);
+        }
+      });
+    }
+  }
+  if (xmlDelegate) {
+    for (const auto& document : xmlDocuments) {
+      auto text = std::make_shared<std::string>(document.second);
+      registry.Register("XmlDelegate::ParseData", document.first, [xmlDelegate, text](MicrobenchmarkState& state) {
+        state.SetBytesPerIteration(text->size());
+        while (state.KeepRunning()) {
+          xmlDelegate->ParseData(*text);
+        }
+      });
+    }
+  }
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_FILE_SDK_MICROBENCHMARKS_H_
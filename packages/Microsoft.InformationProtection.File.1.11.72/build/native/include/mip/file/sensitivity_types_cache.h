@@ -0,0 +1,585 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines SensitivityTypesCache, which loads sensitivity type rule packages on demand and shares them, and
+ *        CompiledRulePackageCache, which recompiles only the rule packages that changed
+ * 
+ * @file sensitivity_types_cache.h
+ */
+
+#ifndef API_MIP_FILE_SENSITIVITY_TYPES_CACHE_H_
+#define API_MIP_FILE_SENSITIVITY_TYPES_CACHE_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/file_engine.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/sensitivity_types_rule_package.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Rule packages of one sensitivity file, immutable once loaded
+ */
+typedef std::vector<std::shared_ptr<SensitivityTypesRulePackage>> SensitivityTypesRulePackages;
+
+/** @cond DOXYGEN_HIDE */
+namespace sensitivitytypes {
+
+// Copy of a rule package that does not keep the engine it came from alive
+class CachedRulePackage : public SensitivityTypesRulePackage {
+public:
+  CachedRulePackage(const std::string& rulePackageId, const std::string& rulePackage)
+      : mRulePackageId(rulePackageId), mRulePackage(rulePackage) {}
+
+  const std::string& GetRulePackageId() const override { return mRulePackageId; }
+  const std::string& GetRulePackage() const override { return mRulePackage; }
+
+private:
+  std::string mRulePackageId;
+  std::string mRulePackage;
+};
+
+// Copies of rule packages, interned by ID and content so that a package unchanged across sensitivity files is one
+// object, which lets CompiledRulePackageCache reuse its compiled form without comparing content
+class RulePackagePool {
+public:
+  std::shared_ptr<const SensitivityTypesRulePackages> Copy(const SensitivityTypesRulePackages& packages) {
+    auto copy = std::make_shared<SensitivityTypesRulePackages>();
+    copy->reserve(packages.size());
+    for (const auto& package : packages) {
+      if (package) {
+        copy->push_back(Intern(*package));
+      }
+    }
+    return copy;
+  }
+
+private:
+  std::shared_ptr<SensitivityTypesRulePackage> Intern(const SensitivityTypesRulePackage& package) {
+    auto& versions = mPackages[package.GetRulePackageId()];
+    std::shared_ptr<SensitivityTypesRulePackage> interned;
+    for (auto version = versions.begin(); version != versions.end();) {
+      auto existing = version->lock();
+      if (!existing) {
+        version = versions.erase(version);
+        continue;
+      }
+      if (!interned && existing->GetRulePackage() == package.GetRulePackage()) {
+        interned = existing;
+      }
+      ++version;
+    }
+    if (!interned) {
+      interned = std::make_shared<CachedRulePackage>(package.GetRulePackageId(), package.GetRulePackage());
+      versions.push_back(interned);
+    }
+    return interned;
+  }
+
+  std::unordered_map<std::string, std::vector<std::weak_ptr<SensitivityTypesRulePackage>>> mPackages;
+};
+
+inline int64_t GetSize(const SensitivityTypesRulePackages& packages) {
+  int64_t size = 0;
+  for (const auto& package : packages) {
+    size += static_cast<int64_t>(package->GetRulePackageId().size() + package->GetRulePackage().size());
+  }
+  return size;
+}
+
+} // namespace sensitivitytypes
+/** @endcond */
+
+/**
+ * @brief Loads sensitivity type rule packages on first use, shares them between engines and drops them under pressure
+ * 
+ * @note Engines that never classify should be added with loadSensitivityTypes = false in FileEngine::Settings, which
+ *       skips the rule packages entirely, and consult this cache only when classification or listing is requested,
+ *       e.g. when FileEngine::HasClassificationRules is true. Packages are keyed by FileEngine::GetSensitivityFileId,
+ *       so tenants with identical rule packages share one copy. Loads are single-flight: concurrent requests for
+ *       the same key wait for one load. The least recently used packages are dropped once their total size exceeds
+ *       the budget; callers holding a returned list keep it alive until they release it. A rule package whose ID
+ *       and content match one already held, e.g. after a custom sensitive information type changed only another
+ *       package, is returned as the same object; see DiffRulePackages and CompiledRulePackageCache.
+ */
+class SensitivityTypesCache {
+public:
+  /**
+   * @brief Loads the rule packages of a sensitivity file, e.g. by adding an engine with loadSensitivityTypes = true
+   *        and calling FileEngine::ListSensitivityTypes
+   */
+  typedef std::function<SensitivityTypesRulePackages(const std::string& sensitivityFileId)> Loader;
+
+  /**
+   * @brief SensitivityTypesCache constructor
+   * 
+   * @param maxBytes Budget for the total size of cached rule packages
+   */
+  explicit SensitivityTypesCache(int64_t maxBytes = 64 * 1024 * 1024)
+      : mMaxBytes(maxBytes),
+        mTotalBytes(0) {}
+
+  /**
+   * @brief Get the rule packages of a sensitivity file, loading them if they are not cached
+   * 
+   * @param sensitivityFileId Sensitivity file ID, from FileEngine::GetSensitivityFileId
+   * @param loader Called, at most once per concurrent miss, to load the packages. Its failures are rethrown and
+   *        nothing is cached, so a caller that was waiting on the failed load tries again with its own loader.
+   * 
+   * @return Rule packages
+   */
+  std::shared_ptr<const SensitivityTypesRulePackages> GetOrLoad(const std::string& sensitivityFileId, Loader loader) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+      if (auto packages = FindLocked(sensitivityFileId)) {
+        return packages;
+      }
+      if (mLoading.find(sensitivityFileId) == mLoading.end()) {
+        break;
+      }
+      mCondition.wait(lock);
+    }
+    mLoading.insert(sensitivityFileId);
+    lock.unlock();
+
+    std::shared_ptr<const SensitivityTypesRulePackages> packages;
+    std::exception_ptr error;
+    try {
+      packages = Copy(loader(sensitivityFileId));
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    mLoading.erase(sensitivityFileId);
+    if (packages) {
+      InsertLocked(sensitivityFileId, packages);
+    }
+    mCondition.notify_all();
+    lock.unlock();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    EnforceMemoryBudget();
+    return packages;
+  }
+
+  /**
+   * @brief Cache the rule packages of an engine that loaded them
+   * 
+   * @param engine Engine added with loadSensitivityTypes = true
+   * 
+   * @return Cached rule packages shared with other engines of the same sensitivity file
+   */
+  std::shared_ptr<const SensitivityTypesRulePackages> Add(const std::shared_ptr<FileEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A FileEngine is required");
+    }
+    const std::string& sensitivityFileId = engine->GetSensitivityFileId();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (auto packages = FindLocked(sensitivityFileId)) {
+        return packages;
+      }
+    }
+    auto packages = Copy(engine->ListSensitivityTypes());
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      InsertLocked(sensitivityFileId, packages);
+    }
+    EnforceMemoryBudget();
+    return packages;
+  }
+
+  /**
+   * @brief Get cached rule packages without loading them
+   * 
+   * @param sensitivityFileId Sensitivity file ID
+   * 
+   * @return Rule packages, or nullptr if they are not cached
+   */
+  std::shared_ptr<const SensitivityTypesRulePackages> Find(const std::string& sensitivityFileId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return FindLocked(sensitivityFileId);
+  }
+
+  /**
+   * @brief Drop the least recently used rule packages until the cache holds at most a number of bytes
+   * 
+   * @param maxBytes Size to trim to, e.g. 0 on a memory pressure notification
+   */
+  void Trim(int64_t maxBytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    TrimLocked(maxBytes);
+  }
+
+  /**
+   * @brief Get the total size of cached rule packages
+   * 
+   * @return Size in bytes
+   */
+  int64_t GetCachedBytes() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTotalBytes;
+  }
+
+  /**
+   * @brief Account the cache against a memory budget, as MemoryCategory::RulePackages
+   * 
+   * @param memoryBudget Budget shared with the application's other caches, or nullptr to stop accounting
+   * 
+   * @note Call before the cache is shared between threads.
+   */
+  void SetMemoryBudget(const std::shared_ptr<MemoryBudget>& memoryBudget) {
+    mMemoryRegistration.reset();
+    mMemoryBudget = memoryBudget;
+    if (mMemoryBudget) {
+      mMemoryRegistration = mMemoryBudget->Register(MemoryCategory::RulePackages,
+          [this]() { return GetCachedBytes(); },
+          [this](int64_t maxBytes) { Trim(maxBytes); });
+      mMemoryBudget->Enforce();
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::shared_ptr<const SensitivityTypesRulePackages> packages;
+    int64_t size;
+    std::list<std::string>::iterator lruPosition;
+  };
+
+  std::shared_ptr<const SensitivityTypesRulePackages> FindLocked(const std::string& sensitivityFileId) {
+    auto entry = mEntries.find(sensitivityFileId);
+    if (entry == mEntries.end()) {
+      return nullptr;
+    }
+    mLru.splice(mLru.begin(), mLru, entry->second.lruPosition);
+    return entry->second.packages;
+  }
+
+  void InsertLocked(const std::string& sensitivityFileId,
+      const std::shared_ptr<const SensitivityTypesRulePackages>& packages) {
+    if (mEntries.find(sensitivityFileId) != mEntries.end()) {
+      return;
+    }
+    mLru.push_front(sensitivityFileId);
+    Entry entry{packages, sensitivitytypes::GetSize(*packages), mLru.begin()};
+    mTotalBytes += entry.size;
+    mEntries.emplace(sensitivityFileId, entry);
+    TrimLocked(mMaxBytes);
+  }
+
+  std::shared_ptr<const SensitivityTypesRulePackages> Copy(const SensitivityTypesRulePackages& packages) {
+    std::lock_guard<std::mutex> lock(mPoolMutex);
+    return mPool.Copy(packages);
+  }
+
+  void EnforceMemoryBudget() {
+    if (mMemoryBudget) {
+      mMemoryBudget->Enforce();
+    }
+  }
+
+  void TrimLocked(int64_t maxBytes) {
+    while (mTotalBytes > maxBytes && !mLru.empty()) {
+      auto entry = mEntries.find(mLru.back());
+      mTotalBytes -= entry->second.size;
+      mEntries.erase(entry);
+      mLru.pop_back();
+    }
+  }
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  int64_t mMaxBytes;
+  int64_t mTotalBytes;
+  std::list<std::string> mLru;
+  std::unordered_map<std::string, Entry> mEntries;
+  std::unordered_set<std::string> mLoading;
+  std::mutex mPoolMutex;
+  sensitivitytypes::RulePackagePool mPool;
+  std::shared_ptr<MemoryBudget> mMemoryBudget;
+  // Declared last so that the budget stops calling into the cache before anything else is destroyed
+  std::shared_ptr<MemoryBudgetRegistration> mMemoryRegistration;
+  /** @endcond */
+};
+
+/**
+ * @brief Difference between the rule packages of two sensitivity files
+ */
+struct RulePackageDiff {
+  SensitivityTypesRulePackages added;     /**< Packages whose ID is new */
+  SensitivityTypesRulePackages changed;   /**< Packages whose ID is kept but whose content changed */
+  SensitivityTypesRulePackages unchanged; /**< Packages whose ID and content are kept */
+  std::vector<std::string> removed;       /**< IDs of packages that are gone */
+
+  /** @brief Whether the rule packages are the same */
+  bool IsEmpty() const { return added.empty() && changed.empty() && removed.empty(); }
+};
+
+/**
+ * @brief Diff the rule packages of two sensitivity files by package ID
+ * 
+ * @param previous Rule packages before, e.g. of the engine being refreshed
+ * @param current Rule packages after
+ * 
+ * @return Difference; packages in it are those of current
+ * 
+ * @note Content is compared rather than the version in the rule package, which custom sensitive information types do
+ *       not always bump. Packages from SensitivityTypesCache that are unchanged are the same object, which is
+ *       compared without reading content.
+ */
+inline RulePackageDiff DiffRulePackages(
+    const SensitivityTypesRulePackages& previous,
+    const SensitivityTypesRulePackages& current) {
+  std::unordered_map<std::string, std::shared_ptr<SensitivityTypesRulePackage>> previousById;
+  for (const auto& package : previous) {
+    if (package) {
+      previousById[package->GetRulePackageId()] = package;
+    }
+  }
+  RulePackageDiff diff;
+  for (const auto& package : current) {
+    if (!package) {
+      continue;
+    }
+    auto match = previousById.find(package->GetRulePackageId());
+    if (match == previousById.end()) {
+      diff.added.push_back(package);
+      continue;
+    }
+    if (match->second == package || match->second->GetRulePackage() == package->GetRulePackage()) {
+      diff.unchanged.push_back(package);
+    } else {
+      diff.changed.push_back(package);
+    }
+    previousById.erase(match);
+  }
+  for (const auto& package : previous) {
+    if (package && previousById.count(package->GetRulePackageId()) != 0) {
+      diff.removed.push_back(package->GetRulePackageId());
+      previousById.erase(package->GetRulePackageId());
+    }
+  }
+  return diff;
+}
+
+/**
+ * @brief Compiles rule packages once per ID and content and shares the result between engines and across refreshes
+ * 
+ * @note A refresh that changes GetSensitivityFileId usually changes a single custom package; passing the new list to
+ *       GetOrCompile compiles only the packages that changed and returns the existing compiled form of the rest.
+ *       Compiles are single-flight per package. Compiled packages stay cached until Prune, which drops those no
+ *       caller holds any more; call it after the engines using the previous rule packages are released.
+ * 
+ * @tparam Compiled Caller's compiled form of a rule package, e.g. its matcher
+ */
+template <typename Compiled>
+class CompiledRulePackageCache {
+public:
+  /**
+   * @brief Compiles a rule package
+   */
+  typedef std::function<std::shared_ptr<const Compiled>(const SensitivityTypesRulePackage& package)> Compiler;
+
+  /**
+   * @brief Get the compiled form of a rule package, compiling it if no package with its ID and content was compiled
+   * 
+   * @param package Rule package
+   * @param compiler Called, at most once per concurrent miss. Its failures are rethrown and nothing is cached.
+   * 
+   * @return Compiled package
+   */
+  std::shared_ptr<const Compiled> GetOrCompile(
+      const std::shared_ptr<SensitivityTypesRulePackage>& package,
+      const Compiler& compiler) {
+    if (!package) {
+      throw BadInputError("A rule package is required");
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::shared_ptr<Entry> entry;
+    for (;;) {
+      entry = FindLocked(*package);
+      if (!entry) {
+        break;
+      }
+      if (entry->compiled) {
+        return entry->compiled;
+      }
+      mCondition.wait(lock);
+    }
+    entry = std::make_shared<Entry>();
+    entry->package = package;
+    mEntries[package->GetRulePackageId()].push_back(entry);
+    lock.unlock();
+
+    std::shared_ptr<const Compiled> compiled;
+    std::exception_ptr error;
+    try {
+      compiled = compiler(*package);
+      if (!compiled) {
+        throw BadInputError("Rule package compiler returned nothing for " + package->GetRulePackageId());
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    if (compiled) {
+      entry->compiled = compiled;
+    } else {
+      RemoveLocked(entry);
+    }
+    mCondition.notify_all();
+    lock.unlock();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return compiled;
+  }
+
+  /**
+   * @brief Get the compiled form of rule packages, compiling only those not compiled yet
+   * 
+   * @param packages Rule packages, e.g. from SensitivityTypesCache::GetOrLoad
+   * @param compiler Called for each package not compiled yet
+   * 
+   * @return Compiled packages, in the order of packages
+   */
+  std::vector<std::shared_ptr<const Compiled>> GetOrCompile(
+      const SensitivityTypesRulePackages& packages,
+      const Compiler& compiler) {
+    std::vector<std::shared_ptr<const Compiled>> compiled;
+    compiled.reserve(packages.size());
+    for (const auto& package : packages) {
+      if (package) {
+        compiled.push_back(GetOrCompile(package, compiler));
+      }
+    }
+    return compiled;
+  }
+
+  /**
+   * @brief Drop compiled packages that no caller holds
+   * 
+   * @return Number of compiled packages dropped
+   */
+  size_t Prune() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t pruned = 0;
+    for (auto versions = mEntries.begin(); versions != mEntries.end();) {
+      auto& entries = versions->second;
+      for (auto entry = entries.begin(); entry != entries.end();) {
+        if ((*entry)->compiled && (*entry)->compiled.use_count() == 1) {
+          entry = entries.erase(entry);
+          ++pruned;
+        } else {
+          ++entry;
+        }
+      }
+      versions = entries.empty() ? mEntries.erase(versions) : std::next(versions);
+    }
+    return pruned;
+  }
+
+  /**
+   * @brief Get the number of compiled packages held
+   * 
+   * @return Number of compiled packages
+   */
+  size_t GetCompiledCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t count = 0;
+    for (const auto& versions : mEntries) {
+      for (const auto& entry : versions.second) {
+        count += entry->compiled ? 1 : 0;
+      }
+    }
+    return count;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::shared_ptr<SensitivityTypesRulePackage> package;
+    std::shared_ptr<const Compiled> compiled;
+  };
+
+  std::shared_ptr<Entry> FindLocked(const SensitivityTypesRulePackage& package) const {
+    auto versions = mEntries.find(package.GetRulePackageId());
+    if (versions == mEntries.end()) {
+      return nullptr;
+    }
+    for (const auto& entry : versions->second) {
+      if (entry->package.get() == &package) {
+        return entry;
+      }
+    }
+    for (const auto& entry : versions->second) {
+      if (entry->package->GetRulePackage() == package.GetRulePackage()) {
+        return entry;
+      }
+    }
+    return nullptr;
+  }
+
+  void RemoveLocked(const std::shared_ptr<Entry>& entry) {
+    auto versions = mEntries.find(entry->package->GetRulePackageId());
+    if (versions == mEntries.end()) {
+      return;
+    }
+    auto& entries = versions->second;
+    entries.erase(std::remove(entries.begin(), entries.end(), entry), entries.end());
+    if (entries.empty()) {
+      mEntries.erase(versions);
+    }
+  }
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Entry>>> mEntries;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_SENSITIVITY_TYPES_CACHE_H_
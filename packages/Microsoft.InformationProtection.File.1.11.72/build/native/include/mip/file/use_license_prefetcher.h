@@ -0,0 +1,325 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines UseLicensePrefetcher, which acquires the use licenses of upcoming files in the background
+ * 
+ * @file use_license_prefetcher.h
+ */
+
+#ifndef API_MIP_FILE_USE_LICENSE_PREFETCHER_H_
+#define API_MIP_FILE_USE_LICENSE_PREFETCHER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/file/publishing_license_batch.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/use_license_cache.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a UseLicensePrefetcher
+ */
+struct UseLicensePrefetchSettings {
+  size_t maxConcurrency = 4;                       /**< Files whose licenses are acquired at the same time */
+  size_t maxQueuedFiles = 4096;                    /**< Files waiting to be prefetched; further files are refused */
+  int64_t readBlockSize = 16 * 1024;               /**< Reads from source streams are made in blocks of this size */
+  std::shared_ptr<UseLicenseCache> useLicenseCache; /**< If set, acquired handlers are also kept in memory */
+};
+
+/**
+ * @brief Counters of a UseLicensePrefetcher
+ */
+struct UseLicensePrefetchStatistics {
+  uint64_t queued = 0;      /**< Files accepted for prefetch */
+  uint64_t refused = 0;     /**< Files refused because the queue was full */
+  uint64_t unprotected = 0; /**< Files without a publishing license */
+  uint64_t duplicates = 0;  /**< Files whose license was already prefetched for the same identity */
+  uint64_t acquired = 0;    /**< Licenses acquired */
+  uint64_t failed = 0;      /**< Files whose license could not be extracted or acquired */
+};
+
+/**
+ * @brief Acquires the use licenses of files a worker will process next, so that licensing overlaps current work
+ * 
+ * @note Each queued file has its publishing license read with FileHandler::GetSerializedPublishingLicense, which
+ *       parses only the part of the file that carries it, and a consumption ProtectionHandler created for it on the
+ *       TaskDispatcherDelegate, at most maxConcurrency at a time. The license lands in the SDK's license cache when
+ *       the protection profile caches licenses; to have FileEngine::CreateFileHandlerAsync find it, pass an engine
+ *       from AttachedProtectionProfile::GetEngine, which shares the FileEngine's storage. With a UseLicenseCache,
+ *       handlers are also kept for consumers that go through UseLicenseCache::GetOrCreateConsumptionHandler. A
+ *       license is acquired once per identity however many files carry it. Failures are only counted: the file's
+ *       own processing surfaces them. Queued files hold their engine weakly and are skipped once it is released;
+ *       releasing the prefetcher stops the remaining work. Thread-safe.
+ */
+class UseLicensePrefetcher {
+public:
+  /**
+   * @brief UseLicensePrefetcher constructor
+   * 
+   * @param taskDispatcher Task dispatcher that runs the prefetches
+   * @param mipContext MIP context, used to read publishing licenses
+   * @param settings Concurrency, queue and cache settings
+   */
+  UseLicensePrefetcher(
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+      const std::shared_ptr<MipContext>& mipContext,
+      const UseLicensePrefetchSettings& settings = UseLicensePrefetchSettings())
+      : mState(std::make_shared<State>()) {
+    if (!taskDispatcher) {
+      throw BadInputError("UseLicensePrefetcher requires a TaskDispatcherDelegate");
+    }
+    if (!mipContext) {
+      throw BadInputError("UseLicensePrefetcher requires a MipContext");
+    }
+    mState->taskDispatcher = taskDispatcher;
+    mState->mipContext = mipContext;
+    mState->settings = settings;
+    mState->settings.maxConcurrency = (std::max)(settings.maxConcurrency, static_cast<size_t>(1));
+    mState->extractionOptions.isInfoParsed = false;
+    mState->extractionOptions.readBlockSize = settings.readBlockSize;
+  }
+
+  /**
+   * @brief Queue a file whose use license should be acquired
+   * 
+   * @param engine Protection engine of the identity that will consume the file
+   * @param source File, as a stream or a path
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return false if the queue is full and the file was refused
+   */
+  bool Prefetch(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      const PublishingLicenseSource& source,
+      const std::shared_ptr<void>& context = nullptr) {
+    return Prefetch(engine, std::vector<PublishingLicenseSource>{source}, context) == 1;
+  }
+
+  /**
+   * @brief Queue files whose use licenses should be acquired, in the order they will be processed
+   * 
+   * @param engine Protection engine of the identity that will consume the files
+   * @param sources Files, as streams or paths
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return Number of files queued; the files after them were refused because the queue is full
+   */
+  size_t Prefetch(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      const std::vector<PublishingLicenseSource>& sources,
+      const std::shared_ptr<void>& context = nullptr) {
+    if (!engine) {
+      throw BadInputError("A ProtectionEngine is required");
+    }
+    size_t accepted = 0;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      for (const auto& source : sources) {
+        if (mState->queue.size() >= mState->settings.maxQueuedFiles) {
+          mState->statistics.refused += sources.size() - accepted;
+          break;
+        }
+        mState->queue.push_back(Item{engine, source, context});
+        ++accepted;
+      }
+      mState->statistics.queued += accepted;
+    }
+    Start(mState);
+    return accepted;
+  }
+
+  /**
+   * @brief Drop the files still waiting, e.g. when the work queue was reordered; prefetches in flight complete
+   */
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->queue.clear();
+  }
+
+  /**
+   * @brief Get the number of files waiting or being prefetched
+   * 
+   * @return Pending files
+   */
+  size_t GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->queue.size() + mState->running;
+  }
+
+  /**
+   * @brief Get the prefetch counters
+   * 
+   * @return Counters since construction
+   */
+  UseLicensePrefetchStatistics GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->statistics;
+  }
+
+  ~UseLicensePrefetcher() { Cancel(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Item {
+    std::weak_ptr<ProtectionEngine> engine;
+    PublishingLicenseSource source;
+    std::shared_ptr<void> context;
+  };
+
+  struct State {
+    std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+    std::shared_ptr<MipContext> mipContext;
+    UseLicensePrefetchSettings settings;
+    PublishingLicenseExtractionOptions extractionOptions;
+    mutable std::mutex mutex;
+    std::deque<Item> queue;
+    size_t running = 0;
+    std::unordered_set<std::string> prefetchedKeys;
+    UseLicensePrefetchStatistics statistics;
+  };
+
+  // Keys of licenses already acquired, bounded so that a long-running worker does not grow without limit
+  static const size_t kMaxPrefetchedKeys = 16 * 1024;
+
+  static std::string CreateKey(const std::string& identity, const std::vector<uint8_t>& serializedPublishingLicense) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : serializedPublishingLicense) {
+      hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return identity + "\n" + std::to_string(serializedPublishingLicense.size()) + ":" + std::to_string(hash);
+  }
+
+  static void Start(const std::shared_ptr<State>& state) {
+    static std::atomic<uint64_t> sTaskCounter(0);
+    std::weak_ptr<State> weakState = state;
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->queue.empty() || state->running >= state->settings.maxConcurrency) {
+          return;
+        }
+        ++state->running;
+      }
+      try {
+        state->taskDispatcher->DispatchTask(
+            "mip-use-license-prefetch-" + std::to_string(++sTaskCounter), [weakState]() { Drain(weakState); });
+      } catch (...) {
+        // The dispatcher is shutting down; files left queued are simply not prefetched
+        std::lock_guard<std::mutex> lock(state->mutex);
+        --state->running;
+        return;
+      }
+    }
+  }
+
+  static void Drain(const std::weak_ptr<State>& weakState) {
+    for (;;) {
+      auto state = weakState.lock();
+      if (!state) {
+        return;
+      }
+      Item item;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->queue.empty()) {
+          --state->running;
+          return;
+        }
+        item = std::move(state->queue.front());
+        state->queue.pop_front();
+      }
+      Process(*state, item);
+    }
+  }
+
+  static void Process(State& state, const Item& item) {
+    auto engine = item.engine.lock();
+    if (!engine) {
+      return;
+    }
+    PublishingLicenseExtraction extraction = plbatch::Extract(item.source, state.mipContext, state.extractionOptions);
+    std::string key;
+    {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (extraction.error) {
+        ++state.statistics.failed;
+        return;
+      }
+      if (extraction.serializedPublishingLicense.empty()) {
+        ++state.statistics.unprotected;
+        return;
+      }
+      key = CreateKey(engine->GetSettings().GetIdentity().GetEmail(), extraction.serializedPublishingLicense);
+      if (!state.prefetchedKeys.insert(key).second) {
+        ++state.statistics.duplicates;
+        return;
+      }
+      if (state.prefetchedKeys.size() > kMaxPrefetchedKeys) {
+        state.prefetchedKeys.clear();
+        state.prefetchedKeys.insert(key);
+      }
+    }
+    bool isAcquired = false;
+    try {
+      ProtectionHandler::ConsumptionSettings settings(extraction.serializedPublishingLicense);
+      auto handler = state.settings.useLicenseCache ?
+          state.settings.useLicenseCache->GetOrCreateConsumptionHandler(engine, settings, item.context) :
+          engine->CreateProtectionHandlerForConsumption(settings, item.context);
+      isAcquired = handler != nullptr;
+    } catch (...) {
+      // Counted below; processing the file itself reports the failure
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (isAcquired) {
+      ++state.statistics.acquired;
+    } else {
+      ++state.statistics.failed;
+      // Let a later file carrying the same license try again
+      state.prefetchedKeys.erase(key);
+    }
+  }
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_FILE_USE_LICENSE_PREFETCHER_H_
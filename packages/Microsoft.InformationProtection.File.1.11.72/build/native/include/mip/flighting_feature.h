@@ -33,6 +33,7 @@
 #ifndef API_MIP_FLIGHTING_FEATURE_H_
 #define API_MIP_FLIGHTING_FEATURE_H_
 
+#include <bitset>
 #include <map>
 
 #include "mip/mip_namespace.h"
@@ -101,6 +102,68 @@ inline const std::map<FlightingFeature, bool>& GetDefaultFeatureSettings() {
   return kDefaultFeatureSettings;
 }
 
+/**
+ * @brief Number of flighting features, one more than the highest FlightingFeature value
+ */
+constexpr unsigned int kFlightingFeatureCount = FlightingFeature::EnableFipsValidatedCryptography + 1;
+
+/**
+ * @brief Flighting feature settings frozen into one bit per feature
+ * 
+ * @note Built once, e.g. when a MipContext is created, so that a hot path checks a feature with a single bit test
+ *       instead of a map lookup. Features missing from the settings take their default from
+ *       GetDefaultFeatureSettings.
+ */
+class FlightingFeatureSet {
+public:
+  /**
+   * @brief Create the set of features enabled by default
+   */
+  FlightingFeatureSet() : FlightingFeatureSet(std::map<FlightingFeature, bool>()) {}
+
+  /**
+   * @brief Create the set of features enabled by default or by an override
+   * 
+   * @param featureSettings Features set to non-default values
+   */
+  explicit FlightingFeatureSet(const std::map<FlightingFeature, bool>& featureSettings) {
+    for (const auto& feature : GetDefaultFeatureSettings()) {
+      Set(feature.first, feature.second);
+    }
+    for (const auto& feature : featureSettings) {
+      Set(feature.first, feature.second);
+    }
+  }
+
+  /**
+   * @brief Gets whether a feature is enabled
+   * 
+   * @param feature Flighting feature
+   * 
+   * @return true if the feature is enabled, false if it is disabled or unknown
+   */
+  bool IsEnabled(FlightingFeature feature) const { return feature < kMaxFeatures && mFeatures[feature]; }
+
+  /**
+   * @brief Enable or disable a feature
+   * 
+   * @param feature Flighting feature
+   * @param isEnabled Whether the feature is enabled
+   */
+  void Set(FlightingFeature feature, bool isEnabled) {
+    if (feature < kMaxFeatures) {
+      mFeatures[feature] = isEnabled;
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static constexpr unsigned int kMaxFeatures = 64;
+  static_assert(kFlightingFeatureCount <= kMaxFeatures, "FlightingFeatureSet must hold every flighting feature");
+  std::bitset<kMaxFeatures> mFeatures;
+  /** @endcond */
+};
+
 MIP_NAMESPACE_END
 #endif  // API_MIP_FLIGHTING_FEATURE_H_
 
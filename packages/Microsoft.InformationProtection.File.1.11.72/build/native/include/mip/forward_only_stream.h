@@ -0,0 +1,228 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a Stream that forwards committed output to a non-seekable sink
+ * 
+ * @file forward_only_stream.h
+ */
+
+#ifndef API_MIP_FORWARD_ONLY_STREAM_H_
+#define API_MIP_FORWARD_ONLY_STREAM_H_
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A write-only Stream that hands finished output to a forward-only sink, such as a chunked HTTP upload.
+ * 
+ * @note Writers such as FileHandler::CommitAsync may seek backwards to patch headers they have already written. This
+ *       stream keeps the most recent backPatchWindow bytes in memory so that those patches succeed, and passes every
+ *       byte that falls out of the window to the sink as soon as it does. Seeking before the start of the window
+ *       throws mip::NotSupportedError. Call Finish once the writer is done to pass the rest of the output to the sink.
+ */
+class ForwardOnlyStream : public Stream {
+public:
+  /**
+   * @brief Signature of the sink receiving finished output, in order
+   * 
+   * @param buffer pointer to the finished bytes
+   * @param bufferLength number of finished bytes
+   * 
+   * @return true if the sink accepted the bytes, else false
+   */
+  typedef std::function<bool(const uint8_t* buffer, int64_t bufferLength)> Sink;
+
+  /**
+   * @brief ForwardOnlyStream constructor
+   * 
+   * @param sink Sink receiving finished output
+   * @param backPatchWindow Number of trailing bytes kept in memory so that the writer can still patch them
+   * @param partSize Minimum number of finished bytes passed to the sink in one call
+   */
+  ForwardOnlyStream(const Sink& sink, int64_t backPatchWindow, int64_t partSize = 1024 * 1024)
+      : mSink(sink),
+        mBackPatchWindow((std::max)(backPatchWindow, static_cast<int64_t>(0))),
+        mPartSize((std::max)(partSize, static_cast<int64_t>(1))),
+        mWindowStart(0),
+        mPosition(0),
+        mIsFinished(false) {
+    if (!mSink) {
+      throw BadInputError("ForwardOnlyStream requires a sink");
+    }
+  }
+
+  /**
+   * @brief Reading is not supported, always returns 0.
+   * 
+   * @return 0
+   */
+  int64_t Read(uint8_t* /*buffer*/, int64_t /*bufferLength*/) override { return 0; }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    if (mIsFinished) {
+      throw NotSupportedError("ForwardOnlyStream cannot be written to after Finish");
+    }
+    if (buffer == nullptr || bufferLength <= 0) {
+      return 0;
+    }
+    int64_t offsetInWindow = mPosition - mWindowStart;
+    int64_t end = offsetInWindow + bufferLength;
+    if (end > static_cast<int64_t>(mWindow.size())) {
+      mWindow.resize(static_cast<size_t>(end));
+    }
+    std::memcpy(mWindow.data() + offsetInWindow, buffer, static_cast<size_t>(bufferLength));
+    mPosition += bufferLength;
+    EmitFinishedBytes();
+    return bufferLength;
+  }
+
+  /**
+   * @brief flush the stream. Bytes still inside the back-patch window are kept until Finish.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override { return true; }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream. Must not be before the start of the back-patch window.
+   */
+  void Seek(int64_t position) override {
+    if (position < mWindowStart) {
+      throw NotSupportedError("ForwardOnlyStream cannot seek to output already passed to the sink");
+    }
+    // Seeking past the end zero-fills the gap on the next write, like a regular file would
+    if (position > Size()) {
+      mWindow.resize(static_cast<size_t>(position - mWindowStart));
+    }
+    mPosition = position;
+  }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return false
+   */
+  bool CanRead() const override { return false; }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true until Finish is called.
+   */
+  bool CanWrite() const override { return !mIsFinished; }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content written so far.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mWindowStart + static_cast<int64_t>(mWindow.size()); }
+
+  /**
+   * @brief Set the stream size. Only the part still inside the back-patch window can be changed.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t value) override {
+    if (value < mWindowStart) {
+      throw NotSupportedError("ForwardOnlyStream cannot truncate output already passed to the sink");
+    }
+    mWindow.resize(static_cast<size_t>(value - mWindowStart));
+    mPosition = (std::min)(mPosition, value);
+  }
+
+  /**
+   * @brief Pass all remaining output to the sink. No further writes are accepted.
+   * 
+   * @return true if the sink accepted the remaining bytes, else false
+   */
+  bool Finish() {
+    if (mIsFinished) {
+      return true;
+    }
+    mIsFinished = true;
+    bool accepted = mWindow.empty() || mSink(mWindow.data(), static_cast<int64_t>(mWindow.size()));
+    mWindowStart += static_cast<int64_t>(mWindow.size());
+    mWindow.clear();
+    return accepted;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~ForwardOnlyStream() { }
+
+private:
+  void EmitFinishedBytes() {
+    // Only bytes further than the back-patch window behind the write position are considered finished
+    int64_t finishedLength = mPosition - mBackPatchWindow - mWindowStart;
+    if (finishedLength < mPartSize) {
+      return;
+    }
+    if (!mSink(mWindow.data(), finishedLength)) {
+      throw FileIOError("ForwardOnlyStream sink rejected output");
+    }
+    mWindow.erase(mWindow.begin(), mWindow.begin() + static_cast<size_t>(finishedLength));
+    mWindowStart += finishedLength;
+  }
+
+  Sink mSink;
+  int64_t mBackPatchWindow;
+  int64_t mPartSize;
+  int64_t mWindowStart;
+  int64_t mPosition;
+  bool mIsFinished;
+  std::vector<uint8_t> mWindow;
+  /** @endcond */
+}; // class ForwardOnlyStream
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_FORWARD_ONLY_STREAM_H_
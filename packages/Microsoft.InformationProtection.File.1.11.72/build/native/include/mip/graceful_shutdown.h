@@ -0,0 +1,617 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ShutDownAsync, which drains outstanding work with a timeout before shutting a MipContext down
+ * 
+ * @file graceful_shutdown.h
+ */
+
+#ifndef API_MIP_GRACEFUL_SHUTDOWN_H_
+#define API_MIP_GRACEFUL_SHUTDOWN_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief What ShutDownAsync drained and what it dropped
+ */
+struct ShutdownReport {
+  bool isDrained = false;                 /**< All tasks, requests and flushes finished within the drain timeout */
+  size_t rejectedTaskCount = 0;           /**< Tasks dispatched after the shutdown started, which were not run */
+  size_t rejectedRequestCount = 0;        /**< Requests sent after the shutdown started, answered as cancelled */
+  size_t cancelledDelayedTaskCount = 0;   /**< Delayed tasks that were not due yet, cancelled at once */
+  size_t cancelledTaskCount = 0;          /**< Queued tasks still not started at the timeout, cancelled */
+  size_t abandonedTaskCount = 0;          /**< Tasks still running at the timeout */
+  size_t cancelledRequestCount = 0;       /**< Requests still outstanding at the timeout, cancelled */
+  std::vector<std::string> unflushed;     /**< Names of the flushes that did not finish within the timeout */
+  std::chrono::milliseconds drainDuration{0};    /**< Time spent draining */
+  std::chrono::milliseconds shutDownDuration{0}; /**< Time spent in MipContext::ShutDown */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace gracefulshutdown {
+
+class CancelledOperation : public HttpOperation {
+public:
+  explicit CancelledOperation(const std::string& id) : mId(id) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return nullptr; }
+  bool IsCancelled() override { return true; }
+
+private:
+  std::string mId;
+};
+
+struct Flush {
+  std::string name;
+  std::function<void()> flush;
+};
+
+struct State {
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool isClosed = false;
+  size_t queuedTaskCount = 0;
+  size_t runningTaskCount = 0;
+  size_t requestCount = 0;
+  size_t rejectedTaskCount = 0;
+  size_t rejectedRequestCount = 0;
+  std::vector<std::function<size_t()>> cancelDelayedTasks;
+  std::vector<std::function<void()>> cancelAllTasks;
+  std::vector<std::function<void()>> cancelAllRequests;
+  std::vector<Flush> flushes;
+
+  bool IsIdleLocked() const { return queuedTaskCount == 0 && runningTaskCount == 0 && requestCount == 0; }
+};
+
+class TrackingTaskDispatcher final : public TaskDispatcherDelegate {
+public:
+  TrackingTaskDispatcher(const std::shared_ptr<TaskDispatcherDelegate>& inner, const std::shared_ptr<State>& state)
+      : mInner(inner),
+        mState(state),
+        mDelayed(std::make_shared<Delayed>()) {}
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    if (Admit()) {
+      mInner->DispatchTask(taskId, Wrap(std::move(task)));
+    }
+  }
+
+  void DispatchTask(
+      const std::string& taskId,
+      std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    if (Admit()) {
+      mInner->DispatchTask(taskId, Wrap(std::move(task)), loggerContext);
+    }
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    if (delaySeconds <= 0) {
+      DispatchTask(taskId, std::move(task));
+    } else if (AdmitDelayed(taskId)) {
+      mInner->DispatchTask(taskId, WrapDelayed(taskId, std::move(task)), delaySeconds);
+    }
+  }
+
+  void DispatchTask(
+      const std::string& taskId,
+      std::function<void()> task,
+      int64_t delaySeconds,
+      const std::shared_ptr<void>& loggerContext) override {
+    if (delaySeconds <= 0) {
+      DispatchTask(taskId, std::move(task), loggerContext);
+    } else if (AdmitDelayed(taskId)) {
+      mInner->DispatchTask(taskId, WrapDelayed(taskId, std::move(task)), delaySeconds, loggerContext);
+    }
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    if (Admit()) {
+      mInner->ExecuteTaskOnIndependentThread(taskId, Wrap(std::move(task)));
+    }
+  }
+
+  void ExecuteTaskOnIndependentThread(
+      const std::string& taskId,
+      std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    if (Admit()) {
+      mInner->ExecuteTaskOnIndependentThread(taskId, Wrap(std::move(task)), loggerContext);
+    }
+  }
+
+  // Cancelling a queued task means its wrapper never runs, so it is erased from the counts here
+  bool CancelTask(const std::string& taskId) override {
+    bool isDelayed = IsDelayed(taskId);
+    if (!mInner->CancelTask(taskId)) {
+      return false;
+    }
+    OnCancelled(taskId, isDelayed);
+    return true;
+  }
+
+  bool CancelTask(const std::string& taskId, const std::shared_ptr<void>& loggerContext) override {
+    bool isDelayed = IsDelayed(taskId);
+    if (!mInner->CancelTask(taskId, loggerContext)) {
+      return false;
+    }
+    OnCancelled(taskId, isDelayed);
+    return true;
+  }
+
+  void CancelAllTasks() override { mInner->CancelAllTasks(); }
+
+  // Cancels the delayed tasks that are not due yet, returns how many were cancelled
+  size_t CancelDelayedTasks() {
+    std::vector<std::pair<std::string, size_t>> delayed;
+    {
+      std::lock_guard<std::mutex> lock(mDelayed->mutex);
+      delayed.assign(mDelayed->tasks.begin(), mDelayed->tasks.end());
+    }
+    size_t cancelledCount = 0;
+    for (const auto& task : delayed) {
+      for (size_t i = 0; i < task.second && CancelTask(task.first); ++i) {
+        ++cancelledCount;
+      }
+    }
+    return cancelledCount;
+  }
+
+private:
+  struct Delayed {
+    std::mutex mutex;
+    std::unordered_map<std::string, size_t> tasks;
+
+    bool Remove(const std::string& taskId) {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto existing = tasks.find(taskId);
+      if (existing == tasks.end()) {
+        return false;
+      }
+      if (--existing->second == 0) {
+        tasks.erase(existing);
+      }
+      return true;
+    }
+  };
+
+  bool Admit() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    if (mState->isClosed) {
+      ++mState->rejectedTaskCount;
+      return false;
+    }
+    ++mState->queuedTaskCount;
+    return true;
+  }
+
+  bool AdmitDelayed(const std::string& taskId) {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      if (mState->isClosed) {
+        ++mState->rejectedTaskCount;
+        return false;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mDelayed->mutex);
+    ++mDelayed->tasks[taskId];
+    return true;
+  }
+
+  bool IsDelayed(const std::string& taskId) {
+    std::lock_guard<std::mutex> lock(mDelayed->mutex);
+    return mDelayed->tasks.count(taskId) != 0;
+  }
+
+  void OnCancelled(const std::string& taskId, bool isDelayed) {
+    if (isDelayed && mDelayed->Remove(taskId)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    if (mState->queuedTaskCount > 0) {
+      --mState->queuedTaskCount;
+    }
+    mState->condition.notify_all();
+  }
+
+  static void Run(State& state, const std::function<void()>& task) {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      --state.runningTaskCount;
+      state.condition.notify_all();
+      throw;
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    --state.runningTaskCount;
+    state.condition.notify_all();
+  }
+
+  std::function<void()> Wrap(std::function<void()> task) {
+    std::shared_ptr<State> state = mState;
+    return [state, task]() {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        --state->queuedTaskCount;
+        ++state->runningTaskCount;
+      }
+      Run(*state, task);
+    };
+  }
+
+  std::function<void()> WrapDelayed(const std::string& taskId, std::function<void()> task) {
+    std::shared_ptr<State> state = mState;
+    std::shared_ptr<Delayed> delayed = mDelayed;
+    return [state, delayed, taskId, task]() {
+      delayed->Remove(taskId);
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        ++state->runningTaskCount;
+      }
+      Run(*state, task);
+    };
+  }
+
+  std::shared_ptr<TaskDispatcherDelegate> mInner;
+  std::shared_ptr<State> mState;
+  std::shared_ptr<Delayed> mDelayed;
+};
+
+class TrackingHttpDelegate final : public HttpDelegate {
+public:
+  TrackingHttpDelegate(const std::shared_ptr<HttpDelegate>& inner, const std::shared_ptr<State>& state)
+      : mInner(inner),
+        mState(state) {}
+
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    if (!Admit()) {
+      return std::make_shared<CancelledOperation>(request->GetId());
+    }
+    try {
+      auto operation = mInner->Send(request, context);
+      Complete(*mState);
+      return operation;
+    } catch (...) {
+      Complete(*mState);
+      throw;
+    }
+  }
+
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    if (!Admit()) {
+      auto operation = std::make_shared<CancelledOperation>(request->GetId());
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+      return operation;
+    }
+    std::shared_ptr<State> state = mState;
+    try {
+      return mInner->SendAsync(request, context, [state, callbackFn](std::shared_ptr<HttpOperation> operation) {
+        Complete(*state);
+        if (callbackFn) {
+          callbackFn(operation);
+        }
+      });
+    } catch (...) {
+      Complete(*mState);
+      throw;
+    }
+  }
+
+  void CancelOperation(const std::string& requestId) override { mInner->CancelOperation(requestId); }
+
+  void CancelAllOperations() override { mInner->CancelAllOperations(); }
+
+private:
+  bool Admit() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    if (mState->isClosed) {
+      ++mState->rejectedRequestCount;
+      return false;
+    }
+    ++mState->requestCount;
+    return true;
+  }
+
+  static void Complete(State& state) {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    --state.requestCount;
+    state.condition.notify_all();
+  }
+
+  std::shared_ptr<HttpDelegate> mInner;
+  std::shared_ptr<State> mState;
+};
+
+} // namespace gracefulshutdown
+/** @endcond */
+
+/**
+ * @brief Tracks the work a MipContext has outstanding so that ShutDownAsync can drain it
+ * 
+ * @note Pass the delegates returned by Wrap to the MipConfiguration and profile settings in place of the ones they
+ *       wrap, and register the flushes of the logger, telemetry and audit delegates with AddFlush. Once a shutdown
+ *       starts, tasks dispatched through the wrapped dispatchers are dropped and requests sent through the wrapped
+ *       transports are answered as cancelled; both are counted in the ShutdownReport.
+ */
+class ShutdownGate {
+public:
+  ShutdownGate() : mState(std::make_shared<gracefulshutdown::State>()) {}
+
+  /**
+   * @brief Track the requests sent through a transport
+   * 
+   * @param httpDelegate Transport
+   * 
+   * @return Transport to use instead
+   */
+  std::shared_ptr<HttpDelegate> Wrap(const std::shared_ptr<HttpDelegate>& httpDelegate) {
+    if (!httpDelegate) {
+      throw BadInputError("ShutdownGate requires an HTTP delegate");
+    }
+    auto wrapped = std::make_shared<gracefulshutdown::TrackingHttpDelegate>(httpDelegate, mState);
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->cancelAllRequests.push_back([httpDelegate]() { httpDelegate->CancelAllOperations(); });
+    return wrapped;
+  }
+
+  /**
+   * @brief Track the tasks dispatched through a dispatcher
+   * 
+   * @param taskDispatcher Dispatcher
+   * 
+   * @return Dispatcher to use instead
+   */
+  std::shared_ptr<TaskDispatcherDelegate> Wrap(const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher) {
+    if (!taskDispatcher) {
+      throw BadInputError("ShutdownGate requires a task dispatcher");
+    }
+    auto wrapped = std::make_shared<gracefulshutdown::TrackingTaskDispatcher>(taskDispatcher, mState);
+    std::weak_ptr<gracefulshutdown::TrackingTaskDispatcher> weakWrapped = wrapped;
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->cancelDelayedTasks.push_back([weakWrapped]() -> size_t {
+      auto shared = weakWrapped.lock();
+      return shared ? shared->CancelDelayedTasks() : 0;
+    });
+    mState->cancelAllTasks.push_back([taskDispatcher]() { taskDispatcher->CancelAllTasks(); });
+    return wrapped;
+  }
+
+  /**
+   * @brief Register something to flush while draining
+   * 
+   * @param name Name reported in ShutdownReport::unflushed if the flush does not finish in time
+   * @param flush Flush, for example of an AsyncTelemetryDelegate, AsyncAuditDelegate or AsyncLoggerDelegate
+   */
+  void AddFlush(const std::string& name, const std::function<void()>& flush) {
+    if (!flush) {
+      throw BadInputError("ShutdownGate::AddFlush requires a flush function");
+    }
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->flushes.push_back(gracefulshutdown::Flush{name, flush});
+  }
+
+  /**
+   * @brief Check if a shutdown started
+   * 
+   * @return True once new work is rejected
+   */
+  bool IsClosed() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->isClosed;
+  }
+
+  /**
+   * @brief Stop accepting work, drain what is outstanding and cancel what is left at the timeout
+   * 
+   * @param drainTimeout Longest time to wait for outstanding tasks, requests and flushes
+   * 
+   * @return What was drained and dropped
+   * 
+   * @note Blocks for at most the timeout, plus the time cancellation takes. Tasks not already running and requests
+   *       not yet answered at the timeout are cancelled through CancelAllTasks and CancelAllOperations of the
+   *       wrapped delegates. A flush that does not finish in time keeps running on its own thread.
+   */
+  ShutdownReport Drain(std::chrono::milliseconds drainTimeout) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + drainTimeout;
+    ShutdownReport report;
+    std::vector<std::function<size_t()>> cancelDelayedTasks;
+    std::vector<gracefulshutdown::Flush> flushes;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->isClosed = true;
+      cancelDelayedTasks = mState->cancelDelayedTasks;
+      flushes = mState->flushes;
+    }
+    for (const auto& cancel : cancelDelayedTasks) {
+      report.cancelledDelayedTaskCount += cancel();
+    }
+
+    std::vector<std::function<void()>> cancelAllTasks;
+    std::vector<std::function<void()>> cancelAllRequests;
+    bool isIdle = false;
+    {
+      std::unique_lock<std::mutex> lock(mState->mutex);
+      isIdle = mState->condition.wait_until(lock, deadline, [this] { return mState->IsIdleLocked(); });
+      if (!isIdle) {
+        report.cancelledTaskCount = mState->queuedTaskCount;
+        report.abandonedTaskCount = mState->runningTaskCount;
+        report.cancelledRequestCount = mState->requestCount;
+        cancelAllTasks = mState->cancelAllTasks;
+        cancelAllRequests = mState->cancelAllRequests;
+      }
+    }
+    // Work still running may have queued events, so the flushes go once it is done or given up on
+    report.unflushed = RunFlushes(flushes, deadline);
+    for (const auto& cancel : cancelAllTasks) {
+      cancel();
+    }
+    for (const auto& cancel : cancelAllRequests) {
+      cancel();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      report.rejectedTaskCount = mState->rejectedTaskCount;
+      report.rejectedRequestCount = mState->rejectedRequestCount;
+    }
+    report.isDrained = isIdle && report.unflushed.empty();
+    report.drainDuration =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    return report;
+  }
+
+  /**
+   * @brief Drain, then shut a MipContext down, without blocking the caller
+   * 
+   * @param context Context to shut down
+   * @param drainTimeout Longest time to wait for outstanding work before cancelling it
+   * 
+   * @return Report, available once MipContext::ShutDown returned
+   * 
+   * @note The work runs on a thread of its own; wait for the result before the process exits.
+   */
+  std::future<ShutdownReport> ShutDownAsync(
+      const std::shared_ptr<MipContext>& context,
+      std::chrono::milliseconds drainTimeout) {
+    if (!context) {
+      throw BadInputError("ShutDownAsync requires a MipContext");
+    }
+    auto promise = std::make_shared<std::promise<ShutdownReport>>();
+    std::future<ShutdownReport> result = promise->get_future();
+    ShutdownGate gate(*this);
+    std::thread([gate, context, drainTimeout, promise]() mutable {
+      try {
+        ShutdownReport report = gate.Drain(drainTimeout);
+        auto start = std::chrono::steady_clock::now();
+        context->ShutDown();
+        report.shutDownDuration =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        promise->set_value(std::move(report));
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+      }
+    }).detach();
+    return result;
+  }
+
+private:
+  static std::vector<std::string> RunFlushes(
+      const std::vector<gracefulshutdown::Flush>& flushes,
+      std::chrono::steady_clock::time_point deadline) {
+    struct Progress {
+      std::mutex mutex;
+      std::condition_variable condition;
+      std::vector<bool> isDone;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->isDone.assign(flushes.size(), false);
+    for (size_t i = 0; i < flushes.size(); ++i) {
+      auto flush = flushes[i].flush;
+      std::thread([progress, flush, i]() {
+        try {
+          flush();
+        } catch (...) {
+          // A failed flush has nothing left to wait for
+        }
+        std::lock_guard<std::mutex> lock(progress->mutex);
+        progress->isDone[i] = true;
+        progress->condition.notify_all();
+      }).detach();
+    }
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    progress->condition.wait_until(lock, deadline, [&progress] {
+      for (bool isDone : progress->isDone) {
+        if (!isDone) {
+          return false;
+        }
+      }
+      return true;
+    });
+    std::vector<std::string> unflushed;
+    for (size_t i = 0; i < flushes.size(); ++i) {
+      if (!progress->isDone[i]) {
+        unflushed.push_back(flushes[i].name);
+      }
+    }
+    return unflushed;
+  }
+
+  std::shared_ptr<gracefulshutdown::State> mState;
+};
+
+/**
+ * @brief Drain a context's outstanding work, then shut it down, without blocking the caller
+ * 
+ * @param context Context to shut down
+ * @param gate Gate whose delegates the context was created with
+ * @param drainTimeout Longest time to wait for outstanding work before cancelling it
+ * 
+ * @return Report, available once MipContext::ShutDown returned
+ */
+inline std::future<ShutdownReport> ShutDownAsync(
+    const std::shared_ptr<MipContext>& context,
+    const std::shared_ptr<ShutdownGate>& gate,
+    std::chrono::milliseconds drainTimeout) {
+  if (!gate) {
+    throw BadInputError("ShutDownAsync requires a ShutdownGate");
+  }
+  return gate->ShutDownAsync(context, drainTimeout);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_GRACEFUL_SHUTDOWN_H_
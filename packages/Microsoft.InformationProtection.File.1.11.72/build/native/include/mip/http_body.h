@@ -0,0 +1,296 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers that build, share and read HTTP bodies without extra copies
+ * 
+ * @file http_body.h
+ */
+
+#ifndef API_MIP_HTTP_BODY_H_
+#define API_MIP_HTTP_BODY_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Assembles a response body from network buffers into the vector an HttpResponse returns, copying each byte
+ *        once
+ * 
+ * @note Reserve the Content-Length before the first buffer arrives so the vector never reallocates. A transport that
+ *       already receives into vectors hands them over with AppendChunk, and a body that arrives as one chunk is moved
+ *       rather than copied.
+ */
+class HttpBodyBuilder {
+public:
+  /**
+   * @brief Reserve room for the whole body
+   * 
+   * @param size Expected size, e.g. from GetContentLength
+   */
+  void Reserve(size_t size) { mBody.reserve(size); }
+
+  /**
+   * @brief Append bytes received from the network
+   * 
+   * @param data Received bytes
+   * @param size Number of bytes
+   */
+  void Append(const uint8_t* data, size_t size) {
+    if (size > 0) {
+      mBody.insert(mBody.end(), data, data + size);
+    }
+  }
+
+  /**
+   * @brief Append a received chunk, taking its storage when it is the first one
+   * 
+   * @param chunk Received chunk; it is moved from
+   */
+  void AppendChunk(std::vector<uint8_t>&& chunk) {
+    if (mBody.empty() && chunk.capacity() >= mBody.capacity()) {
+      mBody = std::move(chunk);
+    } else {
+      mBody.insert(mBody.end(), chunk.begin(), chunk.end());
+    }
+    chunk.clear();
+  }
+
+  /**
+   * @brief Get the number of bytes appended so far
+   * 
+   * @return Body size
+   */
+  size_t GetSize() const { return mBody.size(); }
+
+  /**
+   * @brief Take the assembled body
+   * 
+   * @return Body; the builder is empty afterwards
+   */
+  std::vector<uint8_t> TakeBody() {
+    std::vector<uint8_t> body = std::move(mBody);
+    mBody.clear();
+    return body;
+  }
+
+  /**
+   * @brief Take the assembled body as an immutable buffer that many responses can share
+   * 
+   * @return Shared body; the builder is empty afterwards
+   */
+  std::shared_ptr<const std::vector<uint8_t>> TakeSharedBody() {
+    return std::make_shared<const std::vector<uint8_t>>(TakeBody());
+  }
+
+  /**
+   * @brief Read the Content-Length header
+   * 
+   * @param headers Response headers
+   * 
+   * @return Declared body size, or 0 if the header is missing or invalid
+   */
+  static size_t GetContentLength(const std::map<std::string, std::string, CaseInsensitiveComparator>& headers) {
+    auto header = headers.find("Content-Length");
+    if (header == headers.end()) {
+      return 0;
+    }
+    char* end = nullptr;
+    unsigned long long length = std::strtoull(header->second.c_str(), &end, 10);
+    return end && *end == '\0' ? static_cast<size_t>(length) : 0;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::vector<uint8_t> mBody;
+  /** @endcond */
+};
+
+/**
+ * @brief HttpResponse whose body is an immutable buffer shared with other responses
+ * 
+ * @note Useful when one received body answers several requests, e.g. for coalesced or cached responses. Each response
+ *       carries its own ID, status and headers, while the body is stored once.
+ */
+class SharedBodyHttpResponse : public HttpResponse {
+public:
+  /**
+   * @brief Create a response
+   * 
+   * @param id Request ID
+   * @param statusCode HTTP status code
+   * @param headers Response headers
+   * @param body Shared body
+   */
+  SharedBodyHttpResponse(
+      const std::string& id,
+      int32_t statusCode,
+      const std::map<std::string, std::string, CaseInsensitiveComparator>& headers,
+      const std::shared_ptr<const std::vector<uint8_t>>& body)
+      : mId(id),
+        mStatusCode(statusCode),
+        mHeaders(headers),
+        mBody(body ? body : std::make_shared<const std::vector<uint8_t>>()) {}
+
+  /** @brief Get the request ID */
+  const std::string& GetId() const override { return mId; }
+
+  /** @brief Get the HTTP status code */
+  int32_t GetStatusCode() const override { return mStatusCode; }
+
+  /** @brief Get the body, without copying the shared buffer */
+  const std::vector<uint8_t>& GetBody() const override { return *mBody; }
+
+  /** @brief Get the response headers */
+  const std::map<std::string, std::string, CaseInsensitiveComparator>& GetHeaders() const override { return mHeaders; }
+
+  /**
+   * @brief Get the shared body
+   * 
+   * @return Body buffer, which may be handed to other responses
+   */
+  const std::shared_ptr<const std::vector<uint8_t>>& GetSharedBody() const { return mBody; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::string mId;
+  int32_t mStatusCode;
+  std::map<std::string, std::string, CaseInsensitiveComparator> mHeaders;
+  std::shared_ptr<const std::vector<uint8_t>> mBody;
+  /** @endcond */
+};
+
+/**
+ * @brief Read-only Stream over the body of an HttpResponse, reading the response's buffer in place
+ * 
+ * @note The stream keeps the response alive, so a body can be handed to stream-based parsers or written to a file
+ *       without being copied into another buffer first.
+ */
+class HttpBodyStream : public Stream {
+public:
+  /**
+   * @brief Create a stream over a response body
+   * 
+   * @param response Response whose body is read
+   */
+  explicit HttpBodyStream(const std::shared_ptr<HttpResponse>& response)
+      : mResponse(response),
+        mPosition(0) {
+    if (!mResponse) {
+      throw BadInputError("HttpBodyStream requires a response");
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the body.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    const std::vector<uint8_t>& body = mResponse->GetBody();
+    int64_t bytesToRead = (std::min)(bufferLength, static_cast<int64_t>(body.size()) - mPosition);
+    if (bytesToRead <= 0) {
+      return 0;
+    }
+    std::memcpy(buffer, body.data() + mPosition, static_cast<size_t>(bytesToRead));
+    mPosition += bytesToRead;
+    return bytesToRead;
+  }
+
+  /**
+   * @brief Response bodies are read-only, a mip::NotSupportedError is thrown.
+   */
+  int64_t Write(const uint8_t* /*buffer*/, int64_t /*bufferLength*/) override {
+    throw NotSupportedError("HttpBodyStream is read-only");
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true, there is nothing to flush.
+   */
+  bool Flush() override { return true; }
+
+  /**
+   * @brief Seek specific position within the body.
+   * 
+   * @param position to seek into the body.
+   */
+  void Seek(int64_t position) override {
+    int64_t size = static_cast<int64_t>(mResponse->GetBody().size());
+    mPosition = (std::max)(static_cast<int64_t>(0), (std::min)(position, size));
+  }
+
+  /** @brief A check if stream can be read from. */
+  bool CanRead() const override { return true; }
+
+  /** @brief A check if stream can be written to. */
+  bool CanWrite() const override { return false; }
+
+  /** @brief Get the current position within the body. */
+  int64_t Position() override { return mPosition; }
+
+  /** @brief Get the size of the body. */
+  int64_t Size() override { return static_cast<int64_t>(mResponse->GetBody().size()); }
+
+  /**
+   * @brief Response bodies have a fixed size, a mip::NotSupportedError is thrown.
+   */
+  void Size(int64_t /*value*/) override { throw NotSupportedError("HttpBodyStream size cannot be changed"); }
+
+  /**
+   * @brief Get the body bytes in place
+   * 
+   * @return Pointer to the first byte, valid while the stream exists
+   */
+  const uint8_t* GetData() const { return mResponse->GetBody().data(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<HttpResponse> mResponse;
+  int64_t mPosition;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_HTTP_BODY_H_
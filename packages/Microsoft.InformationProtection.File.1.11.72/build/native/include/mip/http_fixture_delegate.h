@@ -0,0 +1,354 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an HttpDelegate that records service responses to files and replays them offline
+ * 
+ * @file http_fixture_delegate.h
+ */
+
+#ifndef API_MIP_HTTP_FIXTURE_DELEGATE_H_
+#define API_MIP_HTTP_FIXTURE_DELEGATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace httpfixture {
+
+typedef std::map<std::string, std::string, CaseInsensitiveComparator> Headers;
+
+class FixtureResponse : public HttpResponse {
+public:
+  FixtureResponse(
+      const std::string& id,
+      int32_t statusCode,
+      const Headers& headers,
+      const std::vector<uint8_t>& body,
+      std::chrono::milliseconds recordedLatency = std::chrono::milliseconds(-1))
+      : mId(id), mStatusCode(statusCode), mHeaders(headers), mBody(body), mRecordedLatency(recordedLatency) {}
+
+  const std::string& GetId() const override { return mId; }
+  int32_t GetStatusCode() const override { return mStatusCode; }
+  const std::vector<uint8_t>& GetBody() const override { return mBody; }
+  const Headers& GetHeaders() const override { return mHeaders; }
+  // Time the service took to answer when the fixture was recorded, negative if unknown
+  std::chrono::milliseconds GetRecordedLatency() const { return mRecordedLatency; }
+
+private:
+  std::string mId;
+  int32_t mStatusCode;
+  Headers mHeaders;
+  std::vector<uint8_t> mBody;
+  std::chrono::milliseconds mRecordedLatency;
+};
+
+class FixtureOperation : public HttpOperation {
+public:
+  FixtureOperation(const std::string& id, const std::shared_ptr<HttpResponse>& response)
+      : mId(id), mResponse(response) {}
+
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return false; }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+};
+
+// A recorded response: status, headers and body, without the request ID, which is reassigned on replay
+struct Fixture {
+  int32_t statusCode = 0;
+  std::chrono::milliseconds latency{-1};
+  Headers headers;
+  std::vector<uint8_t> body;
+};
+
+inline std::string GetKey(const HttpRequest& request, bool isBodyIncluded) {
+  // 64-bit FNV-1a over the method, the URL and, for exact matches, the body
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= data[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+  std::string line = (request.GetRequestType() == HttpRequestType::Post ? "POST " : "GET ") + request.GetUrl();
+  add(reinterpret_cast<const uint8_t*>(line.data()), line.size());
+  if (isBodyIncluded) {
+    add(request.GetBody().data(), request.GetBody().size());
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), "%s%016llx", isBodyIncluded ? "b" : "u", static_cast<unsigned long long>(hash));
+  return text;
+}
+
+inline std::string GetSanitizedUrl(const std::string& url) {
+  return url.substr(0, url.find('?'));
+}
+
+inline void WriteFixture(const std::string& path, const HttpResponse& response, std::chrono::milliseconds latency) {
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      throw FileIOError("Failed to create HTTP fixture " + temporaryPath);
+    }
+    file << "status " << response.GetStatusCode() << "\n";
+    // Has no ": " separator, so readers that predate it skip the line like a malformed header
+    file << "latency-ms " << latency.count() << "\n";
+    for (const auto& header : response.GetHeaders()) {
+      file << header.first << ": " << header.second << "\n";
+    }
+    file << "\n";
+    file.write(reinterpret_cast<const char*>(response.GetBody().data()),
+        static_cast<std::streamsize>(response.GetBody().size()));
+    if (!file) {
+      throw FileIOError("Failed to write HTTP fixture " + temporaryPath);
+    }
+  }
+  std::remove(path.c_str());
+  if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    throw FileIOError("Failed to commit HTTP fixture " + path);
+  }
+}
+
+inline bool ReadFixture(const std::string& path, Fixture& fixture) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  if (!std::getline(file, line) || line.compare(0, 7, "status ") != 0) {
+    throw BadInputError("Invalid HTTP fixture " + path);
+  }
+  fixture.statusCode = static_cast<int32_t>(std::stol(line.substr(7)));
+  while (std::getline(file, line) && !line.empty()) {
+    if (line.compare(0, 11, "latency-ms ") == 0) {
+      fixture.latency = std::chrono::milliseconds(std::stoll(line.substr(11)));
+      continue;
+    }
+    size_t separator = line.find(": ");
+    if (separator != std::string::npos) {
+      fixture.headers[line.substr(0, separator)] = line.substr(separator + 2);
+    }
+  }
+  fixture.body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+} // namespace httpfixture
+/** @endcond */
+
+/**
+ * @brief HttpDelegate that records service responses to a directory, or replays them without network access
+ * 
+ * @note In recording mode, every request is forwarded to the recording delegate and its response is saved twice:
+ *       keyed by method, URL and body, and keyed by method and URL only. In replay mode, a request is answered from
+ *       the exact fixture if there is one, else from the URL fixture, so requests whose bodies carry nonces still
+ *       replay. Fixtures are read from disk once and then served from memory, so replayed runs, such as benchmarks,
+ *       measure SDK CPU and I/O rather than the network or the fixture store. A request without a fixture fails with
+ *       a NetworkError of category Offline and is counted by GetMissCount. Each fixture also keeps the time the
+ *       service took to answer, which a SimulatedHttpDelegate can replay on top of the responses.
+ */
+class HttpFixtureDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Creates a delegate that replays fixtures
+   * 
+   * @param fixtureDirectory Directory holding the fixtures
+   */
+  explicit HttpFixtureDelegate(const std::string& fixtureDirectory)
+      : mFixtureDirectory(fixtureDirectory),
+        mMissCount(0) {}
+
+  /**
+   * @brief Creates a delegate that records fixtures
+   * 
+   * @param fixtureDirectory Existing directory receiving the fixtures
+   * @param recordingDelegate Delegate that sends the requests to the service
+   */
+  HttpFixtureDelegate(const std::string& fixtureDirectory, const std::shared_ptr<HttpDelegate>& recordingDelegate)
+      : mFixtureDirectory(fixtureDirectory),
+        mRecordingDelegate(recordingDelegate),
+        mMissCount(0) {
+    if (!mRecordingDelegate) {
+      throw BadInputError("HttpFixtureDelegate recording mode requires a delegate");
+    }
+  }
+
+  /**
+   * @brief Send HTTP request
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    if (mRecordingDelegate) {
+      auto start = std::chrono::steady_clock::now();
+      auto operation = mRecordingDelegate->Send(request, context);
+      Record(*request, operation, start);
+      return operation;
+    }
+    return Replay(*request);
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    if (mRecordingDelegate) {
+      auto start = std::chrono::steady_clock::now();
+      return mRecordingDelegate->SendAsync(request, context, [this, request, callbackFn, start](
+          std::shared_ptr<HttpOperation> operation) {
+        Record(*request, operation, start);
+        callbackFn(operation);
+      });
+    }
+    auto operation = Replay(*request);
+    callbackFn(operation);
+    return operation;
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override {
+    if (mRecordingDelegate) {
+      mRecordingDelegate->CancelOperation(requestId);
+    }
+  }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override {
+    if (mRecordingDelegate) {
+      mRecordingDelegate->CancelAllOperations();
+    }
+  }
+
+  /**
+   * @brief Get the number of replayed requests that had no fixture
+   * 
+   * @return Number of misses
+   */
+  size_t GetMissCount() const { return mMissCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::string GetPath(const std::string& key) const { return mFixtureDirectory + "/" + key + ".http"; }
+
+  void Record(
+      const HttpRequest& request,
+      const std::shared_ptr<HttpOperation>& operation,
+      std::chrono::steady_clock::time_point start) {
+    if (!operation || operation->IsCancelled() || !operation->GetResponse()) {
+      return;
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::lock_guard<std::mutex> lock(mMutex);
+    httpfixture::WriteFixture(GetPath(httpfixture::GetKey(request, true)), *operation->GetResponse(), latency);
+    httpfixture::WriteFixture(GetPath(httpfixture::GetKey(request, false)), *operation->GetResponse(), latency);
+  }
+
+  std::shared_ptr<HttpOperation> Replay(const HttpRequest& request) {
+    const httpfixture::Fixture* fixture = Find(httpfixture::GetKey(request, true));
+    if (!fixture) {
+      fixture = Find(httpfixture::GetKey(request, false));
+    }
+    if (!fixture) {
+      ++mMissCount;
+      throw NetworkError(NetworkError::Category::Offline, httpfixture::GetSanitizedUrl(request.GetUrl()),
+          request.GetId(), 0, "No recorded HTTP fixture for request");
+    }
+    auto response = std::make_shared<httpfixture::FixtureResponse>(
+        request.GetId(), fixture->statusCode, fixture->headers, fixture->body, fixture->latency);
+    return std::make_shared<httpfixture::FixtureOperation>(request.GetId(), response);
+  }
+
+  // Fixtures are immutable once loaded, so the returned pointer stays valid for the delegate's lifetime
+  const httpfixture::Fixture* Find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto cached = mFixtures.find(key);
+    if (cached == mFixtures.end()) {
+      std::unique_ptr<httpfixture::Fixture> fixture(new httpfixture::Fixture());
+      if (!httpfixture::ReadFixture(GetPath(key), *fixture)) {
+        fixture.reset();
+      }
+      cached = mFixtures.emplace(key, std::move(fixture)).first;
+    }
+    return cached->second.get();
+  }
+
+  std::string mFixtureDirectory;
+  std::shared_ptr<HttpDelegate> mRecordingDelegate;
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::unique_ptr<httpfixture::Fixture>> mFixtures;
+  std::atomic<size_t> mMissCount;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_HTTP_FIXTURE_DELEGATE_H_
@@ -0,0 +1,358 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines HttpHeaders, a flat header container with inline storage and interned common header names
+ *
+ * @file http_headers.h
+ */
+
+#ifndef API_MIP_HTTP_HEADERS_H_
+#define API_MIP_HTTP_HEADERS_H_
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief An interned HTTP header name, compared by identity instead of by case-folding its text
+ *
+ * @note Get the common names from the functions in the httpheaders namespace; each is created once per process.
+ */
+class HttpHeaderName {
+public:
+  /**
+   * @brief Get the name as sent on the wire
+   *
+   * @return Header name, e.g. "Content-Type"
+   */
+  const std::string& GetName() const { return mName; }
+
+  /**
+   * @brief Get the lowercased name
+   *
+   * @return Lowercased header name, e.g. "content-type"
+   */
+  const std::string& GetLowerName() const { return mLowerName; }
+
+  /** @cond DOXYGEN_HIDE */
+  HttpHeaderName(const char* name, uint32_t id) : mName(name), mLowerName(name), mId(id) {
+    for (char& c : mLowerName) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+  }
+
+  uint32_t GetId() const { return mId; }
+
+private:
+  std::string mName;
+  std::string mLowerName;
+  uint32_t mId;
+  /** @endcond */
+};
+
+namespace httpheaders {
+
+/** @cond DOXYGEN_HIDE */
+#define MIP_HTTP_HEADER_NAME(function, name, id)               \
+  inline const HttpHeaderName& function() {                    \
+    static const HttpHeaderName kName(name, id);               \
+    return kName;                                              \
+  }
+/** @endcond */
+
+/** @brief Gets the interned "Accept" header name */
+MIP_HTTP_HEADER_NAME(Accept, "Accept", 1)
+/** @brief Gets the interned "Accept-Encoding" header name */
+MIP_HTTP_HEADER_NAME(AcceptEncoding, "Accept-Encoding", 2)
+/** @brief Gets the interned "Authorization" header name */
+MIP_HTTP_HEADER_NAME(Authorization, "Authorization", 3)
+/** @brief Gets the interned "Cache-Control" header name */
+MIP_HTTP_HEADER_NAME(CacheControl, "Cache-Control", 4)
+/** @brief Gets the interned "Content-Encoding" header name */
+MIP_HTTP_HEADER_NAME(ContentEncoding, "Content-Encoding", 5)
+/** @brief Gets the interned "Content-Length" header name */
+MIP_HTTP_HEADER_NAME(ContentLength, "Content-Length", 6)
+/** @brief Gets the interned "Content-Type" header name */
+MIP_HTTP_HEADER_NAME(ContentType, "Content-Type", 7)
+/** @brief Gets the interned "Date" header name */
+MIP_HTTP_HEADER_NAME(Date, "Date", 8)
+/** @brief Gets the interned "ETag" header name */
+MIP_HTTP_HEADER_NAME(ETag, "ETag", 9)
+/** @brief Gets the interned "Expires" header name */
+MIP_HTTP_HEADER_NAME(Expires, "Expires", 10)
+/** @brief Gets the interned "If-Modified-Since" header name */
+MIP_HTTP_HEADER_NAME(IfModifiedSince, "If-Modified-Since", 11)
+/** @brief Gets the interned "If-None-Match" header name */
+MIP_HTTP_HEADER_NAME(IfNoneMatch, "If-None-Match", 12)
+/** @brief Gets the interned "Last-Modified" header name */
+MIP_HTTP_HEADER_NAME(LastModified, "Last-Modified", 13)
+/** @brief Gets the interned "Retry-After" header name */
+MIP_HTTP_HEADER_NAME(RetryAfter, "Retry-After", 14)
+/** @brief Gets the interned "traceparent" header name */
+MIP_HTTP_HEADER_NAME(Traceparent, "traceparent", 15)
+/** @brief Gets the interned "User-Agent" header name */
+MIP_HTTP_HEADER_NAME(UserAgent, "User-Agent", 16)
+
+#undef MIP_HTTP_HEADER_NAME
+
+/** @cond DOXYGEN_HIDE */
+// Interned ID of a common header name, or 0. Names of another length are skipped without comparing characters.
+inline uint32_t FindInternedId(const std::string& name) {
+  static const HttpHeaderName* const kNames[] = {&Accept(), &AcceptEncoding(), &Authorization(), &CacheControl(),
+      &ContentEncoding(), &ContentLength(), &ContentType(), &Date(), &ETag(), &Expires(), &IfModifiedSince(),
+      &IfNoneMatch(), &LastModified(), &RetryAfter(), &Traceparent(), &UserAgent()};
+  for (const HttpHeaderName* interned : kNames) {
+    const std::string& lower = interned->GetLowerName();
+    if (lower.size() != name.size()) {
+      continue;
+    }
+    size_t i = 0;
+    while (i < name.size() && lower[i] == std::tolower(static_cast<unsigned char>(name[i]))) {
+      ++i;
+    }
+    if (i == name.size()) {
+      return interned->GetId();
+    }
+  }
+  return 0;
+}
+/** @endcond */
+
+} // namespace httpheaders
+
+/**
+ * @brief Flat, case-insensitive HTTP header container with inline storage for the first few headers
+ *
+ * @note Requests and responses rarely carry more than a handful of headers, so a linear scan over a flat array beats a
+ *       tree of case-folding comparisons, and the first kInlineCapacity headers need no allocation beyond their
+ *       strings. Lookups by an interned HttpHeaderName compare IDs only; lookups by text compare lengths first and
+ *       case-fold only on a length match. HttpRequest and HttpResponse keep returning std::map, since their layout is
+ *       fixed by the SDK binary: delegates build HttpHeaders on their hot paths and convert with ToMap/FromMap at
+ *       that boundary.
+ */
+class HttpHeaders {
+public:
+  /** @brief Number of headers stored without allocating an overflow array */
+  static const size_t kInlineCapacity = 8;
+
+  /**
+   * @brief A header
+   */
+  struct Entry {
+    std::string name;  /**< Name as set */
+    std::string value; /**< Value */
+    uint32_t nameId;   /**< Interned ID of the name, or 0 */
+  };
+
+  /**
+   * @brief Create headers from a map, e.g. HttpRequest::GetHeaders
+   *
+   * @param headers Headers
+   *
+   * @return Flat headers
+   */
+  static HttpHeaders FromMap(const std::map<std::string, std::string, CaseInsensitiveComparator>& headers) {
+    HttpHeaders flat;
+    for (const auto& header : headers) {
+      flat.Append(header.first, header.second, httpheaders::FindInternedId(header.first));
+    }
+    return flat;
+  }
+
+  /**
+   * @brief Convert to the map type of HttpRequest and HttpResponse
+   *
+   * @return Headers
+   */
+  std::map<std::string, std::string, CaseInsensitiveComparator> ToMap() const {
+    std::map<std::string, std::string, CaseInsensitiveComparator> headers;
+    for (size_t i = 0; i < mSize; ++i) {
+      headers[At(i).name] = At(i).value;
+    }
+    return headers;
+  }
+
+  /**
+   * @brief Set a header, replacing any value it had
+   *
+   * @param name Interned header name
+   * @param value Value
+   */
+  void Set(const HttpHeaderName& name, const std::string& value) {
+    Entry* entry = FindEntry(name.GetId());
+    if (entry) {
+      entry->value = value;
+    } else {
+      Append(name.GetName(), value, name.GetId());
+    }
+  }
+
+  /**
+   * @brief Set a header, replacing any value it had
+   *
+   * @param name Header name, compared case-insensitively
+   * @param value Value
+   */
+  void Set(const std::string& name, const std::string& value) {
+    uint32_t id = httpheaders::FindInternedId(name);
+    Entry* entry = FindEntry(name, id);
+    if (entry) {
+      entry->value = value;
+    } else {
+      Append(name, value, id);
+    }
+  }
+
+  /**
+   * @brief Get the value of a header
+   *
+   * @param name Interned header name
+   *
+   * @return Value, or nullptr if the header is not set
+   */
+  const std::string* Get(const HttpHeaderName& name) const {
+    const Entry* entry = const_cast<HttpHeaders*>(this)->FindEntry(name.GetId());
+    return entry ? &entry->value : nullptr;
+  }
+
+  /**
+   * @brief Get the value of a header
+   *
+   * @param name Header name, compared case-insensitively
+   *
+   * @return Value, or nullptr if the header is not set
+   */
+  const std::string* Get(const std::string& name) const {
+    const Entry* entry = const_cast<HttpHeaders*>(this)->FindEntry(name, httpheaders::FindInternedId(name));
+    return entry ? &entry->value : nullptr;
+  }
+
+  /**
+   * @brief Remove a header
+   *
+   * @param name Header name, compared case-insensitively
+   *
+   * @return true if the header was set
+   */
+  bool Remove(const std::string& name) {
+    Entry* entry = FindEntry(name, httpheaders::FindInternedId(name));
+    if (!entry) {
+      return false;
+    }
+    Entry& last = At(mSize - 1);
+    if (entry != &last) {
+      *entry = std::move(last);
+    }
+    --mSize;
+    if (mSize >= kInlineCapacity) {
+      mOverflow.pop_back();
+    } else {
+      mInline[mSize] = Entry();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Get the number of headers
+   *
+   * @return Header count
+   */
+  size_t Size() const { return mSize; }
+
+  /**
+   * @brief Get a header by position; positions change when headers are removed
+   *
+   * @param index Position, less than Size()
+   *
+   * @return Header
+   */
+  const Entry& At(size_t index) const {
+    return index < kInlineCapacity ? mInline[index] : mOverflow[index - kInlineCapacity];
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  Entry& At(size_t index) { return index < kInlineCapacity ? mInline[index] : mOverflow[index - kInlineCapacity]; }
+
+  void Append(const std::string& name, const std::string& value, uint32_t id) {
+    if (mSize < kInlineCapacity) {
+      mInline[mSize] = Entry{name, value, id};
+    } else {
+      mOverflow.push_back(Entry{name, value, id});
+    }
+    ++mSize;
+  }
+
+  Entry* FindEntry(uint32_t id) {
+    for (size_t i = 0; i < mSize; ++i) {
+      if (At(i).nameId == id) {
+        return &At(i);
+      }
+    }
+    return nullptr;
+  }
+
+  Entry* FindEntry(const std::string& name, uint32_t id) {
+    if (id != 0) {
+      return FindEntry(id);
+    }
+    for (size_t i = 0; i < mSize; ++i) {
+      Entry& entry = At(i);
+      if (entry.nameId == 0 && entry.name.size() == name.size() && IsEqualIgnoringCase(entry.name, name)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool IsEqualIgnoringCase(const std::string& lhs, const std::string& rhs) {
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      if (std::tolower(static_cast<unsigned char>(lhs[i])) != std::tolower(static_cast<unsigned char>(rhs[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Entry mInline[kInlineCapacity];
+  size_t mSize = 0;
+  std::vector<Entry> mOverflow;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_HTTP_HEADERS_H_
@@ -0,0 +1,506 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MeteredHttpDelegate, which records latency, status codes, bytes and retries per logical operation
+ * 
+ * @file http_metrics_delegate.h
+ */
+
+#ifndef API_MIP_HTTP_METRICS_DELEGATE_H_
+#define API_MIP_HTTP_METRICS_DELEGATE_H_
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Log-linear latency histogram in microseconds, with 8 sub-buckets per power of two (12.5% precision)
+ * 
+ * @note Values below 16 microseconds are recorded exactly; values above about 12.7 days are clamped.
+ */
+class HttpLatencyHistogram {
+public:
+  /**
+   * @brief Record one latency
+   * 
+   * @param latency Elapsed time of one request
+   */
+  void Record(std::chrono::microseconds latency) {
+    uint64_t value = static_cast<uint64_t>((std::max)(latency.count(), static_cast<int64_t>(0)));
+    mBuckets[GetBucketIndex(value)]++;
+    mCount++;
+    mSum += value;
+    mMax = (std::max)(mMax, value);
+  }
+
+  /**
+   * @brief Add the samples of another histogram
+   * 
+   * @param other Histogram to add
+   */
+  void Merge(const HttpLatencyHistogram& other) {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      mBuckets[i] += other.mBuckets[i];
+    }
+    mCount += other.mCount;
+    mSum += other.mSum;
+    mMax = (std::max)(mMax, other.mMax);
+  }
+
+  /**
+   * @brief Get the number of recorded samples
+   * 
+   * @return Sample count
+   */
+  uint64_t GetCount() const { return mCount; }
+
+  /**
+   * @brief Get the largest recorded latency
+   * 
+   * @return Maximum latency, exact
+   */
+  std::chrono::microseconds GetMax() const { return std::chrono::microseconds(static_cast<int64_t>(mMax)); }
+
+  /**
+   * @brief Get the mean recorded latency
+   * 
+   * @return Mean latency, exact
+   */
+  std::chrono::microseconds GetMean() const {
+    return std::chrono::microseconds(mCount ? static_cast<int64_t>(mSum / mCount) : 0);
+  }
+
+  /**
+   * @brief Get a percentile of the recorded latencies
+   * 
+   * @param percentile Percentile in [0, 100], e.g. 99.0
+   * 
+   * @return Upper bound of the bucket holding the percentile, never more than GetMax()
+   */
+  std::chrono::microseconds GetPercentile(double percentile) const {
+    if (mCount == 0) {
+      return std::chrono::microseconds(0);
+    }
+    double bounded = (std::min)((std::max)(percentile, 0.0), 100.0);
+    uint64_t rank = (std::max)(static_cast<uint64_t>(bounded / 100.0 * static_cast<double>(mCount) + 0.5),
+                               static_cast<uint64_t>(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += mBuckets[i];
+      if (seen >= rank) {
+        return std::chrono::microseconds(static_cast<int64_t>((std::min)(GetBucketUpperBound(i), mMax)));
+      }
+    }
+    return GetMax();
+  }
+
+  /**
+   * @brief Get the non-empty buckets, e.g. to export the whole distribution
+   * 
+   * @return Pairs of bucket upper bound (microseconds, inclusive) and sample count, in ascending order
+   */
+  std::vector<std::pair<uint64_t, uint64_t>> GetBuckets() const {
+    std::vector<std::pair<uint64_t, uint64_t>> buckets;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      if (mBuckets[i] != 0) {
+        buckets.emplace_back(GetBucketUpperBound(i), mBuckets[i]);
+      }
+    }
+    return buckets;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static const int kSubBucketBits = 3;
+  static const int kMaxValueBits = 40;
+  static const size_t kBucketCount = (2u << kSubBucketBits) + (kMaxValueBits - kSubBucketBits) * (1u << kSubBucketBits);
+
+  static size_t GetBucketIndex(uint64_t value) {
+    const uint64_t exactLimit = 2u << kSubBucketBits;
+    value = (std::min)(value, (static_cast<uint64_t>(1) << kMaxValueBits) - 1);
+    if (value < exactLimit) {
+      return static_cast<size_t>(value);
+    }
+    int highestBit = 0;
+    for (uint64_t rest = value; rest > 1; rest >>= 1) {
+      ++highestBit;
+    }
+    int shift = highestBit - kSubBucketBits;
+    uint64_t top = value >> shift;
+    return static_cast<size_t>(exactLimit + (shift - 1) * (1u << kSubBucketBits) + (top - (1u << kSubBucketBits)));
+  }
+
+  static uint64_t GetBucketUpperBound(size_t index) {
+    const size_t exactLimit = 2u << kSubBucketBits;
+    if (index < exactLimit) {
+      return index;
+    }
+    size_t shift = (index - exactLimit) / (1u << kSubBucketBits) + 1;
+    uint64_t top = (index - exactLimit) % (1u << kSubBucketBits) + (1u << kSubBucketBits);
+    return ((top + 1) << shift) - 1;
+  }
+
+  std::array<uint64_t, kBucketCount> mBuckets = {};
+  uint64_t mCount = 0;
+  uint64_t mSum = 0;
+  uint64_t mMax = 0;
+  /** @endcond */
+}; // class HttpLatencyHistogram
+
+/**
+ * @brief Counters of one logical operation, e.g. "policy" or "licensing"
+ */
+struct HttpOperationMetrics {
+  std::string operation;                        /**< Logical operation label */
+  uint64_t requestCount = 0;                    /**< Attempts sent, including retries */
+  uint64_t retryCount = 0;                      /**< Attempts that resent an earlier request ID */
+  uint64_t failureCount = 0;                    /**< Attempts that threw or completed without a response */
+  uint64_t cancelledCount = 0;                  /**< Attempts that completed cancelled */
+  uint64_t bytesSent = 0;                       /**< Request body bytes */
+  uint64_t bytesReceived = 0;                   /**< Response body bytes */
+  std::map<int32_t, uint64_t> statusCodeCounts; /**< Responses per HTTP status code */
+  HttpLatencyHistogram latency;                 /**< Latency of every attempt, from dispatch to completion */
+};
+
+/**
+ * @brief One completed attempt, for the push callback
+ */
+struct HttpRequestSample {
+  std::string operation;                  /**< Logical operation label */
+  std::string requestId;                  /**< ID of the request */
+  int32_t statusCode = 0;                 /**< HTTP status code, 0 when there was no response */
+  bool isRetry = false;                   /**< Whether the request ID was seen before */
+  bool isFailed = false;                  /**< Whether the attempt threw or completed without a response */
+  bool isCancelled = false;               /**< Whether the attempt completed cancelled */
+  uint64_t bytesSent = 0;                 /**< Request body bytes */
+  uint64_t bytesReceived = 0;             /**< Response body bytes */
+  std::chrono::microseconds latency{0};   /**< Time from dispatch to completion */
+};
+
+/**
+ * @brief Derive the logical operation of a request from its URL
+ * 
+ * @param request HTTP request
+ * 
+ * @return One of "audit", "discovery", "policy", "sensitivitytypes", "templates", "usercertificates", "licensing",
+ *         "tracking" or "other"
+ * 
+ * @note Matches well-known path fragments of the MIP and RMS services, case-insensitively. Hosts with custom
+ *       endpoints can pass their own labeler to MeteredHttpDelegate.
+ */
+inline std::string GetHttpOperationLabel(const HttpRequest& request) {
+  static const std::vector<std::pair<const char*, const char*>> kFragments = {
+    {"events.data.microsoft.com", "audit"},
+    {"/audit", "audit"},
+    {"/aria", "audit"},
+    {"servicediscovery", "discovery"},
+    {"/discovery", "discovery"},
+    {"enterpriseregistration", "discovery"},
+    {"/sensitivitytypes", "sensitivitytypes"},
+    {"/sensitiveinformationtypes", "sensitivitytypes"},
+    {"/policy", "policy"},
+    {"/syncservice", "policy"},
+    {"/templates", "templates"},
+    {"/usercertificates", "usercertificates"},
+    {"/certification", "usercertificates"},
+    {"/doctracking", "tracking"},
+    {"/tracking", "tracking"},
+    {"license", "licensing"},
+  };
+  std::string url = request.GetUrl();
+  std::transform(url.begin(), url.end(), url.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  url = url.substr(0, url.find_first_of("?#"));
+  for (const auto& fragment : kFragments) {
+    if (url.find(fragment.first) != std::string::npos) {
+      return fragment.second;
+    }
+  }
+  return "other";
+}
+
+/**
+ * @brief Per-operation HTTP counters shared by any number of MeteredHttpDelegate instances, e.g. one per MipContext
+ */
+class HttpMetricsRegistry {
+public:
+  /**
+   * @brief Get a copy of the counters of every operation seen so far
+   * 
+   * @return Counters ordered by operation label
+   */
+  std::vector<HttpOperationMetrics> GetMetrics() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<HttpOperationMetrics> metrics;
+    metrics.reserve(mMetrics.size());
+    for (const auto& entry : mMetrics) {
+      metrics.push_back(entry.second);
+    }
+    return metrics;
+  }
+
+  /**
+   * @brief Get a copy of the counters of one operation
+   * 
+   * @param operation Logical operation label
+   * 
+   * @return Counters, empty if the operation was never seen
+   */
+  HttpOperationMetrics GetMetrics(const std::string& operation) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto entry = mMetrics.find(operation);
+    if (entry == mMetrics.end()) {
+      HttpOperationMetrics empty;
+      empty.operation = operation;
+      return empty;
+    }
+    return entry->second;
+  }
+
+  /**
+   * @brief Discard every counter, e.g. at the start of a reporting interval
+   */
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMetrics.clear();
+  }
+
+  /**
+   * @brief Set a callback receiving every completed attempt
+   * 
+   * @param onSample Callback, or nullptr to stop pushing samples. It runs on the thread completing the request
+   *                 and must return quickly.
+   */
+  void SetSampleCallback(const std::function<void(const HttpRequestSample&)>& onSample) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOnSample = onSample;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  void Record(const HttpRequestSample& sample) {
+    std::function<void(const HttpRequestSample&)> onSample;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      HttpOperationMetrics& metrics = mMetrics[sample.operation];
+      metrics.operation = sample.operation;
+      metrics.requestCount++;
+      metrics.retryCount += sample.isRetry ? 1 : 0;
+      metrics.failureCount += sample.isFailed ? 1 : 0;
+      metrics.cancelledCount += sample.isCancelled ? 1 : 0;
+      metrics.bytesSent += sample.bytesSent;
+      metrics.bytesReceived += sample.bytesReceived;
+      if (sample.statusCode != 0) {
+        metrics.statusCodeCounts[sample.statusCode]++;
+      }
+      metrics.latency.Record(sample.latency);
+      onSample = mOnSample;
+    }
+    if (onSample) {
+      onSample(sample);
+    }
+  }
+
+private:
+  mutable std::mutex mMutex;
+  std::map<std::string, HttpOperationMetrics> mMetrics;
+  std::function<void(const HttpRequestSample&)> mOnSample;
+  /** @endcond */
+}; // class HttpMetricsRegistry
+
+/**
+ * @brief HttpDelegate decorator recording latency, status codes, body bytes and retries of every attempt into an
+ *        HttpMetricsRegistry, labelled by logical operation rather than raw URL
+ * 
+ * @note Pass it to MipConfiguration/MipContext in place of the transport and keep the registry next to the
+ *       MipContext to pull metrics. Place it beneath a RetryHttpDelegate to time each attempt and count retries, which
+ *       are recognized by a request ID that was sent before.
+ */
+class MeteredHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param registry Registry receiving the counters
+   * @param getOperation Returns the logical operation of a request, or nullptr to use GetHttpOperationLabel
+   */
+  MeteredHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const std::shared_ptr<HttpMetricsRegistry>& registry,
+      const std::function<std::string(const HttpRequest&)>& getOperation = nullptr)
+      : mState(std::make_shared<State>()) {
+    if (!transport || !registry) {
+      throw BadInputError("MeteredHttpDelegate requires a transport and a registry");
+    }
+    mState->transport = transport;
+    mState->registry = registry;
+    mState->getOperation = getOperation;
+    if (!mState->getOperation) {
+      mState->getOperation = GetHttpOperationLabel;
+    }
+  }
+
+  /**
+   * @brief Send HTTP request
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    HttpRequestSample sample = mState->Begin(*request);
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<HttpOperation> operation;
+    try {
+      operation = mState->transport->Send(request, context);
+    } catch (...) {
+      mState->End(sample, start, nullptr);
+      throw;
+    }
+    mState->End(sample, start, operation);
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto sample = std::make_shared<HttpRequestSample>(mState->Begin(*request));
+    auto start = std::chrono::steady_clock::now();
+    auto state = mState;
+    try {
+      return mState->transport->SendAsync(request, context, [state, sample, start, callbackFn](
+          std::shared_ptr<HttpOperation> operation) {
+        state->End(*sample, start, operation);
+        if (callbackFn) {
+          callbackFn(operation);
+        }
+      });
+    } catch (...) {
+      mState->End(*sample, start, nullptr);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Completions can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    static const size_t kMaxRecentIds = 4096;
+
+    std::shared_ptr<HttpDelegate> transport;
+    std::shared_ptr<HttpMetricsRegistry> registry;
+    std::function<std::string(const HttpRequest&)> getOperation;
+    std::mutex mutex;
+    std::unordered_set<std::string> recentIds;
+    std::deque<std::string> recentOrder;
+
+    HttpRequestSample Begin(const HttpRequest& request) {
+      HttpRequestSample sample;
+      sample.operation = getOperation(request);
+      sample.requestId = request.GetId();
+      sample.bytesSent = request.GetBody().size();
+      std::lock_guard<std::mutex> lock(mutex);
+      sample.isRetry = !recentIds.insert(sample.requestId).second;
+      if (!sample.isRetry) {
+        recentOrder.push_back(sample.requestId);
+        if (recentOrder.size() > kMaxRecentIds) {
+          recentIds.erase(recentOrder.front());
+          recentOrder.pop_front();
+        }
+      }
+      return sample;
+    }
+
+    void End(
+        HttpRequestSample& sample,
+        std::chrono::steady_clock::time_point start,
+        const std::shared_ptr<HttpOperation>& operation) {
+      sample.latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      std::shared_ptr<HttpResponse> response = operation ? operation->GetResponse() : nullptr;
+      sample.isCancelled = operation && operation->IsCancelled();
+      sample.isFailed = !response && !sample.isCancelled;
+      if (response) {
+        sample.statusCode = response->GetStatusCode();
+        sample.bytesReceived = response->GetBody().size();
+      }
+      registry->Record(sample);
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+}; // class MeteredHttpDelegate
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_HTTP_METRICS_DELEGATE_H_
@@ -0,0 +1,1170 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines IndexedStorageDelegate, an on-disk StorageDelegate with hash indexes on the key columns
+ * 
+ * @file indexed_storage_delegate.h
+ */
+
+#ifndef API_MIP_INDEXED_STORAGE_DELEGATE_H_
+#define API_MIP_INDEXED_STORAGE_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of an IndexedStorageDelegate
+ */
+struct IndexedStorageDelegateSettings {
+  /**
+   * Encrypts the value of a column the SDK passes as encryptedColumns, which it does when CacheStorageType is not
+   * OnDiskEncrypted. Without protectColumn and unprotectColumn such tables cannot be created.
+   */
+  std::function<std::string(const std::string& value)> protectColumn;
+  /** Decrypts a value produced by protectColumn */
+  std::function<std::string(const std::string& value)> unprotectColumn;
+  /** Bytes of superseded records a table file may hold before it is compacted, at least as many as live records */
+  int64_t compactionMinBytes = 4 * 1024 * 1024;
+  /** Time after its last write a row expires, 0 to keep rows until they are deleted or evicted */
+  std::chrono::seconds rowTtl = std::chrono::seconds(0);
+  /** Row lifetimes of specific tables by table name, overriding rowTtl */
+  std::map<std::string, std::chrono::seconds> tableRowTtls;
+  /** Bytes of live rows per table beyond which the least recently used rows are evicted, 0 for no limit */
+  int64_t maxTableBytes = 0;
+  /** Runs the periodic maintenance of each table, removing expired rows and compacting, if set */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+  /** Time between maintenance runs of each table */
+  std::chrono::seconds maintenanceInterval = std::chrono::minutes(10);
+};
+
+/**
+ * @brief Size and eviction counts of the tables of an IndexedStorageDelegate
+ */
+struct IndexedStorageMetrics {
+  size_t tableCount = 0;        /**< Tables created */
+  size_t rowCount = 0;          /**< Rows in the tables, expired ones not yet removed included */
+  int64_t fileBytes = 0;        /**< Size of the table files */
+  int64_t liveBytes = 0;        /**< Bytes of the table files holding current rows */
+  uint64_t expiredCount = 0;    /**< Rows removed because they outlived their row lifetime */
+  uint64_t evictedCount = 0;    /**< Rows removed to keep a table within maxTableBytes */
+  uint64_t compactionCount = 0; /**< Table files rewritten without their superseded records */
+};
+
+/**
+ * @brief Size of one table of an IndexedStorageDelegate
+ */
+struct IndexedStorageTableMetrics {
+  std::string path;      /**< Table file */
+  size_t rowCount = 0;   /**< Rows in the table, expired ones not yet removed included */
+  int64_t fileBytes = 0; /**< Size of the table file */
+  int64_t liveBytes = 0; /**< Bytes of the table file holding current rows */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace indexedstorage {
+
+enum RecordType : uint8_t { Schema = 1, Put = 2, Remove = 3 };
+
+const char kMagic[8] = {'M', 'I', 'P', 'I', 'D', 'X', '2', '\n'};
+const size_t kRecordHeaderSize = 4 + 4 + 1 + 8;
+const size_t kMaxPendingBytes = 1024 * 1024;
+const size_t kTimestampSize = 8;
+
+struct Counters {
+  std::atomic<uint64_t> expiredCount{0};
+  std::atomic<uint64_t> evictedCount{0};
+  std::atomic<uint64_t> compactionCount{0};
+};
+
+inline int64_t GetTimestamp() {
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline void AppendUint32(std::string& out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+inline uint64_t ReadUint(const char* data, int size) {
+  uint64_t value = 0;
+  for (int i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+inline uint32_t Checksum(const char* data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+  }
+  return hash;
+}
+
+inline void AppendStrings(std::string& out, const std::vector<std::string>& values) {
+  AppendUint32(out, static_cast<uint32_t>(values.size()));
+  for (const auto& value : values) {
+    AppendUint32(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+  }
+}
+
+// Returns false on a truncated list
+inline bool ReadStrings(const std::string& in, size_t& position, std::vector<std::string>& values) {
+  if (in.size() - position < 4) {
+    return false;
+  }
+  uint64_t count = ReadUint(in.data() + position, 4);
+  position += 4;
+  values.clear();
+  for (uint64_t i = 0; i < count; ++i) {
+    if (in.size() - position < 4) {
+      return false;
+    }
+    uint64_t size = ReadUint(in.data() + position, 4);
+    position += 4;
+    if (in.size() - position < size) {
+      return false;
+    }
+    values.emplace_back(in, position, static_cast<size_t>(size));
+    position += static_cast<size_t>(size);
+  }
+  return true;
+}
+
+// [payload size][checksum of the rest][type][row ID][payload], where the payload of a Put starts with the
+// time of the write
+inline std::string EncodeRecord(RecordType type, uint64_t rowId, const std::string& payload) {
+  std::string body;
+  body.push_back(static_cast<char>(type));
+  for (int i = 0; i < 8; ++i) {
+    body.push_back(static_cast<char>((rowId >> (8 * i)) & 0xff));
+  }
+  body.append(payload);
+  std::string record;
+  AppendUint32(record, static_cast<uint32_t>(payload.size()));
+  AppendUint32(record, Checksum(body.data(), body.size()));
+  record.append(body);
+  return record;
+}
+
+// Moves source over target in one step, so a crash leaves either the old or the new file in place
+inline bool ReplaceTableFile(const std::string& source, const std::string& target) {
+#ifdef _WIN32
+  return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+}
+
+inline std::string JoinKey(const std::vector<std::string>& keyValues) {
+  std::string key;
+  for (const auto& value : keyValues) {
+    AppendUint32(key, static_cast<uint32_t>(value.size()));
+    key.append(value);
+  }
+  return key;
+}
+
+// One table file: an append-only log of row versions, indexed in memory by row ID and by each key column, and
+// ordered by last use for eviction. Superseded versions are dropped when the file is compacted. Inside a transaction
+// new records are buffered and written with one flush at commit, or sooner once kMaxPendingBytes are buffered.
+class Table : public TransactionalStorageTable,
+              public StorageTableCursorSource,
+              public std::enable_shared_from_this<Table> {
+public:
+  Table(
+      const std::string& path,
+      const IndexedStorageDelegateSettings& settings,
+      std::chrono::seconds rowTtl,
+      const std::shared_ptr<Counters>& counters)
+      : mPath(path),
+        mSettings(settings),
+        mRowTtl(rowTtl.count()),
+        mCounters(counters) {}
+
+  ~Table() {
+    try {
+      FlushPending();
+    } catch (...) {
+    }
+  }
+
+  // Loads the file, or recreates it when it is missing, damaged or of another schema
+  void Open(
+      const std::vector<std::string>& columns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mColumns = columns;
+    mKeyColumns = keyColumns;
+    mColumnPositions.clear();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      mColumnPositions[columns[i]] = i;
+    }
+    mKeyPositions.clear();
+    for (const auto& keyColumn : keyColumns) {
+      mKeyPositions.push_back(GetPosition(keyColumn));
+    }
+    mIsEncrypted.assign(columns.size(), false);
+    for (const auto& encryptedColumn : encryptedColumns) {
+      mIsEncrypted[GetPosition(encryptedColumn)] = true;
+    }
+    if (!encryptedColumns.empty() && (!mSettings.protectColumn || !mSettings.unprotectColumn)) {
+      throw NotSupportedError(
+          "IndexedStorageDelegate requires protectColumn and unprotectColumn for encrypted columns");
+    }
+    FlushPending();
+    Load();
+  }
+
+  void Insert(const std::vector<std::string>& allColumnValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    InsertRow(allColumnValues);
+    EvictAndCompactIfNeeded();
+  }
+
+  void InsertBatch(const std::vector<std::vector<std::string>>& rows) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    RunBatch([this, &rows]() {
+      for (const auto& row : rows) {
+        InsertRow(row);
+      }
+    });
+  }
+
+  std::vector<std::vector<std::string>> List() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::vector<std::string>> rows;
+    rows.reserve(mRows.size());
+    int64_t now = GetTimestamp();
+    for (const auto& row : mRows) {
+      if (!IsExpired(row.second, now)) {
+        rows.push_back(ReadRow(row.second));
+      }
+    }
+    return rows;
+  }
+
+  void Update(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    UpdateRows(updateColumns, updateValues, queryColumns, queryValues);
+    EvictAndCompactIfNeeded();
+  }
+
+  void UpdateBatch(const std::vector<StorageTableUpdate>& updates) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    RunBatch([this, &updates]() {
+      for (const auto& update : updates) {
+        UpdateRows(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+      }
+    });
+  }
+
+  void BeginTransaction() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mTransactionDepth;
+  }
+
+  void CommitTransaction() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTransactionDepth > 0) {
+      EndTransaction();
+    }
+  }
+
+  void Delete(const std::vector<std::string>& queryColumns, const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint64_t rowId : Match(queryColumns, queryValues, nullptr)) {
+      RemoveRow(rowId);
+    }
+    EvictAndCompactIfNeeded();
+  }
+
+  std::vector<std::vector<std::string>> Find(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::vector<std::string>> rows;
+    Match(queryColumns, queryValues, &rows);
+    return rows;
+  }
+
+  std::unique_ptr<StorageTableCursor> OpenCursor(const StorageTableQuery& query) override;
+
+  size_t GetRowCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRows.size();
+  }
+
+  int64_t GetFileSize() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFileSize;
+  }
+
+  int64_t GetLiveBytes() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLiveBytes;
+  }
+
+  // Removes expired rows, evicts rows beyond maxTableBytes and compacts the file once it holds compactionMinBytes
+  // of superseded records. Skipped while a transaction is open.
+  void Maintain() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTransactionDepth > 0) {
+      return;
+    }
+    if (mRowTtl > 0) {
+      int64_t now = GetTimestamp();
+      std::vector<uint64_t> expired;
+      for (const auto& row : mRows) {
+        if (IsExpired(row.second, now)) {
+          expired.push_back(row.first);
+        }
+      }
+      for (uint64_t rowId : expired) {
+        RemoveRow(rowId);
+      }
+      mCounters->expiredCount += expired.size();
+    }
+    EvictIfNeeded();
+    if (mFileSize - mLiveBytes > mSettings.compactionMinBytes) {
+      Rewrite();
+      ++mCounters->compactionCount;
+    }
+  }
+
+private:
+  friend class Cursor;
+
+  struct Row {
+    int64_t offset = 0;
+    int64_t size = 0;
+    int64_t writtenAt = 0; // seconds since the epoch
+    std::vector<std::string> keyValues;
+    std::list<uint64_t>::iterator lruPosition;
+  };
+
+  // Conditions of a query on key columns, by key ordinal, and on other columns, by column position
+  struct Conditions {
+    std::vector<std::pair<size_t, const std::string*>> keys;
+    std::vector<std::pair<size_t, const std::string*>> others;
+  };
+
+  // A cursor holds the IDs of the candidate rows, and reads and checks one of them per step
+  struct CursorState {
+    StorageTableQuery query;
+    Conditions conditions;
+    std::vector<uint64_t> candidates;
+    size_t position = 0;
+    size_t skip = 0;
+    size_t remaining = 0;
+    std::vector<std::string> values;
+  };
+
+  void InsertRow(const std::vector<std::string>& allColumnValues) {
+    if (allColumnValues.size() != mColumns.size()) {
+      throw BadInputError("Insert expects a value for each of the " + std::to_string(mColumns.size()) + " columns");
+    }
+    // Key columns identify unique entries, so inserting an existing key replaces its row
+    auto existing = mRowsByKey.find(JoinKey(GetKeyValues(allColumnValues)));
+    uint64_t rowId = existing != mRowsByKey.end() ? existing->second : mNextRowId++;
+    WriteRow(rowId, allColumnValues);
+  }
+
+  void UpdateRows(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) {
+    if (updateColumns.size() != updateValues.size()) {
+      throw BadInputError("Update expects a value for each update column");
+    }
+    std::vector<size_t> positions;
+    for (const auto& column : updateColumns) {
+      positions.push_back(GetPosition(column));
+    }
+    std::vector<std::vector<std::string>> rows;
+    std::vector<uint64_t> rowIds = Match(queryColumns, queryValues, &rows);
+    for (size_t i = 0; i < rowIds.size(); ++i) {
+      for (size_t j = 0; j < positions.size(); ++j) {
+        rows[i][positions[j]] = updateValues[j];
+      }
+      // An update onto the key of another row replaces that row
+      auto existing = mRowsByKey.find(JoinKey(GetKeyValues(rows[i])));
+      if (existing != mRowsByKey.end() && existing->second != rowIds[i]) {
+        RemoveRow(existing->second);
+      }
+      WriteRow(rowIds[i], rows[i]);
+    }
+  }
+
+  // Runs the writes of a batch as one transaction, committing what was written even if one of them throws
+  template <typename Function>
+  void RunBatch(Function&& function) {
+    ++mTransactionDepth;
+    try {
+      function();
+    } catch (...) {
+      try {
+        EndTransaction();
+      } catch (...) {
+      }
+      throw;
+    }
+    EndTransaction();
+  }
+
+  void EndTransaction() {
+    if (--mTransactionDepth == 0) {
+      FlushPending();
+      EvictAndCompactIfNeeded();
+    }
+  }
+
+  size_t GetPosition(const std::string& column) const {
+    auto position = mColumnPositions.find(column);
+    if (position == mColumnPositions.end()) {
+      throw BadInputError("Unknown storage table column: " + column);
+    }
+    return position->second;
+  }
+
+  std::vector<std::string> GetKeyValues(const std::vector<std::string>& values) const {
+    std::vector<std::string> keyValues;
+    keyValues.reserve(mKeyPositions.size());
+    for (size_t position : mKeyPositions) {
+      keyValues.push_back(values[position]);
+    }
+    return keyValues;
+  }
+
+  // IDs of the rows that may match a query. A query on every key column is one hash lookup. A query on some key
+  // columns is bounded by the rows sharing the rarest of those values. Other queries scan the table.
+  std::vector<uint64_t> GetCandidates(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues,
+      Conditions& conditions) const {
+    if (queryColumns.size() != queryValues.size()) {
+      throw BadInputError("Expected a value for each query column");
+    }
+    std::vector<const std::string*> fullKey(mKeyPositions.size(), nullptr);
+    size_t fullKeyCount = 0;
+    for (size_t i = 0; i < queryColumns.size(); ++i) {
+      size_t position = GetPosition(queryColumns[i]);
+      size_t keyOrdinal = 0;
+      while (keyOrdinal < mKeyPositions.size() && mKeyPositions[keyOrdinal] != position) {
+        ++keyOrdinal;
+      }
+      if (keyOrdinal < mKeyPositions.size()) {
+        conditions.keys.emplace_back(keyOrdinal, &queryValues[i]);
+        fullKeyCount += fullKey[keyOrdinal] ? 0 : 1;
+        fullKey[keyOrdinal] = &queryValues[i];
+      } else {
+        conditions.others.emplace_back(position, &queryValues[i]);
+      }
+    }
+
+    std::vector<uint64_t> candidates;
+    if (!conditions.keys.empty() && fullKeyCount == mKeyPositions.size()) {
+      std::vector<std::string> keyValues;
+      for (const std::string* value : fullKey) {
+        keyValues.push_back(*value);
+      }
+      auto row = mRowsByKey.find(JoinKey(keyValues));
+      if (row != mRowsByKey.end()) {
+        candidates.push_back(row->second);
+      }
+    } else if (!conditions.keys.empty()) {
+      const std::unordered_set<uint64_t>* rarest = nullptr;
+      for (const auto& condition : conditions.keys) {
+        auto rowIds = mKeyIndexes[condition.first].find(*condition.second);
+        if (rowIds == mKeyIndexes[condition.first].end()) {
+          return candidates;
+        }
+        if (!rarest || rowIds->second.size() < rarest->size()) {
+          rarest = &rowIds->second;
+        }
+      }
+      candidates.assign(rarest->begin(), rarest->end());
+    } else {
+      candidates.reserve(mRows.size());
+      for (const auto& row : mRows) {
+        candidates.push_back(row.first);
+      }
+    }
+    return candidates;
+  }
+
+  static bool MatchesKeys(const Row& row, const Conditions& conditions) {
+    for (const auto& condition : conditions.keys) {
+      if (condition.first >= row.keyValues.size() || row.keyValues[condition.first] != *condition.second) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool MatchesOthers(const std::vector<std::string>& values, const Conditions& conditions) {
+    for (const auto& condition : conditions.others) {
+      if (condition.first >= values.size() || values[condition.first] != *condition.second) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Rows whose columns all equal the query
+  std::vector<uint64_t> Match(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues,
+      std::vector<std::vector<std::string>>* rows) {
+    Conditions conditions;
+    std::vector<uint64_t> matches;
+    int64_t now = GetTimestamp();
+    for (uint64_t rowId : GetCandidates(queryColumns, queryValues, conditions)) {
+      Row& row = mRows[rowId];
+      if (IsExpired(row, now) || !MatchesKeys(row, conditions)) {
+        continue;
+      }
+      Touch(row);
+      if (conditions.others.empty() && !rows) {
+        matches.push_back(rowId);
+        continue;
+      }
+      std::vector<std::string> values = ReadRow(row);
+      if (MatchesOthers(values, conditions)) {
+        matches.push_back(rowId);
+        if (rows) {
+          rows->push_back(std::move(values));
+        }
+      }
+    }
+    return matches;
+  }
+
+  // Moves a cursor to its next matching row. Rows removed since it was opened are skipped, and rows that only need
+  // the key conditions are skipped over the offset without being read.
+  bool Next(CursorState& state) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int64_t now = GetTimestamp();
+    while (state.remaining > 0 && state.position < state.candidates.size()) {
+      auto row = mRows.find(state.candidates[state.position++]);
+      if (row == mRows.end() || IsExpired(row->second, now) || !MatchesKeys(row->second, state.conditions)) {
+        continue;
+      }
+      if (state.skip > 0 && state.conditions.others.empty()) {
+        --state.skip;
+        continue;
+      }
+      state.values = ReadRow(row->second);
+      if (!MatchesOthers(state.values, state.conditions)) {
+        continue;
+      }
+      if (state.skip > 0) {
+        --state.skip;
+        continue;
+      }
+      Touch(row->second);
+      --state.remaining;
+      return true;
+    }
+    state.values.clear();
+    return false;
+  }
+
+  bool IsExpired(const Row& row, int64_t now) const { return mRowTtl > 0 && row.writtenAt + mRowTtl <= now; }
+
+  void Touch(Row& row) { mLru.splice(mLru.begin(), mLru, row.lruPosition); }
+
+  void Index(uint64_t rowId, Row& row) {
+    for (size_t i = 0; i < mKeyPositions.size(); ++i) {
+      mKeyIndexes[i][row.keyValues[i]].insert(rowId);
+    }
+    mRowsByKey[JoinKey(row.keyValues)] = rowId;
+    mLru.push_front(rowId);
+    row.lruPosition = mLru.begin();
+  }
+
+  void Unindex(uint64_t rowId, const Row& row) {
+    mLru.erase(row.lruPosition);
+    for (size_t i = 0; i < mKeyPositions.size(); ++i) {
+      auto rowIds = mKeyIndexes[i].find(row.keyValues[i]);
+      if (rowIds != mKeyIndexes[i].end()) {
+        rowIds->second.erase(rowId);
+        if (rowIds->second.empty()) {
+          mKeyIndexes[i].erase(rowIds);
+        }
+      }
+    }
+    auto byKey = mRowsByKey.find(JoinKey(row.keyValues));
+    if (byKey != mRowsByKey.end() && byKey->second == rowId) {
+      mRowsByKey.erase(byKey);
+    }
+  }
+
+  void WriteRow(uint64_t rowId, const std::vector<std::string>& values) {
+    std::vector<std::string> stored = values;
+    for (size_t i = 0; i < stored.size(); ++i) {
+      if (mIsEncrypted[i]) {
+        stored[i] = mSettings.protectColumn(stored[i]);
+      }
+    }
+    Row row;
+    row.writtenAt = GetTimestamp();
+    std::string payload;
+    for (size_t i = 0; i < kTimestampSize; ++i) {
+      payload.push_back(static_cast<char>((static_cast<uint64_t>(row.writtenAt) >> (8 * i)) & 0xff));
+    }
+    AppendStrings(payload, stored);
+    row.keyValues = GetKeyValues(values);
+    row.offset = Append(EncodeRecord(Put, rowId, payload));
+    row.size = static_cast<int64_t>(kRecordHeaderSize + payload.size());
+    auto existing = mRows.find(rowId);
+    if (existing != mRows.end()) {
+      mLiveBytes -= existing->second.size;
+      Unindex(rowId, existing->second);
+    }
+    mLiveBytes += row.size;
+    Index(rowId, row);
+    mRows[rowId] = std::move(row);
+  }
+
+  void RemoveRow(uint64_t rowId) {
+    auto row = mRows.find(rowId);
+    if (row == mRows.end()) {
+      return;
+    }
+    Append(EncodeRecord(Remove, rowId, std::string()));
+    mLiveBytes -= row->second.size;
+    Unindex(rowId, row->second);
+    mRows.erase(row);
+  }
+
+  // Reads a record from the file, or from the pending writes if it is not flushed yet
+  void ReadRecord(const Row& row, std::string& record) {
+    if (row.offset >= mFlushedSize) {
+      record.assign(mPending, static_cast<size_t>(row.offset - mFlushedSize), static_cast<size_t>(row.size));
+      return;
+    }
+    record.resize(static_cast<size_t>(row.size));
+    mFile.clear();
+    mFile.seekg(row.offset);
+    if (!mFile.read(&record[0], row.size)) {
+      throw FileIOError("Failed to read storage table row from " + mPath);
+    }
+  }
+
+  std::vector<std::string> ReadRow(const Row& row) {
+    std::string record;
+    ReadRecord(row, record);
+    size_t position = kRecordHeaderSize + kTimestampSize;
+    std::vector<std::string> values;
+    if (record.size() < position || !ReadStrings(record, position, values) || values.size() != mColumns.size()) {
+      throw FileIOError("Damaged storage table row in " + mPath);
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (mIsEncrypted[i]) {
+        values[i] = mSettings.unprotectColumn(values[i]);
+      }
+    }
+    return values;
+  }
+
+  int64_t Append(const std::string& record) {
+    int64_t offset = mFileSize;
+    mPending.append(record);
+    mFileSize += static_cast<int64_t>(record.size());
+    if (mTransactionDepth == 0 || mPending.size() >= kMaxPendingBytes) {
+      FlushPending();
+    }
+    return offset;
+  }
+
+  void FlushPending() {
+    if (mPending.empty()) {
+      return;
+    }
+    mFile.clear();
+    mFile.seekp(mFlushedSize);
+    if (!mFile.write(mPending.data(), static_cast<std::streamsize>(mPending.size())) || !mFile.flush()) {
+      throw FileIOError("Failed to write storage table " + mPath);
+    }
+    mFlushedSize = mFileSize;
+    mPending.clear();
+  }
+
+  std::string EncodeSchema() const {
+    std::string payload;
+    AppendStrings(payload, mColumns);
+    AppendStrings(payload, mKeyColumns);
+    std::vector<std::string> encrypted;
+    for (size_t i = 0; i < mColumns.size(); ++i) {
+      if (mIsEncrypted[i]) {
+        encrypted.push_back(mColumns[i]);
+      }
+    }
+    AppendStrings(payload, encrypted);
+    return EncodeRecord(Schema, 0, payload);
+  }
+
+  void Reset() {
+    mRows.clear();
+    mRowsByKey.clear();
+    mKeyIndexes.assign(mKeyPositions.size(), std::unordered_map<std::string, std::unordered_set<uint64_t>>());
+    mLru.clear();
+    mNextRowId = 1;
+    mLiveBytes = 0;
+  }
+
+  void Load() {
+    Reset();
+    if (mFile.is_open()) {
+      mFile.close();
+    }
+    std::string schema = EncodeSchema();
+    std::ifstream in(mPath, std::ios::binary);
+    std::string prefix(sizeof(kMagic) + schema.size(), '\0');
+    if (!in || !in.read(&prefix[0], static_cast<std::streamsize>(prefix.size())) ||
+        prefix.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0 ||
+        prefix.compare(sizeof(kMagic), schema.size(), schema) != 0) {
+      in.close();
+      Rewrite();
+      return;
+    }
+    // Replay the log; a record torn by a crash ends it
+    in.seekg(0, std::ios::end);
+    int64_t fileSize = static_cast<int64_t>(in.tellg());
+    int64_t position = static_cast<int64_t>(prefix.size());
+    in.seekg(position);
+    bool isDamaged = false;
+    char header[kRecordHeaderSize];
+    std::string payload;
+    while (in.read(header, sizeof(header))) {
+      uint64_t payloadSize = ReadUint(header, 4);
+      // The header is not verified yet, a torn size must not drive the allocation
+      if (payloadSize > static_cast<uint64_t>(fileSize - position - static_cast<int64_t>(kRecordHeaderSize))) {
+        isDamaged = true;
+        break;
+      }
+      payload.resize(static_cast<size_t>(payloadSize));
+      if (payloadSize > 0 && !in.read(&payload[0], static_cast<std::streamsize>(payloadSize))) {
+        isDamaged = true;
+        break;
+      }
+      uint32_t checksum = Checksum(header + 8, kRecordHeaderSize - 8);
+      for (char c : payload) {
+        checksum = (checksum ^ static_cast<uint8_t>(c)) * 16777619u;
+      }
+      if (checksum != ReadUint(header + 4, 4)) {
+        isDamaged = true;
+        break;
+      }
+      uint8_t type = static_cast<uint8_t>(header[8]);
+      uint64_t rowId = ReadUint(header + 9, 8);
+      if (type == Put && !Replay(rowId, position, payload)) {
+        isDamaged = true;
+        break;
+      }
+      if (type == Remove) {
+        auto existing = mRows.find(rowId);
+        if (existing != mRows.end()) {
+          mLiveBytes -= existing->second.size;
+          Unindex(rowId, existing->second);
+          mRows.erase(existing);
+        }
+      }
+      mNextRowId = rowId >= mNextRowId ? rowId + 1 : mNextRowId;
+      position += static_cast<int64_t>(kRecordHeaderSize + payloadSize);
+    }
+    isDamaged = isDamaged || in.gcount() != 0;
+    in.close();
+    OpenFile(position);
+    if (isDamaged) {
+      Rewrite();
+    }
+  }
+
+  // Indexes a row version read from the log, returns false if it is damaged
+  bool Replay(uint64_t rowId, int64_t offset, const std::string& payload) {
+    size_t payloadPosition = kTimestampSize;
+    std::vector<std::string> values;
+    if (payload.size() < kTimestampSize || !ReadStrings(payload, payloadPosition, values) ||
+        values.size() != mColumns.size()) {
+      return false;
+    }
+    Row row;
+    row.writtenAt = static_cast<int64_t>(ReadUint(payload.data(), kTimestampSize));
+    row.offset = offset;
+    row.size = static_cast<int64_t>(kRecordHeaderSize + payload.size());
+    row.keyValues = GetKeyValues(values);
+    for (size_t i = 0; i < mKeyPositions.size(); ++i) {
+      if (mIsEncrypted[mKeyPositions[i]]) {
+        row.keyValues[i] = mSettings.unprotectColumn(row.keyValues[i]);
+      }
+    }
+    auto existing = mRows.find(rowId);
+    if (existing != mRows.end()) {
+      mLiveBytes -= existing->second.size;
+      Unindex(rowId, existing->second);
+    }
+    mLiveBytes += row.size;
+    Index(rowId, row);
+    mRows[rowId] = std::move(row);
+    return true;
+  }
+
+  void OpenFile(int64_t size) {
+    mFile.open(mPath, std::ios::in | std::ios::out | std::ios::binary);
+    if (!mFile) {
+      throw FileIOError("Failed to open storage table " + mPath);
+    }
+    mFileSize = size;
+    mFlushedSize = size;
+    mPending.clear();
+  }
+
+  // Writes a new file holding only the schema and the live rows, then renames it over the table file
+  void Rewrite() {
+    std::string temporaryPath = mPath + ".tmp";
+    std::unordered_map<uint64_t, int64_t> offsets;
+    int64_t size = 0;
+    {
+      std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+      std::string schema = EncodeSchema();
+      out.write(kMagic, sizeof(kMagic));
+      out.write(schema.data(), static_cast<std::streamsize>(schema.size()));
+      size = static_cast<int64_t>(sizeof(kMagic) + schema.size());
+      std::string record;
+      for (const auto& row : mRows) {
+        ReadRecord(row.second, record);
+        offsets[row.first] = size;
+        out.write(record.data(), static_cast<std::streamsize>(record.size()));
+        size += row.second.size;
+      }
+      if (!out.flush()) {
+        throw FileIOError("Failed to write storage table " + temporaryPath);
+      }
+    }
+    if (mFile.is_open()) {
+      mFile.close();
+    }
+    if (!ReplaceTableFile(temporaryPath, mPath)) {
+      throw FileIOError("Failed to replace storage table " + mPath);
+    }
+    OpenFile(size);
+    for (auto& row : mRows) {
+      row.second.offset = offsets[row.first];
+    }
+  }
+
+  // Evicts the least recently used rows while the live rows exceed maxTableBytes
+  void EvictIfNeeded() {
+    while (mSettings.maxTableBytes > 0 && mLiveBytes > mSettings.maxTableBytes && !mLru.empty()) {
+      RemoveRow(mLru.back());
+      ++mCounters->evictedCount;
+    }
+  }
+
+  void EvictAndCompactIfNeeded() {
+    if (mTransactionDepth > 0) {
+      return;
+    }
+    EvictIfNeeded();
+    int64_t garbage = mFileSize - mLiveBytes;
+    if (garbage > mSettings.compactionMinBytes && garbage > mLiveBytes) {
+      Rewrite();
+      ++mCounters->compactionCount;
+    }
+  }
+
+  const std::string mPath;
+  const IndexedStorageDelegateSettings mSettings;
+  const int64_t mRowTtl; // seconds
+  const std::shared_ptr<Counters> mCounters;
+  mutable std::mutex mMutex;
+  std::fstream mFile;
+  int64_t mFileSize = 0;
+  int64_t mFlushedSize = 0;
+  std::string mPending;
+  int mTransactionDepth = 0;
+  int64_t mLiveBytes = 0;
+  uint64_t mNextRowId = 1;
+  std::vector<std::string> mColumns;
+  std::vector<std::string> mKeyColumns;
+  std::unordered_map<std::string, size_t> mColumnPositions;
+  std::vector<size_t> mKeyPositions;
+  std::vector<bool> mIsEncrypted;
+  std::unordered_map<uint64_t, Row> mRows;
+  std::unordered_map<std::string, uint64_t> mRowsByKey;
+  std::vector<std::unordered_map<std::string, std::unordered_set<uint64_t>>> mKeyIndexes;
+  std::list<uint64_t> mLru; // most recently used first
+};
+
+class Cursor : public StorageTableCursor {
+public:
+  Cursor(const std::shared_ptr<Table>& table, const StorageTableQuery& query) : mTable(table) {
+    mState.query = query;
+    mState.skip = query.offset;
+    mState.remaining = query.limit;
+    std::lock_guard<std::mutex> lock(mTable->mMutex);
+    mState.candidates = mTable->GetCandidates(mState.query.queryColumns, mState.query.queryValues, mState.conditions);
+  }
+
+  bool Next() override { return mTable->Next(mState); }
+
+  size_t GetColumnCount() const override { return mState.values.size(); }
+
+  StorageValueView GetValue(size_t column) const override { return StorageValueView(mState.values.at(column)); }
+
+private:
+  std::shared_ptr<Table> mTable;
+  Table::CursorState mState;
+};
+
+inline std::unique_ptr<StorageTableCursor> Table::OpenCursor(const StorageTableQuery& query) {
+  return std::unique_ptr<StorageTableCursor>(new Cursor(shared_from_this(), query));
+}
+
+// Runs Table::Maintain every interval until the table is destroyed
+inline void ScheduleMaintenance(
+    const std::weak_ptr<Table>& weakTable,
+    const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+    std::chrono::seconds interval) {
+  static std::atomic<uint64_t> sTaskCounter(0);
+  std::string taskId = "mip-storage-maintenance-" + std::to_string(++sTaskCounter);
+  std::weak_ptr<TaskDispatcherDelegate> weakDispatcher = taskDispatcher;
+  taskDispatcher->DispatchTask(taskId, [weakTable, weakDispatcher, interval]() {
+    std::shared_ptr<Table> table = weakTable.lock();
+    std::shared_ptr<TaskDispatcherDelegate> dispatcher = weakDispatcher.lock();
+    if (!table || !dispatcher) {
+      return;
+    }
+    try {
+      table->Maintain();
+    } catch (...) {
+    }
+    ScheduleMaintenance(weakTable, dispatcher, interval);
+  }, (std::max)(static_cast<int64_t>(interval.count()), static_cast<int64_t>(1)));
+}
+
+} // namespace indexedstorage
+/** @endcond */
+
+/**
+ * @brief StorageDelegate keeping each table in one file on disk, with hash indexes on its key columns in memory
+ * 
+ * @note Pass an instance to MipConfiguration::SetStorageDelegate. The complexity of the StorageTable operations, for
+ *       a table of n rows:
+ *       - Insert: O(1) amortized. A row whose key columns equal those of an existing row replaces it.
+ *       - Find, Update and Delete given every key column: O(1), plus one read per returned row.
+ *       - Find, Update and Delete given some key columns: O(m), where m is the number of rows sharing the rarest of
+ *         the given key values. Other query columns are checked on those rows.
+ *       - Find, Update and Delete given no key column, and List: O(n) reads.
+ *       Tables are also a StorageTableCursorSource: OpenStorageTableCursor reads one row per step instead of copying
+ *       the matching rows into memory, holding only the 8-byte IDs of the candidate rows.
+ *       Memory holds only the key values and file offset of each row, so tables of millions of rows stay cheap to
+ *       query. Writes append to the file, which is compacted once superseded records outgrow live ones, and a record
+ *       torn by a crash is dropped on the next load. Each write is flushed on its own, except within
+ *       TransactionalStorageTable::BeginTransaction and CommitTransaction, or InsertBatch and UpdateBatch, whose
+ *       writes are flushed together at commit. Tables are TransactionalStorageTable instances; use InsertRows,
+ *       UpdateRows or StorageTableTransaction on them.
+ *       Rows older than IndexedStorageDelegateSettings::rowTtl, or the lifetime tableRowTtls sets for their table, are
+ *       no longer returned, and are removed by maintenance. Writes evict the least recently read or written rows of a
+ *       table whose live rows exceed maxTableBytes. Maintenance runs every maintenanceInterval on taskDispatcher, or
+ *       when Maintain is called. The directory passed as the storage path must exist. Tables are not shared between
+ *       processes.
+ */
+class IndexedStorageDelegate : public StorageDelegate {
+public:
+  /**
+   * @brief IndexedStorageDelegate constructor
+   * 
+   * @param settings Column encryption, compaction, expiry and eviction settings
+   */
+  explicit IndexedStorageDelegate(const IndexedStorageDelegateSettings& settings = IndexedStorageDelegateSettings())
+      : mSettings(settings),
+        mCounters(std::make_shared<indexedstorage::Counters>()) {}
+
+  /**
+   * @brief Open or create the file of a table, recreating it if its schema changed
+   * 
+   * @param path Directory holding the table files
+   * @param mipComponent Component owning the table
+   * @param tableName Name of the table
+   * @param allColumns All columns of the table
+   * @param encryptedColumns Columns encrypted with IndexedStorageDelegateSettings::protectColumn
+   * @param keyColumns Columns identifying unique rows, which are indexed
+   * 
+   * @return The table, or a mip::FileIOError, mip::BadInputError or mip::NotSupportedError
+   */
+  StorageTableResult CreateStorageTable(
+      const std::string& path,
+      const MipComponent mipComponent,
+      const std::string& tableName,
+      const std::vector<std::string>& allColumns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) const override {
+    try {
+      std::string filePath = GetFilePath(path, mipComponent, tableName);
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::shared_ptr<indexedstorage::Table>& table = mTables[filePath];
+      if (!table) {
+        auto rowTtl = mSettings.tableRowTtls.find(tableName);
+        table = std::make_shared<indexedstorage::Table>(filePath, mSettings,
+            rowTtl != mSettings.tableRowTtls.end() ? rowTtl->second : mSettings.rowTtl, mCounters);
+        if (mSettings.taskDispatcher) {
+          indexedstorage::ScheduleMaintenance(table, mSettings.taskDispatcher, mSettings.maintenanceInterval);
+        }
+      }
+      table->Open(allColumns, encryptedColumns, keyColumns);
+      return StorageTableResult(table);
+    } catch (...) {
+      return StorageTableResult(std::current_exception());
+    }
+  }
+
+  /**
+   * @brief Gets settings used by this delegate: local storage, no in-memory storage
+   */
+  StorageSettings GetSettings() const override { return StorageSettings(false, false); }
+
+  /**
+   * @brief Remove expired rows, evict rows beyond the size limit and compact the files of every table
+   * 
+   * @note Runs periodically on IndexedStorageDelegateSettings::taskDispatcher if set
+   */
+  void Maintain() const {
+    for (const auto& table : GetTables()) {
+      table->Maintain();
+    }
+  }
+
+  /**
+   * @brief Get the size of the tables and how many rows expired and were evicted
+   */
+  IndexedStorageMetrics GetMetrics() const {
+    IndexedStorageMetrics metrics;
+    for (const auto& table : GetTables()) {
+      ++metrics.tableCount;
+      metrics.rowCount += table->GetRowCount();
+      metrics.fileBytes += table->GetFileSize();
+      metrics.liveBytes += table->GetLiveBytes();
+    }
+    metrics.expiredCount = mCounters->expiredCount;
+    metrics.evictedCount = mCounters->evictedCount;
+    metrics.compactionCount = mCounters->compactionCount;
+    return metrics;
+  }
+
+  /**
+   * @brief Get the size of each table
+   */
+  std::vector<IndexedStorageTableMetrics> GetTableMetrics() const {
+    std::vector<std::pair<std::string, std::shared_ptr<indexedstorage::Table>>> tables;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      tables.assign(mTables.begin(), mTables.end());
+    }
+    std::vector<IndexedStorageTableMetrics> metrics;
+    for (const auto& table : tables) {
+      IndexedStorageTableMetrics tableMetrics;
+      tableMetrics.path = table.first;
+      tableMetrics.rowCount = table.second->GetRowCount();
+      tableMetrics.fileBytes = table.second->GetFileSize();
+      tableMetrics.liveBytes = table.second->GetLiveBytes();
+      metrics.push_back(tableMetrics);
+    }
+    return metrics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static std::string GetFilePath(const std::string& path, MipComponent mipComponent, const std::string& tableName) {
+    std::string name = "mip_" + std::to_string(static_cast<unsigned int>(mipComponent)) + "_";
+    for (char c : tableName) {
+      bool isSafe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+      name.push_back(isSafe ? c : '_');
+    }
+    std::string directory = path;
+    if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+      directory.push_back('/');
+    }
+    return directory + name + ".tbl";
+  }
+
+  std::vector<std::shared_ptr<indexedstorage::Table>> GetTables() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::shared_ptr<indexedstorage::Table>> tables;
+    for (const auto& table : mTables) {
+      tables.push_back(table.second);
+    }
+    return tables;
+  }
+
+  const IndexedStorageDelegateSettings mSettings;
+  const std::shared_ptr<indexedstorage::Counters> mCounters;
+  mutable std::mutex mMutex;
+  mutable std::map<std::string, std::shared_ptr<indexedstorage::Table>> mTables;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_INDEXED_STORAGE_DELEGATE_H_
@@ -0,0 +1,618 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines InflateStream, which decompresses gzip, zlib and raw deflate data while it is read
+ * 
+ * @file inflate_stream.h
+ */
+
+#ifndef API_MIP_INFLATE_STREAM_H_
+#define API_MIP_INFLATE_STREAM_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Container of deflate data
+ */
+enum class InflateFormat : unsigned int {
+  Auto = 0, /**< Detect gzip or zlib from the first two bytes, raw deflate otherwise */
+  Gzip = 1, /**< RFC 1952, as sent with "Content-Encoding: gzip" */
+  Zlib = 2, /**< RFC 1950, as sent with "Content-Encoding: deflate" */
+  Raw = 3,  /**< RFC 1951 without header or trailer */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace inflate {
+
+// Canonical Huffman code with a 9-bit lookup table; longer codes are decoded bit by bit
+struct HuffmanCode {
+  static const int kFastBits = 9;
+  std::array<uint16_t, 16> counts;
+  std::vector<uint16_t> symbols;
+  std::array<uint16_t, 1 << kFastBits> fast; // (symbol << 4) | length, 0 when the code is longer than kFastBits
+
+  void Build(const uint8_t* lengths, size_t count) {
+    counts.fill(0);
+    fast.fill(0);
+    for (size_t i = 0; i < count; ++i) {
+      counts[lengths[i]]++;
+    }
+    counts[0] = 0;
+    int left = 1;
+    for (int length = 1; length < 16; ++length) {
+      left = (left << 1) - counts[length];
+      if (left < 0) {
+        throw BadInputError("Invalid deflate data: over-subscribed Huffman code");
+      }
+    }
+    std::array<uint16_t, 16> offsets;
+    offsets[1] = 0;
+    for (int length = 1; length < 15; ++length) {
+      offsets[length + 1] = static_cast<uint16_t>(offsets[length] + counts[length]);
+    }
+    symbols.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+      if (lengths[i] != 0) {
+        symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+      }
+    }
+    uint32_t code = 0;
+    size_t index = 0;
+    for (int length = 1; length <= kFastBits; ++length) {
+      for (uint16_t i = 0; i < counts[length]; ++i, ++code, ++index) {
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < length; ++bit) {
+          reversed |= ((code >> bit) & 1u) << (length - 1 - bit);
+        }
+        for (uint32_t fill = reversed; fill < fast.size(); fill += 1u << length) {
+          fast[fill] = static_cast<uint16_t>((symbols[index] << 4) | length);
+        }
+      }
+      code <<= 1;
+    }
+  }
+};
+
+inline const std::array<uint32_t, 256>& GetCrcTable() {
+  static const std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> crcTable;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc & 1u) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+      }
+      crcTable[i] = crc;
+    }
+    return crcTable;
+  }();
+  return table;
+}
+
+// Read-only view of a caller-owned buffer, used as the source when inflating a payload already in memory
+class BufferSource : public Stream {
+public:
+  BufferSource(const uint8_t* data, size_t size) : mData(data), mSize(size) { }
+
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    size_t count = static_cast<size_t>((std::min)(static_cast<uint64_t>(bufferLength),
+                                                  static_cast<uint64_t>(mSize - mPosition)));
+    if (count > 0) {
+      std::memcpy(buffer, mData + mPosition, count);
+      mPosition += count;
+    }
+    return static_cast<int64_t>(count);
+  }
+  int64_t Write(const uint8_t* /*buffer*/, int64_t /*bufferLength*/) override {
+    throw NotSupportedError("BufferSource is read-only");
+  }
+  bool Flush() override { return true; }
+  void Seek(int64_t position) override {
+    if (position < 0 || static_cast<uint64_t>(position) > mSize) {
+      throw BadInputError("Seek position is outside the buffer");
+    }
+    mPosition = static_cast<size_t>(position);
+  }
+  bool CanRead() const override { return true; }
+  bool CanWrite() const override { return false; }
+  int64_t Position() override { return static_cast<int64_t>(mPosition); }
+  int64_t Size() override { return static_cast<int64_t>(mSize); }
+  void Size(int64_t /*value*/) override { throw NotSupportedError("BufferSource size cannot be changed"); }
+
+private:
+  const uint8_t* mData;
+  size_t mSize;
+  size_t mPosition = 0;
+};
+
+} // namespace inflate
+/** @endcond */
+
+/**
+ * @brief Read-only Stream that inflates deflate-compressed data from another stream as it is read
+ * 
+ * @note Input is pulled from the source in 16 KB reads and output is decoded into a 64 KB window, so memory use does
+ *       not depend on the payload size and a parser reading from this stream never sees the compressed or the whole
+ *       decompressed payload in memory. gzip CRC-32/size and zlib Adler-32 trailers are verified. Corrupt data, a
+ *       truncated source or output beyond maxOutputSize throws mip::BadInputError from Read.
+ */
+class InflateStream : public Stream {
+public:
+  /**
+   * @brief InflateStream constructor
+   * 
+   * @param source Stream positioned at the start of the compressed data
+   * @param format Container of the compressed data
+   * @param maxOutputSize Largest decompressed size accepted, or 0 for no limit
+   */
+  explicit InflateStream(
+      const std::shared_ptr<Stream>& source,
+      InflateFormat format = InflateFormat::Auto,
+      int64_t maxOutputSize = 0)
+      : mSource(source),
+        mFormat(format),
+        mMaxOutputSize(maxOutputSize),
+        mInput(16 * 1024),
+        mWindow(kWindowSize) {
+    if (!mSource) {
+      throw BadInputError("InflateStream requires a source stream");
+    }
+  }
+
+  /**
+   * @brief Read decompressed bytes into a buffer
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read, 0 once the compressed data ended.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesRead = 0;
+    while (bytesRead < bufferLength) {
+      if (mWritePosition == mReadPosition) {
+        if (mPhase == Phase::Done) {
+          break;
+        }
+        Decode();
+        continue;
+      }
+      size_t offset = static_cast<size_t>(mReadPosition & kWindowMask);
+      size_t available = static_cast<size_t>((std::min)(mWritePosition - mReadPosition,
+                                                        static_cast<uint64_t>(kWindowSize - offset)));
+      size_t count = static_cast<size_t>((std::min)(static_cast<int64_t>(available), bufferLength - bytesRead));
+      std::memcpy(buffer + bytesRead, mWindow.data() + offset, count);
+      mReadPosition += count;
+      bytesRead += static_cast<int64_t>(count);
+    }
+    return bytesRead;
+  }
+
+  /**
+   * @brief The stream is read-only, a mip::NotSupportedError is thrown.
+   */
+  int64_t Write(const uint8_t* /*buffer*/, int64_t /*bufferLength*/) override {
+    throw NotSupportedError("InflateStream is read-only");
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true, there is nothing to flush.
+   */
+  bool Flush() override { return true; }
+
+  /**
+   * @brief Decompression only moves forward, seeking anywhere but the current position throws mip::NotSupportedError.
+   * 
+   * @param position to seek into the stream.
+   */
+  void Seek(int64_t position) override {
+    if (position != Position()) {
+      throw NotSupportedError("InflateStream cannot seek");
+    }
+  }
+
+  /** @brief A check if stream can be read from. */
+  bool CanRead() const override { return true; }
+
+  /** @brief A check if stream can be written to. */
+  bool CanWrite() const override { return false; }
+
+  /** @brief Get the number of decompressed bytes read so far. */
+  int64_t Position() override { return static_cast<int64_t>(mReadPosition); }
+
+  /** @brief Get the number of bytes decompressed so far. The final size is only known once Read returned 0. */
+  int64_t Size() override { return static_cast<int64_t>(mWritePosition); }
+
+  /**
+   * @brief The size is determined by the compressed data, a mip::NotSupportedError is thrown.
+   */
+  void Size(int64_t /*value*/) override { throw NotSupportedError("InflateStream size cannot be changed"); }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~InflateStream() { }
+
+private:
+  enum class Phase { Header, BlockHeader, Stored, Huffman, Trailer, Done };
+
+  static const size_t kWindowSize = 64 * 1024;
+  static const uint64_t kWindowMask = kWindowSize - 1;
+  static const uint64_t kMaxUnread = 32 * 1024 - 258;
+
+  // Decodes until the unread output fills half the window, keeping the other half for back-references
+  void Decode() {
+    while (mPhase != Phase::Done && mWritePosition - mReadPosition < kMaxUnread) {
+      switch (mPhase) {
+        case Phase::Header:
+          ReadHeader();
+          break;
+        case Phase::BlockHeader:
+          ReadBlockHeader();
+          break;
+        case Phase::Stored:
+          if (mStoredRemaining == 0) {
+            mPhase = mIsFinalBlock ? Phase::Trailer : Phase::BlockHeader;
+          } else {
+            Put(static_cast<uint8_t>(GetBits(8)));
+            mStoredRemaining--;
+          }
+          break;
+        case Phase::Huffman:
+          DecodeSymbol();
+          break;
+        case Phase::Trailer:
+          ReadTrailer();
+          break;
+        case Phase::Done:
+          break;
+      }
+    }
+  }
+
+  void ReadHeader() {
+    InflateFormat format = mFormat;
+    if (format == InflateFormat::Auto) {
+      uint32_t firstBytes = PeekBits(16);
+      uint32_t cmf = firstBytes & 0xff;
+      uint32_t flg = firstBytes >> 8;
+      if (mBitCount >= 16 && cmf == 0x1f && flg == 0x8b) {
+        format = InflateFormat::Gzip;
+      } else if (mBitCount >= 16 && (cmf & 0x0f) == 8 && (cmf >> 4) <= 7 && (cmf * 256 + flg) % 31 == 0) {
+        format = InflateFormat::Zlib;
+      } else {
+        format = InflateFormat::Raw;
+      }
+    }
+    mFormat = format;
+    if (format == InflateFormat::Gzip) {
+      if (GetBits(8) != 0x1f || GetBits(8) != 0x8b || GetBits(8) != 8) {
+        throw BadInputError("Invalid gzip header");
+      }
+      uint32_t flags = GetBits(8);
+      GetBits(16);
+      GetBits(16);
+      GetBits(16); // modification time, extra flags and OS
+      if (flags & 0x04) {
+        for (uint32_t extraLength = GetBits(16); extraLength > 0; --extraLength) {
+          GetBits(8);
+        }
+      }
+      for (uint32_t field = 0x08; field <= 0x10; field <<= 1) {
+        if (flags & field) {
+          while (GetBits(8) != 0) {
+          }
+        }
+      }
+      if (flags & 0x02) {
+        GetBits(16);
+      }
+    } else if (format == InflateFormat::Zlib) {
+      uint32_t cmf = GetBits(8);
+      uint32_t flg = GetBits(8);
+      if ((cmf & 0x0f) != 8 || (cmf * 256 + flg) % 31 != 0) {
+        throw BadInputError("Invalid zlib header");
+      }
+      if (flg & 0x20) {
+        throw NotSupportedError("zlib streams with a preset dictionary are not supported");
+      }
+    }
+    mPhase = Phase::BlockHeader;
+  }
+
+  void ReadBlockHeader() {
+    mIsFinalBlock = GetBits(1) == 1;
+    uint32_t type = GetBits(2);
+    if (type == 0) {
+      GetBits(mBitCount % 8);
+      uint32_t length = GetBits(16);
+      if ((GetBits(16) ^ 0xffff) != length) {
+        throw BadInputError("Invalid deflate data: stored block length mismatch");
+      }
+      mStoredRemaining = length;
+      mPhase = Phase::Stored;
+    } else if (type == 1) {
+      uint8_t lengths[288 + 30];
+      std::memset(lengths, 8, 144);
+      std::memset(lengths + 144, 9, 112);
+      std::memset(lengths + 256, 7, 24);
+      std::memset(lengths + 280, 8, 8);
+      std::memset(lengths + 288, 5, 30);
+      mLiterals.Build(lengths, 288);
+      mDistances.Build(lengths + 288, 30);
+      mPhase = Phase::Huffman;
+    } else if (type == 2) {
+      ReadDynamicCodes();
+      mPhase = Phase::Huffman;
+    } else {
+      throw BadInputError("Invalid deflate data: reserved block type");
+    }
+  }
+
+  void ReadDynamicCodes() {
+    static const uint8_t kOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint32_t literalCount = GetBits(5) + 257;
+    uint32_t distanceCount = GetBits(5) + 1;
+    uint32_t codeLengthCount = GetBits(4) + 4;
+    if (literalCount > 286 || distanceCount > 30) {
+      throw BadInputError("Invalid deflate data: too many codes");
+    }
+    uint8_t lengths[286 + 30] = {};
+    for (uint32_t i = 0; i < codeLengthCount; ++i) {
+      lengths[kOrder[i]] = static_cast<uint8_t>(GetBits(3));
+    }
+    inflate::HuffmanCode codeLengths;
+    codeLengths.Build(lengths, 19);
+    std::memset(lengths, 0, 19);
+    uint32_t index = 0;
+    while (index < literalCount + distanceCount) {
+      int symbol = DecodeWith(codeLengths);
+      if (symbol < 16) {
+        lengths[index++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+      uint8_t repeated = 0;
+      uint32_t repeat = 0;
+      if (symbol == 16) {
+        if (index == 0) {
+          throw BadInputError("Invalid deflate data: repeat without a previous length");
+        }
+        repeated = lengths[index - 1];
+        repeat = 3 + GetBits(2);
+      } else if (symbol == 17) {
+        repeat = 3 + GetBits(3);
+      } else {
+        repeat = 11 + GetBits(7);
+      }
+      if (index + repeat > literalCount + distanceCount) {
+        throw BadInputError("Invalid deflate data: too many code lengths");
+      }
+      std::memset(lengths + index, repeated, repeat);
+      index += repeat;
+    }
+    if (lengths[256] == 0) {
+      throw BadInputError("Invalid deflate data: missing end-of-block code");
+    }
+    mLiterals.Build(lengths, literalCount);
+    mDistances.Build(lengths + literalCount, distanceCount);
+  }
+
+  void DecodeSymbol() {
+    static const uint16_t kLengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227,
+        258};
+    static const uint8_t kLengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t kDistanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+        6145, 8193, 12289, 16385, 24577};
+    static const uint8_t kDistanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int symbol = DecodeWith(mLiterals);
+    if (symbol < 256) {
+      Put(static_cast<uint8_t>(symbol));
+      return;
+    }
+    if (symbol == 256) {
+      mPhase = mIsFinalBlock ? Phase::Trailer : Phase::BlockHeader;
+      return;
+    }
+    symbol -= 257;
+    if (symbol >= 29) {
+      throw BadInputError("Invalid deflate data: bad length code");
+    }
+    uint32_t length = kLengthBase[symbol] + GetBits(kLengthExtra[symbol]);
+    int distanceSymbol = DecodeWith(mDistances);
+    if (distanceSymbol >= 30) {
+      throw BadInputError("Invalid deflate data: bad distance code");
+    }
+    uint32_t distance = kDistanceBase[distanceSymbol] + GetBits(kDistanceExtra[distanceSymbol]);
+    if (distance > mWritePosition) {
+      throw BadInputError("Invalid deflate data: distance beyond the start of the output");
+    }
+    for (uint32_t i = 0; i < length; ++i) {
+      Put(mWindow[static_cast<size_t>((mWritePosition - distance) & kWindowMask)]);
+    }
+  }
+
+  void ReadTrailer() {
+    GetBits(mBitCount % 8);
+    if (mFormat == InflateFormat::Gzip) {
+      uint32_t crc = GetBits(16);
+      crc |= GetBits(16) << 16;
+      uint32_t size = GetBits(16);
+      size |= GetBits(16) << 16;
+      if (crc != (mCrc ^ 0xffffffffu) || size != static_cast<uint32_t>(mWritePosition)) {
+        throw BadInputError("Invalid gzip data: checksum mismatch");
+      }
+    } else if (mFormat == InflateFormat::Zlib) {
+      uint32_t adler = 0;
+      for (int i = 0; i < 4; ++i) {
+        adler = (adler << 8) | GetBits(8);
+      }
+      if (adler != ((mAdlerHigh << 16) | mAdlerLow)) {
+        throw BadInputError("Invalid zlib data: checksum mismatch");
+      }
+    }
+    mPhase = Phase::Done;
+  }
+
+  void Put(uint8_t value) {
+    if (mMaxOutputSize > 0 && mWritePosition >= static_cast<uint64_t>(mMaxOutputSize)) {
+      throw BadInputError("Decompressed data exceeds the size limit");
+    }
+    mWindow[static_cast<size_t>(mWritePosition & kWindowMask)] = value;
+    mWritePosition++;
+    if (mFormat == InflateFormat::Gzip) {
+      mCrc = inflate::GetCrcTable()[(mCrc ^ value) & 0xff] ^ (mCrc >> 8);
+    } else if (mFormat == InflateFormat::Zlib) {
+      mAdlerLow += value;
+      mAdlerLow -= mAdlerLow >= 65521 ? 65521 : 0;
+      mAdlerHigh += mAdlerLow;
+      mAdlerHigh -= mAdlerHigh >= 65521 ? 65521 : 0;
+    }
+  }
+
+  int DecodeWith(const inflate::HuffmanCode& code) {
+    uint32_t bits = PeekBits(inflate::HuffmanCode::kFastBits);
+    uint16_t entry = code.fast[bits & ((1u << inflate::HuffmanCode::kFastBits) - 1)];
+    if (entry != 0 && static_cast<int>(entry & 0x0f) <= mBitCount) {
+      DropBits(entry & 0x0f);
+      return entry >> 4;
+    }
+    int first = 0;
+    int index = 0;
+    int value = 0;
+    for (int length = 1; length < 16; ++length) {
+      value |= static_cast<int>(GetBits(1));
+      int count = code.counts[length];
+      if (value - count < first) {
+        return code.symbols[index + (value - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      value <<= 1;
+    }
+    throw BadInputError("Invalid deflate data: bad Huffman code");
+  }
+
+  // Fills the bit buffer with up to @p count bits; fewer are available only at the end of the source
+  uint32_t PeekBits(int count) {
+    while (mBitCount < count) {
+      if (mInputPosition == mInputEnd) {
+        int64_t bytesRead = mSource->Read(mInput.data(), static_cast<int64_t>(mInput.size()));
+        if (bytesRead <= 0) {
+          break;
+        }
+        mInputPosition = 0;
+        mInputEnd = static_cast<size_t>(bytesRead);
+      }
+      mBitBuffer |= static_cast<uint64_t>(mInput[mInputPosition++]) << mBitCount;
+      mBitCount += 8;
+    }
+    return static_cast<uint32_t>(mBitBuffer & ((static_cast<uint64_t>(1) << count) - 1));
+  }
+
+  void DropBits(int count) {
+    mBitBuffer >>= count;
+    mBitCount -= count;
+  }
+
+  uint32_t GetBits(int count) {
+    if (count == 0) {
+      return 0;
+    }
+    uint32_t bits = PeekBits(count);
+    if (mBitCount < count) {
+      throw BadInputError("Compressed data is truncated");
+    }
+    DropBits(count);
+    return bits;
+  }
+
+  std::shared_ptr<Stream> mSource;
+  InflateFormat mFormat;
+  int64_t mMaxOutputSize;
+  std::vector<uint8_t> mInput;
+  size_t mInputPosition = 0;
+  size_t mInputEnd = 0;
+  uint64_t mBitBuffer = 0;
+  int mBitCount = 0;
+  Phase mPhase = Phase::Header;
+  bool mIsFinalBlock = false;
+  uint32_t mStoredRemaining = 0;
+  inflate::HuffmanCode mLiterals;
+  inflate::HuffmanCode mDistances;
+  std::vector<uint8_t> mWindow;
+  uint64_t mWritePosition = 0;
+  uint64_t mReadPosition = 0;
+  uint32_t mCrc = 0xffffffffu;
+  uint32_t mAdlerLow = 1;
+  uint32_t mAdlerHigh = 0;
+  /** @endcond */
+}; // class InflateStream
+
+/** @cond DOXYGEN_HIDE */
+namespace inflate {
+
+// Inflates a payload already in memory; output beyond maxOutputSize (which may be 0) throws mip::BadInputError
+inline std::vector<uint8_t> InflateBuffer(
+    const uint8_t* data,
+    size_t size,
+    InflateFormat format,
+    size_t maxOutputSize) {
+  InflateStream stream(std::make_shared<BufferSource>(data, size), format, static_cast<int64_t>(maxOutputSize) + 1);
+  std::vector<uint8_t> output;
+  for (;;) {
+    size_t offset = output.size();
+    output.resize(offset + 64 * 1024);
+    int64_t bytesRead = stream.Read(output.data() + offset, static_cast<int64_t>(output.size() - offset));
+    output.resize(offset + static_cast<size_t>(bytesRead));
+    if (output.size() > maxOutputSize) {
+      throw BadInputError("Decompressed data exceeds the size limit");
+    }
+    if (bytesRead == 0) {
+      return output;
+    }
+  }
+}
+
+} // namespace inflate
+/** @endcond */
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_INFLATE_STREAM_H_
@@ -0,0 +1,573 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a streaming (SAX) JSON reader that reports values to a handler instead of building a document
+ * 
+ * @file json_reader.h
+ */
+
+#ifndef API_MIP_JSON_READER_H_
+#define API_MIP_JSON_READER_H_
+
+#include <clocale>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/json_delegate.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Receives the values of a JSON text in document order
+ * 
+ * @note Every method returns true to continue or false to stop parsing. Strings and keys point into the input, or
+ *       into a buffer of the reader when they contain escapes, and are only valid during the call. The default
+ *       implementations ignore the value and continue, so a handler only overrides what it needs.
+ */
+class JsonHandler {
+public:
+  /** @brief A null value */
+  virtual bool Null() { return true; }
+  /** @brief A true or false value */
+  virtual bool Bool(bool /*value*/) { return true; }
+  /** @brief A negative integer that fits an int64_t */
+  virtual bool Int64(int64_t /*value*/) { return true; }
+  /** @brief A non-negative integer that fits a uint64_t */
+  virtual bool Uint64(uint64_t /*value*/) { return true; }
+  /** @brief Any other number */
+  virtual bool Double(double /*value*/) { return true; }
+  /** @brief A string value, unescaped UTF-8 */
+  virtual bool String(const char* /*data*/, size_t /*size*/) { return true; }
+  /** @brief The key of the next member of an object, unescaped UTF-8 */
+  virtual bool Key(const char* /*data*/, size_t /*size*/) { return true; }
+  /** @brief The start of an object */
+  virtual bool StartObject() { return true; }
+  /** @brief The end of an object, with its number of members */
+  virtual bool EndObject(size_t /*memberCount*/) { return true; }
+  /** @brief The start of an array */
+  virtual bool StartArray() { return true; }
+  /** @brief The end of an array, with its number of elements */
+  virtual bool EndArray(size_t /*elementCount*/) { return true; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~JsonHandler() {}
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace jsonreader {
+
+const uint64_t kOnes = 0x0101010101010101ULL;
+const uint64_t kHighs = 0x8080808080808080ULL;
+
+// Whether any of the 8 bytes is a quote, a backslash or a control character; may report a byte that follows a match
+inline bool HasSpecialByte(uint64_t word) {
+  uint64_t quote = word ^ (kOnes * '"');
+  uint64_t backslash = word ^ (kOnes * '\\');
+  return (((quote - kOnes) & ~quote) | ((backslash - kOnes) & ~backslash) | ((word - kOnes * 0x20) & ~word)) & kHighs;
+}
+
+inline void AppendUtf8(std::string& out, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    out += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    out += static_cast<char>(0xC0 | (codePoint >> 6));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    out += static_cast<char>(0xE0 | (codePoint >> 12));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (codePoint >> 18));
+    out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+}
+
+// Powers of ten that a double holds exactly, for the fast path of number conversion
+inline double GetExactPowerOfTen(int exponent) {
+  static const double kPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  return kPowers[exponent];
+}
+
+} // namespace jsonreader
+/** @endcond */
+
+/**
+ * @brief Parses JSON text from a buffer, reporting its values to a JsonHandler
+ * 
+ * @note Nothing is allocated per value: strings without escapes are reported in place, and string content is
+ *       scanned 8 bytes at a time. Nesting is tracked on an explicit stack, so deep input cannot overflow the call
+ *       stack; it is limited to maxDepth. A reader can be reused, but not by two threads at once.
+ */
+class JsonReader {
+public:
+  /**
+   * @brief Create a reader
+   * 
+   * @param maxDepth Deepest nesting of objects and arrays accepted
+   */
+  explicit JsonReader(size_t maxDepth = 512) : mMaxDepth(maxDepth) {}
+
+  /**
+   * @brief Parse a JSON text
+   * 
+   * @param data JSON text, UTF-8
+   * @param size Size of the text in bytes
+   * @param handler Receives the values
+   * 
+   * @return false if the handler stopped parsing, true once the whole text was reported
+   * 
+   * @throws BadInputError if the text is not valid JSON or nested deeper than maxDepth
+   */
+  bool Parse(const char* data, size_t size, JsonHandler& handler) {
+    mBegin = data;
+    mPos = data;
+    mEnd = data + size;
+    mStack.clear();
+    SkipWhitespace();
+    for (;;) {
+      // A value is expected at mPos
+      if (mPos == mEnd) {
+        Fail("unexpected end of input");
+      }
+      char c = *mPos;
+      if (c == '{' || c == '[') {
+        bool isObject = c == '{';
+        ++mPos;
+        if (!(isObject ? handler.StartObject() : handler.StartArray())) {
+          return false;
+        }
+        SkipWhitespace();
+        if (mPos < mEnd && *mPos == (isObject ? '}' : ']')) {
+          ++mPos;
+          if (!(isObject ? handler.EndObject(0) : handler.EndArray(0))) {
+            return false;
+          }
+        } else {
+          if (mStack.size() >= mMaxDepth) {
+            Fail("nesting too deep");
+          }
+          mStack.push_back(Frame{isObject, 0});
+          if (isObject && !ParseKey(handler)) {
+            return false;
+          }
+          continue;
+        }
+      } else if (!ParseScalar(handler)) {
+        return false;
+      }
+
+      // A value just ended: close the containers it ended, then move to the next member or element
+      for (;;) {
+        SkipWhitespace();
+        if (mStack.empty()) {
+          if (mPos != mEnd) {
+            Fail("unexpected data after the value");
+          }
+          return true;
+        }
+        Frame& frame = mStack.back();
+        ++frame.count;
+        if (mPos == mEnd) {
+          Fail("unexpected end of input");
+        }
+        c = *mPos++;
+        if (c == ',') {
+          SkipWhitespace();
+          if (frame.isObject && !ParseKey(handler)) {
+            return false;
+          }
+          break;
+        }
+        if (c != (frame.isObject ? '}' : ']')) {
+          --mPos;
+          Fail(frame.isObject ? "expected ',' or '}'" : "expected ',' or ']'");
+        }
+        size_t count = frame.count;
+        bool isObject = frame.isObject;
+        mStack.pop_back();
+        if (!(isObject ? handler.EndObject(count) : handler.EndArray(count))) {
+          return false;
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Parse a JSON text
+   * 
+   * @param value JSON text, UTF-8
+   * @param handler Receives the values
+   * 
+   * @return false if the handler stopped parsing, true once the whole text was reported
+   * 
+   * @throws BadInputError if the text is not valid JSON or nested deeper than maxDepth
+   */
+  bool Parse(const std::string& value, JsonHandler& handler) { return Parse(value.data(), value.size(), handler); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Frame {
+    bool isObject;
+    size_t count;
+  };
+
+  [[noreturn]] void Fail(const char* reason) const {
+    throw BadInputError(std::string("Invalid JSON at offset ") + std::to_string(mPos - mBegin) + ": " + reason);
+  }
+
+  void SkipWhitespace() {
+    while (mPos < mEnd && (*mPos == ' ' || *mPos == '\n' || *mPos == '\r' || *mPos == '\t')) {
+      ++mPos;
+    }
+  }
+
+  bool ParseKey(JsonHandler& handler) {
+    if (mPos == mEnd || *mPos != '"') {
+      Fail("expected a member name");
+    }
+    const char* data = nullptr;
+    size_t size = 0;
+    ParseString(data, size);
+    SkipWhitespace();
+    if (mPos == mEnd || *mPos != ':') {
+      Fail("expected ':'");
+    }
+    ++mPos;
+    SkipWhitespace();
+    return handler.Key(data, size);
+  }
+
+  bool ParseScalar(JsonHandler& handler) {
+    switch (*mPos) {
+      case '"': {
+        const char* data = nullptr;
+        size_t size = 0;
+        ParseString(data, size);
+        return handler.String(data, size);
+      }
+      case 't':
+        ExpectLiteral("true");
+        return handler.Bool(true);
+      case 'f':
+        ExpectLiteral("false");
+        return handler.Bool(false);
+      case 'n':
+        ExpectLiteral("null");
+        return handler.Null();
+      default:
+        return ParseNumber(handler);
+    }
+  }
+
+  void ExpectLiteral(const char* literal) {
+    size_t length = std::strlen(literal);
+    if (static_cast<size_t>(mEnd - mPos) < length || std::memcmp(mPos, literal, length) != 0) {
+      Fail("invalid literal");
+    }
+    mPos += length;
+  }
+
+  // mPos is at the opening quote; on return data points into the input, or into mScratch if there were escapes
+  void ParseString(const char*& data, size_t& size) {
+    const char* start = ++mPos;
+    bool isEscaped = false;
+    for (;;) {
+      while (mEnd - mPos >= 8) {
+        uint64_t word;
+        std::memcpy(&word, mPos, sizeof(word));
+        if (jsonreader::HasSpecialByte(word)) {
+          break;
+        }
+        if (isEscaped) {
+          mScratch.append(mPos, 8);
+        }
+        mPos += 8;
+      }
+      if (mPos == mEnd) {
+        Fail("unterminated string");
+      }
+      unsigned char c = static_cast<unsigned char>(*mPos);
+      if (c == '"') {
+        break;
+      }
+      if (c < 0x20) {
+        Fail("control character in string");
+      }
+      if (c != '\\') {
+        if (isEscaped) {
+          mScratch += static_cast<char>(c);
+        }
+        ++mPos;
+        continue;
+      }
+      if (!isEscaped) {
+        isEscaped = true;
+        mScratch.assign(start, mPos);
+      }
+      ParseEscape();
+    }
+    if (isEscaped) {
+      data = mScratch.data();
+      size = mScratch.size();
+    } else {
+      data = start;
+      size = static_cast<size_t>(mPos - start);
+    }
+    ++mPos;
+  }
+
+  // Appends the unescaped character to mScratch; plain bytes after the first escape are appended by ParseString
+  void ParseEscape() {
+    if (mEnd - mPos < 2) {
+      Fail("unterminated string");
+    }
+    char c = mPos[1];
+    mPos += 2;
+    switch (c) {
+      case '"': mScratch += '"'; break;
+      case '\\': mScratch += '\\'; break;
+      case '/': mScratch += '/'; break;
+      case 'b': mScratch += '\b'; break;
+      case 'f': mScratch += '\f'; break;
+      case 'n': mScratch += '\n'; break;
+      case 'r': mScratch += '\r'; break;
+      case 't': mScratch += '\t'; break;
+      case 'u': {
+        uint32_t codePoint = ParseHex4();
+        if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+          if (mEnd - mPos < 6 || mPos[0] != '\\' || mPos[1] != 'u') {
+            Fail("unpaired surrogate");
+          }
+          mPos += 2;
+          uint32_t low = ParseHex4();
+          if (low < 0xDC00 || low >= 0xE000) {
+            Fail("unpaired surrogate");
+          }
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+        } else if (codePoint >= 0xDC00 && codePoint < 0xE000) {
+          Fail("unpaired surrogate");
+        }
+        jsonreader::AppendUtf8(mScratch, codePoint);
+        break;
+      }
+      default:
+        mPos -= 2;
+        Fail("invalid escape");
+    }
+  }
+
+  uint32_t ParseHex4() {
+    if (mEnd - mPos < 4) {
+      Fail("invalid \\u escape");
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = *mPos++;
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+        value |= static_cast<uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        value |= static_cast<uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        value |= static_cast<uint32_t>(c - 'A' + 10);
+      } else {
+        --mPos;
+        Fail("invalid \\u escape");
+      }
+    }
+    return value;
+  }
+
+  bool ParseNumber(JsonHandler& handler) {
+    const char* start = mPos;
+    bool isNegative = mPos < mEnd && *mPos == '-';
+    if (isNegative) {
+      ++mPos;
+    }
+    if (mPos == mEnd || *mPos < '0' || *mPos > '9') {
+      Fail("invalid value");
+    }
+    uint64_t mantissa = 0;
+    int digitCount = 0;
+    int exponent = 0;
+    bool isOverflow = false;
+    if (*mPos == '0') {
+      ++mPos;
+    } else {
+      for (; mPos < mEnd && *mPos >= '0' && *mPos <= '9'; ++mPos) {
+        if (digitCount < 19) {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*mPos - '0');
+          digitCount += mantissa != 0 ? 1 : 0;
+        } else if (digitCount == 19 && mantissa <= (UINT64_MAX - 9) / 10) {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*mPos - '0');
+          ++digitCount;
+        } else {
+          isOverflow = true;
+          ++exponent;
+        }
+      }
+    }
+    bool isInteger = true;
+    if (mPos < mEnd && *mPos == '.') {
+      isInteger = false;
+      ++mPos;
+      if (mPos == mEnd || *mPos < '0' || *mPos > '9') {
+        Fail("invalid number");
+      }
+      for (; mPos < mEnd && *mPos >= '0' && *mPos <= '9'; ++mPos) {
+        if (digitCount < 19) {
+          mantissa = mantissa * 10 + static_cast<uint64_t>(*mPos - '0');
+          digitCount += mantissa != 0 ? 1 : 0;
+          --exponent;
+        } else {
+          isOverflow = true;
+        }
+      }
+    }
+    if (mPos < mEnd && (*mPos == 'e' || *mPos == 'E')) {
+      isInteger = false;
+      ++mPos;
+      bool isExponentNegative = false;
+      if (mPos < mEnd && (*mPos == '+' || *mPos == '-')) {
+        isExponentNegative = *mPos == '-';
+        ++mPos;
+      }
+      if (mPos == mEnd || *mPos < '0' || *mPos > '9') {
+        Fail("invalid number");
+      }
+      int explicitExponent = 0;
+      for (; mPos < mEnd && *mPos >= '0' && *mPos <= '9'; ++mPos) {
+        explicitExponent = explicitExponent < 100000 ? explicitExponent * 10 + (*mPos - '0') : explicitExponent;
+      }
+      exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+    }
+
+    if (isInteger && !isOverflow) {
+      if (!isNegative) {
+        return handler.Uint64(mantissa);
+      }
+      if (mantissa <= static_cast<uint64_t>(INT64_MAX) + 1) {
+        return handler.Int64(mantissa == static_cast<uint64_t>(INT64_MAX) + 1 ? INT64_MIN :
+                                                                              -static_cast<int64_t>(mantissa));
+      }
+    }
+    // Exact when the mantissa and the power of ten are both exact doubles, else strtod rounds correctly
+    if (!isOverflow && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+      double value = static_cast<double>(mantissa);
+      value = exponent < 0 ? value / jsonreader::GetExactPowerOfTen(-exponent) :
+                             value * jsonreader::GetExactPowerOfTen(exponent);
+      return handler.Double(isNegative ? -value : value);
+    }
+    return handler.Double(ConvertWithStrtod(start, mPos));
+  }
+
+  double ConvertWithStrtod(const char* start, const char* end) {
+    mNumber.assign(start, end);
+    // strtod follows the C locale's decimal point
+    char decimalPoint = std::localeconv()->decimal_point[0];
+    if (decimalPoint != '.') {
+      size_t dot = mNumber.find('.');
+      if (dot != std::string::npos) {
+        mNumber[dot] = decimalPoint;
+      }
+    }
+    return std::strtod(mNumber.c_str(), nullptr);
+  }
+
+  size_t mMaxDepth;
+  const char* mBegin = nullptr;
+  const char* mPos = nullptr;
+  const char* mEnd = nullptr;
+  std::vector<Frame> mStack;
+  std::string mScratch;
+  std::string mNumber;
+  /** @endcond */
+};
+
+/**
+ * @brief Mixin of a JsonDelegate that can report a JSON text to a JsonHandler without building a document
+ * 
+ * @note Found with dynamic_cast; ParseJson falls back to the document of JsonDelegate::Parse for delegates without it.
+ */
+class JsonStreamParser {
+public:
+  /**
+   * @brief Parse a JSON text
+   * 
+   * @param value JSON text
+   * @param handler Receives the values
+   * 
+   * @return false if the handler stopped parsing
+   * 
+   * @throws BadInputError if the text is not valid JSON
+   */
+  virtual bool ParseStream(const std::string& value, JsonHandler& handler) const = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~JsonStreamParser() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Report a JSON text to a handler through a JsonDelegate
+ * 
+ * @param jsonDelegate Delegate, streaming if it is a JsonStreamParser
+ * @param value JSON text
+ * @param handler Receives the values
+ * 
+ * @return false if the handler stopped parsing
+ * 
+ * @throws BadInputError if the text is not valid JSON, or the delegate's parse error
+ * 
+ * @note A delegate that only builds documents parses the text, and the reader then walks its serialization, which
+ *       has the same values in the same order.
+ */
+inline bool ParseJson(const JsonDelegate& jsonDelegate, const std::string& value, JsonHandler& handler) {
+  auto streamParser = dynamic_cast<const JsonStreamParser*>(&jsonDelegate);
+  if (streamParser) {
+    return streamParser->ParseStream(value, handler);
+  }
+  JsonResult result = jsonDelegate.Parse(value);
+  if (!result.GetData()) {
+    auto error = result.GetError();
+    throw BadInputError(error ? error->GetMessage() : "JSON could not be parsed");
+  }
+  JsonReader reader;
+  return reader.Parse(result.GetData()->Root()->SerializeToString(), handler);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_JSON_READER_H_
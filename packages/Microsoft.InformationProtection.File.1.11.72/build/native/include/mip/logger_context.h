@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines logger contexts that wrap an application context and are recognized when the SDK hands them back
+ * 
+ * @file logger_context.h
+ */
+
+#ifndef API_MIP_LOGGER_CONTEXT_H_
+#define API_MIP_LOGGER_CONTEXT_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+class LinkedLoggerContext;
+
+/** @cond DOXYGEN_HIDE */
+namespace loggercontext {
+
+struct Registry {
+  std::mutex mutex;
+  std::unordered_map<const void*, LinkedLoggerContext*> contexts;
+};
+
+// Leaked so that contexts destroyed during static destruction can still unregister
+inline Registry& GetRegistry() {
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+inline LinkedLoggerContext* Find(const void* object) {
+  auto& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto it = registry.contexts.find(object);
+  return it == registry.contexts.end() ? nullptr : it->second;
+}
+
+} // namespace loggercontext
+/** @endcond */
+
+/**
+ * @brief Base of logger contexts that carry SDK-side state, such as a trace context or a deadline, in front of the
+ *        application's own context
+ * 
+ * @note The SDK passes a loggerContext or API context through unchanged to the TaskDispatcherDelegate, the
+ *       HttpDelegate, the LoggerDelegate and the observers, as a std::shared_ptr<void>. Each LinkedLoggerContext
+ *       registers its address so that FindLoggerContext can recognize it there, and wraps the next context, so
+ *       several of them can be chained in any order. Pass the outermost one to the SDK.
+ */
+class LinkedLoggerContext {
+public:
+  LinkedLoggerContext(const LinkedLoggerContext&) = delete;
+  LinkedLoggerContext& operator=(const LinkedLoggerContext&) = delete;
+
+  /**
+   * @brief Get the context this one wraps
+   */
+  const std::shared_ptr<void>& GetInnerContext() const { return mInnerContext; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~LinkedLoggerContext() {
+    auto& registry = loggercontext::GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.contexts.erase(mObject);
+  }
+
+protected:
+  // object is the address of the complete object, which is what a std::shared_ptr<void> to it holds
+  LinkedLoggerContext(const void* object, const std::shared_ptr<void>& innerContext)
+      : mObject(object),
+        mInnerContext(innerContext) {
+    auto& registry = loggercontext::GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.contexts[mObject] = this;
+  }
+
+private:
+  const void* mObject;
+  std::shared_ptr<void> mInnerContext;
+  /** @endcond */
+};
+
+/**
+ * @brief Find a linked logger context of a given type in a chain of them
+ * 
+ * @param loggerContext Logger context received from the SDK
+ * 
+ * @return The first T found by following the inner contexts, or nullptr if there is none
+ */
+template <typename T>
+std::shared_ptr<T> FindLoggerContext(const std::shared_ptr<void>& loggerContext) {
+  std::shared_ptr<void> current = loggerContext;
+  while (current) {
+    // current keeps the context alive after the registry lock is released
+    LinkedLoggerContext* link = loggercontext::Find(current.get());
+    if (!link) {
+      return nullptr;
+    }
+    if (T* found = dynamic_cast<T*>(link)) {
+      return std::shared_ptr<T>(current, found);
+    }
+    current = link->GetInnerContext();
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Get the application context at the end of a chain of linked logger contexts
+ * 
+ * @param loggerContext Logger context received from the SDK, for example in an observer callback
+ * 
+ * @return The first context that is not a LinkedLoggerContext, or nullptr
+ */
+inline std::shared_ptr<void> GetApplicationContext(const std::shared_ptr<void>& loggerContext) {
+  std::shared_ptr<void> current = loggerContext;
+  while (current) {
+    LinkedLoggerContext* link = loggercontext::Find(current.get());
+    if (!link) {
+      return current;
+    }
+    current = link->GetInnerContext();
+  }
+  return nullptr;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_LOGGER_CONTEXT_H_
@@ -0,0 +1,450 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a Stream backed by a memory-mapped file
+ * 
+ * @file mapped_file_stream.h
+ */
+
+#ifndef API_MIP_MAPPED_FILE_STREAM_H_
+#define API_MIP_MAPPED_FILE_STREAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Access requested when mapping a file
+ */
+enum class MappedFileAccess : unsigned int {
+  Read      = 0, /**< File is mapped read-only */
+  ReadWrite = 1, /**< File is mapped for reading and writing, writes past the end grow the file */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace mappedfile {
+
+// Smallest growth of a mapping, so that a run of small writes past the end does not remap on every call
+const int64_t kMinGrowth = 64 * 1024;
+
+// Owns the file descriptor or handle of a MappedFileStream, so that it is closed even if construction fails
+class FileHandle {
+public:
+#ifdef _WIN32
+  using Native = HANDLE;
+  static Native Invalid() { return INVALID_HANDLE_VALUE; }
+#else
+  using Native = int;
+  static Native Invalid() { return -1; }
+#endif
+
+  FileHandle() = default;
+  FileHandle(const FileHandle&) = delete;
+  FileHandle& operator=(const FileHandle&) = delete;
+
+  ~FileHandle() { Close(); }
+
+  void Reset(Native handle) {
+    Close();
+    mHandle = handle;
+  }
+
+  Native Get() const { return mHandle; }
+  bool IsValid() const { return mHandle != Invalid(); }
+
+private:
+  void Close() {
+    if (mHandle != Invalid()) {
+#ifdef _WIN32
+      CloseHandle(mHandle);
+#else
+      close(mHandle);
+#endif
+      mHandle = Invalid();
+    }
+  }
+
+  Native mHandle = Invalid();
+};
+
+} // namespace mappedfile
+/** @endcond */
+
+/**
+ * @brief A Stream that reads and writes directly from a memory-mapped view of a file.
+ * 
+ * @note Read copies straight out of the mapping without any intermediate buffering. Callers that can consume bytes
+ *       in place can use MappedFileStream::Borrow to avoid the copy entirely. Like other streams, a single instance
+ *       should not be used concurrently from multiple threads, except for MappedFileStream::ReadAt and
+ *       MappedFileStream::Borrow which do not touch the stream position. Writes past the end grow the mapping
+ *       geometrically, so the file on disk may be longer than the stream until the stream is destroyed, when it is
+ *       trimmed to Size().
+ */
+class MappedFileStream : public Stream {
+public:
+  /**
+   * @brief MappedFileStream constructor
+   * 
+   * @param path Path of the file to map. The file must already exist.
+   * @param access Requested access
+   * 
+   * @note A mip::FileIOError is thrown if the file cannot be opened or mapped
+   */
+  MappedFileStream(const std::string& path, MappedFileAccess access)
+      : mPath(path),
+        mAccess(access),
+        mData(nullptr),
+        mSize(0),
+        mMappedSize(0),
+        mPosition(0),
+        mIsTrimNeeded(false) {
+    int64_t fileSize = Open();
+    if (fileSize > 0) {
+      mData = MapView(fileSize);
+      mMappedSize = fileSize;
+    }
+    mSize = fileSize;
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesRead = ReadAt(mPosition, buffer, bufferLength);
+    mPosition += bytesRead;
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    if (!CanWrite()) {
+      throw FileIOError("MappedFileStream was not opened for writing: " + mPath);
+    }
+    if (buffer == nullptr || bufferLength <= 0) {
+      return 0;
+    }
+    if (bufferLength > mMappedSize - mPosition) {
+      Grow(mPosition + bufferLength);
+    }
+    std::memcpy(mData + mPosition, buffer, static_cast<size_t>(bufferLength));
+    mPosition += bufferLength;
+    mSize = (std::max)(mSize, mPosition);
+    return bufferLength;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override {
+    if (!CanWrite() || mData == nullptr) {
+      return true;
+    }
+#ifdef _WIN32
+    return FlushViewOfFile(mData, 0) != FALSE && FlushFileBuffers(mFile.Get()) != FALSE;
+#else
+    return msync(mData, static_cast<size_t>(mMappedSize), MS_SYNC) == 0;
+#endif
+  }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override {
+    mPosition = (std::max)(static_cast<int64_t>(0), (std::min)(position, mSize));
+  }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return true; }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mAccess == MappedFileAccess::ReadWrite; }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mSize; }
+
+  /**
+   * @brief Set the stream size, growing the mapping if needed.
+   * 
+   * @param value new stream size.
+   */
+  void Size(int64_t value) override {
+    if (!CanWrite()) {
+      throw FileIOError("MappedFileStream was not opened for writing: " + mPath);
+    }
+    if (value < 0) {
+      throw BadInputError("MappedFileStream size cannot be negative");
+    }
+    if (value > mMappedSize) {
+      Grow(value);
+    }
+    if (value > mSize) {
+      // Bytes left beyond the end by an earlier shrink must read back as zeros, as in a grown file
+      std::memset(mData + mSize, 0, static_cast<size_t>(value - mSize));
+    } else if (value < mSize) {
+      mIsTrimNeeded = true;
+    }
+    mSize = value;
+    mPosition = (std::min)(mPosition, mSize);
+  }
+
+  /**
+   * @brief Read into a buffer from an absolute position without moving the stream position.
+   * 
+   * @param position Absolute position within the file
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t ReadAt(int64_t position, uint8_t* buffer, int64_t bufferLength) const {
+    if (mData == nullptr || buffer == nullptr || bufferLength <= 0 || position < 0 || position >= mSize) {
+      return 0;
+    }
+    int64_t bytesToRead = (std::min)(bufferLength, mSize - position);
+    std::memcpy(buffer, mData + position, static_cast<size_t>(bytesToRead));
+    return bytesToRead;
+  }
+
+  /**
+   * @brief Borrow a pointer into the mapping without copying.
+   * 
+   * @param position Absolute position within the file
+   * @param length Number of bytes the caller intends to access
+   * 
+   * @return Pointer to the mapped bytes, or nullptr if [position, position + length) is not within the file
+   * 
+   * @note The pointer is only valid until the stream is resized or destroyed.
+   */
+  const uint8_t* Borrow(int64_t position, int64_t length) const {
+    if (mData == nullptr || position < 0 || length < 0 || position > mSize || length > mSize - position) {
+      return nullptr;
+    }
+    return mData + position;
+  }
+
+  /**
+   * @brief Get the path of the mapped file
+   * 
+   * @return Path of the mapped file
+   */
+  const std::string& GetPath() const { return mPath; }
+
+  /** @cond DOXYGEN_HIDE */
+  ~MappedFileStream() {
+    if (mData != nullptr) {
+      UnmapView(mData, mMappedSize);
+    }
+    if (mIsTrimNeeded) {
+      try {
+        Resize(mSize);
+      } catch (...) {
+        // The file keeps zeros past the end of the stream
+      }
+    }
+  }
+
+  MappedFileStream(const MappedFileStream&) = delete;
+  MappedFileStream& operator=(const MappedFileStream&) = delete;
+
+private:
+  // Map a larger view before releasing the current one, so that a failure leaves the stream as it was
+  void Grow(int64_t size) {
+    int64_t capacity = (std::max)(size, (std::max)(mMappedSize * 2, mappedfile::kMinGrowth));
+    mIsTrimNeeded = true;
+    Resize(capacity);
+    uint8_t* data = MapView(capacity);
+    if (mData != nullptr) {
+      UnmapView(mData, mMappedSize);
+    }
+    mData = data;
+    mMappedSize = capacity;
+  }
+
+#ifdef _WIN32
+  int64_t Open() {
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, mPath.c_str(), -1, nullptr, 0);
+    std::wstring widePath(wideLength > 0 ? wideLength : 1, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, mPath.c_str(), -1, &widePath[0], wideLength);
+    DWORD desiredAccess = CanWrite() ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+    mFile.Reset(CreateFileW(
+        widePath.c_str(),
+        desiredAccess,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr));
+    if (!mFile.IsValid()) {
+      throw FileIOError("Failed to open file for mapping: " + mPath);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mFile.Get(), &fileSize)) {
+      throw FileIOError("Failed to get size of file: " + mPath);
+    }
+    return fileSize.QuadPart;
+  }
+
+  uint8_t* MapView(int64_t size) {
+    DWORD protect = CanWrite() ? PAGE_READWRITE : PAGE_READONLY;
+    HANDLE mapping = CreateFileMappingW(mFile.Get(), nullptr, protect, 0, 0, nullptr);
+    if (mapping == nullptr) {
+      throw FileIOError("Failed to create file mapping: " + mPath);
+    }
+    DWORD viewAccess = CanWrite() ? FILE_MAP_WRITE : FILE_MAP_READ;
+    void* data = MapViewOfFile(mapping, viewAccess, 0, 0, static_cast<SIZE_T>(size));
+    CloseHandle(mapping);
+    if (data == nullptr) {
+      throw FileIOError("Failed to map view of file: " + mPath);
+    }
+    return static_cast<uint8_t*>(data);
+  }
+
+  static void UnmapView(uint8_t* data, int64_t /*size*/) {
+    UnmapViewOfFile(data);
+  }
+
+  void Resize(int64_t size) {
+    LARGE_INTEGER newSize;
+    newSize.QuadPart = size;
+    if (!SetFilePointerEx(mFile.Get(), newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(mFile.Get())) {
+      throw FileIOError("Failed to resize mapped file: " + mPath);
+    }
+  }
+#else
+  int64_t Open() {
+    mFile.Reset(open(mPath.c_str(), CanWrite() ? O_RDWR : O_RDONLY));
+    if (!mFile.IsValid()) {
+      throw FileIOError("Failed to open file for mapping: " + mPath);
+    }
+    struct stat fileStat;
+    if (fstat(mFile.Get(), &fileStat) != 0) {
+      throw FileIOError("Failed to get size of file: " + mPath);
+    }
+    return static_cast<int64_t>(fileStat.st_size);
+  }
+
+  uint8_t* MapView(int64_t size) {
+    int protect = CanWrite() ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* data = mmap(nullptr, static_cast<size_t>(size), protect, MAP_SHARED, mFile.Get(), 0);
+    if (data == MAP_FAILED) {
+      throw FileIOError("Failed to map file: " + mPath);
+    }
+    madvise(data, static_cast<size_t>(size), MADV_SEQUENTIAL);
+    return static_cast<uint8_t*>(data);
+  }
+
+  static void UnmapView(uint8_t* data, int64_t size) {
+    munmap(data, static_cast<size_t>(size));
+  }
+
+  void Resize(int64_t size) {
+    if (ftruncate(mFile.Get(), static_cast<off_t>(size)) != 0) {
+      throw FileIOError("Failed to resize mapped file: " + mPath);
+    }
+  }
+#endif
+
+  mappedfile::FileHandle mFile;
+  std::string mPath;
+  MappedFileAccess mAccess;
+  uint8_t* mData;
+  int64_t mSize;
+  int64_t mMappedSize;
+  int64_t mPosition;
+  bool mIsTrimNeeded;
+  /** @endcond */
+};
+
+/**
+ * @brief Creates a Stream backed by a memory-mapped file
+ * 
+ * @param path Path of an existing file
+ * @param access Requested access
+ * 
+ * @return Stream reading and writing directly from the file mapping
+ * 
+ * @note The returned stream can be passed to FileEngine::CreateFileHandlerAsync without reading the file into memory
+ *       first. Use std::dynamic_pointer_cast<MappedFileStream> to borrow mapped bytes without copying.
+ */
+inline std::shared_ptr<Stream> CreateStreamFromMappedFile(
+    const std::string& path,
+    MappedFileAccess access = MappedFileAccess::Read) {
+  return std::make_shared<MappedFileStream>(path, access);
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_MAPPED_FILE_STREAM_H_
@@ -0,0 +1,880 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MappedStorageDelegate, a StorageDelegate for read-mostly tables kept in memory-mapped snapshot files
+ * 
+ * @file mapped_storage_delegate.h
+ */
+
+#ifndef API_MIP_MAPPED_STORAGE_DELEGATE_H_
+#define API_MIP_MAPPED_STORAGE_DELEGATE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/indexed_storage_delegate.h"
+#include "mip/mapped_file_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a MappedStorageDelegate
+ */
+struct MappedStorageDelegateSettings {
+  /** Rows written since the last snapshot beyond which a table writes a new snapshot */
+  size_t maxDeltaRows = 1024;
+  /** Bytes of the write log of a table beyond which it writes a new snapshot */
+  int64_t maxDeltaBytes = 4 * 1024 * 1024;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace mappedstorage {
+
+const char kSnapshotMagic[8] = {'M', 'I', 'P', 'S', 'N', 'P', '1', '\n'};
+const char kLogMagic[8] = {'M', 'I', 'P', 'D', 'L', 'T', '1', '\n'};
+// magic, schema size, then after the schema: row count, bucket count, first row, end of rows
+const size_t kSnapshotFieldsSize = 4 * 8;
+
+inline uint64_t Hash(const std::string& key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : key) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+inline void AppendUint64(std::string& out, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+inline std::string JoinKey(const std::vector<StorageValueView>& values, const std::vector<size_t>& keyPositions) {
+  std::string key;
+  for (size_t position : keyPositions) {
+    indexedstorage::AppendUint32(key, static_cast<uint32_t>(values[position].size));
+    key.append(values[position].data != nullptr ? values[position].data : "", values[position].size);
+  }
+  return key;
+}
+
+inline std::vector<StorageValueView> GetViews(const std::vector<std::string>& values) {
+  return std::vector<StorageValueView>(values.begin(), values.end());
+}
+
+// An immutable snapshot file: the header, the rows one after another, then an open-addressing hash index from the
+// key of each row to its offset. Rows are read in place from the mapping.
+class Snapshot {
+public:
+  // Maps a snapshot, returns nullptr if it is missing, of another schema or damaged
+  static std::shared_ptr<Snapshot> Open(const std::string& path, const std::string& schema,
+      size_t columnCount, const std::vector<size_t>& keyPositions) {
+    std::shared_ptr<Snapshot> snapshot(new Snapshot(columnCount, keyPositions));
+    try {
+      snapshot->mFile.reset(new MappedFileStream(path, MappedFileAccess::Read));
+    } catch (const FileIOError&) {
+      return nullptr;
+    }
+    int64_t size = snapshot->mFile->Size();
+    int64_t headerSize = static_cast<int64_t>(sizeof(kSnapshotMagic) + 4 + schema.size() + kSnapshotFieldsSize);
+    const char* header = snapshot->Borrow(0, headerSize);
+    if (header == nullptr || std::memcmp(header, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        indexedstorage::ReadUint(header + sizeof(kSnapshotMagic), 4) != schema.size() ||
+        schema.compare(0, schema.size(), header + sizeof(kSnapshotMagic) + 4, schema.size()) != 0) {
+      return nullptr;
+    }
+    const char* fields = header + sizeof(kSnapshotMagic) + 4 + schema.size();
+    snapshot->mRowCount = indexedstorage::ReadUint(fields, 8);
+    snapshot->mBucketCount = indexedstorage::ReadUint(fields + 8, 8);
+    snapshot->mRowsBegin = static_cast<int64_t>(indexedstorage::ReadUint(fields + 16, 8));
+    snapshot->mRowsEnd = static_cast<int64_t>(indexedstorage::ReadUint(fields + 24, 8));
+    bool isPowerOfTwo = snapshot->mBucketCount != 0 && (snapshot->mBucketCount & (snapshot->mBucketCount - 1)) == 0;
+    if (!isPowerOfTwo || snapshot->mRowsBegin != headerSize || snapshot->mRowsEnd < headerSize ||
+        snapshot->mBucketCount > static_cast<uint64_t>(size) / 8 ||
+        snapshot->mRowsEnd + static_cast<int64_t>(snapshot->mBucketCount * 8) != size) {
+      return nullptr;
+    }
+    return snapshot;
+  }
+
+  // Writes a snapshot of the rows produced by forEachRow, which passes each row to the function it is given
+  template <typename ForEachRow>
+  static void Write(const std::string& path, const std::string& schema, const std::vector<size_t>& keyPositions,
+      ForEachRow&& forEachRow) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string header(kSnapshotMagic, sizeof(kSnapshotMagic));
+    indexedstorage::AppendUint32(header, static_cast<uint32_t>(schema.size()));
+    header.append(schema);
+    size_t fieldsPosition = header.size();
+    header.append(kSnapshotFieldsSize, '\0');
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    uint64_t offset = header.size();
+    std::vector<std::pair<uint64_t, uint64_t>> entries; // key hash, row offset
+    std::string row;
+    forEachRow([&](const std::vector<StorageValueView>& values) {
+      row.clear();
+      for (const auto& value : values) {
+        indexedstorage::AppendUint32(row, static_cast<uint32_t>(value.size));
+        row.append(value.data != nullptr ? value.data : "", value.size);
+      }
+      entries.emplace_back(Hash(JoinKey(values, keyPositions)), offset);
+      out.write(row.data(), static_cast<std::streamsize>(row.size()));
+      offset += row.size();
+    });
+
+    uint64_t bucketCount = 1;
+    while (bucketCount < entries.size() * 2) {
+      bucketCount *= 2;
+    }
+    std::vector<uint64_t> buckets(static_cast<size_t>(bucketCount), 0);
+    for (const auto& entry : entries) {
+      uint64_t bucket = entry.first & (bucketCount - 1);
+      while (buckets[static_cast<size_t>(bucket)] != 0) {
+        bucket = (bucket + 1) & (bucketCount - 1);
+      }
+      buckets[static_cast<size_t>(bucket)] = entry.second + 1;
+    }
+    std::string index;
+    index.reserve(static_cast<size_t>(bucketCount * 8));
+    for (uint64_t bucket : buckets) {
+      AppendUint64(index, bucket);
+    }
+    out.write(index.data(), static_cast<std::streamsize>(index.size()));
+
+    std::string fields;
+    AppendUint64(fields, entries.size());
+    AppendUint64(fields, bucketCount);
+    AppendUint64(fields, header.size());
+    AppendUint64(fields, offset);
+    out.seekp(static_cast<std::streamoff>(fieldsPosition));
+    out.write(fields.data(), static_cast<std::streamsize>(fields.size()));
+    if (!out.flush()) {
+      throw FileIOError("Failed to write storage snapshot " + path);
+    }
+  }
+
+  // Offset of the row with a key, -1 if there is none
+  int64_t Find(const std::string& key, std::vector<StorageValueView>& values) const {
+    const char* buckets = Borrow(mRowsEnd, static_cast<int64_t>(mBucketCount * 8));
+    uint64_t bucket = Hash(key) & (mBucketCount - 1);
+    for (uint64_t probe = 0; probe < mBucketCount; ++probe) {
+      uint64_t entry = indexedstorage::ReadUint(buckets + bucket * 8, 8);
+      if (entry == 0) {
+        return -1;
+      }
+      int64_t offset = static_cast<int64_t>(entry - 1);
+      ReadRow(offset, values);
+      if (JoinKey(values, mKeyPositions) == key) {
+        return offset;
+      }
+      bucket = (bucket + 1) & (mBucketCount - 1);
+    }
+    return -1;
+  }
+
+  // Points values into the mapping at the row at an offset, returns the offset of the next row
+  int64_t ReadRow(int64_t offset, std::vector<StorageValueView>& values) const {
+    values.resize(mColumnCount);
+    for (size_t i = 0; i < mColumnCount; ++i) {
+      const char* size = offset >= mRowsBegin ? Borrow(offset, 4) : nullptr;
+      if (size == nullptr || offset + 4 > mRowsEnd) {
+        throw FileIOError("Damaged storage snapshot " + mFile->GetPath());
+      }
+      int64_t valueSize = static_cast<int64_t>(indexedstorage::ReadUint(size, 4));
+      if (offset + 4 + valueSize > mRowsEnd) {
+        throw FileIOError("Damaged storage snapshot " + mFile->GetPath());
+      }
+      values[i] = StorageValueView(size + 4, static_cast<size_t>(valueSize));
+      offset += 4 + valueSize;
+    }
+    return offset;
+  }
+
+  int64_t GetRowsBegin() const { return mRowsBegin; }
+  int64_t GetRowsEnd() const { return mRowsEnd; }
+  uint64_t GetRowCount() const { return mRowCount; }
+
+private:
+  Snapshot(size_t columnCount, const std::vector<size_t>& keyPositions)
+      : mColumnCount(columnCount),
+        mKeyPositions(keyPositions) {}
+
+  const char* Borrow(int64_t position, int64_t length) const {
+    return reinterpret_cast<const char*>(mFile->Borrow(position, length));
+  }
+
+  std::unique_ptr<MappedFileStream> mFile;
+  const size_t mColumnCount;
+  const std::vector<size_t> mKeyPositions;
+  uint64_t mRowCount = 0;
+  uint64_t mBucketCount = 1;
+  int64_t mRowsBegin = 0;
+  int64_t mRowsEnd = 0;
+};
+
+// A row written since the snapshot, or the removal of a snapshot row
+struct Delta {
+  bool isRemoved = false;
+  std::vector<std::string> values;
+};
+
+typedef std::unordered_map<std::string, Delta> Deltas;
+
+// Conditions of a query by column position
+typedef std::vector<std::pair<size_t, const std::string*>> Conditions;
+
+inline bool Matches(const std::vector<StorageValueView>& values, const Conditions& conditions) {
+  for (const auto& condition : conditions) {
+    if (values[condition.first] != StorageValueView(*condition.second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Visits the rows of a snapshot with its deltas applied, until visit returns false
+template <typename Visit>
+void ForEachRow(const Snapshot& snapshot, const Deltas& deltas, const std::vector<size_t>& keyPositions,
+    Visit&& visit) {
+  std::vector<StorageValueView> values;
+  for (int64_t offset = snapshot.GetRowsBegin(); offset < snapshot.GetRowsEnd();) {
+    offset = snapshot.ReadRow(offset, values);
+    if (!deltas.empty() && deltas.count(JoinKey(values, keyPositions)) != 0) {
+      continue;
+    }
+    if (!visit(values)) {
+      return;
+    }
+  }
+  for (const auto& delta : deltas) {
+    if (!delta.second.isRemoved && !visit(GetViews(delta.second.values))) {
+      return;
+    }
+  }
+}
+
+class Table;
+
+// Reads the rows of the snapshot and deltas current when it was opened, pointing into the mapping for snapshot rows
+class Cursor : public StorageTableCursor {
+public:
+  Cursor(const std::shared_ptr<Snapshot>& snapshot, Deltas&& deltas, const std::vector<size_t>& keyPositions,
+      const StorageTableQuery& query, const std::unordered_map<std::string, size_t>& columnPositions)
+      : mSnapshot(snapshot),
+        mDeltas(std::move(deltas)),
+        mKeyPositions(keyPositions),
+        mQuery(query),
+        mOffset(snapshot->GetRowsBegin()),
+        mSkip(query.offset),
+        mRemaining(query.limit) {
+    mDelta = mDeltas.begin();
+    for (size_t i = 0; i < mQuery.queryColumns.size(); ++i) {
+      mConditions.emplace_back(columnPositions.at(mQuery.queryColumns[i]), &mQuery.queryValues[i]);
+    }
+  }
+
+  bool Next() override {
+    while (mRemaining > 0 && NextRow()) {
+      if (!Matches(mValues, mConditions)) {
+        continue;
+      }
+      if (mSkip > 0) {
+        --mSkip;
+        continue;
+      }
+      --mRemaining;
+      return true;
+    }
+    mValues.clear();
+    return false;
+  }
+
+  size_t GetColumnCount() const override { return mValues.size(); }
+
+  StorageValueView GetValue(size_t column) const override { return mValues.at(column); }
+
+private:
+  bool NextRow() {
+    while (mOffset < mSnapshot->GetRowsEnd()) {
+      mOffset = mSnapshot->ReadRow(mOffset, mValues);
+      if (mDeltas.empty() || mDeltas.count(JoinKey(mValues, mKeyPositions)) == 0) {
+        return true;
+      }
+    }
+    while (mDelta != mDeltas.end()) {
+      const Delta& delta = (mDelta++)->second;
+      if (!delta.isRemoved) {
+        mValues = GetViews(delta.values);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::shared_ptr<Snapshot> mSnapshot;
+  Deltas mDeltas;
+  Deltas::const_iterator mDelta;
+  std::vector<size_t> mKeyPositions;
+  StorageTableQuery mQuery;
+  Conditions mConditions;
+  int64_t mOffset;
+  size_t mSkip;
+  size_t mRemaining;
+  std::vector<StorageValueView> mValues;
+};
+
+// One table: a mapped snapshot, plus a log of the writes since, replayed into memory. Once the log outgrows the
+// settings, the merged rows are written to a new snapshot that replaces the old one and the log starts over.
+class Table : public TransactionalStorageTable,
+              public StorageTableCursorSource {
+public:
+  Table(const std::string& path, const MappedStorageDelegateSettings& settings) : mPath(path), mSettings(settings) {}
+
+  void Open(
+      const std::vector<std::string>& columns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) {
+    if (!encryptedColumns.empty()) {
+      throw NotSupportedError(
+          "MappedStorageDelegate stores no encrypted columns, use CacheStorageType::OnDiskEncrypted");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mColumns = columns;
+    mColumnPositions.clear();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      mColumnPositions[columns[i]] = i;
+    }
+    mKeyPositions.clear();
+    for (const auto& keyColumn : keyColumns) {
+      mKeyPositions.push_back(GetPosition(keyColumn));
+    }
+    // Without key columns a row is identified by all of its values
+    for (size_t i = 0; keyColumns.empty() && i < columns.size(); ++i) {
+      mKeyPositions.push_back(i);
+    }
+    mSchema.clear();
+    indexedstorage::AppendStrings(mSchema, columns);
+    indexedstorage::AppendStrings(mSchema, keyColumns);
+    mTransactionDepth = 0;
+    mSnapshot = Snapshot::Open(mPath + ".snap", mSchema, mColumns.size(), mKeyPositions);
+    if (!mSnapshot) {
+      mDeltas.clear();
+      WriteSnapshot();
+    }
+    LoadLog();
+  }
+
+  void Insert(const std::vector<std::string>& allColumnValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    InsertRow(allColumnValues);
+    EndWrite();
+  }
+
+  std::vector<std::vector<std::string>> List() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::vector<std::string>> rows;
+    ForEachRow(*mSnapshot, mDeltas, mKeyPositions, [&rows](const std::vector<StorageValueView>& values) {
+      rows.push_back(ToStrings(values));
+      return true;
+    });
+    return rows;
+  }
+
+  void Update(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    UpdateRows(updateColumns, updateValues, queryColumns, queryValues);
+    EndWrite();
+  }
+
+  void Delete(const std::vector<std::string>& queryColumns, const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& row : Match(queryColumns, queryValues)) {
+      RemoveRow(JoinKey(GetViews(row), mKeyPositions));
+    }
+    EndWrite();
+  }
+
+  std::vector<std::vector<std::string>> Find(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return Match(queryColumns, queryValues);
+  }
+
+  void InsertBatch(const std::vector<std::vector<std::string>>& rows) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mTransactionDepth;
+    try {
+      for (const auto& row : rows) {
+        InsertRow(row);
+      }
+    } catch (...) {
+      --mTransactionDepth;
+      EndWrite();
+      throw;
+    }
+    --mTransactionDepth;
+    EndWrite();
+  }
+
+  void UpdateBatch(const std::vector<StorageTableUpdate>& updates) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mTransactionDepth;
+    try {
+      for (const auto& update : updates) {
+        UpdateRows(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+      }
+    } catch (...) {
+      --mTransactionDepth;
+      EndWrite();
+      throw;
+    }
+    --mTransactionDepth;
+    EndWrite();
+  }
+
+  void BeginTransaction() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mTransactionDepth;
+  }
+
+  void CommitTransaction() override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTransactionDepth > 0) {
+      --mTransactionDepth;
+      EndWrite();
+    }
+  }
+
+  std::unique_ptr<StorageTableCursor> OpenCursor(const StorageTableQuery& query) override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (query.queryColumns.size() != query.queryValues.size()) {
+      throw BadInputError("Expected a value for each query column");
+    }
+    for (const auto& column : query.queryColumns) {
+      GetPosition(column);
+    }
+    Deltas deltas = mDeltas;
+    return std::unique_ptr<StorageTableCursor>(
+        new Cursor(mSnapshot, std::move(deltas), mKeyPositions, query, mColumnPositions));
+  }
+
+  uint64_t GetSnapshotRowCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSnapshot->GetRowCount();
+  }
+
+  size_t GetDeltaCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDeltas.size();
+  }
+
+private:
+  static std::vector<std::string> ToStrings(const std::vector<StorageValueView>& values) {
+    std::vector<std::string> strings;
+    strings.reserve(values.size());
+    for (const auto& value : values) {
+      strings.push_back(value.ToString());
+    }
+    return strings;
+  }
+
+  size_t GetPosition(const std::string& column) const {
+    auto position = mColumnPositions.find(column);
+    if (position == mColumnPositions.end()) {
+      throw BadInputError("Unknown storage table column: " + column);
+    }
+    return position->second;
+  }
+
+  // Rows whose columns all equal the query. A query on every key column is one lookup in the deltas and, failing
+  // that, in the snapshot index. Other queries scan the table.
+  std::vector<std::vector<std::string>> Match(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) const {
+    if (queryColumns.size() != queryValues.size()) {
+      throw BadInputError("Expected a value for each query column");
+    }
+    Conditions conditions;
+    std::vector<StorageValueView> key(mColumns.size());
+    std::vector<bool> isKeySet(mColumns.size(), false);
+    for (size_t i = 0; i < queryColumns.size(); ++i) {
+      size_t position = GetPosition(queryColumns[i]);
+      conditions.emplace_back(position, &queryValues[i]);
+      key[position] = StorageValueView(queryValues[i]);
+      isKeySet[position] = true;
+    }
+    bool isFullKey = true;
+    for (size_t keyPosition : mKeyPositions) {
+      isFullKey = isFullKey && isKeySet[keyPosition];
+    }
+    std::vector<std::vector<std::string>> rows;
+    if (isFullKey) {
+      std::string joinedKey = JoinKey(key, mKeyPositions);
+      auto delta = mDeltas.find(joinedKey);
+      std::vector<StorageValueView> values;
+      if (delta != mDeltas.end()) {
+        if (!delta->second.isRemoved && Matches(GetViews(delta->second.values), conditions)) {
+          rows.push_back(delta->second.values);
+        }
+      } else if (mSnapshot->Find(joinedKey, values) >= 0 && Matches(values, conditions)) {
+        rows.push_back(ToStrings(values));
+      }
+      return rows;
+    }
+    ForEachRow(*mSnapshot, mDeltas, mKeyPositions, [&](const std::vector<StorageValueView>& values) {
+      if (Matches(values, conditions)) {
+        rows.push_back(ToStrings(values));
+      }
+      return true;
+    });
+    return rows;
+  }
+
+  void InsertRow(const std::vector<std::string>& allColumnValues) {
+    if (allColumnValues.size() != mColumns.size()) {
+      throw BadInputError("Insert expects a value for each of the " + std::to_string(mColumns.size()) + " columns");
+    }
+    std::string payload;
+    indexedstorage::AppendStrings(payload, allColumnValues);
+    Append(indexedstorage::EncodeRecord(indexedstorage::Put, 0, payload));
+    Delta& delta = mDeltas[JoinKey(GetViews(allColumnValues), mKeyPositions)];
+    delta.isRemoved = false;
+    delta.values = allColumnValues;
+  }
+
+  void RemoveRow(const std::string& key) {
+    Append(indexedstorage::EncodeRecord(indexedstorage::Remove, 0, key));
+    Delta& delta = mDeltas[key];
+    delta.isRemoved = true;
+    delta.values.clear();
+  }
+
+  void UpdateRows(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) {
+    if (updateColumns.size() != updateValues.size()) {
+      throw BadInputError("Update expects a value for each update column");
+    }
+    std::vector<size_t> positions;
+    for (const auto& column : updateColumns) {
+      positions.push_back(GetPosition(column));
+    }
+    for (auto& row : Match(queryColumns, queryValues)) {
+      std::string oldKey = JoinKey(GetViews(row), mKeyPositions);
+      for (size_t j = 0; j < positions.size(); ++j) {
+        row[positions[j]] = updateValues[j];
+      }
+      if (JoinKey(GetViews(row), mKeyPositions) != oldKey) {
+        RemoveRow(oldKey);
+      }
+      InsertRow(row);
+    }
+  }
+
+  void Append(const std::string& record) {
+    mLog.write(record.data(), static_cast<std::streamsize>(record.size()));
+    mLogSize += static_cast<int64_t>(record.size());
+    if (!mLog) {
+      throw FileIOError("Failed to write storage log " + mPath + ".log");
+    }
+  }
+
+  // Flushes the log outside transactions, and folds it into a new snapshot once it outgrew the settings
+  void EndWrite() {
+    if (mTransactionDepth > 0) {
+      return;
+    }
+    if (!mLog.flush()) {
+      throw FileIOError("Failed to write storage log " + mPath + ".log");
+    }
+    if (mDeltas.size() > mSettings.maxDeltaRows || mLogSize > mSettings.maxDeltaBytes) {
+      try {
+        WriteSnapshot();
+        ResetLog();
+      } catch (const FileIOError&) {
+        // The snapshot may still be mapped by other processes on platforms that cannot replace mapped files; the log
+        // keeps every write, so the next write tries again
+      }
+    }
+  }
+
+  void WriteSnapshot() {
+    std::string temporaryPath = mPath + ".snap.tmp";
+    std::shared_ptr<Snapshot> current = mSnapshot;
+    const Deltas& deltas = mDeltas;
+    const std::vector<size_t>& keyPositions = mKeyPositions;
+    Snapshot::Write(temporaryPath, mSchema, mKeyPositions, [&current, &deltas, &keyPositions](
+        const std::function<void(const std::vector<StorageValueView>&)>& write) {
+      if (current) {
+        ForEachRow(*current, deltas, keyPositions, [&write](const std::vector<StorageValueView>& values) {
+          write(values);
+          return true;
+        });
+      } else {
+        for (const auto& delta : deltas) {
+          if (!delta.second.isRemoved) {
+            write(GetViews(delta.second.values));
+          }
+        }
+      }
+    });
+    std::string path = mPath + ".snap";
+    // Drop this table's mapping, which would keep the file from being replaced on Windows. Elsewhere the rename
+    // replaces the file atomically while open cursors and other processes keep their mapping of the old one.
+    mSnapshot.reset();
+    current.reset();
+    if (!indexedstorage::ReplaceTableFile(temporaryPath, path)) {
+      std::remove(temporaryPath.c_str());
+      mSnapshot = Snapshot::Open(path, mSchema, mColumns.size(), mKeyPositions);
+      throw FileIOError("Failed to replace storage snapshot " + path);
+    }
+    mSnapshot = Snapshot::Open(path, mSchema, mColumns.size(), mKeyPositions);
+    if (!mSnapshot) {
+      throw FileIOError("Failed to open storage snapshot " + path);
+    }
+    mDeltas.clear();
+  }
+
+  std::string EncodeLogHeader() const {
+    return std::string(kLogMagic, sizeof(kLogMagic)) + indexedstorage::EncodeRecord(indexedstorage::Schema, 0, mSchema);
+  }
+
+  void ResetLog() {
+    if (mLog.is_open()) {
+      mLog.close();
+    }
+    mLog.clear();
+    mLog.open(mPath + ".log", std::ios::binary | std::ios::out | std::ios::trunc);
+    std::string header = EncodeLogHeader();
+    mLog.write(header.data(), static_cast<std::streamsize>(header.size()));
+    if (!mLog.flush()) {
+      throw FileIOError("Failed to write storage log " + mPath + ".log");
+    }
+    mLogSize = static_cast<int64_t>(header.size());
+  }
+
+  // Replays the log into the deltas. A log of another schema is dropped, and a record torn by a crash ends it.
+  void LoadLog() {
+    if (mLog.is_open()) {
+      mLog.close();
+    }
+    mDeltas.clear();
+    std::string header = EncodeLogHeader();
+    std::ifstream in(mPath + ".log", std::ios::binary);
+    std::string prefix(header.size(), '\0');
+    if (!in || !in.read(&prefix[0], static_cast<std::streamsize>(prefix.size())) || prefix != header) {
+      in.close();
+      ResetLog();
+      return;
+    }
+    in.seekg(0, std::ios::end);
+    int64_t fileSize = static_cast<int64_t>(in.tellg());
+    int64_t size = static_cast<int64_t>(header.size());
+    in.seekg(size);
+    char recordHeader[indexedstorage::kRecordHeaderSize];
+    std::string payload;
+    std::vector<std::string> values;
+    bool isDamaged = false;
+    while (in.read(recordHeader, sizeof(recordHeader))) {
+      uint64_t payloadSize = indexedstorage::ReadUint(recordHeader, 4);
+      // The header is not verified yet, a torn size must not drive the allocation
+      int64_t available = fileSize - size - static_cast<int64_t>(indexedstorage::kRecordHeaderSize);
+      if (payloadSize > static_cast<uint64_t>(available)) {
+        isDamaged = true;
+        break;
+      }
+      payload.resize(static_cast<size_t>(payloadSize));
+      if (payloadSize > 0 && !in.read(&payload[0], static_cast<std::streamsize>(payloadSize))) {
+        isDamaged = true;
+        break;
+      }
+      std::string body(recordHeader + 8, indexedstorage::kRecordHeaderSize - 8);
+      body.append(payload);
+      size_t position = 0;
+      uint8_t type = static_cast<uint8_t>(recordHeader[8]);
+      if (indexedstorage::Checksum(body.data(), body.size()) != indexedstorage::ReadUint(recordHeader + 4, 4) ||
+          (type == indexedstorage::Put &&
+           (!indexedstorage::ReadStrings(payload, position, values) || values.size() != mColumns.size()))) {
+        isDamaged = true;
+        break;
+      }
+      if (type == indexedstorage::Put) {
+        Delta& delta = mDeltas[JoinKey(GetViews(values), mKeyPositions)];
+        delta.isRemoved = false;
+        delta.values = values;
+      } else if (type == indexedstorage::Remove) {
+        Delta& delta = mDeltas[payload];
+        delta.isRemoved = true;
+        delta.values.clear();
+      }
+      size += static_cast<int64_t>(indexedstorage::kRecordHeaderSize + payloadSize);
+    }
+    isDamaged = isDamaged || in.gcount() != 0;
+    in.close();
+    if (isDamaged) {
+      // Fold what was read into a snapshot, so the torn tail can be dropped with the log
+      WriteSnapshot();
+      ResetLog();
+      return;
+    }
+    mLog.clear();
+    mLog.open(mPath + ".log", std::ios::binary | std::ios::out | std::ios::app);
+    if (!mLog) {
+      throw FileIOError("Failed to open storage log " + mPath + ".log");
+    }
+    mLogSize = size;
+  }
+
+  const std::string mPath; // without extension
+  const MappedStorageDelegateSettings mSettings;
+  mutable std::mutex mMutex;
+  std::vector<std::string> mColumns;
+  std::unordered_map<std::string, size_t> mColumnPositions;
+  std::vector<size_t> mKeyPositions;
+  std::string mSchema;
+  std::shared_ptr<Snapshot> mSnapshot;
+  Deltas mDeltas;
+  std::ofstream mLog;
+  int64_t mLogSize = 0;
+  int mTransactionDepth = 0;
+};
+
+} // namespace mappedstorage
+/** @endcond */
+
+/**
+ * @brief StorageDelegate for read-mostly tables such as policies, templates and certificates, kept in memory-mapped
+ *        snapshot files
+ * 
+ * @note Each table is an immutable snapshot file, holding the rows followed by a hash index on the key columns, and
+ *       a log of the writes made since. Opening a table maps its snapshot and replays only the log, so startup does
+ *       not deserialize the rows, and processes on one host that open the same snapshot share its pages. Finds given
+ *       every key column are one lookup in the written rows and one probe of the mapped index. Other queries scan the
+ *       mapped rows. Cursors opened with OpenStorageTableCursor return snapshot values pointing into the mapping.
+ *       Once more than MappedStorageDelegateSettings::maxDeltaRows rows or maxDeltaBytes of log were written, the
+ *       table writes a new snapshot, renames it over the old one and starts a new log. Open cursors and other
+ *       processes keep reading the old snapshot; where mapped files cannot be replaced, the log keeps growing until
+ *       a later write succeeds. Encrypted columns are not supported, use CacheStorageType::OnDiskEncrypted. Write
+ *       heavy tables are better kept in an IndexedStorageDelegate. The directory passed as the storage path must
+ *       exist, and only one process may write to a table.
+ */
+class MappedStorageDelegate : public StorageDelegate {
+public:
+  /**
+   * @brief MappedStorageDelegate constructor
+   * 
+   * @param settings When tables write new snapshots
+   */
+  explicit MappedStorageDelegate(const MappedStorageDelegateSettings& settings = MappedStorageDelegateSettings())
+      : mSettings(settings) {}
+
+  /**
+   * @brief Map or create the snapshot of a table, recreating it if its schema changed
+   * 
+   * @param path Directory holding the table files
+   * @param mipComponent Component owning the table
+   * @param tableName Name of the table
+   * @param allColumns All columns of the table
+   * @param encryptedColumns Must be empty
+   * @param keyColumns Columns identifying unique rows, which are indexed
+   * 
+   * @return The table, or a mip::FileIOError, mip::BadInputError or mip::NotSupportedError
+   */
+  StorageTableResult CreateStorageTable(
+      const std::string& path,
+      const MipComponent mipComponent,
+      const std::string& tableName,
+      const std::vector<std::string>& allColumns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) const override {
+    try {
+      std::string filePath = GetFilePath(path, mipComponent, tableName);
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::shared_ptr<mappedstorage::Table>& table = mTables[filePath];
+      if (!table) {
+        table = std::make_shared<mappedstorage::Table>(filePath, mSettings);
+      }
+      table->Open(allColumns, encryptedColumns, keyColumns);
+      return StorageTableResult(table);
+    } catch (...) {
+      return StorageTableResult(std::current_exception());
+    }
+  }
+
+  /**
+   * @brief Gets settings used by this delegate: local storage, no in-memory storage
+   */
+  StorageSettings GetSettings() const override { return StorageSettings(false, false); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Path of the table files, without their extension
+  static std::string GetFilePath(const std::string& path, MipComponent mipComponent, const std::string& tableName) {
+    std::string name = "mip_" + std::to_string(static_cast<unsigned int>(mipComponent)) + "_";
+    for (char c : tableName) {
+      bool isSafe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+      name.push_back(isSafe ? c : '_');
+    }
+    std::string directory = path;
+    if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+      directory.push_back('/');
+    }
+    return directory + name;
+  }
+
+  const MappedStorageDelegateSettings mSettings;
+  mutable std::mutex mMutex;
+  mutable std::map<std::string, std::shared_ptr<mappedstorage::Table>> mTables;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_MAPPED_STORAGE_DELEGATE_H_
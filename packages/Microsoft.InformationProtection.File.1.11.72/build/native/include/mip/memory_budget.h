@@ -0,0 +1,544 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MemoryBudget, which caps the memory held by caches and in-flight buffers by category
+ * 
+ * @file memory_budget.h
+ */
+
+#ifndef API_MIP_MEMORY_BUDGET_H_
+#define API_MIP_MEMORY_BUDGET_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief What memory accounted against a MemoryBudget is used for
+ */
+enum class MemoryCategory : unsigned int {
+  Policy = 0,           /**< Policies, label catalogs and classification results */
+  RulePackages = 1,     /**< Sensitivity type rule packages */
+  Licenses = 2,         /**< Publishing and use licenses */
+  DecryptedContent = 3, /**< Decrypted segments kept for random access */
+  TemporaryStreams = 4, /**< Decrypted or protected temporary streams being produced */
+  HttpCache = 5,        /**< Cached HTTP responses */
+  Buffers = 6,          /**< Internal I/O buffers */
+  Other = 7,            /**< Anything else */
+};
+
+/**
+ * @brief Memory used by one category, from MemoryBudget::GetUsage
+ */
+struct MemoryCategoryUsage {
+  MemoryCategory category = MemoryCategory::Other; /**< Category */
+  int64_t cachedBytes = 0;   /**< Bytes held by the registered caches */
+  int64_t reservedBytes = 0; /**< Bytes held by outstanding reservations */
+  int64_t limitBytes = 0;    /**< Soft limit, 0 if the category is unlimited */
+  uint64_t trimCount = 0;    /**< Times the category's caches were trimmed to honor a limit */
+  uint64_t waitCount = 0;    /**< Reservations that had to wait for memory to be released */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace memorybudget {
+
+const size_t kCategoryCount = 8;
+
+// A registered cache. Its functions are only called with callMutex held, so Unregister returning means that they
+// will not be called again.
+struct Registration {
+  MemoryCategory category;
+  std::function<int64_t()> usage;
+  std::function<void(int64_t)> trim;
+  std::mutex callMutex;
+  bool isActive = true;
+
+  int64_t GetUsage() {
+    std::lock_guard<std::mutex> lock(callMutex);
+    return isActive ? usage() : 0;
+  }
+
+  int64_t Trim(int64_t maxBytes) {
+    std::lock_guard<std::mutex> lock(callMutex);
+    if (!isActive) {
+      return 0;
+    }
+    trim(maxBytes);
+    return usage();
+  }
+};
+
+struct State {
+  std::mutex mutex;
+  std::condition_variable condition;
+  int64_t totalLimit = 0;
+  int64_t limits[kCategoryCount] = {};
+  int64_t reserved[kCategoryCount] = {};
+  uint64_t trimCounts[kCategoryCount] = {};
+  uint64_t waitCounts[kCategoryCount] = {};
+  std::vector<std::shared_ptr<Registration>> registrations;
+
+  int64_t GetTotalReservedLocked() const {
+    int64_t total = 0;
+    for (size_t i = 0; i < kCategoryCount; ++i) {
+      total += reserved[i];
+    }
+    return total;
+  }
+
+  // A reservation larger than a limit is still granted, alone, so that it cannot wait forever
+  bool FitsLocked(size_t category, int64_t bytes) const {
+    int64_t totalReserved = GetTotalReservedLocked();
+    bool isCategoryFit = limits[category] <= 0 || reserved[category] == 0 ||
+        reserved[category] + bytes <= limits[category];
+    bool isTotalFit = totalLimit <= 0 || totalReserved == 0 || totalReserved + bytes <= totalLimit;
+    return isCategoryFit && isTotalFit;
+  }
+};
+
+struct Usage {
+  std::shared_ptr<Registration> registration;
+  int64_t bytes;
+};
+
+// Trims the largest caches first until the excess is gone, returns what is left of it
+inline int64_t TrimLargestFirst(std::vector<Usage>& usages, int64_t excess) {
+  std::sort(usages.begin(), usages.end(), [](const Usage& a, const Usage& b) { return a.bytes > b.bytes; });
+  for (auto& usage : usages) {
+    if (excess <= 0) {
+      break;
+    }
+    if (usage.bytes <= 0) {
+      continue;
+    }
+    int64_t remaining = usage.registration->Trim((std::max)(usage.bytes - excess, static_cast<int64_t>(0)));
+    excess -= usage.bytes - remaining;
+    usage.bytes = remaining;
+  }
+  return excess;
+}
+
+} // namespace memorybudget
+/** @endcond */
+
+/**
+ * @brief A cache's registration with a MemoryBudget, which ends when it is destroyed
+ */
+class MemoryBudgetRegistration {
+public:
+  /** @cond DOXYGEN_HIDE */
+  MemoryBudgetRegistration(
+      const std::weak_ptr<memorybudget::State>& state,
+      const std::shared_ptr<memorybudget::Registration>& registration)
+      : mState(state),
+        mRegistration(registration) {}
+  /** @endcond */
+
+  /**
+   * @brief End the registration. Once this returns, the cache's functions are no longer called.
+   */
+  void Unregister() {
+    if (auto state = mState.lock()) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto& registrations = state->registrations;
+      registrations.erase(std::remove(registrations.begin(), registrations.end(), mRegistration), registrations.end());
+    }
+    std::lock_guard<std::mutex> lock(mRegistration->callMutex);
+    mRegistration->isActive = false;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~MemoryBudgetRegistration() { Unregister(); }
+
+private:
+  MemoryBudgetRegistration(const MemoryBudgetRegistration&) = delete;
+  MemoryBudgetRegistration& operator=(const MemoryBudgetRegistration&) = delete;
+
+  std::weak_ptr<memorybudget::State> mState;
+  std::shared_ptr<memorybudget::Registration> mRegistration;
+  /** @endcond */
+};
+
+/**
+ * @brief Memory reserved from a MemoryBudget, given back when it is destroyed or released
+ */
+class MemoryReservation {
+public:
+  /** @brief An empty reservation */
+  MemoryReservation() : mCategory(MemoryCategory::Other), mBytes(0) {}
+
+  /** @cond DOXYGEN_HIDE */
+  MemoryReservation(const std::shared_ptr<memorybudget::State>& state, MemoryCategory category, int64_t bytes)
+      : mState(state),
+        mCategory(category),
+        mBytes(bytes) {}
+
+  MemoryReservation(MemoryReservation&& other)
+      : mState(std::move(other.mState)),
+        mCategory(other.mCategory),
+        mBytes(other.mBytes) {
+    other.mState.reset();
+    other.mBytes = 0;
+  }
+
+  MemoryReservation& operator=(MemoryReservation&& other) {
+    if (this != &other) {
+      Release();
+      mState = std::move(other.mState);
+      mCategory = other.mCategory;
+      mBytes = other.mBytes;
+      other.mState.reset();
+      other.mBytes = 0;
+    }
+    return *this;
+  }
+
+  ~MemoryReservation() { Release(); }
+  /** @endcond */
+
+  /**
+   * @brief Check if memory is reserved
+   * 
+   * @return False for an empty reservation, a reservation that timed out or a released one
+   */
+  bool IsValid() const { return mState != nullptr; }
+
+  /**
+   * @brief Get the number of bytes reserved
+   * 
+   * @return Bytes
+   */
+  int64_t GetBytes() const { return mBytes; }
+
+  /**
+   * @brief Give the memory back to the budget
+   */
+  void Release() {
+    if (!mState) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->reserved[static_cast<size_t>(mCategory)] -= mBytes;
+    }
+    mState->condition.notify_all();
+    mState.reset();
+    mBytes = 0;
+  }
+
+private:
+  MemoryReservation(const MemoryReservation&) = delete;
+  MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+  std::shared_ptr<memorybudget::State> mState;
+  MemoryCategory mCategory;
+  int64_t mBytes;
+};
+
+/**
+ * @brief Caps the memory held by caches and in-flight buffers, with a soft limit per category and for the total
+ * 
+ * @note Create one budget for the application and pass it to the caches and operations that account against it, such as
+ *       SensitivityTypesCache, CachingHttpDelegate, DecryptedSegmentCacheStream, SpillStream and
+ *       DecryptContainerChildren; memory allocated inside the SDK binary is not accounted. Caches register a function
+ *       reporting their size and one trimming them. After a cache grows it calls Enforce, which trims the largest
+ *       caches of every category over its limit, then the largest caches overall while the total is over its limit.
+ *       Memory that cannot be dropped, such as a temporary stream being produced, is reserved with Reserve instead: a
+ *       reservation first makes room by trimming caches and then waits while the reservations already outstanding would
+ *       exceed the limit. The limits are soft: a cache may exceed its limit until it calls Enforce, and a reservation
+ *       larger than a limit is granted once it is alone.
+ */
+class MemoryBudget {
+public:
+  /** @brief Reports the current size of a cache in bytes */
+  typedef std::function<int64_t()> UsageFunction;
+  /** @brief Drops cached items until the cache holds at most the given number of bytes */
+  typedef std::function<void(int64_t maxBytes)> TrimFunction;
+
+  /**
+   * @brief MemoryBudget constructor
+   * 
+   * @param totalLimit Soft limit for all categories together, 0 for none
+   */
+  explicit MemoryBudget(int64_t totalLimit = 0) : mState(std::make_shared<memorybudget::State>()) {
+    mState->totalLimit = (std::max)(totalLimit, static_cast<int64_t>(0));
+  }
+
+  /**
+   * @brief Set the soft limit of a category
+   * 
+   * @param category Category
+   * @param limitBytes Limit in bytes, 0 for none
+   */
+  void SetLimit(MemoryCategory category, int64_t limitBytes) {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->limits[GetIndex(category)] = (std::max)(limitBytes, static_cast<int64_t>(0));
+    }
+    mState->condition.notify_all();
+    Enforce();
+  }
+
+  /**
+   * @brief Get the soft limit of a category
+   * 
+   * @param category Category
+   * 
+   * @return Limit in bytes, 0 for none
+   */
+  int64_t GetLimit(MemoryCategory category) const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->limits[GetIndex(category)];
+  }
+
+  /**
+   * @brief Set the soft limit for all categories together
+   * 
+   * @param limitBytes Limit in bytes, 0 for none
+   */
+  void SetTotalLimit(int64_t limitBytes) {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->totalLimit = (std::max)(limitBytes, static_cast<int64_t>(0));
+    }
+    mState->condition.notify_all();
+    Enforce();
+  }
+
+  /**
+   * @brief Get the soft limit for all categories together
+   * 
+   * @return Limit in bytes, 0 for none
+   */
+  int64_t GetTotalLimit() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->totalLimit;
+  }
+
+  /**
+   * @brief Account a cache against the budget
+   * 
+   * @param category Category of the cached data
+   * @param usage Reports the cache's size
+   * @param trim Trims the cache
+   * 
+   * @return Registration, which must be destroyed before the cache is. The functions are called without any of the
+   *         budget's locks held, possibly from another thread, but never once the registration is gone.
+   */
+  std::shared_ptr<MemoryBudgetRegistration> Register(
+      MemoryCategory category,
+      const UsageFunction& usage,
+      const TrimFunction& trim) {
+    if (!usage || !trim) {
+      throw BadInputError("MemoryBudget::Register requires usage and trim functions");
+    }
+    GetIndex(category);
+    auto registration = std::make_shared<memorybudget::Registration>();
+    registration->category = category;
+    registration->usage = usage;
+    registration->trim = trim;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->registrations.push_back(registration);
+    }
+    return std::make_shared<MemoryBudgetRegistration>(mState, registration);
+  }
+
+  /**
+   * @brief Trim the registered caches until every limit is honored, as far as trimming caches can
+   * 
+   * @note Caches call this after they grow. A limit's target is what is left of it once reservations are counted.
+   */
+  void Enforce() {
+    std::vector<std::shared_ptr<memorybudget::Registration>> registrations;
+    int64_t limits[memorybudget::kCategoryCount];
+    int64_t reserved[memorybudget::kCategoryCount];
+    int64_t totalLimit = 0;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      registrations = mState->registrations;
+      std::copy(mState->limits, mState->limits + memorybudget::kCategoryCount, limits);
+      std::copy(mState->reserved, mState->reserved + memorybudget::kCategoryCount, reserved);
+      totalLimit = mState->totalLimit;
+    }
+    if (registrations.empty()) {
+      return;
+    }
+    std::vector<memorybudget::Usage> all;
+    all.reserve(registrations.size());
+    for (const auto& registration : registrations) {
+      all.push_back(memorybudget::Usage{registration, registration->GetUsage()});
+    }
+    uint64_t trimCounts[memorybudget::kCategoryCount] = {};
+    int64_t total = 0;
+    for (size_t category = 0; category < memorybudget::kCategoryCount; ++category) {
+      std::vector<memorybudget::Usage> usages;
+      int64_t cached = 0;
+      for (const auto& usage : all) {
+        if (GetIndex(usage.registration->category) == category) {
+          usages.push_back(usage);
+          cached += usage.bytes;
+        }
+      }
+      total += reserved[category];
+      if (limits[category] > 0 && cached + reserved[category] > limits[category]) {
+        int64_t excess = cached + reserved[category] - limits[category];
+        cached -= excess - memorybudget::TrimLargestFirst(usages, excess);
+        ++trimCounts[category];
+      }
+      total += cached;
+    }
+    if (totalLimit > 0 && total > totalLimit) {
+      int64_t before[memorybudget::kCategoryCount] = {};
+      for (auto& usage : all) {
+        usage.bytes = usage.registration->GetUsage();
+        before[GetIndex(usage.registration->category)] += usage.bytes;
+      }
+      memorybudget::TrimLargestFirst(all, total - totalLimit);
+      int64_t after[memorybudget::kCategoryCount] = {};
+      for (const auto& usage : all) {
+        after[GetIndex(usage.registration->category)] += usage.bytes;
+      }
+      for (size_t category = 0; category < memorybudget::kCategoryCount; ++category) {
+        trimCounts[category] += after[category] < before[category] ? 1 : 0;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    for (size_t category = 0; category < memorybudget::kCategoryCount; ++category) {
+      mState->trimCounts[category] += trimCounts[category];
+    }
+  }
+
+  /**
+   * @brief Reserve memory for data that cannot be dropped, waiting for it if needed
+   * 
+   * @param category Category
+   * @param bytes Bytes to reserve
+   * @param timeout Longest wait for other reservations to be released
+   * 
+   * @return Reservation, or an invalid one if the memory did not become available in time
+   */
+  MemoryReservation Reserve(
+      MemoryCategory category,
+      int64_t bytes,
+      std::chrono::milliseconds timeout = (std::chrono::milliseconds::max)()) {
+    size_t index = GetIndex(category);
+    bytes = (std::max)(bytes, static_cast<int64_t>(0));
+    {
+      std::unique_lock<std::mutex> lock(mState->mutex);
+      if (!mState->FitsLocked(index, bytes)) {
+        ++mState->waitCounts[index];
+        auto isFit = [this, index, bytes] { return mState->FitsLocked(index, bytes); };
+        if (timeout == (std::chrono::milliseconds::max)()) {
+          mState->condition.wait(lock, isFit);
+        } else if (!mState->condition.wait_for(lock, timeout, isFit)) {
+          return MemoryReservation();
+        }
+      }
+      mState->reserved[index] += bytes;
+    }
+    // Make room for the reservation in the caches
+    Enforce();
+    return MemoryReservation(mState, category, bytes);
+  }
+
+  /**
+   * @brief Reserve memory without waiting
+   * 
+   * @param category Category
+   * @param bytes Bytes to reserve
+   * 
+   * @return Reservation, or an invalid one if the memory is not available
+   */
+  MemoryReservation TryReserve(MemoryCategory category, int64_t bytes) {
+    return Reserve(category, bytes, std::chrono::milliseconds(0));
+  }
+
+  /**
+   * @brief Get the memory used by each category
+   * 
+   * @return One entry per category
+   */
+  std::vector<MemoryCategoryUsage> GetUsage() const {
+    std::vector<std::shared_ptr<memorybudget::Registration>> registrations;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      registrations = mState->registrations;
+    }
+    std::vector<MemoryCategoryUsage> usages(memorybudget::kCategoryCount);
+    for (const auto& registration : registrations) {
+      usages[GetIndex(registration->category)].cachedBytes += registration->GetUsage();
+    }
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    for (size_t category = 0; category < memorybudget::kCategoryCount; ++category) {
+      usages[category].category = static_cast<MemoryCategory>(category);
+      usages[category].reservedBytes = mState->reserved[category];
+      usages[category].limitBytes = mState->limits[category];
+      usages[category].trimCount = mState->trimCounts[category];
+      usages[category].waitCount = mState->waitCounts[category];
+    }
+    return usages;
+  }
+
+  /**
+   * @brief Get the memory used by all categories together
+   * 
+   * @return Cached and reserved bytes
+   */
+  int64_t GetTotalUsage() const {
+    int64_t total = 0;
+    for (const auto& usage : GetUsage()) {
+      total += usage.cachedBytes + usage.reservedBytes;
+    }
+    return total;
+  }
+
+private:
+  static size_t GetIndex(MemoryCategory category) {
+    size_t index = static_cast<size_t>(category);
+    if (index >= memorybudget::kCategoryCount) {
+      throw BadInputError("Unknown memory category");
+    }
+    return index;
+  }
+
+  std::shared_ptr<memorybudget::State> mState;
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_MEMORY_BUDGET_H_
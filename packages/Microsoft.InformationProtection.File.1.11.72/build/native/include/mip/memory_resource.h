@@ -0,0 +1,260 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MemoryResource, an application-supplied allocator for large buffers and caches
+ *
+ * @file memory_resource.h
+ */
+
+#ifndef API_MIP_MEMORY_RESOURCE_H_
+#define API_MIP_MEMORY_RESOURCE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A class that defines the interface to an application-supplied allocator
+ *
+ * @note Modeled on std::pmr::memory_resource, which is not available in the C++ standard the SDK headers target.
+ *       Applications implement DoAllocate/DoDeallocate, for example over a jemalloc arena per tenant or a NUMA-local
+ *       heap. Implementations must be thread-safe.
+ */
+class MemoryResource {
+public:
+  /**
+   * @brief Allocate memory
+   *
+   * @param bytes Size of the allocation
+   * @param alignment Alignment of the allocation, a power of two
+   *
+   * @return Pointer to the allocation; never nullptr, failures throw std::bad_alloc
+   */
+  void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) { return DoAllocate(bytes, alignment); }
+
+  /**
+   * @brief Free memory previously obtained from Allocate
+   *
+   * @param pointer Pointer returned by Allocate
+   * @param bytes Size passed to Allocate
+   * @param alignment Alignment passed to Allocate
+   */
+  void Deallocate(void* pointer, size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    DoDeallocate(pointer, bytes, alignment);
+  }
+
+  /**
+   * @brief Whether memory allocated by this resource can be freed by another one, and vice versa
+   *
+   * @param other Other resource
+   *
+   * @return true if the resources are interchangeable
+   */
+  bool IsEqual(const MemoryResource& other) const { return this == &other || DoIsEqual(other); }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~MemoryResource() {}
+protected:
+  MemoryResource() {}
+  virtual void* DoAllocate(size_t bytes, size_t alignment) = 0;
+  virtual void DoDeallocate(void* pointer, size_t bytes, size_t alignment) = 0;
+  virtual bool DoIsEqual(const MemoryResource& other) const { return this == &other; }
+  /** @endcond */
+};
+
+/**
+ * @brief MemoryResource allocating through the global operator new and delete
+ */
+class NewDeleteMemoryResource : public MemoryResource {
+  /** @cond DOXYGEN_HIDE */
+protected:
+  void* DoAllocate(size_t bytes, size_t alignment) override {
+    if (alignment > alignof(std::max_align_t)) {
+      // Over-allocate and keep the original pointer just before the aligned block
+      uint8_t* raw = static_cast<uint8_t*>(::operator new(bytes + alignment + sizeof(void*)));
+      uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+      reinterpret_cast<void**>(aligned)[-1] = raw;
+      return reinterpret_cast<void*>(aligned);
+    }
+    return ::operator new(bytes);
+  }
+
+  void DoDeallocate(void* pointer, size_t, size_t alignment) override {
+    if (pointer != nullptr && alignment > alignof(std::max_align_t)) {
+      pointer = static_cast<void**>(pointer)[-1];
+    }
+    ::operator delete(pointer);
+  }
+
+  bool DoIsEqual(const MemoryResource& other) const override {
+    return dynamic_cast<const NewDeleteMemoryResource*>(&other) != nullptr;
+  }
+  /** @endcond */
+};
+
+/**
+ * @brief Get the resource used where no MemoryResource is configured
+ *
+ * @return Process-wide NewDeleteMemoryResource
+ */
+inline const std::shared_ptr<MemoryResource>& GetDefaultMemoryResource() {
+  static const std::shared_ptr<MemoryResource> resource = std::make_shared<NewDeleteMemoryResource>();
+  return resource;
+}
+
+/**
+ * @brief MemoryResource that forwards to another one and counts the bytes it holds
+ *
+ * @note Useful to attribute SDK memory to a tenant, or to profile how much the SDK's buffers and caches hold.
+ */
+class CountingMemoryResource : public MemoryResource {
+public:
+  /**
+   * @brief CountingMemoryResource constructor
+   *
+   * @param upstream Resource performing the allocations, or nullptr for GetDefaultMemoryResource
+   */
+  explicit CountingMemoryResource(const std::shared_ptr<MemoryResource>& upstream = nullptr)
+      : mUpstream(upstream ? upstream : GetDefaultMemoryResource()) {}
+
+  /**
+   * @brief Get the bytes currently allocated
+   *
+   * @return Bytes in use
+   */
+  int64_t GetBytesInUse() const { return mBytesInUse; }
+
+  /**
+   * @brief Get the highest number of bytes allocated at once
+   *
+   * @return Peak bytes in use
+   */
+  int64_t GetPeakBytesInUse() const { return mPeakBytesInUse; }
+
+  /**
+   * @brief Get the number of allocations made
+   *
+   * @return Allocation count
+   */
+  uint64_t GetAllocationCount() const { return mAllocationCount; }
+
+  /** @cond DOXYGEN_HIDE */
+protected:
+  void* DoAllocate(size_t bytes, size_t alignment) override {
+    void* pointer = mUpstream->Allocate(bytes, alignment);
+    ++mAllocationCount;
+    int64_t inUse = mBytesInUse += static_cast<int64_t>(bytes);
+    int64_t peak = mPeakBytesInUse;
+    while (inUse > peak && !mPeakBytesInUse.compare_exchange_weak(peak, inUse)) {
+    }
+    return pointer;
+  }
+
+  void DoDeallocate(void* pointer, size_t bytes, size_t alignment) override {
+    mUpstream->Deallocate(pointer, bytes, alignment);
+    mBytesInUse -= static_cast<int64_t>(bytes);
+  }
+
+private:
+  std::shared_ptr<MemoryResource> mUpstream;
+  std::atomic<int64_t> mBytesInUse{0};
+  std::atomic<int64_t> mPeakBytesInUse{0};
+  std::atomic<uint64_t> mAllocationCount{0};
+  /** @endcond */
+};
+
+/**
+ * @brief Standard allocator drawing from a MemoryResource, for use with standard containers
+ *
+ * @note Modeled on std::pmr::polymorphic_allocator. The allocator shares ownership of its resource, so containers
+ *       may outlive the component that created them.
+ */
+template <typename T>
+class MemoryResourceAllocator {
+public:
+  /** @cond DOXYGEN_HIDE */
+  typedef T value_type;
+
+  template <typename U>
+  friend class MemoryResourceAllocator;
+  /** @endcond */
+
+  /**
+   * @brief MemoryResourceAllocator constructor
+   *
+   * @param resource Resource to draw from, or nullptr for GetDefaultMemoryResource
+   */
+  MemoryResourceAllocator(const std::shared_ptr<MemoryResource>& resource = nullptr)  // NOLINT: implicit by design
+      : mResource(resource ? resource : GetDefaultMemoryResource()) {}
+
+  /** @cond DOXYGEN_HIDE */
+  template <typename U>
+  MemoryResourceAllocator(const MemoryResourceAllocator<U>& other) : mResource(other.mResource) {}
+
+  T* allocate(size_t count) {
+    if (count > static_cast<size_t>(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(mResource->Allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* pointer, size_t count) { mResource->Deallocate(pointer, count * sizeof(T), alignof(T)); }
+
+  template <typename U>
+  bool operator==(const MemoryResourceAllocator<U>& other) const { return mResource->IsEqual(*other.mResource); }
+
+  template <typename U>
+  bool operator!=(const MemoryResourceAllocator<U>& other) const { return !(*this == other); }
+  /** @endcond */
+
+  /**
+   * @brief Get the resource the allocator draws from
+   *
+   * @return Memory resource
+   */
+  const std::shared_ptr<MemoryResource>& GetResource() const { return mResource; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<MemoryResource> mResource;
+  /** @endcond */
+};
+
+/** @brief Byte buffer drawing from a MemoryResource */
+typedef std::vector<uint8_t, MemoryResourceAllocator<uint8_t>> ResourceByteVector;
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_MEMORY_RESOURCE_H_
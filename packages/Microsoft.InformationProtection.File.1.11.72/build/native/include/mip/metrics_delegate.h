@@ -0,0 +1,226 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MetricsDelegate, which receives monotonic stage durations and byte counts, and a timing stream
+ * 
+ * @file metrics_delegate.h
+ */
+
+#ifndef API_MIP_METRICS_DELEGATE_H_
+#define API_MIP_METRICS_DELEGATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A timed stage of an operation
+ */
+struct StageMetric {
+  std::string operation;                    /**< Operation the stage belongs to, e.g. "Commit" */
+  std::string stage;                        /**< Stage name, e.g. "OutputWrite" */
+  std::chrono::nanoseconds duration;        /**< Monotonic duration of the stage */
+  int64_t bytes = 0;                        /**< Bytes processed by the stage, or 0 if not applicable */
+  std::shared_ptr<void> loggerContext;      /**< Logger context passed to the operation, for correlation */
+};
+
+/**
+ * @brief Delegate receiving stage timings. Implementations must be thread-safe.
+ */
+class MetricsDelegate {
+public:
+  /**
+   * @brief Called when a stage completes
+   * 
+   * @param metric Stage timing
+   * 
+   * @note Called on the thread that completed the stage. Keep implementations cheap, since they run on the
+   *       operation's critical path.
+   */
+  virtual void OnStageCompleted(const StageMetric& metric) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~MetricsDelegate() {}
+  /** @endcond */
+};
+
+/**
+ * @brief A Stream decorator that accumulates the time spent in, and bytes passing through, another stream
+ * 
+ * @note Counters are atomic, so they may be sampled from another thread while the stream is in use.
+ */
+class TimingStream : public Stream {
+public:
+  /**
+   * @brief TimingStream constructor
+   * 
+   * @param innerStream Stream being timed
+   */
+  explicit TimingStream(const std::shared_ptr<Stream>& innerStream)
+      : mInnerStream(innerStream),
+        mReadNs(0),
+        mWriteNs(0),
+        mFlushNs(0),
+        mBytesRead(0),
+        mBytesWritten(0) {
+    if (!mInnerStream) {
+      throw BadInputError("TimingStream requires an inner stream");
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    Clock clock(mReadNs);
+    int64_t bytesRead = mInnerStream->Read(buffer, bufferLength);
+    mBytesRead += bytesRead;
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    Clock clock(mWriteNs);
+    int64_t bytesWritten = mInnerStream->Write(buffer, bufferLength);
+    mBytesWritten += bytesWritten;
+    return bytesWritten;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override {
+    Clock clock(mFlushNs);
+    return mInnerStream->Flush();
+  }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mInnerStream->Seek(position); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mInnerStream->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mInnerStream->CanWrite(); }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mInnerStream->Position(); }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mInnerStream->Size(); }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t value) override { mInnerStream->Size(value); }
+
+  /** @brief Get the total time spent in Read */
+  std::chrono::nanoseconds GetReadDuration() const { return std::chrono::nanoseconds(mReadNs.load()); }
+
+  /** @brief Get the total time spent in Write */
+  std::chrono::nanoseconds GetWriteDuration() const { return std::chrono::nanoseconds(mWriteNs.load()); }
+
+  /** @brief Get the total time spent in Flush */
+  std::chrono::nanoseconds GetFlushDuration() const { return std::chrono::nanoseconds(mFlushNs.load()); }
+
+  /** @brief Get the total number of bytes read */
+  int64_t GetBytesRead() const { return mBytesRead; }
+
+  /** @brief Get the total number of bytes written */
+  int64_t GetBytesWritten() const { return mBytesWritten; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~TimingStream() { }
+
+private:
+  class Clock {
+  public:
+    explicit Clock(std::atomic<int64_t>& total) : mTotal(total), mStart(std::chrono::steady_clock::now()) {}
+    ~Clock() {
+      mTotal += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - mStart).count();
+    }
+
+  private:
+    std::atomic<int64_t>& mTotal;
+    std::chrono::steady_clock::time_point mStart;
+  };
+
+  std::shared_ptr<Stream> mInnerStream;
+  std::atomic<int64_t> mReadNs;
+  std::atomic<int64_t> mWriteNs;
+  std::atomic<int64_t> mFlushNs;
+  std::atomic<int64_t> mBytesRead;
+  std::atomic<int64_t> mBytesWritten;
+  /** @endcond */
+}; // class TimingStream
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_METRICS_DELEGATE_H_
@@ -0,0 +1,219 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MicrobenchmarkRegistry, which runs registered microbenchmarks into a BenchmarkRecorder
+ *
+ * @file microbenchmark.h
+ */
+
+#ifndef API_MIP_MICROBENCHMARK_H_
+#define API_MIP_MICROBENCHMARK_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/benchmark_recorder.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Iteration state handed to a microbenchmark body
+ *
+ * @note The body does its setup, then loops with `while (state.KeepRunning()) { ... }`. Only the loop is timed, minus
+ *       the time between PauseTiming and ResumeTiming.
+ */
+class MicrobenchmarkState {
+public:
+  /** @cond DOXYGEN_HIDE */
+  explicit MicrobenchmarkState(int64_t iterations) : mIterations(iterations) {}
+  /** @endcond */
+
+  /**
+   * @brief Advance to the next iteration
+   *
+   * @return true while iterations remain
+   */
+  bool KeepRunning() {
+    if (mCompleted == 0 && !mIsRunning) {
+      mIsRunning = true;
+      mStart = std::chrono::steady_clock::now();
+    }
+    if (mCompleted < mIterations) {
+      ++mCompleted;
+      return true;
+    }
+    PauseTiming();
+    return false;
+  }
+
+  /**
+   * @brief Stop the clock, e.g. to reset state between iterations
+   */
+  void PauseTiming() {
+    if (mIsRunning) {
+      mElapsed += std::chrono::steady_clock::now() - mStart;
+      mIsRunning = false;
+    }
+  }
+
+  /**
+   * @brief Restart the clock after PauseTiming
+   */
+  void ResumeTiming() {
+    if (!mIsRunning) {
+      mIsRunning = true;
+      mStart = std::chrono::steady_clock::now();
+    }
+  }
+
+  /**
+   * @brief Set the number of bytes one iteration processes, used to report throughput
+   *
+   * @param bytes Bytes per iteration
+   */
+  void SetBytesPerIteration(uint64_t bytes) { mBytesPerIteration = bytes; }
+
+  /** @cond DOXYGEN_HIDE */
+  int64_t GetIterations() const { return mIterations; }
+  uint64_t GetBytesPerIteration() const { return mBytesPerIteration; }
+  std::chrono::nanoseconds GetElapsed() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(mElapsed);
+  }
+
+private:
+  int64_t mIterations;
+  int64_t mCompleted = 0;
+  bool mIsRunning = false;
+  uint64_t mBytesPerIteration = 0;
+  std::chrono::steady_clock::time_point mStart;
+  std::chrono::steady_clock::duration mElapsed = std::chrono::steady_clock::duration::zero();
+  /** @endcond */
+};
+
+/**
+ * @brief Registry of microbenchmarks, run with automatically calibrated iteration counts
+ *
+ * @note Each benchmark is recorded in a BenchmarkRecorder under its name as the operation and its variant (cipher
+ *       mode and buffer size, file format, document name) as the format. One sample is recorded per repetition, holding
+ *       the mean time of one iteration, so the recorder's min/median/max describe the spread between repetitions. The
+ *       JSON output carries the SDK version, so runs against different SDK versions can be compared directly.
+ */
+class MicrobenchmarkRegistry {
+public:
+  /** @brief Body of a microbenchmark */
+  typedef std::function<void(MicrobenchmarkState& state)> Function;
+
+  /**
+   * @brief Register a microbenchmark
+   *
+   * @param name Benchmark name, e.g. "ProtectionHandler::EncryptBuffer"
+   * @param variant Variant, e.g. "CBC4K/65536"
+   * @param function Body
+   */
+  void Register(const std::string& name, const std::string& variant, const Function& function) {
+    if (!function) {
+      throw BadInputError("Microbenchmark requires a body");
+    }
+    mBenchmarks.push_back(Benchmark{name, variant, function});
+  }
+
+  /**
+   * @brief Run the registered microbenchmarks
+   *
+   * @param recorder Recorder receiving the results
+   * @param minTime Minimum timed duration of each repetition
+   * @param repetitions Number of repetitions per benchmark
+   * @param filter Only benchmarks whose "name/variant" contains this text are run
+   */
+  void Run(
+      BenchmarkRecorder& recorder,
+      std::chrono::milliseconds minTime = std::chrono::milliseconds(200),
+      int repetitions = 5,
+      const std::string& filter = std::string()) const {
+    for (const Benchmark& benchmark : mBenchmarks) {
+      if (!filter.empty() && (benchmark.name + "/" + benchmark.variant).find(filter) == std::string::npos) {
+        continue;
+      }
+      int64_t iterations = Calibrate(benchmark.function, minTime);
+      for (int i = 0; i < (std::max)(repetitions, 1); ++i) {
+        MicrobenchmarkState state(iterations);
+        benchmark.function(state);
+        recorder.Record(benchmark.name, benchmark.variant, state.GetBytesPerIteration(),
+            static_cast<uint64_t>(state.GetElapsed().count() / iterations));
+      }
+    }
+  }
+
+  /**
+   * @brief Get the number of registered benchmarks
+   *
+   * @return Benchmark count
+   */
+  size_t GetCount() const { return mBenchmarks.size(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Benchmark {
+    std::string name;
+    std::string variant;
+    Function function;
+  };
+
+  // Grows the iteration count tenfold until a run is long enough to extrapolate from, then scales it to minTime
+  static int64_t Calibrate(const Function& function, std::chrono::milliseconds minTime) {
+    const std::chrono::nanoseconds target = minTime;
+    int64_t iterations = 1;
+    while (true) {
+      MicrobenchmarkState state(iterations);
+      function(state);
+      std::chrono::nanoseconds elapsed = state.GetElapsed();
+      if (elapsed >= target || iterations >= kMaxIterations) {
+        return iterations;
+      }
+      if (elapsed >= target / 10) {
+        double scale = static_cast<double>(target.count()) / (std::max)(elapsed.count(), static_cast<int64_t>(1));
+        return (std::min)(static_cast<int64_t>(iterations * scale * 1.1) + 1, kMaxIterations);
+      }
+      iterations = (std::min)(iterations * 10, kMaxIterations);
+    }
+  }
+
+  static const int64_t kMaxIterations = 1000000000;
+
+  std::vector<Benchmark> mBenchmarks;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_MICROBENCHMARK_H_
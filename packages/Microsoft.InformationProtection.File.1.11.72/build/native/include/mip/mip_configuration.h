@@ -115,6 +115,8 @@ public:
    * @brief Set the LoggerDelegate (if any) override implementation
    * 
    * @param loggerDelegate LoggerDelegate override implementation
+   * 
+   * @note Pass an AsyncLoggerDelegate (async_logger_delegate.h) to keep file writes off the logging threads.
    */
   void SetLoggerDelegate(const std::shared_ptr<LoggerDelegate>& loggerDelegate) { mLoggerDelegate = loggerDelegate; }
 
@@ -155,6 +157,15 @@ public:
     return mJsonDelegate;
   }
 
+  /**
+   * @brief Set the JsonDelegate (if any) override implementation
+   * 
+   * @param jsonDelegate JsonDelegate override implementation, or nullptr for the SDK's built-in one
+   * 
+   * @note Pass a FastJsonDelegate (fast_json_delegate.h) to parse into flat documents with few allocations.
+   */
+  void SetJsonDelegate(const std::shared_ptr<JsonDelegate>& jsonDelegate) { mJsonDelegate = jsonDelegate; }
+
   /**
    * @brief Get the XmlDelegate (if any) override implementation. 
    * MipConfiguration needs to be derived from to override the internal xmlDelegate with an alternative.
@@ -171,6 +182,16 @@ public:
    */
   std::map<FlightingFeature, bool> GetFeatureSettings() const { return mfeatureSettings; }
 
+  /**
+   * @brief Get the Flighting features frozen into one bit per feature, defaults included
+   * 
+   * @return Flighting feature set, for checks on hot paths
+   * 
+   * @note Built from the current settings on each call, so that the class layout the SDK binary was built against
+   *       is unchanged; build it once and keep it rather than calling this on a hot path.
+   */
+  FlightingFeatureSet GetFeatureSet() const { return FlightingFeatureSet(mfeatureSettings); }
+
   /**
    * @brief Set the Flighting features which should be set to non-default values
    * 
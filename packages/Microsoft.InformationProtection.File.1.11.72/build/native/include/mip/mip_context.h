@@ -224,6 +224,23 @@ public:
   /** @endcond */
 };
 
+/**
+ * @brief Freeze the flighting features of a context into one bit per feature
+ * 
+ * @param context MipContext
+ * 
+ * @return Flighting feature set, to be built once after MipContext::Create and consulted on hot paths instead of
+ *         MipContext::IsFeatureEnabled
+ */
+inline FlightingFeatureSet GetFeatureSet(const MipContext& context) {
+  FlightingFeatureSet features;
+  for (unsigned int index = 0; index < kFlightingFeatureCount; ++index) {
+    FlightingFeature feature = static_cast<FlightingFeature>(index);
+    features.Set(feature, context.IsFeatureEnabled(feature));
+  }
+  return features;
+}
+
 MIP_NAMESPACE_END
 #endif  // API_MIP_MIP_CONTEXT_H_
 
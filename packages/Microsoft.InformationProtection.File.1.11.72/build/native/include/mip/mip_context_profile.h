@@ -0,0 +1,117 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines configuration profiles that trade features for MipContext start-up time
+ * 
+ * @file mip_context_profile.h
+ */
+
+#ifndef API_MIP_MIP_CONTEXT_PROFILE_H_
+#define API_MIP_MIP_CONTEXT_PROFILE_H_
+
+#include <memory>
+#include <string>
+
+#include "mip/audit_delegate.h"
+#include "mip/audit_event.h"
+#include "mip/common_types.h"
+#include "mip/diagnostic_configuration.h"
+#include "mip/mip_configuration.h"
+#include "mip/mip_namespace.h"
+#include "mip/telemetry_delegate.h"
+#include "mip/telemetry_event.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief What a MipContext is created for
+ */
+enum class MipContextProfile : unsigned int {
+  Full = 0,    /**< Every feature, as MipConfiguration's constructor sets it up */
+  Minimal = 1, /**< Offline, status-only use such as FileHandler::IsProtected, with the least start-up work */
+};
+
+/**
+ * @brief TelemetryDelegate that discards every event
+ */
+class NullTelemetryDelegate : public TelemetryDelegate {
+public:
+  /** @brief Discards the event */
+  void WriteEvent(const std::shared_ptr<TelemetryEvent>& /*event*/) override {}
+  /** @brief Does nothing */
+  void Flush() override {}
+};
+
+/**
+ * @brief AuditDelegate that discards every event
+ */
+class NullAuditDelegate : public AuditDelegate {
+public:
+  /** @brief Discards the event */
+  void WriteEvent(const std::shared_ptr<AuditEvent>& /*event*/) override {}
+  /** @brief Does nothing */
+  void Flush() override {}
+};
+
+/**
+ * @brief Create a configuration for a profile
+ * 
+ * @param appInfo Description of host application
+ * @param path File path for logs, caches, etc.
+ * @param thresholdLogLevel Minimum log level for .miplog
+ * @param profile What the context is created for
+ * 
+ * @return The configuration, to pass to MipContext::Create
+ * 
+ * @note The Minimal profile makes the context offline-only and routes telemetry and audit to NullTelemetryDelegate
+ *       and NullAuditDelegate, so the telemetry library is neither loaded nor started, and turns off its network
+ *       detection and on-disk caching. Its AsyncLoggerDelegate opens the log file and starts its thread only once
+ *       something is logged at the threshold level. Calls that need the network, such as adding an engine, fail.
+ *       Combine it with an in-memory cache storage type in the profile settings so that no cache database is opened.
+ */
+inline std::shared_ptr<MipConfiguration> CreateMipConfiguration(
+    const ApplicationInfo& appInfo,
+    const std::string& path,
+    LogLevel thresholdLogLevel,
+    MipContextProfile profile) {
+  bool isMinimal = profile == MipContextProfile::Minimal;
+  auto configuration = std::make_shared<MipConfiguration>(appInfo, path, thresholdLogLevel, isMinimal);
+  if (isMinimal) {
+    auto diagnosticConfiguration = std::make_shared<DiagnosticConfiguration>();
+    diagnosticConfiguration->isNetworkDetectionEnabled = false;
+    diagnosticConfiguration->isLocalCachingEnabled = false;
+    diagnosticConfiguration->isMinimalTelemetryEnabled = true;
+    diagnosticConfiguration->isFastShutdownEnabled = true;
+    diagnosticConfiguration->telemetryPipelineDelegateOverride = std::make_shared<NullTelemetryDelegate>();
+    diagnosticConfiguration->auditPipelineDelegateOverride = std::make_shared<NullAuditDelegate>();
+    configuration->SetDiagnosticConfiguration(diagnosticConfiguration);
+  }
+  return configuration;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_MIP_CONTEXT_PROFILE_H_
@@ -0,0 +1,224 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines NumaTaskDispatcher, a TaskDispatcherDelegate with one work-stealing partition per NUMA node
+ * 
+ * @file numa_task_dispatcher.h
+ */
+
+#ifndef API_MIP_NUMA_TASK_DISPATCHER_H_
+#define API_MIP_NUMA_TASK_DISPATCHER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/numa_topology.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/task_function.h"
+#include "mip/work_stealing_task_dispatcher.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a NumaTaskDispatcher
+ */
+struct NumaTaskDispatcherSettings {
+  /**
+   * Settings of each node's partition. A workerCount of 0 means one worker per processor of the node, times
+   * oversubscription; independentThreads bounds apply per node.
+   */
+  WorkStealingTaskDispatcherSettings partition;
+  /** Restrict each partition's workers to the processors of its node */
+  bool isPinningEnabled = true;
+};
+
+/**
+ * @brief TaskDispatcherDelegate with one WorkStealingTaskDispatcher per NUMA node, whose workers run on that node
+ * 
+ * @note A task dispatched with an AffinityHint runs on the hinted node, so memory-bound work such as decrypting a
+ *       buffer stays on the node owning the buffer; EncryptBufferParallel, DecryptBufferParallel, EncryptBuffers,
+ *       DecryptBuffers and DecryptContainerChildren pass such hints when given this dispatcher. Tasks dispatched
+ *       without a hint, including every task the SDK dispatches, run on the node of the dispatching thread, so
+ *       continuations stay where their data was produced. Workers steal only within their node. On a host with a
+ *       single node this behaves like one WorkStealingTaskDispatcher.
+ */
+class NumaTaskDispatcher : public TaskDispatcherDelegate {
+public:
+  /**
+   * @brief Start one partition per node of NumaTopology::Get()
+   * 
+   * @param settings Partition settings
+   */
+  explicit NumaTaskDispatcher(const NumaTaskDispatcherSettings& settings = NumaTaskDispatcherSettings())
+      : mGetTaskPriority(settings.partition.getTaskPriority ? settings.partition.getTaskPriority :
+                                                               GetDefaultTaskPriority),
+        mNextNode(0) {
+    const NumaTopology& topology = NumaTopology::Get();
+    for (size_t node = 0; node < topology.GetNodeCount(); ++node) {
+      WorkStealingTaskDispatcherSettings partition = settings.partition;
+      size_t processorCount = topology.GetProcessorCount(node);
+      if (partition.workerCount == 0 && processorCount > 0) {
+        double workers = static_cast<double>(processorCount) * (std::max)(partition.oversubscription, 0.0) + 0.5;
+        partition.workerCount = (std::max)(static_cast<size_t>(workers), static_cast<size_t>(1));
+      }
+      if (settings.isPinningEnabled && topology.GetNodeCount() > 1) {
+        auto onWorkerStart = settings.partition.onWorkerStart;
+        partition.onWorkerStart = [node, onWorkerStart](size_t workerIndex) {
+          NumaTopology::Get().PinCurrentThread(node);
+          if (onWorkerStart) {
+            onWorkerStart(workerIndex);
+          }
+        };
+      }
+      mPartitions.emplace_back(new WorkStealingTaskDispatcher(partition));
+    }
+  }
+
+  using TaskDispatcherDelegate::DispatchTask;
+
+  /**
+   * @brief Execute a task on the node of the calling thread
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   */
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    GetLocalPartition().DispatchTask(taskId, std::move(task));
+  }
+
+  /**
+   * @brief Execute a task on the node of the calling thread after a delay
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param delaySeconds Delay (in seconds) before executing task
+   */
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    GetLocalPartition().DispatchTask(taskId, std::move(task), delaySeconds);
+  }
+
+  /**
+   * @brief Execute a task on a preferred node, with the priority its ID is classified as
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param affinity Preferred node; the node of the calling thread if not set
+   */
+  void DispatchTask(const std::string& taskId, TaskFunction task, const AffinityHint& affinity) {
+    DispatchTask(taskId, std::move(task), affinity, mGetTaskPriority(taskId));
+  }
+
+  /**
+   * @brief Execute a task on a preferred node
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param affinity Preferred node; the node of the calling thread if not set
+   * @param priority Scheduling class
+   */
+  void DispatchTask(const std::string& taskId, TaskFunction task, const AffinityHint& affinity, TaskPriority priority) {
+    GetPartition(affinity).DispatchTask(taskId, std::move(task), priority);
+  }
+
+  /**
+   * @brief Execute a task on a dedicated thread of the calling thread's node
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   */
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    GetLocalPartition().ExecuteTaskOnIndependentThread(taskId, std::move(task));
+  }
+
+  /**
+   * @brief Cancel a task that has not started, on whichever node it was dispatched to
+   *
+   * @param taskId ID of task to cancel
+   * 
+   * @return True if a pending task with this ID was cancelled, else false
+   */
+  bool CancelTask(const std::string& taskId) override {
+    bool isCancelled = false;
+    for (auto& partition : mPartitions) {
+      isCancelled |= partition->CancelTask(taskId);
+    }
+    return isCancelled;
+  }
+
+  /**
+   * @brief Cancel every task that has not started
+   */
+  void CancelAllTasks() override {
+    for (auto& partition : mPartitions) {
+      partition->CancelAllTasks();
+    }
+  }
+
+  /**
+   * @brief Get the number of partitions, one per NUMA node
+   */
+  size_t GetNodeCount() const { return mPartitions.size(); }
+
+  /**
+   * @brief Get the partition of a node, e.g. to read its counters or Submit a task by handle
+   * 
+   * @param node Node index, below GetNodeCount
+   */
+  WorkStealingTaskDispatcher& GetNodePartition(size_t node) { return *mPartitions[node % mPartitions.size()]; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  WorkStealingTaskDispatcher& GetPartition(const AffinityHint& affinity) {
+    return affinity.IsSet() ? GetNodePartition(static_cast<size_t>(affinity.node)) : GetLocalPartition();
+  }
+
+  // Threads on no known node, e.g. when the OS does not report it, are spread round-robin
+  WorkStealingTaskDispatcher& GetLocalPartition() {
+    if (mPartitions.size() == 1) {
+      return *mPartitions.front();
+    }
+    int node = NumaTopology::Get().GetCurrentNode();
+    return GetNodePartition(node >= 0 ? static_cast<size_t>(node) : mNextNode++);
+  }
+
+  std::function<TaskPriority(const std::string&)> mGetTaskPriority;
+  std::atomic<size_t> mNextNode;
+  std::vector<std::unique_ptr<WorkStealingTaskDispatcher>> mPartitions;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_NUMA_TASK_DISPATCHER_H_
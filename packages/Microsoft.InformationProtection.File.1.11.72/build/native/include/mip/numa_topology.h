@@ -0,0 +1,313 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines NumaTopology and AffinityHint, used to keep memory-bound work on the NUMA node owning its buffers
+ * 
+ * @file numa_topology.h
+ */
+
+#ifndef API_MIP_NUMA_TOPOLOGY_H_
+#define API_MIP_NUMA_TOPOLOGY_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief NUMA nodes of the host and the processors belonging to each
+ * 
+ * @note Nodes are numbered densely from 0 in the order the OS reports them. On platforms without NUMA information,
+ *       or when it cannot be read, the host is reported as a single node and every query returns node 0 or -1.
+ */
+class NumaTopology {
+public:
+  /**
+   * @brief Get the topology of the host, read once
+   */
+  static const NumaTopology& Get() {
+    static const NumaTopology sTopology;
+    return sTopology;
+  }
+
+  /**
+   * @brief Get the number of NUMA nodes, at least 1
+   */
+  size_t GetNodeCount() const { return mNodes.empty() ? 1 : mNodes.size(); }
+
+  /**
+   * @brief Get the number of processors of a node
+   * 
+   * @param node Node index
+   * 
+   * @return Processor count, 0 if unknown
+   */
+  size_t GetProcessorCount(size_t node) const {
+#ifdef _WIN32
+    return node < mNodes.size() ? static_cast<size_t>(CountBits(mNodes[node].affinity.Mask)) : 0;
+#else
+    return node < mNodes.size() ? mNodes[node].cpus.size() : 0;
+#endif
+  }
+
+  /**
+   * @brief Get the node of the processor running the calling thread
+   * 
+   * @return Node index, or -1 if unknown
+   */
+  int GetCurrentNode() const {
+    if (mNodes.size() <= 1) {
+      return mNodes.empty() ? -1 : 0;
+    }
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT osNode = 0;
+    return GetNumaProcessorNodeEx(&processor, &osNode) ? ToIndex(osNode) : -1;
+#elif defined(__linux__)
+    int cpu = sched_getcpu();
+    return cpu >= 0 && static_cast<size_t>(cpu) < mNodeOfCpu.size() ? mNodeOfCpu[cpu] : -1;
+#else
+    return -1;
+#endif
+  }
+
+  /**
+   * @brief Get the node whose memory backs an address
+   * 
+   * @param address Address within a buffer
+   * 
+   * @return Node index, or -1 if unknown, e.g. for a page that was never touched
+   */
+  int GetNodeOfAddress(const void* address) const {
+    if (mNodes.size() <= 1 || address == nullptr) {
+      return mNodes.empty() || address == nullptr ? -1 : 0;
+    }
+#ifdef _WIN32
+    PSAPI_WORKING_SET_EX_INFORMATION info;
+    info.VirtualAddress = const_cast<void*>(address);
+    if (!QueryWorkingSetEx(GetCurrentProcess(), &info, sizeof(info)) || !info.VirtualAttributes.Valid) {
+      return -1;
+    }
+    return ToIndex(static_cast<int>(info.VirtualAttributes.Node));
+#elif defined(__linux__) && defined(SYS_get_mempolicy)
+    // MPOL_F_NODE | MPOL_F_ADDR: the node of the page containing the address
+    const unsigned long kNodeOfAddress = 3;
+    int osNode = -1;
+    if (syscall(SYS_get_mempolicy, &osNode, nullptr, 0, const_cast<void*>(address), kNodeOfAddress) != 0) {
+      return -1;
+    }
+    return ToIndex(osNode);
+#else
+    return -1;
+#endif
+  }
+
+  /**
+   * @brief Restrict the calling thread to the processors of a node
+   * 
+   * @param node Node index
+   * 
+   * @return true if the affinity was set
+   */
+  bool PinCurrentThread(size_t node) const {
+    if (node >= mNodes.size()) {
+      return false;
+    }
+#ifdef _WIN32
+    GROUP_AFFINITY affinity = mNodes[node].affinity;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != FALSE;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : mNodes[node].cpus) {
+      CPU_SET(cpu, &cpus);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Node {
+    int osNode = 0;
+#ifdef _WIN32
+    GROUP_AFFINITY affinity;
+#else
+    std::vector<int> cpus;
+#endif
+  };
+
+  NumaTopology() {
+#ifdef _WIN32
+    ULONG highestNode = 0;
+    if (!GetNumaHighestNodeNumber(&highestNode)) {
+      return;
+    }
+    for (ULONG osNode = 0; osNode <= highestNode; ++osNode) {
+      Node node;
+      node.osNode = static_cast<int>(osNode);
+      if (GetNumaNodeProcessorMaskEx(static_cast<USHORT>(osNode), &node.affinity) && node.affinity.Mask != 0) {
+        mNodes.push_back(node);
+      }
+    }
+#elif defined(__linux__)
+    DIR* directory = opendir("/sys/devices/system/node");
+    if (!directory) {
+      return;
+    }
+    std::vector<int> osNodes;
+    while (dirent* entry = readdir(directory)) {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          name.find_first_not_of("0123456789", 4) == std::string::npos) {
+        osNodes.push_back(std::atoi(name.c_str() + 4));
+      }
+    }
+    closedir(directory);
+    std::sort(osNodes.begin(), osNodes.end());
+    for (int osNode : osNodes) {
+      Node node;
+      node.osNode = osNode;
+      std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(osNode) + "/cpulist");
+      std::string ranges;
+      std::getline(cpuList, ranges);
+      node.cpus = ParseCpuList(ranges);
+      if (node.cpus.empty()) {
+        continue; // memory-only node
+      }
+      for (int cpu : node.cpus) {
+        if (static_cast<size_t>(cpu) >= mNodeOfCpu.size()) {
+          mNodeOfCpu.resize(static_cast<size_t>(cpu) + 1, -1);
+        }
+        mNodeOfCpu[cpu] = static_cast<int>(mNodes.size());
+      }
+      mNodes.push_back(node);
+    }
+#endif
+  }
+
+  int ToIndex(int osNode) const {
+    for (size_t i = 0; i < mNodes.size(); ++i) {
+      if (mNodes[i].osNode == osNode) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+#ifdef _WIN32
+  static int CountBits(KAFFINITY mask) {
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1) {
+      ++count;
+    }
+    return count;
+  }
+#else
+  // Parses the kernel's "0-3,8,10-11" format
+  static std::vector<int> ParseCpuList(const std::string& ranges) {
+    std::vector<int> cpus;
+    size_t position = 0;
+    while (position < ranges.size()) {
+      size_t end = ranges.find(',', position);
+      std::string range = ranges.substr(position, end == std::string::npos ? std::string::npos : end - position);
+      size_t dash = range.find('-');
+      if (!range.empty() && range.find_first_not_of("0123456789-") == std::string::npos) {
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) {
+          cpus.push_back(cpu);
+        }
+      }
+      if (end == std::string::npos) {
+        break;
+      }
+      position = end + 1;
+    }
+    return cpus;
+  }
+
+  std::vector<int> mNodeOfCpu;
+#endif
+
+  std::vector<Node> mNodes;
+  /** @endcond */
+};
+
+/**
+ * @brief Preferred NUMA node for a task, usually the node owning the buffers it reads and writes
+ */
+struct AffinityHint {
+  int node = -1; /**< NumaTopology node index, -1 for no preference */
+
+  /** @brief Whether a node is preferred */
+  bool IsSet() const { return node >= 0; }
+
+  /**
+   * @brief Prefer the node whose memory backs a buffer
+   * 
+   * @param address Address within the buffer, which should already be touched
+   */
+  static AffinityHint ForAddress(const void* address) {
+    AffinityHint hint;
+    hint.node = NumaTopology::Get().GetNodeOfAddress(address);
+    return hint;
+  }
+
+  /**
+   * @brief Prefer the node of the processor running the calling thread, e.g. the thread that filled the buffers
+   */
+  static AffinityHint ForCurrentThread() {
+    AffinityHint hint;
+    hint.node = NumaTopology::Get().GetCurrentNode();
+    return hint;
+  }
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_NUMA_TOPOLOGY_H_
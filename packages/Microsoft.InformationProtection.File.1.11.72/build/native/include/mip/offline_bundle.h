@@ -0,0 +1,436 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines offline bundles: service responses recorded for a set of content and replayed from a mapped file
+ * 
+ * @file offline_bundle.h
+ */
+
+#ifndef API_MIP_OFFLINE_BUNDLE_H_
+#define API_MIP_OFFLINE_BUNDLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_body.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mapped_storage_delegate.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace offlinebundle {
+
+typedef std::map<std::string, std::string, CaseInsensitiveComparator> Headers;
+
+// Columns: key, status, headers, body. Content IDs are rows whose key starts with kContentIdPrefix.
+const char kSchema[] = "mip_offline_bundle_v1:key,status,headers,body";
+const size_t kColumnCount = 4;
+const char kResponsePrefix[] = "response\n";
+const char kContentIdPrefix[] = "contentid\n";
+
+// Requests are matched on method, URL and body; headers such as Authorization differ between the recording and the
+// air-gapped hosts and are ignored
+inline std::string GetKey(const HttpRequest& request) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint8_t byte : request.GetBody()) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  }
+  char body[48];
+  std::snprintf(body, sizeof(body), "\n%016llx:%llu", static_cast<unsigned long long>(hash),
+      static_cast<unsigned long long>(request.GetBody().size()));
+  return kResponsePrefix + std::string(request.GetRequestType() == HttpRequestType::Post ? "POST " : "GET ") +
+      request.GetUrl() + body;
+}
+
+inline std::string SerializeHeaders(const Headers& headers) {
+  std::string text;
+  for (const auto& header : headers) {
+    if (header.first.find_first_of(":\n") == std::string::npos && header.second.find('\n') == std::string::npos) {
+      text += header.first + ":" + header.second + "\n";
+    }
+  }
+  return text;
+}
+
+inline Headers ParseHeaders(const std::string& text) {
+  Headers headers;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    std::string line = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      headers[line.substr(0, colon)] = line.substr(colon + 1);
+    }
+    start = end == std::string::npos ? text.size() : end + 1;
+  }
+  return headers;
+}
+
+class BundleOperation : public HttpOperation {
+public:
+  BundleOperation(const std::string& id, const std::shared_ptr<HttpResponse>& response)
+      : mId(id), mResponse(response) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return mResponse; }
+  bool IsCancelled() override { return false; }
+
+private:
+  std::string mId;
+  std::shared_ptr<HttpResponse> mResponse;
+};
+
+} // namespace offlinebundle
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that records the service responses needed to consume a set of content offline
+ * 
+ * @note Export on a connected host: load a profile whose HttpDelegate is the recorder and whose cache storage is
+ *       CacheStorageType::InMemory, so the SDK fetches rather than reuses policy, templates and licenses. Add the
+ *       engine, consume each file of the list once (for example with GetDecryptedTemporaryStream), call AddContentId
+ *       for it, then Write the bundle. Successful responses are recorded as they pass through; failures are not.
+ *       The bundle holds use licenses, so protect it like the content it unlocks.
+ */
+class OfflineBundleRecorder : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests to the service
+   */
+  explicit OfflineBundleRecorder(const std::shared_ptr<HttpDelegate>& transport) : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("OfflineBundleRecorder requires a transport HttpDelegate");
+    }
+    mState->transport = transport;
+  }
+
+  /**
+   * @brief Send HTTP request and record its response
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    auto operation = mState->transport->Send(request, context);
+    mState->Record(*request, operation);
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously and record its response
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto state = mState;
+    std::string key = offlinebundle::GetKey(*request);
+    return mState->transport->SendAsync(request, context, [state, key, callbackFn](
+        std::shared_ptr<HttpOperation> operation) {
+      state->Record(key, operation);
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+    });
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /**
+   * @brief Mark a content as covered by the bundle, once it has been consumed through the recorder
+   * 
+   * @param contentId Content ID, as returned by ProtectionDescriptor::GetContentId
+   */
+  void AddContentId(const std::string& contentId) {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->contentIds.push_back(contentId);
+  }
+
+  /**
+   * @brief Get the number of responses recorded
+   * 
+   * @return Response count
+   */
+  size_t GetResponseCount() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->responses.size();
+  }
+
+  /**
+   * @brief Write the bundle
+   * 
+   * @param path File receiving the bundle; it is replaced if it exists
+   * 
+   * @note A mip::FileIOError is thrown if the file cannot be written
+   */
+  void Write(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    std::string empty;
+    mappedstorage::Snapshot::Write(path, offlinebundle::kSchema, {0},
+        [this, &empty](const std::function<void(const std::vector<StorageValueView>&)>& addRow) {
+          for (const auto& response : mState->responses) {
+            addRow({StorageValueView(response.first), StorageValueView(response.second.status),
+                StorageValueView(response.second.headers), StorageValueView(response.second.body)});
+          }
+          for (const auto& contentId : mState->contentIds) {
+            std::string key = offlinebundle::kContentIdPrefix + contentId;
+            addRow({StorageValueView(key), StorageValueView(empty), StorageValueView(empty), StorageValueView(empty)});
+          }
+        });
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Response {
+    std::string status;
+    std::string headers;
+    std::vector<uint8_t> body;
+  };
+
+  // Async completions can outlive the recorder, so everything they need is kept in shared state
+  struct State {
+    std::shared_ptr<HttpDelegate> transport;
+    mutable std::mutex mutex;
+    std::map<std::string, Response> responses;
+    std::vector<std::string> contentIds;
+
+    void Record(const HttpRequest& request, const std::shared_ptr<HttpOperation>& operation) {
+      Record(offlinebundle::GetKey(request), operation);
+    }
+
+    void Record(const std::string& key, const std::shared_ptr<HttpOperation>& operation) {
+      std::shared_ptr<HttpResponse> response = operation ? operation->GetResponse() : nullptr;
+      if (!response || operation->IsCancelled() || response->GetStatusCode() < 200 ||
+          response->GetStatusCode() >= 300) {
+        return;
+      }
+      Response recorded{std::to_string(response->GetStatusCode()),
+          offlinebundle::SerializeHeaders(response->GetHeaders()), response->GetBody()};
+      std::lock_guard<std::mutex> lock(mutex);
+      responses[key] = std::move(recorded);
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+};
+
+/**
+ * @brief An offline bundle mapped from disk
+ * 
+ * @note The file is memory-mapped and indexed by a hash table written with it, so opening a bundle costs no parsing
+ *       and each lookup touches only the pages of the response it returns. Thread-safe.
+ */
+class OfflineBundle {
+public:
+  /**
+   * @brief Open a bundle written by OfflineBundleRecorder::Write
+   * 
+   * @param path Bundle file
+   * 
+   * @return Bundle. A mip::FileIOError is thrown if the file is missing or not a bundle.
+   */
+  static std::shared_ptr<OfflineBundle> Open(const std::string& path) {
+    auto snapshot = mappedstorage::Snapshot::Open(path, offlinebundle::kSchema, offlinebundle::kColumnCount, {0});
+    if (!snapshot) {
+      throw FileIOError("Missing or damaged offline bundle " + path);
+    }
+    return std::shared_ptr<OfflineBundle>(new OfflineBundle(snapshot));
+  }
+
+  /**
+   * @brief Find the recorded response to a request
+   * 
+   * @param request HTTP request
+   * 
+   * @return Response carrying the request's ID, or nullptr if none was recorded
+   */
+  std::shared_ptr<HttpResponse> Find(const HttpRequest& request) const {
+    std::vector<StorageValueView> values;
+    if (!Find(offlinebundle::GetKey(request), values)) {
+      return nullptr;
+    }
+    int32_t status = static_cast<int32_t>(std::strtol(values[1].ToString().c_str(), nullptr, 10));
+    return std::make_shared<SharedBodyHttpResponse>(request.GetId(), status,
+        offlinebundle::ParseHeaders(values[2].ToString()),
+        std::make_shared<const std::vector<uint8_t>>(values[3].ToBytes()));
+  }
+
+  /**
+   * @brief Whether a content was marked as covered when the bundle was recorded
+   * 
+   * @param contentId Content ID
+   * 
+   * @return true if the bundle covers the content
+   */
+  bool HasContentId(const std::string& contentId) const {
+    std::vector<StorageValueView> values;
+    return Find(offlinebundle::kContentIdPrefix + contentId, values);
+  }
+
+  /**
+   * @brief Get the number of rows, responses and content IDs, in the bundle
+   * 
+   * @return Row count
+   */
+  uint64_t GetRowCount() const { return mSnapshot->GetRowCount(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  explicit OfflineBundle(const std::shared_ptr<mappedstorage::Snapshot>& snapshot) : mSnapshot(snapshot) {}
+
+  bool Find(const std::string& key, std::vector<StorageValueView>& values) const {
+    return mSnapshot->Find(mappedstorage::JoinKey({StorageValueView(key)}, {0}), values) >= 0;
+  }
+
+  std::shared_ptr<mappedstorage::Snapshot> mSnapshot;
+  /** @endcond */
+};
+
+/**
+ * @brief HttpDelegate answering every request from an offline bundle, for air-gapped hosts
+ * 
+ * @note Use it as the profile's HttpDelegate, with an AuthDelegate that returns any non-empty token: requests never
+ *       leave the host. Responses arrive at local speed, and the SDK caches licenses as it does online. A request
+ *       that the bundle does not answer fails with a NetworkError of category Offline and is counted by
+ *       GetMissCount; check OfflineBundle::HasContentId to route uncovered content elsewhere beforehand.
+ */
+class OfflineBundleHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief OfflineBundleHttpDelegate constructor
+   * 
+   * @param bundle Bundle answering the requests
+   */
+  explicit OfflineBundleHttpDelegate(const std::shared_ptr<OfflineBundle>& bundle) : mBundle(bundle), mMissCount(0) {
+    if (!mBundle) {
+      throw BadInputError("OfflineBundleHttpDelegate requires a bundle");
+    }
+  }
+
+  /**
+   * @brief Answer HTTP request from the bundle
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& /*context*/) override {
+    auto response = mBundle->Find(*request);
+    if (!response) {
+      ++mMissCount;
+      throw NetworkError(NetworkError::Category::Offline, request->GetUrl().substr(0, request->GetUrl().find('?')),
+          request->GetId(), 0, "Request is not covered by the offline bundle");
+    }
+    return std::make_shared<offlinebundle::BundleOperation>(request->GetId(), response);
+  }
+
+  /**
+   * @brief Answer HTTP request from the bundle, calling back before returning
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto operation = Send(request, context);
+    if (callbackFn) {
+      callbackFn(operation);
+    }
+    return operation;
+  }
+
+  /** @brief Requests complete before returning, so there is nothing to cancel */
+  void CancelOperation(const std::string& /*requestId*/) override {}
+
+  /** @brief Requests complete before returning, so there is nothing to cancel */
+  void CancelAllOperations() override {}
+
+  /**
+   * @brief Get the number of requests the bundle did not answer
+   * 
+   * @return Miss count
+   */
+  size_t GetMissCount() const { return mMissCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<OfflineBundle> mBundle;
+  std::atomic<size_t> mMissCount;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_OFFLINE_BUNDLE_H_
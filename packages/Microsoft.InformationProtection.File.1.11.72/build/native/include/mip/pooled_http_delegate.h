@@ -0,0 +1,375 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines PooledHttpDelegate, which bounds and reuses the connections an HttpDelegate opens per host
+ * 
+ * @file pooled_http_delegate.h
+ */
+
+#ifndef API_MIP_POOLED_HTTP_DELEGATE_H_
+#define API_MIP_POOLED_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a PooledHttpDelegate
+ */
+struct PooledHttpDelegateSettings {
+  size_t maxConnectionsPerHost = 4;     /**< Connections the transport may keep open to one host */
+  size_t maxStreamsPerConnection = 100; /**< Concurrent requests per connection: 1 for HTTP/1.1, more for HTTP/2 */
+};
+
+/**
+ * @brief Statistics of one host of a PooledHttpDelegate
+ */
+struct PooledHttpHostStatistics {
+  std::string host;      /**< Scheme, host and port */
+  size_t activeCount;    /**< Requests being sent */
+  size_t queuedCount;    /**< Requests waiting for a free stream */
+  size_t maxActiveCount; /**< Highest number of requests sent at once */
+  size_t sentCount;      /**< Requests sent so far */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace pooledhttp {
+
+class CancelledOperation : public HttpOperation {
+public:
+  explicit CancelledOperation(const std::string& id) : mId(id) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return nullptr; }
+  bool IsCancelled() override { return true; }
+
+private:
+  std::string mId;
+};
+
+// Connections are per scheme, host and port, so those form the pool key
+inline std::string GetHostKey(const std::string& url) {
+  size_t schemeEnd = url.find("://");
+  size_t hostBegin = schemeEnd == std::string::npos ? 0 : schemeEnd + 3;
+  size_t hostEnd = url.find_first_of("/?#", hostBegin);
+  std::string key = url.substr(0, hostEnd);
+  std::transform(key.begin(), key.end(), key.begin(),
+      [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return key;
+}
+
+} // namespace pooledhttp
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that bounds the requests sent to each host to what a pool of persistent connections
+ *        can carry, queueing the rest in order
+ * 
+ * @note Pass PooledHttpDelegate to MipConfiguration::SetHttpDelegate, wrapping the transport that actually sends the
+ *       requests. Keep-alive connections, HTTP/2 multiplexing and TLS session resumption are the transport's job; this
+ *       delegate makes them effective by never asking for more concurrent requests per host than
+ *       maxConnectionsPerHost * maxStreamsPerConnection, so a burst of licensing or policy calls queues on warm
+ *       connections instead of opening a new TLS connection per request. Send blocks the calling thread until a
+ *       stream is free; SendAsync returns immediately and starts the request later. Requests still queued can be
+ *       cancelled without reaching the transport.
+ */
+class PooledHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Connection and stream limits
+   */
+  explicit PooledHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const PooledHttpDelegateSettings& settings = PooledHttpDelegateSettings())
+      : mTransport(transport),
+        mMaxActivePerHost((std::max)(settings.maxConnectionsPerHost, static_cast<size_t>(1)) *
+            (std::max)(settings.maxStreamsPerConnection, static_cast<size_t>(1))) {
+    if (!mTransport) {
+      throw BadInputError("PooledHttpDelegate requires a transport HttpDelegate");
+    }
+  }
+
+  /**
+   * @brief Send HTTP request, waiting for a free stream to its host
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    auto entry = std::make_shared<Entry>(request, context);
+    entry->isSync = true;
+    std::string hostKey = pooledhttp::GetHostKey(request->GetUrl());
+    Enqueue(hostKey, entry);
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mStarted.wait(lock, [&entry]() { return entry->isStarted || entry->isCancelled; });
+      if (entry->isCancelled) {
+        return std::make_shared<pooledhttp::CancelledOperation>(request->GetId());
+      }
+    }
+    try {
+      auto operation = mTransport->Send(request, context);
+      Release(hostKey);
+      return operation;
+    } catch (...) {
+      Release(hostKey);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously once a stream to its host is free
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container; while the request is queued it reports the request ID and no response
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto entry = std::make_shared<Entry>(request, context);
+    entry->callback = callbackFn;
+    entry->operation = std::make_shared<QueuedOperation>(request->GetId());
+    Enqueue(pooledhttp::GetHostKey(request->GetUrl()), entry);
+    return entry->operation;
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation, queued or sent
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override {
+    std::vector<std::shared_ptr<Entry>> cancelled;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (auto& host : mHosts) {
+        auto& queue = host.second.queue;
+        for (auto entry = queue.begin(); entry != queue.end();) {
+          if ((*entry)->request->GetId() == requestId) {
+            cancelled.push_back(*entry);
+            entry = queue.erase(entry);
+          } else {
+            ++entry;
+          }
+        }
+      }
+    }
+    Complete(cancelled);
+    mTransport->CancelOperation(requestId);
+  }
+
+  /**
+   * @brief Cancel every queued and sent HTTP operation
+   */
+  void CancelAllOperations() override {
+    std::vector<std::shared_ptr<Entry>> cancelled;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (auto& host : mHosts) {
+        cancelled.insert(cancelled.end(), host.second.queue.begin(), host.second.queue.end());
+        host.second.queue.clear();
+      }
+    }
+    Complete(cancelled);
+    mTransport->CancelAllOperations();
+  }
+
+  /**
+   * @brief Get the statistics of every host contacted so far
+   * 
+   * @return Per-host statistics
+   */
+  std::vector<PooledHttpHostStatistics> GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<PooledHttpHostStatistics> statistics;
+    for (const auto& host : mHosts) {
+      statistics.push_back(PooledHttpHostStatistics{host.first, host.second.activeCount, host.second.queue.size(),
+          host.second.maxActiveCount, host.second.sentCount});
+    }
+    return statistics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Stands for an asynchronous request until the transport's operation replaces it in the callback
+  class QueuedOperation : public HttpOperation {
+  public:
+    explicit QueuedOperation(const std::string& id) : mId(id) {}
+    const std::string& GetId() const override { return mId; }
+    std::shared_ptr<HttpResponse> GetResponse() override { return nullptr; }
+    bool IsCancelled() override { return false; }
+
+  private:
+    std::string mId;
+  };
+
+  struct Entry {
+    Entry(const std::shared_ptr<HttpRequest>& request, const std::shared_ptr<void>& context)
+        : request(request), context(context), isSync(false), isStarted(false), isCancelled(false) {}
+    std::shared_ptr<HttpRequest> request;
+    std::shared_ptr<void> context;
+    std::function<void(std::shared_ptr<HttpOperation>)> callback;
+    std::shared_ptr<HttpOperation> operation;
+    bool isSync;
+    bool isStarted;
+    bool isCancelled;
+  };
+
+  struct Host {
+    std::deque<std::shared_ptr<Entry>> queue;
+    size_t activeCount = 0;
+    size_t maxActiveCount = 0;
+    size_t sentCount = 0;
+    bool isStarting = false;
+  };
+
+  void Enqueue(const std::string& hostKey, const std::shared_ptr<Entry>& entry) {
+    if (!entry->request) {
+      throw BadInputError("PooledHttpDelegate requires a request");
+    }
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mHosts[hostKey].queue.push_back(entry);
+    }
+    StartQueued(hostKey);
+  }
+
+  void Release(const std::string& hostKey) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      --mHosts[hostKey].activeCount;
+    }
+    StartQueued(hostKey);
+  }
+
+  // Starts queued requests while streams are free. A transport completing synchronously re-enters through Release;
+  // the isStarting flag turns that recursion into iterations of the loop that is already running.
+  void StartQueued(const std::string& hostKey) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Host& host = mHosts[hostKey];
+    if (host.isStarting) {
+      return;
+    }
+    host.isStarting = true;
+    while (host.activeCount < mMaxActivePerHost && !host.queue.empty()) {
+      std::shared_ptr<Entry> entry = host.queue.front();
+      host.queue.pop_front();
+      ++host.activeCount;
+      ++host.sentCount;
+      host.maxActiveCount = (std::max)(host.maxActiveCount, host.activeCount);
+      if (entry->isSync) {
+        entry->isStarted = true;
+        mStarted.notify_all();
+        continue;
+      }
+      lock.unlock();
+      StartAsync(hostKey, entry);
+      lock.lock();
+    }
+    host.isStarting = false;
+  }
+
+  void StartAsync(const std::string& hostKey, const std::shared_ptr<Entry>& entry) {
+    try {
+      mTransport->SendAsync(entry->request, entry->context, [this, hostKey, entry](
+          std::shared_ptr<HttpOperation> operation) {
+        {
+          std::lock_guard<std::mutex> lock(mMutex);
+          --mHosts[hostKey].activeCount;
+        }
+        if (entry->callback) {
+          entry->callback(operation);
+        }
+        StartQueued(hostKey);
+      });
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        --mHosts[hostKey].activeCount;
+      }
+      if (entry->callback) {
+        entry->callback(std::make_shared<pooledhttp::CancelledOperation>(entry->request->GetId()));
+      }
+    }
+  }
+
+  void Complete(const std::vector<std::shared_ptr<Entry>>& cancelled) {
+    bool hasSync = false;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (const auto& entry : cancelled) {
+        entry->isCancelled = true;
+        hasSync = hasSync || entry->isSync;
+      }
+    }
+    if (hasSync) {
+      mStarted.notify_all();
+    }
+    for (const auto& entry : cancelled) {
+      if (!entry->isSync && entry->callback) {
+        entry->callback(std::make_shared<pooledhttp::CancelledOperation>(entry->request->GetId()));
+      }
+    }
+  }
+
+  std::shared_ptr<HttpDelegate> mTransport;
+  size_t mMaxActivePerHost;
+  mutable std::mutex mMutex;
+  std::condition_variable mStarted;
+  std::map<std::string, Host> mHosts;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_POOLED_HTTP_DELEGATE_H_
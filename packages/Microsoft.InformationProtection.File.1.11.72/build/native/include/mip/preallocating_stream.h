@@ -0,0 +1,219 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a Stream decorator that reserves the expected size of its output up front
+ * 
+ * @file preallocating_stream.h
+ */
+
+#ifndef API_MIP_PREALLOCATING_STREAM_H_
+#define API_MIP_PREALLOCATING_STREAM_H_
+
+#include <algorithm>
+#include <memory>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A Stream decorator that sizes its inner stream once to the expected output size and trims it when done
+ * 
+ * @note Growing a file write by write fragments it and makes object storage allocate extents repeatedly. This stream
+ *       sets the inner stream to the reserved size when it is created and then tracks the logical size itself:
+ *       Size, Read and Size(value) behave as if only the bytes written existed, and the inner stream grows past the
+ *       reservation only if the estimate was too small. Finish sets the inner stream to the logical size; it is
+ *       also called, ignoring errors, on destruction.
+ */
+class PreallocatingStream : public Stream {
+public:
+  /**
+   * @brief PreallocatingStream constructor
+   * 
+   * @param innerStream Stream being decorated. It must support Size(int64_t).
+   * @param reservedSize Size (in bytes) reserved up front, an upper bound of the expected output size
+   */
+  PreallocatingStream(const std::shared_ptr<Stream>& innerStream, int64_t reservedSize)
+      : mInnerStream(innerStream),
+        mPosition(innerStream ? innerStream->Position() : 0),
+        mSize(innerStream ? innerStream->Size() : 0),
+        mPhysicalSize(mSize) {
+    if (!mInnerStream) {
+      throw BadInputError("PreallocatingStream requires an inner stream");
+    }
+    if (reservedSize > mPhysicalSize) {
+      mInnerStream->Size(reservedSize);
+      mPhysicalSize = reservedSize;
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t length = (std::min)(bufferLength, mSize - mPosition);
+    if (length <= 0) {
+      return 0;
+    }
+    mInnerStream->Seek(mPosition);
+    int64_t bytesRead = mInnerStream->Read(buffer, length);
+    if (bytesRead > 0) {
+      mPosition += bytesRead;
+    }
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    mInnerStream->Seek(mPosition);
+    int64_t bytesWritten = mInnerStream->Write(buffer, bufferLength);
+    if (bytesWritten > 0) {
+      mPosition += bytesWritten;
+      mSize = (std::max)(mSize, mPosition);
+      mPhysicalSize = (std::max)(mPhysicalSize, mPosition);
+    }
+    return bytesWritten;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override { return mInnerStream->Flush(); }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mPosition = (std::max)(position, static_cast<int64_t>(0)); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mInnerStream->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mInnerStream->CanWrite(); }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mSize; }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   * 
+   * @note Shrinking keeps the reservation; only growing past it resizes the inner stream.
+   */
+  void Size(int64_t value) override {
+    if (value < 0) {
+      throw BadInputError("PreallocatingStream size cannot be negative");
+    }
+    if (value > mPhysicalSize) {
+      mInnerStream->Size(value);
+      mPhysicalSize = value;
+    }
+    mSize = value;
+  }
+
+  /**
+   * @brief Trim the inner stream to the bytes written and flush it
+   * 
+   * @return true if the flush succeeded
+   */
+  bool Finish() {
+    if (mPhysicalSize != mSize) {
+      mInnerStream->Size(mSize);
+      mPhysicalSize = mSize;
+    }
+    return mInnerStream->Flush();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~PreallocatingStream() {
+    try {
+      Finish();
+    } catch (...) {
+    }
+  }
+
+protected:
+  std::shared_ptr<Stream> mInnerStream;
+  int64_t mPosition;
+  int64_t mSize;
+  int64_t mPhysicalSize;
+  /** @endcond */
+}; // class PreallocatingStream
+
+/**
+ * @brief Creates a Stream that reserves the expected size of its output in another stream
+ * 
+ * @param innerStream Stream being decorated, for example one returned by CreateStreamFromMappedFile
+ * @param reservedSize Size (in bytes) reserved up front
+ * 
+ * @return Preallocating stream; call PreallocatingStream::Finish once the output is complete
+ */
+inline std::shared_ptr<PreallocatingStream> CreatePreallocatingStream(
+    const std::shared_ptr<Stream>& innerStream,
+    int64_t reservedSize) {
+  return std::make_shared<PreallocatingStream>(innerStream, reservedSize);
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_PREALLOCATING_STREAM_H_
@@ -0,0 +1,366 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines PrewarmingHttpDelegate, which opens connections to service endpoints before the first request and
+ *        keeps them warm while idle
+ * 
+ * @file prewarming_http_delegate.h
+ */
+
+#ifndef API_MIP_PREWARMING_HTTP_DELEGATE_H_
+#define API_MIP_PREWARMING_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace prewarmhttp {
+
+// Body-less GET sent only to get DNS, TCP and TLS set up; its response is ignored
+class PingRequest : public HttpRequest {
+public:
+  PingRequest(const std::string& id, const std::string& url) : mId(id), mUrl(url) {}
+  const std::string& GetId() const override { return mId; }
+  HttpRequestType GetRequestType() const override { return HttpRequestType::Get; }
+  const std::string& GetUrl() const override { return mUrl; }
+  const std::vector<uint8_t>& GetBody() const override { return mBody; }
+  const std::map<std::string, std::string, CaseInsensitiveComparator>& GetHeaders() const override { return mHeaders; }
+  TransportLayerSecurityMinimumVersion GetTransportLayerSecurityMinimumVersion() const override {
+    return TransportLayerSecurityMinimumVersion::TLS1_2;
+  }
+
+private:
+  std::string mId;
+  std::string mUrl;
+  std::vector<uint8_t> mBody;
+  std::map<std::string, std::string, CaseInsensitiveComparator> mHeaders;
+};
+
+// "HTTPS://Host:443/path?q" -> "https://host:443", or "" if the URL has no scheme
+inline std::string GetOrigin(const std::string& url) {
+  size_t schemeEnd = url.find("://");
+  if (schemeEnd == std::string::npos || schemeEnd == 0) {
+    return std::string();
+  }
+  size_t hostEnd = url.find_first_of("/?#", schemeEnd + 3);
+  std::string origin = url.substr(0, hostEnd);
+  std::transform(origin.begin(), origin.end(), origin.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  return origin.size() > schemeEnd + 3 ? origin : std::string();
+}
+
+} // namespace prewarmhttp
+/** @endcond */
+
+/**
+ * @brief Get the well-known service endpoints of a cloud
+ * 
+ * @param cloud Cloud of the engine
+ * 
+ * @return Base URLs of the protection, policy and authority endpoints, empty for Custom, Test and Unknown clouds
+ * 
+ * @note Engines that set a cloud endpoint base URL should pass it to PrewarmingHttpDelegate::Prewarm as well.
+ */
+inline std::vector<std::string> GetCloudServiceEndpoints(Cloud cloud) {
+  switch (cloud) {
+    case Cloud::Commercial:
+    case Cloud::US_GCC:
+      return {"https://api.aadrm.com", "https://dataservice.o365filtering.com", "https://login.microsoftonline.com"};
+    case Cloud::US_GCC_High:
+    case Cloud::US_DoD:
+      return {"https://api.aadrm.us", "https://login.microsoftonline.us"};
+    case Cloud::Germany:
+      return {"https://api.aadrm.de", "https://login.microsoftonline.de"};
+    case Cloud::China_01:
+      return {"https://api.aadrm.cn", "https://login.chinacloudapi.cn"};
+    default:
+      return {};
+  }
+}
+
+/**
+ * @brief Configuration of a PrewarmingHttpDelegate
+ */
+struct PrewarmingHttpDelegateSettings {
+  /** Idle time after which a warmed endpoint is pinged again, or 0 to never ping */
+  std::chrono::seconds keepWarmInterval = std::chrono::seconds(0);
+  /** Path requested by pre-warm and keep-warm pings */
+  std::string pingPath = "/";
+};
+
+/**
+ * @brief HttpDelegate decorator that warms up connections to service endpoints in parallel ahead of the first request,
+ *        and pings them again after a long idle period so that the transport's connections are not torn down
+ * 
+ * @note Call Prewarm right after MipContext::Create, or when adding an engine, with the engine's Cloud and cloud
+ *       endpoint base URL. Pings are plain body-less GET requests sent through the wrapped transport's SendAsync, so
+ *       DNS resolution, TCP and TLS setup happen concurrently and are reused by a connection-pooling transport such as
+ *       PooledHttpDelegate. Their responses are ignored and their failures are silent.
+ */
+class PrewarmingHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Pre-warm and keep-warm options
+   */
+  PrewarmingHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const PrewarmingHttpDelegateSettings& settings = PrewarmingHttpDelegateSettings())
+      : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("PrewarmingHttpDelegate requires a transport");
+    }
+    mState->transport = transport;
+    mState->settings = settings;
+    if (settings.keepWarmInterval.count() > 0) {
+      auto state = mState;
+      mKeepWarm = std::thread([state]() { State::KeepWarm(state); });
+    }
+  }
+
+  /**
+   * @brief Stop the keep-warm pings. Pings in flight still complete.
+   */
+  ~PrewarmingHttpDelegate() {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->isStopping = true;
+    }
+    mState->changed.notify_all();
+    if (mKeepWarm.joinable()) {
+      mKeepWarm.join();
+    }
+  }
+
+  /**
+   * @brief Open connections to every endpoint of a cloud in parallel
+   * 
+   * @param cloud Cloud of the engine, whose well-known endpoints are warmed
+   * @param endpointBaseUrls Additional base URLs, e.g. from SetCloudEndpointBaseUrl
+   * 
+   * @return Number of pings dispatched. Endpoints that were already warmed are skipped.
+   */
+  size_t Prewarm(Cloud cloud, const std::vector<std::string>& endpointBaseUrls = std::vector<std::string>()) {
+    std::vector<std::string> urls = GetCloudServiceEndpoints(cloud);
+    urls.insert(urls.end(), endpointBaseUrls.begin(), endpointBaseUrls.end());
+    std::vector<std::string> origins;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      for (const auto& url : urls) {
+        std::string origin = prewarmhttp::GetOrigin(url);
+        if (!origin.empty() && mState->lastActivity.emplace(origin, std::chrono::steady_clock::now()).second) {
+          origins.push_back(origin);
+        }
+      }
+    }
+    for (const auto& origin : origins) {
+      State::Ping(mState, origin);
+    }
+    return origins.size();
+  }
+
+  /**
+   * @brief Wait for the dispatched pings to complete
+   * 
+   * @param timeout Longest time to wait
+   * 
+   * @return true if no ping is in flight
+   */
+  bool WaitForPrewarm(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mState->mutex);
+    return mState->changed.wait_for(lock, timeout, [this]() { return mState->pendingPings == 0; });
+  }
+
+  /**
+   * @brief Get the endpoints that are being kept warm
+   * 
+   * @return Origins such as "https://api.aadrm.com", in ascending order
+   */
+  std::vector<std::string> GetWarmOrigins() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    std::vector<std::string> origins;
+    for (const auto& entry : mState->lastActivity) {
+      origins.push_back(entry.first);
+    }
+    return origins;
+  }
+
+  /**
+   * @brief Get the number of pre-warm and keep-warm pings sent so far
+   * 
+   * @return Ping count
+   */
+  uint64_t GetPingCount() const { return mState->pingCount; }
+
+  /**
+   * @brief Send HTTP request
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    mState->Touch(request->GetUrl());
+    return mState->transport->Send(request, context);
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    mState->Touch(request->GetUrl());
+    return mState->transport->SendAsync(request, context, callbackFn);
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Ping completions can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    std::shared_ptr<HttpDelegate> transport;
+    PrewarmingHttpDelegateSettings settings;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<std::string, std::chrono::steady_clock::time_point> lastActivity;
+    size_t pendingPings = 0;
+    bool isStopping = false;
+    std::atomic<uint64_t> pingCount{0};
+
+    // Only endpoints that were pre-warmed are tracked, so arbitrary request URLs do not grow the map
+    void Touch(const std::string& url) {
+      std::string origin = prewarmhttp::GetOrigin(url);
+      std::lock_guard<std::mutex> lock(mutex);
+      auto entry = lastActivity.find(origin);
+      if (entry != lastActivity.end()) {
+        entry->second = std::chrono::steady_clock::now();
+      }
+    }
+
+    static void Ping(const std::shared_ptr<State>& state, const std::string& origin) {
+      std::string id = "mip-prewarm-" + std::to_string(++state->pingCount);
+      auto request = std::make_shared<prewarmhttp::PingRequest>(id, origin + state->settings.pingPath);
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->pendingPings++;
+      }
+      auto onDone = [state](std::shared_ptr<HttpOperation>) {
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->pendingPings--;
+        }
+        state->changed.notify_all();
+      };
+      try {
+        state->transport->SendAsync(request, nullptr, onDone);
+      } catch (...) {
+        onDone(nullptr);
+      }
+    }
+
+    static void KeepWarm(const std::shared_ptr<State>& state) {
+      const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          state->settings.keepWarmInterval);
+      std::unique_lock<std::mutex> lock(state->mutex);
+      while (!state->isStopping) {
+        auto now = std::chrono::steady_clock::now();
+        auto nextWake = now + interval;
+        std::vector<std::string> idleOrigins;
+        for (auto& entry : state->lastActivity) {
+          if (now - entry.second >= interval) {
+            idleOrigins.push_back(entry.first);
+            entry.second = now;
+          } else {
+            nextWake = (std::min)(nextWake, entry.second + interval);
+          }
+        }
+        if (!idleOrigins.empty()) {
+          lock.unlock();
+          for (const auto& origin : idleOrigins) {
+            Ping(state, origin);
+          }
+          lock.lock();
+          continue;
+        }
+        state->changed.wait_until(lock, nextWake, [&state]() { return state->isStopping; });
+      }
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  std::thread mKeepWarm;
+  /** @endcond */
+}; // class PrewarmingHttpDelegate
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_PREWARMING_HTTP_DELEGATE_H_
@@ -0,0 +1,343 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a compact, dictionary-based encoding of serialized publishing licenses for application storage
+ * 
+ * @file compact_publishing_license.h
+ */
+
+#ifndef API_MIP_PROTECTION_COMPACT_PUBLISHING_LICENSE_H_
+#define API_MIP_PROTECTION_COMPACT_PUBLISHING_LICENSE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_profile.h"
+#include "mip/protection/publishing_license_info_cache.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace compactpl {
+
+const uint8_t kMagic[4] = {'M', 'P', 'L', 'C'};
+const uint8_t kVersion = 1;
+const size_t kHeaderSize = sizeof(kMagic) + 1 + 8;
+const size_t kMinMatch = 16;
+
+inline uint64_t Hash(const uint8_t* data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+inline void AppendVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+inline uint64_t ReadVarint(const uint8_t* data, size_t size, size_t& position) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (position >= size) {
+      break;
+    }
+    uint8_t byte = data[position++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw BadInputError("Damaged compact publishing license");
+}
+
+} // namespace compactpl
+/** @endcond */
+
+/**
+ * @brief A reference publishing license that compact licenses are encoded against
+ * 
+ * @note Licenses issued from the same template by the same tenant repeat the same certificate chain, issuer, rights
+ *       and template details, and differ mostly in their content ID, timestamps, signature and encrypted keys. Use one
+ *       such license, for example the first one a template produced, as the dictionary of all later ones. Immutable.
+ */
+class PublishingLicenseDictionary {
+public:
+  /**
+   * @brief PublishingLicenseDictionary constructor
+   * 
+   * @param serializedPublishingLicense Reference license
+   */
+  explicit PublishingLicenseDictionary(std::vector<uint8_t> serializedPublishingLicense)
+      : mBytes(std::move(serializedPublishingLicense)),
+        mId(compactpl::Hash(mBytes.data(), mBytes.size())) {
+    if (mBytes.size() < compactpl::kMinMatch) {
+      throw BadInputError("Publishing license dictionary is too small");
+    }
+    // Index every position; later positions win, which favors the matches nearest to the end of long runs
+    mIndex.reserve(mBytes.size());
+    for (size_t i = 0; i + compactpl::kMinMatch <= mBytes.size(); ++i) {
+      mIndex[compactpl::Hash(mBytes.data() + i, compactpl::kMinMatch)] = i;
+    }
+  }
+
+  /**
+   * @brief Get the ID that compact licenses record to name their dictionary
+   * 
+   * @return Hash of the reference license
+   */
+  uint64_t GetId() const { return mId; }
+
+  /**
+   * @brief Get the reference license
+   * 
+   * @return Serialized publishing license
+   */
+  const std::vector<uint8_t>& GetBytes() const { return mBytes; }
+
+  /** @cond DOXYGEN_HIDE */
+  // Offset in the dictionary of a run equal to the kMinMatch bytes at data, or -1
+  int64_t Find(const uint8_t* data) const {
+    auto found = mIndex.find(compactpl::Hash(data, compactpl::kMinMatch));
+    if (found == mIndex.end() || std::memcmp(mBytes.data() + found->second, data, compactpl::kMinMatch) != 0) {
+      return -1;
+    }
+    return static_cast<int64_t>(found->second);
+  }
+  /** @endcond */
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::vector<uint8_t> mBytes;
+  uint64_t mId;
+  std::unordered_map<uint64_t, size_t> mIndex;
+  /** @endcond */
+};
+
+/**
+ * @brief Encodes publishing licenses as copies from a dictionary plus literal bytes, and decodes them on demand
+ * 
+ * @note The publishing license format is set by the service, so files and the service still see standard licenses.
+ *       The compact form is for applications that store the license of each record themselves, next to content
+ *       protected with a ProtectionHandler: a few-KB license typically shrinks to the bytes that differ from its
+ *       dictionary. Nothing is parsed until GetPublishingLicenseInfo is called, which decodes compact licenses and
+ *       passes standard ones through unchanged, so stores holding both forms need no migration. Thread-safe.
+ */
+class CompactPublishingLicenseCodec {
+public:
+  /**
+   * @brief Register a dictionary, so licenses encoded against it can be decoded
+   * 
+   * @param dictionary Dictionary
+   */
+  void AddDictionary(const std::shared_ptr<const PublishingLicenseDictionary>& dictionary) {
+    if (!dictionary) {
+      throw BadInputError("Publishing license dictionary is null");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDictionaries[dictionary->GetId()] = dictionary;
+  }
+
+  /**
+   * @brief Encode a license against a dictionary
+   * 
+   * @param serializedPublishingLicense Standard serialized publishing license
+   * @param dictionary Dictionary to encode against; it is registered with the codec
+   * 
+   * @return Compact license
+   */
+  std::vector<uint8_t> Encode(
+      const std::vector<uint8_t>& serializedPublishingLicense,
+      const std::shared_ptr<const PublishingLicenseDictionary>& dictionary) {
+    AddDictionary(dictionary);
+    const uint8_t* data = serializedPublishingLicense.data();
+    size_t size = serializedPublishingLicense.size();
+    const std::vector<uint8_t>& reference = dictionary->GetBytes();
+    std::vector<uint8_t> compact(compactpl::kMagic, compactpl::kMagic + sizeof(compactpl::kMagic));
+    compact.push_back(compactpl::kVersion);
+    for (int i = 0; i < 8; ++i) {
+      compact.push_back(static_cast<uint8_t>(dictionary->GetId() >> (8 * i)));
+    }
+    compactpl::AppendVarint(compact, size);
+    size_t literalStart = 0;
+    size_t position = 0;
+    while (position + compactpl::kMinMatch <= size) {
+      int64_t offset = dictionary->Find(data + position);
+      if (offset < 0) {
+        ++position;
+        continue;
+      }
+      size_t length = compactpl::kMinMatch;
+      while (position + length < size && static_cast<size_t>(offset) + length < reference.size() &&
+          data[position + length] == reference[static_cast<size_t>(offset) + length]) {
+        ++length;
+      }
+      AppendLiteral(compact, data + literalStart, position - literalStart);
+      compactpl::AppendVarint(compact, (static_cast<uint64_t>(length) << 1) | 1);
+      compactpl::AppendVarint(compact, static_cast<uint64_t>(offset));
+      position += length;
+      literalStart = position;
+    }
+    AppendLiteral(compact, data + literalStart, size - literalStart);
+    return compact;
+  }
+
+  /**
+   * @brief Whether a buffer holds a compact license
+   * 
+   * @param license Compact or standard license
+   * 
+   * @return true for a compact license
+   */
+  static bool IsCompact(const std::vector<uint8_t>& license) {
+    return license.size() >= compactpl::kHeaderSize &&
+        std::memcmp(license.data(), compactpl::kMagic, sizeof(compactpl::kMagic)) == 0;
+  }
+
+  /**
+   * @brief Decode a license
+   * 
+   * @param license Compact or standard license
+   * 
+   * @return Standard serialized publishing license; a standard license is returned as is. A mip::BadInputError is
+   *         thrown if the dictionary is not registered or the license is damaged.
+   */
+  std::vector<uint8_t> Decode(const std::vector<uint8_t>& license) const {
+    if (!IsCompact(license)) {
+      return license;
+    }
+    if (license[sizeof(compactpl::kMagic)] != compactpl::kVersion) {
+      throw BadInputError("Unsupported compact publishing license version");
+    }
+    uint64_t dictionaryId = 0;
+    for (int i = 0; i < 8; ++i) {
+      dictionaryId |= static_cast<uint64_t>(license[sizeof(compactpl::kMagic) + 1 + i]) << (8 * i);
+    }
+    std::shared_ptr<const PublishingLicenseDictionary> dictionary;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto found = mDictionaries.find(dictionaryId);
+      if (found == mDictionaries.end()) {
+        throw BadInputError("Compact publishing license refers to an unknown dictionary");
+      }
+      dictionary = found->second;
+    }
+    const std::vector<uint8_t>& reference = dictionary->GetBytes();
+    const uint8_t* data = license.data();
+    size_t position = compactpl::kHeaderSize;
+    uint64_t decodedSize = compactpl::ReadVarint(data, license.size(), position);
+    if (decodedSize > license.size() * static_cast<uint64_t>(reference.size() + 1)) {
+      throw BadInputError("Damaged compact publishing license");
+    }
+    std::vector<uint8_t> decoded;
+    decoded.reserve(static_cast<size_t>(decodedSize));
+    while (position < license.size()) {
+      uint64_t tag = compactpl::ReadVarint(data, license.size(), position);
+      uint64_t length = tag >> 1;
+      if (decoded.size() + length > decodedSize) {
+        throw BadInputError("Damaged compact publishing license");
+      }
+      if (tag & 1) {
+        uint64_t offset = compactpl::ReadVarint(data, license.size(), position);
+        if (offset > reference.size() || length > reference.size() - offset) {
+          throw BadInputError("Damaged compact publishing license");
+        }
+        decoded.insert(decoded.end(), reference.begin() + static_cast<ptrdiff_t>(offset),
+            reference.begin() + static_cast<ptrdiff_t>(offset + length));
+      } else {
+        if (length > license.size() - position) {
+          throw BadInputError("Damaged compact publishing license");
+        }
+        decoded.insert(decoded.end(), data + position, data + position + length);
+        position += static_cast<size_t>(length);
+      }
+    }
+    if (decoded.size() != decodedSize) {
+      throw BadInputError("Damaged compact publishing license");
+    }
+    return decoded;
+  }
+
+  /**
+   * @brief Parse a compact or standard license
+   * 
+   * @param license Compact or standard license
+   * @param mipContext MIP context passed to ProtectionProfile::GetPublishingLicenseInfo
+   * 
+   * @return Parsed publishing license details, whose serialized license is the standard one
+   */
+  std::shared_ptr<PublishingLicenseInfo> GetPublishingLicenseInfo(
+      const std::vector<uint8_t>& license,
+      const std::shared_ptr<MipContext>& mipContext) const {
+    return ProtectionProfile::GetPublishingLicenseInfo(Decode(license), mipContext);
+  }
+
+  /**
+   * @brief Parse a compact or standard license through a cache, so repeated licenses are parsed once
+   * 
+   * @param license Compact or standard license
+   * @param cache Cache of parsed licenses
+   * 
+   * @return Parsed publishing license details, whose serialized license is the standard one
+   */
+  std::shared_ptr<PublishingLicenseInfo> GetPublishingLicenseInfo(
+      const std::vector<uint8_t>& license,
+      PublishingLicenseInfoCache& cache) const {
+    return IsCompact(license) ? cache.Get(Decode(license)) : cache.Get(license);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static void AppendLiteral(std::vector<uint8_t>& out, const uint8_t* data, size_t size) {
+    if (size > 0) {
+      compactpl::AppendVarint(out, static_cast<uint64_t>(size) << 1);
+      out.insert(out.end(), data, data + size);
+    }
+  }
+
+  mutable std::mutex mMutex;
+  std::unordered_map<uint64_t, std::shared_ptr<const PublishingLicenseDictionary>> mDictionaries;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_COMPACT_PUBLISHING_LICENSE_H_
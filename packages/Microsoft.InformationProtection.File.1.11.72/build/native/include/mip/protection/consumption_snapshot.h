@@ -0,0 +1,256 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ConsumptionSnapshot, which lets other processes of a service consume content licensed once
+ * 
+ * @file consumption_snapshot.h
+ */
+
+#ifndef API_MIP_PROTECTION_CONSUMPTION_SNAPSHOT_H_
+#define API_MIP_PROTECTION_CONSUMPTION_SNAPSHOT_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/delegation_license.h"
+#include "mip/protection/delegation_license_settings.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief What a consumption ProtectionHandler needs to be created again without a licensing request
+ * 
+ * @note The pre-license is a use license encrypted to the certificate of identity, so the content key it carries can
+ *       only be recovered by an engine of that identity; the snapshot holds no key in the clear and needs no further
+ *       protection in transit between processes of the service than the content itself. A changed or truncated
+ *       snapshot fails in ProtectionEngine::CreateProtectionHandlerForConsumption, which validates the license
+ *       signatures.
+ */
+struct ConsumptionSnapshot {
+  std::string identity;                              /**< Email of the identity the pre-license is bound to */
+  std::string contentId;                             /**< Content ID, for the caller's bookkeeping */
+  std::vector<uint8_t> serializedPublishingLicense;  /**< Publishing license of the content */
+  std::vector<uint8_t> serializedPreLicense;         /**< Use license bound to identity, in JSON format */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace consumptionsnapshot {
+
+const uint8_t kMagic[4] = {'M', 'C', 'S', 'N'};
+const uint8_t kVersion = 1;
+
+inline void AppendField(std::vector<uint8_t>& out, const uint8_t* data, size_t size) {
+  uint64_t value = size;
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+  out.insert(out.end(), data, data + size);
+}
+
+inline std::vector<uint8_t> ReadField(const std::vector<uint8_t>& in, size_t& position) {
+  uint64_t size = 0;
+  for (int shift = 0;; shift += 7) {
+    if (position >= in.size() || shift >= 64) {
+      throw BadInputError("Damaged consumption snapshot");
+    }
+    uint8_t byte = in[position++];
+    size |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  if (size > in.size() - position) {
+    throw BadInputError("Damaged consumption snapshot");
+  }
+  std::vector<uint8_t> field(in.begin() + position, in.begin() + position + static_cast<size_t>(size));
+  position += static_cast<size_t>(size);
+  return field;
+}
+
+inline bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+    return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+  });
+}
+
+} // namespace consumptionsnapshot
+/** @endcond */
+
+/**
+ * @brief Serialize a snapshot for another process
+ * 
+ * @param snapshot Snapshot
+ * 
+ * @return Serialized snapshot
+ */
+inline std::vector<uint8_t> SerializeConsumptionSnapshot(const ConsumptionSnapshot& snapshot) {
+  std::vector<uint8_t> out(consumptionsnapshot::kMagic, consumptionsnapshot::kMagic + 4);
+  out.push_back(consumptionsnapshot::kVersion);
+  out.reserve(out.size() + snapshot.identity.size() + snapshot.contentId.size() +
+      snapshot.serializedPublishingLicense.size() + snapshot.serializedPreLicense.size() + 16);
+  consumptionsnapshot::AppendField(
+      out, reinterpret_cast<const uint8_t*>(snapshot.identity.data()), snapshot.identity.size());
+  consumptionsnapshot::AppendField(
+      out, reinterpret_cast<const uint8_t*>(snapshot.contentId.data()), snapshot.contentId.size());
+  consumptionsnapshot::AppendField(
+      out, snapshot.serializedPublishingLicense.data(), snapshot.serializedPublishingLicense.size());
+  consumptionsnapshot::AppendField(out, snapshot.serializedPreLicense.data(), snapshot.serializedPreLicense.size());
+  return out;
+}
+
+/**
+ * @brief Read a snapshot written by SerializeConsumptionSnapshot
+ * 
+ * @param serializedSnapshot Serialized snapshot
+ * 
+ * @return Snapshot
+ * 
+ * @throw BadInputError if the snapshot is damaged or of an unknown version
+ */
+inline ConsumptionSnapshot DeserializeConsumptionSnapshot(const std::vector<uint8_t>& serializedSnapshot) {
+  if (serializedSnapshot.size() < 5 || std::memcmp(serializedSnapshot.data(), consumptionsnapshot::kMagic, 4) != 0) {
+    throw BadInputError("Not a consumption snapshot");
+  }
+  if (serializedSnapshot[4] != consumptionsnapshot::kVersion) {
+    throw BadInputError("Unsupported consumption snapshot version " + std::to_string(serializedSnapshot[4]));
+  }
+  size_t position = 5;
+  ConsumptionSnapshot snapshot;
+  auto identity = consumptionsnapshot::ReadField(serializedSnapshot, position);
+  snapshot.identity.assign(identity.begin(), identity.end());
+  auto contentId = consumptionsnapshot::ReadField(serializedSnapshot, position);
+  snapshot.contentId.assign(contentId.begin(), contentId.end());
+  snapshot.serializedPublishingLicense = consumptionsnapshot::ReadField(serializedSnapshot, position);
+  snapshot.serializedPreLicense = consumptionsnapshot::ReadField(serializedSnapshot, position);
+  if (position != serializedSnapshot.size() || snapshot.serializedPublishingLicense.empty() ||
+      snapshot.serializedPreLicense.empty()) {
+    throw BadInputError("Damaged consumption snapshot");
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Create a snapshot of the license of a content for the identity of an engine, with one licensing request
+ * 
+ * @param engine Engine of the service identity every stage runs as
+ * @param licenseInfo Publishing license of the content. If it carries a pre-license, e.g. one requested with
+ *        ProtectionHandler::PublishingSettings::SetRequestPreLicense when the content was protected, that one is
+ *        used and no request is made.
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return Snapshot bound to the identity of engine
+ * 
+ * @note The license is requested with ProtectionEngine::CreateDelegationLicenses for the engine's own identity, so
+ *       the identity needs the rights that call requires, e.g. super user of the tenant, as pipeline service
+ *       accounts usually have.
+ */
+inline ConsumptionSnapshot CreateConsumptionSnapshot(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const PublishingLicenseInfo& licenseInfo,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  ConsumptionSnapshot snapshot;
+  snapshot.identity = engine->GetSettings().GetIdentity().GetEmail();
+  snapshot.contentId = licenseInfo.GetContentId();
+  snapshot.serializedPublishingLicense = licenseInfo.GetSerializedPublishingLicense();
+  if (licenseInfo.HasPreLicense()) {
+    snapshot.serializedPreLicense = licenseInfo.GetPreLicense();
+    return snapshot;
+  }
+  auto settings = DelegationLicenseSettings::CreateDelegationLicenseSettings(
+      licenseInfo, std::vector<std::string>{snapshot.identity}, true /*aquireEndUserLicenses*/);
+  for (const auto& license : engine->CreateDelegationLicenses(*settings, context)) {
+    if (license && consumptionsnapshot::EqualsIgnoreCase(license->GetUser(), snapshot.identity)) {
+      snapshot.serializedPreLicense = license->GetSerializedUserLicense(ProtectionHandler::PreLicenseFormat::Json);
+      break;
+    }
+  }
+  if (snapshot.serializedPreLicense.empty()) {
+    throw NoPermissionsError(
+        NoPermissionsError::Category::AccessDenied, "No license was issued to " + snapshot.identity);
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Create the consumption settings of a snapshot for an engine
+ * 
+ * @param engine Engine that will consume the content; its identity must be the snapshot's
+ * @param snapshot Snapshot, e.g. from DeserializeConsumptionSnapshot
+ * 
+ * @return Consumption settings carrying the pre-license
+ * 
+ * @throw BadInputError if the snapshot is bound to another identity
+ */
+inline ProtectionHandler::ConsumptionSettings CreateConsumptionSettingsFromSnapshot(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const ConsumptionSnapshot& snapshot) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  if (!consumptionsnapshot::EqualsIgnoreCase(engine->GetSettings().GetIdentity().GetEmail(), snapshot.identity)) {
+    throw BadInputError("Consumption snapshot is bound to another identity");
+  }
+  return ProtectionHandler::ConsumptionSettings(snapshot.serializedPreLicense, snapshot.serializedPublishingLicense);
+}
+
+/**
+ * @brief Create a consumption handler from a snapshot, without a licensing request
+ * 
+ * @param engine Engine that will consume the content; its identity must be the snapshot's
+ * @param snapshot Snapshot, e.g. from DeserializeConsumptionSnapshot
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return ProtectionHandler for the content
+ * 
+ * @note The engine still loads its identity's certificate once, as it does for any consumption; every handler after
+ *       that costs no network request. Combine with UseLicenseCache to also share handlers within a process.
+ */
+inline std::shared_ptr<ProtectionHandler> CreateProtectionHandlerFromSnapshot(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const ConsumptionSnapshot& snapshot,
+    const std::shared_ptr<void>& context = nullptr) {
+  return engine->CreateProtectionHandlerForConsumption(
+      CreateConsumptionSettingsFromSnapshot(engine, snapshot), context);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_CONSUMPTION_SNAPSHOT_H_
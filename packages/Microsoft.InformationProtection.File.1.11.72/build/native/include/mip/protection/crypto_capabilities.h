@@ -0,0 +1,145 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines queries for the crypto capabilities of the host and of a ProtectionHandler
+ * 
+ * @file crypto_capabilities.h
+ */
+
+#ifndef API_MIP_PROTECTION_CRYPTO_CAPABILITIES_H_
+#define API_MIP_PROTECTION_CRYPTO_CAPABILITIES_H_
+
+#include <cstdint>
+#include <memory>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
+
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/protection_handler_utils.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Hardware crypto instructions available on the host CPU
+ */
+struct HostCryptoCapabilities {
+  bool hasAesInstructions = false;    /**< AES-NI (x86) or ARMv8 AES */
+  bool hasVectorAesInstructions = false; /**< VAES (x86), wide-vector AES rounds */
+  bool hasCarryLessMultiply = false;  /**< PCLMULQDQ (x86) or ARMv8 PMULL */
+  bool hasShaInstructions = false;    /**< SHA extensions (x86) or ARMv8 SHA1/SHA2 */
+};
+
+/**
+ * @brief Crypto characteristics of a ProtectionHandler on this host
+ */
+struct ProtectionHandlerCryptoCapabilities {
+  CipherMode cipherMode = CipherMode::CIPHER_MODE_CBC4K; /**< Cipher mode of the handler */
+  int64_t independentUnitSize = 0;  /**< Size (in bytes) of units that can be processed independently, 0 if none */
+  int64_t preferredChunkSize = 0;   /**< Buffer size (in bytes) that keeps per-call overhead low, a multiple of the unit */
+  bool isHardwareAccelerated = false; /**< If the host CPU offers AES instructions */
+};
+
+/**
+ * @brief Detect the crypto instructions offered by the host CPU
+ * 
+ * @return Host crypto capabilities
+ * 
+ * @note This reports what the CPU offers, not which implementation the SDK's crypto provider picked. A mix of hosts
+ *       with and without AES/VAES instructions is the most common cause of large throughput differences between nodes.
+ */
+inline HostCryptoCapabilities GetHostCryptoCapabilities() {
+  HostCryptoCapabilities capabilities;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int registers[4] = {0, 0, 0, 0};
+  __cpuid(registers, 0);
+  int maxLeaf = registers[0];
+  __cpuid(registers, 1);
+  capabilities.hasAesInstructions = (registers[2] & (1 << 25)) != 0;
+  capabilities.hasCarryLessMultiply = (registers[2] & (1 << 1)) != 0;
+  if (maxLeaf >= 7) {
+    __cpuidex(registers, 7, 0);
+    capabilities.hasShaInstructions = (registers[1] & (1 << 29)) != 0;
+    capabilities.hasVectorAesInstructions = (registers[2] & (1 << 9)) != 0;
+  }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    capabilities.hasAesInstructions = (ecx & bit_AES) != 0;
+    capabilities.hasCarryLessMultiply = (ecx & bit_PCLMUL) != 0;
+  }
+  if (__get_cpuid_max(0, nullptr) >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    capabilities.hasShaInstructions = (ebx & (1u << 29)) != 0;
+    capabilities.hasVectorAesInstructions = (ecx & (1u << 9)) != 0;
+  }
+#elif defined(__linux__) && defined(__aarch64__)
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  capabilities.hasAesInstructions = (hwcap & (1ul << 3)) != 0;   // HWCAP_AES
+  capabilities.hasCarryLessMultiply = (hwcap & (1ul << 4)) != 0; // HWCAP_PMULL
+  capabilities.hasShaInstructions = (hwcap & (1ul << 6)) != 0;   // HWCAP_SHA2
+#elif defined(__APPLE__) && defined(__aarch64__)
+  // Every Apple silicon CPU implements the ARMv8 crypto extensions
+  capabilities.hasAesInstructions = true;
+  capabilities.hasCarryLessMultiply = true;
+  capabilities.hasShaInstructions = true;
+#endif
+  return capabilities;
+}
+
+/**
+ * @brief Describe the crypto characteristics of a ProtectionHandler on this host
+ * 
+ * @param handler Protection handler
+ * 
+ * @return Crypto characteristics, suitable for choosing buffer sizes for EncryptBuffer/DecryptBuffer or for
+ *         EncryptBufferParallel/DecryptBufferParallel
+ */
+inline ProtectionHandlerCryptoCapabilities GetCryptoCapabilities(const std::shared_ptr<ProtectionHandler>& handler) {
+  ProtectionHandlerCryptoCapabilities capabilities;
+  if (!handler) {
+    return capabilities;
+  }
+  capabilities.cipherMode = handler->GetCipherMode();
+  capabilities.independentUnitSize = parallelcrypto::GetIndependentUnitSize(capabilities.cipherMode);
+  // 64 units (256 KB for CBC4K) amortizes the per-call cost without leaving the L2 cache
+  capabilities.preferredChunkSize = capabilities.independentUnitSize > 0 ?
+      capabilities.independentUnitSize * 64 :
+      handler->GetBlockSize();
+  capabilities.isHardwareAccelerated = GetHostCryptoCapabilities().hasAesInstructions;
+  return capabilities;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_CRYPTO_CAPABILITIES_H_
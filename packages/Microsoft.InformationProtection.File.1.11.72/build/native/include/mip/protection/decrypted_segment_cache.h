@@ -0,0 +1,499 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a random-access cache of decrypted segments for protected streams
+ * 
+ * @file decrypted_segment_cache.h
+ */
+
+#ifndef API_MIP_PROTECTION_DECRYPTED_SEGMENT_CACHE_H_
+#define API_MIP_PROTECTION_DECRYPTED_SEGMENT_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/memory_budget.h"
+#include "mip/memory_resource.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings for a DecryptedSegmentCacheStream
+ */
+class DecryptedSegmentCacheSettings {
+public:
+  /**
+   * @brief DecryptedSegmentCacheSettings constructor
+   * 
+   * @param maxCachedBytes Maximum number of decrypted bytes kept in the cache
+   * @param prefetchSegments Number of segments loaded in the background after a sequential read, 0 to disable
+   * @param segmentSize Size (in bytes) of each cached segment. The default matches the CBC4K unit size.
+   */
+  DecryptedSegmentCacheSettings(
+      int64_t maxCachedBytes = 4 * 1024 * 1024,
+      int64_t prefetchSegments = 8,
+      int64_t segmentSize = 4096)
+      : mMaxCachedBytes(maxCachedBytes),
+        mPrefetchSegments(prefetchSegments),
+        mSegmentSize(segmentSize) {
+  }
+
+  /**
+   * @brief Gets the maximum number of decrypted bytes kept in the cache
+   * 
+   * @return Byte budget of the cache
+   */
+  int64_t GetMaxCachedBytes() const { return mMaxCachedBytes; }
+
+  /**
+   * @brief Gets the number of segments loaded in the background after a sequential read
+   * 
+   * @return Number of prefetched segments
+   */
+  int64_t GetPrefetchSegments() const { return mPrefetchSegments; }
+
+  /**
+   * @brief Gets the size of each cached segment
+   * 
+   * @return Segment size (in bytes)
+   */
+  int64_t GetSegmentSize() const { return mSegmentSize; }
+
+  /**
+   * @brief Sets the task dispatcher used for background prefetch
+   * 
+   * @param taskDispatcher Task dispatcher. If not set, prefetch runs on a new std::thread.
+   */
+  void SetTaskDispatcherDelegate(const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher) {
+    mTaskDispatcher = taskDispatcher;
+  }
+
+  /**
+   * @brief Gets the task dispatcher used for background prefetch
+   * 
+   * @return Task dispatcher, or nullptr if prefetch runs on a new std::thread
+   */
+  std::shared_ptr<TaskDispatcherDelegate> GetTaskDispatcherDelegate() const { return mTaskDispatcher; }
+
+  /**
+   * @brief Sets the budget the cached segments account against, as MemoryCategory::DecryptedContent
+   * 
+   * @param memoryBudget Memory budget shared with the application's other caches
+   */
+  void SetMemoryBudget(const std::shared_ptr<MemoryBudget>& memoryBudget) { mMemoryBudget = memoryBudget; }
+
+  /**
+   * @brief Gets the budget the cached segments account against
+   * 
+   * @return Memory budget, or nullptr if the cache is only bounded by its own byte budget
+   */
+  std::shared_ptr<MemoryBudget> GetMemoryBudget() const { return mMemoryBudget; }
+
+  /**
+   * @brief Sets the resource the cached segments are allocated from
+   * 
+   * @param memoryResource Memory resource shared with the application's other buffers and caches
+   */
+  void SetMemoryResource(const std::shared_ptr<MemoryResource>& memoryResource) { mMemoryResource = memoryResource; }
+
+  /**
+   * @brief Gets the resource the cached segments are allocated from
+   * 
+   * @return Memory resource, or nullptr if segments use the global operator new
+   */
+  std::shared_ptr<MemoryResource> GetMemoryResource() const { return mMemoryResource; }
+
+private:
+  int64_t mMaxCachedBytes;
+  int64_t mPrefetchSegments;
+  int64_t mSegmentSize;
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  std::shared_ptr<MemoryBudget> mMemoryBudget;
+  std::shared_ptr<MemoryResource> mMemoryResource;
+};
+
+/**
+ * @brief A Stream decorator that keeps an LRU cache of decrypted segments of a protected stream.
+ * 
+ * @note Wrap the stream returned by ProtectionHandler::CreateProtectedStream. Seeking back to a segment that is still
+ *       cached does not decrypt it again. When a read continues from the previously read segment, the following
+ *       segments are decrypted on a background task so that sequential readers rarely wait. Writes go straight to the
+ *       protected stream and drop the cached segments they overlap.
+ */
+class DecryptedSegmentCacheStream : public Stream {
+public:
+  /**
+   * @brief DecryptedSegmentCacheStream constructor
+   * 
+   * @param protectedStream Decrypting stream being cached
+   * @param settings Cache settings
+   */
+  DecryptedSegmentCacheStream(
+      const std::shared_ptr<Stream>& protectedStream,
+      const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings())
+      : mState(std::make_shared<State>()),
+        mPrefetchSegments((std::max)(settings.GetPrefetchSegments(), static_cast<int64_t>(0))),
+        mTaskDispatcher(settings.GetTaskDispatcherDelegate()),
+        mPosition(protectedStream ? protectedStream->Position() : 0) {
+    if (!protectedStream) {
+      throw BadInputError("DecryptedSegmentCacheStream requires a protected stream");
+    }
+    if (settings.GetSegmentSize() <= 0) {
+      throw BadInputError("DecryptedSegmentCacheStream segment size must be positive");
+    }
+    mState->innerStream = protectedStream;
+    mState->segmentSize = settings.GetSegmentSize();
+    mState->maxCachedBytes = (std::max)(settings.GetMaxCachedBytes(), settings.GetSegmentSize());
+    mState->allocator = MemoryResourceAllocator<uint8_t>(settings.GetMemoryResource());
+    mState->memoryBudget = settings.GetMemoryBudget();
+    if (mState->memoryBudget) {
+      State* state = mState.get();
+      mState->memoryRegistration = mState->memoryBudget->Register(MemoryCategory::DecryptedContent,
+          [state]() {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return state->cachedBytes;
+          },
+          [state](int64_t maxBytes) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            Evict(*state, maxBytes, 0);
+          });
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t totalBytesRead = 0;
+    bool isSequential = false;
+    int64_t lastSegmentIndex = -1;
+    uint64_t loadCount = 0;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      loadCount = mState->loadCount;
+      while (totalBytesRead < bufferLength) {
+        int64_t segmentIndex = mPosition / mState->segmentSize;
+        int64_t offsetInSegment = mPosition % mState->segmentSize;
+        if (segmentIndex == mState->lastReadSegment + 1) {
+          isSequential = true;
+        }
+        const ResourceByteVector& segment = GetSegment(*mState, segmentIndex);
+        mState->lastReadSegment = segmentIndex;
+        lastSegmentIndex = segmentIndex;
+        if (offsetInSegment >= static_cast<int64_t>(segment.size())) {
+          break;
+        }
+        int64_t bytesToCopy = (std::min)(
+            bufferLength - totalBytesRead,
+            static_cast<int64_t>(segment.size()) - offsetInSegment);
+        std::memcpy(buffer + totalBytesRead, segment.data() + offsetInSegment, static_cast<size_t>(bytesToCopy));
+        mPosition += bytesToCopy;
+        totalBytesRead += bytesToCopy;
+      }
+      loadCount = mState->loadCount - loadCount;
+    }
+    if (loadCount > 0) {
+      EnforceMemoryBudget(*mState);
+    }
+    if (isSequential && totalBytesRead > 0) {
+      SchedulePrefetch(lastSegmentIndex + 1);
+    }
+    return totalBytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->innerStream->Seek(mPosition);
+    int64_t bytesWritten = mState->innerStream->Write(buffer, bufferLength);
+    if (bytesWritten > 0) {
+      Invalidate(*mState, mPosition / mState->segmentSize, (mPosition + bytesWritten - 1) / mState->segmentSize);
+      mPosition += bytesWritten;
+    }
+    return bytesWritten;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->innerStream->Flush();
+  }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mPosition = (std::max)(position, static_cast<int64_t>(0)); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mState->innerStream->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mState->innerStream->CanWrite(); }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->innerStream->Size();
+  }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t value) override {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->innerStream->Size(value);
+    mState->segments.clear();
+    mState->index.clear();
+    mState->cachedBytes = 0;
+    mState->lastReadSegment = -1;
+  }
+
+  /**
+   * @brief Get the number of decrypted bytes currently held in the cache
+   * 
+   * @return Cached byte count
+   */
+  int64_t GetCachedBytes() const {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    return mState->cachedBytes;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~DecryptedSegmentCacheStream() { }
+
+private:
+  struct CachedSegment {
+    int64_t index;
+    ResourceByteVector data;
+  };
+
+  // Shared with background prefetch tasks, which hold it weakly so that they stop once the stream is released
+  struct State {
+    std::mutex mutex;
+    std::shared_ptr<Stream> innerStream;
+    int64_t segmentSize = 0;
+    int64_t maxCachedBytes = 0;
+    int64_t cachedBytes = 0;
+    int64_t lastReadSegment = -1;
+    bool isPrefetchPending = false;
+    uint64_t loadCount = 0;
+    std::list<CachedSegment> segments;
+    std::unordered_map<int64_t, std::list<CachedSegment>::iterator> index;
+    MemoryResourceAllocator<uint8_t> allocator;
+    std::shared_ptr<MemoryBudget> memoryBudget;
+    // Declared last so that the budget stops calling into the state before anything else is destroyed
+    std::shared_ptr<MemoryBudgetRegistration> memoryRegistration;
+  };
+
+  static const ResourceByteVector& GetSegment(State& state, int64_t segmentIndex) {
+    auto cached = state.index.find(segmentIndex);
+    if (cached != state.index.end()) {
+      state.segments.splice(state.segments.begin(), state.segments, cached->second);
+      return cached->second->data;
+    }
+    return LoadSegment(state, segmentIndex);
+  }
+
+  static const ResourceByteVector& LoadSegment(State& state, int64_t segmentIndex) {
+    ResourceByteVector data(static_cast<size_t>(state.segmentSize), 0, state.allocator);
+    state.innerStream->Seek(segmentIndex * state.segmentSize);
+    int64_t bytesRead = ReadFromStream(state.innerStream, data.data(), state.segmentSize);
+    data.resize(static_cast<size_t>(bytesRead));
+    state.cachedBytes += bytesRead;
+    ++state.loadCount;
+    state.segments.push_front(CachedSegment{segmentIndex, std::move(data)});
+    state.index[segmentIndex] = state.segments.begin();
+    // Never evict the segment just loaded, the caller is about to read it
+    Evict(state, state.maxCachedBytes, 1);
+    return state.segments.front().data;
+  }
+
+  static void Evict(State& state, int64_t maxCachedBytes, size_t keptSegments) {
+    while (state.cachedBytes > maxCachedBytes && state.segments.size() > keptSegments) {
+      state.cachedBytes -= static_cast<int64_t>(state.segments.back().data.size());
+      state.index.erase(state.segments.back().index);
+      state.segments.pop_back();
+    }
+  }
+
+  static void EnforceMemoryBudget(State& state) {
+    if (state.memoryBudget) {
+      state.memoryBudget->Enforce();
+    }
+  }
+
+  static void Invalidate(State& state, int64_t firstSegmentIndex, int64_t lastSegmentIndex) {
+    for (auto it = state.segments.begin(); it != state.segments.end();) {
+      if (it->index >= firstSegmentIndex && it->index <= lastSegmentIndex) {
+        state.cachedBytes -= static_cast<int64_t>(it->data.size());
+        state.index.erase(it->index);
+        it = state.segments.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  static void Prefetch(const std::weak_ptr<State>& weakState, int64_t firstSegmentIndex, int64_t segmentCount) {
+    for (int64_t i = 0; i < segmentCount; ++i) {
+      auto state = weakState.lock();
+      if (!state) {
+        return;
+      }
+      // Take the lock once per segment so that foreground reads are never held up for the whole prefetch
+      std::lock_guard<std::mutex> lock(state->mutex);
+      int64_t segmentIndex = firstSegmentIndex + i;
+      // Stop if the reader jumped elsewhere or the segments would push each other out of the cache
+      if (state->lastReadSegment >= segmentIndex ||
+          state->lastReadSegment < firstSegmentIndex - 1 ||
+          (i + 2) * state->segmentSize > state->maxCachedBytes) {
+        break;
+      }
+      if (state->index.find(segmentIndex) != state->index.end()) {
+        continue;
+      }
+      try {
+        if (LoadSegment(*state, segmentIndex).size() < static_cast<size_t>(state->segmentSize)) {
+          break;
+        }
+      } catch (...) {
+        // Prefetch is best effort, the foreground read will surface the error
+        break;
+      }
+    }
+    auto state = weakState.lock();
+    if (state) {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->isPrefetchPending = false;
+      }
+      EnforceMemoryBudget(*state);
+    }
+  }
+
+  void SchedulePrefetch(int64_t firstSegmentIndex) {
+    if (mPrefetchSegments == 0) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      if (mState->isPrefetchPending) {
+        return;
+      }
+      mState->isPrefetchPending = true;
+    }
+    std::weak_ptr<State> weakState = mState;
+    int64_t segmentCount = mPrefetchSegments;
+    auto task = [weakState, firstSegmentIndex, segmentCount]() {
+      Prefetch(weakState, firstSegmentIndex, segmentCount);
+    };
+    try {
+      if (mTaskDispatcher) {
+        static std::atomic<uint64_t> sTaskCounter(0);
+        mTaskDispatcher->DispatchTask("mip-segment-prefetch-" + std::to_string(++sTaskCounter), task);
+      } else {
+        std::thread(task).detach();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->isPrefetchPending = false;
+    }
+  }
+
+  std::shared_ptr<State> mState;
+  int64_t mPrefetchSegments;
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  int64_t mPosition;
+  /** @endcond */
+}; // class DecryptedSegmentCacheStream
+
+/**
+ * @brief Creates a Stream that caches decrypted segments of a protected stream
+ * 
+ * @param protectedStream Stream returned by ProtectionHandler::CreateProtectedStream
+ * @param settings Cache settings
+ * 
+ * @return Caching stream
+ */
+inline std::shared_ptr<Stream> CreateDecryptedSegmentCacheStream(
+    const std::shared_ptr<Stream>& protectedStream,
+    const DecryptedSegmentCacheSettings& settings = DecryptedSegmentCacheSettings()) {
+  return std::make_shared<DecryptedSegmentCacheStream>(protectedStream, settings);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_DECRYPTED_SEGMENT_CACHE_H_
@@ -0,0 +1,284 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a tenant-scoped ProtectionEngine shared by the users it acts on behalf of
+ * 
+ * @file delegated_protection_engine.h
+ */
+
+#ifndef API_MIP_PROTECTION_DELEGATED_PROTECTION_ENGINE_H_
+#define API_MIP_PROTECTION_DELEGATED_PROTECTION_ENGINE_H_
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/get_template_settings.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/template_descriptor.h"
+#include "mip/protection/use_license_cache.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Limits of the per-user state kept by a DelegatedProtectionEngine
+ */
+struct DelegatedProtectionEngineSettings {
+  size_t maxUsers = 10000;          /**< Users with cached use licenses, least recently active dropped first */
+  size_t maxEntriesPerUser = 256;   /**< Consumption handlers cached for each user */
+  std::chrono::seconds useLicenseTimeToLive = std::chrono::hours(1); /**< Maximum time a cached handler is reused */
+};
+
+/**
+ * @brief One ProtectionEngine for a tenant's service identity, acting on behalf of a different user per operation
+ * 
+ * @note Creating an engine per delegated user duplicates the templates, user certificate and policy state of the
+ *       service identity for every user. Here the engine, and so all of that state, is created once per tenant and
+ *       each call names the user it acts on behalf of: the user is set on the ConsumptionSettings, PublishingSettings
+ *       or GetTemplatesSettings passed to the engine. The only state kept per user is a UseLicenseCache of the
+ *       consumption handlers created for them. The file equivalent is a single FileEngine without
+ *       FileEngine::Settings::SetDelegatedUserEmail, passing ProtectionSettings(delegatedUserEmail, ...) to
+ *       FileHandler::SetLabel and FileHandler::SetProtection. Decryption through a FileHandler always acts for the
+ *       delegated user of its FileEngine, so pass the content's publishing license to
+ *       CreateProtectionHandlerForConsumption to pick the user per operation.
+ */
+class DelegatedProtectionEngine {
+public:
+  /**
+   * @brief DelegatedProtectionEngine constructor
+   * 
+   * @param engine Engine of the tenant's service identity
+   * @param settings Limits of the per-user state
+   */
+  explicit DelegatedProtectionEngine(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      const DelegatedProtectionEngineSettings& settings = DelegatedProtectionEngineSettings())
+      : mEngine(engine),
+        mSettings(settings) {
+    if (!mEngine) {
+      throw BadInputError("DelegatedProtectionEngine requires a ProtectionEngine");
+    }
+    mSettings.maxUsers = (std::max)(mSettings.maxUsers, static_cast<size_t>(1));
+  }
+
+  /**
+   * @brief Get the shared engine
+   * 
+   * @return Engine of the tenant's service identity
+   */
+  const std::shared_ptr<ProtectionEngine>& GetEngine() const { return mEngine; }
+
+  /**
+   * @brief Get the templates available to a user
+   * 
+   * @param delegatedUserEmail User the service identity acts on behalf of
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return Templates
+   */
+  std::vector<std::shared_ptr<TemplateDescriptor>> GetTemplates(
+      const std::string& delegatedUserEmail,
+      const std::shared_ptr<void>& context = nullptr) {
+    ValidateUser(delegatedUserEmail);
+    auto settings = GetTemplatesSettings::CreateGetTemplatesSettings();
+    settings->SetDelegatedUserEmail(delegatedUserEmail);
+    return mEngine->GetTemplates(context, settings);
+  }
+
+  /**
+   * @brief Get the rights a user has for a label
+   * 
+   * @param delegatedUserEmail User the service identity acts on behalf of
+   * @param documentId Document ID associated with the document metadata
+   * @param labelId Label ID associated with the document metadata
+   * @param ownerEmail Owner of the document
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return List of rights
+   */
+  std::vector<std::string> GetRightsForLabelId(
+      const std::string& delegatedUserEmail,
+      const std::string& documentId,
+      const std::string& labelId,
+      const std::string& ownerEmail,
+      const std::shared_ptr<void>& context = nullptr) {
+    ValidateUser(delegatedUserEmail);
+    return mEngine->GetRightsForLabelId(documentId, labelId, ownerEmail, delegatedUserEmail, context);
+  }
+
+  /**
+   * @brief Create a publishing handler on behalf of a user
+   * 
+   * @param delegatedUserEmail User the content is published on behalf of
+   * @param settings Publishing settings, their delegated user is replaced
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return ProtectionHandler
+   */
+  std::shared_ptr<ProtectionHandler> CreateProtectionHandlerForPublishing(
+      const std::string& delegatedUserEmail,
+      const ProtectionHandler::PublishingSettings& settings,
+      const std::shared_ptr<void>& context = nullptr) {
+    ValidateUser(delegatedUserEmail);
+    ProtectionHandler::PublishingSettings delegatedSettings = settings;
+    delegatedSettings.SetDelegatedUserEmail(delegatedUserEmail);
+    return mEngine->CreateProtectionHandlerForPublishing(delegatedSettings, context);
+  }
+
+  /**
+   * @brief Get a consumption handler for a user, from their use license cache if possible
+   * 
+   * @param delegatedUserEmail User the content is consumed on behalf of
+   * @param settings Consumption settings, their delegated user is replaced
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate on a miss
+   * 
+   * @return ProtectionHandler
+   */
+  std::shared_ptr<ProtectionHandler> CreateProtectionHandlerForConsumption(
+      const std::string& delegatedUserEmail,
+      const ProtectionHandler::ConsumptionSettings& settings,
+      const std::shared_ptr<void>& context = nullptr) {
+    ValidateUser(delegatedUserEmail);
+    ProtectionHandler::ConsumptionSettings delegatedSettings = settings;
+    delegatedSettings.SetDelegatedUserEmail(delegatedUserEmail);
+    return GetUseLicenseCache(delegatedUserEmail)->GetOrCreateConsumptionHandler(mEngine, delegatedSettings, context);
+  }
+
+  /**
+   * @brief Drop the cached use licenses of a user, for example when their session ends
+   * 
+   * @param delegatedUserEmail User the service identity acted on behalf of
+   */
+  void ReleaseUser(const std::string& delegatedUserEmail) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto user = mIndex.find(ToLower(delegatedUserEmail));
+    if (user != mIndex.end()) {
+      mUsers.erase(user->second);
+      mIndex.erase(user);
+    }
+  }
+
+  /**
+   * @brief Remove the cached handlers of a content ID for all users, for example after it has been revoked
+   * 
+   * @param contentId Content ID, as returned by ProtectionHandler::GetContentId
+   */
+  void RemoveContent(const std::string& contentId) {
+    for (const auto& cache : GetUseLicenseCaches()) {
+      cache->RemoveContent(contentId);
+    }
+  }
+
+  /**
+   * @brief Get the number of users with per-user state
+   * 
+   * @return User count
+   */
+  size_t GetUserCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mUsers.size();
+  }
+
+  /**
+   * @brief Get the number of cached consumption handlers, over all users
+   * 
+   * @return Entry count
+   */
+  size_t GetUseLicenseEntryCount() const {
+    size_t count = 0;
+    for (const auto& cache : GetUseLicenseCaches()) {
+      count += cache->GetEntryCount();
+    }
+    return count;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct User {
+    std::string key;
+    std::shared_ptr<UseLicenseCache> cache;
+  };
+
+  static std::string ToLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+  }
+
+  static void ValidateUser(const std::string& delegatedUserEmail) {
+    if (delegatedUserEmail.empty()) {
+      throw BadInputError("A delegated user email is required");
+    }
+  }
+
+  std::shared_ptr<UseLicenseCache> GetUseLicenseCache(const std::string& delegatedUserEmail) {
+    std::string key = ToLower(delegatedUserEmail);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto user = mIndex.find(key);
+    if (user != mIndex.end()) {
+      mUsers.splice(mUsers.begin(), mUsers, user->second);
+      return user->second->cache;
+    }
+    auto cache = std::make_shared<UseLicenseCache>(mSettings.maxEntriesPerUser, mSettings.useLicenseTimeToLive);
+    mUsers.push_front(User{key, cache});
+    mIndex[key] = mUsers.begin();
+    while (mUsers.size() > mSettings.maxUsers) {
+      mIndex.erase(mUsers.back().key);
+      mUsers.pop_back();
+    }
+    return cache;
+  }
+
+  std::vector<std::shared_ptr<UseLicenseCache>> GetUseLicenseCaches() const {
+    std::vector<std::shared_ptr<UseLicenseCache>> caches;
+    std::lock_guard<std::mutex> lock(mMutex);
+    caches.reserve(mUsers.size());
+    for (const auto& user : mUsers) {
+      caches.push_back(user.cache);
+    }
+    return caches;
+  }
+
+  std::shared_ptr<ProtectionEngine> mEngine;
+  DelegatedProtectionEngineSettings mSettings;
+  mutable std::mutex mMutex;
+  std::list<User> mUsers;
+  std::unordered_map<std::string, std::list<User>::iterator> mIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_DELEGATED_PROTECTION_ENGINE_H_
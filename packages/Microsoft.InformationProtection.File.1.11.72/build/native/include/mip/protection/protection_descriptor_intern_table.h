@@ -0,0 +1,297 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an intern table handing out shared, immutable ProtectionDescriptors
+ *
+ * @file protection_descriptor_intern_table.h
+ */
+
+#ifndef API_MIP_PROTECTION_PROTECTION_DESCRIPTOR_INTERN_TABLE_H_
+#define API_MIP_PROTECTION_PROTECTION_DESCRIPTOR_INTERN_TABLE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_descriptor_builder.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection_descriptor.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Template-based protection to build a ProtectionDescriptor for
+ */
+struct TemplateProtectionRequest {
+  std::string templateId;                              /**< Protection template ID */
+  std::string name;                                    /**< Policy name, or empty for the template's */
+  std::string description;                             /**< Policy description, or empty for the template's */
+  bool doesContentExpire = false;                      /**< Whether contentValidUntil is applied */
+  std::chrono::system_clock::time_point contentValidUntil; /**< Expiry, if doesContentExpire */
+  bool isAllowOfflineAccessSet = false;                /**< Whether allowOfflineAccess is applied */
+  bool allowOfflineAccess = true;                      /**< Offline access, if isAllowOfflineAccessSet */
+  std::string referrer;                                /**< Referrer, or empty for the template's */
+  std::map<std::string, std::string> encryptedAppData; /**< App data encrypted by the service */
+  std::map<std::string, std::string> signedAppData;    /**< App data signed by the service */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace descriptorintern {
+
+// Length-prefixed fields, so that distinct field values never produce the same key
+class KeyWriter {
+public:
+  void Add(const std::string& value) {
+    mKey += std::to_string(value.size());
+    mKey += ':';
+    mKey += value;
+  }
+
+  void Add(int64_t value) { Add(std::to_string(value)); }
+
+  void Add(const std::vector<std::string>& values) {
+    Add(static_cast<int64_t>(values.size()));
+    for (const std::string& value : values) {
+      Add(value);
+    }
+  }
+
+  void Add(const std::map<std::string, std::string>& values) {
+    Add(static_cast<int64_t>(values.size()));
+    for (const auto& value : values) {
+      Add(value.first);
+      Add(value.second);
+    }
+  }
+
+  std::string& GetKey() { return mKey; }
+
+private:
+  std::string mKey;
+};
+
+inline int64_t ToTicks(const std::chrono::time_point<std::chrono::system_clock>& time) {
+  return static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+inline std::string GetKey(const TemplateProtectionRequest& request) {
+  KeyWriter writer;
+  writer.Add("template");
+  writer.Add(request.templateId);
+  writer.Add(request.name);
+  writer.Add(request.description);
+  writer.Add(request.doesContentExpire ? ToTicks(request.contentValidUntil) : -1);
+  writer.Add(request.isAllowOfflineAccessSet ? static_cast<int64_t>(request.allowOfflineAccess) : -1);
+  writer.Add(request.referrer);
+  writer.Add(request.encryptedAppData);
+  writer.Add(request.signedAppData);
+  return std::move(writer.GetKey());
+}
+
+inline std::string GetKey(const ProtectionDescriptor& descriptor) {
+  KeyWriter writer;
+  writer.Add("descriptor");
+  writer.Add(static_cast<int64_t>(descriptor.GetProtectionType()));
+  writer.Add(descriptor.GetOwner());
+  writer.Add(descriptor.GetName());
+  writer.Add(descriptor.GetDescription());
+  writer.Add(descriptor.GetTemplateId());
+  writer.Add(descriptor.GetLabelId());
+  writer.Add(descriptor.GetContentId());
+  auto userRights = descriptor.GetUserRights();
+  writer.Add(static_cast<int64_t>(userRights.size()));
+  for (const UserRights& group : userRights) {
+    writer.Add(group.Users());
+    writer.Add(group.Rights());
+  }
+  auto userRoles = descriptor.GetUserRoles();
+  writer.Add(static_cast<int64_t>(userRoles.size()));
+  for (const UserRoles& group : userRoles) {
+    writer.Add(group.Users());
+    writer.Add(group.Roles());
+  }
+  writer.Add(descriptor.DoesContentExpire() ? ToTicks(descriptor.GetContentValidUntil()) : -1);
+  writer.Add(static_cast<int64_t>(descriptor.DoesAllowOfflineAccess()));
+  writer.Add(descriptor.GetReferrer());
+  writer.Add(descriptor.GetEncryptedAppData());
+  writer.Add(descriptor.GetSignedAppData());
+  writer.Add(descriptor.GetDoubleKeyUrl());
+  return std::move(writer.GetKey());
+}
+
+} // namespace descriptorintern
+/** @endcond */
+
+/**
+ * @brief Hands out one shared ProtectionDescriptor per distinct protection, instead of one per file
+ *
+ * @note Protecting thousands of files with the same template otherwise builds thousands of identical descriptors,
+ *       each with its own copies of the name, description, user rights and referrer. GetFromTemplate builds a
+ *       descriptor once per distinct TemplateProtectionRequest; Intern maps any descriptor, such as one returned by
+ *       ProtectionHandler::GetProtectionDescriptor, to the first equal one seen. Descriptors only expose const
+ *       getters, so sharing them is safe. The table holds descriptors weakly: one is freed once no caller holds it,
+ *       and its entry is pruned as the table grows. Thread-safe; keep one table per engine or per process.
+ */
+class ProtectionDescriptorInternTable {
+public:
+  /**
+   * @brief Get the shared descriptor for a template-based protection, building it on first use
+   *
+   * @param request Template and overrides
+   *
+   * @return Shared descriptor
+   */
+  std::shared_ptr<ProtectionDescriptor> GetFromTemplate(const TemplateProtectionRequest& request) {
+    if (request.templateId.empty()) {
+      throw BadInputError("Template-based protection requires a template ID");
+    }
+    std::string key = descriptorintern::GetKey(request);
+    auto descriptor = Find(key);
+    if (descriptor) {
+      return descriptor;
+    }
+    // Build outside of the lock; if two threads race, the first to insert wins and the other copy is dropped
+    auto builder = ProtectionDescriptorBuilder::CreateFromTemplate(request.templateId);
+    if (!request.name.empty()) {
+      builder->SetName(request.name);
+    }
+    if (!request.description.empty()) {
+      builder->SetDescription(request.description);
+    }
+    if (request.doesContentExpire) {
+      builder->SetContentValidUntil(request.contentValidUntil);
+    }
+    if (request.isAllowOfflineAccessSet) {
+      builder->SetAllowOfflineAccess(request.allowOfflineAccess);
+    }
+    if (!request.referrer.empty()) {
+      builder->SetReferrer(request.referrer);
+    }
+    if (!request.encryptedAppData.empty()) {
+      builder->SetEncryptedAppData(request.encryptedAppData);
+    }
+    if (!request.signedAppData.empty()) {
+      builder->SetSignedAppData(request.signedAppData);
+    }
+    return Insert(key, builder->Build());
+  }
+
+  /**
+   * @brief Get the shared descriptor equal to a descriptor
+   *
+   * @param descriptor Descriptor
+   *
+   * @return The first equal descriptor interned, or descriptor itself if it is the first
+   *
+   * @note Equality covers every field, including the content ID, so descriptors of distinct protected files do not
+   *       collapse into one.
+   */
+  std::shared_ptr<ProtectionDescriptor> Intern(const std::shared_ptr<ProtectionDescriptor>& descriptor) {
+    if (!descriptor) {
+      return descriptor;
+    }
+    std::string key = descriptorintern::GetKey(*descriptor);
+    auto existing = Find(key);
+    return existing ? existing : Insert(key, descriptor);
+  }
+
+  /**
+   * @brief Get the shared descriptor of a protection handler
+   *
+   * @param handler Protection handler
+   *
+   * @return Shared descriptor equal to handler->GetProtectionDescriptor()
+   */
+  std::shared_ptr<ProtectionDescriptor> GetProtectionDescriptor(const std::shared_ptr<ProtectionHandler>& handler) {
+    if (!handler) {
+      throw BadInputError("Protection handler is null");
+    }
+    return Intern(handler->GetProtectionDescriptor());
+  }
+
+  /**
+   * @brief Get the number of descriptors currently shared
+   *
+   * @return Live descriptor count
+   */
+  size_t GetCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t count = 0;
+    for (const auto& entry : mEntries) {
+      count += entry.second.expired() ? 0 : 1;
+    }
+    return count;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<ProtectionDescriptor> Find(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mEntries.find(key);
+    return found != mEntries.end() ? found->second.lock() : nullptr;
+  }
+
+  std::shared_ptr<ProtectionDescriptor> Insert(const std::string& key,
+      const std::shared_ptr<ProtectionDescriptor>& descriptor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& entry = mEntries[key];
+    auto existing = entry.lock();
+    if (existing) {
+      return existing;
+    }
+    entry = descriptor;
+    // Prune entries whose descriptors were released, amortized over the insertions that doubled the table
+    if (mEntries.size() >= mPruneThreshold) {
+      for (auto it = mEntries.begin(); it != mEntries.end();) {
+        it = it->second.expired() ? mEntries.erase(it) : std::next(it);
+      }
+      mPruneThreshold = (std::max)(static_cast<size_t>(kMinPruneThreshold), mEntries.size() * 2);
+    }
+    return descriptor;
+  }
+
+  static const size_t kMinPruneThreshold = 64;
+
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, std::weak_ptr<ProtectionDescriptor>> mEntries;
+  size_t mPruneThreshold = kMinPruneThreshold;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PROTECTION_DESCRIPTOR_INTERN_TABLE_H_
@@ -0,0 +1,274 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a refreshing cache of templates and rights for a ProtectionEngine
+ * 
+ * @file protection_engine_cache.h
+ */
+
+#ifndef API_MIP_PROTECTION_PROTECTION_ENGINE_CACHE_H_
+#define API_MIP_PROTECTION_PROTECTION_ENGINE_CACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/template_descriptor.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace enginecache {
+
+// Caches values by key. With a dispatcher, each entry is reloaded in the background when its time to live elapses,
+// as long as it was read since the previous load; entries that are not read are dropped instead. Without a
+// dispatcher, an expired entry is reloaded by the next caller.
+template <typename T>
+class RefreshingCache {
+public:
+  RefreshingCache(const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher, std::chrono::seconds timeToLive)
+      : mState(std::make_shared<State>()) {
+    mState->taskDispatcher = taskDispatcher;
+    mState->timeToLive = timeToLive.count() > 0 ? timeToLive : std::chrono::seconds(1);
+  }
+
+  T Get(const std::string& key, const std::function<T()>& loader) {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      auto cached = mState->entries.find(key);
+      if (cached != mState->entries.end() && IsUsable(*mState, cached->second)) {
+        cached->second.isAccessed = true;
+        return cached->second.value;
+      }
+    }
+    T value = loader();
+    bool shouldSchedule = false;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      Entry& entry = mState->entries[key];
+      entry.value = value;
+      entry.loader = loader;
+      entry.isAccessed = false;
+      entry.expiry = std::chrono::steady_clock::now() + mState->timeToLive;
+      if (mState->taskDispatcher && !entry.isRefreshScheduled) {
+        entry.isRefreshScheduled = true;
+        shouldSchedule = true;
+      }
+    }
+    if (shouldSchedule) {
+      ScheduleRefresh(mState, key);
+    }
+    return value;
+  }
+
+  void Remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->entries.erase(key);
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    mState->entries.clear();
+  }
+
+private:
+  struct Entry {
+    T value;
+    std::function<T()> loader;
+    bool isAccessed = false;
+    bool isRefreshScheduled = false;
+    std::chrono::steady_clock::time_point expiry;
+  };
+
+  struct State {
+    std::mutex mutex;
+    std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+    std::chrono::seconds timeToLive;
+    std::unordered_map<std::string, Entry> entries;
+  };
+
+  static bool IsUsable(const State& state, const Entry& entry) {
+    // A background refresh replaces the value around its expiry; allow one extra period before giving up on it
+    auto deadline = state.taskDispatcher ? entry.expiry + state.timeToLive : entry.expiry;
+    return std::chrono::steady_clock::now() < deadline;
+  }
+
+  static void ScheduleRefresh(const std::shared_ptr<State>& state, const std::string& key) {
+    static std::atomic<uint64_t> sTaskCounter(0);
+    std::weak_ptr<State> weakState = state;
+    try {
+      state->taskDispatcher->DispatchTask(
+          "mip-engine-cache-refresh-" + std::to_string(++sTaskCounter),
+          [weakState, key]() { Refresh(weakState, key); },
+          static_cast<int64_t>(state->timeToLive.count()));
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->entries.erase(key);
+    }
+  }
+
+  static void Refresh(const std::weak_ptr<State>& weakState, const std::string& key) {
+    auto state = weakState.lock();
+    if (!state) {
+      return;
+    }
+    std::function<T()> loader;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto cached = state->entries.find(key);
+      if (cached == state->entries.end()) {
+        return;
+      }
+      if (!cached->second.isAccessed) {
+        state->entries.erase(cached);
+        return;
+      }
+      loader = cached->second.loader;
+    }
+    T value;
+    try {
+      value = loader();
+    } catch (...) {
+      // Drop the entry so that the next caller loads it again and sees the error
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->entries.erase(key);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      auto cached = state->entries.find(key);
+      if (cached == state->entries.end()) {
+        return;
+      }
+      cached->second.value = value;
+      cached->second.isAccessed = false;
+      cached->second.expiry = std::chrono::steady_clock::now() + state->timeToLive;
+    }
+    ScheduleRefresh(state, key);
+  }
+
+  std::shared_ptr<State> mState;
+};
+
+} // namespace enginecache
+/** @endcond */
+
+/**
+ * @brief Caches ProtectionEngine::GetTemplates and ProtectionEngine::GetRightsForLabelId results.
+ * 
+ * @note When a TaskDispatcherDelegate is provided, cached results are reloaded in the background once their time to
+ *       live elapses, using the delayed TaskDispatcherDelegate::DispatchTask overload, so callers never wait for a
+ *       refresh. Results that were not read since they were last loaded are dropped instead of reloaded. A failed
+ *       refresh drops the result, and the next caller reloads it and receives the error. Without a dispatcher,
+ *       the first caller after expiry reloads the result.
+ */
+class ProtectionEngineCache {
+public:
+  /**
+   * @brief ProtectionEngineCache constructor
+   * 
+   * @param engine Protection engine whose results are cached
+   * @param timeToLive How long a result is served before it is reloaded
+   * @param taskDispatcher Task dispatcher used for background refresh, nullptr to reload on the calling thread
+   */
+  ProtectionEngineCache(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      std::chrono::seconds timeToLive = std::chrono::minutes(15),
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher = nullptr)
+      : mEngine(engine),
+        mTemplates(taskDispatcher, timeToLive),
+        mRights(taskDispatcher, timeToLive) {
+    if (!mEngine) {
+      throw BadInputError("ProtectionEngineCache requires a ProtectionEngine");
+    }
+  }
+
+  /**
+   * @brief Get collection of templates available to the engine's user
+   *
+   * @param context Client context that will be opaquely passed to optional HttpDelegate when templates are loaded
+   * 
+   * @return List of templates
+   */
+  std::vector<std::shared_ptr<TemplateDescriptor>> GetTemplates(const std::shared_ptr<void>& context = nullptr) {
+    auto engine = mEngine;
+    return mTemplates.Get(std::string(), [engine, context]() { return engine->GetTemplates(context); });
+  }
+
+  /**
+   * @brief Get collection of rights available to the engine's user for a label ID
+   *
+   * @param documentId Document ID associated with the document metadata
+   * @param labelId Label ID associated with the document metadata with which the document created
+   * @param ownerEmail Owner of the document
+   * @param delegatedUserEmail Delegated user, empty if none
+   * @param context Client context that will be opaquely passed to optional HttpDelegate when rights are loaded
+   * 
+   * @return List of rights
+   */
+  std::vector<std::string> GetRightsForLabelId(
+      const std::string& documentId,
+      const std::string& labelId,
+      const std::string& ownerEmail,
+      const std::string& delegatedUserEmail,
+      const std::shared_ptr<void>& context = nullptr) {
+    std::string key;
+    key.append(documentId).append(1, '\n').append(labelId).append(1, '\n');
+    key.append(ownerEmail).append(1, '\n').append(delegatedUserEmail);
+    auto engine = mEngine;
+    return mRights.Get(key, [engine, documentId, labelId, ownerEmail, delegatedUserEmail, context]() {
+      return engine->GetRightsForLabelId(documentId, labelId, ownerEmail, delegatedUserEmail, context);
+    });
+  }
+
+  /**
+   * @brief Drop every cached result, for example after a policy change
+   */
+  void Clear() {
+    mTemplates.Clear();
+    mRights.Clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<ProtectionEngine> mEngine;
+  enginecache::RefreshingCache<std::vector<std::shared_ptr<TemplateDescriptor>>> mTemplates;
+  enginecache::RefreshingCache<std::vector<std::string>> mRights;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PROTECTION_ENGINE_CACHE_H_
@@ -0,0 +1,495 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers for bulk operations through a ProtectionEngine
+ * 
+ * @file protection_engine_utils.h
+ */
+
+#ifndef API_MIP_PROTECTION_PROTECTION_ENGINE_UTILS_H_
+#define API_MIP_PROTECTION_PROTECTION_ENGINE_UTILS_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/delegation_license.h"
+#include "mip/protection/delegation_license_settings.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Result of one item of a batched ProtectionHandler creation
+ */
+struct ProtectionHandlerBatchResult {
+  std::shared_ptr<ProtectionHandler> handler; /**< Created handler, nullptr if creation failed */
+  std::exception_ptr error;                   /**< Failure that occurred during creation, nullptr on success */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace enginebatch {
+
+inline void SetError(ProtectionHandlerBatchResult& result, const std::exception_ptr& error) { result.error = error; }
+inline void SetError(std::exception_ptr& result, const std::exception_ptr& error) { result = error; }
+
+template <typename TResult>
+class BatchState {
+public:
+  explicit BatchState(size_t itemCount) : mResults(itemCount), mInFlight(0), mCompleted(0) {}
+
+  void WaitForSlot(size_t maxInFlight) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this, maxInFlight]() { return mInFlight < maxInFlight; });
+    ++mInFlight;
+  }
+
+  void Complete(size_t index, TResult result) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResults[index] = std::move(result);
+    --mInFlight;
+    ++mCompleted;
+    mCondition.notify_all();
+  }
+
+  void Fail(size_t index, const std::exception_ptr& error) {
+    TResult result;
+    SetError(result, error);
+    Complete(index, std::move(result));
+  }
+
+  std::vector<TResult> WaitForAll() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this]() { return mCompleted == mResults.size(); });
+    return std::move(mResults);
+  }
+
+private:
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::vector<TResult> mResults;
+  size_t mInFlight;
+  size_t mCompleted;
+};
+
+class HandlerItemObserver : public ProtectionHandler::Observer {
+public:
+  HandlerItemObserver(const std::shared_ptr<BatchState<ProtectionHandlerBatchResult>>& state, size_t index)
+      : mState(state), mIndex(index) {}
+
+  void OnCreateProtectionHandlerSuccess(
+      const std::shared_ptr<ProtectionHandler>& protectionHandler,
+      const std::shared_ptr<void>& /*context*/) override {
+    mState->Complete(mIndex, ProtectionHandlerBatchResult{protectionHandler, nullptr});
+  }
+
+  void OnCreateProtectionHandlerFailure(
+      const std::exception_ptr& error,
+      const std::shared_ptr<void>& /*context*/) override {
+    mState->Fail(mIndex, error);
+  }
+
+private:
+  std::shared_ptr<BatchState<ProtectionHandlerBatchResult>> mState;
+  size_t mIndex;
+};
+
+class EngineItemObserver : public ProtectionEngine::Observer {
+public:
+  EngineItemObserver(const std::shared_ptr<BatchState<std::exception_ptr>>& state, size_t index)
+      : mState(state), mIndex(index) {}
+
+  void OnRegisterContentForTrackingAndRevocationSuccess(const std::shared_ptr<void>& /*context*/) override {
+    mState->Complete(mIndex, nullptr);
+  }
+
+  void OnRegisterContentForTrackingAndRevocationFailure(
+      const std::exception_ptr& error,
+      const std::shared_ptr<void>& /*context*/) override {
+    mState->Fail(mIndex, error);
+  }
+
+  void OnRevokeContentSuccess(const std::shared_ptr<void>& /*context*/) override { mState->Complete(mIndex, nullptr); }
+
+  void OnRevokeContentFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    mState->Fail(mIndex, error);
+  }
+
+  void SetDelegationLicensesCallback(
+      const std::function<void(size_t, const std::vector<std::shared_ptr<DelegationLicense>>&)>& callback) {
+    mDelegationLicensesCallback = callback;
+  }
+
+  void OnCreateDelegatedLicensesSuccess(
+      std::vector<std::shared_ptr<DelegationLicense>> delegatedLicenses,
+      const std::shared_ptr<void>& /*context*/) override {
+    try {
+      if (mDelegationLicensesCallback) {
+        mDelegationLicensesCallback(mIndex, delegatedLicenses);
+      }
+    } catch (...) {
+      mState->Fail(mIndex, std::current_exception());
+      return;
+    }
+    mState->Complete(mIndex, nullptr);
+  }
+
+  void OnCreateDelegatedLicensesFailure(
+      const std::exception_ptr& error,
+      const std::shared_ptr<void>& /*context*/) override {
+    mState->Fail(mIndex, error);
+  }
+
+private:
+  std::shared_ptr<BatchState<std::exception_ptr>> mState;
+  size_t mIndex;
+  std::function<void(size_t, const std::vector<std::shared_ptr<DelegationLicense>>&)> mDelegationLicensesCallback;
+};
+
+inline std::string GetLicensingEndpoint(const ProtectionHandler::ConsumptionSettings& settings) {
+  auto licenseInfo = settings.GetPublishingLicenseInfo();
+  if (!licenseInfo || !licenseInfo->IsLicenseParsed()) {
+    return std::string();
+  }
+  auto connectionInfo = licenseInfo->GetConnectionInfo();
+  return connectionInfo ? connectionInfo->GetExtranetUrl() : std::string();
+}
+
+inline std::vector<size_t> GetSequentialOrder(size_t count) {
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+  return order;
+}
+
+// Submits items in the given order, keeping at most maxInFlight incomplete. submit starts the operation for an item
+// and returns its observer, which is kept alive until the whole batch has completed.
+template <typename TObserver, typename TResult>
+std::vector<TResult> RunBatch(
+    const std::vector<size_t>& order,
+    size_t maxInFlight,
+    const std::function<void(size_t, const std::shared_ptr<TObserver>&)>& submit) {
+  maxInFlight = (std::max)(maxInFlight, static_cast<size_t>(1));
+  auto state = std::make_shared<BatchState<TResult>>(order.size());
+  std::vector<std::shared_ptr<TObserver>> observers;
+  observers.reserve(order.size());
+  for (size_t index : order) {
+    state->WaitForSlot(maxInFlight);
+    auto observer = std::make_shared<TObserver>(state, index);
+    observers.push_back(observer);
+    try {
+      submit(index, observer);
+    } catch (...) {
+      state->Fail(index, std::current_exception());
+    }
+  }
+  return state->WaitForAll();
+}
+
+inline std::vector<ProtectionHandlerBatchResult> RunHandlerBatch(
+    const std::vector<size_t>& order,
+    size_t maxInFlight,
+    const std::function<void(size_t, const std::shared_ptr<HandlerItemObserver>&)>& submit) {
+  return RunBatch<HandlerItemObserver, ProtectionHandlerBatchResult>(order, maxInFlight, submit);
+}
+
+inline std::vector<std::exception_ptr> RunEngineBatch(
+    size_t count,
+    size_t maxInFlight,
+    const std::function<void(size_t, const std::shared_ptr<EngineItemObserver>&)>& submit) {
+  return RunBatch<EngineItemObserver, std::exception_ptr>(GetSequentialOrder(count), maxInFlight, submit);
+}
+
+} // namespace enginebatch
+/** @endcond */
+
+/**
+ * @brief Create consumption ProtectionHandlers for many pieces of content, keeping several licensing requests in
+ *        flight at once
+ * 
+ * @param engine Protection engine
+ * @param settings Consumption settings, one per piece of content
+ * @param maxInFlight Maximum number of concurrent ProtectionEngine::CreateProtectionHandlerForConsumptionAsync
+ *        operations
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return One result per item of @p settings, in the same order
+ * 
+ * @note Items whose publishing license has been parsed (see PublishingLicenseInfo::SetParsedData) are submitted
+ *       grouped by licensing endpoint, so that consecutive requests reuse the same connection. A failure of one
+ *       item is reported in its result and does not affect the others. The call blocks until every item completes.
+ */
+inline std::vector<ProtectionHandlerBatchResult> CreateProtectionHandlersForConsumptionBatch(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::vector<ProtectionHandler::ConsumptionSettings>& settings,
+    size_t maxInFlight = 16,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  std::vector<std::string> endpoints;
+  endpoints.reserve(settings.size());
+  std::vector<size_t> order(settings.size());
+  for (size_t i = 0; i < settings.size(); ++i) {
+    endpoints.push_back(enginebatch::GetLicensingEndpoint(settings[i]));
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&endpoints](size_t left, size_t right) {
+    return endpoints[left] < endpoints[right];
+  });
+
+  return enginebatch::RunHandlerBatch(
+      order,
+      maxInFlight,
+      [&engine, &settings, &context](size_t index, const std::shared_ptr<enginebatch::HandlerItemObserver>& observer) {
+        engine->CreateProtectionHandlerForConsumptionAsync(settings[index], observer, context);
+      });
+}
+
+/**
+ * @brief Register many publishing licenses for document tracking and revocation
+ * 
+ * @param engine Protection engine
+ * @param serializedPublishingLicenses Serialized publishing licenses, one per document
+ * @param contentNames Names to associate with the documents, either empty or one per publishing license
+ * @param isOwnerNotificationEnabled Set to true to notify the owners via email whenever the documents are decrypted
+ * @param maxInFlight Maximum number of concurrent registrations
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return One result per publishing license, in the same order: nullptr on success, else the failure
+ * 
+ * @note The call blocks until every registration completes. A failure of one item does not affect the others.
+ */
+inline std::vector<std::exception_ptr> RegisterContentForTrackingAndRevocationBatch(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::vector<std::vector<uint8_t>>& serializedPublishingLicenses,
+    const std::vector<std::string>& contentNames,
+    bool isOwnerNotificationEnabled,
+    size_t maxInFlight = 16,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  if (!contentNames.empty() && contentNames.size() != serializedPublishingLicenses.size()) {
+    throw BadInputError("contentNames must be empty or have one entry per publishing license");
+  }
+  static const std::string kNoContentName;
+  return enginebatch::RunEngineBatch(
+      serializedPublishingLicenses.size(),
+      maxInFlight,
+      [&](size_t index, const std::shared_ptr<enginebatch::EngineItemObserver>& observer) {
+        engine->RegisterContentForTrackingAndRevocationAsync(
+            serializedPublishingLicenses[index],
+            contentNames.empty() ? kNoContentName : contentNames[index],
+            isOwnerNotificationEnabled,
+            observer,
+            context);
+      });
+}
+
+/**
+ * @brief Revoke many documents
+ * 
+ * @param engine Protection engine
+ * @param serializedPublishingLicenses Serialized publishing licenses, one per document
+ * @param maxInFlight Maximum number of concurrent revocations
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return One result per publishing license, in the same order: nullptr on success, else the failure
+ * 
+ * @note The call blocks until every revocation completes. A failure of one item does not affect the others.
+ */
+inline std::vector<std::exception_ptr> RevokeContentBatch(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::vector<std::vector<uint8_t>>& serializedPublishingLicenses,
+    size_t maxInFlight = 16,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  return enginebatch::RunEngineBatch(
+      serializedPublishingLicenses.size(),
+      maxInFlight,
+      [&](size_t index, const std::shared_ptr<enginebatch::EngineItemObserver>& observer) {
+        engine->RevokeContentAsync(serializedPublishingLicenses[index], observer, context);
+      });
+}
+
+/**
+ * @brief Create delegation licenses for a large list of users, delivering them chunk by chunk
+ * 
+ * @param engine Protection engine
+ * @param settings Delegation settings holding the publishing license and the full list of users
+ * @param onLicenses Called with the licenses of each chunk as soon as the chunk completes, along with the index in
+ *        DelegationLicenseSettings::GetUsers of the chunk's first user. Calls are serialized but may come from any
+ *        thread and in any order.
+ * @param usersPerChunk Number of users per ProtectionEngine::CreateDelegationLicensesAsync call
+ * @param maxInFlight Maximum number of concurrent chunks
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return One result per chunk, in user order: nullptr on success, else the failure. Chunk @p i covers users
+ *         [i * usersPerChunk, (i + 1) * usersPerChunk).
+ * 
+ * @note Licenses are not retained once @p onLicenses returns, so memory use is bounded by @p maxInFlight chunks.
+ *       An exception thrown by @p onLicenses is reported as the failure of that chunk.
+ */
+inline std::vector<std::exception_ptr> CreateDelegationLicensesChunked(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const DelegationLicenseSettings& settings,
+    const std::function<void(size_t, const std::vector<std::shared_ptr<DelegationLicense>>&)>& onLicenses,
+    size_t usersPerChunk = 100,
+    size_t maxInFlight = 4,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  auto licenseInfo = settings.GetLicenseInfo();
+  if (!licenseInfo) {
+    throw BadInputError("DelegationLicenseSettings requires a publishing license");
+  }
+  usersPerChunk = (std::max)(usersPerChunk, static_cast<size_t>(1));
+  const std::vector<std::string>& users = settings.GetUsers();
+  size_t chunkCount = (users.size() + usersPerChunk - 1) / usersPerChunk;
+  std::mutex callbackMutex;
+  auto serializedCallback = [&](size_t chunkIndex, const std::vector<std::shared_ptr<DelegationLicense>>& licenses) {
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    onLicenses(chunkIndex * usersPerChunk, licenses);
+  };
+  return enginebatch::RunEngineBatch(
+      chunkCount,
+      maxInFlight,
+      [&](size_t index, const std::shared_ptr<enginebatch::EngineItemObserver>& observer) {
+        auto first = users.begin() + static_cast<std::ptrdiff_t>(index * usersPerChunk);
+        auto last = users.begin() + static_cast<std::ptrdiff_t>((std::min)((index + 1) * usersPerChunk, users.size()));
+        auto chunkSettings = DelegationLicenseSettings::CreateDelegationLicenseSettings(
+            *licenseInfo, std::vector<std::string>(first, last), settings.GetAquireEndUserLicenses());
+        observer->SetDelegationLicensesCallback(serializedCallback);
+        engine->CreateDelegationLicensesAsync(*chunkSettings, observer, context);
+      });
+}
+
+/**
+ * @brief Pre-licenses of the recipients of protected content
+ */
+struct RecipientPreLicenses {
+  std::map<std::string, std::vector<uint8_t>> preLicenses; /**< Pre-license by DelegationLicense::GetUser */
+  std::vector<std::string> failedRecipients;                /**< Recipients of the chunks that failed */
+  std::exception_ptr error;                                 /**< First failure, nullptr if every chunk succeeded */
+};
+
+/**
+ * @brief Request a pre-license for every recipient of content being protected, in the background
+ * 
+ * @param engine Protection engine that created the publishing handler
+ * @param publishingHandler Handler created with ProtectionEngine::CreateProtectionHandlerForPublishing. Its publishing
+ *        license is available as soon as it is created, before any content is encrypted.
+ * @param recipients Recipient emails, e.g. every recipient of a message
+ * @param format Pre-license format recipients' clients expect
+ * @param usersPerChunk Number of recipients per ProtectionEngine::CreateDelegationLicensesAsync call
+ * @param maxInFlight Maximum number of concurrent chunks
+ * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+ * 
+ * @return Future of the pre-licenses, ready once every chunk has completed
+ * 
+ * @note PublishingSettings::SetRequestPreLicense covers one user. This covers every recipient with one round trip
+ *       per chunk, running while the caller encrypts the content with the same handler, so sending waits only for
+ *       whichever of the two takes longer. Attach each recipient's pre-license to their copy, or to the message
+ *       where the transport supports it, so their client opens the content without acquiring a license. The
+ *       engine's identity needs the rights CreateDelegationLicenses requires. The future keeps engine and
+ *       publishingHandler alive until it is ready; it always completes, failures are reported in the result.
+ */
+inline std::future<RecipientPreLicenses> RequestRecipientPreLicensesAsync(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& publishingHandler,
+    const std::vector<std::string>& recipients,
+    ProtectionHandler::PreLicenseFormat format = ProtectionHandler::PreLicenseFormat::Json,
+    size_t usersPerChunk = 100,
+    size_t maxInFlight = 4,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  if (!publishingHandler) {
+    throw BadInputError("A publishing ProtectionHandler is required");
+  }
+  // Read the publishing license on the caller's thread, so that a handler that has none fails here
+  PublishingLicenseInfo licenseInfo(publishingHandler->GetSerializedPublishingLicense());
+  usersPerChunk = (std::max)(usersPerChunk, static_cast<size_t>(1));
+  auto settings = DelegationLicenseSettings::CreateDelegationLicenseSettings(
+      licenseInfo, recipients, true /*aquireEndUserLicenses*/);
+  return std::async(std::launch::async, [engine, publishingHandler, settings, format, usersPerChunk, maxInFlight,
+      context]() {
+    RecipientPreLicenses result;
+    try {
+      auto errors = CreateDelegationLicensesChunked(
+          engine,
+          *settings,
+          [&](size_t, const std::vector<std::shared_ptr<DelegationLicense>>& licenses) {
+            for (const auto& license : licenses) {
+              if (license) {
+                result.preLicenses[license->GetUser()] = license->GetSerializedUserLicense(format);
+              }
+            }
+          },
+          usersPerChunk,
+          maxInFlight,
+          context);
+      const std::vector<std::string>& users = settings->GetUsers();
+      for (size_t chunk = 0; chunk < errors.size(); ++chunk) {
+        if (!errors[chunk]) {
+          continue;
+        }
+        if (!result.error) {
+          result.error = errors[chunk];
+        }
+        size_t end = (std::min)((chunk + 1) * usersPerChunk, users.size());
+        result.failedRecipients.insert(result.failedRecipients.end(), users.begin() + chunk * usersPerChunk,
+            users.begin() + end);
+      }
+    } catch (...) {
+      result.error = std::current_exception();
+      result.failedRecipients = settings->GetUsers();
+    }
+    return result;
+  });
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PROTECTION_ENGINE_UTILS_H_
@@ -0,0 +1,563 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines helpers for rights checks, and for bulk encryption and decryption, through a ProtectionHandler
+ * 
+ * @file protection_handler_utils.h
+ */
+
+#ifndef API_MIP_PROTECTION_PROTECTION_HANDLER_UTILS_H_
+#define API_MIP_PROTECTION_PROTECTION_HANDLER_UTILS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/numa_task_dispatcher.h"
+#include "mip/numa_topology.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/rights.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings controlling how a large buffer is split across cores by EncryptBufferParallel/DecryptBufferParallel
+ */
+class CryptoParallelismSettings {
+public:
+  /**
+   * @brief CryptoParallelismSettings constructor
+   * 
+   * @param maxParallelism Maximum number of segments processed concurrently, including the calling thread
+   * @param minSegmentSize Smallest segment (in bytes) worth handing to another thread
+   */
+  explicit CryptoParallelismSettings(size_t maxParallelism, int64_t minSegmentSize = 256 * 1024)
+      : mMaxParallelism((std::max)(maxParallelism, static_cast<size_t>(1))),
+        mMinSegmentSize((std::max)(minSegmentSize, static_cast<int64_t>(1))) {}
+
+  /**
+   * @brief Get the maximum number of segments processed concurrently
+   * 
+   * @return Maximum parallelism
+   */
+  size_t GetMaxParallelism() const { return mMaxParallelism; }
+
+  /**
+   * @brief Get the smallest segment (in bytes) worth handing to another thread
+   * 
+   * @return Minimum segment size
+   */
+  int64_t GetMinSegmentSize() const { return mMinSegmentSize; }
+
+  /**
+   * @brief Set the task dispatcher used to run segments off the calling thread
+   * 
+   * @param taskDispatcher Task dispatcher. If not set, segments run on new std::thread threads.
+   */
+  void SetTaskDispatcherDelegate(const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher) {
+    mTaskDispatcher = taskDispatcher;
+  }
+
+  /**
+   * @brief Get the task dispatcher used to run segments off the calling thread
+   * 
+   * @return Task dispatcher, or nullptr if new threads are used
+   */
+  std::shared_ptr<TaskDispatcherDelegate> GetTaskDispatcherDelegate() const { return mTaskDispatcher; }
+
+  /**
+   * @brief Set the NUMA node segments should run on, when the task dispatcher is a NumaTaskDispatcher
+   * 
+   * @param affinity Preferred node. If not set, each segment runs on the node owning its output buffer.
+   */
+  void SetAffinityHint(const AffinityHint& affinity) { mAffinity = affinity; }
+
+  /**
+   * @brief Get the NUMA node segments should run on
+   * 
+   * @return Preferred node, unset to follow the output buffers
+   */
+  const AffinityHint& GetAffinityHint() const { return mAffinity; }
+
+private:
+  size_t mMaxParallelism;
+  int64_t mMinSegmentSize;
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  AffinityHint mAffinity;
+};
+
+/**
+ * @brief Describes one independent buffer processed by EncryptBuffers/DecryptBuffers
+ */
+struct CryptoBufferDescriptor {
+  int64_t offsetFromStart;  /**< Relative position of inputBuffer from the very beginning of its content */
+  const uint8_t* inputBuffer; /**< Buffer of content that will be encrypted or decrypted */
+  int64_t inputBufferSize;  /**< Size (in bytes) of input buffer */
+  uint8_t* outputBuffer;    /**< Buffer into which processed content will be copied */
+  int64_t outputBufferSize; /**< Size (in bytes) of output buffer */
+  bool isFinal;             /**< If input buffer contains the final bytes of its content or not */
+  int64_t processedSize;    /**< [Output] Actual size (in bytes) of processed content */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace parallelcrypto {
+
+// Size (in bytes) of the unit within which a cipher mode chains blocks; units can be processed independently
+inline int64_t GetIndependentUnitSize(CipherMode cipherMode) {
+  switch (cipherMode) {
+    case CipherMode::CIPHER_MODE_CBC4K:
+    case CipherMode::CIPHER_MODE_CBC4KNOPADDING:
+      return 4096;
+    case CipherMode::CIPHER_MODE_CBC512NOPADDING:
+      return 512;
+    case CipherMode::CIPHER_MODE_ECB:
+      return 16;
+  }
+  return 0;
+}
+
+inline std::string CreateCryptoTaskId() {
+  static std::atomic<uint64_t> sTaskCounter(0);
+  return "mip-parallel-crypto-" + std::to_string(++sTaskCounter);
+}
+
+// Node for a work item on a NumaTaskDispatcher: the configured one, else the node owning its output buffer
+inline AffinityHint GetAffinityHint(const CryptoParallelismSettings& settings, const void* outputBuffer) {
+  if (settings.GetAffinityHint().IsSet() ||
+      !std::dynamic_pointer_cast<NumaTaskDispatcher>(settings.GetTaskDispatcherDelegate())) {
+    return settings.GetAffinityHint();
+  }
+  return AffinityHint::ForAddress(outputBuffer);
+}
+
+// Work items not yet run, claimed by whichever thread reaches them first
+struct ClaimedWork {
+  explicit ClaimedWork(size_t count) : claimed(count), results(count, 0), errors(count), remaining(count) {}
+  std::vector<std::atomic<bool>> claimed;
+  std::vector<int64_t> results;
+  std::vector<std::exception_ptr> errors;
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t remaining;
+};
+
+// Offers every work item but the last one to the dispatcher, runs the last one inline, then runs inline every item no
+// worker has claimed yet and waits for the claimed ones, since work items reference the caller's buffers. Waiting
+// therefore never needs a free worker, even when called from a dispatcher task. Returns the sum of their results;
+// the first failure is rethrown. On a NumaTaskDispatcher, work item i runs on the node of affinity[i] when given.
+inline int64_t RunConcurrently(
+    const std::shared_ptr<TaskDispatcherDelegate>& dispatcher,
+    const std::vector<std::function<int64_t()>>& work,
+    const std::vector<AffinityHint>& affinity = std::vector<AffinityHint>()) {
+  if (work.empty()) {
+    return 0;
+  }
+  auto numaDispatcher = affinity.empty() ? nullptr : std::dynamic_pointer_cast<NumaTaskDispatcher>(dispatcher);
+  auto state = std::make_shared<ClaimedWork>(work.size());
+  // A worker reaching an item the caller already ran touches only the shared state, never work
+  auto runItem = [state, &work](size_t i) {
+    if (state->claimed[i].exchange(true)) {
+      return;
+    }
+    try {
+      state->results[i] = work[i]();
+    } catch (...) {
+      state->errors[i] = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->remaining == 0) {
+      state->finished.notify_all();
+    }
+  };
+  for (size_t i = 0; i + 1 < work.size(); ++i) {
+    try {
+      if (numaDispatcher && i < affinity.size()) {
+        numaDispatcher->DispatchTask(CreateCryptoTaskId(), [runItem, i]() { runItem(i); }, affinity[i]);
+      } else if (dispatcher) {
+        dispatcher->DispatchTask(CreateCryptoTaskId(), [runItem, i]() { runItem(i); });
+      } else {
+        std::thread([runItem, i]() { runItem(i); }).detach();
+      }
+    } catch (...) {
+      // Left unclaimed for the calling thread
+    }
+  }
+  for (size_t i = work.size(); i-- > 0;) {
+    runItem(i);
+  }
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]() { return state->remaining == 0; });
+  }
+  int64_t total = 0;
+  for (size_t i = 0; i < work.size(); ++i) {
+    if (state->errors[i]) {
+      std::rethrow_exception(state->errors[i]);
+    }
+    total += state->results[i];
+  }
+  return total;
+}
+
+inline int64_t ProcessBufferParallel(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    bool isEncrypt,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    bool isFinal,
+    const CryptoParallelismSettings& settings) {
+  if (!handler) {
+    throw BadInputError("A ProtectionHandler is required");
+  }
+  auto process = [&handler, isEncrypt](
+      int64_t offset, const uint8_t* input, int64_t inputSize, uint8_t* output, int64_t outputSize, bool final) {
+    return isEncrypt ?
+        handler->EncryptBuffer(offset, input, inputSize, output, outputSize, final) :
+        handler->DecryptBuffer(offset, input, inputSize, output, outputSize, final);
+  };
+
+  int64_t unitSize = GetIndependentUnitSize(handler->GetCipherMode());
+  size_t segmentCount = 1;
+  if (unitSize > 0 && offsetFromStart % unitSize == 0) {
+    int64_t units = inputBufferSize / unitSize;
+    int64_t maxSegmentsBySize = inputBufferSize / settings.GetMinSegmentSize();
+    segmentCount = static_cast<size_t>((std::max)(static_cast<int64_t>(1), (std::min)(
+        {static_cast<int64_t>(settings.GetMaxParallelism()), units, maxSegmentsBySize})));
+  }
+  if (segmentCount == 1) {
+    return process(offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal);
+  }
+
+  // Every segment except the last one is a whole number of units, so its output is exactly as large as its input.
+  // The last segment gets the rest of the input and output and carries isFinal.
+  int64_t segmentSize = (inputBufferSize / unitSize / static_cast<int64_t>(segmentCount)) * unitSize;
+  std::vector<std::function<int64_t()>> work;
+  std::vector<AffinityHint> affinity;
+  work.reserve(segmentCount);
+  affinity.reserve(segmentCount);
+  for (size_t i = 0; i < segmentCount; ++i) {
+    int64_t start = static_cast<int64_t>(i) * segmentSize;
+    bool isLast = i + 1 == segmentCount;
+    int64_t inputSize = isLast ? inputBufferSize - start : segmentSize;
+    int64_t outputSize = isLast ? outputBufferSize - start : segmentSize;
+    work.push_back([=]() {
+      return process(
+          offsetFromStart + start, inputBuffer + start, inputSize, outputBuffer + start, outputSize, isLast && isFinal);
+    });
+    affinity.push_back(GetAffinityHint(settings, outputBuffer + start));
+  }
+  return RunConcurrently(settings.GetTaskDispatcherDelegate(), work, affinity);
+}
+
+inline void ProcessBuffers(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    bool isEncrypt,
+    CryptoBufferDescriptor* descriptors,
+    size_t descriptorCount,
+    const CryptoParallelismSettings* settings) {
+  if (!handler) {
+    throw BadInputError("A ProtectionHandler is required");
+  }
+  if (descriptors == nullptr && descriptorCount > 0) {
+    throw BadInputError("Buffer descriptors are required");
+  }
+  // Validate the whole batch up front so that a bad descriptor fails before any work is done
+  for (size_t i = 0; i < descriptorCount; ++i) {
+    const CryptoBufferDescriptor& descriptor = descriptors[i];
+    if (descriptor.inputBufferSize < 0 || (descriptor.inputBufferSize > 0 && descriptor.inputBuffer == nullptr) ||
+        descriptor.outputBuffer == nullptr) {
+      throw BadInputError("Invalid buffer descriptor at index " + std::to_string(i));
+    }
+    if (isEncrypt && descriptor.outputBufferSize <
+        handler->GetProtectedContentLength(descriptor.inputBufferSize, descriptor.isFinal)) {
+      throw InsufficientBufferError("Output buffer too small at index " + std::to_string(i));
+    }
+  }
+  auto processRange = [&handler, isEncrypt, descriptors](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      CryptoBufferDescriptor& d = descriptors[i];
+      d.processedSize = isEncrypt ?
+          handler->EncryptBuffer(
+              d.offsetFromStart, d.inputBuffer, d.inputBufferSize, d.outputBuffer, d.outputBufferSize, d.isFinal) :
+          handler->DecryptBuffer(
+              d.offsetFromStart, d.inputBuffer, d.inputBufferSize, d.outputBuffer, d.outputBufferSize, d.isFinal);
+    }
+  };
+  size_t workerCount = settings ? (std::min)(settings->GetMaxParallelism(), descriptorCount) : 1;
+  if (workerCount <= 1) {
+    processRange(0, descriptorCount);
+    return;
+  }
+  size_t chunkSize = (descriptorCount + workerCount - 1) / workerCount;
+  std::vector<std::function<int64_t()>> work;
+  std::vector<AffinityHint> affinity;
+  for (size_t begin = 0; begin < descriptorCount; begin += chunkSize) {
+    size_t end = (std::min)(begin + chunkSize, descriptorCount);
+    work.push_back([=]() {
+      processRange(begin, end);
+      return static_cast<int64_t>(0);
+    });
+    affinity.push_back(GetAffinityHint(*settings, descriptors[begin].outputBuffer));
+  }
+  RunConcurrently(settings->GetTaskDispatcherDelegate(), work, affinity);
+}
+
+inline int64_t ProcessBufferInPlace(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    bool isEncrypt,
+    int64_t offsetFromStart,
+    uint8_t* buffer,
+    int64_t contentSize,
+    int64_t bufferCapacity,
+    bool isFinal) {
+  if (!handler) {
+    throw BadInputError("A ProtectionHandler is required");
+  }
+  if (contentSize < 0 || bufferCapacity < contentSize || (buffer == nullptr && bufferCapacity > 0)) {
+    throw BadInputError("Invalid in-place buffer");
+  }
+  if (isEncrypt && bufferCapacity < handler->GetProtectedContentLength(contentSize, isFinal)) {
+    throw InsufficientBufferError("Buffer capacity too small for in-place encryption");
+  }
+  // Whole units keep their size through encryption and decryption, so they can be staged one chunk at a time and
+  // copied back over themselves. Only the last chunk can change size (padding is added or removed).
+  int64_t unitSize = GetIndependentUnitSize(handler->GetCipherMode());
+  int64_t chunkSize = contentSize;
+  if (unitSize > 0 && offsetFromStart % unitSize == 0) {
+    chunkSize = (std::min)(contentSize, unitSize * 16);
+  }
+  int64_t lastChunkStart = contentSize > chunkSize ? ((contentSize - 1) / chunkSize) * chunkSize : 0;
+  int64_t lastChunkSize = contentSize - lastChunkStart;
+  int64_t lastOutputSize = isEncrypt ? handler->GetProtectedContentLength(lastChunkSize, isFinal) : lastChunkSize;
+  std::vector<uint8_t> scratch(static_cast<size_t>((std::max)({chunkSize, lastOutputSize, static_cast<int64_t>(1)})));
+  for (int64_t start = 0; start < lastChunkStart; start += chunkSize) {
+    int64_t processed = isEncrypt ?
+        handler->EncryptBuffer(
+            offsetFromStart + start, buffer + start, chunkSize, scratch.data(), chunkSize, false) :
+        handler->DecryptBuffer(
+            offsetFromStart + start, buffer + start, chunkSize, scratch.data(), chunkSize, false);
+    std::memcpy(buffer + start, scratch.data(), static_cast<size_t>(processed));
+  }
+  int64_t processed = isEncrypt ?
+      handler->EncryptBuffer(
+          offsetFromStart + lastChunkStart, buffer + lastChunkStart, lastChunkSize,
+          scratch.data(), static_cast<int64_t>(scratch.size()), isFinal) :
+      handler->DecryptBuffer(
+          offsetFromStart + lastChunkStart, buffer + lastChunkStart, lastChunkSize,
+          scratch.data(), static_cast<int64_t>(scratch.size()), isFinal);
+  if (lastChunkStart + processed > bufferCapacity) {
+    throw InsufficientBufferError("Buffer capacity too small for in-place operation");
+  }
+  std::memcpy(buffer + lastChunkStart, scratch.data(), static_cast<size_t>(processed));
+  return lastChunkStart + processed;
+}
+
+} // namespace parallelcrypto
+/** @endcond */
+
+/**
+ * @brief Encrypt a large buffer by splitting it into independent cipher units processed concurrently
+ *
+ * @param handler Protection handler
+ * @param offsetFromStart Relative position of inputBuffer from the very beginning of the cleartext content
+ * @param inputBuffer Buffer of cleartext content that will be encrypted
+ * @param inputBufferSize Size (in bytes) of input buffer
+ * @param outputBuffer Buffer into which encrypted content will be copied
+ * @param outputBufferSize Size (in bytes) of output buffer
+ * @param isFinal If input buffer contains the final cleartext bytes or not
+ * @param settings Parallelism settings
+ * 
+ * @return actual size (in bytes) of encrypted content
+ * 
+ * @note Cipher modes chain blocks only within a fixed unit (4096 bytes for CBC4K), so segments aligned to that unit
+ *       can be processed by separate ProtectionHandler::EncryptBuffer calls on separate threads. Buffers that are
+ *       small, or whose offset is not aligned to the unit, are processed with a single call on the calling thread.
+ */
+inline int64_t EncryptBufferParallel(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    bool isFinal,
+    const CryptoParallelismSettings& settings) {
+  return parallelcrypto::ProcessBufferParallel(
+      handler, true, offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal, settings);
+}
+
+/**
+ * @brief Decrypt a large buffer by splitting it into independent cipher units processed concurrently
+ *
+ * @param handler Protection handler
+ * @param offsetFromStart Relative position of inputBuffer from the very beginning of the encrypted content
+ * @param inputBuffer Buffer of encrypted content that will be decrypted
+ * @param inputBufferSize Size (in bytes) of input buffer
+ * @param outputBuffer Buffer into which decrypted content will be copied
+ * @param outputBufferSize Size (in bytes) of output buffer
+ * @param isFinal If input buffer contains the final encrypted bytes or not
+ * @param settings Parallelism settings
+ * 
+ * @return actual size (in bytes) of decrypted content
+ * 
+ * @note See EncryptBufferParallel for how the buffer is split.
+ */
+inline int64_t DecryptBufferParallel(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    bool isFinal,
+    const CryptoParallelismSettings& settings) {
+  return parallelcrypto::ProcessBufferParallel(
+      handler, false, offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal, settings);
+}
+
+/**
+ * @brief Encrypt many independent buffers in one call
+ *
+ * @param handler Protection handler
+ * @param descriptors Array of buffers to encrypt; processedSize is filled in for each one
+ * @param descriptorCount Number of descriptors
+ * @param settings Optional parallelism settings. If set, the batch is split across up to
+ *        CryptoParallelismSettings::GetMaxParallelism threads.
+ * 
+ * @note Every descriptor is validated, including output buffer size against
+ *       ProtectionHandler::GetProtectedContentLength, before any buffer is encrypted.
+ */
+inline void EncryptBuffers(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    CryptoBufferDescriptor* descriptors,
+    size_t descriptorCount,
+    const CryptoParallelismSettings* settings = nullptr) {
+  parallelcrypto::ProcessBuffers(handler, true, descriptors, descriptorCount, settings);
+}
+
+/**
+ * @brief Decrypt many independent buffers in one call
+ *
+ * @param handler Protection handler
+ * @param descriptors Array of buffers to decrypt; processedSize is filled in for each one
+ * @param descriptorCount Number of descriptors
+ * @param settings Optional parallelism settings. If set, the batch is split across up to
+ *        CryptoParallelismSettings::GetMaxParallelism threads.
+ */
+inline void DecryptBuffers(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    CryptoBufferDescriptor* descriptors,
+    size_t descriptorCount,
+    const CryptoParallelismSettings* settings = nullptr) {
+  parallelcrypto::ProcessBuffers(handler, false, descriptors, descriptorCount, settings);
+}
+
+/**
+ * @brief Encrypt a buffer in place
+ *
+ * @param handler Protection handler
+ * @param offsetFromStart Relative position of buffer from the very beginning of the cleartext content
+ * @param buffer Buffer holding cleartext content on input and encrypted content on output
+ * @param contentSize Size (in bytes) of cleartext content in the buffer
+ * @param bufferCapacity Total size (in bytes) of the buffer
+ * @param isFinal If the buffer contains the final cleartext bytes or not
+ * 
+ * @return actual size (in bytes) of encrypted content
+ * 
+ * @note ProtectionHandler::EncryptBuffer does not support overlapping input and output buffers. This helper stages
+ *       the content through a scratch buffer of at most 16 cipher units (64 KB for CBC4K) instead of a second copy
+ *       of the whole payload. When isFinal is true, padding may make the output larger than the input, so
+ *       bufferCapacity must be at least ProtectionHandler::GetProtectedContentLength(contentSize, isFinal). If
+ *       offsetFromStart is not aligned to the cipher unit, the whole content is staged at once.
+ */
+inline int64_t EncryptBufferInPlace(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    int64_t offsetFromStart,
+    uint8_t* buffer,
+    int64_t contentSize,
+    int64_t bufferCapacity,
+    bool isFinal) {
+  return parallelcrypto::ProcessBufferInPlace(
+      handler, true, offsetFromStart, buffer, contentSize, bufferCapacity, isFinal);
+}
+
+/**
+ * @brief Decrypt a buffer in place
+ *
+ * @param handler Protection handler
+ * @param offsetFromStart Relative position of buffer from the very beginning of the encrypted content
+ * @param buffer Buffer holding encrypted content on input and decrypted content on output
+ * @param contentSize Size (in bytes) of encrypted content in the buffer
+ * @param isFinal If the buffer contains the final encrypted bytes or not
+ * 
+ * @return actual size (in bytes) of decrypted content
+ * 
+ * @note Decrypted content is never larger than encrypted content; when isFinal is true, padding is removed and the
+ *       returned size may be smaller than contentSize. See EncryptBufferInPlace for how the content is staged.
+ */
+inline int64_t DecryptBufferInPlace(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    int64_t offsetFromStart,
+    uint8_t* buffer,
+    int64_t contentSize,
+    bool isFinal) {
+  return parallelcrypto::ProcessBufferInPlace(
+      handler, false, offsetFromStart, buffer, contentSize, contentSize, isFinal);
+}
+
+/**
+ * @brief Get the well-known rights a protection handler grants, as a bitset
+ *
+ * @param handler Protection handler
+ *
+ * @return Granted rights
+ *
+ * @note Compute the mask once, right after the handler is created, and keep it with the handler: checking rights
+ *       then costs one AND with RightsMask::HasRights instead of a virtual AccessCheck call and string comparisons
+ *       per right. Custom rights are not represented; use AccessCheck for them.
+ */
+inline RightsMask GetRightsMask(const ProtectionHandler& handler) {
+  return rights::GetRightsMask(handler.GetRights());
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PROTECTION_HANDLER_UTILS_H_
@@ -0,0 +1,173 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a cache of parsed publishing licenses
+ * 
+ * @file publishing_license_info_cache.h
+ */
+
+#ifndef API_MIP_PROTECTION_PUBLISHING_LICENSE_INFO_CACHE_H_
+#define API_MIP_PROTECTION_PUBLISHING_LICENSE_INFO_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_common_types.h"
+#include "mip/protection/protection_profile.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Caches the result of ProtectionProfile::GetPublishingLicenseInfo, keyed by the publishing license bytes.
+ * 
+ * @note A hit hashes the license in place, without copying it, and returns the PublishingLicenseInfo that was parsed
+ *       the first time. Callers that only need the content ID, owner, issuer or domains can therefore look them up
+ *       per request for the cost of a hash. The returned objects are shared and must not be modified.
+ */
+class PublishingLicenseInfoCache {
+public:
+  /**
+   * @brief PublishingLicenseInfoCache constructor
+   * 
+   * @param mipContext MIP context passed to ProtectionProfile::GetPublishingLicenseInfo on a miss
+   * @param maxEntries Maximum number of parsed licenses kept, least recently used licenses are evicted first
+   */
+  PublishingLicenseInfoCache(const std::shared_ptr<MipContext>& mipContext, size_t maxEntries = 4096)
+      : mMipContext(mipContext),
+        mMaxEntries(maxEntries > 0 ? maxEntries : 1) {
+    if (!mMipContext) {
+      throw BadInputError("PublishingLicenseInfoCache requires a MipContext");
+    }
+  }
+
+  /**
+   * @brief Get the parsed details of a publishing license
+   * 
+   * @param serializedPublishingLicense Pointer to the serialized publishing license
+   * @param serializedPublishingLicenseSize Size (in bytes) of the serialized publishing license
+   * 
+   * @return Parsed publishing license details
+   */
+  std::shared_ptr<PublishingLicenseInfo> Get(
+      const uint8_t* serializedPublishingLicense,
+      size_t serializedPublishingLicenseSize) {
+    if (serializedPublishingLicense == nullptr && serializedPublishingLicenseSize > 0) {
+      throw BadInputError("Publishing license buffer is null");
+    }
+    uint64_t hash = Hash(serializedPublishingLicense, serializedPublishingLicenseSize);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto cached = mIndex.find(hash);
+      if (cached != mIndex.end() &&
+          Equals(cached->second->info, serializedPublishingLicense, serializedPublishingLicenseSize)) {
+        mEntries.splice(mEntries.begin(), mEntries, cached->second);
+        return cached->second->info;
+      }
+    }
+    // Parse outside of the lock, it may be slow for large licenses
+    auto info = ProtectionProfile::GetPublishingLicenseInfo(
+        std::vector<uint8_t>(serializedPublishingLicense, serializedPublishingLicense + serializedPublishingLicenseSize),
+        mMipContext);
+    if (!info) {
+      return info;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto existing = mIndex.find(hash);
+    if (existing != mIndex.end()) {
+      mEntries.erase(existing->second);
+      mIndex.erase(existing);
+    }
+    mEntries.push_front(Entry{hash, info});
+    mIndex[hash] = mEntries.begin();
+    while (mEntries.size() > mMaxEntries) {
+      mIndex.erase(mEntries.back().hash);
+      mEntries.pop_back();
+    }
+    return info;
+  }
+
+  /**
+   * @brief Get the parsed details of a publishing license
+   * 
+   * @param serializedPublishingLicense Serialized publishing license
+   * 
+   * @return Parsed publishing license details
+   */
+  std::shared_ptr<PublishingLicenseInfo> Get(const std::vector<uint8_t>& serializedPublishingLicense) {
+    return Get(serializedPublishingLicense.data(), serializedPublishingLicense.size());
+  }
+
+  /**
+   * @brief Remove all cached licenses
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mIndex.clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    uint64_t hash;
+    std::shared_ptr<PublishingLicenseInfo> info;
+  };
+
+  // 64-bit FNV-1a. Entries are compared byte for byte on lookup, so collisions only cost a re-parse.
+  static uint64_t Hash(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  static bool Equals(const std::shared_ptr<PublishingLicenseInfo>& info, const uint8_t* data, size_t size) {
+    const std::vector<uint8_t>& license = info->GetSerializedPublishingLicense();
+    return license.size() == size && (size == 0 || std::memcmp(license.data(), data, size) == 0);
+  }
+
+  std::shared_ptr<MipContext> mMipContext;
+  size_t mMaxEntries;
+  std::mutex mMutex;
+  std::list<Entry> mEntries;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> mIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PUBLISHING_LICENSE_INFO_CACHE_H_
@@ -0,0 +1,144 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines PublishingTemplate, for protecting many files with the same descriptor
+ * 
+ * @file publishing_template.h
+ */
+
+#ifndef API_MIP_PROTECTION_PUBLISHING_TEMPLATE_H_
+#define API_MIP_PROTECTION_PUBLISHING_TEMPLATE_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_engine_utils.h"
+#include "mip/protection/protection_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Stamps out publishing ProtectionHandlers that share one set of PublishingSettings.
+ * 
+ * @note Every handler gets its own content key, and therefore its own publishing license. The template makes the
+ *       shared work happen once: the ProtectionDescriptor is built and validated once, and the user's licensor
+ *       certificate is loaded once by Prepare rather than lazily by the first file of the batch.
+ */
+class PublishingTemplate {
+public:
+  /**
+   * @brief PublishingTemplate constructor
+   * 
+   * @param engine Protection engine used to create handlers
+   * @param settings Publishing settings shared by every handler
+   */
+  PublishingTemplate(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      const ProtectionHandler::PublishingSettings& settings)
+      : mEngine(engine),
+        mSettings(settings),
+        mIsPrepared(false) {
+    if (!mEngine) {
+      throw BadInputError("PublishingTemplate requires a ProtectionEngine");
+    }
+    if (!mSettings.GetProtectionDescriptor()) {
+      throw BadInputError("PublishingTemplate requires a ProtectionDescriptor");
+    }
+  }
+
+  /**
+   * @brief Load the user's licensor certificate so that the first handler does not pay for it
+   * 
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return true if the certificate is loaded, else false
+   * 
+   * @note Calling Prepare more than once only loads the certificate once.
+   */
+  bool Prepare(const std::shared_ptr<void>& context = nullptr) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIsPrepared) {
+      mIsPrepared = mEngine->LoadUserCert(context, mSettings);
+    }
+    return mIsPrepared;
+  }
+
+  /**
+   * @brief Create a handler for one new piece of content
+   * 
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return ProtectionHandler with a fresh content key
+   */
+  std::shared_ptr<ProtectionHandler> CreateHandler(const std::shared_ptr<void>& context = nullptr) const {
+    return mEngine->CreateProtectionHandlerForPublishing(mSettings, context);
+  }
+
+  /**
+   * @brief Create handlers for many new pieces of content
+   * 
+   * @param count Number of handlers to create
+   * @param maxInFlight Maximum number of concurrent ProtectionEngine::CreateProtectionHandlerForPublishingAsync
+   *        operations
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate
+   * 
+   * @return @p count results, each with its own content key
+   */
+  std::vector<ProtectionHandlerBatchResult> CreateHandlers(
+      size_t count,
+      size_t maxInFlight = 16,
+      const std::shared_ptr<void>& context = nullptr) const {
+    return enginebatch::RunHandlerBatch(
+        enginebatch::GetSequentialOrder(count),
+        maxInFlight,
+        [this, &context](size_t /*index*/, const std::shared_ptr<enginebatch::HandlerItemObserver>& observer) {
+          mEngine->CreateProtectionHandlerForPublishingAsync(mSettings, observer, context);
+        });
+  }
+
+  /**
+   * @brief Get the publishing settings shared by every handler
+   * 
+   * @return Publishing settings
+   */
+  const ProtectionHandler::PublishingSettings& GetSettings() const { return mSettings; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<ProtectionEngine> mEngine;
+  ProtectionHandler::PublishingSettings mSettings;
+  std::mutex mMutex;
+  bool mIsPrepared;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_PUBLISHING_TEMPLATE_H_
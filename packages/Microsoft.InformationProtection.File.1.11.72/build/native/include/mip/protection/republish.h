@@ -0,0 +1,198 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines RepublishProtection and RewrapProtection, which protect edited or reprotected content around its
+ *        existing content key
+ * 
+ * @file republish.h
+ */
+
+#ifndef API_MIP_PROTECTION_REPUBLISH_H_
+#define API_MIP_PROTECTION_REPUBLISH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/protection_handler_utils.h"
+#include "mip/protection/rights.h"
+#include "mip/service_call_monitor.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Options of RepublishProtection
+ */
+struct RepublishOptions {
+  /** Whether the SDK may reach the service; if false, republishing fails rather than making a request */
+  bool isServiceCallAllowed = true;
+  /** Delegated user to republish on behalf of, or empty */
+  std::string delegatedUserEmail;
+};
+
+/**
+ * @brief Outcome of RepublishProtection
+ */
+struct RepublishResult {
+  std::shared_ptr<ProtectionHandler> handler; /**< Publishing handler protecting the edited content */
+  bool isServiceContacted = false;            /**< Whether republishing made any request to the service */
+  size_t serviceRequestCount = 0;             /**< Number of requests made */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace republishing {
+
+inline RepublishResult Publish(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& consumptionHandler,
+    const std::shared_ptr<ProtectionDescriptor>& descriptor,
+    ServiceCallMonitor& monitor,
+    const RepublishOptions& options,
+    const std::shared_ptr<void>& context) {
+  ProtectionHandler::PublishingSettings settings(descriptor);
+  settings.SetPublishingLicenseForRepublish(consumptionHandler->GetSerializedPublishingLicense());
+  if (!options.delegatedUserEmail.empty()) {
+    settings.SetDelegatedUserEmail(options.delegatedUserEmail);
+  }
+  auto scope = monitor.BeginScope(context, options.isServiceCallAllowed);
+  RepublishResult result;
+  result.handler = engine->CreateProtectionHandlerForPublishing(settings, scope->GetContext());
+  result.serviceRequestCount = scope->GetRequestCount();
+  result.isServiceContacted = result.serviceRequestCount > 0;
+  return result;
+}
+
+// Encrypts the same block with both handlers: with the same key and cipher mode, the output is the same
+inline bool HasSameContentKey(ProtectionHandler& original, ProtectionHandler& rewrapped) {
+  int64_t blockSize = original.GetBlockSize();
+  if (blockSize <= 0 || blockSize != rewrapped.GetBlockSize()) {
+    return false;
+  }
+  std::vector<uint8_t> plain(static_cast<size_t>(blockSize), 0);
+  std::vector<uint8_t> first(plain.size());
+  std::vector<uint8_t> second(plain.size());
+  int64_t firstSize = original.EncryptBuffer(0, plain.data(), blockSize, first.data(), blockSize, false);
+  int64_t secondSize = rewrapped.EncryptBuffer(0, plain.data(), blockSize, second.data(), blockSize, false);
+  return firstSize == secondSize && first == second;
+}
+
+} // namespace republishing
+/** @endcond */
+
+/**
+ * @brief Republish content that was opened for consumption, after it was edited
+ * 
+ * @param engine Protection engine whose profile uses monitor as its HttpDelegate
+ * @param consumptionHandler Handler the content was consumed with; it holds the owner's use license
+ * @param monitor ServiceCallMonitor wrapping the profile's HttpDelegate
+ * @param options Whether the service may be contacted, and delegation
+ * @param context Client context forwarded to the application's delegates
+ * 
+ * @return Publishing handler and whether the service was contacted
+ * 
+ * @note The original publishing license is passed to PublishingSettings::SetPublishingLicenseForRepublish, so the
+ *       SDK keeps the protection and content key of the original instead of issuing new ones. Whether it still
+ *       contacts the service is decided inside the SDK; the result reports it, and with isServiceCallAllowed false
+ *       any request fails the call with a NetworkError of category Offline, so callers can retry online when they
+ *       must. Republishing requires the EDIT right (OWNER includes it); without it, an AccessDeniedError is thrown
+ *       before the SDK is called.
+ */
+inline RepublishResult RepublishProtection(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& consumptionHandler,
+    ServiceCallMonitor& monitor,
+    const RepublishOptions& options = RepublishOptions(),
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine || !consumptionHandler) {
+    throw BadInputError("RepublishProtection requires an engine and a consumption handler");
+  }
+  if (!GetRightsMask(*consumptionHandler).Has(RightId::Edit)) {
+    throw AccessDeniedError("Republishing requires the EDIT or OWNER right");
+  }
+  return republishing::Publish(engine, consumptionHandler, consumptionHandler->GetProtectionDescriptor(), monitor,
+      options, context);
+}
+
+/**
+ * @brief Outcome of RewrapProtection
+ */
+struct RewrapResult : public RepublishResult {
+  std::vector<uint8_t> serializedPublishingLicense; /**< New publishing license, to store in place of the old one */
+};
+
+/**
+ * @brief Change the protection of content without re-encrypting it, by issuing a new publishing license around its
+ *        existing content key
+ * 
+ * @param engine Protection engine whose profile uses monitor as its HttpDelegate
+ * @param consumptionHandler Handler the content was consumed with
+ * @param descriptor New protection, for example from ProtectionDescriptorBuilder::CreateFromTemplate
+ * @param monitor ServiceCallMonitor wrapping the profile's HttpDelegate
+ * @param options Whether the service may be contacted, and delegation
+ * @param context Client context forwarded to the application's delegates
+ * 
+ * @return Publishing handler for the new protection, its publishing license and whether the service was contacted
+ * 
+ * @note For applications that keep the publishing license apart from the ciphertext, such as records protected with
+ *       a ProtectionHandler: store the new license and copy the ciphertext through unchanged, whatever its size.
+ *       Changing protection requires the EDITRIGHTSDATA right (OWNER includes it). The SDK reuses the content key
+ *       when the original license allows it; this is verified by encrypting one block with both handlers, and a
+ *       mip::NotSupportedError is thrown if the key changed, in which case the content must be re-encrypted.
+ *       File formats written by FileHandler keep the license inside a container the SDK owns, so they still go
+ *       through FileHandler::SetProtection and CommitAsync.
+ */
+inline RewrapResult RewrapProtection(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const std::shared_ptr<ProtectionHandler>& consumptionHandler,
+    const std::shared_ptr<ProtectionDescriptor>& descriptor,
+    ServiceCallMonitor& monitor,
+    const RepublishOptions& options = RepublishOptions(),
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine || !consumptionHandler || !descriptor) {
+    throw BadInputError("RewrapProtection requires an engine, a consumption handler and a descriptor");
+  }
+  if (!GetRightsMask(*consumptionHandler).Has(RightId::EditRightsData)) {
+    throw AccessDeniedError("Changing protection requires the EDITRIGHTSDATA or OWNER right");
+  }
+  RewrapResult result;
+  static_cast<RepublishResult&>(result) =
+      republishing::Publish(engine, consumptionHandler, descriptor, monitor, options, context);
+  if (!result.handler || !republishing::HasSameContentKey(*consumptionHandler, *result.handler)) {
+    throw NotSupportedError("The content key could not be kept; the content must be re-encrypted");
+  }
+  result.serializedPublishingLicense = result.handler->GetSerializedPublishingLicense();
+  return result;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_REPUBLISH_H_
@@ -33,6 +33,9 @@
 #ifndef API_MIP_PROTECTION_RIGHTS_H_
 #define API_MIP_PROTECTION_RIGHTS_H_
 
+#include <cctype>
+#include <cstdint>
+#include <initializer_list>
 #include <string>
 #include <vector>
 
@@ -208,6 +211,148 @@ inline std::vector<std::string> EncryptOnlyRights() {
       DocumentEdit(),
       EditRightsData()};
 }
+} // namespace rights
+
+/**
+ * @brief Interned identifier of a well-known right, usable in a RightsMask
+ */
+enum class RightId : unsigned int {
+  Owner = 0,           /**< OWNER */
+  View = 1,            /**< VIEW */
+  AuditedExtract = 2,  /**< AUDITEDEXTRACT */
+  Edit = 3,            /**< EDIT */
+  Export = 4,          /**< EXPORT */
+  Extract = 5,         /**< EXTRACT */
+  Print = 6,           /**< PRINT */
+  Comment = 7,         /**< COMMENT */
+  Reply = 8,           /**< REPLY */
+  ReplyAll = 9,        /**< REPLYALL */
+  Forward = 10,        /**< FORWARD */
+  ViewRightsData = 11, /**< VIEWRIGHTSDATA */
+  DocumentEdit = 12,   /**< DOCEDIT */
+  ObjectModel = 13,    /**< OBJMODEL */
+  EditRightsData = 14, /**< EDITRIGHTSDATA */
+};
+
+/**
+ * @brief Set of well-known rights as a bitset, so that checking several rights costs one AND
+ */
+class RightsMask {
+public:
+  /**
+   * @brief RightsMask constructor
+   * 
+   * @param rights Rights in the set
+   */
+  RightsMask(std::initializer_list<RightId> rights = {}) : mBits(0) {  // NOLINT: implicit from a list by design
+    for (RightId right : rights) {
+      mBits |= GetBit(right);
+    }
+  }
+
+  /**
+   * @brief Whether the set holds a right
+   * 
+   * @param right Right
+   * 
+   * @return true if the right is in the set
+   */
+  bool Has(RightId right) const { return (mBits & GetBit(right)) != 0; }
+
+  /**
+   * @brief Whether the set holds all of the given rights
+   * 
+   * @param required Rights to check
+   * 
+   * @return true if every right in required is in the set
+   */
+  bool HasRights(const RightsMask& required) const { return (mBits & required.mBits) == required.mBits; }
+
+  /**
+   * @brief Add a right to the set
+   * 
+   * @param right Right
+   */
+  void Add(RightId right) { mBits |= GetBit(right); }
+
+  /**
+   * @brief Get the raw bits, one per RightId
+   * 
+   * @return Bits
+   */
+  uint32_t GetBits() const { return mBits; }
+
+  /** @cond DOXYGEN_HIDE */
+  RightsMask operator|(const RightsMask& other) const { return FromBits(mBits | other.mBits); }
+  RightsMask operator&(const RightsMask& other) const { return FromBits(mBits & other.mBits); }
+  bool operator==(const RightsMask& other) const { return mBits == other.mBits; }
+  bool operator!=(const RightsMask& other) const { return mBits != other.mBits; }
+
+  static RightsMask FromBits(uint32_t bits) {
+    RightsMask mask;
+    mask.mBits = bits;
+    return mask;
+  }
+
+private:
+  static uint32_t GetBit(RightId right) { return static_cast<uint32_t>(1) << static_cast<unsigned int>(right); }
+
+  uint32_t mBits;
+  /** @endcond */
+};
+
+namespace rights {
+
+/**
+ * @brief Gets the interned identifier of a right
+ * 
+ * @param right String identifier of the right, compared case-insensitively
+ * @param rightId [Output] Identifier of the right
+ * 
+ * @return false if the right is not a well-known right
+ */
+inline bool TryGetRightId(const std::string& right, RightId& rightId) {
+  static const char* const kNames[] = {"OWNER", "VIEW", "AUDITEDEXTRACT", "EDIT", "EXPORT", "EXTRACT", "PRINT",
+      "COMMENT", "REPLY", "REPLYALL", "FORWARD", "VIEWRIGHTSDATA", "DOCEDIT", "OBJMODEL", "EDITRIGHTSDATA"};
+  for (unsigned int i = 0; i < sizeof(kNames) / sizeof(kNames[0]); ++i) {
+    const char* name = kNames[i];
+    size_t length = 0;
+    while (name[length] != '\0' && length < right.size() &&
+           std::toupper(static_cast<unsigned char>(right[length])) == name[length]) {
+      ++length;
+    }
+    if (name[length] == '\0' && length == right.size()) {
+      rightId = static_cast<RightId>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Gets the set of well-known rights in a list of rights, e.g. from ProtectionHandler::GetRights
+ * 
+ * @param grantedRights String identifiers of the rights
+ * 
+ * @return Set of the well-known rights; custom rights are left out
+ * 
+ * @note OWNER implies every right, so the set holds every well-known right if OWNER is granted.
+ */
+inline RightsMask GetRightsMask(const std::vector<std::string>& grantedRights) {
+  RightsMask mask;
+  for (const std::string& right : grantedRights) {
+    RightId rightId;
+    if (TryGetRightId(right, rightId)) {
+      mask.Add(rightId);
+    }
+  }
+  if (mask.Has(RightId::Owner)) {
+    const unsigned int kRightCount = static_cast<unsigned int>(RightId::EditRightsData) + 1;
+    mask = RightsMask::FromBits((static_cast<uint32_t>(1) << kRightCount) - 1);
+  }
+  return mask;
+}
+
 } // namespace rights
 MIP_NAMESPACE_END
 
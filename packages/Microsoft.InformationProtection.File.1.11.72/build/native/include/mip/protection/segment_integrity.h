@@ -0,0 +1,512 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines SegmentDigestManifest, per-segment SHA-256 digests of cleartext verified in parallel with, or after,
+ *        decryption
+ * 
+ * @file segment_integrity.h
+ */
+
+#ifndef API_MIP_PROTECTION_SEGMENT_INTEGRITY_H_
+#define API_MIP_PROTECTION_SEGMENT_INTEGRITY_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#define MIP_SEGMENT_INTEGRITY_SHA_NI
+#define MIP_SEGMENT_INTEGRITY_SHA_NI_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIP_SEGMENT_INTEGRITY_SHA_NI
+#define MIP_SEGMENT_INTEGRITY_SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#endif
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/crypto_capabilities.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection/protection_handler_utils.h"
+#include "mip/stream.h"
+#include "mip/stream_utils.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief SHA-256 digests of consecutive fixed-size segments of cleartext
+ * 
+ * @note Created by the publisher with ComputeSegmentDigestManifest and stored next to the protected content, e.g.
+ *       with its PFileSegmentIndex. Consumers check decrypted content against it with DecryptAndVerifyBufferParallel,
+ *       VerifySegments or VerifySegmentsAsync.
+ */
+struct SegmentDigestManifest {
+  int64_t segmentSize = 1024 * 1024;               /**< Size (in bytes) of every segment but the last one */
+  int64_t contentSize = 0;                         /**< Size (in bytes) of the cleartext */
+  std::vector<std::array<uint8_t, 32>> digests;    /**< SHA-256 of each segment */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace segmentintegrity {
+
+constexpr const char kMagic[8] = {'M', 'I', 'P', 'S', 'D', 'M', 'F', '1'};
+
+alignas(16) static const uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t RotateRight(uint32_t value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+inline void CompressPortable(uint32_t state[8], const uint8_t* data, size_t blocks) {
+  for (; blocks > 0; --blocks, data += 64) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = (static_cast<uint32_t>(data[4 * i]) << 24) | (static_cast<uint32_t>(data[4 * i + 1]) << 16) |
+          (static_cast<uint32_t>(data[4 * i + 2]) << 8) | data[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+      uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+      uint32_t t1 = h + (RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+          kRoundConstants[i] + w[i];
+      uint32_t t2 = (RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#ifdef MIP_SEGMENT_INTEGRITY_SHA_NI
+// Four rounds per step with the SHA extensions; the state is kept as ABEF/CDGH as the instructions expect
+MIP_SEGMENT_INTEGRITY_SHA_NI_TARGET
+inline void CompressShaNi(uint32_t state[8], const uint8_t* data, size_t blocks) {
+  const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+  __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+  __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+  for (; blocks > 0; --blocks, data += 64) {
+    __m128i abefSaved = abef;
+    __m128i cdghSaved = cdgh;
+    __m128i schedule[4];
+    for (int i = 0; i < 16; ++i) {
+      __m128i words;
+      if (i < 4) {
+        words = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap);
+      } else {
+        words = _mm_add_epi32(_mm_sha256msg1_epu32(schedule[i & 3], schedule[(i - 3) & 3]),
+            _mm_alignr_epi8(schedule[(i - 1) & 3], schedule[(i - 2) & 3], 4));
+        words = _mm_sha256msg2_epu32(words, schedule[(i - 1) & 3]);
+      }
+      schedule[i & 3] = words;
+      __m128i message = _mm_add_epi32(words,
+          _mm_load_si128(reinterpret_cast<const __m128i*>(&kRoundConstants[4 * i])));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0E));
+    }
+    abef = _mm_add_epi32(abef, abefSaved);
+    cdgh = _mm_add_epi32(cdgh, cdghSaved);
+  }
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+inline void Compress(uint32_t state[8], const uint8_t* data, size_t blocks) {
+#ifdef MIP_SEGMENT_INTEGRITY_SHA_NI
+  static const bool hasShaInstructions = GetHostCryptoCapabilities().hasShaInstructions;
+  if (hasShaInstructions) {
+    CompressShaNi(state, data, blocks);
+    return;
+  }
+#endif
+  CompressPortable(state, data, blocks);
+}
+
+inline std::array<uint8_t, 32> Sha256(const uint8_t* data, size_t size) {
+  uint32_t state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  size_t wholeBlocks = size / 64;
+  Compress(state, data, wholeBlocks);
+  uint8_t tail[128] = {};
+  size_t remaining = size - wholeBlocks * 64;
+  if (remaining > 0) {
+    std::memcpy(tail, data + wholeBlocks * 64, remaining);
+  }
+  tail[remaining] = 0x80;
+  size_t tailSize = remaining + 9 <= 64 ? 64 : 128;
+  uint64_t bits = static_cast<uint64_t>(size) * 8;
+  for (int i = 0; i < 8; ++i) {
+    tail[tailSize - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+  }
+  Compress(state, tail, tailSize / 64);
+  std::array<uint8_t, 32> digest;
+  for (int i = 0; i < 8; ++i) {
+    digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+    digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+    digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+    digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+  }
+  return digest;
+}
+
+inline int64_t GetSegmentCount(const SegmentDigestManifest& manifest) {
+  return manifest.contentSize == 0 ? 0 : (manifest.contentSize + manifest.segmentSize - 1) / manifest.segmentSize;
+}
+
+inline void CheckManifest(const SegmentDigestManifest& manifest) {
+  if (manifest.segmentSize <= 0 || manifest.contentSize < 0 ||
+      static_cast<int64_t>(manifest.digests.size()) != GetSegmentCount(manifest)) {
+    throw BadInputError("Segment digest manifest is invalid");
+  }
+}
+
+inline void VerifySegment(const SegmentDigestManifest& manifest, int64_t segment, const uint8_t* data, int64_t size) {
+  int64_t expectedSize = (std::min)(manifest.segmentSize, manifest.contentSize - segment * manifest.segmentSize);
+  if (size != expectedSize ||
+      Sha256(data, static_cast<size_t>(size)) != manifest.digests[static_cast<size_t>(segment)]) {
+    throw BadInputError("Content failed integrity verification at segment " + std::to_string(segment));
+  }
+}
+
+// Splits [firstSegment, firstSegment + count) into one consecutive run per worker and runs them concurrently
+inline void ForEachSegmentRun(int64_t firstSegment, int64_t count, const CryptoParallelismSettings& settings,
+    const std::function<void(int64_t, int64_t)>& run) {
+  if (count <= 0) {
+    return;
+  }
+  int64_t runs = (std::min)(static_cast<int64_t>(settings.GetMaxParallelism()), count);
+  int64_t perRun = (count + runs - 1) / runs;
+  std::vector<std::function<int64_t()>> work;
+  for (int64_t first = firstSegment; first < firstSegment + count; first += perRun) {
+    int64_t last = (std::min)(first + perRun, firstSegment + count);
+    work.push_back([&run, first, last]() {
+      run(first, last);
+      return static_cast<int64_t>(0);
+    });
+  }
+  parallelcrypto::RunConcurrently(settings.GetTaskDispatcherDelegate(), work);
+}
+
+} // namespace segmentintegrity
+/** @endcond */
+
+/**
+ * @brief Computes the segment digests of cleartext, hashing segments concurrently
+ * 
+ * @param data Cleartext
+ * @param size Size (in bytes) of the cleartext
+ * @param segmentSize Size (in bytes) of each segment, a multiple of the cipher unit (4 KB for CBC4K)
+ * @param settings Parallelism settings
+ * 
+ * @return Manifest of the cleartext
+ * 
+ * @note Each segment is hashed with the SHA extensions where the CPU has them, and with portable code otherwise.
+ */
+inline SegmentDigestManifest ComputeSegmentDigestManifest(
+    const uint8_t* data,
+    int64_t size,
+    int64_t segmentSize = 1024 * 1024,
+    const CryptoParallelismSettings& settings = CryptoParallelismSettings(std::thread::hardware_concurrency())) {
+  if ((data == nullptr && size > 0) || size < 0 || segmentSize <= 0) {
+    throw BadInputError("ComputeSegmentDigestManifest requires cleartext and a positive segment size");
+  }
+  SegmentDigestManifest manifest;
+  manifest.segmentSize = segmentSize;
+  manifest.contentSize = size;
+  manifest.digests.resize(static_cast<size_t>(segmentintegrity::GetSegmentCount(manifest)));
+  segmentintegrity::ForEachSegmentRun(0, static_cast<int64_t>(manifest.digests.size()), settings,
+      [&](int64_t first, int64_t last) {
+        for (int64_t segment = first; segment < last; ++segment) {
+          int64_t start = segment * segmentSize;
+          int64_t length = (std::min)(segmentSize, size - start);
+          manifest.digests[static_cast<size_t>(segment)] =
+              segmentintegrity::Sha256(data + start, static_cast<size_t>(length));
+        }
+      });
+  return manifest;
+}
+
+/**
+ * @brief Serialize a manifest
+ * 
+ * @param manifest Manifest to serialize
+ * 
+ * @return Serialized manifest
+ */
+inline std::vector<uint8_t> SerializeSegmentDigestManifest(const SegmentDigestManifest& manifest) {
+  segmentintegrity::CheckManifest(manifest);
+  std::vector<uint8_t> output(segmentintegrity::kMagic, segmentintegrity::kMagic + sizeof(segmentintegrity::kMagic));
+  output.reserve(output.size() + 16 + manifest.digests.size() * 32);
+  for (uint64_t value : {static_cast<uint64_t>(manifest.segmentSize), static_cast<uint64_t>(manifest.contentSize)}) {
+    for (int i = 0; i < 8; ++i) {
+      output.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+  for (const auto& digest : manifest.digests) {
+    output.insert(output.end(), digest.begin(), digest.end());
+  }
+  return output;
+}
+
+/**
+ * @brief Deserialize a manifest
+ * 
+ * @param serializedManifest Manifest returned by SerializeSegmentDigestManifest
+ * 
+ * @return Manifest
+ * 
+ * @throws BadInputError when @p serializedManifest is not a valid manifest
+ */
+inline SegmentDigestManifest DeserializeSegmentDigestManifest(const std::vector<uint8_t>& serializedManifest) {
+  const size_t headerSize = sizeof(segmentintegrity::kMagic) + 16;
+  if (serializedManifest.size() < headerSize || (serializedManifest.size() - headerSize) % 32 != 0 ||
+      !std::equal(segmentintegrity::kMagic, segmentintegrity::kMagic + sizeof(segmentintegrity::kMagic),
+          serializedManifest.begin())) {
+    throw BadInputError("Serialized segment digest manifest is invalid");
+  }
+  uint64_t values[2] = {0, 0};
+  for (int field = 0; field < 2; ++field) {
+    for (int i = 7; i >= 0; --i) {
+      values[field] = (values[field] << 8) | serializedManifest[sizeof(segmentintegrity::kMagic) + 8 * field + i];
+    }
+  }
+  SegmentDigestManifest manifest;
+  manifest.segmentSize = static_cast<int64_t>(values[0]);
+  manifest.contentSize = static_cast<int64_t>(values[1]);
+  for (size_t offset = headerSize; offset < serializedManifest.size(); offset += 32) {
+    std::array<uint8_t, 32> digest;
+    std::copy(serializedManifest.begin() + offset, serializedManifest.begin() + offset + 32, digest.begin());
+    manifest.digests.push_back(digest);
+  }
+  segmentintegrity::CheckManifest(manifest);
+  return manifest;
+}
+
+/**
+ * @brief Verifies decrypted content against a manifest, hashing segments concurrently
+ * 
+ * @param data Decrypted content
+ * @param size Size (in bytes) of @p data
+ * @param offsetFromStart Position of @p data in the cleartext, a multiple of the manifest's segment size
+ * @param manifest Manifest of the cleartext
+ * @param settings Parallelism settings
+ * 
+ * @throws BadInputError when a segment does not match its digest
+ * 
+ * @note Only segments wholly within @p data are verified; the last segment of the content counts as whole when
+ *       @p data reaches the end of the content.
+ */
+inline void VerifySegments(
+    const uint8_t* data,
+    int64_t size,
+    int64_t offsetFromStart,
+    const SegmentDigestManifest& manifest,
+    const CryptoParallelismSettings& settings = CryptoParallelismSettings(std::thread::hardware_concurrency())) {
+  segmentintegrity::CheckManifest(manifest);
+  if (offsetFromStart < 0 || offsetFromStart % manifest.segmentSize != 0 || size < 0) {
+    throw BadInputError("Verified content must start at a segment boundary");
+  }
+  int64_t end = (std::min)(offsetFromStart + size, manifest.contentSize);
+  int64_t firstSegment = offsetFromStart / manifest.segmentSize;
+  int64_t endSegment = end == manifest.contentSize ? segmentintegrity::GetSegmentCount(manifest) :
+                                                     end / manifest.segmentSize;
+  segmentintegrity::ForEachSegmentRun(firstSegment, endSegment - firstSegment, settings,
+      [&](int64_t first, int64_t last) {
+        for (int64_t segment = first; segment < last; ++segment) {
+          int64_t start = segment * manifest.segmentSize;
+          int64_t length = (std::min)(manifest.segmentSize, manifest.contentSize - start);
+          segmentintegrity::VerifySegment(manifest, segment, data + (start - offsetFromStart), length);
+        }
+      });
+}
+
+/**
+ * @brief Decrypts a buffer and verifies it against a manifest, each worker hashing a segment as soon as it has
+ *        decrypted it
+ * 
+ * @param handler Protection handler of a cipher mode whose units are independent, such as CBC4K
+ * @param offsetFromStart Position of @p inputBuffer in the encrypted content, a multiple of the manifest's segment size
+ * @param inputBuffer Encrypted content
+ * @param inputBufferSize Size (in bytes) of @p inputBuffer
+ * @param outputBuffer Buffer receiving the decrypted content
+ * @param outputBufferSize Size (in bytes) of @p outputBuffer
+ * @param isFinal If @p inputBuffer contains the final encrypted bytes or not
+ * @param manifest Manifest of the cleartext
+ * @param settings Parallelism settings
+ * 
+ * @return Size (in bytes) of the decrypted content
+ * 
+ * @throws BadInputError when a segment does not match its digest
+ * 
+ * @note Decryption and hashing of one segment follow each other on the same core while the segment is still in its
+ *       cache, and segments run concurrently across cores, so verification adds little to the time of
+ *       DecryptBufferParallel. Segments that are not wholly within the buffer are decrypted but not verified.
+ */
+inline int64_t DecryptAndVerifyBufferParallel(
+    const std::shared_ptr<ProtectionHandler>& handler,
+    int64_t offsetFromStart,
+    const uint8_t* inputBuffer,
+    int64_t inputBufferSize,
+    uint8_t* outputBuffer,
+    int64_t outputBufferSize,
+    bool isFinal,
+    const SegmentDigestManifest& manifest,
+    const CryptoParallelismSettings& settings = CryptoParallelismSettings(std::thread::hardware_concurrency())) {
+  if (!handler) {
+    throw BadInputError("A ProtectionHandler is required");
+  }
+  segmentintegrity::CheckManifest(manifest);
+  int64_t unitSize = parallelcrypto::GetIndependentUnitSize(handler->GetCipherMode());
+  if (unitSize <= 0 || manifest.segmentSize % unitSize != 0) {
+    throw NotSupportedError("Segments must be whole cipher units of a cipher mode with independent units");
+  }
+  if (offsetFromStart < 0 || offsetFromStart % manifest.segmentSize != 0) {
+    throw BadInputError("Decrypted content must start at a segment boundary");
+  }
+  if (inputBufferSize <= 0) {
+    return handler->DecryptBuffer(
+        offsetFromStart, inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, isFinal);
+  }
+  // Every segment but the last one decrypts to exactly its own size; the last one takes the rest and isFinal
+  int64_t segmentCount = (inputBufferSize + manifest.segmentSize - 1) / manifest.segmentSize;
+  int64_t firstSegment = offsetFromStart / manifest.segmentSize;
+  std::vector<int64_t> decryptedSizes(static_cast<size_t>(segmentCount), 0);
+  segmentintegrity::ForEachSegmentRun(0, segmentCount, settings, [&](int64_t first, int64_t last) {
+    for (int64_t i = first; i < last; ++i) {
+      int64_t start = i * manifest.segmentSize;
+      bool isLast = i + 1 == segmentCount;
+      int64_t inputSize = isLast ? inputBufferSize - start : manifest.segmentSize;
+      int64_t outputSize = isLast ? outputBufferSize - start : manifest.segmentSize;
+      int64_t decrypted = handler->DecryptBuffer(offsetFromStart + start, inputBuffer + start, inputSize,
+          outputBuffer + start, outputSize, isLast && isFinal);
+      decryptedSizes[static_cast<size_t>(i)] = decrypted;
+      if (decrypted != manifest.segmentSize && !(isLast && isFinal)) {
+        continue;
+      }
+      int64_t segment = firstSegment + i;
+      if (segment >= static_cast<int64_t>(manifest.digests.size())) {
+        if (decrypted > 0) {
+          throw BadInputError("Content failed integrity verification: it is longer than its manifest");
+        }
+        continue;
+      }
+      segmentintegrity::VerifySegment(manifest, segment, outputBuffer + start, decrypted);
+    }
+  });
+  int64_t total = 0;
+  for (int64_t size : decryptedSizes) {
+    total += size;
+  }
+  return total;
+}
+
+/**
+ * @brief Verifies the segments of a decrypted stream in the background, for deferred verification
+ * 
+ * @param decryptedStream Decrypted content used only for verification, e.g. a second CreateLazyDecryptedStream over
+ *        the same backing stream, so that it does not move the position of the stream being consumed
+ * @param manifest Manifest of the cleartext
+ * @param firstSegment First segment to verify, e.g. the first one not already verified with VerifySegments
+ * @param settings Task dispatcher running the verification; a new thread if not set
+ * 
+ * @return Future that becomes ready once every segment from @p firstSegment is verified, holding a BadInputError if
+ *         one does not match its digest
+ * 
+ * @note The application consumes the head of the content while its tail is verified, and checks the future before
+ *       acting on the content as a whole, e.g. before committing it.
+ */
+inline std::future<void> VerifySegmentsAsync(
+    const std::shared_ptr<Stream>& decryptedStream,
+    const SegmentDigestManifest& manifest,
+    int64_t firstSegment = 0,
+    const CryptoParallelismSettings& settings = CryptoParallelismSettings(1)) {
+  if (!decryptedStream) {
+    throw BadInputError("VerifySegmentsAsync requires a decrypted stream");
+  }
+  segmentintegrity::CheckManifest(manifest);
+  auto task = std::make_shared<std::packaged_task<void()>>([decryptedStream, manifest, firstSegment]() {
+    std::vector<uint8_t> buffer(static_cast<size_t>((std::min)(manifest.segmentSize, manifest.contentSize)));
+    for (int64_t segment = (std::max)(firstSegment, static_cast<int64_t>(0));
+        segment < segmentintegrity::GetSegmentCount(manifest); ++segment) {
+      int64_t start = segment * manifest.segmentSize;
+      int64_t length = (std::min)(manifest.segmentSize, manifest.contentSize - start);
+      decryptedStream->Seek(start);
+      int64_t bytesRead = ReadFromStream(decryptedStream, buffer.data(), length);
+      segmentintegrity::VerifySegment(manifest, segment, buffer.data(), bytesRead);
+    }
+  });
+  std::future<void> result = task->get_future();
+  auto dispatcher = settings.GetTaskDispatcherDelegate();
+  if (dispatcher) {
+    dispatcher->DispatchTask(parallelcrypto::CreateCryptoTaskId(), [task]() { (*task)(); });
+  } else {
+    std::thread([task]() { (*task)(); }).detach();
+  }
+  return result;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_SEGMENT_INTEGRITY_H_
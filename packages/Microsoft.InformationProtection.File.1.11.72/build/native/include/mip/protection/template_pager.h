@@ -0,0 +1,292 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TemplatePager, which serves the templates of a ProtectionEngine in pages, and GetTemplatePagesAsync
+ * 
+ * @file template_pager.h
+ */
+
+#ifndef API_MIP_PROTECTION_TEMPLATE_PAGER_H_
+#define API_MIP_PROTECTION_TEMPLATE_PAGER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/get_template_settings.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/template_descriptor.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Template fields copied into a page
+ */
+enum class TemplateFields : unsigned int {
+  All = 0,        /**< ID, name and description */
+  IdAndName = 1,  /**< ID and name only, e.g. for a picker that shows descriptions on demand */
+};
+
+/**
+ * @brief Settings of template pages
+ */
+struct TemplatePageSettings {
+  size_t pageSize = 50;                                         /**< Templates per page */
+  TemplateFields fields = TemplateFields::All;                  /**< Fields copied into a page */
+  std::shared_ptr<const GetTemplatesSettings> templateSettings; /**< Settings passed to the engine, may be nullptr */
+};
+
+/**
+ * @brief Fields of a template, as copied into a page
+ */
+struct TemplateSummary {
+  std::string id;           /**< Template ID */
+  std::string name;         /**< Template name */
+  std::string description;  /**< Template description, empty unless TemplateFields::All was requested */
+};
+
+/**
+ * @brief One page of templates
+ */
+struct TemplatePage {
+  std::vector<TemplateSummary> templates; /**< Templates of the page, in the order the engine returned them */
+  std::string continuationToken;          /**< Token of the next page, empty on the last page */
+  size_t totalCount = 0;                  /**< Templates across all pages */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace templatepager {
+
+inline size_t CheckPageSize(size_t pageSize) {
+  if (pageSize == 0) {
+    throw BadInputError("Template page size must be positive");
+  }
+  return pageSize;
+}
+
+inline TemplatePage CreatePage(
+    const std::vector<std::shared_ptr<TemplateDescriptor>>& templates,
+    size_t offset,
+    size_t pageSize,
+    TemplateFields fields,
+    const std::string& tokenPrefix) {
+  TemplatePage page;
+  page.totalCount = templates.size();
+  size_t end = offset + std::min(pageSize, templates.size() - offset);
+  page.templates.reserve(end - offset);
+  for (size_t i = offset; i < end; ++i) {
+    if (!templates[i]) {
+      continue;
+    }
+    TemplateSummary summary;
+    summary.id = templates[i]->GetId();
+    summary.name = templates[i]->GetName();
+    if (fields == TemplateFields::All) {
+      summary.description = templates[i]->GetDescription();
+    }
+    page.templates.push_back(std::move(summary));
+  }
+  if (end < templates.size()) {
+    page.continuationToken = tokenPrefix + std::to_string(end);
+  }
+  return page;
+}
+
+// Delivers the pages of a GetTemplatesAsync result one at a time, projecting each page only when it is delivered
+class PagingObserver : public ProtectionEngine::Observer {
+public:
+  PagingObserver(
+      const TemplatePageSettings& settings,
+      const std::function<bool(const TemplatePage&)>& onPage,
+      const std::function<void(const std::exception_ptr&)>& onComplete)
+      : mSettings(settings),
+        mOnPage(onPage),
+        mOnComplete(onComplete) {}
+
+  void OnGetTemplatesSuccess(
+      const std::vector<std::shared_ptr<TemplateDescriptor>>& templateDescriptors,
+      const std::shared_ptr<void>& /*context*/) override {
+    std::exception_ptr error;
+    try {
+      size_t offset = 0;
+      do {
+        TemplatePage page =
+            CreatePage(templateDescriptors, offset, mSettings.pageSize, mSettings.fields, std::string());
+        offset += std::min(mSettings.pageSize, templateDescriptors.size() - offset);
+        if (!mOnPage(page)) {
+          break;
+        }
+      } while (offset < templateDescriptors.size());
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (mOnComplete) {
+      mOnComplete(error);
+    }
+  }
+
+  void OnGetTemplatesFailure(const std::exception_ptr& error, const std::shared_ptr<void>& /*context*/) override {
+    if (mOnComplete) {
+      mOnComplete(error);
+    }
+  }
+
+private:
+  TemplatePageSettings mSettings;
+  std::function<bool(const TemplatePage&)> mOnPage;
+  std::function<void(const std::exception_ptr&)> mOnComplete;
+};
+
+} // namespace templatepager
+/** @endcond */
+
+/**
+ * @brief Serves the templates of a ProtectionEngine in pages
+ * 
+ * @note The service returns the templates of a user in one response, so the pager loads them once and then copies
+ *       only the fields of the page asked for, instead of every template's strings for every call. A continuation
+ *       token names a position in one load of templates; after Refresh, tokens handed out before it are rejected and
+ *       the caller starts again from the first page.
+ */
+class TemplatePager {
+public:
+  /**
+   * @brief TemplatePager constructor
+   * 
+   * @param engine Protection engine whose templates are paged
+   * @param settings Page size, projection and settings passed to the engine
+   */
+  TemplatePager(const std::shared_ptr<ProtectionEngine>& engine, const TemplatePageSettings& settings = {})
+      : mEngine(engine),
+        mSettings(settings) {
+    if (!mEngine) {
+      throw BadInputError("TemplatePager requires a ProtectionEngine");
+    }
+    templatepager::CheckPageSize(mSettings.pageSize);
+  }
+
+  /**
+   * @brief Get a page of templates
+   * 
+   * @param continuationToken Token of the page, as returned with the previous page; empty for the first page
+   * @param context Client context that will be opaquely passed to optional HttpDelegate when templates are loaded
+   * 
+   * @return Page of templates
+   * 
+   * @throw BadInputError if the token is malformed or was handed out before the last Refresh
+   */
+  TemplatePage GetPage(
+      const std::string& continuationToken = std::string(),
+      const std::shared_ptr<void>& context = nullptr) {
+    std::shared_ptr<const std::vector<std::shared_ptr<TemplateDescriptor>>> templates;
+    uint64_t generation = 0;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!mTemplates) {
+        auto settings = mSettings.templateSettings;
+        mTemplates = std::make_shared<const std::vector<std::shared_ptr<TemplateDescriptor>>>(
+            settings ? mEngine->GetTemplates(context, settings) : mEngine->GetTemplates(context));
+      }
+      templates = mTemplates;
+      generation = mGeneration;
+    }
+    std::string tokenPrefix = std::to_string(generation) + ":";
+    size_t offset = 0;
+    if (!continuationToken.empty()) {
+      if (continuationToken.compare(0, tokenPrefix.size(), tokenPrefix) != 0) {
+        throw BadInputError("Template continuation token has expired or is malformed");
+      }
+      char* end = nullptr;
+      unsigned long long value = std::strtoull(continuationToken.c_str() + tokenPrefix.size(), &end, 10);
+      if (*end != '\0' || value == 0 || value >= templates->size()) {
+        throw BadInputError("Template continuation token is malformed");
+      }
+      offset = static_cast<size_t>(value);
+    }
+    return templatepager::CreatePage(*templates, offset, mSettings.pageSize, mSettings.fields, tokenPrefix);
+  }
+
+  /**
+   * @brief Drop the loaded templates, so that the next page reloads them from the engine
+   */
+  void Refresh() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTemplates.reset();
+    ++mGeneration;
+  }
+
+private:
+  std::shared_ptr<ProtectionEngine> mEngine;
+  TemplatePageSettings mSettings;
+  std::mutex mMutex;
+  std::shared_ptr<const std::vector<std::shared_ptr<TemplateDescriptor>>> mTemplates;
+  uint64_t mGeneration = 1;
+};
+
+/**
+ * @brief Get the templates of a user as a stream of pages
+ * 
+ * @param engine Protection engine whose templates are delivered
+ * @param settings Page size, projection and settings passed to the engine
+ * @param onPage Called with each page in order, on the thread that completes the request; return false to stop
+ * @param onComplete Called once after the last page, with nullptr, or with the error of the request or of onPage
+ * @param context Client context that will be opaquely passed to optional HttpDelegate
+ * 
+ * @return Async control object
+ * 
+ * @note Each page is projected just before it is delivered, so a picker can render the first page without waiting
+ *       for the fields of the rest to be copied. Pages of a stream carry no continuation token.
+ */
+inline std::shared_ptr<AsyncControl> GetTemplatePagesAsync(
+    const std::shared_ptr<ProtectionEngine>& engine,
+    const TemplatePageSettings& settings,
+    const std::function<bool(const TemplatePage&)>& onPage,
+    const std::function<void(const std::exception_ptr&)>& onComplete = nullptr,
+    const std::shared_ptr<void>& context = nullptr) {
+  if (!engine) {
+    throw BadInputError("A ProtectionEngine is required");
+  }
+  if (!onPage) {
+    throw BadInputError("A page callback is required");
+  }
+  templatepager::CheckPageSize(settings.pageSize);
+  auto observer = std::make_shared<templatepager::PagingObserver>(settings, onPage, onComplete);
+  return settings.templateSettings ? engine->GetTemplatesAsync(observer, context, settings.templateSettings)
+                                   : engine->GetTemplatesAsync(observer, context);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_TEMPLATE_PAGER_H_
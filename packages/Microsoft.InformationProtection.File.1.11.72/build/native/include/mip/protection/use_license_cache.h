@@ -0,0 +1,225 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an in-process cache of consumption ProtectionHandlers keyed by content and identity
+ * 
+ * @file use_license_cache.h
+ */
+
+#ifndef API_MIP_PROTECTION_USE_LICENSE_CACHE_H_
+#define API_MIP_PROTECTION_USE_LICENSE_CACHE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_handler.h"
+#include "mip/protection_descriptor.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief An in-memory cache of consumption ProtectionHandlers, keyed by (content ID, identity).
+ * 
+ * @note A ProtectionHandler created for consumption holds the use license for its content, so reusing it avoids the
+ *       licensing round trip entirely. One instance may be shared by any number of ProtectionEngines and profiles in
+ *       the same process, entries are isolated by the identity of the engine (and delegated user, if any). Entries
+ *       expire at the content's validity (ProtectionDescriptor::GetContentValidUntil) or after the configured time to
+ *       live, whichever comes first. This tier sits above the SDK's own license cache: a miss still benefits from
+ *       licenses cached in storage when ProtectionProfile::Settings::SetCanCacheLicenses is enabled.
+ */
+class UseLicenseCache {
+public:
+  /**
+   * @brief UseLicenseCache constructor
+   * 
+   * @param maxEntries Maximum number of handlers kept, least recently used handlers are evicted first
+   * @param timeToLive Maximum time a handler is reused, regardless of content validity
+   */
+  UseLicenseCache(size_t maxEntries = 1024, std::chrono::seconds timeToLive = std::chrono::hours(1))
+      : mMaxEntries(maxEntries > 0 ? maxEntries : 1),
+        mTimeToLive(timeToLive) {}
+
+  /**
+   * @brief Get a cached handler for the content, or create and cache one
+   * 
+   * @param engine Protection engine used on a miss; its identity is part of the cache key
+   * @param settings Consumption settings
+   * @param context Client context that will be opaquely forwarded to optional HttpDelegate on a miss
+   * 
+   * @return ProtectionHandler for the content
+   */
+  std::shared_ptr<ProtectionHandler> GetOrCreateConsumptionHandler(
+      const std::shared_ptr<ProtectionEngine>& engine,
+      const ProtectionHandler::ConsumptionSettings& settings,
+      const std::shared_ptr<void>& context = nullptr) {
+    if (!engine) {
+      throw BadInputError("A ProtectionEngine is required");
+    }
+    std::string key = CreateKey(engine->GetSettings().GetIdentity().GetEmail(), settings);
+    auto cached = Find(key);
+    if (cached) {
+      return cached;
+    }
+    // Create outside of the lock so that a slow licensing request does not block hits for other content
+    auto handler = engine->CreateProtectionHandlerForConsumption(settings, context);
+    if (handler) {
+      Insert(key, handler);
+    }
+    return handler;
+  }
+
+  /**
+   * @brief Get a cached handler without creating one
+   * 
+   * @param identityEmail Email of the identity the handler was created for
+   * @param settings Consumption settings
+   * 
+   * @return Cached ProtectionHandler, or nullptr if there is no unexpired entry
+   */
+  std::shared_ptr<ProtectionHandler> Find(
+      const std::string& identityEmail,
+      const ProtectionHandler::ConsumptionSettings& settings) {
+    return Find(CreateKey(identityEmail, settings));
+  }
+
+  /**
+   * @brief Remove all cached handlers for a content ID, for example after the content has been revoked
+   * 
+   * @param contentId Content ID, as returned by ProtectionHandler::GetContentId
+   */
+  void RemoveContent(const std::string& contentId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+      if (it->contentId == contentId) {
+        mIndex.erase(it->key);
+        it = mEntries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /**
+   * @brief Remove all cached handlers
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mIndex.clear();
+  }
+
+  /**
+   * @brief Get the number of cached handlers, including any that have expired but not yet been evicted
+   * 
+   * @return Entry count
+   */
+  size_t GetEntryCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::string key;
+    std::string contentId;
+    std::shared_ptr<ProtectionHandler> handler;
+    std::chrono::system_clock::time_point expiry;
+  };
+
+  static std::string CreateKey(const std::string& identityEmail, const ProtectionHandler::ConsumptionSettings& settings) {
+    // Unparsed licenses have no content ID yet, so fall back to the serialized license, which identifies it uniquely
+    std::string contentKey;
+    auto licenseInfo = settings.GetPublishingLicenseInfo();
+    if (licenseInfo) {
+      contentKey = licenseInfo->GetContentId();
+      if (contentKey.empty()) {
+        const std::vector<uint8_t>& license = licenseInfo->GetSerializedPublishingLicense();
+        contentKey.assign(license.begin(), license.end());
+      }
+    }
+    std::string key;
+    key.reserve(identityEmail.size() + settings.GetDelegatedUserEmail().size() + contentKey.size() + 2);
+    key.append(identityEmail).append(1, '\n').append(settings.GetDelegatedUserEmail()).append(1, '\n');
+    key.append(contentKey);
+    return key;
+  }
+
+  std::shared_ptr<ProtectionHandler> Find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto cached = mIndex.find(key);
+    if (cached == mIndex.end()) {
+      return nullptr;
+    }
+    if (cached->second->expiry <= std::chrono::system_clock::now()) {
+      mEntries.erase(cached->second);
+      mIndex.erase(cached);
+      return nullptr;
+    }
+    mEntries.splice(mEntries.begin(), mEntries, cached->second);
+    return cached->second->handler;
+  }
+
+  void Insert(const std::string& key, const std::shared_ptr<ProtectionHandler>& handler) {
+    auto expiry = std::chrono::system_clock::now() + mTimeToLive;
+    auto descriptor = handler->GetProtectionDescriptor();
+    if (descriptor && descriptor->DoesContentExpire()) {
+      expiry = (std::min)(expiry, descriptor->GetContentValidUntil());
+    }
+    std::string contentId = handler->GetContentId();
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto existing = mIndex.find(key);
+    if (existing != mIndex.end()) {
+      mEntries.erase(existing->second);
+      mIndex.erase(existing);
+    }
+    mEntries.push_front(Entry{key, contentId, handler, expiry});
+    mIndex[key] = mEntries.begin();
+    while (mEntries.size() > mMaxEntries) {
+      mIndex.erase(mEntries.back().key);
+      mEntries.pop_back();
+    }
+  }
+
+  size_t mMaxEntries;
+  std::chrono::seconds mTimeToLive;
+  mutable std::mutex mMutex;
+  std::list<Entry> mEntries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_USE_LICENSE_CACHE_H_
@@ -0,0 +1,168 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines UserCertWarmer, which loads and renews user certificates in the background
+ * 
+ * @file user_cert_warmer.h
+ */
+
+#ifndef API_MIP_PROTECTION_USER_CERT_WARMER_H_
+#define API_MIP_PROTECTION_USER_CERT_WARMER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_engine.h"
+#include "mip/protection/protection_profile.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Loads the user certificates of registered engines in the background and reloads them periodically.
+ * 
+ * @note ProtectionEngine::LoadUserCert otherwise runs inline on the first protect or consume call of an identity.
+ *       Registered engines are held weakly: renewal stops once the application releases the engine or the warmer.
+ *       A failed load is retried after @p retryInterval.
+ */
+class UserCertWarmer {
+public:
+  /**
+   * @brief UserCertWarmer constructor
+   * 
+   * @param taskDispatcher Task dispatcher that runs the loads
+   * @param renewalInterval Time between certificate reloads of an engine
+   * @param retryInterval Time before a failed load is retried
+   */
+  UserCertWarmer(
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+      std::chrono::seconds renewalInterval = std::chrono::hours(12),
+      std::chrono::seconds retryInterval = std::chrono::minutes(5))
+      : mState(std::make_shared<State>()) {
+    if (!taskDispatcher) {
+      throw BadInputError("UserCertWarmer requires a TaskDispatcherDelegate");
+    }
+    mState->taskDispatcher = taskDispatcher;
+    mState->renewalInterval = (std::max)(renewalInterval, std::chrono::seconds(1));
+    mState->retryInterval = (std::min)((std::max)(retryInterval, std::chrono::seconds(1)), mState->renewalInterval);
+  }
+
+  /**
+   * @brief Load an engine's user certificate now, in the background, and keep renewing it
+   * 
+   * @param engine Protection engine
+   */
+  void Register(const std::shared_ptr<ProtectionEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("A ProtectionEngine is required");
+    }
+    Schedule(mState, engine, 0);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct State {
+    std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+    std::chrono::seconds renewalInterval;
+    std::chrono::seconds retryInterval;
+  };
+
+  static void Schedule(
+      const std::shared_ptr<State>& state,
+      const std::weak_ptr<ProtectionEngine>& engine,
+      int64_t delaySeconds) {
+    static std::atomic<uint64_t> sTaskCounter(0);
+    std::weak_ptr<State> weakState = state;
+    auto task = [weakState, engine]() { Load(weakState, engine); };
+    std::string taskId = "mip-user-cert-warmup-" + std::to_string(++sTaskCounter);
+    if (delaySeconds > 0) {
+      state->taskDispatcher->DispatchTask(taskId, task, delaySeconds);
+    } else {
+      state->taskDispatcher->DispatchTask(taskId, task);
+    }
+  }
+
+  static void Load(const std::weak_ptr<State>& weakState, const std::weak_ptr<ProtectionEngine>& weakEngine) {
+    auto state = weakState.lock();
+    auto engine = weakEngine.lock();
+    if (!state || !engine) {
+      return;
+    }
+    bool isLoaded = false;
+    try {
+      isLoaded = engine->LoadUserCert(nullptr);
+    } catch (...) {
+      // Retried below, the next protect or consume call will surface a persistent failure
+    }
+    try {
+      Schedule(state, engine, isLoaded ? state->renewalInterval.count() : state->retryInterval.count());
+    } catch (...) {
+      // The dispatcher is shutting down
+    }
+  }
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+};
+
+/**
+ * @brief Add engines for a list of identities and load their user certificates in the background
+ * 
+ * @param profile Protection profile
+ * @param settings Engine settings, one per identity
+ * @param warmer Warmer that loads and renews the certificates
+ * 
+ * @return The added engines, in the same order as @p settings
+ * 
+ * @note Call before peak hours so that the first request of each identity does not bootstrap its certificates.
+ *       The application must keep the returned engines alive for renewal to continue.
+ */
+inline std::vector<std::shared_ptr<ProtectionEngine>> PreWarmIdentities(
+    const std::shared_ptr<ProtectionProfile>& profile,
+    const std::vector<ProtectionEngine::Settings>& settings,
+    UserCertWarmer& warmer) {
+  if (!profile) {
+    throw BadInputError("A ProtectionProfile is required");
+  }
+  std::vector<std::shared_ptr<ProtectionEngine>> engines;
+  engines.reserve(settings.size());
+  for (const auto& engineSettings : settings) {
+    auto engine = profile->AddEngine(engineSettings);
+    warmer.Register(engine);
+    engines.push_back(engine);
+  }
+  return engines;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_PROTECTION_USER_CERT_WARMER_H_
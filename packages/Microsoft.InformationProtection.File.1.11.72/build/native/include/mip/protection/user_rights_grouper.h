@@ -0,0 +1,226 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines UserRightsGrouper and UserRolesGrouper, which collapse per-user permission lists into shared groups
+ *
+ * @file user_rights_grouper.h
+ */
+
+#ifndef API_MIP_PROTECTION_USER_RIGHTS_GROUPER_H_
+#define API_MIP_PROTECTION_USER_RIGHTS_GROUPER_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/protection/protection_descriptor_builder.h"
+#include "mip/user_rights.h"
+#include "mip/user_roles.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace usergrouping {
+
+inline const std::vector<std::string>& GetPermissions(const UserRights& group) { return group.Rights(); }
+inline const std::vector<std::string>& GetPermissions(const UserRoles& group) { return group.Roles(); }
+
+} // namespace usergrouping
+/** @endcond */
+
+/**
+ * @brief Groups users by identical permission sets, so each distinct set is stored once
+ *
+ * @note An ad-hoc permission set listing every user with their own rights repeats the same few rights lists
+ *       thousands of times. The grouper keys each list by its sorted, de-duplicated content and appends the user to
+ *       the group holding that list, so 10,000 users with three distinct rights sets become three UserRights. Users
+ *       can be added one at a time, from an iterator range or from a producer function, so the full per-user list
+ *       never has to be materialized. Not thread-safe.
+ *
+ * @tparam TGroup UserRights or UserRoles
+ */
+template <typename TGroup>
+class UserPermissionGrouper {
+public:
+  /** @brief Produces the next user and permissions, returning false when there are none left */
+  typedef std::function<bool(std::string& user, std::vector<std::string>& permissions)> Producer;
+
+  /**
+   * @brief Add a user
+   *
+   * @param user User
+   * @param permissions Rights or roles of the user
+   */
+  void Add(const std::string& user, std::vector<std::string> permissions) {
+    mGroups[GetGroupIndex(std::move(permissions))].first.push_back(user);
+    ++mUserCount;
+  }
+
+  /**
+   * @brief Add a group of users sharing the same permissions
+   *
+   * @param group UserRights or UserRoles
+   */
+  void Add(const TGroup& group) {
+    auto& users = mGroups[GetGroupIndex(usergrouping::GetPermissions(group))].first;
+    users.insert(users.end(), group.Users().begin(), group.Users().end());
+    mUserCount += group.Users().size();
+  }
+
+  /**
+   * @brief Add the users of a range
+   *
+   * @param first Iterator to the first element, a TGroup or a std::pair of user and permissions
+   * @param last Iterator past the last element
+   */
+  template <typename TIterator>
+  void Add(TIterator first, TIterator last) {
+    for (; first != last; ++first) {
+      AddElement(*first);
+    }
+  }
+
+  /**
+   * @brief Add users until the producer runs out
+   *
+   * @param producer Producer, e.g. reading a directory query result page by page
+   */
+  void AddFrom(const Producer& producer) {
+    std::string user;
+    std::vector<std::string> permissions;
+    while (producer(user, permissions)) {
+      Add(user, std::move(permissions));
+      permissions.clear();
+    }
+  }
+
+  /**
+   * @brief Get the number of users added
+   *
+   * @return User count
+   */
+  size_t GetUserCount() const { return mUserCount; }
+
+  /**
+   * @brief Get the number of distinct permission sets
+   *
+   * @return Group count
+   */
+  size_t GetGroupCount() const { return mGroups.size(); }
+
+  /**
+   * @brief Move the groups out, leaving the grouper empty
+   *
+   * @return One UserRights or UserRoles per distinct permission set, in order of first appearance
+   */
+  std::vector<TGroup> Release() {
+    std::vector<TGroup> groups;
+    groups.reserve(mGroups.size());
+    for (auto& group : mGroups) {
+      groups.emplace_back(std::move(group.first), std::move(group.second));
+    }
+    mGroups.clear();
+    mIndex.clear();
+    mUserCount = 0;
+    return groups;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  void AddElement(const TGroup& group) { Add(group); }
+
+  template <typename TUser, typename TPermissions>
+  void AddElement(const std::pair<TUser, TPermissions>& element) {
+    Add(element.first, std::vector<std::string>(element.second.begin(), element.second.end()));
+  }
+
+  size_t GetGroupIndex(std::vector<std::string> permissions) {
+    std::sort(permissions.begin(), permissions.end());
+    permissions.erase(std::unique(permissions.begin(), permissions.end()), permissions.end());
+    std::string key;
+    for (const std::string& permission : permissions) {
+      key += permission;
+      key += '\0';
+    }
+    auto found = mIndex.find(key);
+    if (found != mIndex.end()) {
+      return found->second;
+    }
+    mGroups.emplace_back(std::vector<std::string>(), std::move(permissions));
+    mIndex.emplace(std::move(key), mGroups.size() - 1);
+    return mGroups.size() - 1;
+  }
+
+  std::vector<std::pair<std::vector<std::string>, std::vector<std::string>>> mGroups;
+  std::unordered_map<std::string, size_t> mIndex;
+  size_t mUserCount = 0;
+  /** @endcond */
+};
+
+/** @brief Groups users by identical rights */
+typedef UserPermissionGrouper<UserRights> UserRightsGrouper;
+
+/** @brief Groups users by identical roles */
+typedef UserPermissionGrouper<UserRoles> UserRolesGrouper;
+
+/**
+ * @brief Creates a ProtectionDescriptorBuilder from per-user rights without materializing the per-user list
+ *
+ * @param first Iterator to the first element, a UserRights or a std::pair of user and rights
+ * @param last Iterator past the last element
+ *
+ * @return New ProtectionDescriptorBuilder instance, holding one UserRights per distinct rights set
+ */
+template <typename TIterator>
+inline std::shared_ptr<ProtectionDescriptorBuilder> CreateBuilderFromUserRights(TIterator first, TIterator last) {
+  UserRightsGrouper grouper;
+  grouper.Add(first, last);
+  return ProtectionDescriptorBuilder::CreateFromUserRights(grouper.Release());
+}
+
+/**
+ * @brief Creates a ProtectionDescriptorBuilder from per-user rights read from a producer
+ *
+ * @param producer Producer of users and their rights
+ *
+ * @return New ProtectionDescriptorBuilder instance, holding one UserRights per distinct rights set
+ */
+inline std::shared_ptr<ProtectionDescriptorBuilder> CreateBuilderFromUserRights(
+    const UserRightsGrouper::Producer& producer) {
+  UserRightsGrouper grouper;
+  grouper.AddFrom(producer);
+  return ProtectionDescriptorBuilder::CreateFromUserRights(grouper.Release());
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_PROTECTION_USER_RIGHTS_GROUPER_H_
@@ -0,0 +1,176 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a Stream decorator that limits and counts the bytes read from another stream
+ * 
+ * @file read_budget_stream.h
+ */
+
+#ifndef API_MIP_READ_BUDGET_STREAM_H_
+#define API_MIP_READ_BUDGET_STREAM_H_
+
+#include <algorithm>
+#include <memory>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A read-only Stream decorator that fails any read which would take the total bytes read past a budget.
+ * 
+ * @note A read that would exceed the budget throws FileIOError and sets IsBudgetExceeded, so the caller can tell a
+ *       budget failure from a real I/O error even if the consumer of the stream rethrows it as a different error.
+ */
+class ReadBudgetStream : public Stream {
+public:
+  /**
+   * @brief ReadBudgetStream constructor
+   * 
+   * @param innerStream Stream being read
+   * @param maxBytesToRead Maximum total number of bytes that may be read
+   */
+  ReadBudgetStream(const std::shared_ptr<Stream>& innerStream, int64_t maxBytesToRead)
+      : mInnerStream(innerStream),
+        mMaxBytesToRead((std::max)(maxBytesToRead, static_cast<int64_t>(0))),
+        mBytesRead(0),
+        mIsBudgetExceeded(false) {
+    if (!mInnerStream) {
+      throw BadInputError("ReadBudgetStream requires an inner stream");
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    // Reads at the end of the stream cost nothing, so clamp to the remaining content before checking the budget
+    int64_t remainingContent = (std::max)(mInnerStream->Size() - mInnerStream->Position(), static_cast<int64_t>(0));
+    int64_t requested = (std::min)(bufferLength, remainingContent);
+    if (mBytesRead + requested > mMaxBytesToRead) {
+      mIsBudgetExceeded = true;
+      throw FileIOError("Read budget exceeded");
+    }
+    int64_t bytesRead = mInnerStream->Read(buffer, requested);
+    mBytesRead += bytesRead;
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* /*buffer*/, int64_t /*bufferLength*/) override {
+    throw NotSupportedError("ReadBudgetStream is read-only");
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override { return true; }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mInnerStream->Seek(position); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mInnerStream->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return false; }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mInnerStream->Position(); }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mInnerStream->Size(); }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t /*value*/) override { throw NotSupportedError("ReadBudgetStream is read-only"); }
+
+  /**
+   * @brief Get the total number of bytes read from the inner stream
+   * 
+   * @return Bytes read
+   */
+  int64_t GetBytesRead() const { return mBytesRead; }
+
+  /**
+   * @brief Get whether a read was refused because it would have exceeded the budget
+   * 
+   * @return true if the budget was exceeded
+   */
+  bool IsBudgetExceeded() const { return mIsBudgetExceeded; }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~ReadBudgetStream() { }
+
+private:
+  std::shared_ptr<Stream> mInnerStream;
+  int64_t mMaxBytesToRead;
+  int64_t mBytesRead;
+  bool mIsBudgetExceeded;
+  /** @endcond */
+}; // class ReadBudgetStream
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_READ_BUDGET_STREAM_H_
@@ -0,0 +1,512 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines RegionalEndpointHttpDelegate, which routes service requests to the fastest healthy regional front
+ *        door
+ * 
+ * @file regional_endpoint_http_delegate.h
+ */
+
+#ifndef API_MIP_REGIONAL_ENDPOINT_HTTP_DELEGATE_H_
+#define API_MIP_REGIONAL_ENDPOINT_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+#include "mip/prewarming_http_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A service origin and the front doors serving the same API in other regions
+ */
+struct RegionalEndpointGroup {
+  /** Origin the SDK sends requests to, e.g. "https://api.aadrm.com" or the engine's cloud endpoint base URL */
+  std::string serviceOrigin;
+  /** Origins that can serve the same requests, e.g. the tenant's regional licensing hosts. The service origin is
+   *  a candidate as well. */
+  std::vector<std::string> frontDoors;
+};
+
+/**
+ * @brief Configuration of a RegionalEndpointHttpDelegate
+ */
+struct RegionalEndpointSettings {
+  std::vector<RegionalEndpointGroup> groups; /**< Service origins to route */
+  std::string probePath = "/";               /**< Path requested to measure round-trip time */
+  int probeCount = 3;                        /**< Probes per front door; the fastest is its round-trip time */
+  std::chrono::milliseconds probeTimeout = std::chrono::milliseconds(2000); /**< Probe slower than this fails */
+  /** Interval between evaluations of every front door, or 0 to evaluate only on Evaluate */
+  std::chrono::seconds reevaluationInterval = std::chrono::seconds(300);
+  /** A front door is only replaced by one at least this much faster, so close timings do not flap */
+  double switchMargin = 0.2;
+  int failureThreshold = 2; /**< Consecutive failed requests after which a front door is taken out of rotation */
+  std::chrono::seconds unhealthyPeriod = std::chrono::seconds(60); /**< Time a failed front door is out of rotation */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace regionalendpoint {
+
+class RoutedRequest : public HttpRequest {
+public:
+  RoutedRequest(const std::shared_ptr<HttpRequest>& request, const std::string& url) : mRequest(request), mUrl(url) {}
+  const std::string& GetId() const override { return mRequest->GetId(); }
+  HttpRequestType GetRequestType() const override { return mRequest->GetRequestType(); }
+  const std::string& GetUrl() const override { return mUrl; }
+  const std::vector<uint8_t>& GetBody() const override { return mRequest->GetBody(); }
+  const std::map<std::string, std::string, CaseInsensitiveComparator>& GetHeaders() const override {
+    return mRequest->GetHeaders();
+  }
+  TransportLayerSecurityMinimumVersion GetTransportLayerSecurityMinimumVersion() const override {
+    return mRequest->GetTransportLayerSecurityMinimumVersion();
+  }
+
+private:
+  std::shared_ptr<HttpRequest> mRequest;
+  std::string mUrl;
+};
+
+struct FrontDoor {
+  std::string origin;
+  int64_t roundTripMicroseconds = -1; // -1 until measured, or if its last probe failed
+  int consecutiveFailures = 0;
+  std::chrono::steady_clock::time_point unhealthyUntil;
+};
+
+struct Group {
+  std::string serviceOrigin;
+  std::vector<FrontDoor> frontDoors;
+  int selected = -1; // -1 routes to the service origin unchanged
+};
+
+inline bool IsFailure(const std::shared_ptr<HttpOperation>& operation) {
+  if (!operation || operation->IsCancelled()) {
+    return !operation;
+  }
+  auto response = operation->GetResponse();
+  return !response || response->GetStatusCode() >= 500;
+}
+
+} // namespace regionalendpoint
+/** @endcond */
+
+/**
+ * @brief HttpDelegate decorator that routes requests for a service origin to the fastest healthy of its front doors,
+ *        fails over on errors and periodically re-evaluates
+ * 
+ * @note The Cloud enum and SetCloudEndpointBaseUrl fix one endpoint per engine, so clusters outside its region send
+ *       every licensing request across regions. This delegate rewrites the origin of requests for each configured
+ *       service origin to the selected front door; the path, headers and body are unchanged, so the front doors
+ *       must serve the same API for the tenant. A background thread measures the round-trip time of each front
+ *       door with probeCount GET requests through the wrapped transport (the first also sets up the connection,
+ *       which the others reuse) and selects the fastest one that responded. A front door whose requests fail
+ *       failureThreshold times in a row, with no response or a 5xx status, is taken out of rotation for
+ *       unhealthyPeriod and the next fastest is selected; layer RetryHttpDelegate above this delegate so that the
+ *       retry of a failed request goes to the new front door. Until the first evaluation completes, requests go to
+ *       the service origin.
+ */
+class RegionalEndpointHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param settings Service origins, their front doors and evaluation options
+   */
+  RegionalEndpointHttpDelegate(const std::shared_ptr<HttpDelegate>& transport, const RegionalEndpointSettings& settings)
+      : mState(std::make_shared<State>()) {
+    if (!transport) {
+      throw BadInputError("RegionalEndpointHttpDelegate requires a transport");
+    }
+    if (settings.probeCount <= 0 || settings.failureThreshold <= 0) {
+      throw BadInputError("RegionalEndpointHttpDelegate requires positive probe count and failure threshold");
+    }
+    mState->transport = transport;
+    mState->settings = settings;
+    for (const auto& groupSettings : settings.groups) {
+      regionalendpoint::Group group;
+      group.serviceOrigin = prewarmhttp::GetOrigin(groupSettings.serviceOrigin);
+      if (group.serviceOrigin.empty()) {
+        throw BadInputError("Invalid service origin: " + groupSettings.serviceOrigin);
+      }
+      std::vector<std::string> origins(1, group.serviceOrigin);
+      for (const auto& frontDoor : groupSettings.frontDoors) {
+        std::string origin = prewarmhttp::GetOrigin(frontDoor);
+        if (origin.empty()) {
+          throw BadInputError("Invalid front door: " + frontDoor);
+        }
+        if (std::find(origins.begin(), origins.end(), origin) == origins.end()) {
+          origins.push_back(origin);
+        }
+      }
+      for (const auto& origin : origins) {
+        regionalendpoint::FrontDoor frontDoor;
+        frontDoor.origin = origin;
+        group.frontDoors.push_back(frontDoor);
+      }
+      mState->groups.push_back(std::move(group));
+    }
+    mState->isEvaluationRequested = true;
+    auto state = mState;
+    mEvaluator = std::thread([state]() { State::Evaluate(state); });
+  }
+
+  /**
+   * @brief Stop evaluating. Probes and requests in flight still complete.
+   */
+  ~RegionalEndpointHttpDelegate() {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->isStopping = true;
+    }
+    mState->changed.notify_all();
+    if (mEvaluator.joinable()) {
+      mEvaluator.join();
+    }
+  }
+
+  /**
+   * @brief Measure every front door again now, e.g. after a network change
+   */
+  void Evaluate() {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->isEvaluationRequested = true;
+    }
+    mState->changed.notify_all();
+  }
+
+  /**
+   * @brief Wait for the pending evaluation to complete
+   * 
+   * @param timeout Longest time to wait
+   * 
+   * @return true if every front door was measured since the last Evaluate, or since construction
+   */
+  bool WaitForEvaluation(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mState->mutex);
+    return mState->changed.wait_for(lock, timeout, [this]() {
+      return mState->evaluationCount > 0 && !mState->isEvaluating && !mState->isEvaluationRequested;
+    });
+  }
+
+  /**
+   * @brief Get the front door requests for a service origin are routed to
+   * 
+   * @param serviceOrigin Service origin of a configured group
+   * 
+   * @return Selected origin, or serviceOrigin itself if it is selected, not configured or not evaluated yet
+   */
+  std::string GetSelectedOrigin(const std::string& serviceOrigin) const {
+    std::string origin = prewarmhttp::GetOrigin(serviceOrigin);
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    for (const auto& group : mState->groups) {
+      if (group.serviceOrigin == origin && group.selected >= 0) {
+        return group.frontDoors[static_cast<size_t>(group.selected)].origin;
+      }
+    }
+    return origin;
+  }
+
+  /**
+   * @brief Get the measured round-trip time of a front door
+   * 
+   * @param frontDoor Origin of a front door
+   * 
+   * @return Round-trip time, or a negative duration if not measured or its last probe failed
+   */
+  std::chrono::microseconds GetRoundTripTime(const std::string& frontDoor) const {
+    std::string origin = prewarmhttp::GetOrigin(frontDoor);
+    std::lock_guard<std::mutex> lock(mState->mutex);
+    for (const auto& group : mState->groups) {
+      for (const auto& candidate : group.frontDoors) {
+        if (candidate.origin == origin) {
+          return std::chrono::microseconds(candidate.roundTripMicroseconds);
+        }
+      }
+    }
+    return std::chrono::microseconds(-1);
+  }
+
+  /**
+   * @brief Send HTTP request
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    std::pair<size_t, int> route;
+    auto routed = mState->Route(request, route);
+    std::shared_ptr<HttpOperation> operation;
+    try {
+      operation = mState->transport->Send(routed, context);
+    } catch (...) {
+      mState->Report(route, true);
+      throw;
+    }
+    mState->Report(route, regionalendpoint::IsFailure(operation));
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed upon completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    std::pair<size_t, int> route;
+    auto routed = mState->Route(request, route);
+    std::weak_ptr<State> weakState = mState;
+    try {
+      return mState->transport->SendAsync(routed, context,
+          [weakState, route, callbackFn](std::shared_ptr<HttpOperation> operation) {
+            if (auto state = weakState.lock()) {
+              state->Report(route, regionalendpoint::IsFailure(operation));
+            }
+            if (callbackFn) {
+              callbackFn(operation);
+            }
+          });
+    } catch (...) {
+      mState->Report(route, true);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mState->transport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Completions and the evaluator can outlive the delegate's public surface, so they share this state
+  struct State {
+    std::shared_ptr<HttpDelegate> transport;
+    RegionalEndpointSettings settings;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<regionalendpoint::Group> groups;
+    bool isEvaluationRequested = false;
+    bool isEvaluating = false;
+    bool isStopping = false;
+    uint64_t evaluationCount = 0;
+    std::atomic<uint64_t> probeCount{0};
+
+    // Rewrites the request's origin to the selected front door; route receives the group and front door reported
+    std::shared_ptr<HttpRequest> Route(const std::shared_ptr<HttpRequest>& request, std::pair<size_t, int>& route) {
+      route = std::make_pair(groups.size(), -1);
+      const std::string& url = request->GetUrl();
+      std::string origin = prewarmhttp::GetOrigin(url);
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].serviceOrigin != origin) {
+          continue;
+        }
+        route = std::make_pair(i, groups[i].selected < 0 ? 0 : groups[i].selected);
+        if (groups[i].selected <= 0) {
+          return request;
+        }
+        const std::string& frontDoor = groups[i].frontDoors[static_cast<size_t>(groups[i].selected)].origin;
+        return std::make_shared<regionalendpoint::RoutedRequest>(request, frontDoor + url.substr(origin.size()));
+      }
+      return request;
+    }
+
+    void Report(const std::pair<size_t, int>& route, bool isFailure) {
+      if (route.second < 0) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      regionalendpoint::Group& group = groups[route.first];
+      regionalendpoint::FrontDoor& frontDoor = group.frontDoors[static_cast<size_t>(route.second)];
+      if (!isFailure) {
+        frontDoor.consecutiveFailures = 0;
+        return;
+      }
+      if (++frontDoor.consecutiveFailures >= settings.failureThreshold) {
+        frontDoor.consecutiveFailures = 0;
+        frontDoor.unhealthyUntil = std::chrono::steady_clock::now() + settings.unhealthyPeriod;
+        if (group.selected == route.second || group.selected < 0) {
+          Select(group, true);
+        }
+      }
+    }
+
+    // Picks the fastest healthy front door, keeping the current one unless another is faster by the switch margin
+    void Select(regionalendpoint::Group& group, bool isCurrentFailed) const {
+      auto now = std::chrono::steady_clock::now();
+      int best = -1;
+      for (size_t i = 0; i < group.frontDoors.size(); ++i) {
+        const auto& candidate = group.frontDoors[i];
+        if (candidate.roundTripMicroseconds >= 0 && candidate.unhealthyUntil <= now &&
+            (best < 0 || candidate.roundTripMicroseconds <
+                group.frontDoors[static_cast<size_t>(best)].roundTripMicroseconds)) {
+          best = static_cast<int>(i);
+        }
+      }
+      if (!isCurrentFailed && group.selected >= 0 && best >= 0) {
+        const auto& current = group.frontDoors[static_cast<size_t>(group.selected)];
+        int64_t bestTime = group.frontDoors[static_cast<size_t>(best)].roundTripMicroseconds;
+        if (current.roundTripMicroseconds >= 0 && current.unhealthyUntil <= now &&
+            current.roundTripMicroseconds <= static_cast<int64_t>(bestTime * (1.0 + settings.switchMargin))) {
+          return;
+        }
+      }
+      group.selected = best;
+    }
+
+    // Fastest of probeCount probes, or -1 if one failed or timed out
+    static int64_t Probe(const std::shared_ptr<State>& state, const std::string& origin) {
+      int64_t fastest = -1;
+      for (int i = 0; i < state->settings.probeCount; ++i) {
+        struct Outcome {
+          bool isDone = false;
+          bool isFailed = false;
+        };
+        auto outcome = std::make_shared<Outcome>();
+        std::string id = "mip-regional-probe-" + std::to_string(++state->probeCount);
+        auto request = std::make_shared<prewarmhttp::PingRequest>(id, origin + state->settings.probePath);
+        auto start = std::chrono::steady_clock::now();
+        std::weak_ptr<State> weakState = state;
+        auto onDone = [weakState, outcome](std::shared_ptr<HttpOperation> operation) {
+          bool isFailed = regionalendpoint::IsFailure(operation) || operation->IsCancelled();
+          if (auto state = weakState.lock()) {
+            {
+              std::lock_guard<std::mutex> lock(state->mutex);
+              outcome->isDone = true;
+              outcome->isFailed = isFailed;
+            }
+            state->changed.notify_all();
+          }
+        };
+        try {
+          state->transport->SendAsync(request, nullptr, onDone);
+        } catch (...) {
+          return -1;
+        }
+        std::unique_lock<std::mutex> lock(state->mutex);
+        bool isDone = state->changed.wait_for(lock, state->settings.probeTimeout,
+            [&]() { return outcome->isDone || state->isStopping; });
+        if (!isDone || !outcome->isDone || outcome->isFailed) {
+          lock.unlock();
+          if (!outcome->isDone) {
+            state->transport->CancelOperation(id);
+          }
+          return -1;
+        }
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        fastest = fastest < 0 ? elapsed : (std::min)(fastest, elapsed);
+      }
+      return fastest;
+    }
+
+    static void Evaluate(const std::shared_ptr<State>& state) {
+      auto nextEvaluation = std::chrono::steady_clock::time_point::max();
+      std::unique_lock<std::mutex> lock(state->mutex);
+      while (!state->isStopping) {
+        if (!state->isEvaluationRequested && std::chrono::steady_clock::now() < nextEvaluation) {
+          state->changed.wait_until(lock, nextEvaluation,
+              [&state]() { return state->isStopping || state->isEvaluationRequested; });
+          continue;
+        }
+        state->isEvaluationRequested = false;
+        state->isEvaluating = true;
+        std::vector<std::vector<std::string>> origins;
+        for (const auto& group : state->groups) {
+          origins.emplace_back();
+          for (const auto& frontDoor : group.frontDoors) {
+            origins.back().push_back(frontDoor.origin);
+          }
+        }
+        lock.unlock();
+        std::vector<std::vector<int64_t>> roundTrips(origins.size());
+        for (size_t i = 0; i < origins.size(); ++i) {
+          for (const auto& origin : origins[i]) {
+            roundTrips[i].push_back(Probe(state, origin));
+          }
+        }
+        lock.lock();
+        for (size_t i = 0; i < state->groups.size(); ++i) {
+          for (size_t j = 0; j < state->groups[i].frontDoors.size(); ++j) {
+            state->groups[i].frontDoors[j].roundTripMicroseconds = roundTrips[i][j];
+          }
+          state->Select(state->groups[i], false);
+        }
+        state->isEvaluating = false;
+        state->evaluationCount++;
+        nextEvaluation = state->settings.reevaluationInterval.count() > 0 ?
+            std::chrono::steady_clock::now() + state->settings.reevaluationInterval :
+            std::chrono::steady_clock::time_point::max();
+        state->changed.notify_all();
+      }
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  std::thread mEvaluator;
+  /** @endcond */
+}; // class RegionalEndpointHttpDelegate
+
+MIP_NAMESPACE_END
+#endif // API_MIP_REGIONAL_ENDPOINT_HTTP_DELEGATE_H_
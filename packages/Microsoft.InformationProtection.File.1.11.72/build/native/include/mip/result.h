@@ -0,0 +1,278 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines Result, a value-or-error return type for operations whose failures are expected
+ *
+ * @file result.h
+ */
+
+#ifndef API_MIP_RESULT_H_
+#define API_MIP_RESULT_H_
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A failure reported by the SDK, classified only when inspected
+ *
+ * @note The SDK reports failures as std::exception_ptr. Reading the type or message of one requires rethrowing it
+ *       once; ErrorInfo does that on the first inspection and caches the outcome, so code that only checks for
+ *       failure, or only forwards the error, never pays for an unwind. Not thread-safe: inspect a given ErrorInfo
+ *       from one thread at a time.
+ */
+class ErrorInfo {
+public:
+  /** @brief ErrorInfo constructor for no failure */
+  ErrorInfo() {}
+
+  /**
+   * @brief ErrorInfo constructor
+   *
+   * @param exception Failure reported by the SDK, or nullptr for none
+   */
+  explicit ErrorInfo(std::exception_ptr exception) : mException(std::move(exception)) {}
+
+  /**
+   * @brief Whether there is a failure
+   *
+   * @return true if a failure is held
+   */
+  explicit operator bool() const { return mException != nullptr; }
+
+  /**
+   * @brief Get the failure as reported by the SDK, without classifying it
+   *
+   * @return Exception, or nullptr for none
+   */
+  const std::exception_ptr& GetException() const { return mException; }
+
+  /**
+   * @brief Get the type of the failure
+   *
+   * @return Error type. Failures that are not a mip::Error report ErrorType::INTERNAL_ERROR.
+   */
+  ErrorType GetErrorType() const {
+    Classify();
+    return mType;
+  }
+
+  /**
+   * @brief Get the message of the failure
+   *
+   * @return Error message, or empty for none
+   */
+  const std::string& GetMessage() const {
+    Classify();
+    return mMessage;
+  }
+
+  /**
+   * @brief Get the failure as a mip::Error
+   *
+   * @return Copy of the error, or nullptr if there is no failure or it is not a mip::Error
+   *
+   * @note Use it to read the details of a specific error, such as NoPermissionsError::GetOwner.
+   */
+  const std::shared_ptr<Error>& GetError() const {
+    Classify();
+    return mError;
+  }
+
+  /**
+   * @brief Whether the failure is of a given type
+   *
+   * @param type Error type
+   *
+   * @return true if a failure of this type is held
+   */
+  bool Is(ErrorType type) const { return mException != nullptr && GetErrorType() == type; }
+
+  /**
+   * @brief Rethrow the failure, if any
+   */
+  void Rethrow() const {
+    if (mException) {
+      std::rethrow_exception(mException);
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  void Classify() const {
+    if (mIsClassified || !mException) {
+      return;
+    }
+    mIsClassified = true;
+    try {
+      std::rethrow_exception(mException);
+    } catch (const Error& e) {
+      mType = e.GetErrorType();
+      mMessage = e.GetMessage();
+      mError = e.Clone();
+    } catch (const std::exception& e) {
+      mMessage = e.what();
+    } catch (...) {
+      mMessage = "Unknown error";
+    }
+  }
+
+  std::exception_ptr mException;
+  mutable bool mIsClassified = false;
+  mutable ErrorType mType = ErrorType::INTERNAL_ERROR;
+  mutable std::string mMessage;
+  mutable std::shared_ptr<Error> mError;
+  /** @endcond */
+};
+
+/**
+ * @brief The value of an operation, or the failure that prevented it
+ *
+ * @note Modeled on std::expected, which is not available in the C++ standard the SDK headers target. Returned by the
+ *       Try* counterparts of the synchronous APIs, for callers such as bulk scans where failures like
+ *       ErrorType::NO_PERMISSIONS are routine and should not be thrown across the caller's stack.
+ *
+ * @tparam T Value type
+ */
+template <typename T>
+class Result {
+public:
+  /**
+   * @brief Result constructor for a success
+   *
+   * @param value Value
+   */
+  Result(T value) : mValue(std::move(value)) {}  // NOLINT: implicit by design
+
+  /**
+   * @brief Result constructor for a failure
+   *
+   * @param error Failure
+   */
+  Result(ErrorInfo error) : mError(std::move(error)) {}  // NOLINT: implicit by design
+
+  /**
+   * @brief Whether the operation succeeded
+   *
+   * @return true on success
+   */
+  bool IsOk() const { return !mError; }
+
+  /** @brief Whether the operation succeeded */
+  explicit operator bool() const { return IsOk(); }
+
+  /**
+   * @brief Get the value
+   *
+   * @return Value. A failure is rethrown.
+   */
+  T& GetValue() {
+    mError.Rethrow();
+    return mValue;
+  }
+
+  /**
+   * @brief Get the value
+   *
+   * @return Value. A failure is rethrown.
+   */
+  const T& GetValue() const {
+    mError.Rethrow();
+    return mValue;
+  }
+
+  /**
+   * @brief Get the value, or a fallback on failure
+   *
+   * @param fallback Value returned on failure
+   *
+   * @return Value or fallback
+   */
+  T GetValueOr(T fallback) const { return IsOk() ? mValue : std::move(fallback); }
+
+  /**
+   * @brief Get the failure
+   *
+   * @return Failure; empty on success
+   */
+  const ErrorInfo& GetError() const { return mError; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  T mValue = T();
+  ErrorInfo mError;
+  /** @endcond */
+};
+
+/**
+ * @brief The outcome of an operation that returns no value
+ */
+template <>
+class Result<void> {
+public:
+  /** @brief Result constructor for a success */
+  Result() {}
+
+  /**
+   * @brief Result constructor for a failure
+   *
+   * @param error Failure
+   */
+  Result(ErrorInfo error) : mError(std::move(error)) {}  // NOLINT: implicit by design
+
+  /**
+   * @brief Whether the operation succeeded
+   *
+   * @return true on success
+   */
+  bool IsOk() const { return !mError; }
+
+  /** @brief Whether the operation succeeded */
+  explicit operator bool() const { return IsOk(); }
+
+  /**
+   * @brief Get the failure
+   *
+   * @return Failure; empty on success
+   */
+  const ErrorInfo& GetError() const { return mError; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  ErrorInfo mError;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_RESULT_H_
@@ -0,0 +1,592 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines RetryHttpDelegate, which retries throttled and failed requests within budgets shared by the process
+ * 
+ * @file retry_http_delegate.h
+ */
+
+#ifndef API_MIP_RETRY_HTTP_DELEGATE_H_
+#define API_MIP_RETRY_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/deadline.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/work_stealing_task_dispatcher.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace retryhttp {
+
+// Stands for a request whose next attempt is scheduled, or that failed in the transport without an operation
+class PlaceholderOperation : public HttpOperation {
+public:
+  explicit PlaceholderOperation(const std::string& id) : mId(id) {}
+  const std::string& GetId() const override { return mId; }
+  std::shared_ptr<HttpResponse> GetResponse() override { return nullptr; }
+  bool IsCancelled() override { return false; }
+
+private:
+  std::string mId;
+};
+
+} // namespace retryhttp
+/** @endcond */
+
+/**
+ * @brief What happened to a request that was not answered on the first attempt
+ */
+enum class RetryEventType : unsigned int {
+  Throttled = 0,        /**< The service answered 429 or 503, or the budget key was still blocked by Retry-After */
+  Retried = 1,          /**< The request was sent again */
+  Dropped = 2,          /**< No retry: the budget was exhausted; the caller receives the last response */
+  Exhausted = 3,        /**< No retry: the maximum number of attempts was reached */
+  DeadlineExceeded = 4, /**< No retry: the delay would end past the deadline of the request's context */
+};
+
+/**
+ * @brief One retry decision, for the push callback
+ */
+struct RetryEvent {
+  RetryEventType type;             /**< Decision */
+  std::string budgetKey;           /**< Endpoint and tenant the budget is kept for */
+  int32_t statusCode;              /**< Status of the last response, or 0 if the transport failed */
+  int attempt;                     /**< Attempts made so far */
+  std::chrono::milliseconds delay; /**< Delay before the retry */
+};
+
+/**
+ * @brief Counters of a ThrottleBudgets instance
+ */
+struct RetryMetrics {
+  uint64_t throttledCount;        /**< Throttling responses and requests delayed by Retry-After */
+  uint64_t retriedCount;          /**< Retries sent */
+  uint64_t droppedCount;          /**< Retries refused by an exhausted budget */
+  uint64_t exhaustedCount;        /**< Requests that used all their attempts */
+  uint64_t deadlineExceededCount; /**< Retries refused because the deadline would pass first */
+};
+
+/**
+ * @brief Retry rules of a RetryHttpDelegate
+ */
+struct RetryPolicy {
+  int maxAttempts = 4;                                           /**< Attempts per request, including the first */
+  std::chrono::milliseconds initialBackoff = std::chrono::seconds(1); /**< Delay before the first retry */
+  std::chrono::milliseconds maxBackoff = std::chrono::seconds(60);    /**< Upper bound of the backoff */
+  double backoffMultiplier = 2.0;                                /**< Growth of the backoff per attempt */
+  double jitter = 0.5;            /**< Share of each backoff randomized away, 0 to 1, to spread retries out */
+  std::chrono::milliseconds maxRetryAfter = std::chrono::minutes(5); /**< Longest Retry-After honored */
+  std::vector<int32_t> retryableStatusCodes = {408, 429, 500, 502, 503, 504}; /**< Responses worth retrying */
+  bool isTransportFailureRetried = true;                         /**< Retry when the transport throws */
+};
+
+/**
+ * @brief Token bucket retry budgets and Retry-After blocks, shared by every RetryHttpDelegate of the process
+ * 
+ * @note Each budget key, an endpoint plus a tenant, owns a bucket that refills at tokensPerSecond up to burst. A
+ *       retry spends one token, so when a tenant is throttled the retries of all its engines together stay within
+ *       the bucket rate instead of multiplying the load. A Retry-After received for a key holds back every request
+ *       for that key, first attempts included, until it expires.
+ */
+class ThrottleBudgets {
+public:
+  /**
+   * @brief Create budgets
+   * 
+   * @param tokensPerSecond Retries allowed per second and budget key in steady state
+   * @param burst Retries allowed at once per budget key
+   */
+  explicit ThrottleBudgets(double tokensPerSecond = 1.0, double burst = 10.0)
+      : mTokensPerSecond((std::max)(tokensPerSecond, 0.0)),
+        mBurst((std::max)(burst, 1.0)),
+        mThrottledCount(0),
+        mRetriedCount(0),
+        mDroppedCount(0),
+        mExhaustedCount(0),
+        mDeadlineExceededCount(0) {}
+
+  /**
+   * @brief Spend one retry token
+   * 
+   * @param budgetKey Budget key
+   * 
+   * @return false if the bucket is empty
+   */
+  bool TryAcquire(const std::string& budgetKey) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Bucket& bucket = GetBucket(budgetKey);
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+    bucket.tokens = (std::min)(mBurst, bucket.tokens + elapsed * mTokensPerSecond);
+    bucket.refilled = now;
+    if (bucket.tokens < 1.0) {
+      return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+  }
+
+  /**
+   * @brief Hold back requests for a key
+   * 
+   * @param budgetKey Budget key
+   * @param until Time before which no request for the key is sent
+   */
+  void BlockUntil(const std::string& budgetKey, std::chrono::steady_clock::time_point until) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Bucket& bucket = GetBucket(budgetKey);
+    bucket.blockedUntil = (std::max)(bucket.blockedUntil, until);
+  }
+
+  /**
+   * @brief Get how long requests for a key are still held back
+   * 
+   * @param budgetKey Budget key
+   * 
+   * @return Remaining block, or zero
+   */
+  std::chrono::milliseconds GetBlockedFor(const std::string& budgetKey) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto bucket = mBuckets.find(budgetKey);
+    if (bucket == mBuckets.end()) {
+      return std::chrono::milliseconds(0);
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        bucket->second.blockedUntil - std::chrono::steady_clock::now());
+    return (std::max)(remaining, std::chrono::milliseconds(0));
+  }
+
+  /**
+   * @brief Get the counters of every request that used these budgets
+   * 
+   * @return Metrics
+   */
+  RetryMetrics GetMetrics() const {
+    return RetryMetrics{mThrottledCount, mRetriedCount, mDroppedCount, mExhaustedCount, mDeadlineExceededCount};
+  }
+
+  /**
+   * @brief Set a callback receiving every retry decision, e.g. to export metrics
+   * 
+   * @param onEvent Callback, called on the thread that made the decision, or nullptr
+   */
+  void SetEventCallback(const std::function<void(const RetryEvent&)>& onEvent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOnEvent = onEvent;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  void Report(const RetryEvent& event) {
+    switch (event.type) {
+      case RetryEventType::Throttled: ++mThrottledCount; break;
+      case RetryEventType::Retried: ++mRetriedCount; break;
+      case RetryEventType::Dropped: ++mDroppedCount; break;
+      case RetryEventType::Exhausted: ++mExhaustedCount; break;
+      case RetryEventType::DeadlineExceeded: ++mDeadlineExceededCount; break;
+    }
+    std::function<void(const RetryEvent&)> onEvent;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      onEvent = mOnEvent;
+    }
+    if (onEvent) {
+      onEvent(event);
+    }
+  }
+
+  double GetRandom() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(mRandom);
+  }
+
+private:
+  struct Bucket {
+    double tokens;
+    std::chrono::steady_clock::time_point refilled;
+    std::chrono::steady_clock::time_point blockedUntil;
+  };
+
+  Bucket& GetBucket(const std::string& budgetKey) {
+    auto bucket = mBuckets.find(budgetKey);
+    if (bucket == mBuckets.end()) {
+      bucket = mBuckets.emplace(budgetKey, Bucket{mBurst, std::chrono::steady_clock::now(),
+          std::chrono::steady_clock::time_point()}).first;
+    }
+    return bucket->second;
+  }
+
+  double mTokensPerSecond;
+  double mBurst;
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, Bucket> mBuckets;
+  std::mt19937 mRandom{std::random_device{}()};
+  std::function<void(const RetryEvent&)> mOnEvent;
+  std::atomic<uint64_t> mThrottledCount;
+  std::atomic<uint64_t> mRetriedCount;
+  std::atomic<uint64_t> mDroppedCount;
+  std::atomic<uint64_t> mExhaustedCount;
+  std::atomic<uint64_t> mDeadlineExceededCount;
+  /** @endcond */
+};
+
+/**
+ * @brief HttpDelegate decorator retrying throttled and failed requests with exponential backoff, jitter and
+ *        Retry-After, within budgets shared across the process
+ * 
+ * @note Share one ThrottleBudgets between the delegates of all engines so that they draw on the same budget per
+ *       endpoint and tenant. Asynchronous retries are scheduled with the delayed TaskDispatcherDelegate::DispatchTask
+ *       overload, so no thread waits for them; that overload takes whole seconds, so delays are rounded up, except on a
+ *       WorkStealingTaskDispatcher, which is given the exact delay. Without a dispatcher, and for the blocking Send,
+ *       the calling or a helper thread waits instead. When no retry is allowed the caller receives the last response
+ *       unchanged, so the SDK's own error handling still applies. A retry whose delay would end past the deadline of
+ *       the request's context (see DeadlineLoggerContext) is not made, and a request still blocked by Retry-After at
+ *       its deadline fails at once with OperationCancelledError instead of waiting.
+ *       The budget key is the scheme, host and port of the URL, followed by the tenant that getTenant returns.
+ */
+class RetryHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   * @param budgets Budgets shared by the process
+   * @param policy Retry rules
+   * @param taskDispatcher Schedules delayed retries, or nullptr
+   * @param getTenant Returns the tenant of a request, or nullptr to keep budgets per endpoint only
+   */
+  RetryHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& transport,
+      const std::shared_ptr<ThrottleBudgets>& budgets,
+      const RetryPolicy& policy = RetryPolicy(),
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher = nullptr,
+      const std::function<std::string(const HttpRequest&)>& getTenant = nullptr)
+      : mState(std::make_shared<State>()) {
+    if (!transport || !budgets) {
+      throw BadInputError("RetryHttpDelegate requires a transport and budgets");
+    }
+    mState->transport = transport;
+    mState->budgets = budgets;
+    mState->policy = policy;
+    mState->policy.maxAttempts = (std::max)(mState->policy.maxAttempts, 1);
+    mState->taskDispatcher = taskDispatcher;
+    mState->getTenant = getTenant;
+  }
+
+  /**
+   * @brief Send HTTP request, retrying on the calling thread
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container of the last attempt
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    std::string budgetKey = mState->GetBudgetKey(*request);
+    std::chrono::steady_clock::time_point deadline = GetDeadline(context);
+    for (int attempt = 1;; ++attempt) {
+      std::chrono::milliseconds blockedFor = mState->budgets->GetBlockedFor(budgetKey);
+      if (blockedFor.count() > 0) {
+        mState->budgets->Report(RetryEvent{RetryEventType::Throttled, budgetKey, 0, attempt - 1, blockedFor});
+        State::ThrowIfBlockedPastDeadline(*request, blockedFor, deadline);
+        std::this_thread::sleep_for(blockedFor);
+      }
+      std::shared_ptr<HttpOperation> operation;
+      std::exception_ptr error;
+      try {
+        operation = mState->transport->Send(request, context);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::chrono::milliseconds delay;
+      if (mState->IsCancelled(request->GetId()) ||
+          !mState->ShouldRetry(budgetKey, operation, error, attempt, deadline, delay)) {
+        mState->Forget(request->GetId());
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        return operation;
+      }
+      std::this_thread::sleep_for(delay);
+    }
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, scheduling retries without blocking a thread
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed with the last attempt's operation
+   * 
+   * @return HTTP operation container of the first attempt
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    std::string budgetKey = mState->GetBudgetKey(*request);
+    std::chrono::milliseconds blockedFor = mState->budgets->GetBlockedFor(budgetKey);
+    if (blockedFor.count() > 0) {
+      mState->budgets->Report(RetryEvent{RetryEventType::Throttled, budgetKey, 0, 0, blockedFor});
+      State::ThrowIfBlockedPastDeadline(*request, blockedFor, GetDeadline(context));
+      State::Schedule(mState, request, context, callbackFn, budgetKey, 1, blockedFor);
+      return std::make_shared<retryhttp::PlaceholderOperation>(request->GetId());
+    }
+    return State::Attempt(mState, request, context, callbackFn, budgetKey, 1);
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation, including its scheduled retries
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override {
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      mState->cancelledIds.insert(requestId);
+    }
+    mState->transport->CancelOperation(requestId);
+  }
+
+  /**
+   * @brief Cancel every HTTP operation. Scheduled retries are still sent once.
+   */
+  void CancelAllOperations() override { mState->transport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Scheduled retries can outlive the delegate, so everything they need is kept in shared state
+  struct State {
+    std::shared_ptr<HttpDelegate> transport;
+    std::shared_ptr<ThrottleBudgets> budgets;
+    RetryPolicy policy;
+    std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+    std::function<std::string(const HttpRequest&)> getTenant;
+    std::mutex mutex;
+    std::set<std::string> cancelledIds;
+
+    std::string GetBudgetKey(const HttpRequest& request) const {
+      const std::string& url = request.GetUrl();
+      size_t schemeEnd = url.find("://");
+      size_t hostEnd = url.find_first_of("/?#", schemeEnd == std::string::npos ? 0 : schemeEnd + 3);
+      std::string key = url.substr(0, hostEnd);
+      if (getTenant) {
+        key += " " + getTenant(request);
+      }
+      return key;
+    }
+
+    bool IsCancelled(const std::string& requestId) {
+      std::lock_guard<std::mutex> lock(mutex);
+      return cancelledIds.count(requestId) != 0;
+    }
+
+    void Forget(const std::string& requestId) {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelledIds.erase(requestId);
+    }
+
+    static std::chrono::milliseconds GetRetryAfter(const HttpResponse& response) {
+      auto header = response.GetHeaders().find("Retry-After");
+      if (header == response.GetHeaders().end()) {
+        return std::chrono::milliseconds(-1);
+      }
+      // HTTP dates are not parsed; such a header falls back to the backoff
+      char* end = nullptr;
+      long seconds = std::strtol(header->second.c_str(), &end, 10);
+      return end && *end == '\0' && seconds >= 0 ? std::chrono::milliseconds(seconds * 1000) :
+          std::chrono::milliseconds(-1);
+    }
+
+    static void ThrowIfBlockedPastDeadline(const HttpRequest& request, std::chrono::milliseconds blockedFor,
+        std::chrono::steady_clock::time_point deadline) {
+      if (deadline != (std::chrono::steady_clock::time_point::max)() &&
+          std::chrono::steady_clock::now() + blockedFor >= deadline) {
+        throw OperationCancelledError("HTTP request was cancelled: Retry-After ends past its deadline",
+            {{"HttpRequest.Id", request.GetId()}, {"HttpRequest.Url", request.GetUrl()}});
+      }
+    }
+
+    // Decides whether to retry, reporting the decision, and computes the delay
+    bool ShouldRetry(
+        const std::string& budgetKey,
+        const std::shared_ptr<HttpOperation>& operation,
+        const std::exception_ptr& error,
+        int attempt,
+        std::chrono::steady_clock::time_point deadline,
+        std::chrono::milliseconds& delay) {
+      std::shared_ptr<HttpResponse> response = !error && operation ? operation->GetResponse() : nullptr;
+      int32_t statusCode = response ? response->GetStatusCode() : 0;
+      bool isRetryable = false;
+      if (error || !response) {
+        isRetryable = policy.isTransportFailureRetried && !(operation && operation->IsCancelled());
+      } else {
+        isRetryable = std::find(policy.retryableStatusCodes.begin(), policy.retryableStatusCodes.end(), statusCode) !=
+            policy.retryableStatusCodes.end();
+      }
+      if (!isRetryable) {
+        return false;
+      }
+
+      double backoff = static_cast<double>(policy.initialBackoff.count());
+      for (int i = 1; i < attempt; ++i) {
+        backoff *= policy.backoffMultiplier;
+      }
+      backoff = (std::min)(backoff, static_cast<double>(policy.maxBackoff.count()));
+      double jitter = (std::min)((std::max)(policy.jitter, 0.0), 1.0);
+      delay = std::chrono::milliseconds(static_cast<int64_t>(backoff * (1.0 - jitter * budgets->GetRandom())));
+      if (statusCode == 429 || statusCode == 503) {
+        std::chrono::milliseconds retryAfter = GetRetryAfter(*response);
+        if (retryAfter.count() >= 0) {
+          delay = (std::min)(retryAfter, policy.maxRetryAfter);
+          budgets->BlockUntil(budgetKey, std::chrono::steady_clock::now() + delay);
+        }
+        budgets->Report(RetryEvent{RetryEventType::Throttled, budgetKey, statusCode, attempt, delay});
+      }
+
+      if (attempt >= policy.maxAttempts) {
+        budgets->Report(RetryEvent{RetryEventType::Exhausted, budgetKey, statusCode, attempt, delay});
+        return false;
+      }
+      // Checked before the budget so that a retry that cannot finish in time spends no token
+      if (deadline != (std::chrono::steady_clock::time_point::max)() &&
+          std::chrono::steady_clock::now() + delay >= deadline) {
+        budgets->Report(RetryEvent{RetryEventType::DeadlineExceeded, budgetKey, statusCode, attempt, delay});
+        return false;
+      }
+      if (!budgets->TryAcquire(budgetKey)) {
+        budgets->Report(RetryEvent{RetryEventType::Dropped, budgetKey, statusCode, attempt, delay});
+        return false;
+      }
+      budgets->Report(RetryEvent{RetryEventType::Retried, budgetKey, statusCode, attempt, delay});
+      return true;
+    }
+
+    static std::shared_ptr<HttpOperation> Attempt(
+        const std::shared_ptr<State>& state,
+        const std::shared_ptr<HttpRequest>& request,
+        const std::shared_ptr<void>& context,
+        const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn,
+        const std::string& budgetKey,
+        int attempt) {
+      auto onComplete = [state, request, context, callbackFn, budgetKey, attempt](
+          std::shared_ptr<HttpOperation> operation) {
+        std::chrono::milliseconds delay;
+        if (!state->IsCancelled(request->GetId()) &&
+            state->ShouldRetry(budgetKey, operation, nullptr, attempt, GetDeadline(context), delay)) {
+          Schedule(state, request, context, callbackFn, budgetKey, attempt + 1, delay);
+          return;
+        }
+        state->Forget(request->GetId());
+        if (callbackFn) {
+          callbackFn(operation);
+        }
+      };
+      try {
+        return state->transport->SendAsync(request, context, onComplete);
+      } catch (...) {
+        std::chrono::milliseconds delay;
+        if (attempt == 1 || state->IsCancelled(request->GetId()) ||
+            !state->ShouldRetry(budgetKey, nullptr, std::current_exception(), attempt, GetDeadline(context), delay)) {
+          state->Forget(request->GetId());
+          if (attempt == 1) {
+            throw;
+          }
+          auto failed = std::make_shared<retryhttp::PlaceholderOperation>(request->GetId());
+          if (callbackFn) {
+            callbackFn(failed);
+          }
+          return failed;
+        }
+        Schedule(state, request, context, callbackFn, budgetKey, attempt + 1, delay);
+        return std::make_shared<retryhttp::PlaceholderOperation>(request->GetId());
+      }
+    }
+
+    static void Schedule(
+        const std::shared_ptr<State>& state,
+        const std::shared_ptr<HttpRequest>& request,
+        const std::shared_ptr<void>& context,
+        const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn,
+        const std::string& budgetKey,
+        int attempt,
+        std::chrono::milliseconds delay) {
+      auto retry = [state, request, context, callbackFn, budgetKey, attempt]() {
+        try {
+          Attempt(state, request, context, callbackFn, budgetKey, attempt);
+        } catch (...) {
+          if (callbackFn) {
+            callbackFn(std::make_shared<retryhttp::PlaceholderOperation>(request->GetId()));
+          }
+        }
+      };
+      if (state->taskDispatcher) {
+        static std::atomic<uint64_t> sTaskCounter(0);
+        std::string taskId = "mip-http-retry-" + std::to_string(++sTaskCounter);
+        auto workStealing = std::dynamic_pointer_cast<WorkStealingTaskDispatcher>(state->taskDispatcher);
+        if (workStealing) {
+          workStealing->DispatchTaskAfter(taskId, retry, delay);
+        } else {
+          state->taskDispatcher->DispatchTask(taskId, retry, (delay.count() + 999) / 1000);
+        }
+      } else {
+        std::thread([retry, delay]() {
+          std::this_thread::sleep_for(delay);
+          retry();
+        }).detach();
+      }
+    }
+  };
+
+  std::shared_ptr<State> mState;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_RETRY_HTTP_DELEGATE_H_
@@ -0,0 +1,670 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines SdkMetricsRegistry, a pull-based registry of counters, gauges and histograms describing the SDK,
+ *        and the collectors feeding it
+ * 
+ * @file sdk_metrics.h
+ */
+
+#ifndef API_MIP_SDK_METRICS_H_
+#define API_MIP_SDK_METRICS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/caching_http_delegate.h"
+#include "mip/elastic_thread_pool.h"
+#include "mip/error.h"
+#include "mip/http_metrics_delegate.h"
+#include "mip/indexed_storage_delegate.h"
+#include "mip/metrics_delegate.h"
+#include "mip/mip_namespace.h"
+#include "mip/work_stealing_task_dispatcher.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Kind of an SdkMetricSample
+ */
+enum class SdkMetricType : unsigned int {
+  Counter   = 0, /**< Monotonic total */
+  Gauge     = 1, /**< Current value */
+  Histogram = 2, /**< Distribution of recorded values */
+};
+
+/**
+ * @brief Labels of a metric, e.g. {"operation", "policy"}
+ */
+using SdkMetricLabels = std::map<std::string, std::string>;
+
+/**
+ * @brief Value of one metric at collection time
+ */
+struct SdkMetricSample {
+  std::string name;                                  /**< Metric name, e.g. "mip_http_requests_total" */
+  SdkMetricLabels labels;                            /**< Labels telling samples of the same name apart */
+  SdkMetricType type = SdkMetricType::Counter;       /**< Kind of metric */
+  double value = 0;                                  /**< Value of a counter or gauge */
+  std::vector<std::pair<double, uint64_t>> buckets;  /**< Histogram upper bounds and cumulative counts, ascending */
+  uint64_t count = 0;                                /**< Values recorded by a histogram */
+  double sum = 0;                                    /**< Sum of the values recorded by a histogram */
+};
+
+/**
+ * @brief Monotonic counter owned by an SdkMetricsRegistry
+ */
+class SdkCounter {
+public:
+  /**
+   * @brief Adds to the counter
+   */
+  void Add(uint64_t value = 1) { mValue.fetch_add(value, std::memory_order_relaxed); }
+
+  /**
+   * @brief Get the total
+   */
+  uint64_t Get() const { return mValue.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> mValue{0};
+};
+
+/**
+ * @brief Histogram with fixed bucket bounds owned by an SdkMetricsRegistry
+ */
+class SdkHistogram {
+public:
+  /**
+   * @brief Creates a histogram
+   * 
+   * @param bounds Upper bounds of the buckets, inclusive; values above the last one go to an implicit +Inf bucket
+   */
+  explicit SdkHistogram(std::vector<double> bounds)
+      : mBounds(std::move(bounds)),
+        mCounts(new std::atomic<uint64_t>[mBounds.size() + 1]) {
+    std::sort(mBounds.begin(), mBounds.end());
+    for (size_t i = 0; i <= mBounds.size(); ++i) {
+      mCounts[i].store(0);
+    }
+  }
+
+  /**
+   * @brief Records a value
+   */
+  void Record(double value) {
+    size_t index = static_cast<size_t>(std::lower_bound(mBounds.begin(), mBounds.end(), value) - mBounds.begin());
+    mCounts[index].fetch_add(1, std::memory_order_relaxed);
+    uint64_t expected = mSumBits.load(std::memory_order_relaxed);
+    for (;;) {
+      double sum = 0;
+      std::memcpy(&sum, &expected, sizeof(sum));
+      sum += value;
+      uint64_t desired = 0;
+      std::memcpy(&desired, &sum, sizeof(desired));
+      if (mSumBits.compare_exchange_weak(expected, desired, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Fills the buckets, count and sum of a sample
+   */
+  void Fill(SdkMetricSample& sample) const {
+    sample.type = SdkMetricType::Histogram;
+    sample.buckets.clear();
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < mBounds.size(); ++i) {
+      cumulative += mCounts[i].load(std::memory_order_relaxed);
+      sample.buckets.emplace_back(mBounds[i], cumulative);
+    }
+    sample.count = cumulative + mCounts[mBounds.size()].load(std::memory_order_relaxed);
+    uint64_t bits = mSumBits.load(std::memory_order_relaxed);
+    std::memcpy(&sample.sum, &bits, sizeof(bits));
+  }
+
+  /**
+   * @brief Get bounds from 100 microseconds to about 100 seconds, in seconds, for durations
+   */
+  static std::vector<double> GetDurationBounds() {
+    std::vector<double> bounds;
+    for (double bound = 0.0001; bound < 200; bound *= 2) {
+      bounds.push_back(bound);
+    }
+    return bounds;
+  }
+
+private:
+  std::vector<double> mBounds;
+  std::unique_ptr<std::atomic<uint64_t>[]> mCounts;
+  std::atomic<uint64_t> mSumBits{0};
+};
+
+/**
+ * @brief Registry of the metrics describing an SDK instance, collected on demand
+ * 
+ * @note Keep one next to the MipContext and pass it to SdkMetricsDelegate and the Add...Metrics collectors below.
+ *       Collect returns a snapshot to export, for example through FormatPrometheusText or an OpenTelemetry
+ *       asynchronous instrument callback. Thread-safe.
+ */
+class SdkMetricsRegistry {
+public:
+  /**
+   * @brief Get the counter of a name and labels, creating it if needed
+   * 
+   * @param name Metric name, ending in "_total" by convention
+   * @param labels Labels of the counter
+   * 
+   * @return The counter; keep it to avoid the lookup on every update
+   */
+  std::shared_ptr<SdkCounter> GetCounter(const std::string& name, const SdkMetricLabels& labels = SdkMetricLabels()) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& counter = mCounters[Key(name, labels)];
+    if (!counter) {
+      counter = std::make_shared<SdkCounter>();
+    }
+    return counter;
+  }
+
+  /**
+   * @brief Get the histogram of a name and labels, creating it if needed
+   * 
+   * @param name Metric name, ending in the unit by convention, e.g. "_seconds"
+   * @param labels Labels of the histogram
+   * @param bounds Bucket bounds used when the histogram is created
+   * 
+   * @return The histogram; keep it to avoid the lookup on every update
+   */
+  std::shared_ptr<SdkHistogram> GetHistogram(const std::string& name, const SdkMetricLabels& labels = SdkMetricLabels(),
+      const std::vector<double>& bounds = SdkHistogram::GetDurationBounds()) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& histogram = mHistograms[Key(name, labels)];
+    if (!histogram) {
+      histogram = std::make_shared<SdkHistogram>(bounds);
+    }
+    return histogram;
+  }
+
+  /**
+   * @brief Adds a function appending samples at each collection, for values owned elsewhere
+   * 
+   * @param collect Function appending the current samples, called by Collect on its thread
+   * 
+   * @return Id to pass to RemoveCollector
+   */
+  uint64_t AddCollector(const std::function<void(std::vector<SdkMetricSample>&)>& collect) {
+    if (!collect) {
+      throw BadInputError("SdkMetricsRegistry::AddCollector requires a function");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint64_t id = ++mLastCollectorId;
+    mCollectors[id] = collect;
+    return id;
+  }
+
+  /**
+   * @brief Removes a collector
+   * 
+   * @param id Id returned by AddCollector
+   */
+  void RemoveCollector(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCollectors.erase(id);
+  }
+
+  /**
+   * @brief Get the current value of every metric
+   * 
+   * @return Samples of the counters and histograms of the registry, then those of the collectors
+   */
+  std::vector<SdkMetricSample> Collect() const {
+    std::vector<SdkMetricSample> samples;
+    std::vector<std::function<void(std::vector<SdkMetricSample>&)>> collectors;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (const auto& counter : mCounters) {
+        SdkMetricSample sample;
+        sample.name = counter.first.first;
+        sample.labels = counter.first.second;
+        sample.value = static_cast<double>(counter.second->Get());
+        samples.push_back(std::move(sample));
+      }
+      for (const auto& histogram : mHistograms) {
+        SdkMetricSample sample;
+        sample.name = histogram.first.first;
+        sample.labels = histogram.first.second;
+        histogram.second->Fill(sample);
+        samples.push_back(std::move(sample));
+      }
+      for (const auto& collector : mCollectors) {
+        collectors.push_back(collector.second);
+      }
+    }
+    for (const auto& collector : collectors) {
+      collector(samples);
+    }
+    return samples;
+  }
+
+private:
+  using MetricKey = std::pair<std::string, SdkMetricLabels>;
+
+  static MetricKey Key(const std::string& name, const SdkMetricLabels& labels) { return MetricKey(name, labels); }
+
+  mutable std::mutex mMutex;
+  std::map<MetricKey, std::shared_ptr<SdkCounter>> mCounters;
+  std::map<MetricKey, std::shared_ptr<SdkHistogram>> mHistograms;
+  std::map<uint64_t, std::function<void(std::vector<SdkMetricSample>&)>> mCollectors;
+  uint64_t mLastCollectorId = 0;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace sdkmetrics {
+
+inline SdkMetricSample MakeSample(const std::string& name, SdkMetricType type, double value,
+    const SdkMetricLabels& labels = SdkMetricLabels()) {
+  SdkMetricSample sample;
+  sample.name = name;
+  sample.labels = labels;
+  sample.type = type;
+  sample.value = value;
+  return sample;
+}
+
+inline void AppendNumber(double value, std::string& out) {
+  char text[32];
+  int length = value == static_cast<double>(static_cast<int64_t>(value)) && value < 9e15 && value > -9e15 ?
+      std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(value)) :
+      std::snprintf(text, sizeof(text), "%.15g", value);
+  out.append(text, length > 0 ? static_cast<size_t>(length) : 0);
+}
+
+inline void AppendLabels(const SdkMetricLabels& labels, const char* extraName, const std::string& extraValue,
+    std::string& out) {
+  if (labels.empty() && !extraName) {
+    return;
+  }
+  out.push_back('{');
+  bool isFirst = true;
+  auto append = [&](const std::string& name, const std::string& value) {
+    if (!isFirst) {
+      out.push_back(',');
+    }
+    isFirst = false;
+    out.append(name);
+    out.append("=\"");
+    for (char c : value) {
+      if (c == '\\' || c == '"') {
+        out.push_back('\\');
+        out.push_back(c);
+      } else if (c == '\n') {
+        out.append("\\n");
+      } else {
+        out.push_back(c);
+      }
+    }
+    out.push_back('"');
+  };
+  for (const auto& label : labels) {
+    append(label.first, label.second);
+  }
+  if (extraName) {
+    append(extraName, extraValue);
+  }
+  out.push_back('}');
+}
+
+} // namespace sdkmetrics
+/** @endcond */
+
+/**
+ * @brief Formats samples in the Prometheus text exposition format
+ * 
+ * @param samples Samples, for example from SdkMetricsRegistry::Collect
+ * 
+ * @return Text to serve on a /metrics endpoint
+ */
+inline std::string FormatPrometheusText(const std::vector<SdkMetricSample>& samples) {
+  std::vector<const SdkMetricSample*> sorted;
+  for (const auto& sample : samples) {
+    sorted.push_back(&sample);
+  }
+  // Prometheus requires the samples of a name to be contiguous
+  std::stable_sort(sorted.begin(), sorted.end(), [](const SdkMetricSample* a, const SdkMetricSample* b) {
+    return a->name < b->name;
+  });
+  std::string out;
+  const std::string* lastName = nullptr;
+  for (auto sample : sorted) {
+    if (!lastName || *lastName != sample->name) {
+      static const char* kTypeNames[] = {"counter", "gauge", "histogram"};
+      out.append("# TYPE ").append(sample->name).push_back(' ');
+      out.append(kTypeNames[static_cast<unsigned int>(sample->type)]).push_back('\n');
+      lastName = &sample->name;
+    }
+    if (sample->type != SdkMetricType::Histogram) {
+      out.append(sample->name);
+      sdkmetrics::AppendLabels(sample->labels, nullptr, std::string(), out);
+      out.push_back(' ');
+      sdkmetrics::AppendNumber(sample->value, out);
+      out.push_back('\n');
+      continue;
+    }
+    for (const auto& bucket : sample->buckets) {
+      std::string bound;
+      sdkmetrics::AppendNumber(bucket.first, bound);
+      out.append(sample->name).append("_bucket");
+      sdkmetrics::AppendLabels(sample->labels, "le", bound, out);
+      out.push_back(' ');
+      sdkmetrics::AppendNumber(static_cast<double>(bucket.second), out);
+      out.push_back('\n');
+    }
+    out.append(sample->name).append("_bucket");
+    sdkmetrics::AppendLabels(sample->labels, "le", "+Inf", out);
+    out.push_back(' ');
+    sdkmetrics::AppendNumber(static_cast<double>(sample->count), out);
+    out.append("\n").append(sample->name).append("_sum");
+    sdkmetrics::AppendLabels(sample->labels, nullptr, std::string(), out);
+    out.push_back(' ');
+    sdkmetrics::AppendNumber(sample->sum, out);
+    out.append("\n").append(sample->name).append("_count");
+    sdkmetrics::AppendLabels(sample->labels, nullptr, std::string(), out);
+    out.push_back(' ');
+    sdkmetrics::AppendNumber(static_cast<double>(sample->count), out);
+    out.push_back('\n');
+  }
+  return out;
+}
+
+/**
+ * @brief MetricsDelegate recording FileStageTimer stages into an SdkMetricsRegistry
+ * 
+ * @note Records "mip_stage_duration_seconds" and "mip_stage_bytes_total" per operation and stage, plus
+ *       "mip_handlers_created_total" (each "Open"), "mip_bytes_decrypted_total" (output of "Decrypt") and
+ *       "mip_bytes_committed_total" (output of "Commit", encrypted when the file is protected).
+ */
+class SdkMetricsDelegate : public MetricsDelegate {
+public:
+  /**
+   * @brief Creates the delegate
+   * 
+   * @param registry Registry the stages are recorded into
+   */
+  explicit SdkMetricsDelegate(const std::shared_ptr<SdkMetricsRegistry>& registry)
+      : mRegistry(registry) {
+    if (!mRegistry) {
+      throw BadInputError("SdkMetricsDelegate requires a registry");
+    }
+    mHandlersCreated = mRegistry->GetCounter("mip_handlers_created_total");
+    mBytesDecrypted = mRegistry->GetCounter("mip_bytes_decrypted_total");
+    mBytesCommitted = mRegistry->GetCounter("mip_bytes_committed_total");
+  }
+
+  void OnStageCompleted(const StageMetric& metric) override {
+    Instruments& instruments = GetInstruments(metric.operation, metric.stage);
+    instruments.duration->Record(std::chrono::duration<double>(metric.duration).count());
+    if (metric.bytes > 0) {
+      instruments.bytes->Add(static_cast<uint64_t>(metric.bytes));
+    }
+    if (metric.operation != metric.stage) {
+      return;
+    }
+    if (metric.stage == "Open") {
+      mHandlersCreated->Add();
+    } else if (metric.stage == "Decrypt" && metric.bytes > 0) {
+      mBytesDecrypted->Add(static_cast<uint64_t>(metric.bytes));
+    } else if (metric.stage == "Commit" && metric.bytes > 0) {
+      mBytesCommitted->Add(static_cast<uint64_t>(metric.bytes));
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Instruments {
+    std::shared_ptr<SdkHistogram> duration;
+    std::shared_ptr<SdkCounter> bytes;
+  };
+
+  Instruments& GetInstruments(const std::string& operation, const std::string& stage) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& instruments = mInstruments[std::make_pair(operation, stage)];
+    if (!instruments.duration) {
+      SdkMetricLabels labels = {{"operation", operation}, {"stage", stage}};
+      instruments.duration = mRegistry->GetHistogram("mip_stage_duration_seconds", labels);
+      instruments.bytes = mRegistry->GetCounter("mip_stage_bytes_total", labels);
+    }
+    return instruments;
+  }
+
+  std::shared_ptr<SdkMetricsRegistry> mRegistry;
+  std::shared_ptr<SdkCounter> mHandlersCreated;
+  std::shared_ptr<SdkCounter> mBytesDecrypted;
+  std::shared_ptr<SdkCounter> mBytesCommitted;
+  std::mutex mMutex;
+  std::map<std::pair<std::string, std::string>, Instruments> mInstruments;
+  /** @endcond */
+};
+
+/**
+ * @brief Collects the HTTP metrics of a MeteredHttpDelegate, per logical operation
+ * 
+ * @param registry Registry to add the collector to
+ * @param httpMetrics Registry of the MeteredHttpDelegate, not kept alive by the collector
+ * 
+ * @return Collector id
+ * 
+ * @note Adds "mip_http_requests_total", "mip_http_retries_total", "mip_http_failures_total",
+ *       "mip_http_sent_bytes_total", "mip_http_received_bytes_total" and "mip_http_duration_seconds", labelled by
+ *       operation. Policy refreshes are the requests of operation "policy", license acquisitions those of
+ *       "licensing".
+ */
+inline uint64_t AddHttpMetrics(SdkMetricsRegistry& registry, const std::shared_ptr<HttpMetricsRegistry>& httpMetrics) {
+  std::weak_ptr<HttpMetricsRegistry> weakMetrics = httpMetrics;
+  return registry.AddCollector([weakMetrics](std::vector<SdkMetricSample>& samples) {
+    auto metrics = weakMetrics.lock();
+    if (!metrics) {
+      return;
+    }
+    for (const auto& operation : metrics->GetMetrics()) {
+      SdkMetricLabels labels = {{"operation", operation.operation}};
+      auto counter = [&](const char* name, uint64_t value) {
+        samples.push_back(sdkmetrics::MakeSample(name, SdkMetricType::Counter, static_cast<double>(value), labels));
+      };
+      counter("mip_http_requests_total", operation.requestCount);
+      counter("mip_http_retries_total", operation.retryCount);
+      counter("mip_http_failures_total", operation.failureCount);
+      counter("mip_http_sent_bytes_total", operation.bytesSent);
+      counter("mip_http_received_bytes_total", operation.bytesReceived);
+      SdkMetricSample latency = sdkmetrics::MakeSample("mip_http_duration_seconds", SdkMetricType::Histogram, 0,
+          labels);
+      uint64_t cumulative = 0;
+      for (const auto& bucket : operation.latency.GetBuckets()) {
+        cumulative += bucket.second;
+        latency.buckets.emplace_back(static_cast<double>(bucket.first) / 1e6, cumulative);
+      }
+      latency.count = operation.latency.GetCount();
+      latency.sum = static_cast<double>(operation.latency.GetMean().count()) / 1e6 * static_cast<double>(latency.count);
+      samples.push_back(std::move(latency));
+    }
+  });
+}
+
+/**
+ * @brief Collects the hit and miss counts of a CachingHttpDelegate
+ * 
+ * @param registry Registry to add the collector to
+ * @param cache Caching delegate, not kept alive by the collector
+ * @param cacheName Value of the "cache" label, e.g. "licensing"
+ * 
+ * @return Collector id
+ * 
+ * @note Adds "mip_http_cache_hits_total", "mip_http_cache_revalidations_total" and "mip_http_cache_misses_total".
+ */
+inline uint64_t AddCachingHttpMetrics(SdkMetricsRegistry& registry, const std::shared_ptr<CachingHttpDelegate>& cache,
+    const std::string& cacheName) {
+  std::weak_ptr<CachingHttpDelegate> weakCache = cache;
+  SdkMetricLabels labels = {{"cache", cacheName}};
+  return registry.AddCollector([weakCache, labels](std::vector<SdkMetricSample>& samples) {
+    auto cache = weakCache.lock();
+    if (!cache) {
+      return;
+    }
+    samples.push_back(sdkmetrics::MakeSample("mip_http_cache_hits_total", SdkMetricType::Counter,
+        static_cast<double>(cache->GetHitCount()), labels));
+    samples.push_back(sdkmetrics::MakeSample("mip_http_cache_revalidations_total", SdkMetricType::Counter,
+        static_cast<double>(cache->GetRevalidatedCount()), labels));
+    samples.push_back(sdkmetrics::MakeSample("mip_http_cache_misses_total", SdkMetricType::Counter,
+        static_cast<double>(cache->GetMissCount()), labels));
+  });
+}
+
+/** @cond DOXYGEN_HIDE */
+namespace sdkmetrics {
+
+inline void AppendThreadPoolSamples(const ElasticThreadPoolMetrics& metrics, const SdkMetricLabels& labels,
+    std::vector<SdkMetricSample>& samples) {
+  auto gauge = [&](const char* name, size_t value) {
+    samples.push_back(MakeSample(name, SdkMetricType::Gauge, static_cast<double>(value), labels));
+  };
+  gauge("mip_dispatcher_threads", metrics.threadCount);
+  gauge("mip_dispatcher_busy_threads", metrics.busyThreadCount);
+  gauge("mip_dispatcher_queued_tasks", metrics.queuedTaskCount);
+  samples.push_back(MakeSample("mip_dispatcher_executed_tasks_total", SdkMetricType::Counter,
+      static_cast<double>(metrics.executedTaskCount), labels));
+  samples.push_back(MakeSample("mip_dispatcher_saturated_total", SdkMetricType::Counter,
+      static_cast<double>(metrics.saturatedCount), labels));
+}
+
+} // namespace sdkmetrics
+/** @endcond */
+
+/**
+ * @brief Collects the thread and queue depth metrics of an ElasticThreadPool
+ * 
+ * @param registry Registry to add the collector to
+ * @param pool Thread pool, not kept alive by the collector
+ * @param dispatcherName Value of the "dispatcher" label
+ * 
+ * @return Collector id
+ */
+inline uint64_t AddThreadPoolMetrics(SdkMetricsRegistry& registry, const std::shared_ptr<ElasticThreadPool>& pool,
+    const std::string& dispatcherName) {
+  std::weak_ptr<ElasticThreadPool> weakPool = pool;
+  SdkMetricLabels labels = {{"dispatcher", dispatcherName}};
+  return registry.AddCollector([weakPool, labels](std::vector<SdkMetricSample>& samples) {
+    auto pool = weakPool.lock();
+    if (pool) {
+      sdkmetrics::AppendThreadPoolSamples(pool->GetMetrics(), labels, samples);
+    }
+  });
+}
+
+/**
+ * @brief Collects the metrics of a WorkStealingTaskDispatcher
+ * 
+ * @param registry Registry to add the collector to
+ * @param dispatcher Dispatcher, not kept alive by the collector
+ * @param dispatcherName Value of the "dispatcher" label
+ * 
+ * @return Collector id
+ * 
+ * @note The thread and queue gauges describe the threads running independent tasks; the workers are counted by
+ *       "mip_dispatcher_workers" and their tasks by "mip_dispatcher_worker_tasks_total" and
+ *       "mip_dispatcher_stolen_tasks_total".
+ */
+inline uint64_t AddDispatcherMetrics(SdkMetricsRegistry& registry,
+    const std::shared_ptr<WorkStealingTaskDispatcher>& dispatcher, const std::string& dispatcherName) {
+  std::weak_ptr<WorkStealingTaskDispatcher> weakDispatcher = dispatcher;
+  SdkMetricLabels labels = {{"dispatcher", dispatcherName}};
+  return registry.AddCollector([weakDispatcher, labels](std::vector<SdkMetricSample>& samples) {
+    auto dispatcher = weakDispatcher.lock();
+    if (!dispatcher) {
+      return;
+    }
+    samples.push_back(sdkmetrics::MakeSample("mip_dispatcher_workers", SdkMetricType::Gauge,
+        static_cast<double>(dispatcher->GetWorkerCount()), labels));
+    samples.push_back(sdkmetrics::MakeSample("mip_dispatcher_worker_tasks_total", SdkMetricType::Counter,
+        static_cast<double>(dispatcher->GetExecutedCount()), labels));
+    samples.push_back(sdkmetrics::MakeSample("mip_dispatcher_stolen_tasks_total", SdkMetricType::Counter,
+        static_cast<double>(dispatcher->GetStolenCount()), labels));
+    sdkmetrics::AppendThreadPoolSamples(dispatcher->GetIndependentThreadMetrics(), labels, samples);
+  });
+}
+
+/**
+ * @brief Collects the size of each table of an IndexedStorageDelegate
+ * 
+ * @param registry Registry to add the collector to
+ * @param storage Storage delegate, not kept alive by the collector
+ * 
+ * @return Collector id
+ * 
+ * @note Adds "mip_storage_table_rows", "mip_storage_table_file_bytes" and "mip_storage_table_live_bytes" labelled
+ *       by table file, and "mip_storage_expired_rows_total", "mip_storage_evicted_rows_total" and
+ *       "mip_storage_compactions_total".
+ */
+inline uint64_t AddIndexedStorageMetrics(SdkMetricsRegistry& registry,
+    const std::shared_ptr<IndexedStorageDelegate>& storage) {
+  std::weak_ptr<IndexedStorageDelegate> weakStorage = storage;
+  return registry.AddCollector([weakStorage](std::vector<SdkMetricSample>& samples) {
+    auto storage = weakStorage.lock();
+    if (!storage) {
+      return;
+    }
+    for (const auto& table : storage->GetTableMetrics()) {
+      SdkMetricLabels labels = {{"table", table.path}};
+      samples.push_back(sdkmetrics::MakeSample("mip_storage_table_rows", SdkMetricType::Gauge,
+          static_cast<double>(table.rowCount), labels));
+      samples.push_back(sdkmetrics::MakeSample("mip_storage_table_file_bytes", SdkMetricType::Gauge,
+          static_cast<double>(table.fileBytes), labels));
+      samples.push_back(sdkmetrics::MakeSample("mip_storage_table_live_bytes", SdkMetricType::Gauge,
+          static_cast<double>(table.liveBytes), labels));
+    }
+    IndexedStorageMetrics metrics = storage->GetMetrics();
+    samples.push_back(sdkmetrics::MakeSample("mip_storage_expired_rows_total", SdkMetricType::Counter,
+        static_cast<double>(metrics.expiredCount)));
+    samples.push_back(sdkmetrics::MakeSample("mip_storage_evicted_rows_total", SdkMetricType::Counter,
+        static_cast<double>(metrics.evictedCount)));
+    samples.push_back(sdkmetrics::MakeSample("mip_storage_compactions_total", SdkMetricType::Counter,
+        static_cast<double>(metrics.compactionCount)));
+  });
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_SDK_METRICS_H_
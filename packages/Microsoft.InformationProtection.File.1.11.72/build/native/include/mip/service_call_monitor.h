@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ServiceCallMonitor, which attributes HTTP requests to the API call that caused them
+ * 
+ * @file service_call_monitor.h
+ */
+
+#ifndef API_MIP_SERVICE_CALL_MONITOR_H_
+#define API_MIP_SERVICE_CALL_MONITOR_H_
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace servicecallmonitor {
+
+struct ScopeState {
+  std::atomic<size_t> requestCount{0};
+  bool isServiceCallAllowed = true;
+};
+
+struct MonitorState {
+  std::mutex mutex;
+  std::map<std::weak_ptr<void>, std::shared_ptr<ScopeState>, std::owner_less<std::weak_ptr<void>>> scopes;
+};
+
+} // namespace servicecallmonitor
+/** @endcond */
+
+/**
+ * @brief API calls made with the context of a scope are attributed to it
+ * 
+ * @note The context shares ownership with the scope but points at the caller's own context object, so delegates that
+ *       read the context see what the caller passed. The scope ends when this object is destroyed.
+ */
+class ServiceCallScope {
+public:
+  /**
+   * @brief Get the context to pass to the API call
+   * 
+   * @return Context
+   */
+  const std::shared_ptr<void>& GetContext() const { return mContext; }
+
+  /**
+   * @brief Get the number of HTTP requests made with the context so far
+   * 
+   * @return Request count
+   */
+  size_t GetRequestCount() const { return mState->requestCount; }
+
+  /** @cond DOXYGEN_HIDE */
+  ServiceCallScope(
+      const std::shared_ptr<servicecallmonitor::MonitorState>& monitor,
+      const std::shared_ptr<void>& context,
+      bool isServiceCallAllowed)
+      : mMonitor(monitor),
+        mOwner(std::make_shared<int>(0)),
+        mContext(mOwner, context.get()),
+        mState(std::make_shared<servicecallmonitor::ScopeState>()),
+        mCallerContext(context) {
+    mState->isServiceCallAllowed = isServiceCallAllowed;
+    std::lock_guard<std::mutex> lock(monitor->mutex);
+    monitor->scopes[mOwner] = mState;
+  }
+
+  ~ServiceCallScope() {
+    auto monitor = mMonitor.lock();
+    if (monitor) {
+      std::lock_guard<std::mutex> lock(monitor->mutex);
+      monitor->scopes.erase(mOwner);
+    }
+  }
+
+  ServiceCallScope(const ServiceCallScope&) = delete;
+  ServiceCallScope& operator=(const ServiceCallScope&) = delete;
+
+private:
+  std::weak_ptr<servicecallmonitor::MonitorState> mMonitor;
+  std::shared_ptr<void> mOwner;
+  std::shared_ptr<void> mContext;
+  std::shared_ptr<servicecallmonitor::ScopeState> mState;
+  std::shared_ptr<void> mCallerContext; // keeps the object mContext points at alive
+  /** @endcond */
+};
+
+/**
+ * @brief HttpDelegate decorator that counts, and can refuse, the requests of API calls made within a scope
+ * 
+ * @note Whether an SDK call reaches the service is decided inside the SDK. Wrapping the profile's HttpDelegate in a
+ *       monitor and passing a scope's context to the call tells the caller afterwards whether it did, and a scope
+ *       that disallows service calls makes any such request fail with a NetworkError of category Offline, so the
+ *       call either completes locally or fails fast. Requests with other contexts pass through untouched.
+ */
+class ServiceCallMonitor : public HttpDelegate {
+public:
+  /**
+   * @brief Wrap a transport
+   * 
+   * @param transport Delegate sending the requests
+   */
+  explicit ServiceCallMonitor(const std::shared_ptr<HttpDelegate>& transport)
+      : mTransport(transport),
+        mState(std::make_shared<servicecallmonitor::MonitorState>()) {
+    if (!mTransport) {
+      throw BadInputError("ServiceCallMonitor requires a transport HttpDelegate");
+    }
+  }
+
+  /**
+   * @brief Begin a scope
+   * 
+   * @param context Caller's context, forwarded to the application's delegates as usual
+   * @param isServiceCallAllowed Whether requests made within the scope are sent
+   * 
+   * @return Scope, whose context must be passed to the API calls to attribute
+   */
+  std::unique_ptr<ServiceCallScope> BeginScope(
+      const std::shared_ptr<void>& context = nullptr,
+      bool isServiceCallAllowed = true) {
+    return std::unique_ptr<ServiceCallScope>(new ServiceCallScope(mState, context, isServiceCallAllowed));
+  }
+
+  /**
+   * @brief Send HTTP request, counting it against its scope
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    Admit(*request, context);
+    return mTransport->Send(request, context);
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously, counting it against its scope
+   * 
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   * 
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    Admit(*request, context);
+    return mTransport->SendAsync(request, context, callbackFn);
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   * 
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mTransport->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mTransport->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  void Admit(const HttpRequest& request, const std::shared_ptr<void>& context) {
+    // A scope's context may point at nullptr, so it is matched by owner rather than by pointer
+    std::shared_ptr<servicecallmonitor::ScopeState> scope;
+    {
+      std::lock_guard<std::mutex> lock(mState->mutex);
+      if (mState->scopes.empty()) {
+        return;
+      }
+      auto found = mState->scopes.find(std::weak_ptr<void>(context));
+      if (found == mState->scopes.end()) {
+        return;
+      }
+      scope = found->second;
+    }
+    ++scope->requestCount;
+    if (!scope->isServiceCallAllowed) {
+      throw NetworkError(NetworkError::Category::Offline, request.GetUrl().substr(0, request.GetUrl().find('?')),
+          request.GetId(), 0, "Service calls are not allowed for this operation");
+    }
+  }
+
+  std::shared_ptr<HttpDelegate> mTransport;
+  std::shared_ptr<servicecallmonitor::MonitorState> mState;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_SERVICE_CALL_MONITOR_H_
@@ -0,0 +1,435 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines named shared memory regions and byte rings that move data between processes through them
+ *
+ * @file shared_memory_ring.h
+ */
+
+#ifndef API_MIP_SHARED_MEMORY_RING_H_
+#define API_MIP_SHARED_MEMORY_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A named block of memory shared between processes on the same machine.
+ *
+ * @note Backed by shm_open on POSIX systems and by a pagefile-backed file mapping on Windows. The creating process
+ *       owns the name: on POSIX systems it is unlinked when the creator's region is destroyed, while processes that
+ *       opened it keep their mapping.
+ */
+class SharedMemoryRegion {
+public:
+  /**
+   * @brief Create a new region
+   *
+   * @param name Region name, unique on the machine
+   * @param size Size (in bytes) of the region
+   *
+   * @return Region, filled with zeros
+   */
+  static std::shared_ptr<SharedMemoryRegion> Create(const std::string& name, size_t size) {
+    if (size == 0) {
+      throw BadInputError("SharedMemoryRegion size must be positive");
+    }
+    std::shared_ptr<SharedMemoryRegion> region(new SharedMemoryRegion(name, true));
+#ifdef _WIN32
+    uint64_t size64 = static_cast<uint64_t>(size);
+    region->mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xFFFFFFFF), name.c_str());
+    if (region->mMapping == nullptr || GetLastError() == ERROR_ALREADY_EXISTS) {
+      throw FileIOError("Failed to create shared memory region: " + name);
+    }
+#else
+    region->mDescriptor = shm_open(PosixName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (region->mDescriptor < 0 || ftruncate(region->mDescriptor, static_cast<off_t>(size)) != 0) {
+      throw FileIOError("Failed to create shared memory region: " + name);
+    }
+#endif
+    region->Map(size);
+    return region;
+  }
+
+  /**
+   * @brief Open a region created by another process
+   *
+   * @param name Region name
+   *
+   * @return Region
+   */
+  static std::shared_ptr<SharedMemoryRegion> Open(const std::string& name) {
+    std::shared_ptr<SharedMemoryRegion> region(new SharedMemoryRegion(name, false));
+#ifdef _WIN32
+    region->mMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+    if (region->mMapping == nullptr) {
+      throw FileIOError("Failed to open shared memory region: " + name);
+    }
+    region->Map(0);
+#else
+    region->mDescriptor = shm_open(PosixName(name).c_str(), O_RDWR, 0600);
+    struct stat status;
+    if (region->mDescriptor < 0 || fstat(region->mDescriptor, &status) != 0 || status.st_size <= 0) {
+      throw FileIOError("Failed to open shared memory region: " + name);
+    }
+    region->Map(static_cast<size_t>(status.st_size));
+#endif
+    return region;
+  }
+
+  /**
+   * @brief Get the start of the region
+   *
+   * @return Pointer to the mapped memory
+   */
+  uint8_t* Data() const { return mData; }
+
+  /**
+   * @brief Get the size of the region
+   *
+   * @return Size (in bytes)
+   */
+  size_t Size() const { return mSize; }
+
+  /**
+   * @brief Get the region name
+   *
+   * @return Name
+   */
+  const std::string& GetName() const { return mName; }
+
+  /** @cond DOXYGEN_HIDE */
+  SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+  SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+  ~SharedMemoryRegion() {
+#ifdef _WIN32
+    if (mData != nullptr) {
+      UnmapViewOfFile(mData);
+    }
+    if (mMapping != nullptr) {
+      CloseHandle(mMapping);
+    }
+#else
+    if (mData != nullptr) {
+      munmap(mData, mSize);
+    }
+    if (mDescriptor >= 0) {
+      close(mDescriptor);
+    }
+    if (mIsOwner && mDescriptor >= 0) {
+      shm_unlink(PosixName(mName).c_str());
+    }
+#endif
+  }
+
+private:
+  SharedMemoryRegion(const std::string& name, bool isOwner) : mName(name), mIsOwner(isOwner) {}
+
+#ifndef _WIN32
+  static std::string PosixName(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+  }
+#endif
+
+  void Map(size_t size) {
+#ifdef _WIN32
+    mData = static_cast<uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if (mData == nullptr) {
+      throw FileIOError("Failed to map shared memory region: " + mName);
+    }
+    MEMORY_BASIC_INFORMATION info;
+    mSize = size != 0 ? size : (VirtualQuery(mData, &info, sizeof(info)) != 0 ? info.RegionSize : 0);
+#else
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mDescriptor, 0);
+    if (data == MAP_FAILED) {
+      throw FileIOError("Failed to map shared memory region: " + mName);
+    }
+    mData = static_cast<uint8_t*>(data);
+    mSize = size;
+#endif
+  }
+
+  std::string mName;
+  bool mIsOwner;
+  uint8_t* mData = nullptr;
+  size_t mSize = 0;
+#ifdef _WIN32
+  HANDLE mMapping = nullptr;
+#else
+  int mDescriptor = -1;
+#endif
+  /** @endcond */
+};
+
+/**
+ * @brief A byte ring laid out in shared memory, moving data from writers in one process to a reader in another.
+ *
+ * @note The ring holds two cache-line separated counters and a data area; no pointers are stored, so it can be
+ *       mapped at different addresses in each process. Data is copied once into the ring by the writer and once out
+ *       of it by the reader. Transfers larger than the ring stream through it as the reader drains it. A message is
+ *       written between BeginWrite/EndWrite (or a WriteLock), so concurrent writers in several processes do not
+ *       interleave; there must be a single reader. Waiting spins briefly and then sleeps with backoff, since
+ *       portable cross-process condition variables do not exist.
+ */
+class SharedMemoryRing {
+public:
+  /**
+   * @brief Get the memory needed for a ring
+   *
+   * @param capacity Size (in bytes) of the data area
+   *
+   * @return Size (in bytes) to reserve in the shared region
+   */
+  static size_t GetRequiredSize(size_t capacity) { return sizeof(Header) + capacity; }
+
+  /**
+   * @brief SharedMemoryRing constructor
+   *
+   * @param memory Start of the ring inside a shared region, aligned to 64 bytes
+   * @param size Size (in bytes) of the memory reserved for the ring, as returned by GetRequiredSize
+   * @param initialize Whether to initialize the ring. Only the process that created the region does so.
+   * @param timeout Longest time a read or write waits for the other side
+   */
+  SharedMemoryRing(
+      uint8_t* memory,
+      size_t size,
+      bool initialize,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(30000))
+      : mHeader(reinterpret_cast<Header*>(memory)),
+        mData(memory + sizeof(Header)),
+        mTimeout(timeout) {
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(long long) == sizeof(uint64_t),
+        "Shared memory counters must be lock free");
+    if (memory == nullptr || size <= sizeof(Header) || reinterpret_cast<uintptr_t>(memory) % 64 != 0) {
+      throw BadInputError("SharedMemoryRing requires aligned memory larger than its header");
+    }
+    if (initialize) {
+      new (mHeader) Header();
+      mHeader->capacity = size - sizeof(Header);
+    } else if (mHeader->capacity != size - sizeof(Header)) {
+      throw BadInputError("SharedMemoryRing layout does not match the shared region");
+    }
+  }
+
+  /**
+   * @brief Write bytes, waiting for room as needed
+   *
+   * @param buffer Bytes to write
+   * @param length Number of bytes
+   *
+   * @note A mip::FileIOError is thrown if the ring is closed or the reader does not make room in time.
+   */
+  void Write(const uint8_t* buffer, size_t length) {
+    const uint64_t capacity = mHeader->capacity;
+    while (length > 0) {
+      uint64_t head = mHeader->head.load(std::memory_order_relaxed);
+      uint64_t tail = 0;
+      Wait([&] { tail = mHeader->tail.load(std::memory_order_acquire); return head - tail < capacity; }, "write");
+      size_t chunk = static_cast<size_t>((std::min)(static_cast<uint64_t>(length), capacity - (head - tail)));
+      CopyIn(head % capacity, buffer, chunk);
+      mHeader->head.store(head + chunk, std::memory_order_release);
+      buffer += chunk;
+      length -= chunk;
+    }
+  }
+
+  /**
+   * @brief Read exactly the given number of bytes, waiting for them as needed
+   *
+   * @param buffer Buffer receiving the bytes
+   * @param length Number of bytes
+   *
+   * @note A mip::FileIOError is thrown if the ring is closed or the writer does not provide the bytes in time.
+   */
+  void Read(uint8_t* buffer, size_t length) {
+    const uint64_t capacity = mHeader->capacity;
+    while (length > 0) {
+      uint64_t tail = mHeader->tail.load(std::memory_order_relaxed);
+      uint64_t head = 0;
+      Wait([&] { head = mHeader->head.load(std::memory_order_acquire); return head != tail; }, "read");
+      size_t chunk = static_cast<size_t>((std::min)(static_cast<uint64_t>(length), head - tail));
+      CopyOut(tail % capacity, buffer, chunk);
+      mHeader->tail.store(tail + chunk, std::memory_order_release);
+      buffer += chunk;
+      length -= chunk;
+    }
+  }
+
+  /**
+   * @brief Wait until data is available to read
+   *
+   * @param timeout Longest time to wait
+   *
+   * @return true if data is available, false if the wait timed out
+   *
+   * @note A mip::FileIOError is thrown if the ring is closed.
+   */
+  bool WaitReadable(std::chrono::milliseconds timeout) {
+    try {
+      uint64_t tail = mHeader->tail.load(std::memory_order_relaxed);
+      Wait([&] { return mHeader->head.load(std::memory_order_acquire) != tail; }, "read", timeout);
+      return true;
+    } catch (const FileIOError&) {
+      if (IsClosed()) {
+        throw;
+      }
+      return false;
+    }
+  }
+
+  /**
+   * @brief Take the writer lock so that a multi-part message is not interleaved with other writers
+   */
+  void BeginWrite() {
+    Wait([this] {
+      uint32_t expected = 0;
+      return mHeader->writerLock.compare_exchange_weak(expected, 1, std::memory_order_acquire);
+    }, "lock");
+  }
+
+  /**
+   * @brief Release the writer lock
+   */
+  void EndWrite() { mHeader->writerLock.store(0, std::memory_order_release); }
+
+  /**
+   * @brief Close the ring. Waiting and later reads and writes on both sides fail.
+   */
+  void Close() { mHeader->isClosed.store(1, std::memory_order_release); }
+
+  /**
+   * @brief Whether the ring was closed by either side
+   *
+   * @return true if closed
+   */
+  bool IsClosed() const { return mHeader->isClosed.load(std::memory_order_acquire) != 0; }
+
+  /**
+   * @brief Get the size of the data area
+   *
+   * @return Capacity (in bytes)
+   */
+  size_t GetCapacity() const { return static_cast<size_t>(mHeader->capacity); }
+
+  /**
+   * @brief Holds the writer lock of a ring for one message
+   */
+  class WriteLock {
+  public:
+    /** @brief Take the writer lock */
+    explicit WriteLock(SharedMemoryRing& ring) : mRing(ring) { mRing.BeginWrite(); }
+    /** @brief Release the writer lock */
+    ~WriteLock() { mRing.EndWrite(); }
+    /** @cond DOXYGEN_HIDE */
+    WriteLock(const WriteLock&) = delete;
+    WriteLock& operator=(const WriteLock&) = delete;
+
+  private:
+    SharedMemoryRing& mRing;
+    /** @endcond */
+  };
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct alignas(64) Header {
+    std::atomic<uint64_t> head{0};
+    char headPadding[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail{0};
+    char tailPadding[64 - sizeof(std::atomic<uint64_t>)];
+    uint64_t capacity = 0;
+    std::atomic<uint32_t> writerLock{0};
+    std::atomic<uint32_t> isClosed{0};
+  };
+
+  void CopyIn(uint64_t offset, const uint8_t* buffer, size_t length) {
+    size_t first = (std::min)(length, static_cast<size_t>(mHeader->capacity - offset));
+    std::memcpy(mData + offset, buffer, first);
+    std::memcpy(mData, buffer + first, length - first);
+  }
+
+  void CopyOut(uint64_t offset, uint8_t* buffer, size_t length) {
+    size_t first = (std::min)(length, static_cast<size_t>(mHeader->capacity - offset));
+    std::memcpy(buffer, mData + offset, first);
+    std::memcpy(buffer + first, mData, length - first);
+  }
+
+  template <typename TCondition>
+  void Wait(TCondition isReady, const char* operation) {
+    Wait(isReady, operation, mTimeout);
+  }
+
+  template <typename TCondition>
+  void Wait(TCondition isReady, const char* operation, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::chrono::microseconds sleep(1);
+    for (int spin = 0; !isReady(); ++spin) {
+      if (IsClosed()) {
+        throw FileIOError(std::string("SharedMemoryRing is closed, cannot ") + operation);
+      }
+      if (spin < 64) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        throw FileIOError(std::string("SharedMemoryRing timed out waiting to ") + operation);
+      }
+      std::this_thread::sleep_for(sleep);
+      sleep = (std::min)(sleep * 2, std::chrono::microseconds(1000));
+    }
+  }
+
+  Header* mHeader;
+  uint8_t* mData;
+  std::chrono::milliseconds mTimeout;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_SHARED_MEMORY_RING_H_
@@ -0,0 +1,475 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines SharedResourcePool, which lets several MipContexts in a process share connections, threads and caches
+ * 
+ * @file shared_resource_pool.h
+ */
+
+#ifndef API_MIP_SHARED_RESOURCE_POOL_H_
+#define API_MIP_SHARED_RESOURCE_POOL_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace sharedresourcepool {
+
+struct Cache {
+  std::type_index type;
+  std::shared_ptr<void> instance;
+};
+
+template <typename T>
+std::shared_ptr<T> GetOrCreate(
+    std::map<std::string, Cache>& caches,
+    const std::string& name,
+    const std::function<std::shared_ptr<T>()>& factory) {
+  auto existing = caches.find(name);
+  if (existing != caches.end()) {
+    if (existing->second.type != std::type_index(typeid(T))) {
+      throw BadInputError("Shared cache " + name + " was created with a different type");
+    }
+    return std::static_pointer_cast<T>(existing->second.instance);
+  }
+  std::shared_ptr<T> instance = factory ? factory() : nullptr;
+  if (!instance) {
+    throw BadInputError("Shared cache factory returned no cache for " + name);
+  }
+  caches.emplace(name, Cache{std::type_index(typeid(T)), instance});
+  return instance;
+}
+
+} // namespace sharedresourcepool
+
+/**
+ * @brief Application's view of the pool's HttpDelegate, which can only cancel the requests the application sent
+ */
+class ApplicationHttpDelegate final : public HttpDelegate {
+public:
+  ApplicationHttpDelegate(const std::shared_ptr<HttpDelegate>& httpDelegate, const std::string& applicationId)
+      : mHttpDelegate(httpDelegate),
+        mApplicationId(applicationId),
+        mState(std::make_shared<State>()) {}
+
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    std::string requestId = request->GetId();
+    mState->Add(requestId);
+    try {
+      auto operation = mHttpDelegate->Send(request, context);
+      mState->Remove(requestId);
+      return operation;
+    } catch (...) {
+      mState->Remove(requestId);
+      throw;
+    }
+  }
+
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    std::string requestId = request->GetId();
+    mState->Add(requestId);
+    std::weak_ptr<State> weakState = mState;
+    try {
+      return mHttpDelegate->SendAsync(request, context,
+          [weakState, requestId, callbackFn](std::shared_ptr<HttpOperation> operation) {
+            if (auto state = weakState.lock()) {
+              state->Remove(requestId);
+            }
+            if (callbackFn) {
+              callbackFn(operation);
+            }
+          });
+    } catch (...) {
+      mState->Remove(requestId);
+      throw;
+    }
+  }
+
+  void CancelOperation(const std::string& requestId) override {
+    if (mState->Contains(requestId)) {
+      mHttpDelegate->CancelOperation(requestId);
+    }
+  }
+
+  void CancelAllOperations() override {
+    for (const auto& requestId : mState->GetAll()) {
+      mHttpDelegate->CancelOperation(requestId);
+    }
+  }
+
+  const std::string& GetApplicationId() const { return mApplicationId; }
+
+private:
+  class State {
+  public:
+    void Add(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIds.insert(id);
+    }
+    void Remove(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIds.erase(id);
+    }
+    bool Contains(const std::string& id) const {
+      std::lock_guard<std::mutex> lock(mMutex);
+      return mIds.count(id) != 0;
+    }
+    std::vector<std::string> GetAll() const {
+      std::lock_guard<std::mutex> lock(mMutex);
+      return std::vector<std::string>(mIds.begin(), mIds.end());
+    }
+
+  private:
+    mutable std::mutex mMutex;
+    std::unordered_set<std::string> mIds;
+  };
+
+  std::shared_ptr<HttpDelegate> mHttpDelegate;
+  std::string mApplicationId;
+  std::shared_ptr<State> mState;
+};
+
+/**
+ * @brief Application's view of the pool's TaskDispatcherDelegate, which can only cancel the tasks the application
+ *        dispatched
+ * 
+ * @note Task IDs are prefixed with the application ID before they reach the shared dispatcher, so two applications
+ *       using the same task ID do not collide.
+ */
+class ApplicationTaskDispatcherDelegate final : public TaskDispatcherDelegate {
+public:
+  ApplicationTaskDispatcherDelegate(
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher,
+      const std::string& applicationId)
+      : mTaskDispatcher(taskDispatcher),
+        mApplicationId(applicationId),
+        mState(std::make_shared<State>()) {}
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    mTaskDispatcher->DispatchTask(Track(taskId), Wrap(taskId, std::move(task)));
+  }
+
+  void DispatchTask(
+      const std::string& taskId,
+      std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mTaskDispatcher->DispatchTask(Track(taskId), Wrap(taskId, std::move(task)), loggerContext);
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    mTaskDispatcher->DispatchTask(Track(taskId), Wrap(taskId, std::move(task)), delaySeconds);
+  }
+
+  void DispatchTask(
+      const std::string& taskId,
+      std::function<void()> task,
+      int64_t delaySeconds,
+      const std::shared_ptr<void>& loggerContext) override {
+    mTaskDispatcher->DispatchTask(Track(taskId), Wrap(taskId, std::move(task)), delaySeconds, loggerContext);
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    mTaskDispatcher->ExecuteTaskOnIndependentThread(Track(taskId), Wrap(taskId, std::move(task)));
+  }
+
+  void ExecuteTaskOnIndependentThread(
+      const std::string& taskId,
+      std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mTaskDispatcher->ExecuteTaskOnIndependentThread(Track(taskId), Wrap(taskId, std::move(task)), loggerContext);
+  }
+
+  bool CancelTask(const std::string& taskId) override {
+    if (!mState->Remove(taskId)) {
+      return false;
+    }
+    return mTaskDispatcher->CancelTask(GetSharedTaskId(taskId));
+  }
+
+  bool CancelTask(const std::string& taskId, const std::shared_ptr<void>& loggerContext) override {
+    if (!mState->Remove(taskId)) {
+      return false;
+    }
+    return mTaskDispatcher->CancelTask(GetSharedTaskId(taskId), loggerContext);
+  }
+
+  void CancelAllTasks() override {
+    for (const auto& taskId : mState->RemoveAll()) {
+      mTaskDispatcher->CancelTask(GetSharedTaskId(taskId));
+    }
+  }
+
+  const std::string& GetApplicationId() const { return mApplicationId; }
+
+private:
+  class State {
+  public:
+    void Add(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      ++mIds[id];
+    }
+    bool Remove(const std::string& id) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto existing = mIds.find(id);
+      if (existing == mIds.end()) {
+        return false;
+      }
+      if (--existing->second == 0) {
+        mIds.erase(existing);
+      }
+      return true;
+    }
+    std::vector<std::string> RemoveAll() {
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::vector<std::string> ids;
+      ids.reserve(mIds.size());
+      for (const auto& id : mIds) {
+        ids.push_back(id.first);
+      }
+      mIds.clear();
+      return ids;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::unordered_map<std::string, size_t> mIds;
+  };
+
+  std::string GetSharedTaskId(const std::string& taskId) const { return mApplicationId + "/" + taskId; }
+
+  std::string Track(const std::string& taskId) {
+    mState->Add(taskId);
+    return GetSharedTaskId(taskId);
+  }
+
+  std::function<void()> Wrap(const std::string& taskId, std::function<void()> task) {
+    std::weak_ptr<State> weakState = mState;
+    return [weakState, taskId, task]() {
+      if (auto state = weakState.lock()) {
+        state->Remove(taskId);
+      }
+      task();
+    };
+  }
+
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  std::string mApplicationId;
+  std::shared_ptr<State> mState;
+};
+/** @endcond */
+
+/**
+ * @brief Connections, threads and caches shared by the MipContexts of a process
+ * 
+ * @note Create one pool per process and pass the delegates returned by GetHttpDelegate and GetTaskDispatcherDelegate
+ *       to the profile settings of every application, instead of one transport and dispatcher per MipContext. Each
+ *       application gets its own view, keyed by ApplicationInfo::applicationId: the requests and tasks of all
+ *       applications share one connection pool and one set of threads, but an application can only cancel its own.
+ *       Caches come in two kinds. GetSharedCache returns one cache for every application and is meant for
+ *       content-addressed data that holds nothing user- or application-specific, such as SensitivityTypesCache,
+ *       whose rule packages are keyed by their content ID. GetApplicationCache returns a cache private to one
+ *       application and is meant for anything derived from an identity, such as templates or licenses.
+ */
+class SharedResourcePool {
+public:
+  /**
+   * @brief SharedResourcePool constructor
+   * 
+   * @param httpDelegate Transport shared by all applications, for example a PooledHttpDelegate
+   * @param taskDispatcher Dispatcher shared by all applications, may be null to leave dispatching to each MipContext
+   */
+  SharedResourcePool(
+      const std::shared_ptr<HttpDelegate>& httpDelegate,
+      const std::shared_ptr<TaskDispatcherDelegate>& taskDispatcher)
+      : mHttpDelegate(httpDelegate),
+        mTaskDispatcher(taskDispatcher) {
+    if (!mHttpDelegate) {
+      throw BadInputError("SharedResourcePool requires an HTTP delegate");
+    }
+  }
+
+  /**
+   * @brief Get an application's view of the shared transport
+   * 
+   * @param appInfo Application
+   * 
+   * @return HttpDelegate to set in the application's profile settings. Repeated calls for the same application
+   *         return the same delegate.
+   */
+  std::shared_ptr<HttpDelegate> GetHttpDelegate(const ApplicationInfo& appInfo) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& application = GetApplicationLocked(appInfo);
+    if (!application.httpDelegate) {
+      application.httpDelegate = std::make_shared<ApplicationHttpDelegate>(mHttpDelegate, appInfo.applicationId);
+    }
+    return application.httpDelegate;
+  }
+
+  /**
+   * @brief Get an application's view of the shared dispatcher
+   * 
+   * @param appInfo Application
+   * 
+   * @return TaskDispatcherDelegate to set in the application's profile settings, or nullptr if the pool has no
+   *         dispatcher. Repeated calls for the same application return the same delegate.
+   */
+  std::shared_ptr<TaskDispatcherDelegate> GetTaskDispatcherDelegate(const ApplicationInfo& appInfo) {
+    if (!mTaskDispatcher) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& application = GetApplicationLocked(appInfo);
+    if (!application.taskDispatcher) {
+      application.taskDispatcher =
+          std::make_shared<ApplicationTaskDispatcherDelegate>(mTaskDispatcher, appInfo.applicationId);
+    }
+    return application.taskDispatcher;
+  }
+
+  /**
+   * @brief Get a cache shared by every application, creating it on first use
+   * 
+   * @param name Name of the cache
+   * @param factory Creates the cache if it does not exist yet
+   * 
+   * @return Cache
+   * 
+   * @note Only for content that is the same whoever asks for it. A BadInputError is thrown if a cache with this name
+   *       was created with another type.
+   */
+  template <typename T>
+  std::shared_ptr<T> GetSharedCache(const std::string& name, const std::function<std::shared_ptr<T>()>& factory) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return sharedresourcepool::GetOrCreate<T>(mSharedCaches, name, factory);
+  }
+
+  /**
+   * @brief Get a cache private to an application, creating it on first use
+   * 
+   * @param appInfo Application
+   * @param name Name of the cache
+   * @param factory Creates the cache if the application does not have one yet
+   * 
+   * @return Cache
+   */
+  template <typename T>
+  std::shared_ptr<T> GetApplicationCache(
+      const ApplicationInfo& appInfo,
+      const std::string& name,
+      const std::function<std::shared_ptr<T>()>& factory) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return sharedresourcepool::GetOrCreate<T>(GetApplicationLocked(appInfo).caches, name, factory);
+  }
+
+  /**
+   * @brief Forget an application, for example once its MipContext has shut down
+   * 
+   * @param applicationId Application ID
+   * 
+   * @note Cancels the application's outstanding requests and tasks and drops its private caches. Shared caches are
+   *       kept for the other applications.
+   */
+  void ReleaseApplication(const std::string& applicationId) {
+    Application application;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto existing = mApplications.find(applicationId);
+      if (existing == mApplications.end()) {
+        return;
+      }
+      application = std::move(existing->second);
+      mApplications.erase(existing);
+    }
+    if (application.httpDelegate) {
+      application.httpDelegate->CancelAllOperations();
+    }
+    if (application.taskDispatcher) {
+      application.taskDispatcher->CancelAllTasks();
+    }
+  }
+
+  /**
+   * @brief Get the IDs of the applications using the pool
+   * 
+   * @return Application IDs
+   */
+  std::vector<std::string> GetApplicationIds() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::string> applicationIds;
+    applicationIds.reserve(mApplications.size());
+    for (const auto& application : mApplications) {
+      applicationIds.push_back(application.first);
+    }
+    return applicationIds;
+  }
+
+private:
+  struct Application {
+    std::shared_ptr<ApplicationHttpDelegate> httpDelegate;
+    std::shared_ptr<ApplicationTaskDispatcherDelegate> taskDispatcher;
+    std::map<std::string, sharedresourcepool::Cache> caches;
+  };
+
+  Application& GetApplicationLocked(const ApplicationInfo& appInfo) {
+    if (appInfo.applicationId.empty()) {
+      throw BadInputError("SharedResourcePool requires an application ID");
+    }
+    return mApplications[appInfo.applicationId];
+  }
+
+  mutable std::mutex mMutex;
+  std::shared_ptr<HttpDelegate> mHttpDelegate;
+  std::shared_ptr<TaskDispatcherDelegate> mTaskDispatcher;
+  std::map<std::string, sharedresourcepool::Cache> mSharedCaches;
+  std::unordered_map<std::string, Application> mApplications;
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_SHARED_RESOURCE_POOL_H_
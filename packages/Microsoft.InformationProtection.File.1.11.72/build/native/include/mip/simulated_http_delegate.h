@@ -0,0 +1,427 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines an HttpDelegate that simulates service latency and failures in front of another delegate
+ *
+ * @file simulated_http_delegate.h
+ */
+
+#ifndef API_MIP_SIMULATED_HTTP_DELEGATE_H_
+#define API_MIP_SIMULATED_HTTP_DELEGATE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_fixture_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/timer_wheel.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Latency and failure behavior of a simulated service
+ *
+ * @note Simulated latency is added to the time the responder takes. Latency is drawn from latencyQuantiles if set,
+ *       else from baseLatency plus uniform jitter; slowRequestRate then replaces it with slowLatency for a fraction
+ *       of requests. When a 429 or 503 is injected, the next faultBurstLength - 1 requests of the same endpoint class
+ *       fail the same way, as a throttled or overloaded service would.
+ */
+struct SimulatedServiceProfile {
+  std::string endpointClass;                        /**< Requests sharing a class share fault bursts, e.g. "licensing" */
+  std::chrono::milliseconds baseLatency{20};        /**< Latency of every request */
+  std::chrono::milliseconds latencyJitter{10};      /**< Upper bound of uniformly distributed extra latency */
+  /** @brief Empirical latency distribution as (quantile, latency) points in ascending order, e.g. p50 and p99 */
+  std::vector<std::pair<double, std::chrono::milliseconds>> latencyQuantiles;
+  bool isRecordedLatencyReplayed = false;           /**< Add the latency recorded with HttpFixtureDelegate responses */
+  double slowRequestRate = 0.0;                     /**< Fraction of requests that take slowLatency instead */
+  std::chrono::milliseconds slowLatency{2000};      /**< Latency of slow requests, to model tail latency */
+  double slowBodyRate = 0.0;                        /**< Fraction of responses whose body trickles in */
+  int64_t slowBodyBytesPerSecond = 16 * 1024;       /**< Transfer rate of slow bodies */
+  double throttleRate = 0.0;                        /**< Fraction of requests answered 429 with Retry-After */
+  double serverErrorRate = 0.0;                     /**< Fraction of requests answered 503 */
+  int faultBurstLength = 1;                         /**< Consecutive requests of the class failing once a 429/503 hits */
+  double networkFailureRate = 0.0;                  /**< Fraction of requests that fail without reaching the service */
+  double connectionResetRate = 0.0;                 /**< Fraction of requests reset after the service handled them */
+};
+
+/**
+ * @brief Profile applied to the requests whose URL contains a fragment
+ */
+struct SimulatedEndpointRule {
+  std::string urlFragment;         /**< Text matched against the request URL, e.g. "/my/policy" */
+  SimulatedServiceProfile profile; /**< Profile of matching requests; its endpointClass defaults to urlFragment */
+};
+
+/**
+ * @brief Counters of a SimulatedHttpDelegate
+ */
+struct SimulatedServiceStatistics {
+  uint64_t requestCount = 0;        /**< Requests received */
+  uint64_t slowCount = 0;           /**< Requests given the slow latency */
+  uint64_t slowBodyCount = 0;       /**< Responses whose body trickled in */
+  uint64_t throttledCount = 0;      /**< Requests answered 429 */
+  uint64_t serverErrorCount = 0;    /**< Requests answered 503 */
+  uint64_t networkFailureCount = 0; /**< Requests failed without a response */
+  uint64_t connectionResetCount = 0; /**< Requests reset after the service handled them */
+};
+
+/**
+ * @brief HttpDelegate that delays requests and injects failures around a responder
+ *
+ * @note Intended for tuning timeouts, retries and concurrency limits: the responder is typically an
+ *       HttpFixtureDelegate replaying a recorded session, and the profiles shape it into a service with realistic
+ *       latency, tail and error behavior per endpoint class. With isRecordedLatencyReplayed and zero simulated
+ *       latency, the session replays with the latencies it was recorded with. Random choices come from one generator,
+ *       so a run with a fixed seed and a deterministic request order is reproducible. Synchronous sends sleep on the
+ *       calling thread, as a real transport would block it. Asynchronous sends wait on a TimerWheel and complete on
+ *       the given task dispatcher, or on the wheel's thread if none is given, so simulated latency does not hold a
+ *       thread per request. Failed asynchronous sends complete with an operation that has no response.
+ */
+class SimulatedHttpDelegate : public HttpDelegate {
+public:
+  /** @brief Chooses the profile of a request */
+  typedef std::function<SimulatedServiceProfile(const HttpRequest& request)> ProfileSelector;
+
+  /**
+   * @brief SimulatedHttpDelegate constructor
+   *
+   * @param responder Delegate producing the responses
+   * @param profile Profile of every request
+   * @param dispatcher Dispatcher completing asynchronous sends, or nullptr to complete them on the timer thread
+   */
+  SimulatedHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& responder,
+      const SimulatedServiceProfile& profile,
+      const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr)
+      : SimulatedHttpDelegate(responder, [profile](const HttpRequest&) { return profile; }, dispatcher) {}
+
+  /**
+   * @brief SimulatedHttpDelegate constructor
+   *
+   * @param responder Delegate producing the responses
+   * @param selector Chooses the profile of each request, e.g. from CreateEndpointSelector
+   * @param dispatcher Dispatcher completing asynchronous sends, or nullptr to complete them on the timer thread
+   */
+  SimulatedHttpDelegate(
+      const std::shared_ptr<HttpDelegate>& responder,
+      const ProfileSelector& selector,
+      const std::shared_ptr<TaskDispatcherDelegate>& dispatcher = nullptr)
+      : mResponder(responder),
+        mSelector(selector),
+        mDispatcher(dispatcher),
+        mRandom(std::random_device{}()) {
+    if (!mResponder || !mSelector) {
+      throw BadInputError("SimulatedHttpDelegate requires a responder and a profile");
+    }
+  }
+
+  /**
+   * @brief Create a selector choosing the profile of the first rule whose fragment the request URL contains
+   *
+   * @param rules Rules, in order of precedence
+   * @param defaultProfile Profile of requests matching no rule
+   *
+   * @return Profile selector
+   */
+  static ProfileSelector CreateEndpointSelector(
+      std::vector<SimulatedEndpointRule> rules,
+      const SimulatedServiceProfile& defaultProfile) {
+    for (SimulatedEndpointRule& rule : rules) {
+      if (rule.profile.endpointClass.empty()) {
+        rule.profile.endpointClass = rule.urlFragment;
+      }
+    }
+    return [rules, defaultProfile](const HttpRequest& request) {
+      const std::string& url = request.GetUrl();
+      for (const SimulatedEndpointRule& rule : rules) {
+        if (url.find(rule.urlFragment) != std::string::npos) {
+          return rule.profile;
+        }
+      }
+      return defaultProfile;
+    };
+  }
+
+  /**
+   * @brief Reseed the random choices, to make a run reproducible
+   *
+   * @param seed Seed
+   */
+  void SetSeed(uint64_t seed) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRandom.seed(seed);
+    mBursts.clear();
+  }
+
+  /**
+   * @brief Send HTTP request
+   *
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   *
+   * @return HTTP operation container
+   */
+  std::shared_ptr<HttpOperation> Send(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    Outcome outcome = Decide(*request);
+    if (outcome.fault == Fault::Network) {
+      std::this_thread::sleep_for(outcome.latency);
+      throw NetworkError(NetworkError::Category::NoConnection,
+          httpfixture::GetSanitizedUrl(request->GetUrl()), request->GetId(), 0, "Simulated network failure");
+    }
+    auto operation = outcome.fault == Fault::None ? mResponder->Send(request, context) : Synthesize(*request, outcome);
+    std::this_thread::sleep_for(outcome.latency + GetResponseDelay(outcome, operation));
+    if (outcome.isReset) {
+      throw NetworkError(NetworkError::Category::NoConnection,
+          httpfixture::GetSanitizedUrl(request->GetUrl()), request->GetId(), 0, "Simulated connection reset");
+    }
+    return operation;
+  }
+
+  /**
+   * @brief Send HTTP request asynchronously
+   *
+   * @param request HTTP request
+   * @param context The same context that was passed to the API call that resulted in this HTTP request
+   * @param callbackFn Function that will be executed on completion
+   *
+   * @return HTTP operation container, without a response until the callback runs
+   */
+  std::shared_ptr<HttpOperation> SendAsync(
+      const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    Outcome outcome = Decide(*request);
+    auto pending = std::make_shared<httpfixture::FixtureOperation>(request->GetId(), nullptr);
+    if (outcome.fault == Fault::Network) {
+      CompleteAfter(outcome.latency, pending, callbackFn);
+    } else if (outcome.fault != Fault::None) {
+      auto operation = Synthesize(*request, outcome);
+      CompleteAfter(outcome.latency + GetResponseDelay(outcome, operation), operation, callbackFn);
+    } else {
+      mResponder->SendAsync(request, context, [this, outcome, pending, callbackFn](
+          std::shared_ptr<HttpOperation> operation) {
+        auto delay = outcome.latency + GetResponseDelay(outcome, operation);
+        CompleteAfter(delay, outcome.isReset ? pending : operation, callbackFn);
+      });
+    }
+    return pending;
+  }
+
+  /**
+   * @brief Cancel a specific HTTP operation
+   *
+   * @param requestId ID of request to cancel
+   */
+  void CancelOperation(const std::string& requestId) override { mResponder->CancelOperation(requestId); }
+
+  /**
+   * @brief Cancel all HTTP operations
+   */
+  void CancelAllOperations() override { mResponder->CancelAllOperations(); }
+
+  /**
+   * @brief Get the request and failure counters
+   *
+   * @return Statistics
+   */
+  SimulatedServiceStatistics GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStatistics;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  enum class Fault { None, Throttled, ServerError, Network };
+
+  struct Outcome {
+    std::chrono::milliseconds latency;
+    Fault fault;
+    bool isReset;
+    bool isSlowBody;
+    bool isRecordedLatencyReplayed;
+    int64_t slowBodyBytesPerSecond;
+  };
+
+  struct Burst {
+    Fault fault = Fault::None;
+    int remaining = 0;
+  };
+
+  static std::chrono::milliseconds SampleQuantiles(
+      const std::vector<std::pair<double, std::chrono::milliseconds>>& quantiles,
+      double u) {
+    if (u <= quantiles.front().first) {
+      return quantiles.front().second;
+    }
+    for (size_t i = 1; i < quantiles.size(); ++i) {
+      if (u <= quantiles[i].first) {
+        const auto& low = quantiles[i - 1];
+        const auto& high = quantiles[i];
+        double fraction = (u - low.first) / (std::max)(high.first - low.first, 1e-9);
+        return low.second + std::chrono::milliseconds(static_cast<int64_t>(
+            fraction * static_cast<double>((high.second - low.second).count())));
+      }
+    }
+    return quantiles.back().second;
+  }
+
+  Outcome Decide(const HttpRequest& request) {
+    SimulatedServiceProfile profile = mSelector(request);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mStatistics.requestCount;
+
+    Outcome outcome{profile.baseLatency, Fault::None, false, false, profile.isRecordedLatencyReplayed,
+        (std::max)(profile.slowBodyBytesPerSecond, static_cast<int64_t>(1))};
+    if (uniform(mRandom) < profile.slowRequestRate) {
+      outcome.latency = profile.slowLatency;
+      ++mStatistics.slowCount;
+    } else if (!profile.latencyQuantiles.empty()) {
+      outcome.latency = SampleQuantiles(profile.latencyQuantiles, uniform(mRandom));
+    } else if (profile.latencyJitter.count() > 0) {
+      outcome.latency += std::chrono::milliseconds(static_cast<int64_t>(
+          uniform(mRandom) * static_cast<double>(profile.latencyJitter.count())));
+    }
+
+    Burst& burst = mBursts[profile.endpointClass];
+    double fault = uniform(mRandom);
+    if ((fault -= profile.networkFailureRate) < 0) {
+      outcome.fault = Fault::Network;
+    } else if (burst.remaining > 0) {
+      --burst.remaining;
+      outcome.fault = burst.fault;
+    } else if ((fault -= profile.throttleRate) < 0) {
+      outcome.fault = Fault::Throttled;
+    } else if ((fault -= profile.serverErrorRate) < 0) {
+      outcome.fault = Fault::ServerError;
+    } else if ((fault -= profile.connectionResetRate) < 0) {
+      outcome.isReset = true;
+      ++mStatistics.connectionResetCount;
+    }
+    if ((outcome.fault == Fault::Throttled || outcome.fault == Fault::ServerError) && burst.remaining == 0 &&
+        burst.fault == Fault::None) {
+      burst.fault = outcome.fault;
+      burst.remaining = profile.faultBurstLength - 1;
+    }
+    if (burst.remaining == 0) {
+      burst.fault = Fault::None;
+    }
+    if (outcome.fault == Fault::Network) {
+      ++mStatistics.networkFailureCount;
+    } else if (outcome.fault == Fault::Throttled) {
+      ++mStatistics.throttledCount;
+    } else if (outcome.fault == Fault::ServerError) {
+      ++mStatistics.serverErrorCount;
+    }
+    if (outcome.fault == Fault::None && uniform(mRandom) < profile.slowBodyRate) {
+      outcome.isSlowBody = true;
+      ++mStatistics.slowBodyCount;
+    }
+    return outcome;
+  }
+
+  // Extra time a response takes: its recorded service latency, and the transfer of a slow body
+  static std::chrono::milliseconds GetResponseDelay(
+      const Outcome& outcome,
+      const std::shared_ptr<HttpOperation>& operation) {
+    std::chrono::milliseconds delay(0);
+    auto response = operation ? operation->GetResponse() : nullptr;
+    if (!response) {
+      return delay;
+    }
+    if (outcome.isRecordedLatencyReplayed) {
+      auto fixture = std::dynamic_pointer_cast<httpfixture::FixtureResponse>(response);
+      if (fixture && fixture->GetRecordedLatency().count() > 0) {
+        delay += fixture->GetRecordedLatency();
+      }
+    }
+    if (outcome.isSlowBody) {
+      delay += std::chrono::milliseconds(
+          static_cast<int64_t>(response->GetBody().size()) * 1000 / outcome.slowBodyBytesPerSecond);
+    }
+    return delay;
+  }
+
+  static std::shared_ptr<HttpOperation> Synthesize(const HttpRequest& request, const Outcome& outcome) {
+    httpfixture::Headers headers;
+    int32_t statusCode = 503;
+    if (outcome.fault == Fault::Throttled) {
+      statusCode = 429;
+      headers["Retry-After"] = "1";
+    }
+    auto response = std::make_shared<httpfixture::FixtureResponse>(
+        request.GetId(), statusCode, headers, std::vector<uint8_t>());
+    return std::make_shared<httpfixture::FixtureOperation>(request.GetId(), response);
+  }
+
+  void CompleteAfter(
+      std::chrono::milliseconds delay,
+      const std::shared_ptr<HttpOperation>& operation,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) {
+    auto dispatcher = mDispatcher;
+    mTimers.Schedule(delay, [dispatcher, operation, callbackFn]() {
+      if (dispatcher) {
+        dispatcher->DispatchTask("mip-simulated-" + operation->GetId(), [operation, callbackFn]() {
+          callbackFn(operation);
+        });
+      } else {
+        callbackFn(operation);
+      }
+    });
+  }
+
+  std::shared_ptr<HttpDelegate> mResponder;
+  ProfileSelector mSelector;
+  std::shared_ptr<TaskDispatcherDelegate> mDispatcher;
+  mutable std::mutex mMutex;
+  std::mt19937_64 mRandom;
+  std::map<std::string, Burst> mBursts;
+  SimulatedServiceStatistics mStatistics;
+  TimerWheel mTimers;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_SIMULATED_HTTP_DELEGATE_H_
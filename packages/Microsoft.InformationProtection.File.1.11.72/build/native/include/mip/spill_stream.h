@@ -0,0 +1,373 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines SpillStream, a temporary stream that holds its content in memory up to a ceiling and in a
+ *        temporary file beyond it
+ * 
+ * @file spill_stream.h
+ */
+
+#ifndef API_MIP_SPILL_STREAM_H_
+#define API_MIP_SPILL_STREAM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Hands out the temporary files a SpillStream spills to, e.g. from a pool on fast local storage
+ */
+class TemporaryFileProvider {
+public:
+  /**
+   * @brief Get a temporary file
+   * 
+   * @param path [Output] Path of the file, used in error messages
+   * 
+   * @return File opened for binary reading and writing, or nullptr on failure
+   */
+  virtual std::FILE* Acquire(std::string& path) = 0;
+
+  /**
+   * @brief Give a file back once the stream using it is destroyed
+   * 
+   * @param file File returned by Acquire; the provider closes or reuses it
+   * @param path Path returned by Acquire
+   */
+  virtual void Release(std::FILE* file, const std::string& path) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~TemporaryFileProvider() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Settings of a SpillStream
+ */
+struct SpillStreamSettings {
+  int64_t maxMemoryBytes = 64 * 1024 * 1024; /**< Content held in memory before it moves to a temporary file */
+  std::string temporaryDirectory;            /**< Directory of the temporary file, the system's if empty */
+  std::shared_ptr<MemoryBudget> memoryBudget; /**< Accounts the memory under MemoryCategory::TemporaryStreams */
+  std::shared_ptr<TemporaryFileProvider> fileProvider; /**< Provides the temporary file; overrides temporaryDirectory */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace spillstream {
+
+inline bool Seek(std::FILE* file, int64_t position) {
+#ifdef _WIN32
+  return _fseeki64(file, position, SEEK_SET) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(position), SEEK_SET) == 0;
+#endif
+}
+
+inline bool Truncate(std::FILE* file, int64_t size) {
+  if (std::fflush(file) != 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return _chsize_s(_fileno(file), size) == 0;
+#else
+  return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+inline std::string GetUniquePath(const std::string& directory, const void* owner) {
+  static std::atomic<uint64_t> counter(0);
+  char name[64];
+  std::snprintf(name, sizeof(name), "mip_spill_%p_%llu.tmp", owner,
+      static_cast<unsigned long long>(counter.fetch_add(1)));
+  char last = directory.back();
+  return last == '/' || last == '\\' ? directory + name : directory + "/" + name;
+}
+
+} // namespace spillstream
+/** @endcond */
+
+/**
+ * @brief A read/write temporary stream whose memory use is capped, for content of any size
+ * 
+ * @note Content up to maxMemoryBytes is held in memory. The first write beyond it moves the content to a temporary
+ *       file, which is used from then on and deleted when the stream is destroyed, so the memory held stays at
+ *       most maxMemoryBytes however large the content grows. Positions and sizes are 64-bit throughout. With a
+ *       MemoryBudget, the ceiling is reserved under MemoryCategory::TemporaryStreams on the first write; if the
+ *       budget cannot grant it, the stream starts on disk. A TemporaryFileProvider, such as TemporaryStorage, can
+ *       supply the file instead, e.g. from a pool on tmpfs or a local SSD. Not thread-safe, like other streams.
+ */
+class SpillStream : public Stream {
+public:
+  /**
+   * @brief SpillStream constructor
+   * 
+   * @param settings Memory ceiling, temporary directory and budget
+   */
+  explicit SpillStream(const SpillStreamSettings& settings = SpillStreamSettings())
+      : mSettings(settings),
+        mFile(nullptr),
+        mPosition(0),
+        mSize(0),
+        mIsReserved(false) {
+    mSettings.maxMemoryBytes = (std::max)(mSettings.maxMemoryBytes, static_cast<int64_t>(0));
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~SpillStream() {
+    if (mFile == nullptr) {
+      return;
+    }
+    if (mSettings.fileProvider) {
+      mSettings.fileProvider->Release(mFile, mPath);
+      return;
+    }
+    std::fclose(mFile);
+    if (!mPath.empty()) {
+      std::remove(mPath.c_str());
+    }
+  }
+
+  SpillStream(const SpillStream&) = delete;
+  SpillStream& operator=(const SpillStream&) = delete;
+  /** @endcond */
+
+  /**
+   * @brief Read into a buffer from the stream.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    if (buffer == nullptr || bufferLength <= 0 || mPosition >= mSize) {
+      return 0;
+    }
+    int64_t length = (std::min)(bufferLength, mSize - mPosition);
+    if (mFile == nullptr) {
+      std::memcpy(buffer, mMemory.data() + mPosition, static_cast<size_t>(length));
+    } else {
+      if (!spillstream::Seek(mFile, mPosition)) {
+        throw FileIOError("Failed to seek temporary file " + mPath);
+      }
+      length = static_cast<int64_t>(std::fread(buffer, 1, static_cast<size_t>(length), mFile));
+    }
+    mPosition += length;
+    return length;
+  }
+
+  /**
+   * @brief Write into the stream from a buffer.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    if (buffer == nullptr || bufferLength <= 0) {
+      return 0;
+    }
+    int64_t end = mPosition + bufferLength;
+    if (mFile == nullptr && !FitsInMemory(end)) {
+      Spill();
+    }
+    if (mFile == nullptr) {
+      if (end > static_cast<int64_t>(mMemory.size())) {
+        Grow(end);
+      }
+      std::memcpy(mMemory.data() + mPosition, buffer, static_cast<size_t>(bufferLength));
+    } else {
+      if (!spillstream::Seek(mFile, mPosition) ||
+          std::fwrite(buffer, 1, static_cast<size_t>(bufferLength), mFile) != static_cast<size_t>(bufferLength)) {
+        throw FileIOError("Failed to write temporary file " + mPath);
+      }
+    }
+    mPosition = end;
+    mSize = (std::max)(mSize, end);
+    return bufferLength;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override { return mFile == nullptr || std::fflush(mFile) == 0; }
+
+  /**
+   * @brief Seek specific position within the stream.
+   * 
+   * @param position to seek into stream.
+   */
+  void Seek(int64_t position) override { mPosition = (std::max)(position, static_cast<int64_t>(0)); }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return true; }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return true; }
+
+  /**
+   * @brief Get the current position within the stream. 
+   * 
+   * @return position within the stream.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the content within the stream.
+   * 
+   * @return the stream size. 
+   */
+  int64_t Size() override { return mSize; }
+
+  /**
+   * @brief Set the stream size.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t value) override {
+    value = (std::max)(value, static_cast<int64_t>(0));
+    if (mFile == nullptr && !FitsInMemory(value)) {
+      Spill();
+    }
+    if (mFile == nullptr) {
+      Grow(value);
+    } else if (!spillstream::Truncate(mFile, value)) {
+      throw FileIOError("Failed to resize temporary file " + mPath);
+    }
+    mSize = value;
+  }
+
+  /**
+   * @brief Check whether the content moved to a temporary file
+   * 
+   * @return true once the memory ceiling was exceeded
+   */
+  bool IsSpilled() const { return mFile != nullptr; }
+
+  /**
+   * @brief Get the memory held for the content
+   * 
+   * @return Bytes held in memory, 0 once spilled
+   */
+  int64_t GetMemoryBytes() const { return static_cast<int64_t>(mMemory.capacity()); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  bool FitsInMemory(int64_t size) {
+    if (size > mSettings.maxMemoryBytes) {
+      return false;
+    }
+    if (mSettings.memoryBudget && !mIsReserved) {
+      mIsReserved = true;
+      mReservation = mSettings.memoryBudget->TryReserve(MemoryCategory::TemporaryStreams, mSettings.maxMemoryBytes);
+      if (!mReservation.IsValid()) {
+        mSettings.maxMemoryBytes = 0;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Grows geometrically, but never reserves past the ceiling
+  void Grow(int64_t size) {
+    if (size > static_cast<int64_t>(mMemory.capacity())) {
+      int64_t capacity = (std::max)(size, static_cast<int64_t>(mMemory.capacity()) * 2);
+      mMemory.reserve(static_cast<size_t>((std::min)(capacity, (std::max)(size, mSettings.maxMemoryBytes))));
+    }
+    mMemory.resize(static_cast<size_t>(size));
+  }
+
+  void Spill() {
+    if (mSettings.fileProvider) {
+      mFile = mSettings.fileProvider->Acquire(mPath);
+    } else if (mSettings.temporaryDirectory.empty()) {
+      mFile = std::tmpfile();
+    } else {
+      mPath = spillstream::GetUniquePath(mSettings.temporaryDirectory, this);
+      mFile = std::fopen(mPath.c_str(), "w+b");
+    }
+    if (mFile == nullptr) {
+      throw FileIOError("Failed to create temporary file" + (mPath.empty() ? std::string() : " " + mPath));
+    }
+    if (!spillstream::Seek(mFile, 0) ||
+        (!mMemory.empty() && std::fwrite(mMemory.data(), 1, mMemory.size(), mFile) != mMemory.size())) {
+      throw FileIOError("Failed to write temporary file " + mPath);
+    }
+    std::vector<uint8_t>().swap(mMemory);
+    mReservation.Release();
+  }
+
+  SpillStreamSettings mSettings;
+  std::vector<uint8_t> mMemory;
+  std::FILE* mFile;
+  std::string mPath;
+  int64_t mPosition;
+  int64_t mSize;
+  bool mIsReserved;
+  MemoryReservation mReservation;
+  /** @endcond */
+};
+
+/**
+ * @brief Create a temporary stream whose memory use is capped
+ * 
+ * @param settings Memory ceiling, temporary directory and budget
+ * 
+ * @return Empty SpillStream
+ */
+inline std::shared_ptr<SpillStream> CreateSpillStream(const SpillStreamSettings& settings = SpillStreamSettings()) {
+  return std::make_shared<SpillStream>(settings);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_SPILL_STREAM_H_
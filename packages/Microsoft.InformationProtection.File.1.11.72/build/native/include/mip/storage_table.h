@@ -33,7 +33,13 @@
 #ifndef API_MIP_STORAGE_TABLE_H_
 #define API_MIP_STORAGE_TABLE_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "mip/mip_namespace.h"
@@ -42,6 +48,11 @@ MIP_NAMESPACE_BEGIN
 
 /**
  * @brief A class that defines the interface to the MIP SDK storage table used for caching
+ * 
+ * @note Values are byte strings: a std::string may hold any bytes, including NUL, and its size is the size of the
+ *       value. Binary values such as licenses, certificates and policy packages need no text encoding; store them
+ *       as they are. Use ToStorageValue, ToStorageBytes and StorageValueView::GetBytes to convert at byte-oriented
+ *       boundaries such as remote stores.
  */
 class StorageTable {
 public:
@@ -104,5 +115,350 @@ protected:
    /** @endcond */
 };
 
+/**
+ * @brief One row update of a batch passed to TransactionalStorageTable::UpdateBatch, with the arguments of
+ *        StorageTable::Update
+ */
+struct StorageTableUpdate {
+  std::vector<std::string> updateColumns; /**< Column names that define the new row data */
+  std::vector<std::string> updateValues;  /**< Column values corresponding to updateColumns */
+  std::vector<std::string> queryColumns;  /**< Column names that identify the table rows to update */
+  std::vector<std::string> queryValues;   /**< Column values corresponding to queryColumns */
+};
+
+/**
+ * @brief A StorageTable that can write many rows in one call and group writes into transactions
+ * 
+ * @note Storage whose writes are expensive, such as remote stores or tables that sync to disk on every write, can
+ *       derive from TransactionalStorageTable instead of StorageTable and override these methods to write a batch in
+ *       one round trip or one sync. Writes between BeginTransaction and CommitTransaction are visible at once and
+ *       made durable together by CommitTransaction. Transactions may nest; only the outermost commit takes effect.
+ *       The default implementations loop over Insert/Update and do not group writes.
+ */
+class TransactionalStorageTable : public StorageTable {
+public:
+  /**
+   * @brief Adds rows to the table
+   * 
+   * @param rows Rows, each with all column values in sequence as represented in storage table.
+   */
+  virtual void InsertBatch(const std::vector<std::vector<std::string>>& rows) {
+    for (const auto& row : rows) {
+      Insert(row);
+    }
+  }
+
+  /**
+   * @brief Applies several row updates in order
+   * 
+   * @param updates Updates, each with the arguments of StorageTable::Update
+   */
+  virtual void UpdateBatch(const std::vector<StorageTableUpdate>& updates) {
+    for (const auto& update : updates) {
+      Update(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+    }
+  }
+
+  /**
+   * @brief Starts grouping writes until the matching CommitTransaction
+   */
+  virtual void BeginTransaction() {}
+
+  /**
+   * @brief Makes the writes since the matching BeginTransaction durable
+   */
+  virtual void CommitTransaction() {}
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~TransactionalStorageTable() {}
+protected:
+  TransactionalStorageTable() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Adds rows to any storage table
+ * 
+ * @param table Table to write to
+ * @param rows Rows, each with all column values in sequence as represented in storage table.
+ * 
+ * @note Uses TransactionalStorageTable::InsertBatch if the table supports it, else loops over StorageTable::Insert.
+ */
+inline void InsertRows(StorageTable& table, const std::vector<std::vector<std::string>>& rows) {
+  TransactionalStorageTable* transactionalTable = dynamic_cast<TransactionalStorageTable*>(&table);
+  if (transactionalTable != nullptr) {
+    transactionalTable->InsertBatch(rows);
+    return;
+  }
+  for (const auto& row : rows) {
+    table.Insert(row);
+  }
+}
+
+/**
+ * @brief Applies several row updates to any storage table
+ * 
+ * @param table Table to write to
+ * @param updates Updates, each with the arguments of StorageTable::Update
+ * 
+ * @note Uses TransactionalStorageTable::UpdateBatch if the table supports it, else loops over StorageTable::Update.
+ */
+inline void UpdateRows(StorageTable& table, const std::vector<StorageTableUpdate>& updates) {
+  TransactionalStorageTable* transactionalTable = dynamic_cast<TransactionalStorageTable*>(&table);
+  if (transactionalTable != nullptr) {
+    transactionalTable->UpdateBatch(updates);
+    return;
+  }
+  for (const auto& update : updates) {
+    table.Update(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+  }
+}
+
+/**
+ * @brief Groups the writes to a storage table made during its lifetime into one transaction
+ * 
+ * @note Commits on destruction if Commit was not called, also when unwinding, since the writes were already applied.
+ *       Does nothing for tables that are not a TransactionalStorageTable.
+ */
+class StorageTableTransaction {
+public:
+  /**
+   * @brief Begin a transaction on a table
+   * 
+   * @param table Table to group writes to
+   */
+  explicit StorageTableTransaction(StorageTable& table)
+      : mTable(dynamic_cast<TransactionalStorageTable*>(&table)) {
+    if (mTable) {
+      mTable->BeginTransaction();
+    }
+  }
+
+  /**
+   * @brief Commit the transaction
+   */
+  void Commit() {
+    TransactionalStorageTable* table = mTable;
+    mTable = nullptr;
+    if (table) {
+      table->CommitTransaction();
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~StorageTableTransaction() {
+    try {
+      Commit();
+    } catch (...) {
+    }
+  }
+
+  StorageTableTransaction(const StorageTableTransaction&) = delete;
+  StorageTableTransaction& operator=(const StorageTableTransaction&) = delete;
+
+private:
+  TransactionalStorageTable* mTable;
+  /** @endcond */
+};
+
+/**
+ * @brief A non-owning view of a storage table value
+ */
+struct StorageValueView {
+  const char* data = nullptr; /**< First byte of the value */
+  size_t size = 0;            /**< Size of the value in bytes */
+
+  /** @cond DOXYGEN_HIDE */
+  StorageValueView() {}
+  StorageValueView(const char* valueData, size_t valueSize) : data(valueData), size(valueSize) {}
+  StorageValueView(const std::string& value) : data(value.data()), size(value.size()) {}
+  StorageValueView(const std::vector<uint8_t>& value)
+      : data(reinterpret_cast<const char*>(value.data())), size(value.size()) {}
+  /** @endcond */
+
+  /**
+   * @brief Gets the value as bytes, without copying
+   */
+  const uint8_t* GetBytes() const { return reinterpret_cast<const uint8_t*>(data); }
+
+  /**
+   * @brief Copies the value into a string
+   */
+  std::string ToString() const { return std::string(data != nullptr ? data : "", size); }
+
+  /**
+   * @brief Copies the value into a byte vector
+   */
+  std::vector<uint8_t> ToBytes() const { return std::vector<uint8_t>(GetBytes(), GetBytes() + size); }
+
+  /** @cond DOXYGEN_HIDE */
+  bool operator==(const StorageValueView& other) const {
+    return size == other.size && (size == 0 || std::memcmp(data, other.data, size) == 0);
+  }
+  bool operator!=(const StorageValueView& other) const { return !(*this == other); }
+  /** @endcond */
+};
+
+/**
+ * @brief Converts binary data to a storage table value, byte for byte
+ * 
+ * @param bytes Binary data, for example a license or a certificate
+ * @param size Size of the data in bytes
+ * 
+ * @return The value, of the same size
+ */
+inline std::string ToStorageValue(const uint8_t* bytes, size_t size) {
+  return size == 0 ? std::string() : std::string(reinterpret_cast<const char*>(bytes), size);
+}
+
+/**
+ * @brief Converts binary data to a storage table value, byte for byte
+ * 
+ * @param bytes Binary data, for example a license or a certificate
+ * 
+ * @return The value, of the same size
+ */
+inline std::string ToStorageValue(const std::vector<uint8_t>& bytes) {
+  return ToStorageValue(bytes.data(), bytes.size());
+}
+
+/**
+ * @brief Converts a storage table value to binary data, byte for byte
+ * 
+ * @param value Value read from a storage table
+ * 
+ * @return The bytes of the value
+ */
+inline std::vector<uint8_t> ToStorageBytes(const std::string& value) {
+  return StorageValueView(value).ToBytes();
+}
+
+/**
+ * @brief Rows read by a StorageTableCursor
+ */
+struct StorageTableQuery {
+  std::vector<std::string> queryColumns;  /**< Column names that identify the rows, all rows if empty */
+  std::vector<std::string> queryValues;   /**< Column values corresponding to queryColumns */
+  size_t offset = 0;                      /**< Matching rows to skip */
+  size_t limit = static_cast<size_t>(-1); /**< Most rows to return after the skipped ones */
+};
+
+/**
+ * @brief Reads the rows of a storage table one at a time
+ * 
+ * @note A cursor starts before the first row. The values returned by GetValue are valid until the next call to Next
+ *       or the destruction of the cursor. Rows written while the cursor is open may or may not be returned, and rows
+ *       are returned in no particular order.
+ */
+class StorageTableCursor {
+public:
+  /**
+   * @brief Moves to the next row
+   * 
+   * @return false once there are no more rows
+   */
+  virtual bool Next() = 0;
+
+  /**
+   * @brief Gets the number of columns of each row
+   */
+  virtual size_t GetColumnCount() const = 0;
+
+  /**
+   * @brief Gets a value of the current row
+   * 
+   * @param column Position of the column in the table's columns
+   */
+  virtual StorageValueView GetValue(size_t column) const = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~StorageTableCursor() {}
+protected:
+  StorageTableCursor() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Implemented by storage tables that can read rows without copying all of them into memory
+ * 
+ * @note Storage tables implement this interface alongside StorageTable or TransactionalStorageTable. Use
+ *       OpenStorageTableCursor to read any table.
+ */
+class StorageTableCursorSource {
+public:
+  /**
+   * @brief Opens a cursor over the rows matching a query
+   * 
+   * @param query Rows to read
+   * 
+   * @return The cursor
+   */
+  virtual std::unique_ptr<StorageTableCursor> OpenCursor(const StorageTableQuery& query) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~StorageTableCursorSource() {}
+protected:
+  StorageTableCursorSource() {}
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace storagetable {
+
+// Cursor over rows already read into memory, for tables that are not a StorageTableCursorSource
+class MaterializedCursor : public StorageTableCursor {
+public:
+  MaterializedCursor(std::vector<std::vector<std::string>>&& rows, size_t offset, size_t limit)
+      : mRows(std::move(rows)),
+        mNext(offset),
+        mEnd(limit < mRows.size() - (std::min)(offset, mRows.size()) ? offset + limit : mRows.size()) {}
+
+  bool Next() override {
+    if (mNext >= mEnd) {
+      mCurrent = nullptr;
+      return false;
+    }
+    mCurrent = &mRows[mNext++];
+    return true;
+  }
+
+  size_t GetColumnCount() const override { return mCurrent != nullptr ? mCurrent->size() : 0; }
+
+  StorageValueView GetValue(size_t column) const override { return StorageValueView(mCurrent->at(column)); }
+
+private:
+  std::vector<std::vector<std::string>> mRows;
+  size_t mNext;
+  size_t mEnd;
+  const std::vector<std::string>* mCurrent = nullptr;
+};
+
+} // namespace storagetable
+/** @endcond */
+
+/**
+ * @brief Opens a cursor over the rows of any storage table
+ * 
+ * @param table Table to read
+ * @param query Rows to read
+ * 
+ * @return The cursor
+ * 
+ * @note Uses StorageTableCursorSource::OpenCursor if the table supports it. Otherwise the rows are read with
+ *       StorageTable::List or StorageTable::Find and held by the cursor.
+ */
+inline std::unique_ptr<StorageTableCursor> OpenStorageTableCursor(
+    StorageTable& table,
+    const StorageTableQuery& query = StorageTableQuery()) {
+  StorageTableCursorSource* source = dynamic_cast<StorageTableCursorSource*>(&table);
+  if (source != nullptr) {
+    return source->OpenCursor(query);
+  }
+  std::vector<std::vector<std::string>> rows =
+      query.queryColumns.empty() ? table.List() : table.Find(query.queryColumns, query.queryValues);
+  return std::unique_ptr<StorageTableCursor>(
+      new storagetable::MaterializedCursor(std::move(rows), query.offset, query.limit));
+}
+
 MIP_NAMESPACE_END
 #endif // API_MIP_STORAGE_TABLE_H_
\ No newline at end of file
@@ -33,6 +33,7 @@
 #ifndef API_MIP_STREAM_H_
 #define API_MIP_STREAM_H_
 
+#include <cstddef>
 #include <future>
 #include <vector>
 
@@ -120,6 +121,137 @@ protected:
   /** @endcond */
 }; // class Stream
 
+/**
+ * @brief A buffer segment used to read from a stream with a single vectored call.
+ */
+struct StreamReadSegment {
+  uint8_t* buffer;      /**< Pointer to a buffer */
+  int64_t bufferLength; /**< Buffer size */
+};
+
+/**
+ * @brief A buffer segment used to write into a stream with a single vectored call.
+ */
+struct StreamWriteSegment {
+  const uint8_t* buffer; /**< Pointer to a buffer */
+  int64_t bufferLength;  /**< Buffer size */
+};
+
+/**
+ * @brief A Stream that can move several buffer segments in a single call (scatter/gather).
+ * 
+ * @note Applications whose streams are expensive to call, such as network or blob-backed streams, can derive from
+ *       VectoredStream instead of Stream and override ReadV/WriteV to turn many small transfers into a few large ones.
+ *       The default implementations loop over Read/Write.
+ */
+class VectoredStream : public Stream {
+public:
+  /**
+   * @brief Read into a sequence of buffer segments from the stream.
+   * 
+   * @param segments pointer to an array of buffer segments, filled in order
+   * @param segmentCount number of segments.
+   * @return total number of bytes read. Reading stops at the first segment that is not completely filled.
+   */
+  virtual int64_t ReadV(const StreamReadSegment* segments, size_t segmentCount) {
+    return ReadSegments(*this, segments, segmentCount);
+  }
+
+  /**
+   * @brief Write into the stream from a sequence of buffer segments.
+   * 
+   * @param segments pointer to an array of buffer segments, written in order
+   * @param segmentCount number of segments.
+   * @return total number of bytes written. Writing stops at the first segment that is not completely written.
+   */
+  virtual int64_t WriteV(const StreamWriteSegment* segments, size_t segmentCount) {
+    return WriteSegments(*this, segments, segmentCount);
+  }
+
+  /**
+   * @brief Read into a sequence of buffer segments by calling Stream::Read once per segment.
+   * 
+   * @param stream stream to read from.
+   * @param segments pointer to an array of buffer segments, filled in order
+   * @param segmentCount number of segments.
+   * @return total number of bytes read. Reading stops at the first segment that is not completely filled.
+   */
+  static int64_t ReadSegments(Stream& stream, const StreamReadSegment* segments, size_t segmentCount) {
+    int64_t totalBytesRead = 0;
+    for (size_t i = 0; i < segmentCount; ++i) {
+      int64_t bytesRead = stream.Read(segments[i].buffer, segments[i].bufferLength);
+      totalBytesRead += bytesRead;
+      if (bytesRead < segments[i].bufferLength) {
+        break;
+      }
+    }
+    return totalBytesRead;
+  }
+
+  /**
+   * @brief Write from a sequence of buffer segments by calling Stream::Write once per segment.
+   * 
+   * @param stream stream to write to.
+   * @param segments pointer to an array of buffer segments, written in order
+   * @param segmentCount number of segments.
+   * @return total number of bytes written. Writing stops at the first segment that is not completely written.
+   */
+  static int64_t WriteSegments(Stream& stream, const StreamWriteSegment* segments, size_t segmentCount) {
+    int64_t totalBytesWritten = 0;
+    for (size_t i = 0; i < segmentCount; ++i) {
+      int64_t bytesWritten = stream.Write(segments[i].buffer, segments[i].bufferLength);
+      totalBytesWritten += bytesWritten;
+      if (bytesWritten < segments[i].bufferLength) {
+        break;
+      }
+    }
+    return totalBytesWritten;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~VectoredStream() { }
+
+protected:
+  VectoredStream() { }
+  /** @endcond */
+}; // class VectoredStream
+
+/**
+ * @brief Read into a sequence of buffer segments from any stream.
+ * 
+ * @param stream stream to read from.
+ * @param segments pointer to an array of buffer segments, filled in order
+ * @param segmentCount number of segments.
+ * @return total number of bytes read.
+ * 
+ * @note Uses VectoredStream::ReadV if the stream supports it, else loops over Stream::Read.
+ */
+inline int64_t ReadV(Stream& stream, const StreamReadSegment* segments, size_t segmentCount) {
+  VectoredStream* vectoredStream = dynamic_cast<VectoredStream*>(&stream);
+  if (vectoredStream != nullptr) {
+    return vectoredStream->ReadV(segments, segmentCount);
+  }
+  return VectoredStream::ReadSegments(stream, segments, segmentCount);
+}
+
+/**
+ * @brief Write into any stream from a sequence of buffer segments.
+ * 
+ * @param stream stream to write to.
+ * @param segments pointer to an array of buffer segments, written in order
+ * @param segmentCount number of segments.
+ * @return total number of bytes written.
+ * 
+ * @note Uses VectoredStream::WriteV if the stream supports it, else loops over Stream::Write.
+ */
+inline int64_t WriteV(Stream& stream, const StreamWriteSegment* segments, size_t segmentCount) {
+  VectoredStream* vectoredStream = dynamic_cast<VectoredStream*>(&stream);
+  if (vectoredStream != nullptr) {
+    return vectoredStream->WriteV(segments, segmentCount);
+  }
+  return VectoredStream::WriteSegments(stream, segments, segmentCount);
+}
+
 MIP_NAMESPACE_END
 
 #endif // API_MIP_STREAM_H_
@@ -0,0 +1,267 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines a Stream that exposes a window of a larger stream
+ * 
+ * @file stream_slice.h
+ */
+
+#ifndef API_MIP_STREAM_SLICE_H_
+#define API_MIP_STREAM_SLICE_H_
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "mip/error.h"
+#include "mip/mapped_file_stream.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace streamslice {
+
+// Lock shared by every slice of one parent. Entries live as long as a slice holds the lock, and each slice holds its
+// parent, so a parent cannot be freed and its address reused while its entry is live.
+inline std::shared_ptr<std::mutex> GetParentLock(const Stream* parent) {
+  static std::mutex sRegistryMutex;
+  static std::map<const Stream*, std::weak_ptr<std::mutex>> sParentLocks;
+  static size_t sNextSweepSize = 64;
+  std::lock_guard<std::mutex> lock(sRegistryMutex);
+  std::weak_ptr<std::mutex>& entry = sParentLocks[parent];
+  std::shared_ptr<std::mutex> parentLock = entry.lock();
+  if (!parentLock) {
+    parentLock = std::make_shared<std::mutex>();
+    entry = parentLock;
+  }
+  if (sParentLocks.size() >= sNextSweepSize) {
+    for (auto it = sParentLocks.begin(); it != sParentLocks.end();) {
+      it = it->second.expired() ? sParentLocks.erase(it) : ++it;
+    }
+    sNextSweepSize = (std::max)(static_cast<size_t>(64), sParentLocks.size() * 2);
+  }
+  return parentLock;
+}
+
+} // namespace streamslice
+/** @endcond */
+
+/**
+ * @brief A Stream over the byte range [offset, offset + length) of a parent stream.
+ * 
+ * @note Each slice keeps its own position, so many slices of one parent can be handed to different FileHandlers.
+ *       Access to the parent is serialized by one lock shared between all slices of that parent. Slices of a
+ *       read-only MappedFileStream read straight from the mapping and take no lock; a writable one can be remapped
+ *       by a write, so its slices lock for reads too.
+ */
+class StreamSlice : public Stream {
+public:
+  /**
+   * @brief StreamSlice constructor
+   * 
+   * @param parent Stream being sliced
+   * @param offset Absolute position of the slice within @p parent
+   * @param length Size (in bytes) of the slice
+   * @param parentLock Lock guarding @p parent, or nullptr for the lock shared by every slice of @p parent
+   */
+  StreamSlice(
+      const std::shared_ptr<Stream>& parent,
+      int64_t offset,
+      int64_t length,
+      const std::shared_ptr<std::mutex>& parentLock)
+      : mParent(parent),
+        mMappedParent(std::dynamic_pointer_cast<MappedFileStream>(parent)),
+        mParentLock(parentLock),
+        mOffset(offset),
+        mLength(length),
+        mPosition(0) {
+    if (!mParent) {
+      throw BadInputError("StreamSlice requires a parent stream");
+    }
+    if (mOffset < 0 || mLength < 0) {
+      throw BadInputError("StreamSlice offset and length cannot be negative");
+    }
+    if (!mParentLock) {
+      mParentLock = streamslice::GetParentLock(mParent.get());
+    }
+    if (mMappedParent && mMappedParent->CanWrite()) {
+      mMappedParent.reset();
+    }
+  }
+
+  /**
+   * @brief Read into a buffer from the slice.
+   * 
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes read.
+   */
+  int64_t Read(uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesToRead = (std::min)(bufferLength, mLength - mPosition);
+    if (bytesToRead <= 0) {
+      return 0;
+    }
+    int64_t bytesRead = 0;
+    if (mMappedParent) {
+      bytesRead = mMappedParent->ReadAt(mOffset + mPosition, buffer, bytesToRead);
+    } else {
+      std::lock_guard<std::mutex> lock(*mParentLock);
+      mParent->Seek(mOffset + mPosition);
+      bytesRead = mParent->Read(buffer, bytesToRead);
+    }
+    mPosition += bytesRead;
+    return bytesRead;
+  }
+
+  /**
+   * @brief Write into the slice from a buffer. Writes never extend past the end of the slice.
+   *
+   * @param buffer pointer to a buffer
+   * @param bufferLength buffer size.
+   * @return number of bytes written.
+   */
+  int64_t Write(const uint8_t* buffer, int64_t bufferLength) override {
+    int64_t bytesToWrite = (std::min)(bufferLength, mLength - mPosition);
+    if (bytesToWrite <= 0) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(*mParentLock);
+    mParent->Seek(mOffset + mPosition);
+    int64_t bytesWritten = mParent->Write(buffer, bytesToWrite);
+    mPosition += bytesWritten;
+    return bytesWritten;
+  }
+
+  /**
+   * @brief flush the stream.
+   * 
+   * @return true if successful else false.
+   */
+  bool Flush() override {
+    std::lock_guard<std::mutex> lock(*mParentLock);
+    return mParent->Flush();
+  }
+
+  /**
+   * @brief Seek specific position within the slice.
+   * 
+   * @param position to seek into the slice, relative to its start.
+   */
+  void Seek(int64_t position) override {
+    mPosition = (std::max)(static_cast<int64_t>(0), (std::min)(position, mLength));
+  }
+
+  /**
+   * @brief A check if stream can be read from.
+   * 
+   * @return true if readable else false.
+   */
+  bool CanRead() const override { return mParent->CanRead(); }
+
+  /**
+   * @brief A check if stream can be written to.
+   * 
+   * @return true if writeable else false.
+   */
+  bool CanWrite() const override { return mParent->CanWrite(); }
+
+  /**
+   * @brief Get the current position within the slice. 
+   * 
+   * @return position within the slice.
+   */
+  int64_t Position() override { return mPosition; }
+
+  /**
+   * @brief Get the size of the slice.
+   * 
+   * @return the slice size. 
+   */
+  int64_t Size() override { return mLength; }
+
+  /**
+   * @brief Slices have a fixed size, a mip::NotSupportedError is thrown.
+   * 
+   * @param value stream size. 
+   */
+  void Size(int64_t /*value*/) override {
+    throw NotSupportedError("StreamSlice size cannot be changed");
+  }
+
+  /**
+   * @brief Create a slice of this slice that shares the same parent and lock
+   * 
+   * @param offset Position of the new slice, relative to the start of this slice
+   * @param length Size (in bytes) of the new slice, clamped to the end of this slice
+   * 
+   * @return Slice over the same parent stream
+   */
+  std::shared_ptr<StreamSlice> CreateSlice(int64_t offset, int64_t length) const {
+    int64_t boundedOffset = (std::max)(static_cast<int64_t>(0), (std::min)(offset, mLength));
+    int64_t boundedLength = (std::max)(static_cast<int64_t>(0), (std::min)(length, mLength - boundedOffset));
+    return std::make_shared<StreamSlice>(mParent, mOffset + boundedOffset, boundedLength, mParentLock);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~StreamSlice() { }
+
+private:
+  std::shared_ptr<Stream> mParent;
+  std::shared_ptr<MappedFileStream> mMappedParent; // Only set when read-only, so that reads need no lock
+  std::shared_ptr<std::mutex> mParentLock;
+  int64_t mOffset;
+  int64_t mLength;
+  int64_t mPosition;
+  /** @endcond */
+}; // class StreamSlice
+
+/**
+ * @brief Creates a Stream over a window of another stream without copying it
+ * 
+ * @param parent Stream being sliced. If it is itself a StreamSlice, the new slice shares its parent.
+ * @param offset Position of the slice within @p parent
+ * @param length Size (in bytes) of the slice
+ * 
+ * @return Slice with its own independent position, sharing one lock with every other slice of the same parent
+ */
+inline std::shared_ptr<StreamSlice> CreateStreamSlice(
+    const std::shared_ptr<Stream>& parent,
+    int64_t offset,
+    int64_t length) {
+  auto parentSlice = std::dynamic_pointer_cast<StreamSlice>(parent);
+  if (parentSlice) {
+    return parentSlice->CreateSlice(offset, length);
+  }
+  return std::make_shared<StreamSlice>(parent, offset, length, nullptr);
+}
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_STREAM_SLICE_H_
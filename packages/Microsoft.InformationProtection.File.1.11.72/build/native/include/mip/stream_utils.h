@@ -33,11 +33,15 @@
 #ifndef API_MIP_STREAM_UTILS_H_
 #define API_MIP_STREAM_UTILS_H_
 
+#include <algorithm>
+#include <cstring>
 #include <future>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "mip/buffer_pool.h"
+#include "mip/error.h"
 #include "mip/mip_export.h"
 #include "mip/mip_namespace.h"
 #include "mip/stream.h"
@@ -91,6 +95,126 @@ MIP_API std::shared_ptr<mip::Stream> CreateStreamFromBuffer(uint8_t* buffer, con
  */
 MIP_API std::vector<uint8_t> ReadFromStream(const std::shared_ptr<mip::Stream>& stream);
 
+/**
+ * @brief Read the remaining bytes of a stream into a caller-owned buffer.
+ * 
+ * @param stream pointer to a stream.
+ * @param buffer pointer to a buffer.
+ * @param bufferLength buffer size.
+ * 
+ * @return number of bytes read. At most @p bufferLength bytes are read, starting from the current stream position.
+ */
+inline int64_t ReadFromStream(const std::shared_ptr<mip::Stream>& stream, uint8_t* buffer, int64_t bufferLength) {
+  int64_t totalBytesRead = 0;
+  while (totalBytesRead < bufferLength) {
+    int64_t bytesRead = stream->Read(buffer + totalBytesRead, bufferLength - totalBytesRead);
+    if (bytesRead <= 0) {
+      break;
+    }
+    totalBytesRead += bytesRead;
+  }
+  return totalBytesRead;
+}
+
+/**
+ * @brief Read the remaining bytes of a stream into a reusable vector.
+ * 
+ * @param stream pointer to a stream.
+ * @param buffer [Output] vector that receives the bytes. It is resized to the number of bytes read; its capacity is
+ *        kept, so reusing the same vector across calls avoids reallocation.
+ * 
+ * @return number of bytes read, starting from the current stream position.
+ * 
+ * @note The vector is sized once from Stream::Size() rather than grown while reading.
+ */
+inline int64_t ReadFromStreamInto(const std::shared_ptr<mip::Stream>& stream, std::vector<uint8_t>& buffer) {
+  int64_t remaining = (std::max)(stream->Size() - stream->Position(), static_cast<int64_t>(0));
+  buffer.resize(static_cast<size_t>(remaining));
+  int64_t totalBytesRead = remaining > 0 ? ReadFromStream(stream, buffer.data(), remaining) : 0;
+  // Some streams report a conservative size, so drain anything left after the expected end
+  uint8_t tail[4096];
+  int64_t bytesRead = 0;
+  while (totalBytesRead == static_cast<int64_t>(buffer.size()) &&
+         (bytesRead = stream->Read(tail, sizeof(tail))) > 0) {
+    buffer.insert(buffer.end(), tail, tail + bytesRead);
+    totalBytesRead += bytesRead;
+  }
+  buffer.resize(static_cast<size_t>(totalBytesRead));
+  return totalBytesRead;
+}
+
+/**
+ * @brief Copy the remaining bytes of one stream into another through a caller-owned buffer.
+ * 
+ * @param source stream to read from, starting at its current position.
+ * @param destination stream to write to, starting at its current position.
+ * @param buffer pointer to the intermediate buffer.
+ * @param bufferLength buffer size.
+ * 
+ * @return number of bytes copied.
+ * 
+ * @note A mip::FileIOError is thrown if the destination stream accepts fewer bytes than were read.
+ */
+inline int64_t CopyStream(
+    const std::shared_ptr<mip::Stream>& source,
+    const std::shared_ptr<mip::Stream>& destination,
+    uint8_t* buffer,
+    int64_t bufferLength) {
+  if (buffer == nullptr || bufferLength <= 0) {
+    throw BadInputError("CopyStream requires a non-empty buffer");
+  }
+  int64_t totalBytesCopied = 0;
+  int64_t bytesRead = 0;
+  while ((bytesRead = source->Read(buffer, bufferLength)) > 0) {
+    if (destination->Write(buffer, bytesRead) != bytesRead) {
+      throw FileIOError("CopyStream failed to write to destination stream");
+    }
+    totalBytesCopied += bytesRead;
+  }
+  return totalBytesCopied;
+}
+
+/**
+ * @brief Copy the remaining bytes of one stream into another, one chunk at a time.
+ * 
+ * @param source stream to read from, starting at its current position.
+ * @param destination stream to write to, starting at its current position.
+ * @param bufferSize size (in bytes) of the single intermediate buffer.
+ * 
+ * @return number of bytes copied.
+ * 
+ * @note A mip::FileIOError is thrown if the destination stream accepts fewer bytes than were read.
+ */
+inline int64_t CopyStream(
+    const std::shared_ptr<mip::Stream>& source,
+    const std::shared_ptr<mip::Stream>& destination,
+    int64_t bufferSize = 64 * 1024) {
+  if (bufferSize <= 0) {
+    throw BadInputError("CopyStream buffer size must be positive");
+  }
+  std::vector<uint8_t> buffer(static_cast<size_t>(bufferSize));
+  return CopyStream(source, destination, buffer.data(), bufferSize);
+}
+
+/**
+ * @brief Copy the remaining bytes of one stream into another, using a block from a buffer pool.
+ * 
+ * @param source stream to read from, starting at its current position.
+ * @param destination stream to write to, starting at its current position.
+ * @param bufferPool pool providing the single intermediate buffer.
+ * 
+ * @return number of bytes copied.
+ * 
+ * @note A mip::FileIOError is thrown if the destination stream accepts fewer bytes than were read.
+ */
+inline int64_t CopyStream(
+    const std::shared_ptr<mip::Stream>& source,
+    const std::shared_ptr<mip::Stream>& destination,
+    const std::shared_ptr<BufferPoolDelegate>& bufferPool) {
+  PooledBuffer buffer(bufferPool);
+  return CopyStream(source, destination, buffer.Data(), static_cast<int64_t>(buffer.Size()));
+}
+
 MIP_NAMESPACE_END
 
 #endif // API_MIP_STREAM_UTILS_H_
@@ -37,6 +37,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "mip/mip_namespace.h"
 
@@ -66,7 +67,7 @@ public:
       const std::string& taskId,
       std::function<void()> task,
       const std::shared_ptr<void>& /*loggerContext*/) {
-    DispatchTask(taskId, task);
+    DispatchTask(taskId, std::move(task));
   }
 
   /**
@@ -91,7 +92,7 @@ public:
       std::function<void()> task,
       int64_t delaySeconds,
       const std::shared_ptr<void>& /*loggerContext*/) {
-    DispatchTask(taskId, task, delaySeconds);
+    DispatchTask(taskId, std::move(task), delaySeconds);
   }
 
   /**
@@ -113,7 +114,7 @@ public:
       const std::string& taskId,
       std::function<void()> task,
       const std::shared_ptr<void>& /*loggerContext*/) {
-    ExecuteTaskOnIndependentThread(taskId, task);
+    ExecuteTaskOnIndependentThread(taskId, std::move(task));
   }
 
   /**
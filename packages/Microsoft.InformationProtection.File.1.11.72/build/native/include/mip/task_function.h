@@ -0,0 +1,219 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TaskFunction, a move-only task with inline storage for small captures
+ * 
+ * @file task_function.h
+ */
+
+#ifndef API_MIP_TASK_FUNCTION_H_
+#define API_MIP_TASK_FUNCTION_H_
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief A move-only void() callable that stores small captures inline instead of on the heap
+ * 
+ * @note Callables of up to kInlineSize bytes that can be moved without throwing are stored inline, which covers a
+ *       std::function and lambdas capturing a few shared_ptrs, the common shape of SDK tasks. Larger callables take
+ *       one heap allocation. Unlike std::function, the callable need not be copyable, and moving a TaskFunction
+ *       never allocates.
+ */
+class TaskFunction {
+public:
+  /** Bytes of inline storage */
+  static const size_t kInlineSize = 6 * sizeof(void*);
+
+  /**
+   * @brief Create an empty task
+   */
+  TaskFunction() noexcept : mOps(nullptr) {}
+
+  /**
+   * @brief Create an empty task
+   */
+  TaskFunction(std::nullptr_t) noexcept : mOps(nullptr) {}
+
+  /**
+   * @brief Create a task from a callable, taking ownership of it
+   * 
+   * @param function Callable invocable with no arguments; an empty std::function or null pointer gives an empty task
+   */
+  template <typename F,
+            typename Decayed = typename std::decay<F>::type,
+            typename = typename std::enable_if<!std::is_same<Decayed, TaskFunction>::value>::type,
+            typename = decltype(std::declval<Decayed&>()())>
+  TaskFunction(F&& function) : mOps(nullptr) {
+    if (IsEmpty(function)) {
+      return;
+    }
+    Store<Decayed>(std::forward<F>(function), std::integral_constant<bool, IsInline<Decayed>()>());
+  }
+
+  /**
+   * @brief Move constructor, leaving @p other empty
+   */
+  TaskFunction(TaskFunction&& other) noexcept : mOps(other.mOps) {
+    if (mOps) {
+      mOps->move(&other.mStorage, &mStorage);
+      other.mOps = nullptr;
+    }
+  }
+
+  /**
+   * @brief Move assignment, leaving @p other empty
+   */
+  TaskFunction& operator=(TaskFunction&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      if (other.mOps) {
+        other.mOps->move(&other.mStorage, &mStorage);
+        mOps = other.mOps;
+        other.mOps = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Destroy the callable, making the task empty
+   */
+  TaskFunction& operator=(std::nullptr_t) noexcept {
+    Reset();
+    return *this;
+  }
+
+  TaskFunction(const TaskFunction&) = delete;
+  TaskFunction& operator=(const TaskFunction&) = delete;
+
+  ~TaskFunction() { Reset(); }
+
+  /**
+   * @brief Run the task. Throws std::bad_function_call if it is empty.
+   */
+  void operator()() {
+    if (!mOps) {
+      throw std::bad_function_call();
+    }
+    mOps->invoke(&mStorage);
+  }
+
+  /**
+   * @brief Whether the task holds a callable
+   */
+  explicit operator bool() const noexcept { return mOps != nullptr; }
+
+  /**
+   * @brief Whether the callable is stored inline, i.e. creating the task did not allocate
+   */
+  bool IsStoredInline() const noexcept { return mOps && mOps->isInline; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+  struct Ops {
+    void (*invoke)(void* storage);
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+    bool isInline;
+  };
+
+  template <typename F>
+  static constexpr bool IsInline() {
+    return sizeof(F) <= kInlineSize && alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<F>::value;
+  }
+
+  template <typename F>
+  static bool IsEmpty(const F& function) { return IsNull(function, 0); }
+  template <typename F>
+  static auto IsNull(const F& function, int) -> decltype(function == nullptr) { return function == nullptr; }
+  template <typename F>
+  static bool IsNull(const F&, long) { return false; }
+
+  template <typename F>
+  struct InlineOps {
+    static void Invoke(void* storage) { (*static_cast<F*>(storage))(); }
+    static void Move(void* from, void* to) {
+      ::new (to) F(std::move(*static_cast<F*>(from)));
+      static_cast<F*>(from)->~F();
+    }
+    static void Destroy(void* storage) { static_cast<F*>(storage)->~F(); }
+    static const Ops* Get() {
+      static const Ops ops = {&Invoke, &Move, &Destroy, true};
+      return &ops;
+    }
+  };
+
+  template <typename F>
+  struct HeapOps {
+    static void Invoke(void* storage) { (**static_cast<F**>(storage))(); }
+    static void Move(void* from, void* to) { *static_cast<F**>(to) = *static_cast<F**>(from); }
+    static void Destroy(void* storage) { delete *static_cast<F**>(storage); }
+    static const Ops* Get() {
+      static const Ops ops = {&Invoke, &Move, &Destroy, false};
+      return &ops;
+    }
+  };
+
+  template <typename F, typename Arg>
+  void Store(Arg&& function, std::true_type /*isInline*/) {
+    ::new (&mStorage) F(std::forward<Arg>(function));
+    mOps = InlineOps<F>::Get();
+  }
+
+  template <typename F, typename Arg>
+  void Store(Arg&& function, std::false_type /*isInline*/) {
+    *reinterpret_cast<F**>(&mStorage) = new F(std::forward<Arg>(function));
+    mOps = HeapOps<F>::Get();
+  }
+
+  void Reset() noexcept {
+    if (mOps) {
+      const Ops* ops = mOps;
+      mOps = nullptr;
+      ops->destroy(&mStorage);
+    }
+  }
+
+  Storage mStorage;
+  const Ops* mOps;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_TASK_FUNCTION_H_
@@ -0,0 +1,248 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TaskHandle, an integer reference to a dispatched task that can be cancelled without a lookup
+ * 
+ * @file task_handle.h
+ */
+
+#ifndef API_MIP_TASK_HANDLE_H_
+#define API_MIP_TASK_HANDLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "mip/common_types.h"
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Identifies a task returned by WorkStealingTaskDispatcher::Submit and the dispatch overloads taking a priority
+ * 
+ * @note A handle stays valid after its task ran or was cancelled; cancelling it then returns false, even once its
+ *       slot was reused by a later task.
+ */
+struct TaskHandle {
+  uint32_t index = 0;      /**< Slot of the task */
+  uint32_t generation = 0; /**< Generation of the slot when the task was dispatched, 0 for no task */
+
+  /** @brief Whether the handle refers to a dispatched task */
+  bool IsValid() const { return generation != 0; }
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace taskhandle {
+
+enum TaskState : uint32_t { Free = 0, Pending = 1, Running = 2, Cancelled = 3 };
+
+// Slab of task states addressed by TaskHandle. Each slot packs its generation and state into one word, so starting and
+// cancelling a task is a single compare-and-swap. Slots live in chunks of doubling size that never move, and free
+// slots are kept on a lock-free stack; only allocating a new chunk takes a lock.
+class TaskSlots {
+public:
+  TaskSlots() : mFreeHead(0), mNextIndex(0) {
+    for (auto& chunk : mChunks) {
+      chunk = nullptr;
+    }
+  }
+
+  ~TaskSlots() {
+    for (auto& chunk : mChunks) {
+      delete[] chunk.load();
+    }
+  }
+
+  TaskSlots(const TaskSlots&) = delete;
+  TaskSlots& operator=(const TaskSlots&) = delete;
+
+  // Returns the handle of a slot in state Pending
+  TaskHandle Acquire() {
+    uint32_t index = Pop();
+    Slot& slot = *GetSlot(index);
+    uint32_t generation = static_cast<uint32_t>(slot.word.load() >> 32);
+    slot.word = Pack(generation, Pending);
+    TaskHandle handle;
+    handle.index = index;
+    handle.generation = generation;
+    return handle;
+  }
+
+  // Bumps the generation of the slot, so outstanding handles no longer match, then frees it
+  void Release(const TaskHandle& handle) {
+    Slot* slot = GetSlot(handle);
+    if (!slot) {
+      return;
+    }
+    uint32_t generation = handle.generation == 0xffffffffu ? 1 : handle.generation + 1;
+    slot->word = Pack(generation, Free);
+    Push(handle.index);
+  }
+
+  bool Transition(const TaskHandle& handle, TaskState from, TaskState to) {
+    Slot* slot = GetSlot(handle);
+    if (!slot) {
+      return false;
+    }
+    uint64_t expected = Pack(handle.generation, from);
+    return slot->word.compare_exchange_strong(expected, Pack(handle.generation, to));
+  }
+
+  bool IsPending(const TaskHandle& handle) const {
+    Slot* slot = GetSlot(handle);
+    return slot && slot->word.load() == Pack(handle.generation, Pending);
+  }
+
+  // Cancels every pending task, O(number of slots ever allocated)
+  void CancelAll() {
+    uint32_t count = mNextIndex;
+    for (uint32_t index = 0; index < count; ++index) {
+      Slot* slot = GetSlot(index);
+      if (!slot) {
+        continue;
+      }
+      uint64_t word = slot->word.load();
+      if (static_cast<uint32_t>(word) == Pending) {
+        slot->word.compare_exchange_strong(word, Pack(static_cast<uint32_t>(word >> 32), Cancelled));
+      }
+    }
+  }
+
+private:
+  static const uint32_t kFirstChunkBits = 10;
+  static const int kChunkCount = 32 - kFirstChunkBits;
+  static const uint32_t kNoSlot = 0xffffffffu;
+
+  struct Slot {
+    std::atomic<uint64_t> word{static_cast<uint64_t>(1) << 32};
+    std::atomic<uint32_t> next{kNoSlot};
+  };
+
+  static uint64_t Pack(uint32_t generation, uint32_t state) {
+    return (static_cast<uint64_t>(generation) << 32) | state;
+  }
+
+  // Chunk c holds the (1 << kFirstChunkBits) << c slots starting at ((1 << c) - 1) << kFirstChunkBits
+  static int GetChunk(uint32_t index, uint32_t* offset) {
+    uint64_t position = (static_cast<uint64_t>(index) >> kFirstChunkBits) + 1;
+    int chunk = 0;
+    while ((position >> (chunk + 1)) != 0) {
+      ++chunk;
+    }
+    *offset = index - static_cast<uint32_t>(((static_cast<uint64_t>(1) << chunk) - 1) << kFirstChunkBits);
+    return chunk;
+  }
+
+  Slot* GetSlot(uint32_t index) const {
+    uint32_t offset;
+    int chunk = GetChunk(index, &offset);
+    Slot* slots = chunk < kChunkCount ? mChunks[chunk].load(std::memory_order_acquire) : nullptr;
+    return slots ? &slots[offset] : nullptr;
+  }
+
+  Slot* GetSlot(const TaskHandle& handle) const { return handle.IsValid() ? GetSlot(handle.index) : nullptr; }
+
+  // The free stack head packs a tag, bumped on every change against ABA, with the top slot plus one
+  uint32_t Pop() {
+    uint64_t head = mFreeHead.load();
+    while (static_cast<uint32_t>(head) != 0) {
+      uint32_t index = static_cast<uint32_t>(head) - 1;
+      uint32_t next = GetSlot(index)->next.load();
+      uint64_t newHead = (((head >> 32) + 1) << 32) | (next == kNoSlot ? 0 : next + 1);
+      if (mFreeHead.compare_exchange_weak(head, newHead)) {
+        return index;
+      }
+    }
+    uint32_t index = mNextIndex++;
+    uint32_t offset;
+    int chunk = GetChunk(index, &offset);
+    if (!mChunks[chunk].load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(mGrowMutex);
+      if (!mChunks[chunk].load()) {
+        mChunks[chunk].store(new Slot[static_cast<size_t>(1) << (kFirstChunkBits + chunk)], std::memory_order_release);
+      }
+    }
+    return index;
+  }
+
+  void Push(uint32_t index) {
+    Slot& slot = *GetSlot(index);
+    uint64_t head = mFreeHead.load();
+    uint64_t newHead;
+    do {
+      slot.next = static_cast<uint32_t>(head) == 0 ? kNoSlot : static_cast<uint32_t>(head) - 1;
+      newHead = (((head >> 32) + 1) << 32) | (static_cast<uint64_t>(index) + 1);
+    } while (!mFreeHead.compare_exchange_weak(head, newHead));
+  }
+
+  std::atomic<Slot*> mChunks[kChunkCount];
+  std::atomic<uint64_t> mFreeHead;
+  std::atomic<uint32_t> mNextIndex;
+  std::mutex mGrowMutex;
+};
+
+} // namespace taskhandle
+/** @endcond */
+
+/**
+ * @brief AsyncControl cancelling a task by its TaskHandle, with one compare-and-swap and no string lookup or lock
+ * 
+ * @note Holds only the slot table of the dispatcher, so it can safely outlive the dispatcher.
+ */
+class TaskHandleAsyncControl : public AsyncControl {
+public:
+  /** @cond DOXYGEN_HIDE */
+  TaskHandleAsyncControl(const std::shared_ptr<taskhandle::TaskSlots>& slots, const TaskHandle& handle)
+      : mSlots(slots),
+        mHandle(handle) {
+  }
+  /** @endcond */
+
+  /**
+   * @brief Cancel the task if it has not started
+   * 
+   * @return true if the task was pending and will not run, else false
+   */
+  bool Cancel() override {
+    return mSlots && mSlots->Transition(mHandle, taskhandle::Pending, taskhandle::Cancelled);
+  }
+
+  /**
+   * @brief Get the handle of the task
+   */
+  const TaskHandle& GetHandle() const { return mHandle; }
+
+private:
+  std::shared_ptr<taskhandle::TaskSlots> mSlots;
+  TaskHandle mHandle;
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_TASK_HANDLE_H_
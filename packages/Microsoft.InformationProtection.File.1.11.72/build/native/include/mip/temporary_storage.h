@@ -0,0 +1,265 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TemporaryStorage, which places temporary streams in memory or in pooled files on fast storage
+ * 
+ * @file temporary_storage.h
+ */
+
+#ifndef API_MIP_TEMPORARY_STORAGE_H_
+#define API_MIP_TEMPORARY_STORAGE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+#include "mip/error.h"
+#include "mip/memory_budget.h"
+#include "mip/mip_namespace.h"
+#include "mip/spill_stream.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a TemporaryStorage
+ */
+struct TemporaryStorageSettings {
+  std::string directory;                     /**< Directory of the temporary files, e.g. on tmpfs or a local SSD */
+  int64_t maxMemoryBytes = 4 * 1024 * 1024;  /**< Content held in memory before a stream moves to a file */
+  size_t pooledFileCount = 0;                /**< Files created up front and reused, instead of one per stream */
+  int64_t preallocatedBytes = 0;             /**< Space allocated for each pooled file */
+  bool isSecureDeletionEnabled = false;      /**< Whether a file is overwritten with zeros once released */
+  std::shared_ptr<MemoryBudget> memoryBudget; /**< Accounts the memory of the streams */
+  /** Runs the overwriting of released files; done on the releasing thread if not set */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace temporarystorage {
+
+inline bool Preallocate(std::FILE* file, int64_t size) {
+  if (size <= 0) {
+    return true;
+  }
+#if defined(__linux__)
+  return std::fflush(file) == 0 && posix_fallocate(fileno(file), 0, static_cast<off_t>(size)) == 0;
+#else
+  return spillstream::Truncate(file, size);
+#endif
+}
+
+inline int64_t GetFileSize(std::FILE* file) {
+#ifdef _WIN32
+  return _fseeki64(file, 0, SEEK_END) == 0 ? static_cast<int64_t>(_ftelli64(file)) : -1;
+#else
+  return fseeko(file, 0, SEEK_END) == 0 ? static_cast<int64_t>(ftello(file)) : -1;
+#endif
+}
+
+inline bool Overwrite(std::FILE* file) {
+  int64_t size = GetFileSize(file);
+  if (size < 0 || !spillstream::Seek(file, 0)) {
+    return false;
+  }
+  std::vector<uint8_t> zeros(static_cast<size_t>((std::min)(size, static_cast<int64_t>(1024 * 1024))));
+  for (int64_t written = 0; written < size;) {
+    size_t length = static_cast<size_t>((std::min)(size - written, static_cast<int64_t>(zeros.size())));
+    if (std::fwrite(zeros.data(), 1, length, file) != length) {
+      return false;
+    }
+    written += static_cast<int64_t>(length);
+  }
+  return std::fflush(file) == 0;
+}
+
+} // namespace temporarystorage
+/** @endcond */
+
+/**
+ * @brief Places temporary streams in memory up to a threshold, then in files on a chosen, preferably fast, volume
+ * 
+ * @note The SDK picks the location of the temporary files it creates itself, for example for
+ *       FileHandler::GetDecryptedTemporaryFileAsync, so route temporary content through streams instead: create file
+ *       handlers from streams, commit to a stream from CreateStream (or pass GetStreamSettings to
+ *       CommitFileToSpillStream) and decrypt with GetDecryptedStreamWithinCeiling. Streams up to maxMemoryBytes never
+ *       touch the disk. Larger ones take a file from the pool, whose space was allocated up front so writes do not
+ *       extend it, or create one in the directory when the pool is empty. Released files are truncated and
+ *       preallocated again before reuse, so no stream reads content of a previous one; with secure deletion they are
+ *       first overwritten with zeros, on the task dispatcher if set. Create it with TemporaryStorage::Create;
+ *       thread-safe.
+ */
+class TemporaryStorage : public TemporaryFileProvider, public std::enable_shared_from_this<TemporaryStorage> {
+public:
+  /**
+   * @brief Create a temporary storage and its pool of files
+   * 
+   * @param settings Directory, memory threshold, pool and deletion settings
+   * 
+   * @return Temporary storage. A mip::FileIOError is thrown if the pooled files cannot be created.
+   */
+  static std::shared_ptr<TemporaryStorage> Create(const TemporaryStorageSettings& settings) {
+    if (settings.directory.empty()) {
+      throw BadInputError("TemporaryStorage requires a directory");
+    }
+    std::shared_ptr<TemporaryStorage> storage(new TemporaryStorage(settings));
+    for (size_t i = 0; i < settings.pooledFileCount; ++i) {
+      std::string path;
+      std::FILE* file = storage->CreateFile(path);
+      if (file == nullptr || !temporarystorage::Preallocate(file, settings.preallocatedBytes)) {
+        if (file != nullptr) {
+          std::fclose(file);
+          std::remove(path.c_str());
+        }
+        throw FileIOError("Failed to create temporary file " + path);
+      }
+      storage->mPool.emplace_back(file, path);
+    }
+    return storage;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~TemporaryStorage() {
+    for (auto& entry : mPool) {
+      std::fclose(entry.first);
+      std::remove(entry.second.c_str());
+    }
+  }
+  /** @endcond */
+
+  /**
+   * @brief Create an empty temporary stream
+   * 
+   * @return Stream held in memory up to maxMemoryBytes and in a file of this storage beyond
+   */
+  std::shared_ptr<SpillStream> CreateStream() { return CreateSpillStream(GetStreamSettings()); }
+
+  /**
+   * @brief Get the settings of the streams of this storage, e.g. for CommitFileToSpillStream
+   * 
+   * @return Stream settings whose files come from this storage
+   */
+  SpillStreamSettings GetStreamSettings() {
+    SpillStreamSettings settings;
+    settings.maxMemoryBytes = mSettings.maxMemoryBytes;
+    settings.memoryBudget = mSettings.memoryBudget;
+    settings.fileProvider = shared_from_this();
+    return settings;
+  }
+
+  /**
+   * @brief Get the number of files waiting in the pool
+   * 
+   * @return Pooled file count
+   */
+  size_t GetPooledFileCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPool.size();
+  }
+
+  /**
+   * @brief Get a temporary file, from the pool if one is waiting
+   * 
+   * @param path [Output] Path of the file
+   * 
+   * @return File opened for binary reading and writing, or nullptr on failure
+   */
+  std::FILE* Acquire(std::string& path) override {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!mPool.empty()) {
+        std::FILE* file = mPool.back().first;
+        path = std::move(mPool.back().second);
+        mPool.pop_back();
+        return file;
+      }
+    }
+    return CreateFile(path);
+  }
+
+  /**
+   * @brief Give a file back, to be wiped and pooled or deleted
+   * 
+   * @param file File returned by Acquire
+   * @param path Path returned by Acquire
+   */
+  void Release(std::FILE* file, const std::string& path) override {
+    if (file == nullptr) {
+      return;
+    }
+    auto self = shared_from_this();
+    auto recycle = [self, file, path]() { self->Recycle(file, path); };
+    if (mSettings.isSecureDeletionEnabled && mSettings.taskDispatcher) {
+      static std::atomic<uint64_t> sTaskCounter(0);
+      mSettings.taskDispatcher->DispatchTask("mip-temporary-file-" + std::to_string(++sTaskCounter), recycle);
+    } else {
+      recycle();
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  explicit TemporaryStorage(const TemporaryStorageSettings& settings) : mSettings(settings) {}
+
+  std::FILE* CreateFile(std::string& path) {
+    path = spillstream::GetUniquePath(mSettings.directory, this);
+    return std::fopen(path.c_str(), "w+b");
+  }
+
+  void Recycle(std::FILE* file, const std::string& path) {
+    bool isReusable = !mSettings.isSecureDeletionEnabled || temporarystorage::Overwrite(file);
+    isReusable = isReusable && spillstream::Truncate(file, 0) &&
+        temporarystorage::Preallocate(file, mSettings.preallocatedBytes);
+    if (isReusable) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mPool.size() < mSettings.pooledFileCount) {
+        mPool.emplace_back(file, path);
+        return;
+      }
+    }
+    std::fclose(file);
+    std::remove(path.c_str());
+  }
+
+  TemporaryStorageSettings mSettings;
+  mutable std::mutex mMutex;
+  std::vector<std::pair<std::FILE*, std::string>> mPool;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_TEMPORARY_STORAGE_H_
@@ -0,0 +1,400 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TieredStorageDelegate, an in-process cache tier over a shared StorageDelegate
+ * 
+ * @file tiered_storage_delegate.h
+ */
+
+#ifndef API_MIP_TIERED_STORAGE_DELEGATE_H_
+#define API_MIP_TIERED_STORAGE_DELEGATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Settings of a TieredStorageDelegate
+ */
+struct TieredStorageDelegateSettings {
+  /** How long rows found in the shared tier are answered from memory, 0 to not keep them */
+  std::chrono::milliseconds entryTtl = std::chrono::seconds(30);
+  /** How long a query that found no rows in the shared tier is answered from memory, 0 to not keep it */
+  std::chrono::milliseconds negativeEntryTtl = std::chrono::seconds(5);
+  /** Most queries kept in memory per table, the least recently used are evicted first */
+  size_t maxEntriesPerTable = 4096;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace tieredstorage {
+
+struct Counters {
+  std::atomic<uint64_t> hitCount{0};
+  std::atomic<uint64_t> negativeHitCount{0};
+  std::atomic<uint64_t> missCount{0};
+  std::atomic<uint64_t> coalescedCount{0};
+  std::atomic<uint64_t> evictedCount{0};
+};
+
+inline void AppendValues(std::string& key, const std::vector<std::string>& values) {
+  key += std::to_string(values.size());
+  for (const auto& value : values) {
+    key += ':' + std::to_string(value.size()) + ':';
+    key += value;
+  }
+}
+
+inline std::string EncodeQuery(
+    const std::vector<std::string>& queryColumns,
+    const std::vector<std::string>& queryValues) {
+  std::string key;
+  AppendValues(key, queryColumns);
+  AppendValues(key, queryValues);
+  return key;
+}
+
+// Caches the results of Find by query. Every write through the table clears the cache and bumps its version; a read
+// from the shared tier that started before a write is returned to its callers but not cached.
+class Table : public TransactionalStorageTable, public StorageTableCursorSource {
+public:
+  Table(const TieredStorageDelegateSettings& settings, const std::shared_ptr<Counters>& counters)
+      : mSettings(settings),
+        mCounters(counters) {}
+
+  // Points the table at a newly created shared table, whose schema may differ
+  void Reset(const std::shared_ptr<StorageTable>& shared) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mShared = shared;
+    InvalidateLocked();
+  }
+
+  void Insert(const std::vector<std::string>& allColumnValues) override {
+    Write([&allColumnValues](StorageTable& shared) { shared.Insert(allColumnValues); });
+  }
+
+  std::vector<std::vector<std::string>> List() override { return GetShared()->List(); }
+
+  void Update(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    Write([&](StorageTable& shared) { shared.Update(updateColumns, updateValues, queryColumns, queryValues); });
+  }
+
+  void Delete(const std::vector<std::string>& queryColumns, const std::vector<std::string>& queryValues) override {
+    Write([&](StorageTable& shared) { shared.Delete(queryColumns, queryValues); });
+  }
+
+  std::vector<std::vector<std::string>> Find(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    std::string key = EncodeQuery(queryColumns, queryValues);
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto entry = mEntries.find(key);
+    if (entry != mEntries.end()) {
+      if (std::chrono::steady_clock::now() < entry->second.expiry) {
+        mOrder.splice(mOrder.begin(), mOrder, entry->second.position);
+        ++(entry->second.rows->empty() ? mCounters->negativeHitCount : mCounters->hitCount);
+        return *entry->second.rows;
+      }
+      mOrder.erase(entry->second.position);
+      mEntries.erase(entry);
+    }
+
+    // Concurrent misses on one query share a single read of the shared tier
+    auto flight = mFlights.find(key);
+    if (flight != mFlights.end() && flight->second->version == mVersion) {
+      std::shared_ptr<Flight> joined = flight->second;
+      ++mCounters->coalescedCount;
+      mFlightDone.wait(lock, [&joined] { return joined->isDone; });
+      if (joined->error) {
+        std::rethrow_exception(joined->error);
+      }
+      return *joined->rows;
+    }
+    auto started = std::make_shared<Flight>();
+    started->version = mVersion;
+    mFlights[key] = started;
+    std::shared_ptr<StorageTable> shared = mShared;
+    lock.unlock();
+    ++mCounters->missCount;
+
+    std::shared_ptr<const std::vector<std::vector<std::string>>> rows;
+    std::exception_ptr error;
+    try {
+      rows = std::make_shared<const std::vector<std::vector<std::string>>>(shared->Find(queryColumns, queryValues));
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    started->rows = rows;
+    started->error = error;
+    started->isDone = true;
+    flight = mFlights.find(key);
+    if (flight != mFlights.end() && flight->second == started) {
+      mFlights.erase(flight);
+    }
+    if (!error && started->version == mVersion) {
+      Store(key, rows);
+    }
+    mFlightDone.notify_all();
+    lock.unlock();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return *rows;
+  }
+
+  void InsertBatch(const std::vector<std::vector<std::string>>& rows) override {
+    Write([&rows](StorageTable& shared) { InsertRows(shared, rows); });
+  }
+
+  void UpdateBatch(const std::vector<StorageTableUpdate>& updates) override {
+    Write([&updates](StorageTable& shared) { UpdateRows(shared, updates); });
+  }
+
+  void BeginTransaction() override {
+    TransactionalStorageTable* shared = dynamic_cast<TransactionalStorageTable*>(GetShared().get());
+    if (shared != nullptr) {
+      shared->BeginTransaction();
+    }
+  }
+
+  void CommitTransaction() override {
+    TransactionalStorageTable* shared = dynamic_cast<TransactionalStorageTable*>(GetShared().get());
+    if (shared != nullptr) {
+      shared->CommitTransaction();
+    }
+  }
+
+  std::unique_ptr<StorageTableCursor> OpenCursor(const StorageTableQuery& query) override {
+    return OpenStorageTableCursor(*GetShared(), query);
+  }
+
+private:
+  struct Entry {
+    std::shared_ptr<const std::vector<std::vector<std::string>>> rows;
+    std::chrono::steady_clock::time_point expiry;
+    std::list<std::string>::iterator position;
+  };
+
+  struct Flight {
+    uint64_t version = 0;
+    bool isDone = false;
+    std::shared_ptr<const std::vector<std::vector<std::string>>> rows;
+    std::exception_ptr error;
+  };
+
+  std::shared_ptr<StorageTable> GetShared() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mShared;
+  }
+
+  // Writes through to the shared tier, dropping the cache even if the write fails part way
+  template <typename Function>
+  void Write(Function&& function) {
+    std::shared_ptr<StorageTable> shared = GetShared();
+    try {
+      function(*shared);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      InvalidateLocked();
+      throw;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    InvalidateLocked();
+  }
+
+  void InvalidateLocked() {
+    ++mVersion;
+    mEntries.clear();
+    mOrder.clear();
+  }
+
+  void Store(const std::string& key, const std::shared_ptr<const std::vector<std::vector<std::string>>>& rows) {
+    std::chrono::milliseconds ttl = rows->empty() ? mSettings.negativeEntryTtl : mSettings.entryTtl;
+    if (ttl.count() <= 0 || mSettings.maxEntriesPerTable == 0) {
+      return;
+    }
+    while (mEntries.size() >= mSettings.maxEntriesPerTable) {
+      mEntries.erase(mOrder.back());
+      mOrder.pop_back();
+      ++mCounters->evictedCount;
+    }
+    mOrder.push_front(key);
+    Entry& entry = mEntries[key];
+    entry.rows = rows;
+    entry.expiry = std::chrono::steady_clock::now() + ttl;
+    entry.position = mOrder.begin();
+  }
+
+  const TieredStorageDelegateSettings mSettings;
+  const std::shared_ptr<Counters> mCounters;
+  std::mutex mMutex;
+  std::condition_variable mFlightDone;
+  std::shared_ptr<StorageTable> mShared;
+  uint64_t mVersion = 0;
+  std::unordered_map<std::string, Entry> mEntries;
+  std::list<std::string> mOrder; // most recently used first
+  std::unordered_map<std::string, std::shared_ptr<Flight>> mFlights;
+};
+
+} // namespace tieredstorage
+/** @endcond */
+
+/**
+ * @brief StorageDelegate answering repeated reads from memory in front of a StorageDelegate shared by many processes
+ * 
+ * @note Wrap a delegate over a store shared by a cluster, for example one backed by Redis, and pass the result to
+ *       MipConfiguration::SetStorageDelegate on each node. The licenses, templates and policies one node stores in the
+ *       shared tier are found there by the others, which then keep them in memory:
+ *       - Find results are kept for TieredStorageDelegateSettings::entryTtl, and queries that found nothing for
+ *         negativeEntryTtl, so lookups of absent entries do not reach the shared tier every time.
+ *       - Concurrent Find calls for the same query wait for a single read of the shared tier.
+ *       - Insert, Update and Delete write through to the shared tier and drop the table's memory tier. Versions
+ *         ensure that a read racing a write is not cached.
+ *       Writes made by other processes become visible within entryTtl. List and cursors always read the shared tier.
+ *       GetSettings returns the settings of the shared delegate: a shared delegate reporting
+ *       StorageSettings::IsRemoteStorage makes the SDK encrypt the columns it passes as encrypted columns itself.
+ */
+class TieredStorageDelegate : public StorageDelegate {
+public:
+  /**
+   * @brief TieredStorageDelegate constructor
+   * 
+   * @param shared Delegate of the tier shared between processes
+   * @param settings Lifetimes and size of the memory tier
+   */
+  explicit TieredStorageDelegate(
+      const std::shared_ptr<StorageDelegate>& shared,
+      const TieredStorageDelegateSettings& settings = TieredStorageDelegateSettings())
+      : mShared(shared),
+        mSettings(settings),
+        mCounters(std::make_shared<tieredstorage::Counters>()) {
+    if (!shared) {
+      throw BadInputError("TieredStorageDelegate requires a shared StorageDelegate");
+    }
+  }
+
+  /**
+   * @brief Create the table in the shared tier and put a memory tier in front of it
+   * 
+   * @param path Default path for mip storage.
+   * @param mipComponent #MipComponent associated with this table.
+   * @param tableName Name of the table to create.
+   * @param allColumns All columns represented in the table.
+   * @param encryptedColumns Columns within @p allColumns that need to be encrypted, passed to the shared delegate
+   * @param keyColumns Key columns used to identify unique table entries.
+   * 
+   * @return The table, or the error of the shared delegate
+   * 
+   * @note Tables created more than once share their memory tier, so writes through any of them invalidate it.
+   */
+  StorageTableResult CreateStorageTable(
+      const std::string& path,
+      const MipComponent mipComponent,
+      const std::string& tableName,
+      const std::vector<std::string>& allColumns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) const override {
+    StorageTableResult shared =
+        mShared->CreateStorageTable(path, mipComponent, tableName, allColumns, encryptedColumns, keyColumns);
+    if (shared.GetError()) {
+      return shared;
+    }
+    std::string key = std::to_string(static_cast<unsigned int>(mipComponent)) + '\n' + path + '\n' + tableName;
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<tieredstorage::Table>& table = mTables[key];
+    if (!table) {
+      table = std::make_shared<tieredstorage::Table>(mSettings, mCounters);
+    }
+    table->Reset(shared.GetData());
+    return StorageTableResult(table);
+  }
+
+  /**
+   * @brief Gets the settings of the shared delegate
+   */
+  StorageSettings GetSettings() const override { return mShared->GetSettings(); }
+
+  /**
+   * @brief Get the number of Find calls answered from memory with rows
+   */
+  uint64_t GetHitCount() const { return mCounters->hitCount; }
+
+  /**
+   * @brief Get the number of Find calls answered from memory with no rows
+   */
+  uint64_t GetNegativeHitCount() const { return mCounters->negativeHitCount; }
+
+  /**
+   * @brief Get the number of Find calls that read the shared tier
+   */
+  uint64_t GetMissCount() const { return mCounters->missCount; }
+
+  /**
+   * @brief Get the number of Find calls that waited for another call's read of the shared tier
+   */
+  uint64_t GetCoalescedCount() const { return mCounters->coalescedCount; }
+
+  /**
+   * @brief Get the number of queries evicted from memory to stay within maxEntriesPerTable
+   */
+  uint64_t GetEvictedCount() const { return mCounters->evictedCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  const std::shared_ptr<StorageDelegate> mShared;
+  const TieredStorageDelegateSettings mSettings;
+  const std::shared_ptr<tieredstorage::Counters> mCounters;
+  mutable std::mutex mMutex;
+  mutable std::map<std::string, std::shared_ptr<tieredstorage::Table>> mTables;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_TIERED_STORAGE_DELEGATE_H_
@@ -0,0 +1,348 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TimerWheel, a hierarchical timer wheel with millisecond resolution and O(1) schedule and cancel
+ * 
+ * @file timer_wheel.h
+ */
+
+#ifndef API_MIP_TIMER_WHEEL_H_
+#define API_MIP_TIMER_WHEEL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Identifies a timer scheduled on a TimerWheel
+ */
+struct TimerHandle {
+  uint32_t index = 0;      /**< Slot of the timer */
+  uint32_t generation = 0; /**< Generation of the slot when the timer was scheduled, 0 for no timer */
+
+  /** @brief Whether the handle was returned by TimerWheel::Schedule */
+  bool IsValid() const { return generation != 0; }
+};
+
+/**
+ * @brief Runs callbacks after millisecond delays on one thread, using five levels of 64-slot wheels
+ * 
+ * @note Scheduling and cancelling are O(1): timers live in a slab addressed by TimerHandle and are linked into the
+ *       slot of their expiry, and timers further out than a level's range cascade down as time passes. The thread
+ *       sleeps until the next tick at which a non-empty slot expires or cascades, so idle timers cost no wakeups and
+ *       timers expiring in the same millisecond share one. Callbacks run on the wheel's thread, outside its lock, and
+ *       should only hand work off, e.g. to a TaskDispatcherDelegate. Pending timers are dropped on destruction.
+ */
+class TimerWheel {
+public:
+  /**
+   * @brief Start the timer thread
+   */
+  TimerWheel()
+      : mStart(std::chrono::steady_clock::now()),
+        mCurrentTick(0),
+        mPendingCount(0),
+        mFreeList(kNoNode),
+        mIsStopping(false),
+        mWakeupCount(0) {
+    for (auto& slot : mSlots) {
+      slot = kNoNode;
+    }
+    mThread = std::thread([this]() { Run(); });
+  }
+
+  /**
+   * @brief Stop the timer thread, dropping pending timers
+   */
+  ~TimerWheel() { Stop(); }
+
+  /**
+   * @brief Run a callback after a delay
+   * 
+   * @param delay Delay, 0 or negative to run on the next tick
+   * @param callback Function to run
+   * 
+   * @return Handle to cancel the timer
+   */
+  TimerHandle Schedule(std::chrono::milliseconds delay, std::function<void()> callback) {
+    uint64_t nextWake;
+    TimerHandle handle;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      uint32_t index = Allocate();
+      Node& node = mNodes[index];
+      // The current tick is partly over, so one more tick guarantees at least the requested delay
+      node.expiry = GetTick() + 1 + static_cast<uint64_t>(delay.count() > 0 ? delay.count() : 0);
+      node.expiry = node.expiry > mCurrentTick ? node.expiry : mCurrentTick + 1;
+      node.callback = std::move(callback);
+      Link(index);
+      mPendingCount++;
+      handle.index = index;
+      handle.generation = node.generation;
+      nextWake = node.expiry;
+    }
+    if (nextWake < mSleepUntil) {
+      mChanged.notify_one();
+    }
+    return handle;
+  }
+
+  /**
+   * @brief Cancel a timer that has not fired
+   * 
+   * @param handle Handle returned by Schedule
+   * 
+   * @return true if the timer was pending and will not fire
+   */
+  bool Cancel(const TimerHandle& handle) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!handle.IsValid() || handle.index >= mNodes.size() || mNodes[handle.index].generation != handle.generation ||
+        !mNodes[handle.index].isLinked) {
+      return false;
+    }
+    Unlink(handle.index);
+    Release(handle.index);
+    mPendingCount--;
+    return true;
+  }
+
+  /**
+   * @brief Stop the timer thread, dropping pending timers. Waits for a running callback to return.
+   */
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mIsStopping = true;
+    }
+    mChanged.notify_all();
+    if (mThread.joinable() && mThread.get_id() != std::this_thread::get_id()) {
+      mThread.join();
+    }
+  }
+
+  /**
+   * @brief Get the number of timers that have not fired
+   */
+  size_t GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPendingCount;
+  }
+
+  /**
+   * @brief Get the number of times the timer thread woke up, for observing wakeup coalescing
+   */
+  uint64_t GetWakeupCount() const { return mWakeupCount; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static const int kSlotBits = 6;
+  static const uint64_t kSlotCount = 1u << kSlotBits;
+  static const int kLevelCount = 5;
+  static const uint64_t kMaxDelta = (static_cast<uint64_t>(1) << (kSlotBits * kLevelCount)) - 1;
+  static const uint32_t kNoNode = 0xffffffffu;
+
+  struct Node {
+    uint64_t expiry = 0;
+    std::function<void()> callback;
+    uint32_t previous = kNoNode;
+    uint32_t next = kNoNode;
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+    bool isLinked = false;
+  };
+
+  uint64_t GetTick() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - mStart).count());
+  }
+
+  uint32_t Allocate() {
+    if (mFreeList != kNoNode) {
+      uint32_t index = mFreeList;
+      mFreeList = mNodes[index].next;
+      return index;
+    }
+    mNodes.emplace_back();
+    mNodes.back().generation = 1;
+    return static_cast<uint32_t>(mNodes.size() - 1);
+  }
+
+  void Release(uint32_t index) {
+    Node& node = mNodes[index];
+    node.callback = nullptr;
+    node.generation = node.generation == 0xffffffffu ? 1 : node.generation + 1;
+    node.next = mFreeList;
+    mFreeList = index;
+  }
+
+  // Timers beyond the range of the top level wait in its furthest slot and are re-linked when it cascades
+  void Link(uint32_t index) {
+    Node& node = mNodes[index];
+    uint64_t delta = node.expiry > mCurrentTick ? node.expiry - mCurrentTick : 0;
+    uint64_t bucketTick = delta > kMaxDelta ? mCurrentTick + kMaxDelta : (delta == 0 ? mCurrentTick : node.expiry);
+    delta = bucketTick - mCurrentTick;
+    int level = 0;
+    while (level < kLevelCount - 1 && delta >= (kSlotCount << (kSlotBits * level))) {
+      ++level;
+    }
+    node.slot = static_cast<uint32_t>(level * kSlotCount + ((bucketTick >> (kSlotBits * level)) & (kSlotCount - 1)));
+    node.previous = kNoNode;
+    node.next = mSlots[node.slot];
+    if (node.next != kNoNode) {
+      mNodes[node.next].previous = index;
+    }
+    mSlots[node.slot] = index;
+    node.isLinked = true;
+  }
+
+  void Unlink(uint32_t index) {
+    Node& node = mNodes[index];
+    if (node.previous != kNoNode) {
+      mNodes[node.previous].next = node.next;
+    } else {
+      mSlots[node.slot] = node.next;
+    }
+    if (node.next != kNoNode) {
+      mNodes[node.next].previous = node.previous;
+    }
+    node.isLinked = false;
+  }
+
+  // Earliest tick after the current one at which a non-empty slot expires or cascades
+  uint64_t GetNextEventTick() const {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < kLevelCount; ++level) {
+      int shift = kSlotBits * level;
+      uint64_t base = mCurrentTick >> shift;
+      for (uint64_t step = 1; step <= kSlotCount; ++step) {
+        uint64_t slot = level * kSlotCount + ((base + step) & (kSlotCount - 1));
+        if (mSlots[slot] != kNoNode) {
+          uint64_t tick = (base + step) << shift;
+          next = tick < next ? tick : next;
+          break;
+        }
+      }
+    }
+    return next;
+  }
+
+  // Moves the wheel to @p tick, collecting the callbacks of expired timers
+  void ProcessTick(uint64_t tick, std::vector<std::function<void()>>& expired) {
+    mCurrentTick = tick;
+    for (int level = kLevelCount - 1; level > 0; --level) {
+      int shift = kSlotBits * level;
+      if ((tick & ((static_cast<uint64_t>(1) << shift) - 1)) != 0) {
+        continue;
+      }
+      uint32_t slot = static_cast<uint32_t>(level * kSlotCount + ((tick >> shift) & (kSlotCount - 1)));
+      uint32_t index = mSlots[slot];
+      mSlots[slot] = kNoNode;
+      while (index != kNoNode) {
+        uint32_t next = mNodes[index].next;
+        Link(index);
+        index = next;
+      }
+    }
+    uint32_t slot = static_cast<uint32_t>(tick & (kSlotCount - 1));
+    uint32_t index = mSlots[slot];
+    mSlots[slot] = kNoNode;
+    while (index != kNoNode) {
+      uint32_t next = mNodes[index].next;
+      mNodes[index].isLinked = false;
+      if (mNodes[index].expiry <= tick) {
+        expired.push_back(std::move(mNodes[index].callback));
+        Release(index);
+        mPendingCount--;
+      } else {
+        Link(index);
+      }
+      index = next;
+    }
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::vector<std::function<void()>> expired;
+    while (!mIsStopping) {
+      uint64_t now = GetTick();
+      uint64_t next = GetNextEventTick();
+      while (next <= now) {
+        ProcessTick(next, expired);
+        next = GetNextEventTick();
+      }
+      mCurrentTick = now > mCurrentTick ? now : mCurrentTick;
+      if (!expired.empty()) {
+        lock.unlock();
+        for (auto& callback : expired) {
+          try {
+            callback();
+          } catch (...) {
+          }
+        }
+        expired.clear();
+        lock.lock();
+        continue;
+      }
+      mSleepUntil = next;
+      if (next == UINT64_MAX) {
+        mChanged.wait(lock);
+      } else {
+        mChanged.wait_until(lock, mStart + std::chrono::milliseconds(next));
+      }
+      mSleepUntil = 0;
+      mWakeupCount++;
+    }
+  }
+
+  const std::chrono::steady_clock::time_point mStart;
+  uint64_t mCurrentTick;
+  size_t mPendingCount;
+  std::vector<Node> mNodes;
+  uint32_t mSlots[kSlotCount * kLevelCount];
+  uint32_t mFreeList;
+  bool mIsStopping;
+  std::atomic<uint64_t> mSleepUntil{0};
+  std::atomic<uint64_t> mWakeupCount;
+  mutable std::mutex mMutex;
+  std::condition_variable mChanged;
+  std::thread mThread;
+  /** @endcond */
+}; // class TimerWheel
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_TIMER_WHEEL_H_
@@ -0,0 +1,597 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines TracingDelegate and the decorators opening spans for dispatched tasks and HTTP calls, with W3C
+ *        trace context propagated through the logger context
+ * 
+ * @file tracing_delegate.h
+ */
+
+#ifndef API_MIP_TRACING_DELEGATE_H_
+#define API_MIP_TRACING_DELEGATE_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/http_delegate.h"
+#include "mip/http_operation.h"
+#include "mip/http_request.h"
+#include "mip/http_response.h"
+#include "mip/logger_context.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Identity of a span, as carried by the W3C traceparent header
+ */
+struct TraceContext {
+  std::array<uint8_t, 16> traceId = {}; /**< Trace id, all zero when not set */
+  std::array<uint8_t, 8> spanId = {};   /**< Span id, all zero when not set */
+  uint8_t flags = 1;                    /**< Trace flags, 1 when sampled */
+
+  /**
+   * @brief Get if the trace and span ids are set
+   */
+  bool IsValid() const {
+    return traceId != std::array<uint8_t, 16>() && spanId != std::array<uint8_t, 8>();
+  }
+
+  /**
+   * @brief Get the trace id as 32 lowercase hex digits
+   */
+  std::string GetTraceIdHex() const { return ToHex(traceId.data(), traceId.size()); }
+
+  /**
+   * @brief Get the span id as 16 lowercase hex digits
+   */
+  std::string GetSpanIdHex() const { return ToHex(spanId.data(), spanId.size()); }
+
+  /**
+   * @brief Get the value of a traceparent header, "00-<trace id>-<span id>-<flags>"
+   */
+  std::string ToTraceparent() const {
+    return "00-" + GetTraceIdHex() + "-" + GetSpanIdHex() + "-" + ToHex(&flags, 1);
+  }
+
+  /**
+   * @brief Parses a traceparent header
+   * 
+   * @param traceparent Header value
+   * @param context Receives the trace context
+   * 
+   * @return false if the value is not a valid version 00 traceparent
+   */
+  static bool FromTraceparent(const std::string& traceparent, TraceContext& context) {
+    TraceContext parsed;
+    if (traceparent.size() < 55 || traceparent.compare(0, 3, "00-") != 0 || traceparent[35] != '-' ||
+        traceparent[52] != '-' || (traceparent.size() > 55 && traceparent[55] != '-')) {
+      return false;
+    }
+    if (!FromHex(traceparent, 3, parsed.traceId.data(), parsed.traceId.size()) ||
+        !FromHex(traceparent, 36, parsed.spanId.data(), parsed.spanId.size()) ||
+        !FromHex(traceparent, 53, &parsed.flags, 1) || !parsed.IsValid()) {
+      return false;
+    }
+    context = parsed;
+    return true;
+  }
+
+  /**
+   * @brief Creates the context of a new trace, with random ids
+   */
+  static TraceContext CreateRoot() {
+    TraceContext context;
+    FillRandom(context.traceId.data(), context.traceId.size());
+    FillRandom(context.spanId.data(), context.spanId.size());
+    return context;
+  }
+
+  /**
+   * @brief Creates the context of a child span in the same trace, with a random span id
+   */
+  TraceContext CreateChild() const {
+    TraceContext context = *this;
+    FillRandom(context.spanId.data(), context.spanId.size());
+    return context;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static std::string ToHex(const uint8_t* data, size_t size) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+      hex.push_back(kDigits[data[i] >> 4]);
+      hex.push_back(kDigits[data[i] & 0xF]);
+    }
+    return hex;
+  }
+
+  static bool FromHex(const std::string& text, size_t offset, uint8_t* data, size_t size) {
+    auto digit = [](char c) {
+      return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    };
+    for (size_t i = 0; i < size; ++i) {
+      int high = digit(text[offset + 2 * i]);
+      int low = digit(text[offset + 2 * i + 1]);
+      if (high < 0 || low < 0) {
+        return false;
+      }
+      data[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return true;
+  }
+
+  static void FillRandom(uint8_t* data, size_t size) {
+    static thread_local std::mt19937_64 engine(std::random_device{}());
+    do {
+      for (size_t i = 0; i < size; i += 8) {
+        uint64_t value = engine();
+        for (size_t j = i; j < size && j < i + 8; ++j) {
+          data[j] = static_cast<uint8_t>(value >> (8 * (j - i)));
+        }
+      }
+    } while (std::all_of(data, data + size, [](uint8_t byte) { return byte == 0; }));
+  }
+  /** @endcond */
+};
+
+/**
+ * @brief Kind of a span, as in OpenTelemetry
+ */
+enum class TraceSpanKind : unsigned int {
+  Internal = 0, /**< Work inside the process, such as a queued or running task */
+  Client   = 1, /**< Outgoing request, such as an HTTP call */
+};
+
+/**
+ * @brief A span opened by a TracingDelegate
+ */
+class TraceSpan {
+public:
+  /**
+   * @brief Get the identity of the span, the parent of the spans it contains
+   */
+  virtual const TraceContext& GetContext() const = 0;
+
+  /**
+   * @brief Sets a string attribute
+   */
+  virtual void SetAttribute(const std::string& name, const std::string& value) = 0;
+
+  /**
+   * @brief Sets an integer attribute
+   */
+  virtual void SetAttribute(const std::string& name, int64_t value) = 0;
+
+  /**
+   * @brief Marks the span as failed
+   * 
+   * @param description Error description
+   */
+  virtual void SetError(const std::string& description) = 0;
+
+  /**
+   * @brief Ends the span, called once
+   */
+  virtual void End() = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~TraceSpan() {}
+protected:
+  TraceSpan() {}
+  /** @endcond */
+};
+
+/**
+ * @brief Delegate creating spans, typically backed by an OpenTelemetry tracer. Implementations must be thread-safe.
+ * 
+ * @note An OpenTelemetry implementation starts a span whose parent is a remote span context built from the parent's
+ *       trace id, span id and flags, and returns its own ids from TraceSpan::GetContext.
+ */
+class TracingDelegate {
+public:
+  /**
+   * @brief Starts a span
+   * 
+   * @param name Span name, e.g. "HTTP POST"
+   * @param parent Parent span, always valid
+   * @param kind Span kind
+   * 
+   * @return The span, or nullptr not to trace this step (e.g. when not sampled)
+   */
+  virtual std::shared_ptr<TraceSpan> StartSpan(const std::string& name, const TraceContext& parent,
+      TraceSpanKind kind) = 0;
+
+  /** @cond DOXYGEN_HIDE */
+  virtual ~TracingDelegate() {}
+protected:
+  TracingDelegate() {}
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace tracing {
+
+inline TraceContext& GetCurrentContext() {
+  static thread_local TraceContext current;
+  return current;
+}
+
+} // namespace tracing
+/** @endcond */
+
+/**
+ * @brief Logger context carrying a trace context, to pass where the SDK takes a loggerContext
+ * 
+ * @note For example as FileEngine::Settings::SetLoggerContext or to an *Async call. The SDK hands the same pointer to
+ *       the TaskDispatcherDelegate, the HttpDelegate and LoggerDelegate::WriteToLogWithContext, where
+ *       TraceLoggerContext::From recognizes it, so TracingTaskDispatcherDelegate and TracingHttpDelegate open their
+ *       spans under it. Your own context, if any, is kept as the inner context.
+ */
+class TraceLoggerContext final : public LinkedLoggerContext {
+public:
+  /**
+   * @brief Creates a logger context
+   * 
+   * @param context Parent of the spans opened for the calls it is passed to
+   * @param innerContext Application context carried along
+   */
+  explicit TraceLoggerContext(const TraceContext& context,
+      const std::shared_ptr<void>& innerContext = std::shared_ptr<void>())
+      : LinkedLoggerContext(this, innerContext),
+        mContext(context) {}
+
+  /**
+   * @brief Get the trace context
+   */
+  const TraceContext& GetTraceContext() const { return mContext; }
+
+  /**
+   * @brief Get the TraceLoggerContext a logger context points to
+   * 
+   * @param loggerContext Logger context received from the SDK
+   * 
+   * @return The TraceLoggerContext, also when wrapped by another LinkedLoggerContext, or nullptr if there is none
+   */
+  static std::shared_ptr<TraceLoggerContext> From(const std::shared_ptr<void>& loggerContext) {
+    return FindLoggerContext<TraceLoggerContext>(loggerContext);
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  TraceContext mContext;
+  /** @endcond */
+};
+
+/**
+ * @brief Makes a trace context the current one of the calling thread for its lifetime
+ * 
+ * @note Tasks run by TracingTaskDispatcherDelegate have their span as current trace context, so work they start
+ *       without a TraceLoggerContext, such as HTTP calls, is traced under them.
+ */
+class TraceScope {
+public:
+  /**
+   * @brief Sets the current trace context
+   * 
+   * @param context Trace context, an invalid context clears it
+   */
+  explicit TraceScope(const TraceContext& context) : mPrevious(tracing::GetCurrentContext()) {
+    tracing::GetCurrentContext() = context;
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  /** @cond DOXYGEN_HIDE */
+  ~TraceScope() { tracing::GetCurrentContext() = mPrevious; }
+
+private:
+  TraceContext mPrevious;
+  /** @endcond */
+};
+
+/**
+ * @brief Get the parent of a span opened for a call
+ * 
+ * @param loggerContext Logger context passed with the call
+ * 
+ * @return The trace context of a TraceLoggerContext, else the current trace context of the calling thread, which
+ *         is invalid outside a TraceScope
+ */
+inline TraceContext GetParentTraceContext(const std::shared_ptr<void>& loggerContext) {
+  auto traceLoggerContext = TraceLoggerContext::From(loggerContext);
+  return traceLoggerContext ? traceLoggerContext->GetTraceContext() : tracing::GetCurrentContext();
+}
+
+/** @cond DOXYGEN_HIDE */
+namespace tracing {
+
+inline std::string GetErrorDescription(std::exception_ptr error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception& e) {
+    return e.what();
+  } catch (...) {
+    return "Unknown error";
+  }
+}
+
+// Ends the queue span when the task starts, then runs it under a span of its own
+inline std::function<void()> WrapTask(const std::shared_ptr<TracingDelegate>& tracer, const std::string& taskId,
+    std::function<void()> task, const std::shared_ptr<void>& loggerContext) {
+  TraceContext parent = GetParentTraceContext(loggerContext);
+  if (!parent.IsValid()) {
+    return task;
+  }
+  std::shared_ptr<TraceSpan> queueSpan = tracer->StartSpan("mip.task.queued", parent, TraceSpanKind::Internal);
+  if (queueSpan) {
+    queueSpan->SetAttribute("mip.task_id", taskId);
+  }
+  return [tracer, taskId, task, parent, queueSpan]() {
+    if (queueSpan) {
+      queueSpan->End();
+    }
+    std::shared_ptr<TraceSpan> runSpan = tracer->StartSpan("mip.task.run", parent, TraceSpanKind::Internal);
+    if (!runSpan) {
+      TraceScope scope(parent);
+      task();
+      return;
+    }
+    runSpan->SetAttribute("mip.task_id", taskId);
+    TraceScope scope(runSpan->GetContext());
+    try {
+      task();
+    } catch (...) {
+      runSpan->SetError(GetErrorDescription(std::current_exception()));
+      runSpan->End();
+      throw;
+    }
+    runSpan->End();
+  };
+}
+
+class TracedRequest : public HttpRequest {
+public:
+  TracedRequest(const std::shared_ptr<HttpRequest>& request, const TraceContext& context)
+      : mRequest(request),
+        mHeaders(request->GetHeaders()) {
+    mHeaders["traceparent"] = context.ToTraceparent();
+  }
+  const std::string& GetId() const override { return mRequest->GetId(); }
+  HttpRequestType GetRequestType() const override { return mRequest->GetRequestType(); }
+  const std::string& GetUrl() const override { return mRequest->GetUrl(); }
+  const std::vector<uint8_t>& GetBody() const override { return mRequest->GetBody(); }
+  const std::map<std::string, std::string, CaseInsensitiveComparator>& GetHeaders() const override {
+    return mHeaders;
+  }
+  TransportLayerSecurityMinimumVersion GetTransportLayerSecurityMinimumVersion() const override {
+    return mRequest->GetTransportLayerSecurityMinimumVersion();
+  }
+
+private:
+  std::shared_ptr<HttpRequest> mRequest;
+  std::map<std::string, std::string, CaseInsensitiveComparator> mHeaders;
+};
+
+inline void EndHttpSpan(TraceSpan& span, const std::shared_ptr<HttpOperation>& operation) {
+  std::shared_ptr<HttpResponse> response;
+  try {
+    response = operation ? operation->GetResponse() : nullptr;
+  } catch (...) {
+  }
+  if (operation && operation->IsCancelled()) {
+    span.SetError("Cancelled");
+  } else if (!response) {
+    span.SetError("No response");
+  } else {
+    span.SetAttribute("http.status_code", static_cast<int64_t>(response->GetStatusCode()));
+    if (response->GetStatusCode() >= 400) {
+      span.SetError("HTTP " + std::to_string(response->GetStatusCode()));
+    }
+  }
+  span.End();
+}
+
+} // namespace tracing
+/** @endcond */
+
+/**
+ * @brief TaskDispatcherDelegate decorator opening a span for the time each task waits and one for its run
+ * 
+ * @note Tasks dispatched with a TraceLoggerContext, or from a thread with a current trace context, are traced: a
+ *       "mip.task.queued" span from dispatch to start and a "mip.task.run" span around the task, which is the current
+ *       trace context while it runs. Other tasks are passed through untouched.
+ */
+class TracingTaskDispatcherDelegate : public TaskDispatcherDelegate {
+public:
+  /**
+   * @brief Creates the decorator
+   * 
+   * @param inner Dispatcher running the tasks
+   * @param tracer Delegate creating the spans
+   */
+  TracingTaskDispatcherDelegate(const std::shared_ptr<TaskDispatcherDelegate>& inner,
+      const std::shared_ptr<TracingDelegate>& tracer)
+      : mInner(inner),
+        mTracer(tracer) {
+    if (!mInner || !mTracer) {
+      throw BadInputError("TracingTaskDispatcherDelegate requires a dispatcher and a tracing delegate");
+    }
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    mInner->DispatchTask(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), nullptr));
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->DispatchTask(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), loggerContext), loggerContext);
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    mInner->DispatchTask(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), nullptr), delaySeconds);
+  }
+
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->DispatchTask(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), loggerContext), delaySeconds,
+        loggerContext);
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task) override {
+    mInner->ExecuteTaskOnIndependentThread(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), nullptr));
+  }
+
+  void ExecuteTaskOnIndependentThread(const std::string& taskId, std::function<void()> task,
+      const std::shared_ptr<void>& loggerContext) override {
+    mInner->ExecuteTaskOnIndependentThread(taskId, tracing::WrapTask(mTracer, taskId, std::move(task), loggerContext),
+        loggerContext);
+  }
+
+  bool CancelTask(const std::string& taskId) override { return mInner->CancelTask(taskId); }
+
+  bool CancelTask(const std::string& taskId, const std::shared_ptr<void>& loggerContext) override {
+    return mInner->CancelTask(taskId, loggerContext);
+  }
+
+  void CancelAllTasks() override { mInner->CancelAllTasks(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<TaskDispatcherDelegate> mInner;
+  std::shared_ptr<TracingDelegate> mTracer;
+  /** @endcond */
+};
+
+/**
+ * @brief HttpDelegate decorator opening a client span for each request and sending its W3C traceparent header
+ * 
+ * @note Requests whose context is a TraceLoggerContext, or that are sent from a thread with a current trace
+ *       context, are traced as "HTTP GET" or "HTTP POST" spans with the url and status code as attributes. Other
+ *       requests are passed through untouched.
+ */
+class TracingHttpDelegate : public HttpDelegate {
+public:
+  /**
+   * @brief Creates the decorator
+   * 
+   * @param inner Delegate sending the requests
+   * @param tracer Delegate creating the spans
+   */
+  TracingHttpDelegate(const std::shared_ptr<HttpDelegate>& inner, const std::shared_ptr<TracingDelegate>& tracer)
+      : mInner(inner),
+        mTracer(tracer) {
+    if (!mInner || !mTracer) {
+      throw BadInputError("TracingHttpDelegate requires an HTTP delegate and a tracing delegate");
+    }
+  }
+
+  std::shared_ptr<HttpOperation> Send(const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) override {
+    auto span = StartSpan(request, context);
+    if (!span) {
+      return mInner->Send(request, context);
+    }
+    std::shared_ptr<HttpOperation> operation;
+    try {
+      operation = mInner->Send(std::make_shared<tracing::TracedRequest>(request, span->GetContext()), context);
+    } catch (...) {
+      span->SetError(tracing::GetErrorDescription(std::current_exception()));
+      span->End();
+      throw;
+    }
+    tracing::EndHttpSpan(*span, operation);
+    return operation;
+  }
+
+  std::shared_ptr<HttpOperation> SendAsync(const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context,
+      const std::function<void(std::shared_ptr<HttpOperation>)>& callbackFn) override {
+    auto span = StartSpan(request, context);
+    if (!span) {
+      return mInner->SendAsync(request, context, callbackFn);
+    }
+    auto callback = [span, callbackFn](std::shared_ptr<HttpOperation> operation) {
+      tracing::EndHttpSpan(*span, operation);
+      if (callbackFn) {
+        callbackFn(operation);
+      }
+    };
+    try {
+      return mInner->SendAsync(std::make_shared<tracing::TracedRequest>(request, span->GetContext()), context,
+          callback);
+    } catch (...) {
+      span->SetError(tracing::GetErrorDescription(std::current_exception()));
+      span->End();
+      throw;
+    }
+  }
+
+  void CancelOperation(const std::string& requestId) override { mInner->CancelOperation(requestId); }
+
+  void CancelAllOperations() override { mInner->CancelAllOperations(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<TraceSpan> StartSpan(const std::shared_ptr<HttpRequest>& request,
+      const std::shared_ptr<void>& context) {
+    TraceContext parent = GetParentTraceContext(context);
+    if (!request || !parent.IsValid()) {
+      return nullptr;
+    }
+    const char* method = request->GetRequestType() == HttpRequestType::Post ? "POST" : "GET";
+    auto span = mTracer->StartSpan(std::string("HTTP ") + method, parent, TraceSpanKind::Client);
+    if (span) {
+      span->SetAttribute("http.method", method);
+      span->SetAttribute("http.url", request->GetUrl());
+    }
+    return span;
+  }
+
+  std::shared_ptr<HttpDelegate> mInner;
+  std::shared_ptr<TracingDelegate> mTracer;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_TRACING_DELEGATE_H_
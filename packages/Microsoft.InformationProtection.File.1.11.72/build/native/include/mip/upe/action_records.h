@@ -0,0 +1,365 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ActionRecordArena, a flat, type-tagged view of the actions returned by ComputeActions
+ * 
+ * @file action_records.h
+ */
+
+#ifndef API_MIP_UPE_ACTION_RECORDS_H_
+#define API_MIP_UPE_ACTION_RECORDS_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/action.h"
+#include "mip/upe/add_content_footer_action.h"
+#include "mip/upe/add_content_header_action.h"
+#include "mip/upe/add_watermark_action.h"
+#include "mip/upe/apply_label_action.h"
+#include "mip/upe/custom_action.h"
+#include "mip/upe/justify_action.h"
+#include "mip/upe/metadata_action.h"
+#include "mip/upe/protect_adhoc_action.h"
+#include "mip/upe/protect_adhoc_dk_action.h"
+#include "mip/upe/protect_by_encrypt_only_action.h"
+#include "mip/upe/protect_by_template_action.h"
+#include "mip/upe/protect_do_not_forward_action.h"
+#include "mip/upe/protect_do_not_forward_dk_action.h"
+#include "mip/upe/recommend_label_action.h"
+#include "mip/upe/remove_content_footer_action.h"
+#include "mip/upe/remove_content_header_action.h"
+#include "mip/upe/remove_protection_action.h"
+#include "mip/upe/remove_watermark_action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Maps an action class to its ActionType, e.g. ActionTypeOf<ProtectByTemplateAction>::value
+ */
+template <typename TAction>
+struct ActionTypeOf;
+
+/** @cond DOXYGEN_HIDE */
+template <> struct ActionTypeOf<AddContentFooterAction> {
+  static constexpr ActionType value = ActionType::ADD_CONTENT_FOOTER;
+};
+template <> struct ActionTypeOf<AddContentHeaderAction> {
+  static constexpr ActionType value = ActionType::ADD_CONTENT_HEADER;
+};
+template <> struct ActionTypeOf<AddWatermarkAction> {
+  static constexpr ActionType value = ActionType::ADD_WATERMARK;
+};
+template <> struct ActionTypeOf<CustomAction> {
+  static constexpr ActionType value = ActionType::CUSTOM;
+};
+template <> struct ActionTypeOf<JustifyAction> {
+  static constexpr ActionType value = ActionType::JUSTIFY;
+};
+template <> struct ActionTypeOf<MetadataAction> {
+  static constexpr ActionType value = ActionType::METADATA;
+};
+template <> struct ActionTypeOf<ProtectAdhocAction> {
+  static constexpr ActionType value = ActionType::PROTECT_ADHOC;
+};
+template <> struct ActionTypeOf<ProtectByTemplateAction> {
+  static constexpr ActionType value = ActionType::PROTECT_BY_TEMPLATE;
+};
+template <> struct ActionTypeOf<ProtectDoNotForwardAction> {
+  static constexpr ActionType value = ActionType::PROTECT_DO_NOT_FORWARD;
+};
+template <> struct ActionTypeOf<RemoveContentFooterAction> {
+  static constexpr ActionType value = ActionType::REMOVE_CONTENT_FOOTER;
+};
+template <> struct ActionTypeOf<RemoveContentHeaderAction> {
+  static constexpr ActionType value = ActionType::REMOVE_CONTENT_HEADER;
+};
+template <> struct ActionTypeOf<RemoveProtectionAction> {
+  static constexpr ActionType value = ActionType::REMOVE_PROTECTION;
+};
+template <> struct ActionTypeOf<RemoveWatermarkAction> {
+  static constexpr ActionType value = ActionType::REMOVE_WATERMARK;
+};
+template <> struct ActionTypeOf<ApplyLabelAction> {
+  static constexpr ActionType value = ActionType::APPLY_LABEL;
+};
+template <> struct ActionTypeOf<RecommendLabelAction> {
+  static constexpr ActionType value = ActionType::RECOMMEND_LABEL;
+};
+template <> struct ActionTypeOf<ProtectAdhocDkAction> {
+  static constexpr ActionType value = ActionType::PROTECT_ADHOC_DK;
+};
+template <> struct ActionTypeOf<ProtectDoNotForwardDkAction> {
+  static constexpr ActionType value = ActionType::PROTECT_DO_NOT_FORWARD_DK;
+};
+template <> struct ActionTypeOf<ProtectByEncryptOnlyAction> {
+  static constexpr ActionType value = ActionType::PROTECT_BY_ENCRYPT_ONLY;
+};
+/** @endcond */
+
+/**
+ * @brief Get an action as its concrete class, tested through Action::GetType instead of RTTI
+ * 
+ * @param action Action, or nullptr
+ * 
+ * @return The action as TAction, or nullptr if it is of another type
+ */
+template <typename TAction>
+inline const TAction* ActionAs(const Action* action) {
+  return action && action->GetType() == ActionTypeOf<TAction>::value ? static_cast<const TAction*>(action) : nullptr;
+}
+
+/**
+ * @brief Call a visitor with an action as its concrete class, dispatched on Action::GetType
+ * 
+ * @param action Action
+ * @param visitor Callable accepting a const reference to every action class, e.g. a generic lambda or an overload set
+ * 
+ * @return The visitor's result
+ */
+template <typename TVisitor>
+inline auto VisitAction(const Action& action, TVisitor&& visitor)
+    -> decltype(std::forward<TVisitor>(visitor)(std::declval<const CustomAction&>())) {
+  switch (action.GetType()) {
+    case ActionType::ADD_CONTENT_FOOTER:
+      return std::forward<TVisitor>(visitor)(static_cast<const AddContentFooterAction&>(action));
+    case ActionType::ADD_CONTENT_HEADER:
+      return std::forward<TVisitor>(visitor)(static_cast<const AddContentHeaderAction&>(action));
+    case ActionType::ADD_WATERMARK:
+      return std::forward<TVisitor>(visitor)(static_cast<const AddWatermarkAction&>(action));
+    case ActionType::CUSTOM:
+      return std::forward<TVisitor>(visitor)(static_cast<const CustomAction&>(action));
+    case ActionType::JUSTIFY:
+      return std::forward<TVisitor>(visitor)(static_cast<const JustifyAction&>(action));
+    case ActionType::METADATA:
+      return std::forward<TVisitor>(visitor)(static_cast<const MetadataAction&>(action));
+    case ActionType::PROTECT_ADHOC:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectAdhocAction&>(action));
+    case ActionType::PROTECT_BY_TEMPLATE:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectByTemplateAction&>(action));
+    case ActionType::PROTECT_DO_NOT_FORWARD:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectDoNotForwardAction&>(action));
+    case ActionType::REMOVE_CONTENT_FOOTER:
+      return std::forward<TVisitor>(visitor)(static_cast<const RemoveContentFooterAction&>(action));
+    case ActionType::REMOVE_CONTENT_HEADER:
+      return std::forward<TVisitor>(visitor)(static_cast<const RemoveContentHeaderAction&>(action));
+    case ActionType::REMOVE_PROTECTION:
+      return std::forward<TVisitor>(visitor)(static_cast<const RemoveProtectionAction&>(action));
+    case ActionType::REMOVE_WATERMARK:
+      return std::forward<TVisitor>(visitor)(static_cast<const RemoveWatermarkAction&>(action));
+    case ActionType::APPLY_LABEL:
+      return std::forward<TVisitor>(visitor)(static_cast<const ApplyLabelAction&>(action));
+    case ActionType::RECOMMEND_LABEL:
+      return std::forward<TVisitor>(visitor)(static_cast<const RecommendLabelAction&>(action));
+    case ActionType::PROTECT_ADHOC_DK:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectAdhocDkAction&>(action));
+    case ActionType::PROTECT_DO_NOT_FORWARD_DK:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectDoNotForwardDkAction&>(action));
+    case ActionType::PROTECT_BY_ENCRYPT_ONLY:
+      return std::forward<TVisitor>(visitor)(static_cast<const ProtectByEncryptOnlyAction&>(action));
+  }
+  throw BadInputError("Unknown action type");
+}
+
+/**
+ * @brief One action: its type tag and a non-owning pointer to the action, valid while its arena holds it
+ */
+struct ActionRecord {
+  ActionType type;      /**< Type of the action, read once when the record was added */
+  const Action* action; /**< The action, owned by the arena */
+
+  /**
+   * @brief Get the action as its concrete class
+   * 
+   * @return The action as TAction
+   * 
+   * @note The record's type must be ActionTypeOf<TAction>::value.
+   */
+  template <typename TAction>
+  const TAction& As() const {
+    return static_cast<const TAction&>(*action);
+  }
+
+  /**
+   * @brief Get the action as its concrete class if it has that type
+   * 
+   * @return The action as TAction, or nullptr
+   */
+  template <typename TAction>
+  const TAction* TryAs() const {
+    return type == ActionTypeOf<TAction>::value ? static_cast<const TAction*>(action) : nullptr;
+  }
+};
+
+/**
+ * @brief A contiguous range of the records of one evaluation
+ */
+class ActionRecordRange {
+public:
+  /** @cond DOXYGEN_HIDE */
+  ActionRecordRange(const ActionRecord* data, size_t size, unsigned int typeMask)
+      : mData(data), mSize(size), mTypeMask(typeMask) {}
+  /** @endcond */
+
+  /** @brief Get the first record */
+  const ActionRecord* begin() const { return mData; }
+
+  /** @brief Get the end of the records */
+  const ActionRecord* end() const { return mData + mSize; }
+
+  /** @brief Get the number of records */
+  size_t size() const { return mSize; }
+
+  /** @brief Get whether there are no records */
+  bool empty() const { return mSize == 0; }
+
+  /** @brief Get a record by index */
+  const ActionRecord& operator[](size_t index) const { return mData[index]; }
+
+  /**
+   * @brief Check whether any record has a type
+   * 
+   * @param type Action type
+   * 
+   * @return true if one of the records has the type
+   */
+  bool Contains(ActionType type) const { return (mTypeMask & static_cast<unsigned int>(type)) != 0; }
+
+  /**
+   * @brief Get the union of the records' types
+   * 
+   * @return Bit mask of ActionType values
+   */
+  unsigned int GetTypeMask() const { return mTypeMask; }
+
+  /**
+   * @brief Get the first action of a class
+   * 
+   * @return The action, or nullptr if there is none
+   */
+  template <typename TAction>
+  const TAction* Find() const {
+    if (!Contains(ActionTypeOf<TAction>::value)) {
+      return nullptr;
+    }
+    for (const auto& record : *this) {
+      if (const TAction* action = record.TryAs<TAction>()) {
+        return action;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  const ActionRecord* mData;
+  size_t mSize;
+  unsigned int mTypeMask;
+};
+
+/**
+ * @brief Caller-owned storage that turns ComputeActions results into flat, type-tagged records
+ * 
+ * @note Adding takes ownership of the action pointers by moving them, so no reference count is touched, and Clear
+ *       keeps the capacity of both the owning list and the records. Reusing one arena across evaluations in a hot
+ *       loop therefore allocates only when a result is larger than any seen before. Dispatching on
+ *       ActionRecord::type or with VisitAction replaces dynamic_pointer_cast. The existing action classes stay the
+ *       views through which the action's data is read. An arena is not thread safe; use one per thread.
+ */
+class ActionRecordArena {
+public:
+  /**
+   * @brief Add the actions of one evaluation
+   * 
+   * @param actions Actions returned by PolicyHandler::ComputeActions; they are moved from
+   * 
+   * @return Index of the added range, for GetRange
+   */
+  size_t Add(std::vector<std::shared_ptr<Action>>&& actions) {
+    size_t first = mRecords.size();
+    unsigned int typeMask = 0;
+    mRecords.reserve(first + actions.size());
+    for (auto& action : actions) {
+      if (!action) {
+        continue;
+      }
+      ActionType type = action->GetType();
+      typeMask |= static_cast<unsigned int>(type);
+      mRecords.push_back(ActionRecord{type, action.get()});
+      mOwners.push_back(std::move(action));
+    }
+    actions.clear();
+    mRanges.push_back(Range{first, mRecords.size() - first, typeMask});
+    return mRanges.size() - 1;
+  }
+
+  /**
+   * @brief Get the records of one evaluation
+   * 
+   * @param index Index returned by Add
+   * 
+   * @return Records of the evaluation, valid until Clear
+   */
+  ActionRecordRange GetRange(size_t index) const {
+    const Range& range = mRanges.at(index);
+    return ActionRecordRange(mRecords.data() + range.first, range.size, range.typeMask);
+  }
+
+  /**
+   * @brief Get the number of evaluations added
+   * 
+   * @return Range count
+   */
+  size_t GetRangeCount() const { return mRanges.size(); }
+
+  /**
+   * @brief Release every action while keeping the allocated capacity
+   */
+  void Clear() {
+    mOwners.clear();
+    mRecords.clear();
+    mRanges.clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Range {
+    size_t first;
+    size_t size;
+    unsigned int typeMask;
+  };
+
+  std::vector<std::shared_ptr<Action>> mOwners;
+  std::vector<ActionRecord> mRecords;
+  std::vector<Range> mRanges;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_ACTION_RECORDS_H_
@@ -0,0 +1,308 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines BatchedClassificationExecutionState, which classifies content once per policy evaluation, and
+ *        ClassificationResultsCache, which keeps the results by content hash
+ * 
+ * @file batched_classification.h
+ */
+
+#ifndef API_MIP_UPE_BATCHED_CLASSIFICATION_H_
+#define API_MIP_UPE_BATCHED_CLASSIFICATION_H_
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/classification_request.h"
+#include "mip/upe/classification_result.h"
+#include "mip/upe/execution_state.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Results of classifying one content, with the classification IDs that were evaluated
+ * 
+ * @note An ID in classifiedIds without an entry in results was evaluated and not found, so it is never evaluated
+ *       again for the same content.
+ */
+struct ClassifiedContent {
+  std::map<std::string, std::shared_ptr<ClassificationResult>> results; /**< Results found, by classification ID */
+  std::vector<std::string> classifiedIds;                               /**< Classification IDs evaluated */
+};
+
+/**
+ * @brief Caches classification results by content, so that content seen again is not classified again
+ * 
+ * @note Keys are chosen by the caller and must identify both the content and the rule packages, e.g. the hash from
+ *       ClassificationCache::ComputeContentHash followed by FileEngine::GetSensitivityFileId. Entries accumulate
+ *       the IDs evaluated by successive evaluations of the same content. Thread safe.
+ */
+class ClassificationResultsCache {
+public:
+  /**
+   * @brief ClassificationResultsCache constructor
+   * 
+   * @param maxEntries Maximum number of contents kept, least recently used contents are evicted first
+   */
+  explicit ClassificationResultsCache(size_t maxEntries = 1024) : mMaxEntries(maxEntries > 0 ? maxEntries : 1) {}
+
+  /**
+   * @brief Get what is known about a content
+   * 
+   * @param key Content key
+   * 
+   * @return Results and evaluated IDs, or nullptr if the content is not cached
+   */
+  std::shared_ptr<const ClassifiedContent> Find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto entry = mIndex.find(key);
+    if (entry == mIndex.end()) {
+      return nullptr;
+    }
+    mLru.splice(mLru.begin(), mLru, entry->second);
+    return entry->second->content;
+  }
+
+  /**
+   * @brief Add the results of an evaluation of a content, merged with what is already cached for it
+   * 
+   * @param key Content key
+   * @param content Results found and the IDs evaluated
+   */
+  void Add(const std::string& key, const ClassifiedContent& content) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto merged = std::make_shared<ClassifiedContent>(content);
+    auto entry = mIndex.find(key);
+    if (entry != mIndex.end()) {
+      const ClassifiedContent& existing = *entry->second->content;
+      merged->results.insert(existing.results.begin(), existing.results.end());
+      for (const auto& id : existing.classifiedIds) {
+        if (content.results.count(id) == 0 &&
+            std::find(content.classifiedIds.begin(), content.classifiedIds.end(), id) == content.classifiedIds.end()) {
+          merged->classifiedIds.push_back(id);
+        }
+      }
+      mLru.erase(entry->second);
+      mIndex.erase(entry);
+    }
+    mLru.push_front(Entry{key, merged});
+    mIndex[key] = mLru.begin();
+    while (mLru.size() > mMaxEntries) {
+      mIndex.erase(mLru.back().key);
+      mLru.pop_back();
+    }
+  }
+
+  /**
+   * @brief Remove all contents
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIndex.clear();
+    mLru.clear();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::string key;
+    std::shared_ptr<const ClassifiedContent> content;
+  };
+
+  std::mutex mMutex;
+  size_t mMaxEntries;
+  std::list<Entry> mLru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+  /** @endcond */
+};
+
+/**
+ * @brief Settings of BatchedClassificationExecutionState
+ */
+struct BatchedClassificationSettings {
+  /** Classifications evaluated with the first request, e.g. every type of the engine's rule packages */
+  std::vector<std::shared_ptr<ClassificationRequest>> expectedRequests;
+  std::shared_ptr<ClassificationResultsCache> cache; /**< Results of content seen before, or nullptr */
+  std::string cacheKey;                              /**< Key of the content in cache */
+};
+
+/**
+ * @brief Forwards to an application's ExecutionState, classifying the content at most once per policy evaluation
+ * 
+ * @note The SDK may call GetClassificationResults several times during one evaluation, each time with the
+ *       classifications its current rule needs. The first call here asks the application's state for all of them
+ *       at once: those requested, those in BatchedClassificationSettings::expectedRequests, and none already known
+ *       from the cache. Later calls are answered from those results, and only IDs not evaluated yet reach the
+ *       application, again as one request. With expectedRequests covering the policy, the application classifies
+ *       each document once. Create one state per evaluation; new results are added to the cache as they come.
+ */
+class BatchedClassificationExecutionState : public ExecutionState {
+public:
+  /**
+   * @brief BatchedClassificationExecutionState constructor
+   * 
+   * @param inner Application's execution state
+   * @param settings Expected requests and cache
+   */
+  BatchedClassificationExecutionState(
+      const std::shared_ptr<const ExecutionState>& inner,
+      const BatchedClassificationSettings& settings = BatchedClassificationSettings())
+      : mInner(inner),
+        mSettings(settings) {
+    if (!mInner) {
+      throw BadInputError("An ExecutionState is required");
+    }
+    if (mSettings.cache) {
+      if (auto cached = mSettings.cache->Find(mSettings.cacheKey)) {
+        mResults = cached->results;
+        mEvaluatedIds.insert(cached->classifiedIds.begin(), cached->classifiedIds.end());
+        for (const auto& result : cached->results) {
+          mEvaluatedIds.insert(result.first);
+        }
+      }
+    }
+  }
+
+  std::shared_ptr<Label> GetNewLabel() const override { return mInner->GetNewLabel(); }
+  std::string GetContentIdentifier() const override { return mInner->GetContentIdentifier(); }
+  DataState GetDataState() const override { return mInner->GetDataState(); }
+  std::pair<bool, std::string> IsDowngradeJustified() const override { return mInner->IsDowngradeJustified(); }
+  AssignmentMethod GetNewLabelAssignmentMethod() const override { return mInner->GetNewLabelAssignmentMethod(); }
+  std::vector<std::pair<std::string, std::string>> GetNewLabelExtendedProperties() const override {
+    return mInner->GetNewLabelExtendedProperties();
+  }
+  std::vector<MetadataEntry> GetContentMetadata(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& namePrefixes) const override {
+    return mInner->GetContentMetadata(names, namePrefixes);
+  }
+  std::shared_ptr<ProtectionDescriptor> GetProtectionDescriptor() const override {
+    return mInner->GetProtectionDescriptor();
+  }
+  std::string GetContentFormat() const override { return mInner->GetContentFormat(); }
+  MetadataVersion GetContentMetadataVersion() const override { return mInner->GetContentMetadataVersion(); }
+  ActionType GetSupportedActions() const override { return mInner->GetSupportedActions(); }
+  std::map<std::string, std::string> GetAuditMetadata() const override { return mInner->GetAuditMetadata(); }
+
+  /**
+   * @brief Return the results of the requested classifications, asking the application only for those not known yet
+   * 
+   * @param classificationIds Classifications requested by the SDK
+   * 
+   * @return Results of the requested classifications found in the content, or nullptr if the application's state
+   *         ran no classification
+   */
+  std::shared_ptr<ClassificationResults> GetClassificationResults(
+      const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds) const override {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::shared_ptr<ClassificationRequest>> missing;
+    AddMissingLocked(classificationIds, missing);
+    if (!missing.empty()) {
+      AddMissingLocked(mSettings.expectedRequests, missing);
+      auto results = mInner->GetClassificationResults(missing);
+      ++mBatchCount;
+      if (!results) {
+        return nullptr;
+      }
+      ClassifiedContent added;
+      added.results = *results;
+      for (const auto& request : missing) {
+        added.classifiedIds.push_back(request->GetClassificationId());
+      }
+      mResults.insert(results->begin(), results->end());
+      mEvaluatedIds.insert(added.classifiedIds.begin(), added.classifiedIds.end());
+      if (mSettings.cache) {
+        mSettings.cache->Add(mSettings.cacheKey, added);
+      }
+    }
+    auto results = std::make_shared<ClassificationResults>();
+    for (const auto& request : classificationIds) {
+      if (!request) {
+        continue;
+      }
+      auto result = mResults.find(request->GetClassificationId());
+      if (result != mResults.end()) {
+        results->insert(*result);
+      }
+    }
+    return results;
+  }
+
+  /**
+   * @brief Get the number of times the application's state was asked to classify
+   * 
+   * @return 0 if every request was answered from the cache, 1 if the expected requests covered the evaluation
+   */
+  size_t GetBatchCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBatchCount;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  void AddMissingLocked(
+      const std::vector<std::shared_ptr<ClassificationRequest>>& requests,
+      std::vector<std::shared_ptr<ClassificationRequest>>& missing) const {
+    for (const auto& request : requests) {
+      if (!request) {
+        continue;
+      }
+      const std::string id = request->GetClassificationId();
+      if (mEvaluatedIds.count(id) != 0) {
+        continue;
+      }
+      bool isListed = false;
+      for (const auto& listed : missing) {
+        isListed = isListed || listed->GetClassificationId() == id;
+      }
+      if (!isListed) {
+        missing.push_back(request);
+      }
+    }
+  }
+
+  std::shared_ptr<const ExecutionState> mInner;
+  BatchedClassificationSettings mSettings;
+  mutable std::mutex mMutex;
+  mutable std::map<std::string, std::shared_ptr<ClassificationResult>> mResults;
+  mutable std::set<std::string> mEvaluatedIds;
+  mutable size_t mBatchCount = 0;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_BATCHED_CLASSIFICATION_H_
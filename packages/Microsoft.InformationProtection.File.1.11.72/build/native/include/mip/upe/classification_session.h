@@ -0,0 +1,198 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ClassificationSession, which classifies text delivered in chunks
+ * 
+ * @file classification_session.h
+ */
+
+#ifndef API_MIP_UPE_CLASSIFICATION_SESSION_H_
+#define API_MIP_UPE_CLASSIFICATION_SESSION_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/stream.h"
+#include "mip/upe/classification_request.h"
+#include "mip/upe/classification_result.h"
+#include "mip/upe/local_classifier.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Classifies text that arrives in chunks, e.g. a large log export, with memory bounded by the match length and
+ *        proximity window rather than the content size
+ * 
+ * @note Each chunk is scanned together with the last GetMaxMatchLength bytes before it, and only matches that start
+ *       at least GetMaxMatchLength bytes before the end of the text received so far are accepted, so a match crossing
+ *       a chunk boundary is reported exactly once. Accepted matches are handed to a ClassificationEvaluator, which
+ *       counts an entity instance as soon as its proximity window is complete. A session is not thread safe.
+ */
+class ClassificationSession {
+public:
+  /**
+   * @brief Start a session
+   * 
+   * @param classifier Compiled classifier, which must outlive the session
+   * @param classificationIds Entities to report, or empty to report every entity found
+   */
+  explicit ClassificationSession(
+      const std::shared_ptr<const LocalClassifier>& classifier,
+      const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds =
+          std::vector<std::shared_ptr<ClassificationRequest>>())
+      : mClassifier(classifier),
+        mBufferOffset(0),
+        mAcceptedOffset(0),
+        mIsFinished(false) {
+    if (!mClassifier) {
+      throw BadInputError("ClassificationSession requires a classifier");
+    }
+    mEvaluator = mClassifier->CreateEvaluator(classificationIds);
+  }
+
+  /**
+   * @brief Add the next chunk of text
+   * 
+   * @param text Text, in UTF-8. A chunk may end in the middle of a character.
+   * @param size Size of the chunk in bytes
+   */
+  void Write(const char* text, size_t size) {
+    if (mIsFinished) {
+      throw BadInputError("ClassificationSession was already finished");
+    }
+    mBuffer.append(text, size);
+    int64_t maxMatchLength = static_cast<int64_t>(mClassifier->GetMaxMatchLength());
+    int64_t safeOffset = mBufferOffset + static_cast<int64_t>(mBuffer.size()) - maxMatchLength;
+    // Scanning once a full window of new text is buffered keeps the rescanned overlap a small share of each scan
+    if (safeOffset - mAcceptedOffset >= maxMatchLength) {
+      Process(safeOffset);
+    }
+  }
+
+  /**
+   * @brief Add the next chunk of text
+   * 
+   * @param text Text, in UTF-8
+   */
+  void Write(const std::string& text) { Write(text.data(), text.size()); }
+
+  /**
+   * @brief Read a stream to its end and add its content
+   * 
+   * @param stream Stream of UTF-8 text, read from its current position
+   * @param chunkSize Bytes read per call
+   */
+  void Write(Stream& stream, size_t chunkSize = 1024 * 1024) {
+    std::vector<uint8_t> chunk((std::max)(chunkSize, static_cast<size_t>(1)));
+    for (;;) {
+      int64_t read = stream.Read(chunk.data(), static_cast<int64_t>(chunk.size()));
+      if (read <= 0) {
+        return;
+      }
+      Write(reinterpret_cast<const char*>(chunk.data()), static_cast<size_t>(read));
+    }
+  }
+
+  /**
+   * @brief Classify the remaining text and get the results
+   * 
+   * @return Results of the entities found, keyed by entity ID, in the form returned by
+   *         ExecutionState::GetClassificationResults
+   * 
+   * @note No text may be written afterwards.
+   */
+  std::shared_ptr<ClassificationResults> Finish() {
+    if (!mIsFinished) {
+      Process(mBufferOffset + static_cast<int64_t>(mBuffer.size()));
+      mIsFinished = true;
+      mResults = mEvaluator->GetResults();
+      mBuffer.clear();
+      mBuffer.shrink_to_fit();
+    }
+    return mResults;
+  }
+
+  /**
+   * @brief Get the total number of bytes written
+   * 
+   * @return Content size so far
+   */
+  int64_t GetSize() const { return mBufferOffset + static_cast<int64_t>(mBuffer.size()); }
+
+  /**
+   * @brief Get the number of bytes currently buffered, as a measure of the session's memory use
+   * 
+   * @return Buffered text size
+   */
+  size_t GetBufferedSize() const { return mBuffer.size(); }
+
+  /**
+   * @brief Get the number of matches held for proximity windows that are still open
+   * 
+   * @return Held match count
+   */
+  size_t GetHeldMatchCount() const { return mEvaluator->GetHeldMatchCount(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  // Accepts the matches starting in [mAcceptedOffset, safeOffset) and drops text that no later match can reach
+  void Process(int64_t safeOffset) {
+    mMatches.clear();
+    mClassifier->Scan(mBuffer.data(), mBuffer.size(), mBufferOffset, mMatches);
+    for (const auto& match : mMatches) {
+      if (match.start >= mAcceptedOffset && match.start < safeOffset) {
+        mEvaluator->Add(match);
+      }
+    }
+    mAcceptedOffset = safeOffset;
+    mEvaluator->Flush(safeOffset);
+
+    // Keeping one maximum match length before the next accepted offset preserves boundary context such as \b
+    int64_t keepFrom = (std::max)(mBufferOffset,
+        safeOffset - static_cast<int64_t>(mClassifier->GetMaxMatchLength()));
+    mBuffer.erase(0, static_cast<size_t>(keepFrom - mBufferOffset));
+    mBufferOffset = keepFrom;
+  }
+
+  std::shared_ptr<const LocalClassifier> mClassifier;
+  std::unique_ptr<ClassificationEvaluator> mEvaluator;
+  std::string mBuffer;
+  std::vector<ClassificationMatch> mMatches;
+  int64_t mBufferOffset;
+  int64_t mAcceptedOffset;
+  bool mIsFinished;
+  std::shared_ptr<ClassificationResults> mResults;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_CLASSIFICATION_SESSION_H_
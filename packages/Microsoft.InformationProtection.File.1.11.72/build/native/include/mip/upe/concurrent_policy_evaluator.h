@@ -0,0 +1,222 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ConcurrentPolicyEvaluator, which lets many threads evaluate one policy without sharing a handler
+ * 
+ * @file concurrent_policy_evaluator.h
+ */
+
+#ifndef API_MIP_UPE_CONCURRENT_POLICY_EVALUATOR_H_
+#define API_MIP_UPE_CONCURRENT_POLICY_EVALUATOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/action.h"
+#include "mip/upe/content_label.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/policy_engine.h"
+#include "mip/upe/policy_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace concurrentpolicy {
+
+// An engine published to the evaluating threads. Threads hold it weakly, so replacing the engine or destroying the
+// evaluator releases every thread's handler the next time that thread creates a handler.
+struct Snapshot {
+  std::shared_ptr<PolicyEngine> engine;
+  uint64_t generation;
+};
+
+struct ThreadHandler {
+  std::weak_ptr<const Snapshot> snapshot;
+  uint64_t generation;
+  std::shared_ptr<PolicyHandler> handler;
+};
+
+inline std::unordered_map<uint64_t, ThreadHandler>& GetThreadHandlers() {
+  static thread_local std::unordered_map<uint64_t, ThreadHandler> sHandlers;
+  return sHandlers;
+}
+
+inline uint64_t CreateEvaluatorId() {
+  static std::atomic<uint64_t> sEvaluatorCounter(0);
+  return ++sEvaluatorCounter;
+}
+
+} // namespace concurrentpolicy
+/** @endcond */
+
+/**
+ * @brief Evaluates policy from any number of threads over an immutable, swappable policy engine snapshot
+ * 
+ * @note The SDK does not document PolicyHandler as safe to share between threads, so instead of serializing calls to
+ *       one handler, every thread lazily creates its own handler from the current engine and keeps it. On the hot path
+ *       a call reads one atomic generation counter and a thread-local table, then calls the thread's handler; no lock
+ *       is taken. UpdateEngine publishes a new engine read-copy-update style: calls already running finish on the old
+ *       engine, and each thread moves to the new one on its next call, dropping its old handler.
+ *       
+ *       A handler belongs to the thread that created it. NotifyCommittedActions must be called on the thread that
+ *       computed the actions, so it reaches the same handler. Handlers of a destroyed evaluator are released when
+ *       their thread next creates a handler for any evaluator, or when the thread exits.
+ */
+class ConcurrentPolicyEvaluator {
+public:
+  /**
+   * @brief Create an evaluator
+   * 
+   * @param engine Policy engine; its policy becomes the first snapshot
+   * @param isAuditDiscoveryEnabled Passed to PolicyEngine::CreatePolicyHandler
+   * @param isGetSensitivityLabelAuditDiscoveryEnabled Passed to PolicyEngine::CreatePolicyHandler
+   */
+  explicit ConcurrentPolicyEvaluator(
+      const std::shared_ptr<PolicyEngine>& engine,
+      bool isAuditDiscoveryEnabled = false,
+      bool isGetSensitivityLabelAuditDiscoveryEnabled = true)
+      : mId(concurrentpolicy::CreateEvaluatorId()),
+        mIsAuditDiscoveryEnabled(isAuditDiscoveryEnabled),
+        mIsGetSensitivityLabelAuditDiscoveryEnabled(isGetSensitivityLabelAuditDiscoveryEnabled),
+        mGeneration(0) {
+    UpdateEngine(engine);
+  }
+
+  ConcurrentPolicyEvaluator(const ConcurrentPolicyEvaluator&) = delete;
+  ConcurrentPolicyEvaluator& operator=(const ConcurrentPolicyEvaluator&) = delete;
+
+  /**
+   * @brief Publish a new engine, e.g. after its policy was refreshed
+   * 
+   * @param engine Policy engine to evaluate with from now on
+   */
+  void UpdateEngine(const std::shared_ptr<PolicyEngine>& engine) {
+    if (!engine) {
+      throw BadInputError("ConcurrentPolicyEvaluator requires a PolicyEngine");
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint64_t generation = mGeneration.load(std::memory_order_relaxed) + 1;
+    mSnapshot = std::make_shared<const concurrentpolicy::Snapshot>(concurrentpolicy::Snapshot{engine, generation});
+    mGeneration.store(generation, std::memory_order_release);
+  }
+
+  /**
+   * @brief Get the engine currently published
+   * 
+   * @return Policy engine
+   */
+  std::shared_ptr<PolicyEngine> GetEngine() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSnapshot->engine;
+  }
+
+  /**
+   * @brief Get the calling thread's handler for the current engine, creating it on first use
+   * 
+   * @return Policy handler, which must only be used by the calling thread
+   * 
+   * @note The handler is returned by value, so a call reentering the evaluator on the same thread cannot release it
+   *       while it is still in use.
+   */
+  std::shared_ptr<PolicyHandler> GetThreadHandler() {
+    auto& handlers = concurrentpolicy::GetThreadHandlers();
+    auto entry = handlers.find(mId);
+    if (entry != handlers.end() && entry->second.generation == mGeneration.load(std::memory_order_acquire)) {
+      return entry->second.handler;
+    }
+    return CreateThreadHandler(handlers);
+  }
+
+  /**
+   * @brief Compute the actions of a state with the calling thread's handler
+   * 
+   * @param state Execution state
+   * 
+   * @return Actions, as returned by PolicyHandler::ComputeActions
+   */
+  std::vector<std::shared_ptr<Action>> ComputeActions(const ExecutionState& state) {
+    return GetThreadHandler()->ComputeActions(state);
+  }
+
+  /**
+   * @brief Get the label of a state with the calling thread's handler
+   * 
+   * @param state Execution state
+   * 
+   * @return Label, as returned by PolicyHandler::GetSensitivityLabel
+   */
+  std::shared_ptr<ContentLabel> GetSensitivityLabel(const ExecutionState& state) {
+    return GetThreadHandler()->GetSensitivityLabel(state);
+  }
+
+  /**
+   * @brief Notify the calling thread's handler that the computed actions were committed
+   * 
+   * @param state Execution state after the commit
+   */
+  void NotifyCommittedActions(const ExecutionState& state) { GetThreadHandler()->NotifyCommittedActions(state); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::shared_ptr<PolicyHandler> CreateThreadHandler(
+      std::unordered_map<uint64_t, concurrentpolicy::ThreadHandler>& handlers) {
+    std::shared_ptr<const concurrentpolicy::Snapshot> snapshot;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      snapshot = mSnapshot;
+    }
+    // Cold path: drop this thread's handlers of replaced engines and destroyed evaluators
+    for (auto handler = handlers.begin(); handler != handlers.end();) {
+      handler = handler->second.snapshot.expired() ? handlers.erase(handler) : std::next(handler);
+    }
+    auto handler = snapshot->engine->CreatePolicyHandler(mIsAuditDiscoveryEnabled,
+        mIsGetSensitivityLabelAuditDiscoveryEnabled);
+    if (!handler) {
+      throw BadInputError("PolicyEngine::CreatePolicyHandler returned no handler");
+    }
+    handlers[mId] = concurrentpolicy::ThreadHandler{snapshot, snapshot->generation, handler};
+    return handler;
+  }
+
+  uint64_t mId;
+  bool mIsAuditDiscoveryEnabled;
+  bool mIsGetSensitivityLabelAuditDiscoveryEnabled;
+  mutable std::mutex mMutex;
+  std::shared_ptr<const concurrentpolicy::Snapshot> mSnapshot;
+  std::atomic<uint64_t> mGeneration;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_CONCURRENT_POLICY_EVALUATOR_H_
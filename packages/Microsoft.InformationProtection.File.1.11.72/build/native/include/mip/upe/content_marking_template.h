@@ -0,0 +1,425 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines compiled content-marking templates and a cache of their rendered text
+ *
+ * @file content_marking_template.h
+ */
+
+#ifndef API_MIP_UPE_CONTENT_MARKING_TEMPLATE_H_
+#define API_MIP_UPE_CONTENT_MARKING_TEMPLATE_H_
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/add_content_footer_action.h"
+#include "mip/upe/add_content_header_action.h"
+#include "mip/upe/add_watermark_action.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Values of the variables of a marking, keyed by name without the ${}, for example "Item.Label" or "User.Name"
+ *
+ * @note A variable is known if it has an entry, even an empty one.
+ */
+typedef std::map<std::string, std::string> ContentMarkingVariables;
+
+/**
+ * @brief Marking text compiled into a list of literal and variable tokens
+ *
+ * @note Recognizes ${Name} variables and ${If.App.<ids>}...${If.End} sections, whose text is only kept for the
+ *       applications listed, for example ${If.App.WXP} for Word, Excel and PowerPoint. Compile once per distinct text,
+ *       then render per file. Immutable, so a template can be shared between threads.
+ */
+class ContentMarkingTemplate {
+public:
+  /**
+   * @brief Compile a marking text
+   *
+   * @param text Text of an AddContentHeaderAction, AddContentFooterAction or AddWatermarkAction
+   *
+   * @return Compiled template
+   */
+  static std::shared_ptr<ContentMarkingTemplate> Compile(const std::string& text) {
+    return std::shared_ptr<ContentMarkingTemplate>(new ContentMarkingTemplate(text));
+  }
+
+  /**
+   * @brief Render the template
+   *
+   * @param variables Values of the known variables
+   * @param appId Application rendering the marking, matched against ${If.App.<ids>} sections, for example "W"; empty
+   *        to drop every conditional section
+   * @param markingType Default removes unknown variables, PassThrough keeps them as written and None returns the text
+   *        unchanged, matching PolicyEngine::Settings::SetVariableTextMarkingType
+   *
+   * @return Rendered text
+   */
+  std::string Render(
+      const ContentMarkingVariables& variables,
+      const std::string& appId = std::string(),
+      VariableTextMarkingType markingType = VariableTextMarkingType::Default) const {
+    if (markingType == VariableTextMarkingType::None) {
+      return mText;
+    }
+    std::string rendered;
+    rendered.reserve(mLiteralSize);
+    bool isIncluded = true;
+    for (const Token& token : mTokens) {
+      switch (token.kind) {
+        case TokenKind::Literal:
+          if (isIncluded) {
+            rendered += token.text;
+          }
+          break;
+        case TokenKind::Variable:
+          if (isIncluded) {
+            auto value = variables.find(token.text);
+            if (value != variables.end()) {
+              rendered += value->second;
+            } else if (markingType == VariableTextMarkingType::PassThrough) {
+              rendered += "${" + token.text + "}";
+            }
+          }
+          break;
+        case TokenKind::IfApp:
+          isIncluded = IsAppListed(token.text, appId);
+          break;
+        case TokenKind::IfEnd:
+          isIncluded = true;
+          break;
+      }
+    }
+    return rendered;
+  }
+
+  /**
+   * @brief Get the names of the variables the template references, each listed once
+   *
+   * @return Variable names, in order of first appearance
+   */
+  const std::vector<std::string>& GetVariableNames() const { return mVariableNames; }
+
+  /**
+   * @brief Whether the template has variables or conditional sections
+   *
+   * @return false if rendering always returns the text as is
+   */
+  bool HasTokens() const { return mTokens.size() > 1 || (!mTokens.empty() && mTokens[0].kind != TokenKind::Literal); }
+
+  /**
+   * @brief Get the text the template was compiled from
+   *
+   * @return Marking text
+   */
+  const std::string& GetText() const { return mText; }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  enum class TokenKind { Literal, Variable, IfApp, IfEnd };
+
+  struct Token {
+    TokenKind kind;
+    std::string text;
+  };
+
+  explicit ContentMarkingTemplate(const std::string& text) : mText(text) {
+    static const std::string kIfApp = "If.App.";
+    static const std::string kIfEnd = "If.End";
+    size_t literalStart = 0;
+    size_t position = 0;
+    while ((position = text.find("${", position)) != std::string::npos) {
+      size_t end = text.find('}', position + 2);
+      if (end == std::string::npos) {
+        break;
+      }
+      AddLiteral(text.substr(literalStart, position - literalStart));
+      std::string name = text.substr(position + 2, end - position - 2);
+      if (name.compare(0, kIfApp.size(), kIfApp) == 0) {
+        mTokens.push_back(Token{TokenKind::IfApp, name.substr(kIfApp.size())});
+      } else if (name == kIfEnd) {
+        mTokens.push_back(Token{TokenKind::IfEnd, std::string()});
+      } else {
+        if (std::find(mVariableNames.begin(), mVariableNames.end(), name) == mVariableNames.end()) {
+          mVariableNames.push_back(name);
+        }
+        mTokens.push_back(Token{TokenKind::Variable, std::move(name)});
+      }
+      position = literalStart = end + 1;
+    }
+    AddLiteral(text.substr(literalStart));
+  }
+
+  void AddLiteral(std::string literal) {
+    if (!literal.empty()) {
+      mLiteralSize += literal.size();
+      mTokens.push_back(Token{TokenKind::Literal, std::move(literal)});
+    }
+  }
+
+  static bool IsAppListed(const std::string& appIds, const std::string& appId) {
+    if (appId.empty()) {
+      return false;
+    }
+    for (char id : appId) {
+      for (char listed : appIds) {
+        if (std::toupper(static_cast<unsigned char>(id)) == std::toupper(static_cast<unsigned char>(listed))) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  std::string mText;
+  std::vector<Token> mTokens;
+  std::vector<std::string> mVariableNames;
+  size_t mLiteralSize = 0;
+  /** @endcond */
+};
+
+/**
+ * @brief Compiles each distinct marking text once and caches its rendered output
+ *
+ * @note A bulk relabel applies the same few header, footer and watermark texts to every document. The renderer keeps
+ *       one ContentMarkingTemplate per text and one rendered string per combination of text, application, marking
+ *       type and values of the variables the text references, so documents sharing a label and user reuse the same
+ *       output. Variables a text does not reference, such as a per-document Item.Name, do not split its entries.
+ *       Configure the engine with VariableTextMarkingType::None so actions carry the unrendered text, and call
+ *       Clear when FileProfile::Observer::OnPolicyChanged reports a new policy. Thread-safe.
+ */
+class ContentMarkingRenderer {
+public:
+  /**
+   * @brief ContentMarkingRenderer constructor
+   *
+   * @param maxEntries Maximum number of rendered texts kept, least recently used ones are evicted first
+   */
+  explicit ContentMarkingRenderer(size_t maxEntries = 4096) : mMaxEntries(maxEntries > 0 ? maxEntries : 1) {}
+
+  /**
+   * @brief Get the compiled template of a text, compiling it on first use
+   *
+   * @param text Marking text
+   *
+   * @return Compiled template
+   */
+  std::shared_ptr<ContentMarkingTemplate> GetTemplate(const std::string& text) {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto found = mTemplates.find(text);
+      if (found != mTemplates.end()) {
+        return found->second;
+      }
+    }
+    auto compiled = ContentMarkingTemplate::Compile(text);
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTemplates.emplace(text, compiled).first->second;
+  }
+
+  /**
+   * @brief Render a marking text
+   *
+   * @param text Marking text
+   * @param variables Values of the known variables
+   * @param appId Application rendering the marking, see ContentMarkingTemplate::Render
+   * @param markingType How unknown variables are rendered, see ContentMarkingTemplate::Render
+   *
+   * @return Rendered text
+   */
+  std::string Render(
+      const std::string& text,
+      const ContentMarkingVariables& variables,
+      const std::string& appId = std::string(),
+      VariableTextMarkingType markingType = VariableTextMarkingType::Default) {
+    auto compiled = GetTemplate(text);
+    if (!compiled->HasTokens() || markingType == VariableTextMarkingType::None) {
+      return text;
+    }
+    std::string key = GetKey(*compiled, variables, appId, markingType);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto cached = mIndex.find(key);
+      if (cached != mIndex.end()) {
+        mEntries.splice(mEntries.begin(), mEntries, cached->second);
+        return cached->second->rendered;
+      }
+    }
+    std::string rendered = compiled->Render(variables, appId, markingType);
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mIndex.find(key) == mIndex.end()) {
+      mEntries.push_front(Entry{key, rendered});
+      mIndex[key] = mEntries.begin();
+      while (mEntries.size() > mMaxEntries) {
+        mIndex.erase(mEntries.back().key);
+        mEntries.pop_back();
+      }
+    }
+    return rendered;
+  }
+
+  /**
+   * @brief Render the text of a content header action
+   *
+   * @param action Action returned by classification
+   * @param variables Values of the known variables
+   * @param appId Application rendering the marking
+   * @param markingType How unknown variables are rendered
+   *
+   * @return Rendered text
+   */
+  std::string Render(
+      const AddContentHeaderAction& action,
+      const ContentMarkingVariables& variables,
+      const std::string& appId = std::string(),
+      VariableTextMarkingType markingType = VariableTextMarkingType::Default) {
+    return Render(action.GetText(), variables, appId, markingType);
+  }
+
+  /**
+   * @brief Render the text of a content footer action
+   *
+   * @param action Action returned by classification
+   * @param variables Values of the known variables
+   * @param appId Application rendering the marking
+   * @param markingType How unknown variables are rendered
+   *
+   * @return Rendered text
+   */
+  std::string Render(
+      const AddContentFooterAction& action,
+      const ContentMarkingVariables& variables,
+      const std::string& appId = std::string(),
+      VariableTextMarkingType markingType = VariableTextMarkingType::Default) {
+    return Render(action.GetText(), variables, appId, markingType);
+  }
+
+  /**
+   * @brief Render the text of a watermark action
+   *
+   * @param action Action returned by classification
+   * @param variables Values of the known variables
+   * @param appId Application rendering the marking
+   * @param markingType How unknown variables are rendered
+   *
+   * @return Rendered text
+   */
+  std::string Render(
+      const AddWatermarkAction& action,
+      const ContentMarkingVariables& variables,
+      const std::string& appId = std::string(),
+      VariableTextMarkingType markingType = VariableTextMarkingType::Default) {
+    return Render(action.GetText(), variables, appId, markingType);
+  }
+
+  /**
+   * @brief Remove all templates and rendered texts, for example after a policy change
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTemplates.clear();
+    mEntries.clear();
+    mIndex.clear();
+  }
+
+  /**
+   * @brief Get the number of compiled templates
+   *
+   * @return Template count
+   */
+  size_t GetTemplateCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTemplates.size();
+  }
+
+  /**
+   * @brief Get the number of rendered texts cached
+   *
+   * @return Entry count
+   */
+  size_t GetEntryCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    std::string key;
+    std::string rendered;
+  };
+
+  // Length-prefixed fields, so that distinct values never produce the same key. Unknown variables are marked apart
+  // from empty ones, since Default and PassThrough render them differently.
+  static std::string GetKey(
+      const ContentMarkingTemplate& compiled,
+      const ContentMarkingVariables& variables,
+      const std::string& appId,
+      VariableTextMarkingType markingType) {
+    std::string key;
+    auto add = [&key](const std::string& value) {
+      key += std::to_string(value.size());
+      key += ':';
+      key += value;
+    };
+    add(compiled.GetText());
+    add(appId);
+    key += std::to_string(static_cast<unsigned int>(markingType));
+    for (const std::string& name : compiled.GetVariableNames()) {
+      auto value = variables.find(name);
+      if (value != variables.end()) {
+        add(value->second);
+      } else {
+        key += '-';
+      }
+    }
+    return key;
+  }
+
+  size_t mMaxEntries;
+  mutable std::mutex mMutex;
+  std::unordered_map<std::string, std::shared_ptr<ContentMarkingTemplate>> mTemplates;
+  std::list<Entry> mEntries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_UPE_CONTENT_MARKING_TEMPLATE_H_
@@ -0,0 +1,1624 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines LocalClassifier, which evaluates sensitivity type rule packages against text in process
+ * 
+ * @file local_classifier.h
+ */
+
+#ifndef API_MIP_UPE_LOCAL_CLASSIFIER_H_
+#define API_MIP_UPE_LOCAL_CLASSIFIER_H_
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/upe/classification_request.h"
+#include "mip/upe/classification_result.h"
+#include "mip/upe/detailed_classification_result.h"
+#include "mip/upe/sensitivity_types_rule_package.h"
+
+MIP_NAMESPACE_BEGIN
+
+/** @cond DOXYGEN_HIDE */
+namespace localclassifier {
+
+// Minimal XML element tree, enough for rule packages. Names are local names, without a namespace prefix.
+struct XmlElement {
+  std::string name;
+  std::map<std::string, std::string> attributes;
+  std::string text;
+  std::vector<XmlElement> children;
+
+  const std::string& GetAttribute(const std::string& attributeName) const {
+    static const std::string kEmpty;
+    auto attribute = attributes.find(attributeName);
+    return attribute == attributes.end() ? kEmpty : attribute->second;
+  }
+};
+
+inline void AppendUtf8(std::string& output, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    output += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    output += static_cast<char>(0xC0 | (codePoint >> 6));
+    output += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    output += static_cast<char>(0xE0 | (codePoint >> 12));
+    output += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    output += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    output += static_cast<char>(0xF0 | (codePoint >> 18));
+    output += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    output += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    output += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+}
+
+// Rule packages are usually UTF-16 with a byte order mark; everything is matched as UTF-8
+inline std::string ToUtf8(const std::string& xml) {
+  if (xml.size() >= 3 && static_cast<unsigned char>(xml[0]) == 0xEF && static_cast<unsigned char>(xml[1]) == 0xBB &&
+      static_cast<unsigned char>(xml[2]) == 0xBF) {
+    return xml.substr(3);
+  }
+  bool isLittleEndian = xml.size() >= 2 && static_cast<unsigned char>(xml[0]) == 0xFF &&
+      static_cast<unsigned char>(xml[1]) == 0xFE;
+  bool isBigEndian = xml.size() >= 2 && static_cast<unsigned char>(xml[0]) == 0xFE &&
+      static_cast<unsigned char>(xml[1]) == 0xFF;
+  if (!isLittleEndian && !isBigEndian) {
+    return xml;
+  }
+  std::string output;
+  output.reserve(xml.size() / 2);
+  for (size_t i = 2; i + 1 < xml.size(); i += 2) {
+    uint32_t unit = isLittleEndian ?
+        static_cast<unsigned char>(xml[i]) | (static_cast<unsigned char>(xml[i + 1]) << 8) :
+        (static_cast<unsigned char>(xml[i]) << 8) | static_cast<unsigned char>(xml[i + 1]);
+    if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < xml.size()) {
+      uint32_t low = isLittleEndian ?
+          static_cast<unsigned char>(xml[i + 2]) | (static_cast<unsigned char>(xml[i + 3]) << 8) :
+          (static_cast<unsigned char>(xml[i + 2]) << 8) | static_cast<unsigned char>(xml[i + 3]);
+      unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+      i += 2;
+    }
+    AppendUtf8(output, unit);
+  }
+  return output;
+}
+
+inline std::string Unescape(const std::string& value) {
+  std::string output;
+  output.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    size_t end;
+    if (value[i] != '&' || (end = value.find(';', i)) == std::string::npos) {
+      output += value[i];
+      continue;
+    }
+    std::string entity = value.substr(i + 1, end - i - 1);
+    if (entity == "lt") {
+      output += '<';
+    } else if (entity == "gt") {
+      output += '>';
+    } else if (entity == "amp") {
+      output += '&';
+    } else if (entity == "quot") {
+      output += '"';
+    } else if (entity == "apos") {
+      output += '\'';
+    } else if (entity.size() > 1 && entity[0] == '#') {
+      bool isHex = entity[1] == 'x' || entity[1] == 'X';
+      AppendUtf8(output, static_cast<uint32_t>(std::strtoul(entity.c_str() + (isHex ? 2 : 1), nullptr,
+          isHex ? 16 : 10)));
+    } else {
+      output += value.substr(i, end - i + 1);
+    }
+    i = end;
+  }
+  return output;
+}
+
+inline std::string GetLocalName(const std::string& name) {
+  size_t colon = name.find(':');
+  return colon == std::string::npos ? name : name.substr(colon + 1);
+}
+
+class XmlParser {
+public:
+  explicit XmlParser(const std::string& xml) : mXml(xml), mPosition(0) {}
+
+  XmlElement Parse() {
+    SkipProlog();
+    XmlElement root;
+    if (!ParseElement(root)) {
+      throw BadInputError("Rule package has no root element");
+    }
+    return root;
+  }
+
+private:
+  void SkipProlog() {
+    for (;;) {
+      SkipSpace();
+      if (StartsWith("<?")) {
+        Skip("?>");
+      } else if (StartsWith("<!--")) {
+        Skip("-->");
+      } else if (StartsWith("<!")) {
+        Skip(">");
+      } else {
+        return;
+      }
+    }
+  }
+
+  bool ParseElement(XmlElement& element) {
+    if (mPosition >= mXml.size() || mXml[mPosition] != '<') {
+      return false;
+    }
+    ++mPosition;
+    element.name = GetLocalName(ReadName());
+    for (;;) {
+      SkipSpace();
+      if (StartsWith("/>")) {
+        mPosition += 2;
+        return true;
+      }
+      if (StartsWith(">")) {
+        ++mPosition;
+        break;
+      }
+      std::string attributeName = GetLocalName(ReadName());
+      SkipSpace();
+      if (!StartsWith("=")) {
+        throw BadInputError("Malformed rule package attribute");
+      }
+      ++mPosition;
+      SkipSpace();
+      char quote = mPosition < mXml.size() ? mXml[mPosition] : '\0';
+      size_t close = quote == '"' || quote == '\'' ? mXml.find(quote, mPosition + 1) : std::string::npos;
+      if (close == std::string::npos) {
+        throw BadInputError("Malformed rule package attribute");
+      }
+      element.attributes[attributeName] = Unescape(mXml.substr(mPosition + 1, close - mPosition - 1));
+      mPosition = close + 1;
+    }
+    for (;;) {
+      if (mPosition >= mXml.size()) {
+        throw BadInputError("Unterminated rule package element");
+      }
+      if (StartsWith("</")) {
+        Skip(">");
+        return true;
+      }
+      if (StartsWith("<!--")) {
+        Skip("-->");
+      } else if (StartsWith("<![CDATA[")) {
+        size_t end = mXml.find("]]>", mPosition);
+        if (end == std::string::npos) {
+          throw BadInputError("Unterminated CDATA section");
+        }
+        element.text += mXml.substr(mPosition + 9, end - mPosition - 9);
+        mPosition = end + 3;
+      } else if (StartsWith("<?")) {
+        Skip("?>");
+      } else if (StartsWith("<")) {
+        element.children.emplace_back();
+        ParseElement(element.children.back());
+      } else {
+        size_t end = mXml.find('<', mPosition);
+        element.text += Unescape(mXml.substr(mPosition, end - mPosition));
+        mPosition = end == std::string::npos ? mXml.size() : end;
+      }
+    }
+  }
+
+  std::string ReadName() {
+    size_t start = mPosition;
+    while (mPosition < mXml.size() && !std::isspace(static_cast<unsigned char>(mXml[mPosition])) &&
+           mXml[mPosition] != '>' && mXml[mPosition] != '/' && mXml[mPosition] != '=') {
+      ++mPosition;
+    }
+    return mXml.substr(start, mPosition - start);
+  }
+
+  void SkipSpace() {
+    while (mPosition < mXml.size() && std::isspace(static_cast<unsigned char>(mXml[mPosition]))) {
+      ++mPosition;
+    }
+  }
+
+  void Skip(const char* terminator) {
+    size_t end = mXml.find(terminator, mPosition);
+    mPosition = end == std::string::npos ? mXml.size() : end + std::char_traits<char>::length(terminator);
+  }
+
+  bool StartsWith(const char* prefix) const { return mXml.compare(mPosition, std::strlen(prefix), prefix) == 0; }
+
+  const std::string& mXml;
+  size_t mPosition;
+};
+
+inline bool IsWordCharacter(unsigned char c) {
+  return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+// Multi-pattern literal matcher: every keyword term of every rule package in one Aho-Corasick automaton, expanded
+// into a dense transition table so that scanning costs one table lookup per input byte
+class KeywordAutomaton {
+public:
+  struct Term {
+    uint32_t matcherIndex;
+    std::string text;
+    bool isCaseSensitive;
+    bool isWordMatch;
+  };
+
+  void Add(const Term& term) {
+    if (term.text.empty()) {
+      return;
+    }
+    mTerms.push_back(term);
+  }
+
+  void Build() {
+    mTransitions.assign(256, 0);
+    mOutputs.assign(1, std::vector<uint32_t>());
+    std::vector<int32_t> failure(1, 0);
+    for (uint32_t termIndex = 0; termIndex < mTerms.size(); ++termIndex) {
+      int32_t state = 0;
+      for (char c : mTerms[termIndex].text) {
+        unsigned char folded = static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(c)));
+        int32_t& next = mTransitions[static_cast<size_t>(state) * 256 + folded];
+        if (next == 0) {
+          next = static_cast<int32_t>(mOutputs.size());
+          mOutputs.emplace_back();
+          failure.push_back(0);
+          mTransitions.resize(mTransitions.size() + 256, 0);
+          state = static_cast<int32_t>(mOutputs.size()) - 1;
+        } else {
+          state = next;
+        }
+      }
+      mOutputs[static_cast<size_t>(state)].push_back(termIndex);
+    }
+    // Breadth-first pass turning the trie into a complete automaton
+    std::deque<int32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+      if (int32_t next = mTransitions[static_cast<size_t>(c)]) {
+        queue.push_back(next);
+      }
+    }
+    while (!queue.empty()) {
+      int32_t state = queue.front();
+      queue.pop_front();
+      const auto& inherited = mOutputs[static_cast<size_t>(failure[static_cast<size_t>(state)])];
+      mOutputs[static_cast<size_t>(state)].insert(mOutputs[static_cast<size_t>(state)].end(), inherited.begin(),
+          inherited.end());
+      for (int c = 0; c < 256; ++c) {
+        int32_t& next = mTransitions[static_cast<size_t>(state) * 256 + static_cast<size_t>(c)];
+        int32_t fallback = mTransitions[static_cast<size_t>(failure[static_cast<size_t>(state)]) * 256 +
+            static_cast<size_t>(c)];
+        if (next == 0) {
+          next = fallback;
+        } else {
+          failure[static_cast<size_t>(next)] = fallback;
+          queue.push_back(next);
+        }
+      }
+    }
+  }
+
+  // Reports (term, start, end) for every occurrence that satisfies the term's case and word rules
+  template <typename TCallback>
+  void Scan(const char* text, size_t size, TCallback callback) const {
+    if (mTerms.empty()) {
+      return;
+    }
+    static unsigned char sFold[256];
+    static bool sIsFoldReady = [] {
+      for (int c = 0; c < 256; ++c) {
+        sFold[c] = static_cast<unsigned char>(std::tolower(c));
+      }
+      return true;
+    }();
+    (void)sIsFoldReady;
+    int32_t state = 0;
+    for (size_t i = 0; i < size; ++i) {
+      state = mTransitions[static_cast<size_t>(state) * 256 + sFold[static_cast<unsigned char>(text[i])]];
+      for (uint32_t termIndex : mOutputs[static_cast<size_t>(state)]) {
+        const Term& term = mTerms[termIndex];
+        size_t start = i + 1 - term.text.size();
+        size_t end = i + 1;
+        if (term.isCaseSensitive && std::memcmp(text + start, term.text.data(), term.text.size()) != 0) {
+          continue;
+        }
+        if (term.isWordMatch && ((start > 0 && IsWordCharacter(static_cast<unsigned char>(text[start - 1]))) ||
+            (end < size && IsWordCharacter(static_cast<unsigned char>(text[end]))))) {
+          continue;
+        }
+        callback(term.matcherIndex, start, end);
+      }
+    }
+  }
+
+private:
+  std::vector<Term> mTerms;
+  std::vector<int32_t> mTransitions;
+  std::vector<std::vector<uint32_t>> mOutputs;
+};
+
+// Regular expression matcher without backtracking: an ECMAScript pattern is compiled to a program of byte sets,
+// splits and assertions that a Pike VM runs over the text once, so time is linear in the text and stack use does not
+// depend on it. Backreferences and lookbehind are rejected with mip::BadInputError; a lookahead examines at most
+// maxLookahead bytes.
+class LinearRegex {
+public:
+  LinearRegex(const std::string& pattern, size_t maxLookahead) : mMaxLookahead(maxLookahead) {
+    std::vector<Node> nodes;
+    uint32_t root = Parser(pattern, nodes, mSets).Parse();
+    Emit(nodes, root);
+    Append(Op::Match);
+    BuildFirstBytes();
+  }
+
+  // Calls callback(start, end) for each leftmost non-empty match, scanning on after the end of the previous one
+  template <typename TCallback>
+  void ForEachMatch(const char* text, size_t size, TCallback callback) const {
+    Run run(mProgram.size());
+    size_t start = 0;
+    size_t end = 0;
+    for (size_t position = 0; Search(run, text, size, position, start, end); position = end) {
+      callback(start, end);
+    }
+  }
+
+private:
+  static const size_t kMaxProgramSize = 64 * 1024;
+  static const int kMaxNestingDepth = 100;
+  static const int kMaxRepeatCount = 1000;
+
+  enum class Op : uint8_t { Set, Split, Jump, Begin, End, WordBoundary, Lookahead, Match };
+
+  // Set: x is the byte set. Split: continue at x first, then at y. Jump: to x. WordBoundary: negate for \B.
+  // Lookahead: the assertion's program starts at x, negate for (?!...).
+  struct Instruction {
+    Op op;
+    uint32_t x;
+    uint32_t y;
+    bool negate;
+  };
+
+  struct Thread {
+    uint32_t pc;
+    size_t start;
+  };
+
+  // Threads in priority order, the generation in which each instruction was last added, and AddThread's stack
+  struct Threads {
+    explicit Threads(size_t programSize) : marks(programSize, 0) {}
+    std::vector<Thread> threads;
+    std::vector<uint32_t> marks;
+    std::vector<uint32_t> stack;
+  };
+
+  // State of one scan, reused across its matches; assertions run one level deeper in lookahead
+  struct Run {
+    explicit Run(size_t programSize) : current(programSize), next(programSize) {}
+    Threads current;
+    Threads next;
+    uint32_t generation = 0;
+    std::unique_ptr<Run> lookahead;
+  };
+
+  typedef std::bitset<256> ByteSet;
+
+  static uint32_t NextGeneration(Run& run) {
+    if (++run.generation == 0) {
+      std::fill(run.current.marks.begin(), run.current.marks.end(), 0);
+      std::fill(run.next.marks.begin(), run.next.marks.end(), 0);
+      run.generation = 1;
+    }
+    return run.generation;
+  }
+
+  // Finds the leftmost non-empty match starting at or after from; false if there is none
+  bool Search(Run& run, const char* text, size_t size, size_t from, size_t& matchStart, size_t& matchEnd) const {
+    Threads& current = run.current;
+    Threads& next = run.next;
+    current.threads.clear();
+    uint32_t generation = NextGeneration(run);
+    bool isMatched = false;
+    for (size_t position = from;; ++position) {
+      if (!isMatched) {
+        if (current.threads.empty() && mHasFirstBytes) {
+          while (position < size && !mFirstBytes[static_cast<unsigned char>(text[position])]) {
+            ++position;
+          }
+          if (position >= size) {
+            return false;
+          }
+        }
+        AddThread(run, current, generation, 0, position, text, size, position);
+      }
+      generation = NextGeneration(run);
+      if (current.threads.empty()) {
+        if (isMatched || position >= size) {
+          break;
+        }
+        continue;
+      }
+      next.threads.clear();
+      for (const Thread& thread : current.threads) {
+        const Instruction& instruction = mProgram[thread.pc];
+        if (instruction.op == Op::Match) {
+          // Threads after this one have lower priority and are dropped
+          if (position > thread.start) {
+            isMatched = true;
+            matchStart = thread.start;
+            matchEnd = position;
+            break;
+          }
+        } else if (position < size && mSets[instruction.x][static_cast<unsigned char>(text[position])]) {
+          AddThread(run, next, generation, thread.pc + 1, thread.start, text, size, position + 1);
+        }
+      }
+      current.threads.swap(next.threads);
+      current.marks.swap(next.marks);
+      if (position >= size) {
+        break;
+      }
+    }
+    return isMatched;
+  }
+
+  // Syntax tree node; children index the node list
+  struct Node {
+    enum class Type { Set, Concat, Alternate, Repeat, Begin, End, WordBoundary, Lookahead };
+    Type type;
+    uint32_t set;
+    int min;
+    int max; // -1 for no upper bound
+    bool isGreedy;
+    bool negate;
+    std::vector<uint32_t> children;
+
+    explicit Node(Type nodeType)
+        : type(nodeType), set(0), min(0), max(0), isGreedy(true), negate(false) {}
+  };
+
+  class Parser {
+  public:
+    Parser(const std::string& pattern, std::vector<Node>& nodes, std::vector<ByteSet>& sets)
+        : mPattern(pattern), mNodes(nodes), mSets(sets) {}
+
+    uint32_t Parse() {
+      uint32_t root = ParseAlternation(0);
+      if (mPosition != mPattern.size()) {
+        throw BadInputError("Unmatched ')' in regular expression");
+      }
+      return root;
+    }
+
+  private:
+    uint32_t ParseAlternation(int depth) {
+      if (depth > kMaxNestingDepth) {
+        throw BadInputError("Regular expression is nested too deeply");
+      }
+      std::vector<uint32_t> alternatives(1, ParseSequence(depth));
+      while (mPosition < mPattern.size() && mPattern[mPosition] == '|') {
+        ++mPosition;
+        alternatives.push_back(ParseSequence(depth));
+      }
+      if (alternatives.size() == 1) {
+        return alternatives[0];
+      }
+      uint32_t alternation = Add(Node::Type::Alternate);
+      mNodes[alternation].children.swap(alternatives);
+      return alternation;
+    }
+
+    uint32_t ParseSequence(int depth) {
+      std::vector<uint32_t> terms;
+      while (mPosition < mPattern.size() && mPattern[mPosition] != '|' && mPattern[mPosition] != ')') {
+        terms.push_back(ParseQuantifier(ParseAtom(depth)));
+      }
+      uint32_t sequence = Add(Node::Type::Concat);
+      mNodes[sequence].children.swap(terms);
+      return sequence;
+    }
+
+    // The atom, wrapped in a Repeat node if a quantifier follows it
+    uint32_t ParseQuantifier(uint32_t atom) {
+      if (mPosition >= mPattern.size()) {
+        return atom;
+      }
+      int min = 0;
+      int max = -1;
+      char c = mPattern[mPosition];
+      if (c == '*' || c == '+' || c == '?') {
+        min = c == '+' ? 1 : 0;
+        max = c == '?' ? 1 : -1;
+        ++mPosition;
+      } else if (c == '{') {
+        ++mPosition;
+        min = ParseCount();
+        max = min;
+        if (mPosition < mPattern.size() && mPattern[mPosition] == ',') {
+          ++mPosition;
+          max = mPosition < mPattern.size() && mPattern[mPosition] == '}' ? -1 : ParseCount();
+        }
+        if (mPosition >= mPattern.size() || mPattern[mPosition] != '}' || (max >= 0 && max < min)) {
+          throw BadInputError("Invalid quantifier in regular expression");
+        }
+        ++mPosition;
+      } else {
+        return atom;
+      }
+      Node::Type type = mNodes[atom].type;
+      if (type != Node::Type::Set && type != Node::Type::Concat && type != Node::Type::Alternate) {
+        throw BadInputError("Quantified assertion in regular expression");
+      }
+      uint32_t repeat = Add(Node::Type::Repeat);
+      mNodes[repeat].min = min;
+      mNodes[repeat].max = max;
+      mNodes[repeat].children.push_back(atom);
+      if (mPosition < mPattern.size() && mPattern[mPosition] == '?') {
+        mNodes[repeat].isGreedy = false;
+        ++mPosition;
+      }
+      return repeat;
+    }
+
+    int ParseCount() {
+      size_t start = mPosition;
+      int count = 0;
+      while (mPosition < mPattern.size() && mPattern[mPosition] >= '0' && mPattern[mPosition] <= '9') {
+        count = count * 10 + (mPattern[mPosition++] - '0');
+        if (count > kMaxRepeatCount) {
+          throw BadInputError("Regular expression repeat count is too large");
+        }
+      }
+      if (mPosition == start) {
+        throw BadInputError("Invalid quantifier in regular expression");
+      }
+      return count;
+    }
+
+    uint32_t ParseAtom(int depth) {
+      char c = mPattern[mPosition++];
+      switch (c) {
+        case '^':
+          return Add(Node::Type::Begin);
+        case '$':
+          return Add(Node::Type::End);
+        case '.': {
+          ByteSet set;
+          set.set();
+          set['\n'] = false;
+          set['\r'] = false;
+          return AddSet(set);
+        }
+        case '[':
+          return ParseClass();
+        case '(':
+          return ParseGroup(depth);
+        case '\\':
+          return ParseEscape();
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+          throw BadInputError("Nothing to repeat in regular expression");
+        default:
+          return AddByte(static_cast<unsigned char>(c));
+      }
+    }
+
+    uint32_t ParseGroup(int depth) {
+      bool isLookahead = false;
+      bool negate = false;
+      if (mPosition < mPattern.size() && mPattern[mPosition] == '?') {
+        char kind = mPosition + 1 < mPattern.size() ? mPattern[mPosition + 1] : '\0';
+        if (kind != ':' && kind != '=' && kind != '!') {
+          throw BadInputError("Unsupported group in regular expression");
+        }
+        isLookahead = kind != ':';
+        negate = kind == '!';
+        mPosition += 2;
+      }
+      uint32_t body = ParseAlternation(depth + 1);
+      if (mPosition >= mPattern.size() || mPattern[mPosition] != ')') {
+        throw BadInputError("Unmatched '(' in regular expression");
+      }
+      ++mPosition;
+      // Wrapped so that a quantifier applies to the whole group
+      uint32_t group = Add(isLookahead ? Node::Type::Lookahead : Node::Type::Concat);
+      mNodes[group].negate = negate;
+      mNodes[group].children.push_back(body);
+      return group;
+    }
+
+    uint32_t ParseEscape() {
+      if (mPosition >= mPattern.size()) {
+        throw BadInputError("Trailing '\\' in regular expression");
+      }
+      char c = mPattern[mPosition];
+      if (c == 'b' || c == 'B') {
+        ++mPosition;
+        uint32_t boundary = Add(Node::Type::WordBoundary);
+        mNodes[boundary].negate = c == 'B';
+        return boundary;
+      }
+      if (c >= '1' && c <= '9') {
+        throw BadInputError("Backreferences are not supported");
+      }
+      ByteSet set;
+      if (ParseClassEscape(set)) {
+        return AddSet(set);
+      }
+      uint32_t codePoint = ParseCharacterEscape();
+      if (codePoint < 0x80) {
+        return AddByte(static_cast<unsigned char>(codePoint));
+      }
+      // Text is UTF-8, so a non-ASCII character matches the sequence of its encoded bytes
+      std::string encoded;
+      AppendUtf8(encoded, codePoint);
+      std::vector<uint32_t> bytes;
+      for (char byte : encoded) {
+        bytes.push_back(AddByte(static_cast<unsigned char>(byte)));
+      }
+      uint32_t sequence = Add(Node::Type::Concat);
+      mNodes[sequence].children.swap(bytes);
+      return sequence;
+    }
+
+    // Adds the members of \d \D \s \S \w or \W at mPosition to set; false for any other escape
+    bool ParseClassEscape(ByteSet& set) {
+      char c = mPattern[mPosition];
+      char lower = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      if (lower != 'd' && lower != 's' && lower != 'w') {
+        return false;
+      }
+      ++mPosition;
+      for (int byte = 0; byte < 256; ++byte) {
+        bool isMember = lower == 'd' ? (byte >= '0' && byte <= '9') :
+            lower == 's' ? (byte == ' ' || (byte >= '\t' && byte <= '\r')) :
+            (byte < 0x80 && (std::isalnum(byte) || byte == '_'));
+        if (isMember != (c != lower)) {
+          set[static_cast<size_t>(byte)] = true;
+        }
+      }
+      return true;
+    }
+
+    // The character of any other escape at mPosition
+    uint32_t ParseCharacterEscape() {
+      char c = mPattern[mPosition++];
+      switch (c) {
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case '0': return 0;
+        case 'c':
+          if (mPosition < mPattern.size() && std::isalpha(static_cast<unsigned char>(mPattern[mPosition]))) {
+            return static_cast<uint32_t>(mPattern[mPosition++]) % 32;
+          }
+          throw BadInputError("Invalid control escape in regular expression");
+        case 'x':
+          return ParseHex(2);
+        case 'u':
+          return ParseHex(4);
+        default:
+          return static_cast<unsigned char>(c);
+      }
+    }
+
+    uint32_t ParseHex(int digits) {
+      uint32_t value = 0;
+      for (int i = 0; i < digits; ++i) {
+        unsigned char c = mPosition < mPattern.size() ? static_cast<unsigned char>(mPattern[mPosition++]) : 0;
+        if (!std::isxdigit(c)) {
+          throw BadInputError("Invalid hexadecimal escape in regular expression");
+        }
+        value = value * 16 + static_cast<uint32_t>(std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+      }
+      return value;
+    }
+
+    uint32_t ParseClass() {
+      ByteSet set;
+      bool isNegated = mPosition < mPattern.size() && mPattern[mPosition] == '^';
+      mPosition += isNegated ? 1 : 0;
+      for (;;) {
+        if (mPosition >= mPattern.size()) {
+          throw BadInputError("Unmatched '[' in regular expression");
+        }
+        if (mPattern[mPosition] == ']') {
+          ++mPosition;
+          break;
+        }
+        int low = ParseClassAtom(set);
+        if (low < 0 || mPosition + 1 >= mPattern.size() || mPattern[mPosition] != '-' ||
+            mPattern[mPosition + 1] == ']') {
+          if (low >= 0) {
+            set[static_cast<size_t>(low)] = true;
+          }
+          continue;
+        }
+        ++mPosition;
+        int high = ParseClassAtom(set);
+        if (high < low) {
+          throw BadInputError("Invalid range in regular expression class");
+        }
+        for (int byte = low; byte <= high; ++byte) {
+          set[static_cast<size_t>(byte)] = true;
+        }
+      }
+      if (isNegated) {
+        set.flip();
+      }
+      return AddSet(set);
+    }
+
+    // One class member: its byte, or -1 after adding the members of a class escape such as \d to set
+    int ParseClassAtom(ByteSet& set) {
+      char c = mPattern[mPosition++];
+      if (c != '\\') {
+        return static_cast<unsigned char>(c);
+      }
+      if (mPosition >= mPattern.size()) {
+        throw BadInputError("Trailing '\\' in regular expression");
+      }
+      if (ParseClassEscape(set)) {
+        return -1;
+      }
+      if (mPattern[mPosition] == 'b') {
+        ++mPosition;
+        return '\b';
+      }
+      uint32_t codePoint = ParseCharacterEscape();
+      if (codePoint >= 0x80) {
+        throw BadInputError("Non-ASCII characters in a regular expression class are not supported");
+      }
+      return static_cast<int>(codePoint);
+    }
+
+    uint32_t Add(Node::Type type) {
+      mNodes.push_back(Node(type));
+      return static_cast<uint32_t>(mNodes.size() - 1);
+    }
+
+    uint32_t AddSet(const ByteSet& set) {
+      uint32_t node = Add(Node::Type::Set);
+      mNodes[node].set = static_cast<uint32_t>(mSets.size());
+      mSets.push_back(set);
+      return node;
+    }
+
+    uint32_t AddByte(unsigned char byte) {
+      ByteSet set;
+      set[byte] = true;
+      return AddSet(set);
+    }
+
+    const std::string& mPattern;
+    std::vector<Node>& mNodes;
+    std::vector<ByteSet>& mSets;
+    size_t mPosition = 0;
+  };
+
+  uint32_t Append(Op op, uint32_t x = 0, uint32_t y = 0, bool negate = false) {
+    if (mProgram.size() >= kMaxProgramSize) {
+      throw BadInputError("Regular expression is too complex");
+    }
+    mProgram.push_back(Instruction{op, x, y, negate});
+    return static_cast<uint32_t>(mProgram.size() - 1);
+  }
+
+  uint32_t Next() const { return static_cast<uint32_t>(mProgram.size()); }
+
+  void Emit(const std::vector<Node>& nodes, uint32_t index) {
+    const Node& node = nodes[index];
+    switch (node.type) {
+      case Node::Type::Set:
+        Append(Op::Set, node.set);
+        break;
+      case Node::Type::Concat:
+        for (uint32_t child : node.children) {
+          Emit(nodes, child);
+        }
+        break;
+      case Node::Type::Alternate: {
+        // Each alternative but the last is tried first and jumps past the others when it completes
+        std::vector<uint32_t> jumps;
+        for (size_t i = 0; i + 1 < node.children.size(); ++i) {
+          uint32_t split = Append(Op::Split, Next() + 1);
+          Emit(nodes, node.children[i]);
+          jumps.push_back(Append(Op::Jump));
+          mProgram[split].y = Next();
+        }
+        Emit(nodes, node.children.back());
+        for (uint32_t jump : jumps) {
+          mProgram[jump].x = Next();
+        }
+        break;
+      }
+      case Node::Type::Repeat:
+        EmitRepeat(nodes, node);
+        break;
+      case Node::Type::Begin:
+        Append(Op::Begin);
+        break;
+      case Node::Type::End:
+        Append(Op::End);
+        break;
+      case Node::Type::WordBoundary:
+        Append(Op::WordBoundary, 0, 0, node.negate);
+        break;
+      case Node::Type::Lookahead: {
+        // The assertion's own program follows, skipped by a jump and ended by its own Match
+        uint32_t lookahead = Append(Op::Lookahead, 0, 0, node.negate);
+        uint32_t jump = Append(Op::Jump);
+        mProgram[lookahead].x = Next();
+        Emit(nodes, node.children[0]);
+        Append(Op::Match);
+        mProgram[jump].x = Next();
+        break;
+      }
+    }
+  }
+
+  // Optional copies become splits that prefer the body when greedy and the exit when lazy
+  void EmitRepeat(const std::vector<Node>& nodes, const Node& node) {
+    uint32_t body = node.children[0];
+    for (int i = 0; i < node.min; ++i) {
+      Emit(nodes, body);
+    }
+    std::vector<uint32_t> splits;
+    if (node.max < 0) {
+      uint32_t split = Append(Op::Split, Next() + 1);
+      Emit(nodes, body);
+      Append(Op::Jump, split);
+      splits.push_back(split);
+    }
+    for (int i = node.min; i < node.max; ++i) {
+      splits.push_back(Append(Op::Split, Next() + 1));
+      Emit(nodes, body);
+    }
+    for (uint32_t split : splits) {
+      mProgram[split].y = Next();
+      if (!node.isGreedy) {
+        std::swap(mProgram[split].x, mProgram[split].y);
+      }
+    }
+  }
+
+  // Bytes that can start a match, used to skip ahead when the program starts with byte sets only
+  void BuildFirstBytes() {
+    mFirstBytes.reset();
+    std::vector<bool> isVisited(mProgram.size(), false);
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+      uint32_t pc = stack.back();
+      stack.pop_back();
+      if (isVisited[pc]) {
+        continue;
+      }
+      isVisited[pc] = true;
+      const Instruction& instruction = mProgram[pc];
+      if (instruction.op == Op::Set) {
+        mFirstBytes |= mSets[instruction.x];
+      } else if (instruction.op == Op::Split) {
+        stack.push_back(instruction.x);
+        stack.push_back(instruction.y);
+      } else if (instruction.op == Op::Jump) {
+        stack.push_back(instruction.x);
+      } else {
+        return;
+      }
+    }
+    mHasFirstBytes = true;
+  }
+
+  static bool IsWordByte(const char* text, size_t size, size_t position) {
+    if (position >= size) {
+      return false;
+    }
+    unsigned char c = static_cast<unsigned char>(text[position]);
+    return c < 0x80 && (std::isalnum(c) || c == '_');
+  }
+
+  // Adds the thread at pc and every thread reachable from it without consuming a byte, in priority order
+  void AddThread(Run& run, Threads& list, uint32_t generation, uint32_t pc, size_t start, const char* text,
+      size_t size, size_t position) const {
+    std::vector<uint32_t>& stack = list.stack;
+    stack.assign(1, pc);
+    while (!stack.empty()) {
+      pc = stack.back();
+      stack.pop_back();
+      if (list.marks[pc] == generation) {
+        continue;
+      }
+      list.marks[pc] = generation;
+      const Instruction& instruction = mProgram[pc];
+      switch (instruction.op) {
+        case Op::Set:
+        case Op::Match:
+          list.threads.push_back(Thread{pc, start});
+          break;
+        case Op::Split:
+          stack.push_back(instruction.y);
+          stack.push_back(instruction.x);
+          break;
+        case Op::Jump:
+          stack.push_back(instruction.x);
+          break;
+        case Op::Begin:
+          if (position == 0) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        case Op::End:
+          if (position == size) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        case Op::WordBoundary: {
+          bool isBoundary =
+              (position > 0 && IsWordByte(text, size, position - 1)) != IsWordByte(text, size, position);
+          if (isBoundary != instruction.negate) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        }
+        case Op::Lookahead:
+          if (!run.lookahead) {
+            run.lookahead.reset(new Run(mProgram.size()));
+          }
+          if (MatchesAt(*run.lookahead, instruction.x, text, size, position) != instruction.negate) {
+            stack.push_back(pc + 1);
+          }
+          break;
+      }
+    }
+  }
+
+  // Whether the program at pc matches, possibly empty, at position, looking at no more than mMaxLookahead bytes
+  bool MatchesAt(Run& run, uint32_t pc, const char* text, size_t size, size_t position) const {
+    size_t end = size - position > mMaxLookahead ? position + mMaxLookahead : size;
+    Threads& current = run.current;
+    Threads& next = run.next;
+    current.threads.clear();
+    AddThread(run, current, NextGeneration(run), pc, position, text, size, position);
+    for (; !current.threads.empty(); ++position) {
+      uint32_t generation = NextGeneration(run);
+      next.threads.clear();
+      for (const Thread& thread : current.threads) {
+        const Instruction& instruction = mProgram[thread.pc];
+        if (instruction.op == Op::Match) {
+          return true;
+        }
+        if (position < end && mSets[instruction.x][static_cast<unsigned char>(text[position])]) {
+          AddThread(run, next, generation, thread.pc + 1, thread.start, text, size, position + 1);
+        }
+      }
+      current.threads.swap(next.threads);
+      current.marks.swap(next.marks);
+    }
+    return false;
+  }
+
+  std::vector<Instruction> mProgram;
+  std::vector<ByteSet> mSets;
+  ByteSet mFirstBytes;
+  bool mHasFirstBytes = false;
+  size_t mMaxLookahead;
+};
+
+class LocalDetailedResult : public DetailedClassificationResult {
+public:
+  LocalDetailedResult(int confidenceLevel, int count) : mConfidenceLevel(confidenceLevel), mCount(count) {}
+  int GetConfidenceLevel() const override { return mConfidenceLevel; }
+  int GetCount() const override { return mCount; }
+
+private:
+  int mConfidenceLevel;
+  int mCount;
+};
+
+class LocalClassificationResult : public ClassificationResult {
+public:
+  LocalClassificationResult(const std::string& id, const std::string& name, int count, int confidenceLevel,
+      const std::vector<std::shared_ptr<DetailedClassificationResult>>& details)
+      : mId(id), mName(name), mCount(count), mConfidenceLevel(confidenceLevel), mDetails(details) {}
+  std::string GetId() const override { return mId; }
+  std::string GetName() const override { return mName; }
+  int GetCount() const override { return mCount; }
+  int GetConfidenceLevel() const override { return mConfidenceLevel; }
+  std::string GetSensitiveInformationDetections() const override { return std::string(); }
+  std::vector<std::shared_ptr<DetailedClassificationResult>> GetDetailedClassificationAttributes() const override {
+    return mDetails;
+  }
+
+private:
+  std::string mId;
+  std::string mName;
+  int mCount;
+  int mConfidenceLevel;
+  std::vector<std::shared_ptr<DetailedClassificationResult>> mDetails;
+};
+
+} // namespace localclassifier
+/** @endcond */
+
+/**
+ * @brief A detection of one regular expression or keyword list at an absolute offset in the classified text
+ */
+struct ClassificationMatch {
+  uint32_t matcherIndex; /**< Index of the regular expression or keyword list in the classifier */
+  int64_t start;         /**< Offset of the first byte of the match */
+  int64_t end;           /**< Offset just past the last byte of the match */
+};
+
+class ClassificationEvaluator;
+
+/**
+ * @brief Evaluates the entities of sensitivity type rule packages against UTF-8 text without calling the SDK
+ * 
+ * @note Rule packages are compiled once: every keyword term of every package goes into one multi-pattern automaton
+ *       scanned in a single pass, and each regular expression is compiled once to a matcher that runs in time linear
+ *       in the text without backtracking, so no input can exhaust the stack. Entities, patterns, IdMatch, Match (with
+ *       minCount) and Any (with minMatches and maxMatches) elements, the patternsProximity window and confidence
+ *       levels are supported; a regular expression's validators attribute names functions registered with the
+ *       constructor, and "Func_luhn" checks the Luhn checksum of the match. Regular expressions use the ECMAScript
+ *       grammar without backreferences, so an expression using backreferences, lookbehind or constructs only .NET
+ *       supports is skipped and the patterns using it never match. A compiled classifier is immutable and may be
+ *       shared by any number of threads.
+ */
+class LocalClassifier {
+public:
+  /**
+   * @brief Validates the text matched by a regular expression, e.g. a checksum
+   */
+  typedef std::function<bool(const char* match, size_t size)> Validator;
+
+  /**
+   * @brief Compile rule packages
+   * 
+   * @param rulePackages Rule packages, e.g. from FileEngine::ListSensitivityTypes or SensitivityTypesCache
+   * @param validators Validators by name, in addition to the built-in "Func_luhn"
+   * @param maxMatchLength Longest text a single regular expression match may span, used to overlap chunked and
+   *        parallel scans, and the most text a lookahead examines
+   */
+  explicit LocalClassifier(
+      const std::vector<std::shared_ptr<SensitivityTypesRulePackage>>& rulePackages,
+      const std::map<std::string, Validator>& validators = std::map<std::string, Validator>(),
+      size_t maxMatchLength = 256)
+      : mMaxMatchLength((std::max)(maxMatchLength, static_cast<size_t>(1))),
+        mMaxProximity(0) {
+    std::map<std::string, Validator> allValidators = validators;
+    allValidators.emplace("Func_luhn", &IsLuhnValid);
+    for (const auto& package : rulePackages) {
+      if (package) {
+        Compile(localclassifier::XmlParser(localclassifier::ToUtf8(package->GetRulePackage())).Parse(),
+            allValidators);
+      }
+    }
+    mKeywords.Build();
+    for (auto& entity : mEntities) {
+      mMaxProximity = (std::max)(mMaxProximity, entity.proximity);
+    }
+  }
+
+  /**
+   * @brief Find every regular expression and keyword match in a block of text
+   * 
+   * @param text Text, in UTF-8
+   * @param size Size of the text in bytes
+   * @param baseOffset Absolute offset of the first byte, added to the reported offsets
+   * @param matches Receives the matches, sorted by start offset
+   */
+  void Scan(const char* text, size_t size, int64_t baseOffset, std::vector<ClassificationMatch>& matches) const {
+    size_t firstMatch = matches.size();
+    mKeywords.Scan(text, size, [&](uint32_t matcherIndex, size_t start, size_t end) {
+      matches.push_back(ClassificationMatch{matcherIndex, baseOffset + static_cast<int64_t>(start),
+          baseOffset + static_cast<int64_t>(end)});
+    });
+    for (const auto& regex : mRegexes) {
+      regex.expression.ForEachMatch(text, size, [&](size_t start, size_t end) {
+        bool isValid = true;
+        for (const auto& validator : regex.validators) {
+          isValid = isValid && validator(text + start, end - start);
+        }
+        if (isValid) {
+          matches.push_back(ClassificationMatch{regex.matcherIndex, baseOffset + static_cast<int64_t>(start),
+              baseOffset + static_cast<int64_t>(end)});
+        }
+      });
+    }
+    std::sort(matches.begin() + static_cast<std::ptrdiff_t>(firstMatch), matches.end(),
+        [](const ClassificationMatch& left, const ClassificationMatch& right) {
+          return left.start != right.start ? left.start < right.start :
+              left.end != right.end ? left.end < right.end : left.matcherIndex < right.matcherIndex;
+        });
+  }
+
+  /**
+   * @brief Classify a complete text
+   * 
+   * @param text Text, in UTF-8
+   * @param classificationIds Entities to report, or empty to report every entity found
+   * 
+   * @return Results of the entities found, keyed by entity ID, in the form returned by
+   *         ExecutionState::GetClassificationResults
+   */
+  std::shared_ptr<ClassificationResults> Classify(
+      const std::string& text,
+      const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds =
+          std::vector<std::shared_ptr<ClassificationRequest>>()) const;
+
+  /**
+   * @brief Create an evaluator counting entity instances from matches
+   * 
+   * @param classificationIds Entities to report, or empty to report every entity found
+   * 
+   * @return Evaluator, which must not outlive the classifier
+   */
+  std::unique_ptr<ClassificationEvaluator> CreateEvaluator(
+      const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds =
+          std::vector<std::shared_ptr<ClassificationRequest>>()) const;
+
+  /**
+   * @brief Get the longest text a single match may span
+   * 
+   * @return Maximum match length in bytes
+   */
+  size_t GetMaxMatchLength() const { return mMaxMatchLength; }
+
+  /**
+   * @brief Get the widest proximity window of any entity
+   * 
+   * @return Proximity in bytes
+   */
+  int64_t GetMaxProximity() const { return mMaxProximity; }
+
+  /**
+   * @brief Get the number of compiled entities
+   * 
+   * @return Entity count
+   */
+  size_t GetEntityCount() const { return mEntities.size(); }
+
+  /**
+   * @brief Check the Luhn checksum of the digits in a match, ignoring separators
+   * 
+   * @param match Matched text
+   * @param size Size of the match
+   * 
+   * @return true if the match has at least two digits and a valid checksum
+   */
+  static bool IsLuhnValid(const char* match, size_t size) {
+    int sum = 0;
+    int digitCount = 0;
+    for (size_t i = size; i > 0; --i) {
+      char c = match[i - 1];
+      if (c < '0' || c > '9') {
+        continue;
+      }
+      int digit = c - '0';
+      if (digitCount++ % 2 == 1) {
+        digit = digit * 2 > 9 ? digit * 2 - 9 : digit * 2;
+      }
+      sum += digit;
+    }
+    return digitCount >= 2 && sum % 10 == 0;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  struct Requirement {
+    std::vector<uint32_t> matcherIndexes; // Any of these matchers
+    int minCount;                         // Matches of the listed matchers, or distinct matchers for Any
+    int maxCount;                         // Upper bound on distinct matchers for Any, or -1
+    bool isAny;
+  };
+
+  struct Pattern {
+    int confidenceLevel;
+    uint32_t idMatcherIndex;
+    std::vector<Requirement> requirements;
+  };
+
+  struct Entity {
+    std::string id;
+    std::string name;
+    int64_t proximity = 300;
+    std::vector<Pattern> patterns;
+  };
+
+  const std::vector<Entity>& GetEntities() const { return mEntities; }
+
+  // Entities with at least one pattern whose IdMatch is the given matcher
+  const std::vector<uint32_t>& GetEntitiesById(uint32_t matcherIndex) const {
+    static const std::vector<uint32_t> kEmpty;
+    auto entities = mEntitiesByIdMatcher.find(matcherIndex);
+    return entities == mEntitiesByIdMatcher.end() ? kEmpty : entities->second;
+  }
+
+private:
+  struct Regex {
+    uint32_t matcherIndex;
+    localclassifier::LinearRegex expression;
+    std::vector<Validator> validators;
+  };
+
+  uint32_t GetMatcherIndex(const std::string& id) {
+    auto entry = mMatcherIndexes.emplace(id, static_cast<uint32_t>(mMatcherIndexes.size()));
+    return entry.first->second;
+  }
+
+  void Compile(const localclassifier::XmlElement& element, const std::map<std::string, Validator>& validators) {
+    if (element.name == "Regex") {
+      uint32_t matcherIndex = GetMatcherIndex(element.GetAttribute("id"));
+      try {
+        mRegexes.push_back(Regex{matcherIndex, localclassifier::LinearRegex(element.text, mMaxMatchLength),
+            std::vector<Validator>()});
+      } catch (const BadInputError&) {
+        return;
+      }
+      Regex& regex = mRegexes.back();
+      std::string names = element.GetAttribute("validators");
+      for (size_t position = 0; position < names.size();) {
+        size_t end = names.find_first_of(" ,;", position);
+        std::string name = names.substr(position, end == std::string::npos ? std::string::npos : end - position);
+        auto validator = validators.find(name);
+        if (!name.empty() && validator != validators.end()) {
+          regex.validators.push_back(validator->second);
+        }
+        position = end == std::string::npos ? names.size() : end + 1;
+      }
+    } else if (element.name == "Keyword") {
+      uint32_t matcherIndex = GetMatcherIndex(element.GetAttribute("id"));
+      for (const auto& group : element.children) {
+        bool isWordMatch = group.GetAttribute("matchStyle") != "string";
+        for (const auto& term : group.children) {
+          if (term.name == "Term") {
+            bool isCaseSensitive = term.GetAttribute("caseSensitive") == "true";
+            mKeywords.Add(localclassifier::KeywordAutomaton::Term{matcherIndex, term.text, isCaseSensitive,
+                isWordMatch});
+          }
+        }
+      }
+    } else if (element.name == "Entity") {
+      Entity entity;
+      entity.id = element.GetAttribute("id");
+      const std::string& proximity = element.GetAttribute("patternsProximity");
+      if (!proximity.empty()) {
+        entity.proximity = std::strtoll(proximity.c_str(), nullptr, 10);
+      }
+      for (const auto& child : element.children) {
+        if (child.name == "Pattern") {
+          CompilePattern(child, entity);
+        }
+      }
+      uint32_t entityIndex = static_cast<uint32_t>(mEntities.size());
+      for (const auto& pattern : entity.patterns) {
+        auto& entities = mEntitiesByIdMatcher[pattern.idMatcherIndex];
+        if (entities.empty() || entities.back() != entityIndex) {
+          entities.push_back(entityIndex);
+        }
+      }
+      mEntityIndexes[entity.id] = entityIndex;
+      mEntities.push_back(std::move(entity));
+    } else if (element.name == "Resource") {
+      // Localized names arrive after the entities, so they are attached by ID
+      auto entityIndex = mEntityIndexes.find(element.GetAttribute("idRef"));
+      for (const auto& child : element.children) {
+        if (entityIndex != mEntityIndexes.end() && child.name == "Name" &&
+            (child.GetAttribute("default") == "true" || mEntities[entityIndex->second].name.empty())) {
+          mEntities[entityIndex->second].name = child.text;
+        }
+      }
+    } else {
+      for (const auto& child : element.children) {
+        Compile(child, validators);
+      }
+    }
+  }
+
+  void CompilePattern(const localclassifier::XmlElement& element, Entity& entity) {
+    Pattern pattern{std::atoi(element.GetAttribute("confidenceLevel").c_str()), 0, std::vector<Requirement>()};
+    bool hasIdMatch = false;
+    for (const auto& child : element.children) {
+      if (child.name == "IdMatch") {
+        pattern.idMatcherIndex = GetMatcherIndex(child.GetAttribute("idRef"));
+        hasIdMatch = true;
+      } else if (child.name == "Match") {
+        const std::string& minCount = child.GetAttribute("minCount");
+        pattern.requirements.push_back(Requirement{{GetMatcherIndex(child.GetAttribute("idRef"))},
+            minCount.empty() ? 1 : std::atoi(minCount.c_str()), -1, false});
+      } else if (child.name == "Any") {
+        Requirement any{std::vector<uint32_t>(), 1, -1, true};
+        const std::string& minMatches = child.GetAttribute("minMatches");
+        const std::string& maxMatches = child.GetAttribute("maxMatches");
+        if (!minMatches.empty()) {
+          any.minCount = std::atoi(minMatches.c_str());
+        }
+        if (!maxMatches.empty()) {
+          any.maxCount = std::atoi(maxMatches.c_str());
+        }
+        for (const auto& match : child.children) {
+          if (match.name == "Match") {
+            any.matcherIndexes.push_back(GetMatcherIndex(match.GetAttribute("idRef")));
+          }
+        }
+        pattern.requirements.push_back(std::move(any));
+      }
+    }
+    if (hasIdMatch) {
+      entity.patterns.push_back(std::move(pattern));
+    }
+  }
+
+  size_t mMaxMatchLength;
+  int64_t mMaxProximity;
+  std::unordered_map<std::string, uint32_t> mMatcherIndexes;
+  std::unordered_map<std::string, uint32_t> mEntityIndexes;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> mEntitiesByIdMatcher;
+  std::vector<Entity> mEntities;
+  std::vector<Regex> mRegexes;
+  localclassifier::KeywordAutomaton mKeywords;
+  /** @endcond */
+};
+
+/**
+ * @brief Accumulates matches in text order and counts entity instances, holding only the matches that can still fall
+ *        inside a proximity window
+ * 
+ * @note Obtained from LocalClassifier::CreateEvaluator. Add matches sorted by start offset, call Flush with the offset
+ *       below which no more matches will start, and GetResults once all text was added.
+ */
+class ClassificationEvaluator {
+public:
+  /** @cond DOXYGEN_HIDE */
+  ClassificationEvaluator(const LocalClassifier& classifier, const std::vector<std::string>& entityIds)
+      : mClassifier(classifier),
+        mCounts(classifier.GetEntities().size()) {
+    for (const auto& id : entityIds) {
+      mRequestedIds.push_back(id);
+    }
+  }
+  /** @endcond */
+
+  /**
+   * @brief Add one match. Matches must be added in start offset order.
+   * 
+   * @param match Match
+   * @param isCounted false if the match may only support other instances' patterns, e.g. because it lies outside
+   *        the segment this evaluator counts
+   */
+  void Add(const ClassificationMatch& match, bool isCounted = true) {
+    mMatches.push_back(match);
+    if (!isCounted) {
+      return;
+    }
+    for (uint32_t entityIndex : mClassifier.GetEntitiesById(match.matcherIndex)) {
+      int64_t proximity = mClassifier.GetEntities()[entityIndex].proximity;
+      mPending.push_back(Candidate{match, entityIndex, match.start - proximity, match.end + proximity});
+    }
+  }
+
+  /**
+   * @brief Add matches sorted by start offset
+   * 
+   * @param matches Matches
+   */
+  void Add(const std::vector<ClassificationMatch>& matches) {
+    for (const auto& match : matches) {
+      Add(match);
+    }
+  }
+
+  /**
+   * @brief Count the instances whose proximity window is complete and release matches no window can still use
+   * 
+   * @param safeOffset Offset below which no more matches will start
+   */
+  void Flush(int64_t safeOffset) {
+    size_t kept = 0;
+    for (size_t i = 0; i < mPending.size(); ++i) {
+      if (mPending[i].windowEnd <= safeOffset) {
+        Evaluate(mPending[i]);
+      } else {
+        mPending[kept++] = mPending[i];
+      }
+    }
+    mPending.resize(kept);
+    // Future candidates start at or after safeOffset, so their windows start no earlier than this
+    int64_t keepFrom = safeOffset - mClassifier.GetMaxProximity();
+    for (const auto& candidate : mPending) {
+      keepFrom = (std::min)(keepFrom, candidate.windowStart);
+    }
+    while (!mMatches.empty() && mMatches.front().start < keepFrom) {
+      mMatches.pop_front();
+    }
+  }
+
+  /**
+   * @brief Count every remaining instance and build the results
+   * 
+   * @return Results of the entities found, keyed by entity ID
+   */
+  std::shared_ptr<ClassificationResults> GetResults() {
+    for (const auto& candidate : mPending) {
+      Evaluate(candidate);
+    }
+    mPending.clear();
+    auto results = std::make_shared<ClassificationResults>();
+    const auto& entities = mClassifier.GetEntities();
+    for (size_t i = 0; i < entities.size(); ++i) {
+      const EntityCount& count = mCounts[i];
+      if (count.byConfidence.empty() || !IsRequested(entities[i].id)) {
+        continue;
+      }
+      int total = 0;
+      std::vector<std::shared_ptr<DetailedClassificationResult>> details;
+      for (const auto& band : count.byConfidence) {
+        total += band.second;
+        details.push_back(std::make_shared<localclassifier::LocalDetailedResult>(band.first, band.second));
+      }
+      (*results)[entities[i].id] = std::make_shared<localclassifier::LocalClassificationResult>(
+          entities[i].id, entities[i].name, total, count.byConfidence.rbegin()->first, details);
+    }
+    return results;
+  }
+
+  /**
+   * @brief Get the number of matches currently held
+   * 
+   * @return Match count
+   */
+  size_t GetHeldMatchCount() const { return mMatches.size(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Candidate {
+    ClassificationMatch idMatch;
+    uint32_t entityIndex;
+    int64_t windowStart;
+    int64_t windowEnd;
+  };
+
+  struct EntityCount {
+    std::map<int, int> byConfidence;
+  };
+
+  bool IsRequested(const std::string& id) const {
+    return mRequestedIds.empty() || std::find(mRequestedIds.begin(), mRequestedIds.end(), id) != mRequestedIds.end();
+  }
+
+  // Counts the matches of the listed matchers that start inside the window, other than the IdMatch itself
+  int CountMatches(const LocalClassifier::Requirement& requirement, const Candidate& candidate,
+      std::vector<uint32_t>* distinctMatchers) const {
+    auto first = std::lower_bound(mMatches.begin(), mMatches.end(), candidate.windowStart,
+        [](const ClassificationMatch& match, int64_t offset) { return match.start < offset; });
+    int count = 0;
+    for (auto match = first; match != mMatches.end() && match->start < candidate.windowEnd; ++match) {
+      bool isIdMatch = match->matcherIndex == candidate.idMatch.matcherIndex &&
+          match->start == candidate.idMatch.start && match->end == candidate.idMatch.end;
+      if (isIdMatch || std::find(requirement.matcherIndexes.begin(), requirement.matcherIndexes.end(),
+                                 match->matcherIndex) == requirement.matcherIndexes.end()) {
+        continue;
+      }
+      ++count;
+      if (distinctMatchers &&
+          std::find(distinctMatchers->begin(), distinctMatchers->end(), match->matcherIndex) ==
+              distinctMatchers->end()) {
+        distinctMatchers->push_back(match->matcherIndex);
+      }
+    }
+    return count;
+  }
+
+  void Evaluate(const Candidate& candidate) {
+    const auto& entity = mClassifier.GetEntities()[candidate.entityIndex];
+    EntityCount& count = mCounts[candidate.entityIndex];
+    int bestConfidence = -1;
+    for (const auto& pattern : entity.patterns) {
+      if (pattern.idMatcherIndex != candidate.idMatch.matcherIndex || pattern.confidenceLevel <= bestConfidence) {
+        continue;
+      }
+      bool isSatisfied = true;
+      for (const auto& requirement : pattern.requirements) {
+        if (requirement.isAny) {
+          std::vector<uint32_t> distinctMatchers;
+          CountMatches(requirement, candidate, &distinctMatchers);
+          int distinct = static_cast<int>(distinctMatchers.size());
+          isSatisfied = distinct >= requirement.minCount &&
+              (requirement.maxCount < 0 || distinct <= requirement.maxCount);
+        } else {
+          isSatisfied = CountMatches(requirement, candidate, nullptr) >= requirement.minCount;
+        }
+        if (!isSatisfied) {
+          break;
+        }
+      }
+      if (isSatisfied) {
+        bestConfidence = pattern.confidenceLevel;
+      }
+    }
+    if (bestConfidence >= 0) {
+      ++count.byConfidence[bestConfidence];
+    }
+  }
+
+  const LocalClassifier& mClassifier;
+  std::vector<std::string> mRequestedIds;
+  std::deque<ClassificationMatch> mMatches;
+  std::vector<Candidate> mPending;
+  std::vector<EntityCount> mCounts;
+  /** @endcond */
+};
+
+inline std::unique_ptr<ClassificationEvaluator> LocalClassifier::CreateEvaluator(
+    const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds) const {
+  std::vector<std::string> entityIds;
+  for (const auto& request : classificationIds) {
+    if (request) {
+      entityIds.push_back(request->GetClassificationId());
+    }
+  }
+  return std::unique_ptr<ClassificationEvaluator>(new ClassificationEvaluator(*this, entityIds));
+}
+
+inline std::shared_ptr<ClassificationResults> LocalClassifier::Classify(
+    const std::string& text,
+    const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds) const {
+  std::vector<ClassificationMatch> matches;
+  Scan(text.data(), text.size(), 0, matches);
+  auto evaluator = CreateEvaluator(classificationIds);
+  evaluator->Add(matches);
+  return evaluator->GetResults();
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_LOCAL_CLASSIFIER_H_
@@ -0,0 +1,298 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MemoizedPolicyHandler, which reuses ComputeActions results for repeated execution state inputs
+ * 
+ * @file memoized_policy_handler.h
+ */
+
+#ifndef API_MIP_UPE_MEMOIZED_POLICY_HANDLER_H_
+#define API_MIP_UPE_MEMOIZED_POLICY_HANDLER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection_descriptor.h"
+#include "mip/upe/action.h"
+#include "mip/upe/content_label.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/label.h"
+#include "mip/upe/metadata_entry.h"
+#include "mip/upe/metadata_version.h"
+#include "mip/upe/policy_engine.h"
+#include "mip/upe/policy_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Immutable list of actions shared between the callers that computed it
+ */
+typedef std::shared_ptr<const std::vector<std::shared_ptr<Action>>> SharedActions;
+
+/**
+ * @brief Thread-safe LRU cache of ComputeActions results, shared by MemoizedPolicyHandler instances
+ */
+class ComputeActionsCache {
+public:
+  /**
+   * @brief ComputeActionsCache constructor
+   * 
+   * @param maxEntries Maximum number of cached results
+   */
+  explicit ComputeActionsCache(size_t maxEntries = 4096)
+      : mMaxEntries(maxEntries),
+        mHitCount(0),
+        mMissCount(0) {}
+
+  /**
+   * @brief Drop every result, e.g. from FileProfile::Observer::OnPolicyChanged
+   * 
+   * @note Not required for correctness, since keys include the policy file ID, but it frees results of the old
+   *       policy at once.
+   */
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mLru.clear();
+  }
+
+  /** @brief Get the number of cached results */
+  size_t GetEntryCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  /** @brief Get the number of lookups answered from the cache */
+  uint64_t GetHitCount() const { return mHitCount; }
+
+  /** @brief Get the number of lookups that computed actions */
+  uint64_t GetMissCount() const { return mMissCount; }
+
+  /** @cond DOXYGEN_HIDE */
+  SharedActions Find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto entry = mEntries.find(key);
+    if (entry == mEntries.end()) {
+      ++mMissCount;
+      return nullptr;
+    }
+    ++mHitCount;
+    mLru.splice(mLru.begin(), mLru, entry->second.second);
+    return entry->second.first;
+  }
+
+  void Add(const std::string& key, const SharedActions& actions) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mMaxEntries == 0 || mEntries.find(key) != mEntries.end()) {
+      return;
+    }
+    mLru.push_front(key);
+    mEntries.emplace(key, std::make_pair(actions, mLru.begin()));
+    while (mEntries.size() > mMaxEntries) {
+      mEntries.erase(mLru.back());
+      mLru.pop_back();
+    }
+  }
+
+private:
+  size_t mMaxEntries;
+  mutable std::mutex mMutex;
+  std::list<std::string> mLru;
+  std::unordered_map<std::string, std::pair<SharedActions, std::list<std::string>::iterator>> mEntries;
+  std::atomic<uint64_t> mHitCount;
+  std::atomic<uint64_t> mMissCount;
+  /** @endcond */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace memoizedpolicy {
+
+// Length-prefixed fields keep the key unambiguous whatever the strings contain
+inline void Append(std::string& key, const std::string& value) {
+  key += std::to_string(value.size());
+  key += ':';
+  key += value;
+}
+
+inline void Append(std::string& key, uint64_t value) {
+  Append(key, std::to_string(value));
+}
+
+inline std::string GetLabelMetadataPrefix() { return "MSIP_Label_"; }
+
+} // namespace memoizedpolicy
+/** @endcond */
+
+/**
+ * @brief PolicyHandler decorator that returns a cached result when ComputeActions sees the same relevant inputs again
+ * 
+ * @note The key covers the policy file ID, the new label, its assignment method and extended properties, the content
+ *       format, metadata version, supported actions, data state, downgrade justification, the protection template and
+ *       label, and the MSIP_Label_* metadata that carries the current label. States are evaluated without the cache
+ *       when the engine has classification rules for the content format, since automatic labeling depends on the
+ *       content itself. Cached results skip the inner handler, including any audit it would emit for the
+ *       computation; NotifyCommittedActions and GetSensitivityLabel always forward.
+ */
+class MemoizedPolicyHandler : public PolicyHandler {
+public:
+  /**
+   * @brief MemoizedPolicyHandler constructor
+   * 
+   * @param engine Engine that created the inner handler, consulted for its policy file ID and classification rules
+   * @param innerHandler Handler computing actions on a cache miss
+   * @param cache Cache, which may be shared by the handlers of several engines
+   */
+  MemoizedPolicyHandler(
+      const std::shared_ptr<PolicyEngine>& engine,
+      const std::shared_ptr<PolicyHandler>& innerHandler,
+      const std::shared_ptr<ComputeActionsCache>& cache)
+      : mEngine(engine),
+        mInnerHandler(innerHandler),
+        mCache(cache) {
+    if (!mEngine || !mInnerHandler || !mCache) {
+      throw BadInputError("MemoizedPolicyHandler requires an engine, a handler and a cache");
+    }
+  }
+
+  /**
+   * @brief Get the sensitivity label from existing content
+   * 
+   * @param state Current state of the content
+   * 
+   * @return Label currently applied to content. If unlabeled, returns empty.
+   */
+  std::shared_ptr<ContentLabel> GetSensitivityLabel(const ExecutionState& state) override {
+    return mInnerHandler->GetSensitivityLabel(state);
+  }
+
+  /**
+   * @brief Executes the rules in the handler and returns the list of actions to be executed
+   * 
+   * @param state Current state of the content
+   * 
+   * @return List of actions that should be executed
+   */
+  std::vector<std::shared_ptr<Action>> ComputeActions(const ExecutionState& state) override {
+    return *ComputeSharedActions(state);
+  }
+
+  /**
+   * @brief Compute actions without copying a cached result
+   * 
+   * @param state Current state of the content
+   * 
+   * @return Actions shared with other callers; they must not be modified
+   */
+  SharedActions ComputeSharedActions(const ExecutionState& state) {
+    std::string contentFormat = state.GetContentFormat();
+    if (mEngine->HasClassificationRules(std::vector<std::string>{contentFormat})) {
+      return std::make_shared<const std::vector<std::shared_ptr<Action>>>(mInnerHandler->ComputeActions(state));
+    }
+    std::string key = GetKey(state, contentFormat);
+    if (auto actions = mCache->Find(key)) {
+      return actions;
+    }
+    auto actions = std::make_shared<const std::vector<std::shared_ptr<Action>>>(mInnerHandler->ComputeActions(state));
+    mCache->Add(key, actions);
+    return actions;
+  }
+
+  /**
+   * @brief Called once the actions computed for the state have been committed
+   * 
+   * @param state Current state of the content
+   */
+  void NotifyCommittedActions(const ExecutionState& state) override { mInnerHandler->NotifyCommittedActions(state); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  std::string GetKey(const ExecutionState& state, const std::string& contentFormat) const {
+    using memoizedpolicy::Append;
+    std::string key;
+    Append(key, mEngine->GetPolicyFileId());
+    auto newLabel = state.GetNewLabel();
+    Append(key, newLabel ? newLabel->GetId() : std::string());
+    Append(key, static_cast<uint64_t>(state.GetNewLabelAssignmentMethod()));
+    auto extendedProperties = state.GetNewLabelExtendedProperties();
+    Append(key, static_cast<uint64_t>(extendedProperties.size()));
+    for (const auto& property : extendedProperties) {
+      Append(key, property.first);
+      Append(key, property.second);
+    }
+    Append(key, contentFormat);
+    MetadataVersion version = state.GetContentMetadataVersion();
+    Append(key, static_cast<uint64_t>(version.GetValue()));
+    Append(key, static_cast<uint64_t>(version.GetFlags()));
+    Append(key, static_cast<uint64_t>(state.GetSupportedActions()));
+    Append(key, static_cast<uint64_t>(state.GetDataState()));
+    auto justification = state.IsDowngradeJustified();
+    Append(key, static_cast<uint64_t>(justification.first ? 1 : 0));
+    Append(key, justification.second);
+    auto descriptor = state.GetProtectionDescriptor();
+    Append(key, static_cast<uint64_t>(descriptor ? 1 : 0));
+    if (descriptor) {
+      Append(key, static_cast<uint64_t>(descriptor->GetProtectionType()));
+      Append(key, descriptor->GetTemplateId());
+      Append(key, descriptor->GetLabelId());
+    }
+    auto metadata = state.GetContentMetadata(
+        std::vector<std::string>(), std::vector<std::string>{memoizedpolicy::GetLabelMetadataPrefix()});
+    // Applications may return metadata in any order, so sort it to keep equal states on one key
+    std::vector<std::pair<std::string, std::string>> labelMetadata;
+    labelMetadata.reserve(metadata.size());
+    for (const auto& entry : metadata) {
+      labelMetadata.emplace_back(entry.GetKey(), entry.GetValue());
+    }
+    std::sort(labelMetadata.begin(), labelMetadata.end());
+    Append(key, static_cast<uint64_t>(labelMetadata.size()));
+    for (const auto& entry : labelMetadata) {
+      Append(key, entry.first);
+      Append(key, entry.second);
+    }
+    return key;
+  }
+
+  std::shared_ptr<PolicyEngine> mEngine;
+  std::shared_ptr<PolicyHandler> mInnerHandler;
+  std::shared_ptr<ComputeActionsCache> mCache;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_MEMOIZED_POLICY_HANDLER_H_
@@ -0,0 +1,256 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines MetadataIndex, a sorted view over caller-owned metadata answering name and prefix queries
+ * 
+ * @file metadata_index.h
+ */
+
+#ifndef API_MIP_UPE_METADATA_INDEX_H_
+#define API_MIP_UPE_METADATA_INDEX_H_
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/metadata_entry.h"
+#include "mip/upe/metadata_version.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Sorted, non-owning index of metadata key/value pairs
+ * 
+ * @note The index stores pointers to the caller's key and value strings, which must outlive it and stay unmodified.
+ *       Name and prefix lookups are binary searches that compare keys ignoring ASCII case, like Office custom
+ *       properties, and only matching entries are ever copied.
+ */
+class MetadataIndex {
+public:
+  /**
+   * @brief Add one entry
+   * 
+   * @param key Metadata key, owned by the caller
+   * @param value Metadata value, owned by the caller
+   * @param version Metadata version of the entry
+   */
+  void Add(const std::string& key, const std::string& value, uint32_t version = 0) {
+    mEntries.push_back(Entry{&key, &value, version});
+    mIsSorted = false;
+  }
+
+  /**
+   * @brief Add every entry of a list of key/value pairs
+   * 
+   * @param entries Key/value pairs, owned by the caller
+   * @param version Metadata version of the entries
+   */
+  void Add(const std::vector<std::pair<std::string, std::string>>& entries, uint32_t version = 0) {
+    mEntries.reserve(mEntries.size() + entries.size());
+    for (const auto& entry : entries) {
+      Add(entry.first, entry.second, version);
+    }
+  }
+
+  /**
+   * @brief Remove every entry
+   */
+  void Clear() {
+    mEntries.clear();
+    mIsSorted = true;
+  }
+
+  /**
+   * @brief Find the value of a key
+   * 
+   * @param name Key
+   * 
+   * @return Pointer to the caller's value, or nullptr if the key is absent
+   */
+  const std::string* Find(const std::string& name) const {
+    Sort();
+    auto entry = std::lower_bound(mEntries.begin(), mEntries.end(), name, IsKeyBefore);
+    return entry != mEntries.end() && Compare(*entry->key, name) == 0 ? entry->value : nullptr;
+  }
+
+  /**
+   * @brief Visit every entry whose key starts with a prefix, in key order
+   * 
+   * @param prefix Key prefix
+   * @param visitor Called with the key, value and version of each entry; return false to stop
+   */
+  void VisitPrefix(
+      const std::string& prefix,
+      const std::function<bool(const std::string& key, const std::string& value, uint32_t version)>& visitor) const {
+    Sort();
+    for (auto entry = std::lower_bound(mEntries.begin(), mEntries.end(), prefix, IsKeyBefore);
+         entry != mEntries.end() && HasPrefix(*entry->key, prefix); ++entry) {
+      if (!visitor(*entry->key, *entry->value, entry->version)) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Answer an ExecutionState::GetContentMetadata query
+   * 
+   * @param names Keys to return
+   * @param namePrefixes Key prefixes to return
+   * 
+   * @return Matching entries, each once, in key order
+   */
+  std::vector<MetadataEntry> GetMetadata(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& namePrefixes) const {
+    Sort();
+    std::vector<const Entry*> matches;
+    for (const auto& name : names) {
+      auto entry = std::lower_bound(mEntries.begin(), mEntries.end(), name, IsKeyBefore);
+      for (; entry != mEntries.end() && Compare(*entry->key, name) == 0; ++entry) {
+        matches.push_back(&*entry);
+      }
+    }
+    for (const auto& prefix : namePrefixes) {
+      auto entry = std::lower_bound(mEntries.begin(), mEntries.end(), prefix, IsKeyBefore);
+      for (; entry != mEntries.end() && HasPrefix(*entry->key, prefix); ++entry) {
+        matches.push_back(&*entry);
+      }
+    }
+    // Entries are stored sorted, so ordering the matches by address orders them by key and groups duplicates
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    std::vector<MetadataEntry> result;
+    result.reserve(matches.size());
+    for (const Entry* entry : matches) {
+      result.emplace_back(*entry->key, *entry->value, entry->version);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Get the number of entries
+   * 
+   * @return Entry count
+   */
+  size_t GetCount() const { return mEntries.size(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  struct Entry {
+    const std::string* key;
+    const std::string* value;
+    uint32_t version;
+  };
+
+  static int Compare(const std::string& left, const std::string& right) {
+    size_t size = (std::min)(left.size(), right.size());
+    for (size_t i = 0; i < size; ++i) {
+      int l = std::tolower(static_cast<unsigned char>(left[i]));
+      int r = std::tolower(static_cast<unsigned char>(right[i]));
+      if (l != r) {
+        return l < r ? -1 : 1;
+      }
+    }
+    return left.size() == right.size() ? 0 : (left.size() < right.size() ? -1 : 1);
+  }
+
+  static bool IsKeyBefore(const Entry& entry, const std::string& key) { return Compare(*entry.key, key) < 0; }
+
+  static bool HasPrefix(const std::string& key, const std::string& prefix) {
+    if (key.size() < prefix.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < prefix.size(); ++i) {
+      if (std::tolower(static_cast<unsigned char>(key[i])) != std::tolower(static_cast<unsigned char>(prefix[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Sort() const {
+    if (!mIsSorted) {
+      std::stable_sort(mEntries.begin(), mEntries.end(), [](const Entry& left, const Entry& right) {
+        return Compare(*left.key, *right.key) < 0;
+      });
+      mIsSorted = true;
+    }
+  }
+
+  mutable std::vector<Entry> mEntries;
+  mutable bool mIsSorted = true;
+  /** @endcond */
+};
+
+/**
+ * @brief ExecutionState base whose GetContentMetadata is answered from a MetadataIndex
+ * 
+ * @note Derived classes fill the index, typically once per item from storage they already own, and implement the
+ *       remaining ExecutionState methods. Each SDK query then costs a few binary searches and copies only the
+ *       matching entries. Call GetContentMetadataIndex().Find or VisitPrefix to probe keys without any allocation.
+ *       The index sorts itself lazily on the first query, so fill it completely before sharing the state between
+ *       threads.
+ */
+class IndexedMetadataExecutionState : public ExecutionState {
+public:
+  /**
+   * @brief Get the meta-data items from the content.
+   * 
+   * @param names Keys to return
+   * @param namePrefixes Key prefixes to return
+   * 
+   * @return the metadata applied to the content.
+   */
+  std::vector<MetadataEntry> GetContentMetadata(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& namePrefixes) const override {
+    return mMetadataIndex.GetMetadata(names, namePrefixes);
+  }
+
+  /**
+   * @brief Get the metadata index
+   * 
+   * @return Index the content metadata is answered from
+   */
+  const MetadataIndex& GetContentMetadataIndex() const { return mMetadataIndex; }
+
+  /** @cond DOXYGEN_HIDE */
+protected:
+  MetadataIndex& GetMutableContentMetadataIndex() { return mMetadataIndex; }
+
+private:
+  MetadataIndex mMetadataIndex;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_METADATA_INDEX_H_
@@ -0,0 +1,257 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ClassifyParallel, which classifies one text on several threads
+ * 
+ * @file parallel_classification.h
+ */
+
+#ifndef API_MIP_UPE_PARALLEL_CLASSIFICATION_H_
+#define API_MIP_UPE_PARALLEL_CLASSIFICATION_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/upe/classification_request.h"
+#include "mip/upe/classification_result.h"
+#include "mip/upe/local_classifier.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Options of ClassifyParallel
+ */
+struct ParallelClassificationOptions {
+  size_t maxParallel = 1;                                 /**< Maximum number of segments classified at once */
+  size_t minSegmentSize = 1024 * 1024;                    /**< Smallest segment worth a separate task, in bytes */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher; /**< Runs segments off the calling thread, or nullptr */
+};
+
+/**
+ * @brief Combine the results of several classifications of disjoint parts of one content
+ * 
+ * @param parts Results to combine
+ * 
+ * @return Per entity: the summed count, the highest confidence level and the summed count of each confidence level
+ */
+inline std::shared_ptr<ClassificationResults> MergeClassificationResults(
+    const std::vector<std::shared_ptr<ClassificationResults>>& parts) {
+  struct Merged {
+    std::string name;
+    int count = 0;
+    int confidenceLevel = 0;
+    std::map<int, int> byConfidence;
+  };
+  std::map<std::string, Merged> merged;
+  for (const auto& part : parts) {
+    if (!part) {
+      continue;
+    }
+    for (const auto& entry : *part) {
+      if (!entry.second) {
+        continue;
+      }
+      Merged& entity = merged[entry.first];
+      if (entity.name.empty()) {
+        entity.name = entry.second->GetName();
+      }
+      entity.count += entry.second->GetCount();
+      entity.confidenceLevel = (std::max)(entity.confidenceLevel, entry.second->GetConfidenceLevel());
+      for (const auto& detail : entry.second->GetDetailedClassificationAttributes()) {
+        if (detail) {
+          entity.byConfidence[detail->GetConfidenceLevel()] += detail->GetCount();
+        }
+      }
+    }
+  }
+  auto results = std::make_shared<ClassificationResults>();
+  for (const auto& entity : merged) {
+    std::vector<std::shared_ptr<DetailedClassificationResult>> details;
+    for (const auto& band : entity.second.byConfidence) {
+      details.push_back(std::make_shared<localclassifier::LocalDetailedResult>(band.first, band.second));
+    }
+    (*results)[entity.first] = std::make_shared<localclassifier::LocalClassificationResult>(entity.first,
+        entity.second.name, entity.second.count, entity.second.confidenceLevel, details);
+  }
+  return results;
+}
+
+/** @cond DOXYGEN_HIDE */
+namespace parallelclassification {
+
+inline std::string CreateTaskId() {
+  static std::atomic<uint64_t> sTaskCounter(0);
+  return "mip-classify-" + std::to_string(++sTaskCounter);
+}
+
+// Segments not yet run, claimed by whichever thread reaches them first
+struct ClaimedSegments {
+  explicit ClaimedSegments(size_t count) : claimed(count), remaining(count) {}
+  std::vector<std::atomic<bool>> claimed;
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t remaining;
+};
+
+// Offers every segment but the last one to the dispatcher, runs the last one inline, then runs inline every segment
+// no worker has claimed yet and waits for the claimed ones. Waiting therefore never needs a free worker, even when
+// called from a dispatcher task. runSegment must not throw.
+inline void RunSegments(size_t count, const std::shared_ptr<TaskDispatcherDelegate>& dispatcher,
+    const std::function<void(size_t)>& runSegment) {
+  auto state = std::make_shared<ClaimedSegments>(count);
+  // A worker reaching a segment the caller already ran touches only the shared state
+  auto runClaimed = [state, &runSegment](size_t segment) {
+    if (state->claimed[segment].exchange(true)) {
+      return;
+    }
+    runSegment(segment);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->remaining == 0) {
+      state->finished.notify_all();
+    }
+  };
+  for (size_t segment = 0; segment + 1 < count; ++segment) {
+    try {
+      if (dispatcher) {
+        dispatcher->DispatchTask(CreateTaskId(), [runClaimed, segment]() { runClaimed(segment); });
+      } else {
+        std::thread([runClaimed, segment]() { runClaimed(segment); }).detach();
+      }
+    } catch (...) {
+      // Left unclaimed for the calling thread
+    }
+  }
+  for (size_t segment = count; segment-- > 0;) {
+    runClaimed(segment);
+  }
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state]() { return state->remaining == 0; });
+}
+
+// Counts the instances whose IdMatch starts in [begin, end). The scan reaches one proximity window and one match
+// length further on each side, so every supporting match an instance can see in the whole text is seen here too.
+inline std::shared_ptr<ClassificationResults> ClassifySegment(
+    const LocalClassifier& classifier,
+    const char* text,
+    size_t size,
+    size_t begin,
+    size_t end,
+    const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds) {
+  size_t margin = static_cast<size_t>(classifier.GetMaxProximity()) + classifier.GetMaxMatchLength();
+  size_t scanBegin = begin > margin ? begin - margin : 0;
+  size_t scanEnd = (std::min)(size, end + margin);
+  std::vector<ClassificationMatch> matches;
+  classifier.Scan(text + scanBegin, scanEnd - scanBegin, static_cast<int64_t>(scanBegin), matches);
+  auto evaluator = classifier.CreateEvaluator(classificationIds);
+  for (const auto& match : matches) {
+    evaluator->Add(match, match.start >= static_cast<int64_t>(begin) && match.start < static_cast<int64_t>(end));
+  }
+  return evaluator->GetResults();
+}
+
+} // namespace parallelclassification
+/** @endcond */
+
+/**
+ * @brief Classify one text by splitting it into segments classified concurrently
+ * 
+ * @param classifier Compiled classifier
+ * @param text Text, in UTF-8
+ * @param size Size of the text in bytes
+ * @param classificationIds Entities to report, or empty to report every entity found
+ * @param options Parallelism, segment size and dispatcher options
+ * 
+ * @return Results of the entities found, keyed by entity ID, in the form returned by
+ *         ExecutionState::GetClassificationResults
+ * 
+ * @note Each segment counts only the instances whose primary match starts inside it but also scans the neighbouring
+ *       text within one proximity window, so instances near a segment boundary produce the same counts and confidence
+ *       levels as a single-threaded LocalClassifier::Classify. The calling thread classifies the last segment and
+ *       every segment no worker has started, then waits for the others, so it may be called from a dispatcher task.
+ */
+inline std::shared_ptr<ClassificationResults> ClassifyParallel(
+    const LocalClassifier& classifier,
+    const char* text,
+    size_t size,
+    const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds =
+        std::vector<std::shared_ptr<ClassificationRequest>>(),
+    const ParallelClassificationOptions& options = ParallelClassificationOptions()) {
+  size_t bySize = size / (std::max)(options.minSegmentSize, static_cast<size_t>(1));
+  size_t segmentCount = (std::max)((std::min)(options.maxParallel, bySize), static_cast<size_t>(1));
+  std::vector<std::shared_ptr<ClassificationResults>> parts(segmentCount);
+  std::vector<std::exception_ptr> errors(segmentCount);
+  auto runSegment = [&](size_t segment) {
+    try {
+      parts[segment] = parallelclassification::ClassifySegment(classifier, text, size, size * segment / segmentCount,
+          size * (segment + 1) / segmentCount, classificationIds);
+    } catch (...) {
+      errors[segment] = std::current_exception();
+    }
+  };
+
+  parallelclassification::RunSegments(segmentCount, options.taskDispatcher, runSegment);
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return segmentCount == 1 ? parts[0] : MergeClassificationResults(parts);
+}
+
+/**
+ * @brief Classify one text by splitting it into segments classified concurrently
+ * 
+ * @param classifier Compiled classifier
+ * @param text Text, in UTF-8
+ * @param classificationIds Entities to report, or empty to report every entity found
+ * @param options Parallelism, segment size and dispatcher options
+ * 
+ * @return Results of the entities found, keyed by entity ID
+ */
+inline std::shared_ptr<ClassificationResults> ClassifyParallel(
+    const LocalClassifier& classifier,
+    const std::string& text,
+    const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds =
+        std::vector<std::shared_ptr<ClassificationRequest>>(),
+    const ParallelClassificationOptions& options = ParallelClassificationOptions()) {
+  return ClassifyParallel(classifier, text.data(), text.size(), classificationIds, options);
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_PARALLEL_CLASSIFICATION_H_
@@ -0,0 +1,365 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines ComputeActionsBatch, which evaluates policy for many execution states in one call
+ * 
+ * @file policy_handler_batch.h
+ */
+
+#ifndef API_MIP_UPE_POLICY_HANDLER_BATCH_H_
+#define API_MIP_UPE_POLICY_HANDLER_BATCH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/protection_descriptor.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/upe/action.h"
+#include "mip/upe/classification_request.h"
+#include "mip/upe/classification_result.h"
+#include "mip/upe/execution_state.h"
+#include "mip/upe/label.h"
+#include "mip/upe/metadata_entry.h"
+#include "mip/upe/metadata_version.h"
+#include "mip/upe/policy_engine.h"
+#include "mip/upe/policy_handler.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Read-only view of the actions computed for one execution state, pointing into a ComputeActionsBatchResult
+ */
+class ActionSpan {
+public:
+  /** @cond DOXYGEN_HIDE */
+  ActionSpan(const std::shared_ptr<Action>* data, size_t size) : mData(data), mSize(size) {}
+  /** @endcond */
+
+  /** @brief Get the first action */
+  const std::shared_ptr<Action>* begin() const { return mData; }
+
+  /** @brief Get the end of the actions */
+  const std::shared_ptr<Action>* end() const { return mData + mSize; }
+
+  /** @brief Get the number of actions */
+  size_t size() const { return mSize; }
+
+  /** @brief Get whether there are no actions */
+  bool empty() const { return mSize == 0; }
+
+  /** @brief Get an action by index */
+  const std::shared_ptr<Action>& operator[](size_t index) const { return mData[index]; }
+
+private:
+  const std::shared_ptr<Action>* mData;
+  size_t mSize;
+};
+
+/**
+ * @brief Actions computed by ComputeActionsBatch, stored contiguously for the whole batch
+ */
+class ComputeActionsBatchResult {
+public:
+  /**
+   * @brief Get the number of execution states in the batch
+   * 
+   * @return Number of states
+   */
+  size_t GetCount() const { return mErrors.size(); }
+
+  /**
+   * @brief Get the actions computed for one execution state
+   * 
+   * @param index Index of the state in the batch
+   * 
+   * @return Actions, empty if the state failed
+   */
+  ActionSpan GetActions(size_t index) const {
+    return ActionSpan(mActions.data() + mOffsets[index], mOffsets[index + 1] - mOffsets[index]);
+  }
+
+  /**
+   * @brief Get the failure of one execution state
+   * 
+   * @param index Index of the state in the batch
+   * 
+   * @return Failure, nullptr on success
+   */
+  const std::exception_ptr& GetError(size_t index) const { return mErrors[index]; }
+
+  /** @cond DOXYGEN_HIDE */
+  std::vector<std::shared_ptr<Action>> mActions;
+  std::vector<size_t> mOffsets;
+  std::vector<std::exception_ptr> mErrors;
+  /** @endcond */
+};
+
+/**
+ * @brief Options of the engine overload of ComputeActionsBatch
+ */
+struct ComputeActionsBatchOptions {
+  size_t maxParallel = 1; /**< Policy handlers evaluating concurrently, each on its own slice of the batch */
+  bool isAuditDiscoveryEnabled = false; /**< Passed to PolicyEngine::CreatePolicyHandler */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher; /**< Runs slices off the calling thread, or nullptr */
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace policybatch {
+
+// Forwards to an application's ExecutionState, answering repeated GetContentMetadata queries from the first reply
+class HoistedExecutionState : public ExecutionState {
+public:
+  explicit HoistedExecutionState(const ExecutionState& inner) : mInner(inner) {}
+
+  std::shared_ptr<Label> GetNewLabel() const override { return mInner.GetNewLabel(); }
+  std::string GetContentIdentifier() const override { return mInner.GetContentIdentifier(); }
+  DataState GetDataState() const override { return mInner.GetDataState(); }
+  std::pair<bool, std::string> IsDowngradeJustified() const override { return mInner.IsDowngradeJustified(); }
+  AssignmentMethod GetNewLabelAssignmentMethod() const override { return mInner.GetNewLabelAssignmentMethod(); }
+  std::vector<std::pair<std::string, std::string>> GetNewLabelExtendedProperties() const override {
+    return mInner.GetNewLabelExtendedProperties();
+  }
+  std::vector<MetadataEntry> GetContentMetadata(
+      const std::vector<std::string>& names,
+      const std::vector<std::string>& namePrefixes) const override {
+    for (const auto& query : mMetadata) {
+      if (query.names == names && query.namePrefixes == namePrefixes) {
+        return query.entries;
+      }
+    }
+    mMetadata.push_back(MetadataQuery{names, namePrefixes, mInner.GetContentMetadata(names, namePrefixes)});
+    return mMetadata.back().entries;
+  }
+  std::shared_ptr<ProtectionDescriptor> GetProtectionDescriptor() const override {
+    return mInner.GetProtectionDescriptor();
+  }
+  std::string GetContentFormat() const override { return mInner.GetContentFormat(); }
+  MetadataVersion GetContentMetadataVersion() const override { return mInner.GetContentMetadataVersion(); }
+  ActionType GetSupportedActions() const override { return mInner.GetSupportedActions(); }
+  std::shared_ptr<ClassificationResults> GetClassificationResults(
+      const std::vector<std::shared_ptr<ClassificationRequest>>& classificationIds) const override {
+    return mInner.GetClassificationResults(classificationIds);
+  }
+  std::map<std::string, std::string> GetAuditMetadata() const override { return mInner.GetAuditMetadata(); }
+
+private:
+  struct MetadataQuery {
+    std::vector<std::string> names;
+    std::vector<std::string> namePrefixes;
+    std::vector<MetadataEntry> entries;
+  };
+
+  const ExecutionState& mInner;
+  mutable std::vector<MetadataQuery> mMetadata;
+};
+
+// Evaluates states [begin, end) with one handler, appending to one slice of the result
+inline void ComputeSlice(
+    PolicyHandler& handler,
+    const ExecutionState* const* states,
+    size_t begin,
+    size_t end,
+    std::vector<std::shared_ptr<Action>>& actions,
+    std::vector<size_t>& counts,
+    std::vector<std::exception_ptr>& errors) {
+  for (size_t i = begin; i < end; ++i) {
+    try {
+      if (!states[i]) {
+        throw BadInputError("ComputeActionsBatch requires an execution state");
+      }
+      HoistedExecutionState state(*states[i]);
+      std::vector<std::shared_ptr<Action>> computed = handler.ComputeActions(state);
+      counts[i] = computed.size();
+      std::move(computed.begin(), computed.end(), std::back_inserter(actions));
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  }
+}
+
+inline std::string CreateTaskId() {
+  static std::atomic<uint64_t> sTaskCounter(0);
+  return "mip-compute-actions-" + std::to_string(++sTaskCounter);
+}
+
+// Slices not yet run, claimed by whichever thread reaches them first
+struct ClaimedSlices {
+  explicit ClaimedSlices(size_t count) : claimed(count), remaining(count) {}
+  std::vector<std::atomic<bool>> claimed;
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t remaining;
+};
+
+// Offers every slice but the last one to the dispatcher, runs the last one inline, then runs inline every slice no
+// worker has claimed yet and waits for the claimed ones. Waiting therefore never needs a free worker, even when
+// called from a dispatcher task. runSlice must not throw.
+inline void RunSlices(size_t count, const std::shared_ptr<TaskDispatcherDelegate>& dispatcher,
+    const std::function<void(size_t)>& runSlice) {
+  auto state = std::make_shared<ClaimedSlices>(count);
+  // A worker reaching a slice the caller already ran touches only the shared state
+  auto runClaimed = [state, &runSlice](size_t slice) {
+    if (state->claimed[slice].exchange(true)) {
+      return;
+    }
+    runSlice(slice);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->remaining == 0) {
+      state->finished.notify_all();
+    }
+  };
+  for (size_t slice = 0; slice + 1 < count; ++slice) {
+    try {
+      if (dispatcher) {
+        dispatcher->DispatchTask(CreateTaskId(), [runClaimed, slice]() { runClaimed(slice); });
+      } else {
+        std::thread([runClaimed, slice]() { runClaimed(slice); }).detach();
+      }
+    } catch (...) {
+      // Left unclaimed for the calling thread
+    }
+  }
+  for (size_t slice = count; slice-- > 0;) {
+    runClaimed(slice);
+  }
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state]() { return state->remaining == 0; });
+}
+
+inline void FinishOffsets(ComputeActionsBatchResult& result, const std::vector<size_t>& counts) {
+  result.mOffsets.resize(counts.size() + 1);
+  result.mOffsets[0] = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    result.mOffsets[i + 1] = result.mOffsets[i] + counts[i];
+  }
+}
+
+} // namespace policybatch
+/** @endcond */
+
+/**
+ * @brief Compute the actions of many execution states with one policy handler
+ * 
+ * @param handler Policy handler
+ * @param states Execution states; the pointers must stay valid during the call
+ * @param count Number of states
+ * 
+ * @return Actions of every state, stored in one contiguous list shared by the batch, and per-state failures
+ * 
+ * @note Each state is evaluated with PolicyHandler::ComputeActions. Repeated GetContentMetadata queries made by the
+ *       SDK during one evaluation are answered from the state's first reply, so the application's implementation
+ *       runs once per distinct query. A failing state does not stop the batch.
+ */
+inline ComputeActionsBatchResult ComputeActionsBatch(
+    PolicyHandler& handler,
+    const ExecutionState* const* states,
+    size_t count) {
+  ComputeActionsBatchResult result;
+  std::vector<size_t> counts(count, 0);
+  result.mErrors.resize(count);
+  policybatch::ComputeSlice(handler, states, 0, count, result.mActions, counts, result.mErrors);
+  policybatch::FinishOffsets(result, counts);
+  return result;
+}
+
+/**
+ * @brief Compute the actions of many execution states, splitting the batch across several policy handlers
+ * 
+ * @param engine Policy engine creating one handler per slice
+ * @param states Execution states; the pointers must stay valid during the call
+ * @param count Number of states
+ * @param options Parallelism, audit and dispatcher options
+ * 
+ * @return Actions of every state, stored in one contiguous list shared by the batch, and per-state failures
+ * 
+ * @note The batch is split into up to maxParallel contiguous slices. The calling thread evaluates the last slice and
+ *       every slice no worker has started, then waits for the others, so no handler is shared between threads and
+ *       the batch may be computed from a dispatcher task. A failure to create a handler is reported for every state
+ *       of its slice.
+ */
+inline ComputeActionsBatchResult ComputeActionsBatch(
+    const std::shared_ptr<PolicyEngine>& engine,
+    const ExecutionState* const* states,
+    size_t count,
+    const ComputeActionsBatchOptions& options = ComputeActionsBatchOptions()) {
+  if (!engine) {
+    throw BadInputError("A PolicyEngine is required");
+  }
+  size_t sliceCount = (std::max)((std::min)(options.maxParallel, count), static_cast<size_t>(1));
+  ComputeActionsBatchResult result;
+  std::vector<size_t> counts(count, 0);
+  result.mErrors.resize(count);
+  std::vector<std::vector<std::shared_ptr<Action>>> sliceActions(sliceCount);
+
+  auto runSlice = [&](size_t slice) {
+    size_t begin = count * slice / sliceCount;
+    size_t end = count * (slice + 1) / sliceCount;
+    try {
+      auto handler = engine->CreatePolicyHandler(options.isAuditDiscoveryEnabled);
+      if (!handler) {
+        throw BadInputError("PolicyEngine::CreatePolicyHandler returned no handler");
+      }
+      policybatch::ComputeSlice(*handler, states, begin, end, sliceActions[slice], counts, result.mErrors);
+    } catch (...) {
+      for (size_t i = begin; i < end; ++i) {
+        result.mErrors[i] = std::current_exception();
+      }
+    }
+  };
+
+  policybatch::RunSlices(sliceCount, options.taskDispatcher, runSlice);
+
+  // Slices are contiguous, so concatenating them in order lines the actions up with the offsets
+  size_t total = 0;
+  for (const auto& actions : sliceActions) {
+    total += actions.size();
+  }
+  result.mActions.reserve(total);
+  for (auto& actions : sliceActions) {
+    std::move(actions.begin(), actions.end(), std::back_inserter(result.mActions));
+  }
+  policybatch::FinishOffsets(result, counts);
+  return result;
+}
+
+MIP_NAMESPACE_END
+#endif // API_MIP_UPE_POLICY_HANDLER_BATCH_H_
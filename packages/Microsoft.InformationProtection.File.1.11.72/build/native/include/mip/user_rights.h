@@ -34,6 +34,7 @@
 #define API_MIP_USER_RIGHTS_H_
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "mip/mip_namespace.h"
@@ -53,6 +54,15 @@ public:
    */
   UserRights(const std::vector<std::string>& users, const std::vector<std::string>& rights) : mUsers(users), mRights(rights) {}
 
+  /**
+   * @brief UserRights constructor taking ownership of the lists, to avoid copying large groups
+   * 
+   * @param users Group of users that share the same rights
+   * @param rights Rights shared by group of users
+   */
+  UserRights(std::vector<std::string>&& users, std::vector<std::string>&& rights)
+      : mUsers(std::move(users)), mRights(std::move(rights)) {}
+
   /**
    * @brief Gets users associated with a set of rights
    * 
@@ -34,6 +34,7 @@
 #define API_MIP_USER_ROLES_H_
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "mip/mip_export.h"
@@ -54,6 +55,15 @@ public:
    */
   UserRoles(const std::vector<std::string>& users, const std::vector<std::string>& roles) : mUsers(users), mRoles(roles) {}
 
+  /**
+   * @brief UserRoles constructor taking ownership of the lists, to avoid copying large groups
+   * 
+   * @param users Group of users that share the same roles
+   * @param roles Roles shared by group of users
+   */
+  UserRoles(std::vector<std::string>&& users, std::vector<std::string>&& roles)
+      : mUsers(std::move(users)), mRoles(std::move(roles)) {}
+
   /**
    * @brief Gets users associated with a set of roles
    * 
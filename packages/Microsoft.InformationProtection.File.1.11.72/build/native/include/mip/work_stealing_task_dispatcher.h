@@ -0,0 +1,655 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines WorkStealingTaskDispatcher, a scalable TaskDispatcherDelegate with per-worker deques and task
+ *        priorities
+ * 
+ * @file work_stealing_task_dispatcher.h
+ */
+
+#ifndef API_MIP_WORK_STEALING_TASK_DISPATCHER_H_
+#define API_MIP_WORK_STEALING_TASK_DISPATCHER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mip/common_types.h"
+#include "mip/elastic_thread_pool.h"
+#include "mip/mip_namespace.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/task_function.h"
+#include "mip/task_handle.h"
+#include "mip/timer_wheel.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief Scheduling class of a task
+ */
+enum class TaskPriority : unsigned int {
+  Interactive = 0, /**< A caller is waiting for the result, e.g. CreateFileHandlerAsync or a parallel fan-out */
+  Normal = 1,      /**< Default for tasks that cannot be classified */
+  Background = 2,  /**< Refreshes, flushes, prefetches and warm-ups nobody is waiting for */
+};
+
+/**
+ * @brief Classify a task by its ID
+ * 
+ * @param taskId ID passed to TaskDispatcherDelegate::DispatchTask
+ * 
+ * @return Background for the cache refresh, certificate warm-up, segment prefetch and connection pre-warm tasks of
+ *         this SDK's helpers, Interactive for their parallel fan-outs, Normal otherwise
+ */
+inline TaskPriority GetDefaultTaskPriority(const std::string& taskId) {
+  static const char* const kBackground[] = {
+      "mip-engine-cache-refresh-", "mip-user-cert-warmup-", "mip-segment-prefetch-", "mip-prewarm-"};
+  static const char* const kInteractive[] = {
+      "mip-parallel-crypto-", "mip-container-decrypt-", "mip-classify-", "mip-compute-actions-", "mip-await-"};
+  for (const char* prefix : kBackground) {
+    if (taskId.compare(0, std::char_traits<char>::length(prefix), prefix) == 0) {
+      return TaskPriority::Background;
+    }
+  }
+  for (const char* prefix : kInteractive) {
+    if (taskId.compare(0, std::char_traits<char>::length(prefix), prefix) == 0) {
+      return TaskPriority::Interactive;
+    }
+  }
+  return TaskPriority::Normal;
+}
+
+/**
+ * @brief Settings of a WorkStealingTaskDispatcher
+ */
+struct WorkStealingTaskDispatcherSettings {
+  /** Number of worker threads, or 0 for one per hardware thread */
+  size_t workerCount = 0;
+  /** Extra workers per hardware thread when workerCount is 0, for task mixes that block on I/O */
+  double oversubscription = 1.0;
+  /** Classifies tasks dispatched without a priority, GetDefaultTaskPriority if not set */
+  std::function<TaskPriority(const std::string& taskId)> getTaskPriority;
+  /** Wait after which a queued lower-class task runs ahead of higher-class tasks */
+  std::chrono::milliseconds starvationTimeout = std::chrono::milliseconds(500);
+  /** Bounds of the threads running ExecuteTaskOnIndependentThread tasks */
+  ElasticThreadPoolSettings independentThreads;
+  /** Called on each worker thread before it runs tasks, e.g. to set its processor affinity */
+  std::function<void(size_t workerIndex)> onWorkerStart;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace workstealing {
+
+const size_t kPriorityCount = 3;
+
+// Frees its slot once the last queue, shard or timer holding it lets go
+struct Task {
+  explicit Task(taskhandle::TaskSlots* taskSlots) : slots(taskSlots), handle(taskSlots->Acquire()) {}
+  ~Task() { slots->Release(handle); }
+
+  taskhandle::TaskSlots* slots;
+  TaskHandle handle;
+  std::string id;
+  bool isNamed = false;
+  TaskFunction function;
+  size_t priority = 0;
+  std::chrono::steady_clock::time_point queuedAt;
+  TimerHandle timer; // guarded by the task's shard
+};
+
+// Deques owned by one worker, one per priority: the owner pushes and pops at the back, thieves take from the front
+struct WorkerQueue {
+  std::mutex mutex;
+  std::deque<std::shared_ptr<Task>> tasks[kPriorityCount];
+};
+
+} // namespace workstealing
+/** @endcond */
+
+/**
+ * @brief TaskDispatcherDelegate running tasks on a fixed set of workers with per-worker work-stealing deques
+ * 
+ * @note Tasks dispatched from a worker go to that worker's own deque and run LIFO, which keeps continuation chains on
+ *       a warm cache; tasks dispatched from other threads go to a global injection queue. Idle workers take from the
+ *       injection queue, then steal the oldest task of another worker, then sleep. Task bookkeeping is sharded so that
+ *       dispatch and cancellation do not contend on one lock on many-core machines. Delayed tasks wait in a TimerWheel
+ *       with millisecond resolution, see DispatchTaskAfter. CancelTask succeeds for tasks that have not started.
+ *       Submit skips the task ID altogether and returns a TaskHandle that Cancel and CreateAsyncControl use without a
+ *       string lookup or lock. The overloads added by this class take a move-only TaskFunction, and tasks are moved,
+ *       never copied, from dispatch to the worker that runs them.
+ *       Tasks are scheduled strictly by TaskPriority, except that a task queued longer than starvationTimeout runs
+ *       ahead of higher classes. Tasks the SDK dispatches through the TaskDispatcherDelegate interface are classified
+ *       by their ID with getTaskPriority.
+ *       Pass an instance to FileProfile::Settings::SetTaskDispatcherDelegate,
+ *       ProtectionProfile::Settings::SetTaskDispatcherDelegate or PolicyProfile::Settings::SetTaskDispatcherDelegate.
+ *       Tasks still pending on destruction are discarded.
+ */
+class WorkStealingTaskDispatcher : public TaskDispatcherDelegate {
+public:
+  /**
+   * @brief Start the workers and the timer thread
+   * 
+   * @param settings Worker count
+   */
+  explicit WorkStealingTaskDispatcher(
+      const WorkStealingTaskDispatcherSettings& settings = WorkStealingTaskDispatcherSettings())
+      : mSlots(std::make_shared<taskhandle::TaskSlots>()),
+        mGetTaskPriority(settings.getTaskPriority ? settings.getTaskPriority : GetDefaultTaskPriority),
+        mStarvationTimeout(settings.starvationTimeout),
+        mPendingCount(0),
+        mSleepingCount(0),
+        mExecutedCount(0),
+        mStolenCount(0),
+        mPromotedCount(0),
+        mIsStopping(false),
+        mOnWorkerStart(settings.onWorkerStart),
+        mIndependentThreads(settings.independentThreads) {
+    size_t workerCount = settings.workerCount;
+    if (workerCount == 0) {
+      double hardwareThreads = static_cast<double>((std::max)(std::thread::hardware_concurrency(), 1u));
+      workerCount = static_cast<size_t>(hardwareThreads * (std::max)(settings.oversubscription, 0.0) + 0.5);
+    }
+    workerCount = (std::max)(workerCount, static_cast<size_t>(1));
+    for (auto& pendingCount : mPendingByPriority) {
+      pendingCount = 0;
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+      mQueues.emplace_back(new workstealing::WorkerQueue());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+      mWorkers.emplace_back([this, i]() { RunWorker(i); });
+    }
+  }
+
+  /**
+   * @brief Discard pending tasks and join the workers and independent threads once their running tasks return
+   */
+  ~WorkStealingTaskDispatcher() {
+    mTimers.Stop();
+    mIndependentThreads.Stop();
+    CancelAllTasks();
+    {
+      std::lock_guard<std::mutex> lock(mSleepMutex);
+      mIsStopping = true;
+    }
+    mWakeUp.notify_all();
+    for (auto& worker : mWorkers) {
+      worker.join();
+    }
+  }
+
+  using TaskDispatcherDelegate::DispatchTask;
+
+  /**
+   * @brief Execute a task on a worker, with the priority its ID is classified as
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   */
+  void DispatchTask(const std::string& taskId, std::function<void()> task) override {
+    DispatchTask(taskId, std::move(task), mGetTaskPriority(taskId));
+  }
+
+  /**
+   * @brief Execute a task on a worker
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param priority Scheduling class
+   * 
+   * @return Handle to cancel the task with
+   */
+  TaskHandle DispatchTask(const std::string& taskId, TaskFunction task, TaskPriority priority) {
+    auto registered = Register(taskId, std::move(task), priority);
+    Push(registered);
+    return registered->handle;
+  }
+
+  /**
+   * @brief Execute a task on a worker after a delay, with the priority its ID is classified as
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param delaySeconds Delay (in seconds) before executing task
+   */
+  void DispatchTask(const std::string& taskId, std::function<void()> task, int64_t delaySeconds) override {
+    DispatchTask(taskId, std::move(task), delaySeconds, mGetTaskPriority(taskId));
+  }
+
+  /**
+   * @brief Execute a task on a worker after a delay
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param delaySeconds Delay (in seconds) before executing task
+   * @param priority Scheduling class once the delay elapsed
+   * 
+   * @return Handle to cancel the task with
+   */
+  TaskHandle DispatchTask(
+      const std::string& taskId,
+      TaskFunction task,
+      int64_t delaySeconds,
+      TaskPriority priority) {
+    auto delay = std::chrono::seconds((std::max)(delaySeconds, static_cast<int64_t>(0)));
+    return DispatchTaskAfter(taskId, std::move(task), delay, priority);
+  }
+
+  /**
+   * @brief Execute a task on a worker after a delay with millisecond resolution, e.g. for retry backoff
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param delay Delay before executing task
+   * @param priority Scheduling class once the delay elapsed
+   * 
+   * @return Handle to cancel the task with
+   */
+  TaskHandle DispatchTaskAfter(
+      const std::string& taskId,
+      TaskFunction task,
+      std::chrono::milliseconds delay,
+      TaskPriority priority) {
+    auto registered = Register(taskId, std::move(task), priority);
+    TimerHandle timer = PushAfter(registered, delay);
+    if (timer.IsValid()) {
+      Shard& shard = GetShard(taskId);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      registered->timer = timer;
+    }
+    return registered->handle;
+  }
+
+  /**
+   * @brief Execute a task on a worker after a delay with millisecond resolution, with the priority its ID is
+   *        classified as
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * @param delay Delay before executing task
+   * 
+   * @return Handle to cancel the task with
+   */
+  TaskHandle DispatchTaskAfter(const std::string& taskId, TaskFunction task, std::chrono::milliseconds delay) {
+    return DispatchTaskAfter(taskId, std::move(task), delay, mGetTaskPriority(taskId));
+  }
+
+  /**
+   * @brief Execute a task on a worker without a task ID, so that dispatch and cancellation take no string copy or
+   *        lookup
+   *
+   * @param task Function to be executed
+   * @param priority Scheduling class
+   * 
+   * @return Handle to cancel the task with
+   */
+  TaskHandle Submit(TaskFunction task, TaskPriority priority = TaskPriority::Normal) {
+    auto created = Create(std::move(task), priority);
+    Push(created);
+    return created->handle;
+  }
+
+  /**
+   * @brief Execute a task on a worker after a delay with millisecond resolution, without a task ID
+   *
+   * @param task Function to be executed
+   * @param delay Delay before executing task
+   * @param priority Scheduling class once the delay elapsed
+   * 
+   * @return Handle to cancel the task with
+   * 
+   * @note A cancelled delayed task is released once its delay elapses.
+   */
+  TaskHandle SubmitAfter(
+      TaskFunction task,
+      std::chrono::milliseconds delay,
+      TaskPriority priority = TaskPriority::Normal) {
+    auto created = Create(std::move(task), priority);
+    PushAfter(created, delay);
+    return created->handle;
+  }
+
+  /**
+   * @brief Cancel a task that has not started, with one compare-and-swap
+   *
+   * @param handle Handle returned when the task was dispatched
+   * 
+   * @return True if the task was pending and will not run, else false
+   */
+  bool Cancel(const TaskHandle& handle) {
+    return mSlots->Transition(handle, taskhandle::Pending, taskhandle::Cancelled);
+  }
+
+  /**
+   * @brief Create an AsyncControl whose Cancel cancels a task by its handle
+   *
+   * @param handle Handle returned when the task was dispatched
+   * 
+   * @return AsyncControl that may outlive the dispatcher
+   */
+  std::shared_ptr<AsyncControl> CreateAsyncControl(const TaskHandle& handle) const {
+    return std::make_shared<TaskHandleAsyncControl>(mSlots, handle);
+  }
+
+  /**
+   * @brief Execute a task on a dedicated thread, for work that blocks for long periods
+   *
+   * @param taskId ID to uniquely identify a task
+   * @param task Function to be executed
+   * 
+   * @note Runs on an ElasticThreadPool bounded by independentThreads, so the task waits in its queue while
+   *       maxThreads independent tasks are running.
+   */
+  void ExecuteTaskOnIndependentThread(const std::string& /*taskId*/, std::function<void()> task) override {
+    mIndependentThreads.Execute(std::move(task));
+  }
+
+  /**
+   * @brief Cancel a task that has not started
+   *
+   * @param taskId ID of task to cancel
+   * 
+   * @return True if a pending task with this ID was cancelled, else false
+   */
+  bool CancelTask(const std::string& taskId) override {
+    Shard& shard = GetShard(taskId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bool isCancelled = false;
+    auto range = shard.tasks.equal_range(taskId);
+    for (auto entry = range.first; entry != range.second; ++entry) {
+      if (Cancel(entry->second->handle)) {
+        mTimers.Cancel(entry->second->timer);
+        isCancelled = true;
+      }
+    }
+    shard.tasks.erase(range.first, range.second);
+    return isCancelled;
+  }
+
+  /**
+   * @brief Cancel every task that has not started
+   */
+  void CancelAllTasks() override {
+    for (auto& shard : mShards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      for (auto& entry : shard.tasks) {
+        if (Cancel(entry.second->handle)) {
+          mTimers.Cancel(entry.second->timer);
+        }
+      }
+      shard.tasks.clear();
+    }
+    mSlots->CancelAll();
+  }
+
+  /**
+   * @brief Get the number of worker threads
+   */
+  size_t GetWorkerCount() const { return mWorkers.size(); }
+
+  /**
+   * @brief Get the number of tasks run so far
+   */
+  uint64_t GetExecutedCount() const { return mExecutedCount; }
+
+  /**
+   * @brief Get the number of tasks a worker took from another worker's deque
+   */
+  uint64_t GetStolenCount() const { return mStolenCount; }
+
+  /**
+   * @brief Get the number of tasks run ahead of higher classes because they waited longer than starvationTimeout
+   */
+  uint64_t GetPromotedCount() const { return mPromotedCount; }
+
+  /**
+   * @brief Get the saturation and thread counts of the pool running ExecuteTaskOnIndependentThread tasks
+   */
+  ElasticThreadPoolMetrics GetIndependentThreadMetrics() const { return mIndependentThreads.GetMetrics(); }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  static const size_t kShardCount = 16;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_multimap<std::string, std::shared_ptr<workstealing::Task>> tasks;
+  };
+
+  // Identifies the worker running on the current thread, if any
+  struct CurrentWorker {
+    const WorkStealingTaskDispatcher* dispatcher;
+    size_t index;
+  };
+
+  static CurrentWorker& GetCurrentWorker() {
+    static thread_local CurrentWorker currentWorker = {nullptr, 0};
+    return currentWorker;
+  }
+
+  Shard& GetShard(const std::string& taskId) { return mShards[std::hash<std::string>()(taskId) % kShardCount]; }
+
+  std::shared_ptr<workstealing::Task> Create(TaskFunction function, TaskPriority priority) {
+    auto task = std::make_shared<workstealing::Task>(mSlots.get());
+    task->function = std::move(function);
+    task->priority = (std::min)(static_cast<size_t>(priority), workstealing::kPriorityCount - 1);
+    return task;
+  }
+
+  std::shared_ptr<workstealing::Task> Register(
+      const std::string& taskId,
+      TaskFunction function,
+      TaskPriority priority) {
+    auto task = Create(std::move(function), priority);
+    task->id = taskId;
+    task->isNamed = true;
+    Shard& shard = GetShard(taskId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.tasks.emplace(taskId, task);
+    return task;
+  }
+
+  void Unregister(const std::shared_ptr<workstealing::Task>& task) {
+    if (!task->isNamed) {
+      return;
+    }
+    Shard& shard = GetShard(task->id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.tasks.equal_range(task->id);
+    for (auto entry = range.first; entry != range.second; ++entry) {
+      if (entry->second == task) {
+        shard.tasks.erase(entry);
+        break;
+      }
+    }
+  }
+
+  void Push(const std::shared_ptr<workstealing::Task>& task) {
+    const CurrentWorker& currentWorker = GetCurrentWorker();
+    task->queuedAt = std::chrono::steady_clock::now();
+    if (currentWorker.dispatcher == this) {
+      workstealing::WorkerQueue& queue = *mQueues[currentWorker.index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks[task->priority].push_back(task);
+    } else {
+      std::lock_guard<std::mutex> lock(mInjectionMutex);
+      mInjection[task->priority].push_back(task);
+    }
+    ++mPendingByPriority[task->priority];
+    ++mPendingCount;
+    if (mSleepingCount > 0) {
+      std::lock_guard<std::mutex> lock(mSleepMutex);
+      mWakeUp.notify_one();
+    }
+  }
+
+  // Returns the timer holding the task, if it is delayed
+  TimerHandle PushAfter(const std::shared_ptr<workstealing::Task>& task, std::chrono::milliseconds delay) {
+    if (delay.count() <= 0) {
+      Push(task);
+      return TimerHandle();
+    }
+    return mTimers.Schedule(delay, [this, task]() {
+      if (mSlots->IsPending(task->handle)) {
+        Push(task);
+      }
+    });
+  }
+
+  std::shared_ptr<workstealing::Task> Take(size_t index) {
+    std::shared_ptr<workstealing::Task> task;
+    // Starvation protection: the oldest task of a lower class that waited too long goes first
+    auto starvedBefore = std::chrono::steady_clock::now() - mStarvationTimeout;
+    for (size_t priority = workstealing::kPriorityCount - 1; priority > 0; --priority) {
+      if (mPendingByPriority[priority] > 0 && (task = TakeOldest(index, priority, &starvedBefore))) {
+        ++mPromotedCount;
+        return task;
+      }
+    }
+    for (size_t priority = 0; priority < workstealing::kPriorityCount; ++priority) {
+      if (mPendingByPriority[priority] == 0) {
+        continue;
+      }
+      {
+        workstealing::WorkerQueue& queue = *mQueues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        auto& tasks = queue.tasks[priority];
+        if (!tasks.empty()) {
+          task = std::move(tasks.back());
+          tasks.pop_back();
+          --mPendingByPriority[priority];
+          return task;
+        }
+      }
+      if ((task = TakeOldest(index, priority, nullptr))) {
+        return task;
+      }
+    }
+    return task;
+  }
+
+  // Takes from the front of the injection queue, then of the other workers' deques; with @p queuedBefore, only a task
+  // queued before that time
+  std::shared_ptr<workstealing::Task> TakeOldest(
+      size_t index,
+      size_t priority,
+      const std::chrono::steady_clock::time_point* queuedBefore) {
+    std::shared_ptr<workstealing::Task> task;
+    auto isEligible = [queuedBefore](const std::deque<std::shared_ptr<workstealing::Task>>& tasks) {
+      return !tasks.empty() && (!queuedBefore || tasks.front()->queuedAt < *queuedBefore);
+    };
+    {
+      std::lock_guard<std::mutex> lock(mInjectionMutex);
+      if (isEligible(mInjection[priority])) {
+        task = std::move(mInjection[priority].front());
+        mInjection[priority].pop_front();
+        --mPendingByPriority[priority];
+        return task;
+      }
+    }
+    for (size_t offset = queuedBefore ? 0 : 1; offset < mQueues.size(); ++offset) {
+      workstealing::WorkerQueue& victim = *mQueues[(index + offset) % mQueues.size()];
+      std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+      if (lock.owns_lock() && isEligible(victim.tasks[priority])) {
+        task = std::move(victim.tasks[priority].front());
+        victim.tasks[priority].pop_front();
+        --mPendingByPriority[priority];
+        if (offset != 0) {
+          ++mStolenCount;
+        }
+        return task;
+      }
+    }
+    return task;
+  }
+
+  void RunWorker(size_t index) {
+    GetCurrentWorker() = CurrentWorker{this, index};
+    if (mOnWorkerStart) {
+      try {
+        mOnWorkerStart(index);
+      } catch (...) {
+      }
+    }
+    while (!mIsStopping) {
+      std::shared_ptr<workstealing::Task> task = mPendingCount > 0 ? Take(index) : nullptr;
+      if (task) {
+        --mPendingCount;
+        if (mSlots->Transition(task->handle, taskhandle::Pending, taskhandle::Running)) {
+          Unregister(task);
+          try {
+            task->function();
+          } catch (...) {
+          }
+          ++mExecutedCount;
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mSleepMutex);
+      ++mSleepingCount;
+      mWakeUp.wait_for(lock, std::chrono::milliseconds(100), [this]() { return mPendingCount > 0 || mIsStopping; });
+      --mSleepingCount;
+    }
+  }
+
+  // Declared first so that it outlives every task, queued or held by a timer
+  std::shared_ptr<taskhandle::TaskSlots> mSlots;
+  std::vector<std::unique_ptr<workstealing::WorkerQueue>> mQueues;
+  std::vector<std::thread> mWorkers;
+  Shard mShards[kShardCount];
+  std::function<TaskPriority(const std::string&)> mGetTaskPriority;
+  std::chrono::steady_clock::duration mStarvationTimeout;
+  std::mutex mInjectionMutex;
+  std::deque<std::shared_ptr<workstealing::Task>> mInjection[workstealing::kPriorityCount];
+  std::atomic<int64_t> mPendingByPriority[workstealing::kPriorityCount];
+  std::mutex mSleepMutex;
+  std::condition_variable mWakeUp;
+  std::atomic<int64_t> mPendingCount;
+  std::atomic<int64_t> mSleepingCount;
+  std::atomic<uint64_t> mExecutedCount;
+  std::atomic<uint64_t> mStolenCount;
+  std::atomic<uint64_t> mPromotedCount;
+  std::atomic<bool> mIsStopping;
+  std::function<void(size_t)> mOnWorkerStart;
+  TimerWheel mTimers;
+  ElasticThreadPool mIndependentThreads;
+  /** @endcond */
+}; // class WorkStealingTaskDispatcher
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_WORK_STEALING_TASK_DISPATCHER_H_
@@ -0,0 +1,467 @@
+/*
+ *
+ * Copyright (c) Microsoft Corporation.
+ * All rights reserved.
+ *
+ * This code is licensed under the MIT License.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files(the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions :
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/**
+ * @brief Defines WriteBehindStorageDelegate, which journals storage table writes in memory and persists them in batches
+ * 
+ * @file write_behind_storage_delegate.h
+ */
+
+#ifndef API_MIP_WRITE_BEHIND_STORAGE_DELEGATE_H_
+#define API_MIP_WRITE_BEHIND_STORAGE_DELEGATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mip/error.h"
+#include "mip/mip_namespace.h"
+#include "mip/storage_delegate.h"
+#include "mip/storage_table.h"
+#include "mip/task_dispatcher_delegate.h"
+#include "mip/work_stealing_task_dispatcher.h"
+
+MIP_NAMESPACE_BEGIN
+
+/**
+ * @brief When writes through a WriteBehindStorageDelegate reach its inner delegate
+ */
+enum class WriteBehindDurability : unsigned int {
+  WriteThrough = 0, /**< Before the write returns */
+  Batched = 1,      /**< In a batch after WriteBehindStorageSettings::flushDelay; lost if the process dies first */
+};
+
+/**
+ * @brief Settings of a WriteBehindStorageDelegate
+ */
+struct WriteBehindStorageSettings {
+  /** When writes are persisted */
+  WriteBehindDurability durability = WriteBehindDurability::Batched;
+  /** Time from the first journaled write of a table to the flush that persists it */
+  std::chrono::milliseconds flushDelay = std::chrono::milliseconds(500);
+  /** Writes journaled per table before a writer flushes them on its own thread */
+  size_t maxPendingWrites = 10000;
+  /** Runs the flushes, a new std::thread per flush if not set */
+  std::shared_ptr<TaskDispatcherDelegate> taskDispatcher;
+};
+
+/** @cond DOXYGEN_HIDE */
+namespace writebehind {
+
+struct Counters {
+  std::atomic<uint64_t> pendingCount{0};
+  std::atomic<uint64_t> flushedCount{0};
+  std::atomic<uint64_t> failedCount{0};
+  std::mutex errorMutex;
+  std::exception_ptr lastError;
+};
+
+enum class OperationType { Insert, Update, Delete };
+
+struct Operation {
+  OperationType type;
+  std::vector<std::string> values; // inserted row
+  StorageTableUpdate update;       // update, or the query of a delete
+};
+
+// Journals writes and applies them to the inner table in order, one flush at a time. Reads flush the journal first,
+// so they see every earlier write.
+class Table : public TransactionalStorageTable,
+              public StorageTableCursorSource,
+              public std::enable_shared_from_this<Table> {
+public:
+  Table(const WriteBehindStorageSettings& settings, const std::shared_ptr<Counters>& counters)
+      : mSettings(settings),
+        mCounters(counters) {}
+
+  ~Table() {
+    try {
+      Flush();
+    } catch (...) {
+    }
+  }
+
+  // Persists the journal to the previous inner table, then points the table at a newly created one
+  void Reset(const std::shared_ptr<StorageTable>& inner) {
+    std::lock_guard<std::mutex> flushLock(mFlushMutex);
+    FlushLocked();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mInner = inner;
+  }
+
+  void Insert(const std::vector<std::string>& allColumnValues) override {
+    Operation operation{OperationType::Insert, allColumnValues, StorageTableUpdate()};
+    Enqueue(std::move(operation));
+  }
+
+  std::vector<std::vector<std::string>> List() override {
+    Flush();
+    return GetInner()->List();
+  }
+
+  void Update(
+      const std::vector<std::string>& updateColumns,
+      const std::vector<std::string>& updateValues,
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    Operation operation{
+        OperationType::Update, {}, StorageTableUpdate{updateColumns, updateValues, queryColumns, queryValues}};
+    Enqueue(std::move(operation));
+  }
+
+  void Delete(const std::vector<std::string>& queryColumns, const std::vector<std::string>& queryValues) override {
+    Operation operation{OperationType::Delete, {}, StorageTableUpdate{{}, {}, queryColumns, queryValues}};
+    Enqueue(std::move(operation));
+  }
+
+  std::vector<std::vector<std::string>> Find(
+      const std::vector<std::string>& queryColumns,
+      const std::vector<std::string>& queryValues) override {
+    Flush();
+    return GetInner()->Find(queryColumns, queryValues);
+  }
+
+  void InsertBatch(const std::vector<std::vector<std::string>>& rows) override {
+    for (const auto& row : rows) {
+      Insert(row);
+    }
+  }
+
+  void UpdateBatch(const std::vector<StorageTableUpdate>& updates) override {
+    for (const auto& update : updates) {
+      Update(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+    }
+  }
+
+  // A commit persists the journal, so it is durable once CommitTransaction returns
+  void CommitTransaction() override { Flush(); }
+
+  std::unique_ptr<StorageTableCursor> OpenCursor(const StorageTableQuery& query) override {
+    Flush();
+    return OpenStorageTableCursor(*GetInner(), query);
+  }
+
+  // Applies the journaled writes to the inner table. Failures are counted and do not stop later writes.
+  void Flush() {
+    std::lock_guard<std::mutex> flushLock(mFlushMutex);
+    FlushLocked();
+  }
+
+private:
+  std::shared_ptr<StorageTable> GetInner() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mInner;
+  }
+
+  void Enqueue(Operation&& operation) {
+    if (mSettings.durability == WriteBehindDurability::WriteThrough) {
+      std::lock_guard<std::mutex> flushLock(mFlushMutex);
+      FlushLocked();
+      ApplyOne(*GetInner(), operation);
+      return;
+    }
+    bool isFull = false;
+    bool isScheduling = false;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mJournal.push_back(std::move(operation));
+      ++mCounters->pendingCount;
+      isFull = mJournal.size() >= mSettings.maxPendingWrites;
+      isScheduling = !isFull && !mIsFlushScheduled;
+      mIsFlushScheduled = mIsFlushScheduled || isScheduling;
+    }
+    if (isFull) {
+      Flush();
+    } else if (isScheduling) {
+      ScheduleFlush();
+    }
+  }
+
+  void ScheduleFlush() {
+    std::weak_ptr<Table> weakTable = shared_from_this();
+    auto flush = [weakTable]() {
+      std::shared_ptr<Table> table = weakTable.lock();
+      if (table) {
+        table->Flush();
+      }
+    };
+    if (mSettings.taskDispatcher) {
+      static std::atomic<uint64_t> sTaskCounter(0);
+      std::string taskId = "mip-storage-flush-" + std::to_string(++sTaskCounter);
+      auto workStealing = std::dynamic_pointer_cast<WorkStealingTaskDispatcher>(mSettings.taskDispatcher);
+      if (workStealing) {
+        workStealing->DispatchTaskAfter(taskId, flush, mSettings.flushDelay);
+      } else {
+        mSettings.taskDispatcher->DispatchTask(taskId, flush, (mSettings.flushDelay.count() + 999) / 1000);
+      }
+    } else {
+      std::chrono::milliseconds delay = mSettings.flushDelay;
+      std::thread([flush, delay]() {
+        std::this_thread::sleep_for(delay);
+        flush();
+      }).detach();
+    }
+  }
+
+  void FlushLocked() {
+    std::vector<Operation> operations;
+    std::shared_ptr<StorageTable> inner;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      operations.swap(mJournal);
+      mIsFlushScheduled = false;
+      inner = mInner;
+    }
+    if (!operations.empty() && inner) {
+      Apply(*inner, operations);
+    }
+    mCounters->pendingCount -= operations.size();
+  }
+
+  static void ApplyOne(StorageTable& inner, const Operation& operation) {
+    if (operation.type == OperationType::Insert) {
+      inner.Insert(operation.values);
+    } else if (operation.type == OperationType::Update) {
+      const StorageTableUpdate& update = operation.update;
+      inner.Update(update.updateColumns, update.updateValues, update.queryColumns, update.queryValues);
+    } else {
+      inner.Delete(operation.update.queryColumns, operation.update.queryValues);
+    }
+  }
+
+  // Applies runs of inserts and updates as batches, all in one transaction of the inner table. A run that fails is
+  // applied again one write at a time, which inserts and updates keyed by their values tolerate, so only the failing
+  // writes are lost.
+  void Apply(StorageTable& inner, const std::vector<Operation>& operations) {
+    StorageTableTransaction transaction(inner);
+    size_t begin = 0;
+    while (begin < operations.size()) {
+      size_t end = begin + 1;
+      while (end < operations.size() && operations[end].type == operations[begin].type &&
+             operations[begin].type != OperationType::Delete) {
+        ++end;
+      }
+      try {
+        if (operations[begin].type == OperationType::Insert) {
+          std::vector<std::vector<std::string>> rows;
+          for (size_t i = begin; i < end; ++i) {
+            rows.push_back(operations[i].values);
+          }
+          InsertRows(inner, rows);
+        } else if (operations[begin].type == OperationType::Update) {
+          std::vector<StorageTableUpdate> updates;
+          for (size_t i = begin; i < end; ++i) {
+            updates.push_back(operations[i].update);
+          }
+          UpdateRows(inner, updates);
+        } else {
+          ApplyOne(inner, operations[begin]);
+        }
+        mCounters->flushedCount += end - begin;
+      } catch (...) {
+        if (end - begin == 1) {
+          Fail(std::current_exception());
+        } else {
+          for (size_t i = begin; i < end; ++i) {
+            try {
+              ApplyOne(inner, operations[i]);
+              ++mCounters->flushedCount;
+            } catch (...) {
+              Fail(std::current_exception());
+            }
+          }
+        }
+      }
+      begin = end;
+    }
+    try {
+      transaction.Commit();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mCounters->errorMutex);
+      mCounters->lastError = std::current_exception();
+    }
+  }
+
+  void Fail(const std::exception_ptr& error) {
+    ++mCounters->failedCount;
+    std::lock_guard<std::mutex> lock(mCounters->errorMutex);
+    mCounters->lastError = error;
+  }
+
+  const WriteBehindStorageSettings mSettings;
+  const std::shared_ptr<Counters> mCounters;
+  std::mutex mFlushMutex; // held across a flush so batches reach the inner table in order
+  std::mutex mMutex;
+  std::shared_ptr<StorageTable> mInner;
+  std::vector<Operation> mJournal;
+  bool mIsFlushScheduled = false;
+};
+
+} // namespace writebehind
+/** @endcond */
+
+/**
+ * @brief StorageDelegate that takes the latency of the storage it wraps out of the SDK's write path
+ * 
+ * @note With WriteBehindDurability::Batched, Insert, Update and Delete append to an in-memory journal and return. A
+ *       flush dispatched on WriteBehindStorageSettings::taskDispatcher applies each table's journal flushDelay later,
+ *       with runs of inserts and updates passed to InsertRows and UpdateRows inside one StorageTableTransaction. A
+ *       writer that finds maxPendingWrites journaled flushes them itself. Find, List and cursors flush the table's
+ *       journal first, so reads always see earlier writes, and CommitTransaction persists it. Writes that fail
+ *       when flushed are counted and reported by GetLastFlushError; they are not retried. Call Flush before
+ *       MipContext::ShutDown; the delegate, and each table, also flush when destroyed.
+ */
+class WriteBehindStorageDelegate : public StorageDelegate {
+public:
+  /**
+   * @brief WriteBehindStorageDelegate constructor
+   * 
+   * @param inner Delegate persisting the writes
+   * @param settings Durability and flush scheduling
+   */
+  explicit WriteBehindStorageDelegate(
+      const std::shared_ptr<StorageDelegate>& inner,
+      const WriteBehindStorageSettings& settings = WriteBehindStorageSettings())
+      : mInner(inner),
+        mSettings(settings),
+        mCounters(std::make_shared<writebehind::Counters>()) {
+    if (!inner) {
+      throw BadInputError("WriteBehindStorageDelegate requires an inner StorageDelegate");
+    }
+  }
+
+  /** @cond DOXYGEN_HIDE */
+  ~WriteBehindStorageDelegate() { Flush(); }
+  /** @endcond */
+
+  /**
+   * @brief Create the table with the inner delegate and journal its writes
+   * 
+   * @param path Default path for mip storage.
+   * @param mipComponent #MipComponent associated with this table.
+   * @param tableName Name of the table to create.
+   * @param allColumns All columns represented in the table.
+   * @param encryptedColumns Columns within @p allColumns that need to be encrypted, passed to the inner delegate
+   * @param keyColumns Key columns used to identify unique table entries.
+   * 
+   * @return The table, or the error of the inner delegate
+   * 
+   * @note Tables created more than once share their journal. Writes journaled before the table is created again are
+   *       flushed to the previous inner table first.
+   */
+  StorageTableResult CreateStorageTable(
+      const std::string& path,
+      const MipComponent mipComponent,
+      const std::string& tableName,
+      const std::vector<std::string>& allColumns,
+      const std::vector<std::string>& encryptedColumns,
+      const std::vector<std::string>& keyColumns) const override {
+    std::string key = std::to_string(static_cast<unsigned int>(mipComponent)) + '\n' + path + '\n' + tableName;
+    std::shared_ptr<writebehind::Table> table;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      std::shared_ptr<writebehind::Table>& slot = mTables[key];
+      if (!slot) {
+        slot = std::make_shared<writebehind::Table>(mSettings, mCounters);
+      }
+      table = slot;
+    }
+    // The inner table may be dropped and recreated, so pending writes for its old schema go first
+    table->Flush();
+    StorageTableResult inner =
+        mInner->CreateStorageTable(path, mipComponent, tableName, allColumns, encryptedColumns, keyColumns);
+    if (inner.GetError()) {
+      return inner;
+    }
+    table->Reset(inner.GetData());
+    return StorageTableResult(table);
+  }
+
+  /**
+   * @brief Gets the settings of the inner delegate
+   */
+  StorageSettings GetSettings() const override { return mInner->GetSettings(); }
+
+  /**
+   * @brief Persist the journaled writes of every table, blocking until they reached the inner delegate
+   */
+  void Flush() const {
+    std::vector<std::shared_ptr<writebehind::Table>> tables;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (const auto& table : mTables) {
+        tables.push_back(table.second);
+      }
+    }
+    for (const auto& table : tables) {
+      table->Flush();
+    }
+  }
+
+  /**
+   * @brief Get the number of writes journaled and not yet flushed
+   */
+  uint64_t GetPendingWriteCount() const { return mCounters->pendingCount; }
+
+  /**
+   * @brief Get the number of journaled writes applied to the inner delegate
+   */
+  uint64_t GetFlushedWriteCount() const { return mCounters->flushedCount; }
+
+  /**
+   * @brief Get the number of journaled writes the inner delegate failed
+   */
+  uint64_t GetFailedWriteCount() const { return mCounters->failedCount; }
+
+  /**
+   * @brief Get the last error of a flush, nullptr if none failed
+   */
+  std::exception_ptr GetLastFlushError() const {
+    std::lock_guard<std::mutex> lock(mCounters->errorMutex);
+    return mCounters->lastError;
+  }
+
+  /** @cond DOXYGEN_HIDE */
+private:
+  const std::shared_ptr<StorageDelegate> mInner;
+  const WriteBehindStorageSettings mSettings;
+  const std::shared_ptr<writebehind::Counters> mCounters;
+  mutable std::mutex mMutex;
+  mutable std::map<std::string, std::shared_ptr<writebehind::Table>> mTables;
+  /** @endcond */
+};
+
+MIP_NAMESPACE_END
+
+#endif // API_MIP_WRITE_BEHIND_STORAGE_DELEGATE_H_